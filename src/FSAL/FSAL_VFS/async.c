@@ -0,0 +1,571 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/async.c
+ * @brief Asynchronous read/write engines for VFS
+ *
+ * Two engines are provided.  The "threads" engine hands each I/O to a small
+ * pool of I/O threads that do the pread/pwrite, so a worker thread is not
+ * held for the duration of the disk access.  The "io_uring" engine (only
+ * when built with liburing) submits reads to a kernel ring and reaps
+ * completions from a single thread.  Writes always go to the I/O threads,
+ * which take on the caller's credentials for them; the ring would do them
+ * as the server, bypassing the caller's quota and permissions.
+ *
+ * In both cases the submitting thread finds a file descriptor exactly like
+ * vfs_read2/vfs_write2 do, and if that fd is the shared one on the object,
+ * dups it so that the object lock can be dropped before the I/O is queued.
+ * The I/O then owns its fd and closes it on completion.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/access_check.h"
+#include "fridgethr.h"
+#include "vfs_methods.h"
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+/**
+ * @brief An asynchronous I/O in flight
+ */
+struct vfs_async_io {
+	struct fsal_obj_handle *obj_hdl; /*< Object the I/O is for */
+	struct fsal_io_arg *io_arg;	/*< Caller's arguments and results */
+	fsal_async_cb done_cb;		/*< Caller's completion callback */
+	void *caller_arg;		/*< Argument for done_cb */
+	int fd;				/*< fd owned by this I/O */
+	bool is_write;			/*< Write rather than read */
+	struct user_cred creds;		/*< Caller credentials for writes */
+};
+
+static struct vfs_async_params async_params;
+static struct fridgethr *vfs_io_fridge;
+
+#ifdef USE_IO_URING
+static struct io_uring vfs_ring;
+static pthread_mutex_t vfs_ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t vfs_ring_reaper;
+static bool vfs_ring_running;
+
+/* User data of an SQE whose submission failed and was made a NOP */
+static char vfs_ring_dropped;
+#endif
+
+/**
+ * @brief Finish an asynchronous I/O and invoke the caller's callback
+ *
+ * @param[in] io      The I/O
+ * @param[in] status  Final status
+ */
+static void vfs_async_done(struct vfs_async_io *io, fsal_status_t status)
+{
+	struct fsal_obj_handle *obj_hdl = io->obj_hdl;
+	struct fsal_io_arg *io_arg = io->io_arg;
+	fsal_async_cb done_cb = io->done_cb;
+	void *caller_arg = io->caller_arg;
+
+	close(io->fd);
+	gsh_free(io);
+
+	done_cb(obj_hdl, status, io_arg, caller_arg);
+}
+
+/**
+ * @brief Perform an I/O synchronously on the current thread
+ *
+ * Used by the threads engine, and by the io_uring engine for writes and
+ * when a read cannot be submitted to the ring.
+ *
+ * @param[in] io      The I/O
+ */
+static void vfs_async_do_io(struct vfs_async_io *io)
+{
+	struct fsal_io_arg *io_arg = io->io_arg;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	ssize_t nb;
+	int retval;
+
+	if (io->is_write) {
+		fsal_set_credentials(&io->creds);
+
+		nb = pwrite(io->fd, io_arg->buffer, io_arg->io_request,
+			    io_arg->offset);
+
+		if (nb == -1) {
+			retval = errno;
+			status = fsalstat(posix2fsal_error(retval), retval);
+		} else {
+			io_arg->io_amount = nb;
+
+			if (io_arg->fsal_stable && fsync(io->fd) == -1) {
+				retval = errno;
+				status = fsalstat(posix2fsal_error(retval),
+						  retval);
+			}
+		}
+
+		fsal_restore_ganesha_credentials();
+	} else {
+		nb = pread(io->fd, io_arg->buffer, io_arg->io_request,
+			   io_arg->offset);
+
+		if (nb == -1) {
+			retval = errno;
+			status = fsalstat(posix2fsal_error(retval), retval);
+		} else {
+			io_arg->io_amount = nb;
+			io_arg->end_of_file = (nb == 0);
+		}
+	}
+
+	vfs_async_done(io, status);
+}
+
+/**
+ * @brief I/O thread body for the threads engine
+ *
+ * @param[in] ctx  Thread context; ctx->arg is the I/O
+ */
+static void vfs_async_thread_io(struct fridgethr_context *ctx)
+{
+	vfs_async_do_io(ctx->arg);
+}
+
+#ifdef USE_IO_URING
+/**
+ * @brief Process one completion queue entry
+ *
+ * @param[in] cqe  The entry, for a read
+ */
+static void vfs_uring_complete(struct io_uring_cqe *cqe)
+{
+	struct vfs_async_io *io = io_uring_cqe_get_data(cqe);
+	struct fsal_io_arg *io_arg = io->io_arg;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+	if (cqe->res < 0) {
+		status = fsalstat(posix2fsal_error(-cqe->res), -cqe->res);
+	} else {
+		io_arg->io_amount = cqe->res;
+		io_arg->end_of_file = (cqe->res == 0);
+	}
+
+	vfs_async_done(io, status);
+}
+
+/**
+ * @brief Completion reaper thread for the io_uring engine
+ *
+ * @param[in] arg  Unused
+ *
+ * @return NULL
+ */
+static void *vfs_uring_reaper(void *arg)
+{
+	struct io_uring_cqe *cqe;
+	int rc;
+
+	SetNameFunction("vfs_uring");
+
+	while (true) {
+		rc = io_uring_wait_cqe(&vfs_ring, &cqe);
+
+		if (rc == -EINTR)
+			continue;
+
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"io_uring_wait_cqe failed: %s", strerror(-rc));
+			break;
+		}
+
+		/* A NULL user data entry is the shutdown NOP */
+		if (io_uring_cqe_get_data(cqe) == NULL) {
+			io_uring_cqe_seen(&vfs_ring, cqe);
+			break;
+		}
+
+		if (io_uring_cqe_get_data(cqe) != &vfs_ring_dropped)
+			vfs_uring_complete(cqe);
+		io_uring_cqe_seen(&vfs_ring, cqe);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Queue a read to the ring
+ *
+ * @param[in] io  The I/O, a read
+ *
+ * @return true if queued, false if the ring was full or would not take it.
+ */
+static bool vfs_uring_submit(struct vfs_async_io *io)
+{
+	struct fsal_io_arg *io_arg = io->io_arg;
+	struct io_uring_sqe *sqe;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&vfs_ring_mutex);
+
+	sqe = io_uring_get_sqe(&vfs_ring);
+	if (sqe == NULL) {
+		PTHREAD_MUTEX_unlock(&vfs_ring_mutex);
+		return false;
+	}
+
+	io_uring_prep_read(sqe, io->fd, io_arg->buffer,
+			   io_arg->io_request, io_arg->offset);
+	io_uring_sqe_set_data(sqe, io);
+
+	rc = io_uring_submit(&vfs_ring);
+	if (rc <= 0) {
+		/* The kernel took nothing, but the entry is already in the
+		 * ring and goes with the next submission; make that a NOP
+		 * the reaper ignores, and let the caller do the read.
+		 */
+		io_uring_prep_nop(sqe);
+		io_uring_sqe_set_data(sqe, &vfs_ring_dropped);
+		PTHREAD_MUTEX_unlock(&vfs_ring_mutex);
+		LogDebug(COMPONENT_FSAL,
+			 "io_uring_submit failed (%s)",
+			 strerror(rc < 0 ? -rc : EAGAIN));
+		return false;
+	}
+
+	PTHREAD_MUTEX_unlock(&vfs_ring_mutex);
+
+	return true;
+}
+#endif /* USE_IO_URING */
+
+/**
+ * @brief Initialize the asynchronous I/O engine
+ *
+ * @param[in] params  Engine configuration
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int vfs_async_init(const struct vfs_async_params *params)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	async_params = *params;
+
+#ifdef USE_IO_URING
+	if (async_params.engine == VFS_ASYNC_IO_URING) {
+		rc = io_uring_queue_init(async_params.queue_depth,
+					 &vfs_ring, 0);
+		if (rc < 0) {
+			LogWarn(COMPONENT_FSAL,
+				"io_uring unavailable (%s), falling back to I/O threads",
+				strerror(-rc));
+			async_params.engine = VFS_ASYNC_THREADS;
+		} else {
+			rc = pthread_create(&vfs_ring_reaper, NULL,
+					    vfs_uring_reaper, NULL);
+			if (rc != 0) {
+				LogCrit(COMPONENT_FSAL,
+					"Could not start io_uring reaper: %d",
+					rc);
+				io_uring_queue_exit(&vfs_ring);
+				async_params.engine = VFS_ASYNC_NONE;
+				return rc;
+			}
+			vfs_ring_running = true;
+		}
+	}
+#else
+	if (async_params.engine == VFS_ASYNC_IO_URING) {
+		LogWarn(COMPONENT_FSAL,
+			"Built without io_uring support, using I/O threads");
+		async_params.engine = VFS_ASYNC_THREADS;
+	}
+#endif
+
+	/* The thread pool also backs the io_uring engine, for writes and
+	 * for reads the ring cannot take.
+	 */
+	if (async_params.engine == VFS_ASYNC_NONE)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = async_params.threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&vfs_io_fridge, "VFS_IO", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize VFS I/O thread fridge: %d", rc);
+		vfs_async_shutdown();
+		async_params.engine = VFS_ASYNC_NONE;
+		return rc;
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"VFS asynchronous I/O engine %s, %u threads, queue depth %u",
+		async_params.engine == VFS_ASYNC_IO_URING
+			? "io_uring" : "threads",
+		async_params.threads, async_params.queue_depth);
+
+	return 0;
+}
+
+/**
+ * @brief Shut down the asynchronous I/O engine
+ *
+ * Outstanding I/O is allowed to complete.
+ */
+void vfs_async_shutdown(void)
+{
+	int rc;
+
+#ifdef USE_IO_URING
+	if (vfs_ring_running) {
+		struct io_uring_sqe *sqe;
+
+		/* Queue a NOP with no data to tell the reaper to exit; it
+		 * completes after everything already submitted.
+		 */
+		PTHREAD_MUTEX_lock(&vfs_ring_mutex);
+		sqe = io_uring_get_sqe(&vfs_ring);
+		if (sqe != NULL) {
+			sqe->flags |= IOSQE_IO_DRAIN;
+			io_uring_prep_nop(sqe);
+			io_uring_sqe_set_data(sqe, NULL);
+			rc = io_uring_submit(&vfs_ring);
+			if (rc <= 0) {
+				LogMajor(COMPONENT_FSAL,
+					 "Could not stop io_uring reaper (%s)",
+					 strerror(rc < 0 ? -rc : EAGAIN));
+				sqe = NULL;
+			}
+		}
+		PTHREAD_MUTEX_unlock(&vfs_ring_mutex);
+
+		if (sqe != NULL)
+			pthread_join(vfs_ring_reaper, NULL);
+		else
+			pthread_cancel(vfs_ring_reaper);
+
+		io_uring_queue_exit(&vfs_ring);
+		vfs_ring_running = false;
+	}
+#endif
+
+	if (vfs_io_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(vfs_io_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(vfs_io_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down VFS I/O threads: %d", rc);
+	}
+
+	fridgethr_destroy(vfs_io_fridge);
+	vfs_io_fridge = NULL;
+}
+
+/**
+ * @brief Common submission path for asynchronous reads and writes
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         Bypass share reservation
+ * @param[in,out] io_arg         Arguments and results of the I/O
+ * @param[in]     is_write       Write rather than read
+ * @param[in]     done_cb        Completion callback
+ * @param[in]     caller_arg     Argument for done_cb
+ */
+static void vfs_async_submit(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct fsal_io_arg *io_arg,
+			     bool is_write,
+			     fsal_async_cb done_cb,
+			     void *caller_arg)
+{
+	struct vfs_async_io *io;
+	fsal_status_t status;
+	int my_fd = -1;
+	bool has_lock = false;
+	bool closefd = false;
+	int rc;
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		done_cb(obj_hdl, fsalstat(posix2fsal_error(EXDEV), EXDEV),
+			io_arg, caller_arg);
+		return;
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			 is_write ? FSAL_O_WRITE : FSAL_O_READ,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		if (closefd)
+			close(my_fd);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return;
+	}
+
+	if (!closefd) {
+		/* Shared fd; take our own reference to the open file so the
+		 * object lock need not be held across the I/O.
+		 */
+		rc = dup(my_fd);
+		if (rc < 0) {
+			rc = errno;
+			if (has_lock)
+				PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+			done_cb(obj_hdl, fsalstat(posix2fsal_error(rc), rc),
+				io_arg, caller_arg);
+			return;
+		}
+		my_fd = rc;
+	}
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	io = gsh_malloc(sizeof(*io));
+	io->obj_hdl = obj_hdl;
+	io->io_arg = io_arg;
+	io->done_cb = done_cb;
+	io->caller_arg = caller_arg;
+	io->fd = my_fd;
+	io->is_write = is_write;
+	if (is_write)
+		io->creds = *op_ctx->creds;
+
+#ifdef USE_IO_URING
+	/* Writes need the caller's credentials, which only the I/O
+	 * threads take on.
+	 */
+	if (async_params.engine == VFS_ASYNC_IO_URING && !is_write &&
+	    vfs_uring_submit(io))
+		return;
+#endif
+
+	rc = fridgethr_submit(vfs_io_fridge, vfs_async_thread_io, io);
+
+	if (rc != 0) {
+		/* Could not queue it; do it here rather than fail it. */
+		LogDebug(COMPONENT_FSAL,
+			 "Unable to queue I/O (%d), doing it inline", rc);
+		vfs_async_do_io(io);
+	}
+}
+
+/**
+ * @brief Read data from a file asynchronously
+ *
+ * Falls back to a synchronous vfs_read2 when no engine is configured or
+ * when READ_PLUS information is requested.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in,out] read_arg       Arguments and results of the read
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for done_cb
+ */
+
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     struct fsal_io_arg *read_arg,
+		     fsal_async_cb done_cb,
+		     void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (async_params.engine != VFS_ASYNC_NONE && read_arg->info == NULL) {
+		vfs_async_submit(obj_hdl, bypass, read_arg, false,
+				 done_cb, caller_arg);
+		return;
+	}
+
+	status = vfs_read2(obj_hdl, bypass, read_arg->state, read_arg->offset,
+			   read_arg->io_request, read_arg->buffer,
+			   &read_arg->io_amount, &read_arg->end_of_file,
+			   read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/**
+ * @brief Write data to a file asynchronously
+ *
+ * Falls back to a synchronous vfs_write2 when no engine is configured or
+ * when WRITE_PLUS information is passed.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in,out] write_arg      Arguments and results of the write
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for done_cb
+ */
+
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      struct fsal_io_arg *write_arg,
+		      fsal_async_cb done_cb,
+		      void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (async_params.engine != VFS_ASYNC_NONE &&
+	    write_arg->info == NULL) {
+		vfs_async_submit(obj_hdl, bypass, write_arg, true,
+				 done_cb, caller_arg);
+		return;
+	}
+
+	status = vfs_write2(obj_hdl, bypass, write_arg->state,
+			    write_arg->offset, write_arg->io_request,
+			    write_arg->buffer, &write_arg->io_amount,
+			    &write_arg->fsal_stable, write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
@@ -101,6 +101,7 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	} else if (hdl->obj_handle.type == DIRECTORY) {
 		hdl->u.directory.path = NULL;
 		hdl->u.directory.fs_location = NULL;
+		hdl->u.directory.readdir_fd = -1;
 	} else if (hdl->obj_handle.type == SYMBOLIC_LINK) {
 		ssize_t retlink;
 		size_t len = stat->st_size + 1;
@@ -160,24 +161,38 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	return NULL;
 }
 
-static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
-				    int dirfd, const char *path,
-				    struct fsal_obj_handle **handle,
-				    struct attrlist *attrs_out)
+/**
+ * @brief Stat a name in a directory and find its handle
+ *
+ * This is the part of a lookup that only makes system calls, so it may
+ * be done on any thread; read_dirents runs it for several entries at
+ * once.  vfs_lookup_finish makes the object handle from the results.
+ *
+ * @param[in]  parent_hdl Directory holding the name
+ * @param[in]  dirfd      FD for the directory
+ * @param[in]  path       Name to look up
+ * @param[out] stat       stat(2) results for the name
+ * @param[out] fs_out     FileSystem holding the object
+ * @param[out] fh         VFS FH for the object
+ *
+ * @return FSAL status.
+ */
+fsal_status_t vfs_lookup_prefetch(struct vfs_fsal_obj_handle *parent_hdl,
+				  int dirfd, const char *path,
+				  struct stat *stat,
+				  struct fsal_filesystem **fs_out,
+				  vfs_file_handle_t *fh)
 {
-	struct vfs_fsal_obj_handle *hdl;
-	int retval, fd;
-	struct stat stat;
-	vfs_file_handle_t *fh = NULL;
+	int retval;
 	fsal_dev_t dev;
 	struct fsal_filesystem *fs;
 	bool xfsal = false;
 	fsal_status_t status;
-	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
 
-	vfs_alloc_handle(fh);
+	memset(fh, 0, sizeof(*fh));
+	fh->handle_len = VFS_HANDLE_LEN;
 
-	retval = fstatat(dirfd, path, &stat, AT_SYMLINK_NOFOLLOW);
+	retval = fstatat(dirfd, path, stat, AT_SYMLINK_NOFOLLOW);
 
 	if (retval < 0) {
 		retval = errno;
@@ -187,7 +202,7 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 		return status;
 	}
 
-	dev = posix2fsal_devt(stat.st_dev);
+	dev = posix2fsal_devt(stat->st_dev);
 
 	fs = parent_hdl->obj_handle.fs;
 	if ((dev.minor != parent_hdl->dev.minor) ||
@@ -257,8 +272,39 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 		}
 	}
 
+	*fs_out = fs;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Make the object handle for a name looked up in a directory
+ *
+ * @param[in]  parent_hdl Directory holding the name
+ * @param[in]  dirfd      FD for the directory
+ * @param[in]  path       Name looked up
+ * @param[in]  stat       stat(2) results from vfs_lookup_prefetch
+ * @param[in]  fs         FileSystem from vfs_lookup_prefetch
+ * @param[in]  fh         VFS FH from vfs_lookup_prefetch
+ * @param[out] handle     The new handle
+ * @param[out] attrs_out  Optional attributes for the object
+ *
+ * @return FSAL status.
+ */
+fsal_status_t vfs_lookup_finish(struct vfs_fsal_obj_handle *parent_hdl,
+				int dirfd, const char *path,
+				struct stat *stat,
+				struct fsal_filesystem *fs,
+				vfs_file_handle_t *fh,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out)
+{
+	struct vfs_fsal_obj_handle *hdl;
+	int fd;
+	fsal_status_t status;
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+
 	/* allocate an obj_handle and fill it up */
-	hdl = alloc_handle(dirfd, fh, fs, &stat, parent_hdl->handle, path,
+	hdl = alloc_handle(dirfd, fh, fs, stat, parent_hdl->handle, path,
 			   op_ctx->fsal_export);
 
 	if (hdl == NULL) {
@@ -267,7 +313,7 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	}
 
 	if (attrs_out != NULL) {
-		posix2fsal_attributes_all(&stat, attrs_out);
+		posix2fsal_attributes_all(stat, attrs_out);
 	}
 
 	/* if it is a directory and the sticky bit is set
@@ -381,6 +427,27 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
+				    int dirfd, const char *path,
+				    struct fsal_obj_handle **handle,
+				    struct attrlist *attrs_out)
+{
+	struct stat stat;
+	vfs_file_handle_t *fh = NULL;
+	struct fsal_filesystem *fs;
+	fsal_status_t status;
+
+	vfs_alloc_handle(fh);
+
+	status = vfs_lookup_prefetch(parent_hdl, dirfd, path, &stat, &fs, fh);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	return vfs_lookup_finish(parent_hdl, dirfd, path, &stat, fs, fh,
+				 handle, attrs_out);
+}
+
 /* handle methods
  */
 
@@ -1160,6 +1227,14 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
  * read_dirents
  * read the directory and call through the callback function for
  * each entry.
+ *
+ * Entries are gathered in batches of Readdir_Batch; the stat and handle
+ * of each entry in a batch are fetched at once by the readdir threads,
+ * and the entries are then passed to the callback in cookie order.
+ * Entries read past the one the callback stops at are thrown away; the
+ * next call seeks back to them.  The directory fd is kept on the handle
+ * for the next call.
+ *
  * @param dir_hdl [IN] the directory to read
  * @param whence [IN] where to start (next)
  * @param dir_state [IN] pass thru of state to callback
@@ -1178,10 +1253,13 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	int retval = 0;
 	off_t seekloc = 0;
 	off_t baseloc = 0;
-	unsigned int bpos;
-	int nread;
+	unsigned int bpos = 0;
+	int nread = 0;
 	struct vfs_dirent dentry, *dentryp = &dentry;
 	char buf[BUF_SIZE];
+	struct vfs_readdir_entry one, *entries = &one, *ent;
+	uint32_t batch, count, ix;
+	bool end = false;
 
 	if (whence != NULL)
 		seekloc = (off_t) *whence;
@@ -1197,7 +1275,7 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		status = posix2fsal_status(retval);
 		goto out;
 	}
-	dirfd = vfs_fsal_open(myself, O_RDONLY | O_DIRECTORY, &status.major);
+	dirfd = vfs_readdir_fd_get(myself, &status.major);
 	if (dirfd < 0) {
 		retval = -dirfd;
 		status = posix2fsal_status(retval);
@@ -1207,57 +1285,91 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	if (seekloc < 0) {
 		retval = errno;
 		status = posix2fsal_status(retval);
-		goto done;
-	}
+		goto bad_fd;
+	}
+
+	batch = vfs_readdir_batch();
+	if (batch > 1)
+		entries = gsh_malloc(batch * sizeof(*entries));
+
+	while (!end) {
+		/* Gather a batch of entries */
+		for (count = 0; count < batch;) {
+			if (bpos >= nread) {
+				baseloc = seekloc;
+				nread = vfs_readents(dirfd, buf, BUF_SIZE,
+						     &seekloc);
+				if (nread < 0) {
+					retval = errno;
+					status = posix2fsal_status(retval);
+					goto bad_fd;
+				}
+				bpos = 0;
+				if (nread == 0) {
+					end = true;
+					break;
+				}
+			}
 
-	do {
-		baseloc = seekloc;
-		nread = vfs_readents(dirfd, buf, BUF_SIZE, &seekloc);
-		if (nread < 0) {
-			retval = errno;
-			status = posix2fsal_status(retval);
-			goto done;
+			if (to_vfs_dirent(buf, bpos, dentryp, baseloc)
+			    && strcmp(dentryp->vd_name, ".") != 0
+			    && strcmp(dentryp->vd_name, "..") != 0) {
+				/* must skip '.' and '..' */
+				ent = &entries[count++];
+				(void) strlcpy(ent->name, dentryp->vd_name,
+					       sizeof(ent->name));
+				ent->cookie = (fsal_cookie_t) dentryp->vd_offset;
+			}
+
+			bpos += dentryp->vd_reclen;
 		}
-		if (nread == 0)
-			break;
-		for (bpos = 0; bpos < nread;) {
+
+		vfs_readdir_prefetch(myself, dirfd, entries, count);
+
+		for (ix = 0; ix < count; ix++) {
 			struct fsal_obj_handle *hdl;
 			struct attrlist attrs;
 			enum fsal_dir_result cb_rc;
 
-			if (!to_vfs_dirent(buf, bpos, dentryp, baseloc)
-			    || strcmp(dentryp->vd_name, ".") == 0
-			    || strcmp(dentryp->vd_name, "..") == 0)
-				goto skip;	/* must skip '.' and '..' */
+			ent = &entries[ix];
+			status = ent->status;
+
+			if (FSAL_IS_ERROR(status))
+				goto done;
 
 			fsal_prepare_attrs(&attrs, attrmask);
 
-			status = lookup_with_fd(myself, dirfd, dentryp->vd_name,
-					&hdl, &attrs);
+			status = vfs_lookup_finish(myself, dirfd, ent->name,
+						   &ent->stat, ent->fs,
+						   &ent->fh, &hdl, &attrs);
 
-			if (FSAL_IS_ERROR(status)) {
+			if (FSAL_IS_ERROR(status))
 				goto done;
-			}
 
 			/* callback to cache inode */
-			cb_rc = cb(dentryp->vd_name, hdl, &attrs, dir_state,
-				(fsal_cookie_t) dentryp->vd_offset);
+			cb_rc = cb(ent->name, hdl, &attrs, dir_state,
+				   ent->cookie);
 
 			fsal_release_attrs(&attrs);
 
 			/* Read ahead not supported by this FSAL. */
 			if (cb_rc >= DIR_READAHEAD)
 				goto done;
-
- skip:
-			bpos += dentryp->vd_reclen;
 		}
-	} while (nread > 0);
+	}
 
 	*eof = true;
  done:
+	vfs_readdir_fd_put(myself, dirfd);
+	goto out_free;
+
+ bad_fd:
 	close(dirfd);
 
+ out_free:
+	if (entries != &one)
+		gsh_free(entries);
+
  out:
 	return status;
 }
@@ -1628,6 +1740,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		handle_to_key(obj_hdl, &key);
 		vfs_state_release(&key);
 	} else if (type == DIRECTORY) {
+		vfs_readdir_fd_release(myself);
 		if (myself->u.directory.path != NULL)
 			gsh_free(myself->u.directory.path);
 		if (myself->u.directory.fs_location != NULL)
@@ -1731,6 +1844,8 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->lock_op2 = vfs_lock_op2;
 	ops->setattr2 = vfs_setattr2;
 	ops->close2 = vfs_close2;
+	ops->read2_async = vfs_read2_async;
+	ops->write2_async = vfs_write2_async;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = vfs_list_ext_attrs;
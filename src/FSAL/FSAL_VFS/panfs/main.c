@@ -39,6 +39,7 @@
 #include "gsh_list.h"
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
+#include "../vfs_methods.h"
 
 /* PANFS FSAL module private storage
  */
@@ -107,6 +108,11 @@ struct config_block panfs_param = {
 	.blk_desc.u.blk.commit = noop_conf_commit
 };
 
+/* PANFS has no readdir options: no threads and no cached fds */
+static const struct vfs_readdir_params panfs_readdir = {
+	.batch = 1,
+};
+
 /* private helper for export object
  */
 
@@ -140,6 +146,7 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
+	(void) vfs_readdir_init(&panfs_readdir);
 	display_fsinfo(&panfs_me->fs_info);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
@@ -193,6 +200,8 @@ MODULE_FINI void panfs_unload(void)
 {
 	int retval;
 
+	vfs_readdir_shutdown();
+
 	retval = unregister_fsal(&PANFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "PANFS module failed to unregister");
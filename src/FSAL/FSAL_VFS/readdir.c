@@ -0,0 +1,338 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/readdir.c
+ * @brief Batched directory reading for VFS
+ *
+ * read_dirents gathers a batch of entries and has the fstatat and
+ * name_to_handle_at of each done here before it makes the handles and
+ * calls back.  With Readdir_Threads set, a batch is shared between the
+ * calling thread and up to that many pool threads, each taking the next
+ * entry not yet taken until none are left, so a cold directory costs
+ * one disk round trip per batch rather than one per entry.  Handles are
+ * still made, and entries passed back, on the calling thread.
+ *
+ * The directory fd read_dirents opens is kept on the handle between
+ * calls, up to Readdir_Cached_Fds of them in all, and closed when the
+ * handle is released.  Cached fds count in open_fd_count, so they are
+ * held to the same limits as open files.
+ *
+ * Only FSAL_VFS has options for these; FSAL_XFS and FSAL_PANFS start
+ * with no readdir threads and no cached fds.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+#include "vfs_methods.h"
+
+/**
+ * @brief A batch of entries being fetched
+ *
+ * Shared by the caller and the pool threads queued to help it, and
+ * freed by whichever of them lets go last, so the caller need not wait
+ * for a queued thread that starts after the batch is done.
+ */
+struct vfs_readdir_job {
+	struct vfs_fsal_obj_handle *dir_hdl;	/*< Directory being read */
+	int dirfd;				/*< Its fd */
+	struct vfs_readdir_entry *entries;	/*< The entries */
+	uint32_t count;				/*< Number of entries */
+	uint32_t next;				/*< Next entry to fetch */
+	uint32_t done;				/*< Entries fetched */
+	uint32_t refs;				/*< Caller and queued threads */
+	pthread_mutex_t mutex;			/*< Protects done for cond */
+	pthread_cond_t cond;			/*< Signalled when all done */
+};
+
+static struct vfs_readdir_params readdir_params;
+static struct fridgethr *vfs_readdir_fridge;
+
+/** Directory fds cached on handles */
+static uint32_t vfs_readdir_fds;
+
+/**
+ * @brief Fetch entries of a batch until none are left
+ *
+ * Entries past the end are never touched, so a thread that gets here
+ * after the caller has returned does nothing.
+ *
+ * @param[in] job The batch
+ */
+static void vfs_readdir_fetch(struct vfs_readdir_job *job)
+{
+	struct vfs_readdir_entry *ent;
+	uint32_t ix;
+
+	while ((ix = atomic_postinc_uint32_t(&job->next)) < job->count) {
+		ent = &job->entries[ix];
+		ent->status = vfs_lookup_prefetch(job->dir_hdl, job->dirfd,
+						  ent->name, &ent->stat,
+						  &ent->fs, &ent->fh);
+
+		if (atomic_inc_uint32_t(&job->done) == job->count) {
+			PTHREAD_MUTEX_lock(&job->mutex);
+			pthread_cond_signal(&job->cond);
+			PTHREAD_MUTEX_unlock(&job->mutex);
+		}
+	}
+}
+
+/**
+ * @brief Let go of a batch, freeing it if nobody else holds it
+ *
+ * @param[in] job The batch
+ */
+static void vfs_readdir_job_put(struct vfs_readdir_job *job)
+{
+	if (atomic_dec_uint32_t(&job->refs) != 0)
+		return;
+
+	PTHREAD_COND_destroy(&job->cond);
+	PTHREAD_MUTEX_destroy(&job->mutex);
+	gsh_free(job);
+}
+
+static void vfs_readdir_thread(struct fridgethr_context *ctx)
+{
+	struct vfs_readdir_job *job = ctx->arg;
+
+	vfs_readdir_fetch(job);
+	vfs_readdir_job_put(job);
+}
+
+/**
+ * @brief Fetch the stat and handle of a batch of entries
+ *
+ * Sets the status, stat, fs and fh of each entry.  Returns when all of
+ * them are done, which may be before every pool thread queued to help
+ * has started.
+ *
+ * @param[in]     dir_hdl Directory being read
+ * @param[in]     dirfd   Its fd
+ * @param[in,out] entries The entries
+ * @param[in]     count   Number of entries
+ */
+void vfs_readdir_prefetch(struct vfs_fsal_obj_handle *dir_hdl, int dirfd,
+			  struct vfs_readdir_entry *entries, uint32_t count)
+{
+	struct vfs_readdir_job *job;
+	struct vfs_readdir_entry *ent;
+	uint32_t want = 0, ix;
+	int rc;
+
+	if (vfs_readdir_fridge != NULL && count > 1)
+		want = MIN(readdir_params.threads, count - 1);
+
+	if (want == 0) {
+		for (ent = entries; ent < entries + count; ent++)
+			ent->status = vfs_lookup_prefetch(dir_hdl, dirfd,
+							  ent->name, &ent->stat,
+							  &ent->fs, &ent->fh);
+		return;
+	}
+
+	job = gsh_calloc(1, sizeof(*job));
+	job->dir_hdl = dir_hdl;
+	job->dirfd = dirfd;
+	job->entries = entries;
+	job->count = count;
+	job->refs = 1;
+	PTHREAD_MUTEX_init(&job->mutex, NULL);
+	PTHREAD_COND_init(&job->cond, NULL);
+
+	for (ix = 0; ix < want; ix++) {
+		(void) atomic_inc_uint32_t(&job->refs);
+		rc = fridgethr_submit(vfs_readdir_fridge, vfs_readdir_thread,
+				      job);
+		if (rc != 0) {
+			(void) atomic_dec_uint32_t(&job->refs);
+			LogDebug(COMPONENT_FSAL,
+				 "Unable to queue readdir fetch (%d)", rc);
+			break;
+		}
+	}
+
+	vfs_readdir_fetch(job);
+
+	/* Wait only for entries other threads have taken */
+	PTHREAD_MUTEX_lock(&job->mutex);
+	while (atomic_fetch_uint32_t(&job->done) < count)
+		pthread_cond_wait(&job->cond, &job->mutex);
+	PTHREAD_MUTEX_unlock(&job->mutex);
+
+	vfs_readdir_job_put(job);
+}
+
+/**
+ * @brief Number of entries read_dirents should gather at once
+ *
+ * @return Readdir_Batch, or 1 with no readdir threads.
+ */
+uint32_t vfs_readdir_batch(void)
+{
+	if (vfs_readdir_fridge == NULL || readdir_params.batch == 0)
+		return 1;
+
+	return readdir_params.batch;
+}
+
+/**
+ * @brief Get an fd to read a directory with
+ *
+ * Takes the fd cached on the handle if there is one, or opens one.  The
+ * caller must seek it and give it back with vfs_readdir_fd_put.
+ *
+ * @param[in]  dir_hdl    The directory
+ * @param[out] fsal_error FSAL error on failure
+ *
+ * @return The fd, or -errno.
+ */
+int vfs_readdir_fd_get(struct vfs_fsal_obj_handle *dir_hdl,
+		       fsal_errors_t *fsal_error)
+{
+	int fd;
+
+	fd = __sync_lock_test_and_set(&dir_hdl->u.directory.readdir_fd, -1);
+
+	if (fd >= 0) {
+		(void) atomic_dec_uint32_t(&vfs_readdir_fds);
+		(void) atomic_dec_size_t(&open_fd_count);
+		return fd;
+	}
+
+	return vfs_fsal_open(dir_hdl, O_RDONLY | O_DIRECTORY, fsal_error);
+}
+
+/**
+ * @brief Give back an fd from vfs_readdir_fd_get
+ *
+ * The fd is cached on the handle, and counted in open_fd_count, unless
+ * another already is or Readdir_Cached_Fds are cached, in which case it
+ * is closed.
+ *
+ * @param[in] dir_hdl The directory
+ * @param[in] fd      The fd
+ */
+void vfs_readdir_fd_put(struct vfs_fsal_obj_handle *dir_hdl, int fd)
+{
+	if (atomic_inc_uint32_t(&vfs_readdir_fds) <=
+	    readdir_params.cached_fds &&
+	    __sync_bool_compare_and_swap(&dir_hdl->u.directory.readdir_fd,
+					 -1, fd)) {
+		(void) atomic_inc_size_t(&open_fd_count);
+		return;
+	}
+
+	(void) atomic_dec_uint32_t(&vfs_readdir_fds);
+	close(fd);
+}
+
+/**
+ * @brief Close the fd cached on a directory handle being released
+ *
+ * @param[in] dir_hdl The directory
+ */
+void vfs_readdir_fd_release(struct vfs_fsal_obj_handle *dir_hdl)
+{
+	int fd;
+
+	fd = __sync_lock_test_and_set(&dir_hdl->u.directory.readdir_fd, -1);
+
+	if (fd >= 0) {
+		(void) atomic_dec_uint32_t(&vfs_readdir_fds);
+		(void) atomic_dec_size_t(&open_fd_count);
+		close(fd);
+	}
+}
+
+/**
+ * @brief Start the readdir threads
+ *
+ * @param[in] params Readdir parameters from the VFS block
+ *
+ * @return 0 on success, or an error from fridgethr_init.
+ */
+int vfs_readdir_init(const struct vfs_readdir_params *params)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	readdir_params = *params;
+
+	if (readdir_params.threads == 0)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = readdir_params.threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&vfs_readdir_fridge, "VFS_RDIR", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize VFS readdir thread fridge: %d",
+			 rc);
+		vfs_readdir_fridge = NULL;
+		readdir_params.threads = 0;
+		return rc;
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"VFS readdir %u threads, batches of %u, %u cached fds",
+		readdir_params.threads, readdir_params.batch,
+		readdir_params.cached_fds);
+
+	return 0;
+}
+
+/**
+ * @brief Stop the readdir threads
+ */
+void vfs_readdir_shutdown(void)
+{
+	int rc;
+
+	if (vfs_readdir_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(vfs_readdir_fridge, fridgethr_comm_stop,
+				    120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(vfs_readdir_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down VFS readdir threads: %d", rc);
+	}
+
+	fridgethr_destroy(vfs_readdir_fridge);
+	vfs_readdir_fridge = NULL;
+}
@@ -40,6 +40,7 @@
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
 #include "fsal_handle_syscalls.h"
+#include "../vfs_methods.h"
 
 /* VFS FSAL module private storage
  */
@@ -54,6 +55,8 @@
 struct vfs_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_staticfsinfo_t fs_info;
+	struct vfs_async_params async;
+	struct vfs_readdir_params readdir;
 	/* vfsfs_specific_initinfo_t specific_info;  placeholder */
 };
 
@@ -83,23 +86,42 @@ static struct fsal_staticfsinfo_t default_posix_info = {
 	.link_supports_permission_checks = false,
 };
 
+static struct config_item_list async_engines[] = {
+	CONFIG_LIST_TOK("none", VFS_ASYNC_NONE),
+	CONFIG_LIST_TOK("threads", VFS_ASYNC_THREADS),
+	CONFIG_LIST_TOK("io_uring", VFS_ASYNC_IO_URING),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item vfs_params[] = {
 	CONF_ITEM_BOOL("link_support", true,
-		       fsal_staticfsinfo_t, link_support),
+		       vfs_fsal_module, fs_info.link_support),
 	CONF_ITEM_BOOL("symlink_support", true,
-		       fsal_staticfsinfo_t, symlink_support),
+		       vfs_fsal_module, fs_info.symlink_support),
 	CONF_ITEM_BOOL("cansettime", true,
-		       fsal_staticfsinfo_t, cansettime),
+		       vfs_fsal_module, fs_info.cansettime),
 	CONF_ITEM_UI64("maxread", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxread),
+		       vfs_fsal_module, fs_info.maxread),
 	CONF_ITEM_UI64("maxwrite", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxwrite),
+		       vfs_fsal_module, fs_info.maxwrite),
 	CONF_ITEM_MODE("umask", 0,
-		       fsal_staticfsinfo_t, umask),
+		       vfs_fsal_module, fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false,
-		       fsal_staticfsinfo_t, auth_exportpath_xdev),
+		       vfs_fsal_module, fs_info.auth_exportpath_xdev),
 	CONF_ITEM_MODE("xattr_access_rights", 0400,
-		       fsal_staticfsinfo_t, xattr_access_rights),
+		       vfs_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_TOKEN("Async_IO_Engine", VFS_ASYNC_NONE, async_engines,
+			vfs_fsal_module, async.engine),
+	CONF_ITEM_UI32("Async_IO_Threads", 1, 1024, 16,
+		       vfs_fsal_module, async.threads),
+	CONF_ITEM_UI32("Async_IO_Queue_Depth", 8, 32768, 256,
+		       vfs_fsal_module, async.queue_depth),
+	CONF_ITEM_UI32("Readdir_Threads", 0, 256, 0,
+		       vfs_fsal_module, readdir.threads),
+	CONF_ITEM_UI32("Readdir_Batch", 1, 1024, 64,
+		       vfs_fsal_module, readdir.batch),
+	CONF_ITEM_UI32("Readdir_Cached_Fds", 0, 65536, 256,
+		       vfs_fsal_module, readdir.cached_fds),
 	CONFIG_EOL
 };
 
@@ -182,11 +204,17 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 	(void) load_config_from_parse(config_struct,
 				      &vfs_param,
-				      &vfs_me->fs_info,
+				      vfs_me,
 				      true,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
+	if (vfs_async_init(&vfs_me->async) != 0)
+		LogWarn(COMPONENT_FSAL,
+			"FSAL_VFS asynchronous I/O disabled");
+	if (vfs_readdir_init(&vfs_me->readdir) != 0)
+		LogWarn(COMPONENT_FSAL,
+			"FSAL_VFS parallel readdir disabled");
 	display_fsinfo(&vfs_me->fs_info);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
@@ -253,6 +281,9 @@ MODULE_FINI void vfs_unload(void)
 {
 	int retval;
 
+	vfs_async_shutdown();
+	vfs_readdir_shutdown();
+
 	retval = unregister_fsal(&VFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "VFS module failed to unregister");
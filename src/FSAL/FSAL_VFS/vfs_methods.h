@@ -160,6 +160,7 @@ struct vfs_fsal_obj_handle {
 		struct {
 			char *path;
 			char *fs_location;
+			int readdir_fd;	/*< Cached by read_dirents, or -1 */
 		} directory;
 		struct {
 			unsigned char *link_content;
@@ -223,6 +224,52 @@ struct closefd {
 	int close_fd;
 };
 
+/**
+ * @brief Asynchronous I/O engines
+ */
+enum vfs_async_engine {
+	VFS_ASYNC_NONE,		/*< Complete read2_async/write2_async inline */
+	VFS_ASYNC_THREADS,	/*< Hand I/O to a pool of I/O threads */
+	VFS_ASYNC_IO_URING,	/*< Submit I/O to an io_uring */
+};
+
+struct vfs_async_params {
+	uint32_t engine;	/*< enum vfs_async_engine */
+	uint32_t threads;	/*< I/O threads */
+	uint32_t queue_depth;	/*< io_uring submission queue entries */
+};
+
+int vfs_async_init(const struct vfs_async_params *params);
+void vfs_async_shutdown(void);
+
+struct vfs_readdir_params {
+	uint32_t threads;	/*< Threads fetching entry attributes */
+	uint32_t batch;		/*< Entries fetched at once */
+	uint32_t cached_fds;	/*< Directory fds kept open between calls */
+};
+
+/**
+ * @brief A directory entry being read by read_dirents
+ */
+struct vfs_readdir_entry {
+	char name[NAME_MAX + 1];	/*< Entry name */
+	fsal_cookie_t cookie;		/*< Cookie of the entry */
+	fsal_status_t status;		/*< Result of vfs_lookup_prefetch */
+	struct stat stat;		/*< Its results */
+	struct fsal_filesystem *fs;
+	vfs_file_handle_t fh;
+};
+
+int vfs_readdir_init(const struct vfs_readdir_params *params);
+void vfs_readdir_shutdown(void);
+uint32_t vfs_readdir_batch(void);
+void vfs_readdir_prefetch(struct vfs_fsal_obj_handle *dir_hdl, int dirfd,
+			  struct vfs_readdir_entry *entries, uint32_t count);
+int vfs_readdir_fd_get(struct vfs_fsal_obj_handle *dir_hdl,
+		       fsal_errors_t *fsal_error);
+void vfs_readdir_fd_put(struct vfs_fsal_obj_handle *dir_hdl, int fd);
+void vfs_readdir_fd_release(struct vfs_fsal_obj_handle *dir_hdl);
+
 int vfs_fsal_open(struct vfs_fsal_obj_handle *hdl,
 		  int openflags,
 		  fsal_errors_t *fsal_error);
@@ -235,6 +282,19 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 					 const char *path,
 					 struct fsal_export *exp_hdl);
 
+fsal_status_t vfs_lookup_prefetch(struct vfs_fsal_obj_handle *parent_hdl,
+				  int dirfd, const char *path,
+				  struct stat *stat,
+				  struct fsal_filesystem **fs_out,
+				  vfs_file_handle_t *fh);
+fsal_status_t vfs_lookup_finish(struct vfs_fsal_obj_handle *parent_hdl,
+				int dirfd, const char *path,
+				struct stat *stat,
+				struct fsal_filesystem *fs,
+				vfs_file_handle_t *fh,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out);
+
 static inline bool vfs_unopenable_type(object_file_type_t type)
 {
 	if ((type == SOCKET_FILE) || (type == CHARACTER_FILE)
@@ -305,6 +365,27 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 bool *fsal_stable,
 			 struct io_info *info);
 
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     struct fsal_io_arg *read_arg,
+		     fsal_async_cb done_cb,
+		     void *caller_arg);
+
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      struct fsal_io_arg *write_arg,
+		      fsal_async_cb done_cb,
+		      void *caller_arg);
+
+fsal_status_t find_fd(int *fd,
+		      struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      struct state_t *state,
+		      fsal_openflags_t openflags,
+		      bool *has_lock,
+		      bool *closefd,
+		      bool open_for_locks);
+
 fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
@@ -39,6 +39,7 @@
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
 #include "fsal_handle_syscalls.h"
+#include "../vfs_methods.h"
 
 /* VFS FSAL module private storage
  */
@@ -111,6 +112,11 @@ struct config_block xfs_param = {
 	.blk_desc.u.blk.commit = noop_conf_commit
 };
 
+/* XFS has no readdir options: no threads and no cached fds */
+static const struct vfs_readdir_params xfs_readdir = {
+	.batch = 1,
+};
+
 /* private helper for export object
  */
 
@@ -186,6 +192,7 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
+	(void) vfs_readdir_init(&xfs_readdir);
 	display_fsinfo(&xfs_me->fs_info);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
@@ -251,6 +258,8 @@ MODULE_FINI void xfs_unload(void)
 {
 	int retval;
 
+	vfs_readdir_shutdown();
+
 	retval = unregister_fsal(&XFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "XFS module failed to unregister");
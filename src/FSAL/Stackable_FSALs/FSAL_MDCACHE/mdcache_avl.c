@@ -172,6 +172,9 @@ void unchunk_dirent(mdcache_dir_entry_t *dirent)
 	/* Remove from chunk */
 	glist_del(&dirent->chunk_list);
 
+	/* Its encodings go with the chunk */
+	mdc_dirent_enc_free(dirent);
+
 	/* Remove from FSAL cookie AVL tree */
 	avltree_remove(&dirent->node_ck, &parent->fsobj.fsdir.avl.ck);
 
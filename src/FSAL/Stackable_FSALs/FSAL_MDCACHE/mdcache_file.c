@@ -894,6 +894,149 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Completion context for an asynchronous read or write
+ *
+ * The sub-FSAL calls back with its own handle; this carries what is needed
+ * to update the cache entry and call the caller's callback with the MDCACHE
+ * handle.
+ */
+struct mdc_async_arg {
+	mdcache_entry_t *entry;
+	fsal_async_cb done_cb;
+	void *caller_arg;
+};
+
+/**
+ * @brief Callback for sub-FSAL asynchronous read completion
+ *
+ * May be called from a sub-FSAL thread, so must not use op_ctx.
+ *
+ * @param[in] sub_hdl		Sub-FSAL object the read was issued on
+ * @param[in] ret		Status of the read
+ * @param[in] read_arg		Arguments and results of the read
+ * @param[in] caller_arg	Our mdc_async_arg
+ */
+static void mdc_read2_async_cb(struct fsal_obj_handle *sub_hdl,
+			       fsal_status_t ret,
+			       struct fsal_io_arg *read_arg,
+			       void *caller_arg)
+{
+	struct mdc_async_arg *arg = caller_arg;
+	mdcache_entry_t *entry = arg->entry;
+	fsal_async_cb done_cb = arg->done_cb;
+	void *done_arg = arg->caller_arg;
+
+	gsh_free(arg);
+
+	if (!FSAL_IS_ERROR(ret))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (ret.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	done_cb(&entry->obj_handle, ret, read_arg, done_arg);
+}
+
+/**
+ * @brief Read from a file asynchronously
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl		Object to read
+ * @param[in] bypass		Bypass deny read
+ * @param[in,out] read_arg	Arguments and results of the read
+ * @param[in] done_cb		Completion callback
+ * @param[in] caller_arg	Argument for @a done_cb
+ */
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *read_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg = gsh_malloc(sizeof(*arg));
+
+	arg->entry = entry;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	subcall(
+		entry->sub_handle->obj_ops.read2_async(
+			entry->sub_handle, bypass, read_arg,
+			mdc_read2_async_cb, arg)
+	       );
+}
+
+/**
+ * @brief Callback for sub-FSAL asynchronous write completion
+ *
+ * May be called from a sub-FSAL thread, so must not use op_ctx.
+ *
+ * @param[in] sub_hdl		Sub-FSAL object the write was issued on
+ * @param[in] ret		Status of the write
+ * @param[in] write_arg		Arguments and results of the write
+ * @param[in] caller_arg	Our mdc_async_arg
+ */
+static void mdc_write2_async_cb(struct fsal_obj_handle *sub_hdl,
+				fsal_status_t ret,
+				struct fsal_io_arg *write_arg,
+				void *caller_arg)
+{
+	struct mdc_async_arg *arg = caller_arg;
+	mdcache_entry_t *entry = arg->entry;
+	fsal_async_cb done_cb = arg->done_cb;
+	void *done_arg = arg->caller_arg;
+
+	gsh_free(arg);
+
+	if (ret.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+	else
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	done_cb(&entry->obj_handle, ret, write_arg, done_arg);
+}
+
+/**
+ * @brief Write to a file asynchronously
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl		Object to write
+ * @param[in] bypass		Bypass any non-mandatory deny write
+ * @param[in,out] write_arg	Arguments and results of the write
+ * @param[in] done_cb		Completion callback
+ * @param[in] caller_arg	Argument for @a done_cb
+ */
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct fsal_io_arg *write_arg,
+			  fsal_async_cb done_cb,
+			  void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg = gsh_malloc(sizeof(*arg));
+
+	arg->entry = entry;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	/* Attributes are about to change; stop trusting them now so a
+	 * GETATTR racing with the write does not serve stale ones.
+	 */
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
+
+	subcall(
+		entry->sub_handle->obj_ops.write2_async(
+			entry->sub_handle, bypass, write_arg,
+			mdc_write2_async_cb, arg)
+	       );
+}
+
 /**
  * @brief Seek within a file (new style)
  *
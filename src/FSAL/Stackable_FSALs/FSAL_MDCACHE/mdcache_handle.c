@@ -1779,6 +1779,8 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->lock_op2 = mdcache_lock_op2;
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
+	ops->read2_async = mdcache_read2_async;
+	ops->write2_async = mdcache_write2_async;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = mdcache_list_ext_attrs;
@@ -2623,6 +2623,127 @@ again:
  * @return FSAL status
  */
 
+/**
+ * @brief Offer a dirent's kept READDIR encoding to the callback
+ *
+ * Copies the encoding kept with the caller's key into the caller's
+ * buffer if the entry is unchanged since it was encoded, and notes the
+ * entry's attributes for mdc_dirent_enc_keep.
+ *
+ * @note The content_lock MUST be held
+ *
+ * @param[in]     dirent The dirent
+ * @param[in]     entry  Its entry, with attributes just refreshed
+ * @param[in,out] enc    The caller's encodings
+ * @param[out]    ea     The entry's attributes
+ */
+
+static void mdc_dirent_enc_get(mdcache_dir_entry_t *dirent,
+			       mdcache_entry_t *entry,
+			       struct fsal_readdir_enc *enc,
+			       struct mdcache_enc_attrs *ea)
+{
+	struct mdcache_dirent_enc *de;
+
+	enc->cached_len = 0;
+	enc->store_len = 0;
+
+	memset(ea, 0, sizeof(*ea));
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	ea->valid_mask = entry->attrs.valid_mask;
+	memcpy(ea->attrs, (char *) &entry->attrs + MDC_ENC_ATTRS_START,
+	       MDC_ENC_ATTRS_LEN);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	PTHREAD_MUTEX_lock(&dirent->chunk->enc_lock);
+
+	for (de = dirent->enc; de != NULL; de = de->next) {
+		if (memcmp(de->key, enc->key, sizeof(de->key)) != 0)
+			continue;
+
+		if (memcmp(&de->attrs, ea, sizeof(*ea)) == 0 &&
+		    de->len <= enc->buflen) {
+			memcpy(enc->buf, de->buf, de->len);
+			enc->cached_len = de->len;
+		}
+		break;
+	}
+
+	PTHREAD_MUTEX_unlock(&dirent->chunk->enc_lock);
+}
+
+/**
+ * @brief Keep the callback's READDIR encoding of a dirent
+ *
+ * Replaces an encoding with the same key, and the oldest if the dirent
+ * has too many.
+ *
+ * @note The content_lock MUST be held
+ *
+ * @param[in] dirent The dirent
+ * @param[in] enc    The caller's encodings
+ * @param[in] ea     The entry's attributes from mdc_dirent_enc_get
+ */
+
+static void mdc_dirent_enc_keep(mdcache_dir_entry_t *dirent,
+				struct fsal_readdir_enc *enc,
+				struct mdcache_enc_attrs *ea)
+{
+	struct mdcache_dirent_enc *de, **pde, *old, *drop = NULL;
+	int n = 1;
+
+	de = gsh_malloc(sizeof(*de) + enc->store_len);
+	memcpy(de->key, enc->key, sizeof(de->key));
+	de->attrs = *ea;
+	de->len = enc->store_len;
+	memcpy(de->buf, enc->store, enc->store_len);
+
+	PTHREAD_MUTEX_lock(&dirent->chunk->enc_lock);
+
+	de->next = dirent->enc;
+	dirent->enc = de;
+
+	for (pde = &de->next; *pde != NULL;) {
+		old = *pde;
+		if (n < MDCACHE_DIRENT_ENC_MAX &&
+		    memcmp(old->key, de->key, sizeof(de->key)) != 0) {
+			n++;
+			pde = &old->next;
+			continue;
+		}
+		*pde = old->next;
+		old->next = drop;
+		drop = old;
+	}
+
+	PTHREAD_MUTEX_unlock(&dirent->chunk->enc_lock);
+
+	while (drop != NULL) {
+		old = drop;
+		drop = old->next;
+		gsh_free(old);
+	}
+}
+
+/**
+ * @brief Free the READDIR encodings kept with a dirent
+ *
+ * @note The content_lock MUST be held for write
+ *
+ * @param[in] dirent The dirent
+ */
+
+void mdc_dirent_enc_free(mdcache_dir_entry_t *dirent)
+{
+	struct mdcache_dirent_enc *de;
+
+	while (dirent->enc != NULL) {
+		de = dirent->enc;
+		dirent->enc = de->next;
+		gsh_free(de);
+	}
+}
+
 fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 				      fsal_cookie_t whence,
 				      void *dir_state,
@@ -2795,6 +2916,8 @@ again:
 		enum fsal_dir_result cb_result;
 		mdcache_entry_t *entry = NULL;
 		struct attrlist attrs;
+		struct fsal_readdir_enc *enc = op_ctx->readdir_enc;
+		struct mdcache_enc_attrs ea;
 
 		if (dirent->ck == whence) {
 			/* When called with whence, the caller always wants the
@@ -2854,9 +2977,16 @@ again:
 			return status;
 		}
 
+		if (enc != NULL)
+			mdc_dirent_enc_get(dirent, entry, enc, &ea);
+
 		cb_result = cb(dirent->name, &entry->obj_handle, &entry->attrs,
 			       dir_state, next_ck);
 
+		if (enc != NULL && enc->store_len != 0 &&
+		    cb_result < DIR_TERMINATE)
+			mdc_dirent_enc_keep(dirent, enc, &ea);
+
 		fsal_release_attrs(&attrs);
 
 		if (cb_result >= DIR_TERMINATE || dirent->eod) {
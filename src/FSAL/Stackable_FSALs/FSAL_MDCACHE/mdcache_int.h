@@ -326,6 +326,43 @@ struct dir_chunk {
 	fsal_cookie_t next_ck;
 	/** Number of entries in chunk */
 	int num_entries;
+	/** Protects the encodings kept with the chunk's dirents, which
+	 *  are added under the read content_lock */
+	pthread_mutex_t enc_lock;
+};
+
+/** Most encodings kept per dirent */
+#define MDCACHE_DIRENT_ENC_MAX 2
+
+/** The part of the attributes an encoding depends on */
+#define MDC_ENC_ATTRS_START offsetof(struct attrlist, type)
+#define MDC_ENC_ATTRS_LEN (offsetof(struct attrlist, expire_time_attr) - \
+			   MDC_ENC_ATTRS_START)
+
+/** The attributes an entry had when it was encoded */
+struct mdcache_enc_attrs {
+	attrmask_t valid_mask;
+	char attrs[MDC_ENC_ATTRS_LEN];
+};
+
+/**
+ * @brief A dirent as a protocol encoded it for READDIR
+ *
+ * Reused while the key matches and the entry's attributes, from type
+ * through generation, are unchanged since it was encoded.
+ */
+
+struct mdcache_dirent_enc {
+	/** Next encoding of the same dirent */
+	struct mdcache_dirent_enc *next;
+	/** How the entry was encoded */
+	uint32_t key[FSAL_READDIR_ENC_KEY];
+	/** The attributes encoded */
+	struct mdcache_enc_attrs attrs;
+	/** Length of the encoding */
+	uint32_t len;
+	/** The encoding */
+	char buf[];
 };
 
 /**
@@ -368,6 +405,8 @@ typedef struct mdcache_dir_entry__ {
 	mdcache_key_t ckey;
 	/** Flags */
 	uint32_t flags;
+	/** Encodings for READDIR, protected by the chunk's enc_lock */
+	struct mdcache_dirent_enc *enc;
 	/** The NUL-terminated filename */
 	char name[];
 } mdcache_dir_entry_t;
@@ -448,6 +487,7 @@ fsal_status_t mdcache_readdir_uncached(mdcache_entry_t *directory, fsal_cookie_t
 				       fsal_readdir_cb cb, attrmask_t attrmask,
 				       bool *eod_met);
 void mdcache_clean_dirent_chunk(struct dir_chunk *chunk);
+void mdc_dirent_enc_free(mdcache_dir_entry_t *dirent);
 bool add_dirent_to_chunk(mdcache_entry_t *parent_dir,
 			 mdcache_dir_entry_t *new_dir_entry);
 fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
@@ -953,6 +993,16 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 			     size_t *write_amount,
 			     bool *fsal_stable,
 			     struct io_info *info);
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *read_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg);
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct fsal_io_arg *write_arg,
+			  fsal_async_cb done_cb,
+			  void *caller_arg);
 fsal_status_t mdcache_seek2(struct fsal_obj_handle *obj_hdl,
 			    struct state_t *state,
 			    struct io_info *info);
@@ -872,6 +872,7 @@ struct dir_chunk *mdcache_get_chunk(mdcache_entry_t *parent)
 		/* alloc chunk (if fails, aborts) */
 		chunk = gsh_calloc(1, sizeof(struct dir_chunk));
 		glist_init(&chunk->dirents);
+		PTHREAD_MUTEX_init(&chunk->enc_lock, NULL);
 		(void) atomic_inc_int64_t(&lru_state.chunks_used);
 	}
 
@@ -1950,6 +1951,7 @@ void lru_remove_chunk(struct dir_chunk *chunk)
 	mdcache_clean_dirent_chunk(chunk);
 
 	/* And now we can free the chunk. */
+	PTHREAD_MUTEX_destroy(&chunk->enc_lock);
 	gsh_free(chunk);
 }
 
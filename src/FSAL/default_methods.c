@@ -1563,6 +1563,49 @@ static fsal_status_t close2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* read2_async
+ * default case performs a synchronous read2 and completes inline
+ */
+
+static void read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			struct fsal_io_arg *read_arg,
+			fsal_async_cb done_cb,
+			void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.read2(obj_hdl, bypass, read_arg->state,
+					read_arg->offset, read_arg->io_request,
+					read_arg->buffer, &read_arg->io_amount,
+					&read_arg->end_of_file, read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/* write2_async
+ * default case performs a synchronous write2 and completes inline
+ */
+
+static void write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *write_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.write2(obj_hdl, bypass, write_arg->state,
+					 write_arg->offset,
+					 write_arg->io_request,
+					 write_arg->buffer,
+					 &write_arg->io_amount,
+					 &write_arg->fsal_stable,
+					 write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+
 /* Default fsal handle object method vector.
  * copied to allocated vector at register time
  */
@@ -1632,6 +1675,8 @@ struct fsal_obj_ops def_handle_ops = {
 	.lock_op2 = lock_op2,
 	.setattr2 = setattr2,
 	.close2 = close2,
+	.read2_async = read2_async,
+	.write2_async = write2_async,
 };
 
 /* fsal_pnfs_ds common methods */
@@ -1117,6 +1117,94 @@ fsal_status_t fsal_write2(struct fsal_obj_handle *obj,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Start an asynchronous read
+ *
+ * @param[in]     obj          File to be read
+ * @param[in]     bypass       If state doesn't indicate a share reservation,
+ *                             bypass any deny read
+ * @param[in,out] read_arg     Arguments and results of the read
+ * @param[in]     done_cb      Completion callback
+ * @param[in]     caller_arg   Opaque argument for done_cb
+ *
+ * The completion callback should pass the status through fsal_io_complete.
+ */
+
+void fsal_read2_async(struct fsal_obj_handle *obj,
+		      bool bypass,
+		      struct fsal_io_arg *read_arg,
+		      fsal_async_cb done_cb,
+		      void *caller_arg)
+{
+	read_arg->io_amount = 0;
+	read_arg->end_of_file = false;
+
+	obj->obj_ops.read2_async(obj, bypass, read_arg, done_cb, caller_arg);
+}
+
+/**
+ * @brief Start an asynchronous write
+ *
+ * @param[in]     obj          File to be written
+ * @param[in]     bypass       If state doesn't indicate a share reservation,
+ *                             bypass any non-mandatory deny write
+ * @param[in,out] write_arg    Arguments and results of the write
+ * @param[in]     done_cb      Completion callback
+ * @param[in]     caller_arg   Opaque argument for done_cb
+ *
+ * The completion callback should pass the status through fsal_io_complete.
+ */
+
+void fsal_write2_async(struct fsal_obj_handle *obj,
+		       bool bypass,
+		       struct fsal_io_arg *write_arg,
+		       fsal_async_cb done_cb,
+		       void *caller_arg)
+{
+	if (op_ctx->export_perms->options & EXPORT_OPTION_COMMIT) {
+		/* Force sync if export requires it */
+		write_arg->fsal_stable = true;
+	}
+
+	write_arg->io_amount = 0;
+
+	obj->obj_ops.write2_async(obj, bypass, write_arg, done_cb, caller_arg);
+}
+
+/**
+ * @brief Post-process the status of an asynchronous read or write
+ *
+ * Does the same fixups fsal_read2 and fsal_write2 do for synchronous I/O.
+ * Safe to call without op_ctx.
+ *
+ * @param[in]     status       Status passed to the completion callback
+ * @param[in,out] io_arg       Arguments and results of the I/O
+ * @param[in]     is_read      true for a read, false for a write
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t fsal_io_complete(fsal_status_t status,
+			       struct fsal_io_arg *io_arg,
+			       bool is_read)
+{
+	/* Fixup FSAL_SHARE_DENIED status */
+	if (status.major == ERR_FSAL_SHARE_DENIED)
+		status = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "FSAL async %s operation returned %s, asked_size=%zu, effective_size=%zu",
+		     is_read ? "READ" : "WRITE", fsal_err_txt(status),
+		     io_arg->io_request, io_arg->io_amount);
+
+	if (FSAL_IS_ERROR(status)) {
+		io_arg->io_amount = 0;
+		return status;
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief Read/Write
  *
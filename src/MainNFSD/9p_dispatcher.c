@@ -44,12 +44,13 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>		/* For inet_ntop() */
 #include "hashtable.h"
 #include "log.h"
 #include "abstract_mem.h"
 #include "abstract_atomic.h"
+#include "fridgethr.h"
 #include "nfs_init.h"
 #include "nfs_core.h"
 #include "nfs_exports.h"
@@ -99,242 +100,430 @@ void DispatchWork9P(request_data_t *req)
 }
 
 /**
- * _9p_socket_thread: 9p socket manager.
+ * @brief A 9P/TCP connection served by an event thread
  *
- * This function is the main loop for the 9p socket manager.
- * One such thread exists per connection.
- *
- * @param Arg the socket number cast as a void * in pthread_create
+ * Messages are read without blocking as the socket becomes readable,
+ * into a buffer the size of each message which is handed with the
+ * request to the worker that frees it.
+ */
+
+struct _9p_tcp_conn {
+	struct _9p_conn conn;		/*< What the protocol layer sees */
+	struct glist_head closing;	/*< Waiting for workers to let go */
+	char hdr[_9P_HDR_SIZE];		/*< Size of the next message */
+	char *msg;			/*< Message being read */
+	uint32_t msglen;
+	uint32_t have;			/*< Bytes of header or message read */
+	char strcaller[INET6_ADDRSTRLEN];
+};
+
+/**
+ * @brief An event thread, serving many connections
+ */
+
+struct _9p_event_thread {
+	int epfd;
+	pthread_t id;
+	int index;
+	struct glist_head closing;	/*< Closed connections still in use */
+};
+
+#define _9P_EVENTS_PER_WAIT 64
+
+/* At most this many messages are read from one connection at a time,
+ * so a busy client does not hold up the others on the thread.
+ */
+#define _9P_MSGS_PER_EVENT 16
+
+static struct _9p_event_thread *_9p_event_threads;
+
+/**
+ * @brief Set up the connection for a newly accepted socket
  *
- * @return NULL
+ * @param[in] tcp_sock The socket
  *
+ * @return The connection.
  */
 
-void *_9p_socket_thread(void *Arg)
+static struct _9p_tcp_conn *_9p_tcp_conn_new(long int tcp_sock)
 {
-	long int tcp_sock = (long int)Arg;
-	int rc = -1;
-	struct pollfd fds[1];
-	int fdcount = 1;
-	static char my_name[MAXNAMLEN + 1];
-	char strcaller[INET6_ADDRSTRLEN];
-	request_data_t *req = NULL;
-	int tag;
-	unsigned long sequence = 0;
-	unsigned int i = 0;
-	char *_9pmsg = NULL;
-	uint32_t msglen;
-
-	struct _9p_conn _9p_conn;
+	struct _9p_tcp_conn *tconn = gsh_calloc(1, sizeof(*tconn));
+	struct _9p_conn *conn = &tconn->conn;
 	socklen_t addrpeerlen;
+	unsigned int i;
+	int rc;
 
-	int readlen = 0;
-	int total_readlen = 0;
-
-	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
-	SetNameFunction(my_name);
+	glist_init(&tconn->closing);
 
-	/* Init the struct _9p_conn structure */
-	memset(&_9p_conn, 0, sizeof(_9p_conn));
-	PTHREAD_MUTEX_init(&_9p_conn.sock_lock, NULL);
-	_9p_conn.trans_type = _9P_TCP;
-	_9p_conn.trans_data.sockfd = tcp_sock;
+	PTHREAD_MUTEX_init(&conn->sock_lock, NULL);
+	conn->trans_type = _9P_TCP;
+	conn->trans_data.sockfd = tcp_sock;
 	for (i = 0; i < FLUSH_BUCKETS; i++) {
-		PTHREAD_MUTEX_init(&_9p_conn.flush_buckets[i].lock, NULL);
-		glist_init(&_9p_conn.flush_buckets[i].list);
+		PTHREAD_MUTEX_init(&conn->flush_buckets[i].lock, NULL);
+		glist_init(&conn->flush_buckets[i].list);
 	}
-	atomic_store_uint32_t(&_9p_conn.refcount, 0);
-
-	/* Init the fids pointers array */
-	memset(&_9p_conn.fids, 0, _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	atomic_store_uint32_t(&conn->refcount, 0);
+	_9p_init_fids(conn);
 
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
-	_9p_conn.msize = _9p_param._9p_tcp_msize;
+	conn->msize = _9p_param._9p_tcp_msize;
 
-	if (gettimeofday(&_9p_conn.birth, NULL) == -1)
+	if (gettimeofday(&conn->birth, NULL) == -1)
 		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
 
-	addrpeerlen = sizeof(_9p_conn.addrpeer);
-	rc = getpeername(tcp_sock, (struct sockaddr *)&_9p_conn.addrpeer,
+	addrpeerlen = sizeof(conn->addrpeer);
+	rc = getpeername(tcp_sock, (struct sockaddr *)&conn->addrpeer,
 			 &addrpeerlen);
 	if (rc == -1) {
 		LogMajor(COMPONENT_9P,
 			 "Cannot get peername to tcp socket for 9p, error %d (%s)",
 			 errno, strerror(errno));
-		/* XXX */
-		strncpy(strcaller, "(unresolved)", INET6_ADDRSTRLEN);
-		strcaller[12] = '\0';
+		snprintf(tconn->strcaller, INET6_ADDRSTRLEN, "(unresolved)");
 	} else {
-		switch (_9p_conn.addrpeer.ss_family) {
+		switch (conn->addrpeer.ss_family) {
 		case AF_INET:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in *)&_9p_conn.addrpeer)->
-				  sin_addr, strcaller, INET6_ADDRSTRLEN);
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in *)&conn->addrpeer)->
+				  sin_addr, tconn->strcaller, INET6_ADDRSTRLEN);
 			break;
 		case AF_INET6:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in6 *)&_9p_conn.addrpeer)->
-				  sin6_addr, strcaller, INET6_ADDRSTRLEN);
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in6 *)&conn->addrpeer)->
+				  sin6_addr, tconn->strcaller, INET6_ADDRSTRLEN);
 			break;
 		default:
-			snprintf(strcaller, INET6_ADDRSTRLEN, "BAD ADDRESS");
+			snprintf(tconn->strcaller, INET6_ADDRSTRLEN,
+				 "BAD ADDRESS");
 			break;
 		}
 
 		LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
-			 tcp_sock, strcaller);
+			 tcp_sock, tconn->strcaller);
 	}
-	_9p_conn.client = get_gsh_client(&_9p_conn.addrpeer, false);
+	conn->client = get_gsh_client(&conn->addrpeer, false);
 
-	/* Set up the structure used by poll */
-	memset((char *)fds, 0, sizeof(struct pollfd));
-	fds[0].fd = tcp_sock;
-	fds[0].events =
-	    POLLIN | POLLPRI | POLLRDBAND | POLLRDNORM | POLLRDHUP | POLLHUP |
-	    POLLERR | POLLNVAL;
+	return tconn;
+}
 
-	for (;;) {
-		total_readlen = 0;  /* new message */
-		rc = poll(fds, fdcount, -1);
-		if (rc == -1) {
-			/* timeout = -1 => Wait indefinitely for events */
-			/* Interruption if not an issue */
-			if (errno == EINTR)
-				continue;
+/**
+ * @brief Release a connection no worker uses any more
+ *
+ * @param[in] tconn The connection
+ */
 
-			LogCrit(COMPONENT_9P,
-				"Got error %u (%s) on fd %ld connect to %s while polling on socket",
-				errno, strerror(errno), tcp_sock, strcaller);
-		}
+static void _9p_tcp_conn_free(struct _9p_tcp_conn *tconn)
+{
+	struct _9p_conn *conn = &tconn->conn;
+	unsigned int i;
 
-		if (fds[0].revents & POLLNVAL) {
-			LogEvent(COMPONENT_9P,
-				 "Client %s on socket %lu produced POLLNVAL",
-				 strcaller, tcp_sock);
-			goto end;
-		}
+	close(conn->trans_data.sockfd);
 
-		if (fds[0].revents & (POLLERR | POLLHUP | POLLRDHUP)) {
-			LogEvent(COMPONENT_9P,
-				 "Client %s on socket %lu has shut down and closed",
-				 strcaller, tcp_sock);
-			goto end;
-		}
+	/* Free buffer if we encountered an error
+	 * before we could give it to a worker */
+	if (tconn->msg)
+		gsh_free(tconn->msg);
 
-		if (!(fds[0].revents & (POLLIN | POLLRDNORM)))
-			continue;
+	_9p_cleanup_fids(conn);
 
-		/* Prepare to read the message */
-		_9pmsg = gsh_malloc(_9p_conn.msize);
+	if (conn->client != NULL)
+		put_gsh_client(conn->client);
 
-		/* An incoming 9P request: the msg has a 4 bytes header
-		   showing the size of the msg including the header */
-		readlen = recv(fds[0].fd, _9pmsg,
-			       _9P_HDR_SIZE, MSG_WAITALL);
-		if (readlen != _9P_HDR_SIZE)
-			goto badmsg;
+	for (i = 0; i < FLUSH_BUCKETS; i++)
+		PTHREAD_MUTEX_destroy(&conn->flush_buckets[i].lock);
+	PTHREAD_MUTEX_destroy(&conn->sock_lock);
 
-		msglen = *(uint32_t *) _9pmsg;
-		if (msglen > _9p_conn.msize) {
-			LogCrit(COMPONENT_9P,
-				"Message size too big! got %u, max = %u",
-				msglen, _9p_conn.msize);
-			goto end;
-		}
+	gsh_free(tconn);
+}
+
+static void _9p_tcp_conn_free_job(struct fridgethr_context *ctx)
+{
+	_9p_tcp_conn_free(ctx->arg);
+}
+
+/**
+ * @brief Free a connection from a general fridge thread
+ *
+ * Clunking what fids the client left open goes to the FSAL and can
+ * take a while, which must not hold up the other connections of the
+ * event thread.
+ *
+ * @param[in] tconn The connection, no longer in use by workers
+ */
+
+static void _9p_tcp_conn_release(struct _9p_tcp_conn *tconn)
+{
+	int rc;
+
+	rc = fridgethr_submit(general_fridge, _9p_tcp_conn_free_job, tconn);
+	if (rc != 0) {
+		LogMajor(COMPONENT_9P,
+			 "Unable to queue release of socket %lu (%d), releasing inline",
+			 tconn->conn.trans_data.sockfd, rc);
+		_9p_tcp_conn_free(tconn);
+	}
+}
+
+/**
+ * @brief Stop reading a connection and free it once workers are done
+ *
+ * @param[in] thr   The event thread serving it
+ * @param[in] tconn The connection
+ */
+
+static void _9p_tcp_close(struct _9p_event_thread *thr,
+			  struct _9p_tcp_conn *tconn)
+{
+	long int tcp_sock = tconn->conn.trans_data.sockfd;
+
+	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
+
+	(void) epoll_ctl(thr->epfd, EPOLL_CTL_DEL, tcp_sock, NULL);
+
+	if (atomic_fetch_uint32_t(&tconn->conn.refcount) == 0) {
+		_9p_tcp_conn_release(tconn);
+		return;
+	}
+
+	LogEvent(COMPONENT_9P, "Waiting for workers to release pconn");
+	glist_add_tail(&thr->closing, &tconn->closing);
+}
+
+/**
+ * @brief Hand a complete message to the workers
+ *
+ * @param[in] tconn The connection it came on
+ */
+
+static void _9p_tcp_dispatch(struct _9p_tcp_conn *tconn)
+{
+	request_data_t *req;
+	int tag;
+
+	LogFullDebug(COMPONENT_9P,
+		     "Received 9P/TCP message of size %u from client %s on socket %lu",
+		     tconn->msglen, tconn->strcaller,
+		     tconn->conn.trans_data.sockfd);
 
-		LogFullDebug(COMPONENT_9P,
-			     "Received 9P/TCP message of size %u from client %s on socket %lu",
-			     msglen, strcaller, tcp_sock);
+	server_stats_transport_done(tconn->conn.client,
+				    tconn->msglen, 1, 0,
+				    0, 0, 0);
 
-		total_readlen += readlen;
-		while (total_readlen < msglen) {
-			readlen = recv(fds[0].fd,
-				       _9pmsg + total_readlen,
-				       msglen - total_readlen,
-				       0);
+	/* Message is good. */
+	req = pool_alloc(request_pool);
+
+	req->rtype = _9P_REQUEST;
+	req->r_u._9p._9pmsg = tconn->msg;
+	req->r_u._9p.pconn = &tconn->conn;
+
+	/* Add this request to the request list,
+	 * should it be flushed later. */
+	tag = *(u16 *) (tconn->msg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
+	_9p_AddFlushHook(&req->r_u._9p, tag, tconn->conn.sequence++);
+	LogFullDebug(COMPONENT_9P, "Request tag is %d\n", tag);
+
+	/* Message was OK push it */
+	DispatchWork9P(req);
+
+	/* Not our buffer anymore */
+	tconn->msg = NULL;
+	tconn->have = 0;
+}
 
-			if (readlen > 0) {
-				total_readlen += readlen;
+/**
+ * @brief Read what a readable connection has for us
+ *
+ * @param[in] tconn The connection
+ *
+ * @return false if the connection must be closed.
+ */
+
+static bool _9p_tcp_read(struct _9p_tcp_conn *tconn)
+{
+	long int tcp_sock = tconn->conn.trans_data.sockfd;
+	ssize_t readlen;
+	int msgs = 0;
+
+	while (msgs < _9P_MSGS_PER_EVENT) {
+		if (tconn->msg == NULL) {
+			/* An incoming 9P request: the msg has a 4 bytes
+			 * header showing the size of the msg including
+			 * the header */
+			readlen = recv(tcp_sock, tconn->hdr + tconn->have,
+				       _9P_HDR_SIZE - tconn->have,
+				       MSG_DONTWAIT);
+			if (readlen <= 0)
+				goto check;
+
+			tconn->have += readlen;
+			if (tconn->have < _9P_HDR_SIZE)
 				continue;
+
+			tconn->msglen = *(uint32_t *) tconn->hdr;
+			if (tconn->msglen > tconn->conn.msize) {
+				LogCrit(COMPONENT_9P,
+					"Message size too big! got %u, max = %u",
+					tconn->msglen, tconn->conn.msize);
+				return false;
 			}
-			if (readlen == 0 ||
-			    (readlen < 0 && errno != EINTR))
-				goto badmsg;
-		}	/* while */
-
-		server_stats_transport_done(_9p_conn.client,
-					    total_readlen, 1, 0,
-					    0, 0, 0);
-
-		/* Message is good. */
-		req = pool_alloc(request_pool);
-
-		req->rtype = _9P_REQUEST;
-		req->r_u._9p._9pmsg = _9pmsg;
-		req->r_u._9p.pconn = &_9p_conn;
-
-		/* Add this request to the request list,
-		 * should it be flushed later. */
-		tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE +
-				_9P_TYPE_SIZE);
-		_9p_AddFlushHook(&req->r_u._9p, tag,
-				 sequence++);
-		LogFullDebug(COMPONENT_9P,
-			     "Request tag is %d\n", tag);
-
-		/* Message was OK push it */
-		DispatchWork9P(req);
-
-		/* Not our buffer anymore */
-		_9pmsg = NULL;
+			if (tconn->msglen < _9P_STD_HDR_SIZE) {
+				LogEvent(COMPONENT_9P,
+					 "Header too small! for client %s on socket %lu: msglen=%u expected=%u",
+					 tconn->strcaller, tcp_sock,
+					 tconn->msglen, _9P_STD_HDR_SIZE);
+				return false;
+			}
+
+			tconn->msg = gsh_malloc(tconn->msglen);
+			memcpy(tconn->msg, tconn->hdr, _9P_HDR_SIZE);
+		}
+
+		readlen = recv(tcp_sock, tconn->msg + tconn->have,
+			       tconn->msglen - tconn->have, MSG_DONTWAIT);
+		if (readlen <= 0)
+			goto check;
+
+		tconn->have += readlen;
+		if (tconn->have == tconn->msglen) {
+			_9p_tcp_dispatch(tconn);
+			msgs++;
+		}
 		continue;
 
-badmsg:
+check:
+		if (readlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (readlen < 0 && errno == EINTR)
+			continue;
+
 		if (readlen == 0)
 			LogEvent(COMPONENT_9P,
 				 "Premature end for Client %s on socket %lu, total read = %u",
-				 strcaller, tcp_sock, total_readlen);
-		else if (readlen < 0) {
+				 tconn->strcaller, tcp_sock, tconn->have);
+		else
 			LogEvent(COMPONENT_9P,
 				 "Read error client %s on socket %lu errno=%d, total read = %u",
-				 strcaller, tcp_sock,
-				 errno, total_readlen);
-		} else
-			LogEvent(COMPONENT_9P,
-				 "Header too small! for client %s on socket %lu: readlen=%u expected=%u",
-				 strcaller, tcp_sock, readlen,
-				 _9P_HDR_SIZE);
+				 tconn->strcaller, tcp_sock, errno,
+				 tconn->have);
 
 		/* Either way, we close the connection.
 		 * It is not possible to survive
 		 * once we get out of sync in the TCP stream
 		 * with the client
 		 */
-		break; /* bail out */
-	}			/* for( ;; ) */
+		return false;
+	}
 
-end:
-	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
-	close(tcp_sock);
+	return true;
+}
 
-	/* Free buffer if we encountered an error
-	 * before we could give it to a worker */
-	if (_9pmsg)
-		gsh_free(_9pmsg);
+/**
+ * _9p_event_thread: read 9P/TCP requests on a set of connections.
+ *
+ * @param Arg the struct _9p_event_thread
+ *
+ * @return NULL
+ *
+ */
 
-	while (atomic_fetch_uint32_t(&_9p_conn.refcount)) {
-		LogEvent(COMPONENT_9P, "Waiting for workers to release pconn");
-		sleep(1);
+static void *_9p_event_thread(void *Arg)
+{
+	struct _9p_event_thread *thr = Arg;
+	struct epoll_event events[_9P_EVENTS_PER_WAIT];
+	struct _9p_tcp_conn *tconn;
+	struct glist_head *glist;
+	struct glist_head *glistn;
+	char my_name[32];
+	int timeout;
+	int nfds;
+	int i;
+
+	snprintf(my_name, sizeof(my_name), "9p_epoll#%d", thr->index);
+	SetNameFunction(my_name);
+
+	for (;;) {
+		/* Look again in a while for closed connections
+		 * workers still have */
+		timeout = glist_empty(&thr->closing) ? -1 : 1000;
+
+		nfds = epoll_wait(thr->epfd, events, _9P_EVENTS_PER_WAIT,
+				  timeout);
+		if (nfds == -1) {
+			/* Interruption if not an issue */
+			if (errno == EINTR)
+				continue;
+
+			LogCrit(COMPONENT_9P,
+				"Got error %u (%s) on epoll fd %d",
+				errno, strerror(errno), thr->epfd);
+			nfds = 0;
+		}
+
+		for (i = 0; i < nfds; i++) {
+			tconn = events[i].data.ptr;
+
+			if ((events[i].events & EPOLLIN) &&
+			    !_9p_tcp_read(tconn)) {
+				_9p_tcp_close(thr, tconn);
+				continue;
+			}
+
+			if (events[i].events &
+			    (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+				LogEvent(COMPONENT_9P,
+					 "Client %s on socket %lu has shut down and closed",
+					 tconn->strcaller,
+					 tconn->conn.trans_data.sockfd);
+				_9p_tcp_close(thr, tconn);
+			}
+		}
+
+		glist_for_each_safe(glist, glistn, &thr->closing) {
+			tconn = glist_entry(glist, struct _9p_tcp_conn,
+					    closing);
+			if (atomic_fetch_uint32_t(&tconn->conn.refcount))
+				continue;
+			glist_del(&tconn->closing);
+			_9p_tcp_conn_release(tconn);
+		}
 	}
 
-	_9p_cleanup_fids(&_9p_conn);
+	return NULL;
+}				/* _9p_event_thread */
 
-	if (_9p_conn.client != NULL)
-		put_gsh_client(_9p_conn.client);
+/**
+ * @brief Start the event threads
+ *
+ * @param[in] attr_thr Thread attributes
+ */
 
-	pthread_exit(NULL);
-}				/* _9p_socket_thread */
+static void _9p_start_event_threads(pthread_attr_t *attr_thr)
+{
+	int nthreads = _9p_param._9p_tcp_event_threads;
+	struct _9p_event_thread *thr;
+	int rc;
+	int i;
+
+	_9p_event_threads = gsh_calloc(nthreads, sizeof(*_9p_event_threads));
+
+	for (i = 0; i < nthreads; i++) {
+		thr = &_9p_event_threads[i];
+		thr->index = i;
+		glist_init(&thr->closing);
+
+		thr->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (thr->epfd == -1)
+			LogFatal(COMPONENT_9P_DISPATCH,
+				 "Could not create 9p epoll fd, error = %d (%s)",
+				 errno, strerror(errno));
+
+		rc = pthread_create(&thr->id, attr_thr, _9p_event_thread, thr);
+		if (rc != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create 9p event thread, error = %d (%s)",
+				 rc, strerror(rc));
+	}
+}
 
 /**
  * _9p_create_socket_V4 : create the socket and bind for 9P using
@@ -540,10 +729,9 @@ err:
 void *_9p_dispatcher_thread(void *Arg)
 {
 	int _9p_socket;
-	int rc = 0;
 	long int newsock = -1;
 	pthread_attr_t attr_thr;
-	pthread_t tcp_thrid;
+	unsigned int next_thread = 0;
 
 	SetNameFunction("_9p_disp");
 
@@ -576,9 +764,15 @@ void *_9p_dispatcher_thread(void *Arg)
 		LogDebug(COMPONENT_9P_DISPATCH,
 			 "can't set pthread's join state");
 
+	_9p_start_event_threads(&attr_thr);
+
 	LogEvent(COMPONENT_9P_DISPATCH, "9P dispatcher started");
 
 	while (true) {
+		struct _9p_event_thread *thr;
+		struct _9p_tcp_conn *tconn;
+		struct epoll_event ev;
+
 		newsock = accept(_9p_socket, NULL, NULL);
 
 		if (newsock < 0) {
@@ -587,13 +781,21 @@ void *_9p_dispatcher_thread(void *Arg)
 			continue;
 		}
 
-		/* Starting the thread dedicated to signal handling */
-		rc = pthread_create(&tcp_thrid, &attr_thr,
-				    _9p_socket_thread, (void *)newsock);
-		if (rc != 0) {
-			LogFatal(COMPONENT_THREAD,
-				 "Could not create 9p socket manager thread, error = %d (%s)",
-				 errno, strerror(errno));
+		tconn = _9p_tcp_conn_new(newsock);
+
+		/* Spread the connections over the event threads */
+		thr = &_9p_event_threads[next_thread++ %
+					 _9p_param._9p_tcp_event_threads];
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = tconn;
+
+		if (epoll_ctl(thr->epfd, EPOLL_CTL_ADD, newsock, &ev) == -1) {
+			LogCrit(COMPONENT_9P_DISPATCH,
+				"Could not watch 9p socket %ld, error = %d (%s)",
+				newsock, errno, strerror(errno));
+			_9p_tcp_conn_free(tconn);
 		}
 	}			/* while */
 
@@ -80,10 +80,10 @@ static void *_9p_rdma_cleanup_conn_thread(void *arg)
 			 trans);
 
 		if (priv->pconn) {
+			_9p_cleanup_fids(priv->pconn);
+
 			if (priv->pconn->client != NULL)
 				put_gsh_client(priv->pconn->client);
-
-			_9p_cleanup_fids(priv->pconn);
 		}
 
 		if (priv->pconn)
@@ -155,6 +155,7 @@ void *_9p_rdma_thread(void *Arg)
 	}
 	p_9p_conn->sequence = 0;
 	atomic_store_uint32_t(&p_9p_conn->refcount, 0);
+	_9p_init_fids(p_9p_conn);
 	p_9p_conn->trans_type = _9P_RDMA;
 	p_9p_conn->trans_data.rdma_trans = trans;
 
@@ -168,11 +169,6 @@ void *_9p_rdma_thread(void *Arg)
 	p_9p_conn->client =
 		get_gsh_client(&p_9p_conn->addrpeer, false);
 
-	/* Init the fids pointers array */
-	memset(&p_9p_conn->fids,
-	       0,
-	       _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
-
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
 	p_9p_conn->msize = _9p_param._9p_rdma_msize;
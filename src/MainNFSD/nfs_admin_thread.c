@@ -42,6 +42,10 @@
 #include "export_mgr.h"
 #include "fsal.h"
 #include "netgroup_cache.h"
+#ifdef _USE_NLM
+#include "nsm.h"
+#include "nlm_async.h"
+#endif
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #endif
@@ -418,6 +422,13 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "General fridge shut down.");
 	}
 
+	idmapper_shutdown();
+
+#ifdef _USE_NLM
+	nsm_shutdown();
+	nlm_async_callback_shutdown();
+#endif
+
 	rc = reaper_shutdown();
 	if (rc != 0) {
 		LogMajor(COMPONENT_THREAD,
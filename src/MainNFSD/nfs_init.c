@@ -64,6 +64,7 @@
 #include "delayed_exec.h"
 #include "client_mgr.h"
 #include "export_mgr.h"
+#include "server_stats.h"
 #ifdef USE_CAPS
 #include <sys/capability.h>	/* For capget/capset */
 #endif
@@ -391,6 +392,9 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 		return -1;
 	}
 
+	/* Stats sharding depends on Shard_Client_Stats */
+	server_stats_init();
+
 	/* Worker paramters: ip/name hash table and expiration for each entry */
 	(void) load_config_from_parse(parse_tree,
 				      &nfs_ip_name,
@@ -820,7 +824,7 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	/* Create stable storage directory, this needs to be done before
 	 * starting the recovery thread.
 	 */
-	nfs4_create_recov_dir();
+	nfs4_recovery_init();
 
 	/* read in the client IDs */
 	nfs4_load_recov_clids(NULL);
@@ -972,7 +976,8 @@ void nfs_start(nfs_start_info_t *p_start_info)
 
 	/* if not in grace period, clean up the old state directory */
 	if (!nfs_in_grace())
-		nfs4_clean_old_recov_dir(v4_old_dir);
+		nfs4_recovery_cleanup();
+	nfs4_recovery_shutdown();
 
 	Cleanup();
 
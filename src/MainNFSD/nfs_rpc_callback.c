@@ -1125,7 +1125,7 @@ static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
  retry:
 	for (cur = 0;
 	     cur < MIN(session->back_channel_attrs.ca_maxrequests,
-		       NFS41_NB_SLOTS);
+		       NFS41_NB_CB_SLOTS);
 	     ++cur) {
 
 		if (!(session->cb_slots[cur].in_use) && (!found)) {
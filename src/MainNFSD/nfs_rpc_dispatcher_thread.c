@@ -44,6 +44,8 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
 #include "hashtable.h"
 #include "log.h"
 #include "gsh_rpc.h"
@@ -62,6 +64,7 @@
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "fridgethr.h"
+#include "client_mgr.h"
 
 #define NFS_pcp nfs_param.core_param
 #define NFS_options NFS_pcp.core_options
@@ -1193,6 +1196,12 @@ static void nfs_rpc_free_user_data(SVCXPRT *xprt)
 		nfs_dupreq_put_drc(xprt, xprt->xp_u2, DRC_FLAG_RELEASE);
 		xprt->xp_u2 = NULL;
 	}
+	if (xprt->xp_u1) {
+		gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+		if (xu->client != NULL)
+			put_gsh_client(xu->client);
+	}
 	free_gsh_xprt_private(xprt);
 }
 
@@ -1200,28 +1209,66 @@ uint32_t nfs_rpc_outstanding_reqs_est(void)
 {
 	static uint32_t ctr;
 	static uint32_t nreqs;
-	struct req_q_pair *qpair;
 	uint32_t treqs;
-	int ix;
+	uint32_t ix;
 
 	if ((atomic_inc_uint32_t(&ctr) % 10) != 0)
 		return atomic_fetch_uint32_t(&nreqs);
 
 	treqs = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		treqs += atomic_fetch_uint32_t(&qpair->producer.size);
-		treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
-	}
+	for (ix = 0; ix < nfs_req_st.reqs.nshards; ++ix)
+		treqs += atomic_fetch_uint32_t(
+				&nfs_req_st.reqs.shards[ix].size);
 
 	atomic_store_uint32_t(&nreqs, treqs);
 	return treqs;
 }
 
+/**
+ * @brief Outstanding request cap of a client
+ *
+ * @return The cap, 0 if none.
+ */
+static inline uint32_t nfs_rpc_client_max_reqs(struct gsh_client *client)
+{
+	uint32_t max = atomic_fetch_uint32_t(&client->qos_max_reqs);
+
+	return max ? max : nfs_param.core_param.dispatch_client_max_reqs;
+}
+
+/**
+ * @brief Whether the client of a transport has a share of its cap
+ *
+ * Only connections remember their client, and only fair queuing
+ * counts a client's requests.
+ *
+ * @param[in] xprt  The transport
+ * @param[in] share Divisor of the cap
+ */
+static inline bool nfs_rpc_client_over(SVCXPRT *xprt, uint32_t share)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+	struct gsh_client *client;
+	uint32_t max;
+
+	if (!nfs_param.core_param.dispatch_fair_queuing || xu == NULL)
+		return false;
+
+	client = atomic_fetch_voidptr((void **)&xu->client);
+	if (client == NULL)
+		return false;
+
+	max = nfs_rpc_client_max_reqs(client);
+
+	return max != 0 &&
+	       atomic_fetch_uint32_t(&client->qos_reqs) >= max / share;
+}
+
 static inline bool stallq_should_unstall(SVCXPRT *xprt)
 {
 	return ((xprt->xp_requests
-		 < nfs_param.core_param.dispatch_max_reqs_xprt / 2)
+		 < nfs_param.core_param.dispatch_max_reqs_xprt / 2
+		 && !nfs_rpc_client_over(xprt, 2))
 		|| (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED));
 }
 
@@ -1283,8 +1330,9 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 	bool activate = false;
 	uint32_t nreqs = xprt->xp_requests;
 
-	/* check per-xprt quota */
-	if (likely(nreqs < nfs_param.core_param.dispatch_max_reqs_xprt)) {
+	/* check per-xprt and per-client quota */
+	if (likely(nreqs < nfs_param.core_param.dispatch_max_reqs_xprt &&
+		   !nfs_rpc_client_over(xprt, 1))) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "xprt %p xp_refs %" PRIu32 " has %" PRIu32
 			 " reqs active (max %d)",
@@ -1339,12 +1387,255 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 	return true;
 }
 
+void thr_deferq(struct fridgethr_context *thr_ctx)
+{
+	request_data_t *reqdata;
+	struct timespec ts;
+
+	PTHREAD_MUTEX_lock(&nfs_req_st.deferq.mtx);
+
+	while ((reqdata = glist_first_entry(&nfs_req_st.deferq.q,
+					    request_data_t, req_q)) != NULL) {
+		now(&ts);
+		if (reqdata->r_u.req.deferred_until > timespec_to_nsecs(&ts)) {
+			nsecs_to_timespec(reqdata->r_u.req.deferred_until, &ts);
+			(void) pthread_cond_timedwait(&nfs_req_st.deferq.cv,
+						      &nfs_req_st.deferq.mtx,
+						      &ts);
+			continue;
+		}
+
+		glist_del(&reqdata->req_q);
+		PTHREAD_MUTEX_unlock(&nfs_req_st.deferq.mtx);
+
+		nfs_rpc_complete_async_request(&reqdata->r_u.req);
+
+		PTHREAD_MUTEX_lock(&nfs_req_st.deferq.mtx);
+	}
+
+	nfs_req_st.deferq.active = false;
+	PTHREAD_MUTEX_unlock(&nfs_req_st.deferq.mtx);
+
+	LogDebug(COMPONENT_DISPATCH, "deferq idle, thread exit");
+}
+
+static int deferq_cmpf(struct glist_head *a, struct glist_head *b)
+{
+	request_data_t *ra = glist_entry(a, request_data_t, req_q);
+	request_data_t *rb = glist_entry(b, request_data_t, req_q);
+
+	/* Requests with the same deadline go in the order deferred */
+	return ra->r_u.req.deferred_until > rb->r_u.req.deferred_until
+		? 1 : -1;
+}
+
+/**
+ * @brief Requeue a suspended request after a delay
+ *
+ * Used for requests held back by rate limiting, so the worker can move
+ * on to other requests instead of sleeping.  The request is completed
+ * with nfs_rpc_complete_async_request once the delay has passed.
+ *
+ * @param[in] reqnfs	The request, about to return NFS_REQ_ASYNC_WAIT
+ * @param[in] delay	Nanoseconds to hold it back
+ */
+void nfs_rpc_defer_req(nfs_request_t *reqnfs, nsecs_elapsed_t delay)
+{
+	request_data_t *reqdata = container_of(reqnfs, request_data_t, r_u.req);
+	struct timespec ts;
+	bool activate = false;
+
+	now(&ts);
+	reqnfs->deferred_until = timespec_to_nsecs(&ts) + delay;
+
+	PTHREAD_MUTEX_lock(&nfs_req_st.deferq.mtx);
+
+	glist_insert_sorted(&nfs_req_st.deferq.q, &reqdata->req_q, deferq_cmpf);
+
+	/* if no thread is servicing the deferq, start one */
+	if (!nfs_req_st.deferq.active) {
+		nfs_req_st.deferq.active = true;
+		activate = true;
+	} else if (nfs_req_st.deferq.q.next == &reqdata->req_q) {
+		/* new earliest deadline */
+		pthread_cond_signal(&nfs_req_st.deferq.cv);
+	}
+
+	PTHREAD_MUTEX_unlock(&nfs_req_st.deferq.mtx);
+
+	if (activate) {
+		int rc = 0;
+
+		LogDebug(COMPONENT_DISPATCH, "starting deferq service thread");
+		rc = fridgethr_submit(req_fridge, thr_deferq,
+				      NULL /* no arg */);
+		if (rc != 0) {
+			/* the next deferral tries again */
+			LogCrit(COMPONENT_DISPATCH,
+				"Failed to start deferq: %d", rc);
+			PTHREAD_MUTEX_lock(&nfs_req_st.deferq.mtx);
+			nfs_req_st.deferq.active = false;
+			PTHREAD_MUTEX_unlock(&nfs_req_st.deferq.mtx);
+		}
+	}
+}
+
+/**
+ * @brief NUMA node of a CPU
+ *
+ * @param[in] cpu The CPU
+ *
+ * @return The node, or 0 if sysfs does not say.
+ */
+static uint32_t nfs_rpc_cpu_node(uint32_t cpu)
+{
+	char path[64];
+	DIR *dir;
+	struct dirent *de;
+	uint32_t node = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%" PRIu32,
+		 cpu);
+
+	dir = opendir(path);
+	if (dir == NULL)
+		return 0;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp(de->d_name, "node", 4) == 0 &&
+		    isdigit(de->d_name[4])) {
+			node = strtoul(de->d_name + 4, NULL, 10);
+			break;
+		}
+	}
+
+	closedir(dir);
+
+	return node;
+}
+
+/**
+ * @brief Build the order in which the request classes are served
+ *
+ * Each class appears as often as its Dispatch_Weight_* and the
+ * appearances are spread out (smooth weighted round robin), so a
+ * heavy class does not get its turns in one burst.
+ */
+static void nfs_rpc_queue_schedule_init(void)
+{
+	uint32_t weight[N_REQ_QUEUES];
+	int32_t current[N_REQ_QUEUES] = { 0 };
+	uint32_t total = 0;
+	uint32_t ix, iy, best;
+
+	weight[REQ_Q_MOUNT] = NFS_pcp.dispatch_weight_mount;
+	weight[REQ_Q_CALL] = NFS_pcp.dispatch_weight_call;
+	weight[REQ_Q_LOW_LATENCY] = NFS_pcp.dispatch_weight_low_latency;
+	weight[REQ_Q_HIGH_LATENCY] = NFS_pcp.dispatch_weight_high_latency;
+
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+		if (weight[ix] == 0)
+			weight[ix] = 1;
+		total += weight[ix];
+	}
+
+	gsh_free(nfs_req_st.reqs.schedule);
+	nfs_req_st.reqs.schedule = gsh_malloc(total);
+	nfs_req_st.reqs.schedule_len = total;
+
+	for (ix = 0; ix < total; ++ix) {
+		best = 0;
+		for (iy = 0; iy < N_REQ_QUEUES; ++iy) {
+			current[iy] += weight[iy];
+			if (current[iy] > current[best])
+				best = iy;
+		}
+		current[best] -= total;
+		nfs_req_st.reqs.schedule[ix] = best;
+	}
+}
+
+/**
+ * @brief Set up the request queue shards
+ *
+ * Called at init, and by tests; the queues must be empty and no
+ * worker may be running.
+ *
+ * @param[in] shard_by DISPATCH_SHARD_NONE, _CPU or _NODE
+ */
+void nfs_rpc_queue_shards_init(uint32_t shard_by)
+{
+	struct req_q_shard *shard;
+	struct req_q_pair *qpair;
+	long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	uint32_t nshards = 1;
+	uint32_t cpu, ix, iy;
+	size_t size;
+
+	if (ncpus < 1)
+		ncpus = 1;
+
+	gsh_free(nfs_req_st.reqs.shards);
+	gsh_free(nfs_req_st.reqs.cpu_shard);
+
+	nfs_req_st.reqs.ncpus = ncpus;
+	nfs_req_st.reqs.cpu_shard = gsh_calloc(ncpus, sizeof(uint32_t));
+
+	for (cpu = 0; cpu < ncpus; ++cpu) {
+		switch (shard_by) {
+		case DISPATCH_SHARD_CPU:
+			ix = cpu;
+			break;
+		case DISPATCH_SHARD_NODE:
+			/* Nodes without CPUs just make empty shards */
+			ix = nfs_rpc_cpu_node(cpu);
+			if (ix >= ncpus)
+				ix = 0;
+			break;
+		default:
+			ix = 0;
+			break;
+		}
+		nfs_req_st.reqs.cpu_shard[cpu] = ix;
+		if (ix >= nshards)
+			nshards = ix + 1;
+	}
+
+	size = sizeof(struct req_q_shard) * nshards;
+	nfs_req_st.reqs.shards = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+						    size);
+	memset(nfs_req_st.reqs.shards, 0, size);
+	nfs_req_st.reqs.nshards = nshards;
+	nfs_req_st.reqs.waiters = 0;
+
+	for (ix = 0; ix < nshards; ++ix) {
+		shard = &nfs_req_st.reqs.shards[ix];
+		for (iy = 0; iy < N_REQ_QUEUES; ++iy) {
+			qpair = &shard->nfs_request_q.qset[iy];
+			qpair->s = req_q_s[iy];
+			nfs_rpc_q_init(&qpair->producer);
+			nfs_rpc_q_init(&qpair->consumer);
+		}
+		for (iy = 0; iy < N_REQ_QUEUES; ++iy) {
+			pthread_spin_init(&shard->fq[iy].sp,
+					  PTHREAD_PROCESS_PRIVATE);
+			glist_init(&shard->fq[iy].active);
+		}
+		pthread_spin_init(&shard->sp, PTHREAD_PROCESS_PRIVATE);
+		glist_init(&shard->wait_list);
+	}
+
+	nfs_rpc_queue_schedule_init();
+
+	LogInfo(COMPONENT_DISPATCH,
+		"%" PRIu32 " request queue shard(s) for %ld CPUs",
+		nshards, ncpus);
+}
+
 void nfs_rpc_queue_init(void)
 {
 	struct fridgethr_params reqparams;
-	struct req_q_pair *qpair;
 	int rc = 0;
-	int ix;
 
 	memset(&reqparams, 0, sizeof(struct fridgethr_params));
     /**
@@ -1364,25 +1655,20 @@ void nfs_rpc_queue_init(void)
 		LogFatal(COMPONENT_DISPATCH,
 			 "Unable to initialize decoder thread pool: %d", rc);
 
-	/* queues */
-	pthread_spin_init(&nfs_req_st.reqs.sp, PTHREAD_PROCESS_PRIVATE);
-	nfs_req_st.reqs.size = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		qpair->s = req_q_s[ix];
-		nfs_rpc_q_init(&qpair->producer);
-		nfs_rpc_q_init(&qpair->consumer);
-	}
-
-	/* waitq */
-	glist_init(&nfs_req_st.reqs.wait_list);
-	nfs_req_st.reqs.waiters = 0;
+	/* queues and waitqs */
+	nfs_rpc_queue_shards_init(nfs_param.core_param.dispatch_shard_by);
 
 	/* stallq */
 	gsh_mutex_init(&nfs_req_st.stallq.mtx, NULL);
 	glist_init(&nfs_req_st.stallq.q);
 	nfs_req_st.stallq.active = false;
 	nfs_req_st.stallq.stalled = 0;
+
+	/* deferq */
+	gsh_mutex_init(&nfs_req_st.deferq.mtx, NULL);
+	PTHREAD_COND_init(&nfs_req_st.deferq.cv, NULL);
+	glist_init(&nfs_req_st.deferq.q);
+	nfs_req_st.deferq.active = false;
 }
 
 static uint32_t enqueued_reqs;
@@ -1398,11 +1684,221 @@ uint32_t get_dequeue_count(void)
 	return dequeued_reqs;
 }
 
+/**
+ * @brief Wake a worker for a request queued on a shard
+ *
+ * A worker waiting on the shard itself is preferred.  Failing that,
+ * a worker waiting on another shard is woken to steal the request, so
+ * a request never waits for the busy workers of its own shard while
+ * others are idle.
+ *
+ * @param[in] shard Shard the request was queued on
+ */
+static void nfs_rpc_wake_worker(struct req_q_shard *shard)
+{
+	struct req_q_shard *shards = nfs_req_st.reqs.shards;
+	uint32_t nshards = nfs_req_st.reqs.nshards;
+	uint32_t start = shard - shards;
+	struct req_q_shard *other;
+	wait_q_entry_t *wqe;
+	uint32_t ix;
+
+	/* Under load nobody waits; don't even look at the shards */
+	if (atomic_fetch_uint32_t(&nfs_req_st.reqs.waiters) == 0)
+		return;
+
+	for (ix = 0; ix < nshards; ++ix) {
+		other = &shards[(start + ix) % nshards];
+
+		if (atomic_fetch_uint32_t(&other->waiters) == 0)
+			continue;
+
+		/* SPIN LOCKED */
+		pthread_spin_lock(&other->sp);
+		if (other->waiters == 0) {
+			pthread_spin_unlock(&other->sp);
+			continue;
+		}
+
+		wqe = glist_first_entry(&other->wait_list, wait_q_entry_t,
+					waitq);
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "shard %" PRIu32 " waiters %u signal wqe %p (for shard %"
+			     PRIu32 ")",
+			     (uint32_t) (other - shards), other->waiters, wqe,
+			     start);
+
+		/* release 1 waiter */
+		glist_del(&wqe->waitq);
+		(void) atomic_dec_uint32_t(&other->waiters);
+		(void) atomic_dec_uint32_t(&nfs_req_st.reqs.waiters);
+		--(wqe->waiters);
+		/* ! SPIN LOCKED */
+		pthread_spin_unlock(&other->sp);
+		PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
+		/* XXX reliable handoff */
+		wqe->flags |= Wqe_LFlag_SyncDone;
+		if (wqe->flags & Wqe_LFlag_WaitSync)
+			pthread_cond_signal(&wqe->lwe.cv);
+		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+		return;
+	}
+}
+
+/**
+ * @brief Client of a transport
+ *
+ * Connections remember their client, so it is looked up once per
+ * connection rather than once per request.  UDP transports are shared
+ * by every client.
+ *
+ * @param[in] xprt The transport
+ *
+ * @return The client, with a reference, or NULL.
+ */
+static struct gsh_client *nfs_rpc_xprt_client(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+	struct gsh_client *client;
+
+	if (xu != NULL && xu->client != NULL) {
+		inc_gsh_client_refcount(xu->client);
+		return xu->client;
+	}
+
+	client = get_gsh_client((sockaddr_t *) svc_getrpccaller(xprt), false);
+
+	/* Only the connection's decoder gets here (decoder guard) */
+	if (client != NULL && xu != NULL && xprt->xp_type != XPRT_UDP) {
+		inc_gsh_client_refcount(client);
+		atomic_store_voidptr((void **)&xu->client, client);
+	}
+
+	return client;
+}
+
+static inline uint32_t nfs_rpc_client_weight(struct gsh_client *client)
+{
+	uint32_t weight = atomic_fetch_uint32_t(&client->qos_weight);
+
+	return weight ? weight : NFS_pcp.dispatch_client_weight;
+}
+
+/**
+ * @brief A client's flow in one class of one shard
+ *
+ * The client's flows are allocated on its first queued request.
+ *
+ * @param[in] client The client
+ * @param[in] shard  The shard
+ * @param[in] slot   The request class
+ */
+static struct req_flow *nfs_rpc_client_flow(struct gsh_client *client,
+					    struct req_q_shard *shard,
+					    uint32_t slot)
+{
+	struct req_flow *flows;
+	uint32_t ix, n;
+
+	flows = atomic_fetch_voidptr((void **)&client->qos_flows);
+	if (unlikely(flows == NULL)) {
+		PTHREAD_RWLOCK_wrlock(&client->lock);
+		flows = client->qos_flows;
+		if (flows == NULL) {
+			n = nfs_req_st.reqs.nshards * N_REQ_QUEUES;
+			flows = gsh_calloc(n, sizeof(struct req_flow));
+			for (ix = 0; ix < n; ++ix)
+				glist_init(&flows[ix].q);
+			atomic_store_voidptr((void **)&client->qos_flows,
+					     flows);
+		}
+		PTHREAD_RWLOCK_unlock(&client->lock);
+	}
+
+	return &flows[(shard - nfs_req_st.reqs.shards) * N_REQ_QUEUES + slot];
+}
+
+/**
+ * @brief Queue a request on its client's flow
+ *
+ * A flow that had nothing queued joins the end of the line.
+ */
+static void nfs_rpc_fq_enqueue(struct req_fq *fq, struct req_flow *flow,
+			       request_data_t *reqdata)
+{
+	pthread_spin_lock(&fq->sp);
+	glist_add_tail(&flow->q, &reqdata->req_q);
+	if ((flow->size)++ == 0) {
+		flow->deficit =
+			nfs_rpc_client_weight(reqdata->r_u.req.client);
+		glist_add_tail(&fq->active, &flow->link);
+	}
+	++(fq->size);
+	pthread_spin_unlock(&fq->sp);
+}
+
+/**
+ * @brief Take the next request in deficit round robin order
+ *
+ * The flow at the head of the line is served until it has used up its
+ * weight in requests, then goes to the back of the line.
+ *
+ * @return A request, or NULL if no flow has any.
+ */
+static request_data_t *nfs_rpc_fq_dequeue(struct req_fq *fq)
+{
+	request_data_t *reqdata = NULL;
+	struct req_flow *flow;
+
+	pthread_spin_lock(&fq->sp);
+	flow = glist_first_entry(&fq->active, struct req_flow, link);
+	if (flow == NULL)
+		goto out;
+
+	reqdata = glist_first_entry(&flow->q, request_data_t, req_q);
+	glist_del(&reqdata->req_q);
+	--(fq->size);
+
+	if (--(flow->size) == 0) {
+		glist_del(&flow->link);
+	} else if (--(flow->deficit) == 0) {
+		flow->deficit =
+			nfs_rpc_client_weight(reqdata->r_u.req.client);
+		glist_del(&flow->link);
+		glist_add_tail(&fq->active, &flow->link);
+	}
+
+ out:
+	pthread_spin_unlock(&fq->sp);
+	return reqdata;
+}
+
+/**
+ * @brief Release a request's charge against its client
+ *
+ * @param[in] reqdata The request, done with
+ */
+void nfs_rpc_fq_release(request_data_t *reqdata)
+{
+	struct gsh_client *client = reqdata->r_u.req.client;
+
+	if (client == NULL)
+		return;
+
+	(void) atomic_dec_uint32_t(&client->qos_reqs);
+	put_gsh_client(client);
+	reqdata->r_u.req.client = NULL;
+}
+
 void nfs_rpc_enqueue_req(request_data_t *reqdata)
 {
+	struct req_q_shard *shard;
 	struct req_q_set *nfs_request_q;
 	struct req_q_pair *qpair;
 	struct req_q *q;
+	struct gsh_client *client = NULL;
+	uint32_t slot;
 
 #if defined(HAVE_BLKIN)
 	BLKIN_TIMESTAMP(
@@ -1411,7 +1907,8 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-enter");
 #endif
 
-	nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	shard = nfs_rpc_q_local_shard();
+	nfs_request_q = &shard->nfs_request_q;
 
 	switch (reqdata->rtype) {
 	case NFS_REQUEST:
@@ -1419,32 +1916,65 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 			     "enter rq_xid=%" PRIu32 " lookahead.flags=%u",
 			     reqdata->r_u.req.svc.rq_msg.rm_xid,
 			     reqdata->r_u.req.lookahead.flags);
-		if (reqdata->r_u.req.lookahead.flags & NFS_LOOKAHEAD_MOUNT) {
-			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
+		if (reqdata->r_u.req.lookahead.flags & NFS_LOOKAHEAD_MOUNT)
+			slot = REQ_Q_MOUNT;
+		else if (NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead))
+			slot = REQ_Q_HIGH_LATENCY;
+		else
+			slot = REQ_Q_LOW_LATENCY;
+
+		/* Resumed requests already hold resources, so they do
+		 * not wait for their client's turn again.
+		 */
+		if (reqdata->r_u.req.async_flags & NFS_REQ_ASYNC_SUSPENDED)
 			break;
+
+		if (NFS_pcp.dispatch_fair_queuing &&
+		    reqdata->r_u.req.client == NULL) {
+			reqdata->r_u.req.client = nfs_rpc_xprt_client(
+					reqdata->r_u.req.svc.rq_xprt);
+			if (reqdata->r_u.req.client != NULL)
+				(void) atomic_inc_uint32_t(
+					&reqdata->r_u.req.client->qos_reqs);
 		}
-		if (NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead))
-			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
-		else
-			qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
+		client = reqdata->r_u.req.client;
 		break;
 	case NFS_CALL:
-		qpair = &(nfs_request_q->qset[REQ_Q_CALL]);
+		slot = REQ_Q_CALL;
 		break;
 #ifdef _USE_9P
 	case _9P_REQUEST:
-		/* XXX identify high-latency requests and allocate
-		 * to the high-latency queue, as above */
-		qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
+		if (_9p_high_latency(&reqdata->r_u._9p))
+			slot = REQ_Q_HIGH_LATENCY;
+		else
+			slot = REQ_Q_LOW_LATENCY;
 		break;
 #endif
 	default:
 		goto out;
 	}
 
+	qpair = &(nfs_request_q->qset[slot]);
+
 	/* this one is real, timestamp it
 	 */
 	now(&reqdata->time_queued);
+
+	/* count it before it can be found, so size never underflows */
+	(void) atomic_inc_uint32_t(&shard->size);
+
+	if (client != NULL) {
+		nfs_rpc_fq_enqueue(&shard->fq[slot],
+				   nfs_rpc_client_flow(client, shard, slot),
+				   reqdata);
+		(void) atomic_inc_uint32_t(&enqueued_reqs);
+		LogDebug(COMPONENT_DISPATCH,
+			 "enqueued req for %s, %s fair queue (enq %u deq %u)",
+			 client->hostaddr_str, qpair->s,
+			 enqueued_reqs, dequeued_reqs);
+		goto wake;
+	}
+
 	/* always append to producer queue */
 	q = &qpair->producer;
 	pthread_spin_lock(&q->sp);
@@ -1473,38 +2003,9 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		 q, qpair->s, &qpair->producer, &qpair->consumer, q->size,
 		 enqueued_reqs, dequeued_reqs);
 
+ wake:
 	/* potentially wakeup some thread */
-
-	/* global waitq */
-	{
-		wait_q_entry_t *wqe;
-
-		/* SPIN LOCKED */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		if (nfs_req_st.reqs.waiters) {
-			wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
-						wait_q_entry_t, waitq);
-
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "nfs_req_st.reqs.waiters %u signal wqe %p (for q %p)",
-				     nfs_req_st.reqs.waiters, wqe, q);
-
-			/* release 1 waiter */
-			glist_del(&wqe->waitq);
-			--(nfs_req_st.reqs.waiters);
-			--(wqe->waiters);
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-			PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
-			/* XXX reliable handoff */
-			wqe->flags |= Wqe_LFlag_SyncDone;
-			if (wqe->flags & Wqe_LFlag_WaitSync)
-				pthread_cond_signal(&wqe->lwe.cv);
-			PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
-		} else
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-	}
+	nfs_rpc_wake_worker(shard);
 
  out:
 	return;
@@ -1568,59 +2069,117 @@ request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
 	return reqdata;
 }
 
-request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+/**
+ * @brief Take a request from one shard
+ *
+ * The classes are served in the order of the class schedule, falling
+ * back to the following classes when the scheduled one is empty.
+ *
+ * @param[in] shard The shard
+ *
+ * @return A request, or NULL if the shard is empty.
+ */
+static request_data_t *nfs_rpc_dequeue_shard(struct req_q_shard *shard)
 {
-	request_data_t *reqdata = NULL;
-	struct req_q_set *nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	request_data_t *reqdata;
 	struct req_q_pair *qpair;
+	struct req_fq *fq;
 	uint32_t ix, slot;
-	struct timespec timeout;
 
-	/* XXX: the following stands in for a more robust/flexible
-	 * weighting function */
+	if (atomic_fetch_uint32_t(&shard->size) == 0)
+		return NULL;
 
-	/* slot in 1..4 */
- retry_deq:
-	slot = (nfs_rpc_q_next_slot() % 4);
-	for (ix = 0; ix < 4; ++ix) {
-		switch (slot) {
-		case 0:
-			/* MOUNT */
-			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
-			break;
-		case 1:
-			/* NFS_CALL */
-			qpair = &(nfs_request_q->qset[REQ_Q_CALL]);
-			break;
-		case 2:
-			/* LL */
-			qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
-			break;
-		case 3:
-			/* HL */
-			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
-			break;
-		default:
-			/* not here */
-			abort();
-			break;
-		}
+	/* slot is MOUNT, CALL, LL or HL, in Dispatch_Weight_* shares */
+	slot = nfs_req_st.reqs.schedule[nfs_rpc_q_next_slot(shard) %
+					nfs_req_st.reqs.schedule_len];
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+		qpair = &shard->nfs_request_q.qset[slot];
+		fq = &shard->fq[slot];
+		reqdata = NULL;
 
 		LogFullDebug(COMPONENT_DISPATCH,
 			     "dequeue_req try qpair %s %p:%p", qpair->s,
 			     &qpair->producer, &qpair->consumer);
 
-		/* anything? */
-		reqdata = nfs_rpc_consume_req(qpair);
+		/* anything?  Requests with and without a client take
+		 * turns.
+		 */
+		if (atomic_fetch_uint32_t(&fq->size) != 0 &&
+		    (atomic_inc_uint32_t(&fq->turn) & 1))
+			reqdata = nfs_rpc_fq_dequeue(fq);
+		if (!reqdata)
+			reqdata = nfs_rpc_consume_req(qpair);
+		if (!reqdata && atomic_fetch_uint32_t(&fq->size) != 0)
+			reqdata = nfs_rpc_fq_dequeue(fq);
 		if (reqdata) {
-			(void) atomic_inc_uint32_t(&dequeued_reqs);
-			break;
+			(void) atomic_dec_uint32_t(&shard->size);
+			return reqdata;
 		}
 
-		++slot;
-		slot = slot % 4;
+		slot = (slot + 1) % N_REQ_QUEUES;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Whether any shard has requests queued
+ */
+static bool nfs_rpc_queues_pending(void)
+{
+	uint32_t ix;
+
+	for (ix = 0; ix < nfs_req_st.reqs.nshards; ++ix)
+		if (atomic_fetch_uint32_t(&nfs_req_st.reqs.shards[ix].size))
+			return true;
+
+	return false;
+}
+
+/**
+ * @brief Take a waiting worker off its shard's wait list
+ *
+ * Does nothing if an enqueuer already took it off.
+ *
+ * @param[in] shard Shard the worker waits on
+ * @param[in] wqe   The worker's wait queue entry
+ */
+static void nfs_rpc_unwait(struct req_q_shard *shard, wait_q_entry_t *wqe)
+{
+	pthread_spin_lock(&shard->sp);
+	if (wqe->waitq.next != NULL || wqe->waitq.prev != NULL) {
+		/* Element is still in wqitq, remove it */
+		glist_del(&wqe->waitq);
+		(void) atomic_dec_uint32_t(&shard->waiters);
+		(void) atomic_dec_uint32_t(&nfs_req_st.reqs.waiters);
+		--(wqe->waiters);
+	}
+	pthread_spin_unlock(&shard->sp);
+	wqe->flags &= ~(Wqe_LFlag_WaitSync | Wqe_LFlag_SyncDone);
+}
 
-	}			/* for */
+request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+{
+	request_data_t *reqdata = NULL;
+	struct req_q_shard *shards = nfs_req_st.reqs.shards;
+	uint32_t nshards = nfs_req_st.reqs.nshards;
+	struct req_q_shard *local;
+	uint32_t ix, start;
+	struct timespec timeout;
+
+ retry_deq:
+	/* Own shard first */
+	local = nfs_rpc_q_local_shard();
+	reqdata = nfs_rpc_dequeue_shard(local);
+
+	/* Then steal, starting with the next shard so thieves spread */
+	start = local - shards;
+	for (ix = 1; reqdata == NULL && ix < nshards; ++ix)
+		reqdata = nfs_rpc_dequeue_shard(
+				&shards[(start + ix) % nshards]);
+
+	if (reqdata)
+		(void) atomic_inc_uint32_t(&dequeued_reqs);
 
 	/* wait */
 	if (!reqdata) {
@@ -1633,10 +2192,19 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 		wqe->flags = Wqe_LFlag_WaitSync;
 		wqe->waiters = 1;
 		/* XXX functionalize */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		glist_add_tail(&nfs_req_st.reqs.wait_list, &wqe->waitq);
-		++(nfs_req_st.reqs.waiters);
-		pthread_spin_unlock(&nfs_req_st.reqs.sp);
+		pthread_spin_lock(&local->sp);
+		glist_add_tail(&local->wait_list, &wqe->waitq);
+		(void) atomic_inc_uint32_t(&local->waiters);
+		(void) atomic_inc_uint32_t(&nfs_req_st.reqs.waiters);
+		pthread_spin_unlock(&local->sp);
+
+		/* A request queued since we looked saw no waiter */
+		if (nfs_rpc_queues_pending()) {
+			nfs_rpc_unwait(local, wqe);
+			PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+			goto retry_deq;
+		}
+
 		while (!(wqe->flags & Wqe_LFlag_SyncDone)) {
 			timeout.tv_sec = time(NULL) + 5;
 			timeout.tv_nsec = 0;
@@ -1645,25 +2213,13 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 			if (fridgethr_you_should_break(ctx)) {
 				/* We are returning;
 				 * so take us out of the waitq */
-				pthread_spin_lock(&nfs_req_st.reqs.sp);
-				if (wqe->waitq.next != NULL
-				    || wqe->waitq.prev != NULL) {
-					/* Element is still in wqitq,
-					 * remove it */
-					glist_del(&wqe->waitq);
-					--(nfs_req_st.reqs.waiters);
-					--(wqe->waiters);
-					wqe->flags &=
-					    ~(Wqe_LFlag_WaitSync |
-					      Wqe_LFlag_SyncDone);
-				}
-				pthread_spin_unlock(&nfs_req_st.reqs.sp);
+				nfs_rpc_unwait(local, wqe);
 				PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
 				return NULL;
 			}
 		}
 
-		/* XXX wqe was removed from nfs_req_st.waitq
+		/* XXX wqe was removed from the shard's waitq
 		 * (by signalling thread) */
 		wqe->flags &= ~(Wqe_LFlag_WaitSync | Wqe_LFlag_SyncDone);
 		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
@@ -2024,7 +2580,10 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	if (context) {
 		/* release internal locks, result ignored */
 		stat = SVC_STAT(xprt);
-		/* already running worker thread, do not enqueue */
+		/* already running worker thread, do not enqueue; nor can
+		 * the request be suspended and handed to another worker.
+		 */
+		reqdata->r_u.req.async_flags = NFS_REQ_ASYNC_DISABLED;
 		nfs_rpc_execute(reqdata);
 		return XPRT_IDLE;
 	}
@@ -59,6 +59,8 @@
 #include "export_mgr.h"
 #include "server_stats.h"
 #include "uid2grp.h"
+#include "gsh_iobuf.h"
+#include "rate_limit.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -133,7 +135,8 @@ const nfs_function_desc_t nfs3_func_desc[] = {
 	 .xdr_encode_func = (xdrproc_t) xdr_READ3res,
 	 .funcname = "nfs3_read",
 	 .dispatch_behaviour =
-	 NEEDS_CRED | NEEDS_EXPORT | SUPPORTS_GSS | MAKES_IO},
+	 NEEDS_CRED | NEEDS_EXPORT | SUPPORTS_GSS | MAKES_IO,
+	 .resume_function = nfs3_read_resume},
 	{
 	 .service_function = nfs3_write,
 	 .free_function = nfs3_write_free,
@@ -142,8 +145,8 @@ const nfs_function_desc_t nfs3_func_desc[] = {
 	 .funcname = "nfs3_write",
 	 .dispatch_behaviour =
 	 (MAKES_WRITE | NEEDS_CRED | NEEDS_EXPORT | CAN_BE_DUP | SUPPORTS_GSS |
-	  MAKES_IO)
-	 },
+	  MAKES_IO),
+	 .resume_function = nfs3_write_resume},
 	{
 	 .service_function = nfs3_create,
 	 .free_function = nfs3_create_free,
@@ -282,9 +285,10 @@ const nfs_function_desc_t nfs4_func_desc[] = {
 	 .service_function = nfs4_Compound,
 	 .free_function = nfs4_Compound_Free,
 	 .xdr_decode_func = (xdrproc_t) xdr_COMPOUND4args,
-	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res,
+	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res_extended,
 	 .funcname = "nfs4_Comp",
-	 .dispatch_behaviour = CAN_BE_DUP}
+	 .dispatch_behaviour = CAN_BE_DUP,
+	 .resume_function = nfs4_Compound_resume}
 };
 
 const nfs_function_desc_t mnt1_func_desc[] = {
@@ -702,13 +706,240 @@ const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *reqnfs)
 	return funcdesc;
 }
 
+/**
+ * @brief Send the reply (or not) for a request that has been processed
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in]     rc		Result of the service function
+ */
+static void nfs_rpc_reply(request_data_t *reqdata, int rc)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	struct nfs_encoded_reply *enc;
+	xdrproc_t xdr_reply = reqdesc->xdr_encode_func;
+	void *reply = res_nfs;
+	const char *client_ip = "<unknown client>";
+	bool ok;
+
+	if (op_ctx->client != NULL)
+		client_ip = op_ctx->client->hostaddr_str;
+
+/* NFSv4 stats are handled in nfs4_compound()
+ */
+	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
+	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
+		server_stats_nfs_done(reqdata, rc, false);
+
+	/* If request is dropped, no return to the client */
+	if (rc == NFS_REQ_DROP) {
+		/* The request was dropped */
+		LogDebug(COMPONENT_DISPATCH,
+			 "Drop request rpc_xid=%" PRIu32
+			 ", program %" PRIu32
+			 ", version %" PRIu32
+			 ", function %" PRIu32,
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 reqdata->r_u.req.svc.rq_msg.cb_prog,
+			 reqdata->r_u.req.svc.rq_msg.cb_vers,
+			 reqdata->r_u.req.svc.rq_msg.cb_proc);
+
+		/* If the request is not normally cached, then the entry
+		 * will be removed later.  We only remove a reply that is
+		 * normally cached that has been dropped.
+		 */
+		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
+		    != DUPREQ_SUCCESS) {
+			LogCrit(COMPONENT_DISPATCH,
+				"Attempt to delete duplicate request failed on line %d",
+				__LINE__);
+		}
+		return;
+	} else {
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Before svc_sendreply on socket %d", xprt->xp_fd);
+
+		/* If the DRC keeps the reply encoded, send that */
+		enc = nfs_dupreq_encode(&reqdata->r_u.req.svc, reqdesc,
+					res_nfs);
+		if (enc != NULL) {
+			xdr_reply = (xdrproc_t) xdr_nfs_encoded_reply;
+			reply = enc;
+		}
+
+		/* READ data, or the encoded reply, may go out straight
+		 * from its buffer when the reply is not wrapped by
+		 * RPCSEC_GSS.
+		 */
+		gsh_iobuf_zero_copy(xprt->xp_type == XPRT_TCP &&
+				    reqdata->r_u.req.svc.rq_msg.cb_cred.oa_flavor
+					!= RPCSEC_GSS);
+
+		/* encoding the result on xdr output */
+		ok = svc_sendreply(&reqdata->r_u.req.svc, xdr_reply,
+				   (caddr_t) reply);
+
+		gsh_iobuf_zero_copy(false);
+
+		if (!ok) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request."
+				 " rpcxid=%" PRIu32
+				 " socket=%d function:%s client:%s"
+				 " program:%" PRIu32
+				 " nfs version:%" PRIu32
+				 " proc:%" PRIu32
+				 " errno: %d",
+				 reqdata->r_u.req.svc.rq_msg.rm_xid,
+				 xprt->xp_fd,
+				 reqdesc->funcname,
+				 client_ip,
+				 reqdata->r_u.req.svc.rq_msg.cb_prog,
+				 reqdata->r_u.req.svc.rq_msg.cb_vers,
+				 reqdata->r_u.req.svc.rq_msg.cb_proc,
+				 errno);
+			if (xprt->xp_type != XPRT_UDP)
+				svc_destroy(xprt);
+			return;
+		}
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "After svc_sendreply on socket %d", xprt->xp_fd);
+
+	}			/* rc == NFS_REQ_DROP */
+
+	/* Finish any request not already deleted */
+	(void) nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+}
+
+/**
+ * @brief Release the resources held by a request
+ *
+ * @param[in,out] reqdata	NFS request
+ */
+static void nfs_rpc_release(request_data_t *reqdata)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
+
+	/* Free the allocated resources once the work is done */
+	/* Free the arguments */
+	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
+		if (!SVC_FREEARGS(&reqdata->r_u.req.svc,
+				  reqdesc->xdr_decode_func,
+				  (caddr_t) arg_nfs)) {
+			LogCrit(COMPONENT_DISPATCH,
+				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
+				reqdesc->funcname);
+		}
+	}
+
+	/* Finalize the request, if nfs_dupreq_start was reached.  A
+	 * reply replayed from an encoded DRC entry has no res_nfs.
+	 */
+	if (reqdata->r_u.req.svc.rq_u1 != NULL)
+		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+
+	SetClientIP(NULL);
+	if (op_ctx->client != NULL) {
+		put_gsh_client(op_ctx->client);
+		op_ctx->client = NULL;
+	}
+	if (op_ctx->ctx_export != NULL) {
+		put_gsh_export(op_ctx->ctx_export);
+		op_ctx->ctx_export = NULL;
+	}
+	clean_credentials();
+	op_ctx = NULL;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, end, reqdata);
+#endif
+}
+
+/**
+ * @brief Get a suspended request going again
+ *
+ * A request deferred by rate limiting runs its service function again,
+ * anything else is resumed.
+ *
+ * @param[in,out] reqnfs	NFS request
+ *
+ * @return As the service function.
+ */
+static int nfs_rpc_continue(nfs_request_t *reqnfs)
+{
+	uint32_t flags;
+
+	flags = atomic_postclear_uint32_t_bits(&reqnfs->async_flags,
+					       NFS_REQ_ASYNC_RERUN);
+
+	if (flags & NFS_REQ_ASYNC_RERUN)
+		return reqnfs->funcdesc->service_function(&reqnfs->arg_nfs,
+							  &reqnfs->svc,
+							  reqnfs->res_nfs);
+
+	return reqnfs->funcdesc->resume_function(&reqnfs->arg_nfs,
+						 &reqnfs->svc,
+						 reqnfs->res_nfs);
+}
+
+/**
+ * @brief Finish processing a request
+ *
+ * If the service function suspended the request waiting for asynchronous
+ * I/O, mark it suspended.  If the I/O has already completed, resume it
+ * inline; otherwise, nfs_rpc_complete_async_request will requeue it and
+ * the request no longer belongs to this thread.
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in]     rc		Result of the service function
+ *
+ * @return As nfs_rpc_execute.
+ */
+static bool nfs_rpc_finish(request_data_t *reqdata, int rc)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+	uint32_t flags;
+
+	while (rc == NFS_REQ_ASYNC_WAIT) {
+		flags = atomic_postset_uint32_t_bits(&reqnfs->async_flags,
+						     NFS_REQ_ASYNC_SUSPENDED);
+
+		if ((flags & NFS_REQ_ASYNC_COMPLETE) == 0) {
+			/* Not done yet, whoever completes it requeues it */
+			SetClientIP(NULL);
+			op_ctx = NULL;
+			return false;
+		}
+
+		/* Already done, carry on here */
+		atomic_clear_uint32_t_bits(&reqnfs->async_flags,
+					   NFS_REQ_ASYNC_SUSPENDED |
+					   NFS_REQ_ASYNC_COMPLETE);
+
+		rc = nfs_rpc_continue(reqnfs);
+	}
+
+	nfs_rpc_reply(reqdata, rc);
+	nfs_rpc_release(reqdata);
+
+	return true;
+}
+
 /**
  * @brief Main RPC dispatcher routine
  *
  * @param[in,out] reqdata	NFS request
  *
+ * @retval true if the request is finished.
+ * @retval false if the request was suspended waiting for asynchronous I/O;
+ *         it will be requeued when the I/O completes and must not be touched.
  */
-void nfs_rpc_execute(request_data_t *reqdata)
+bool nfs_rpc_execute(request_data_t *reqdata)
 {
 	const char *client_ip = "<unknown client>";
 	const char *progname = "unknown";
@@ -716,9 +947,11 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
 	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
 	nfs_res_t *res_nfs;
-	struct export_perms export_perms;
-	struct user_cred user_credentials;
-	struct req_op_context req_ctx;
+	struct nfs_encoded_reply *enc;
+	xdrproc_t xdr_reply;
+	void *reply;
+	bool ok;
+	struct export_perms *export_perms = &reqdata->r_u.req.export_perms;
 	dupreq_status_t dpq_status;
 	struct timespec timer_start;
 	enum auth_stat auth_rc;
@@ -741,14 +974,14 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 	/* set up the request context
 	 */
-	memset(&export_perms, 0, sizeof(export_perms));
-	memset(&req_ctx, 0, sizeof(req_ctx));
-	op_ctx = &req_ctx;
-	op_ctx->creds = &user_credentials;
+	memset(export_perms, 0, sizeof(*export_perms));
+	memset(&reqdata->r_u.req.req_ctx, 0, sizeof(reqdata->r_u.req.req_ctx));
+	op_ctx = &reqdata->r_u.req.req_ctx;
+	op_ctx->creds = &reqdata->r_u.req.user_credentials;
 	op_ctx->caller_addr = (sockaddr_t *)svc_getrpccaller(xprt);
 	op_ctx->nfs_vers = reqdata->r_u.req.svc.rq_msg.cb_vers;
 	op_ctx->req_type = reqdata->rtype;
-	op_ctx->export_perms = &export_perms;
+	op_ctx->export_perms = export_perms;
 
 	/* Set up initial export permissions that don't allow anything. */
 	export_check_access();
@@ -776,7 +1009,13 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 * xprt private data. */
 
 	port = get_port(op_ctx->caller_addr);
-	op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
+	if (reqdata->r_u.req.client != NULL) {
+		/* Already looked up by fair queuing */
+		op_ctx->client = reqdata->r_u.req.client;
+		inc_gsh_client_refcount(op_ctx->client);
+	} else {
+		op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
+	}
 	if (op_ctx->client == NULL) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "Cannot get client block for Program %" PRIu32
@@ -830,9 +1069,25 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				     "Before svc_sendreply on socket %d (dup req)",
 				     xprt->xp_fd);
 
-			if (!svc_sendreply(&reqdata->r_u.req.svc,
-					   reqdesc->xdr_encode_func,
-					   (caddr_t) res_nfs)) {
+			/* The DRC may have kept the reply encoded */
+			enc = nfs_dupreq_encoded(&reqdata->r_u.req.svc);
+			if (enc != NULL) {
+				xdr_reply = (xdrproc_t) xdr_nfs_encoded_reply;
+				reply = enc;
+			} else {
+				xdr_reply = reqdesc->xdr_encode_func;
+				reply = res_nfs;
+			}
+
+			gsh_iobuf_zero_copy(
+				xprt->xp_type == XPRT_TCP &&
+				reqdata->r_u.req.svc.rq_msg.cb_cred.oa_flavor
+					!= RPCSEC_GSS);
+			ok = svc_sendreply(&reqdata->r_u.req.svc, xdr_reply,
+					   (caddr_t) reply);
+			gsh_iobuf_zero_copy(false);
+
+			if (!ok) {
 				LogDebug(COMPONENT_DISPATCH,
 					 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a duplicate request."
 					 " rpcxid=%" PRIu32
@@ -1057,7 +1312,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		export_check_access();
 
-		if ((export_perms.options & EXPORT_OPTION_ACCESS_MASK) == 0) {
+		if ((export_perms->options & EXPORT_OPTION_ACCESS_MASK) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Client %s is not allowed to access Export_Id %d %s"
 				", vers=%" PRIu32
@@ -1072,7 +1327,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
-		if ((EXPORT_OPTION_NFSV3 & export_perms.options) == 0) {
+		if ((EXPORT_OPTION_NFSV3 & export_perms->options) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" not allowed on Export_Id %d %s for client %s",
@@ -1088,9 +1343,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		/* Check transport type */
 		if (((xprt_type == XPRT_UDP)
-		     && ((export_perms.options & EXPORT_OPTION_UDP) == 0))
+		     && ((export_perms->options & EXPORT_OPTION_UDP) == 0))
 		    || ((xprt_type == XPRT_TCP)
-			&& ((export_perms.options & EXPORT_OPTION_TCP) == 0))) {
+			&& ((export_perms->options & EXPORT_OPTION_TCP) == 0))) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" over %s not allowed on Export_Id %d %s for client %s",
@@ -1124,7 +1379,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		/* Check if client is using a privileged port,
 		 * but only for NFS protocol */
 		if ((reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
-		 && (export_perms.options & EXPORT_OPTION_PRIVILEGED_PORT)
+		 && (export_perms->options & EXPORT_OPTION_PRIVILEGED_PORT)
 		 && (port >= IPPORT_RESERVED)) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Non-reserved Port %d is not allowed on Export_Id %d %s for client %s",
@@ -1143,7 +1398,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 */
 	if (op_ctx->ctx_export != NULL
 	    && (reqdesc->dispatch_behaviour & MAKES_IO)
-	    && !(export_perms.options & EXPORT_OPTION_RW_ACCESS)) {
+	    && !(export_perms->options & EXPORT_OPTION_RW_ACCESS)) {
 		/* Request of type MDONLY_RO were rejected at the
 		 * nfs_rpc_dispatcher level.
 		 * This is done by replying EDQUOT
@@ -1175,7 +1430,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		}
 	} else if (op_ctx->ctx_export != NULL
 		   && (reqdesc->dispatch_behaviour & MAKES_WRITE)
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_WRITE_ACCESS
 			| EXPORT_OPTION_MD_WRITE_ACCESS)) == 0) {
 		if (reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
@@ -1202,7 +1457,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			rc = NFS_REQ_DROP;
 		}
 	} else if (op_ctx->ctx_export != NULL
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_READ_ACCESS
 			 | EXPORT_OPTION_MD_READ_ACCESS)) == 0) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1222,7 +1477,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				/* If NEEDS_CRED and not NEEDS_EXPORT,
 				 * don't squash
 				 */
-				export_perms.options = EXPORT_OPTION_ROOT;
+				export_perms->options = EXPORT_OPTION_ROOT;
 			}
 
 			if (nfs_req_creds(&reqdata->r_u.req.svc) != NFS4_OK) {
@@ -1307,74 +1562,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
  req_error:
 #endif /* _USE_NFS3 */
 
-/* NFSv4 stats are handled in nfs4_compound()
- */
-	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
-	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
-		server_stats_nfs_done(reqdata, rc, false);
-
-	/* If request is dropped, no return to the client */
-	if (rc == NFS_REQ_DROP) {
-		/* The request was dropped */
-		LogDebug(COMPONENT_DISPATCH,
-			 "Drop request rpc_xid=%" PRIu32
-			 ", program %" PRIu32
-			 ", version %" PRIu32
-			 ", function %" PRIu32,
-			 reqdata->r_u.req.svc.rq_msg.rm_xid,
-			 reqdata->r_u.req.svc.rq_msg.cb_prog,
-			 reqdata->r_u.req.svc.rq_msg.cb_vers,
-			 reqdata->r_u.req.svc.rq_msg.cb_proc);
-
-		/* If the request is not normally cached, then the entry
-		 * will be removed later.  We only remove a reply that is
-		 * normally cached that has been dropped.
-		 */
-		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
-		    != DUPREQ_SUCCESS) {
-			LogCrit(COMPONENT_DISPATCH,
-				"Attempt to delete duplicate request failed on line %d",
-				__LINE__);
-		}
-		goto freeargs;
-	} else {
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Before svc_sendreply on socket %d", xprt->xp_fd);
-
-		/* encoding the result on xdr output */
-		if (!svc_sendreply(&reqdata->r_u.req.svc,
-				   reqdesc->xdr_encode_func,
-				   (caddr_t) res_nfs)) {
-			LogDebug(COMPONENT_DISPATCH,
-				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request."
-				 " rpcxid=%" PRIu32
-				 " socket=%d function:%s client:%s"
-				 " program:%" PRIu32
-				 " nfs version:%" PRIu32
-				 " proc:%" PRIu32
-				 " errno: %d",
-				 reqdata->r_u.req.svc.rq_msg.rm_xid,
-				 xprt->xp_fd,
-				 reqdesc->funcname,
-				 client_ip,
-				 reqdata->r_u.req.svc.rq_msg.cb_prog,
-				 reqdata->r_u.req.svc.rq_msg.cb_vers,
-				 reqdata->r_u.req.svc.rq_msg.cb_proc,
-				 errno);
-			if (xprt->xp_type != XPRT_UDP)
-				svc_destroy(xprt);
-			goto freeargs;
-		}
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "After svc_sendreply on socket %d", xprt->xp_fd);
-
-	}			/* rc == NFS_REQ_DROP */
-
-	/* Finish any request not already deleted */
-	if (dpq_status == DUPREQ_SUCCESS)
-		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
-	goto freeargs;
+	return nfs_rpc_finish(reqdata, rc);
 
 	/* Reject the request for authentication reason (incompatible
 	 * file handle) */
@@ -1401,41 +1589,97 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	}
 
  freeargs:
-	/* Free the allocated resources once the work is done */
-	/* Free the arguments */
-	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
-		if (!SVC_FREEARGS(&reqdata->r_u.req.svc,
-				  reqdesc->xdr_decode_func,
-				  (caddr_t) arg_nfs)) {
-			LogCrit(COMPONENT_DISPATCH,
-				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
-				reqdesc->funcname);
-		}
-	}
+	nfs_rpc_release(reqdata);
+	return true;
+}
 
-	/* Finalize the request. */
-	if (res_nfs)
-		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+/**
+ * @brief Resume a request suspended for asynchronous I/O
+ *
+ * Called by a worker that dequeued a request that
+ * nfs_rpc_complete_async_request put back on the queue.
+ *
+ * @param[in,out] reqdata	NFS request
+ *
+ * @return As nfs_rpc_execute.
+ */
+bool nfs_rpc_resume(request_data_t *reqdata)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+	int rc;
 
-	SetClientIP(NULL);
-	if (op_ctx->client != NULL) {
-		put_gsh_client(op_ctx->client);
-		op_ctx->client = NULL;
-	}
-	if (op_ctx->ctx_export != NULL) {
-		put_gsh_export(op_ctx->ctx_export);
-		op_ctx->ctx_export = NULL;
-	}
-	clean_credentials();
-	op_ctx = NULL;
+	atomic_clear_uint32_t_bits(&reqnfs->async_flags,
+				   NFS_REQ_ASYNC_SUSPENDED |
+				   NFS_REQ_ASYNC_COMPLETE);
 
-#ifdef USE_LTTNG
-	tracepoint(nfs_rpc, end, reqdata);
-#endif
+	op_ctx = &reqnfs->req_ctx;
+	if (op_ctx->client != NULL)
+		SetClientIP(op_ctx->client->hostaddr_str);
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "Resuming %s rpc_xid=%" PRIu32,
+		     reqnfs->funcdesc->funcname, reqnfs->svc.rq_msg.rm_xid);
+
+	rc = nfs_rpc_continue(reqnfs);
+
+	return nfs_rpc_finish(reqdata, rc);
+}
+
+/**
+ * @brief Signal that a suspended request's asynchronous I/O is done
+ *
+ * May be called from any thread, including from within the service
+ * function before it has returned NFS_REQ_ASYNC_WAIT.  Whichever of this
+ * function and the worker comes second gets the request going again.
+ *
+ * @param[in] reqnfs	NFS request
+ */
+void nfs_rpc_complete_async_request(nfs_request_t *reqnfs)
+{
+	uint32_t flags;
+
+	flags = atomic_postset_uint32_t_bits(&reqnfs->async_flags,
+					     NFS_REQ_ASYNC_COMPLETE);
+
+	if (flags & NFS_REQ_ASYNC_SUSPENDED)
+		nfs_rpc_enqueue_req(container_of(reqnfs, request_data_t,
+						 r_u.req));
 }
 
+/**
+ * @brief Defer a READ or WRITE that is over its rate limits
+ *
+ * Checks the operation against the limits of the export and client in
+ * op_ctx.  If it must wait, the request is handed to the dispatcher to
+ * be requeued when it may go; the caller must then suspend it without
+ * having done anything, and arrange to run the operation again when it
+ * is resumed.  Requests that may not be suspended are not limited.
+ *
+ * @param[in] reqnfs	NFS request
+ * @param[in] write	Whether the operation is a write
+ * @param[in] bytes	Bytes the operation transfers
+ *
+ * @return true if the request has been deferred.
+ */
+bool nfs_rpc_rate_limit(nfs_request_t *reqnfs, bool write, uint64_t bytes)
+{
+	nsecs_elapsed_t delay;
+
+	if (!nfs_rpc_async_allowed(reqnfs))
+		return false;
+
+	delay = rate_limit_check(write, bytes);
+	if (delay == 0)
+		return false;
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "Deferring %s of %" PRIu64 " bytes for %" PRIu64 " ns",
+		     write ? "WRITE" : "READ", bytes, delay);
+
+	nfs_rpc_defer_req(reqnfs, delay);
+
+	return true;
+}
 #ifdef _USE_9P
 /**
  * @brief Execute a 9p request
@@ -1546,6 +1790,17 @@ static void worker_run(struct fridgethr_context *ctx)
 				"Unexpected unknown request");
 			break;
 		case NFS_REQUEST:
+			if (reqdata->r_u.req.async_flags &
+			    NFS_REQ_ASYNC_SUSPENDED) {
+				/* Asynchronous I/O done, finish the request
+				 * even if the xprt has gone away since the
+				 * I/O holds resources that must be released.
+				 */
+				if (!nfs_rpc_resume(reqdata))
+					continue;
+				break;
+			}
+
 			/* check for destroyed xprts */
 			if (reqdata->r_u.req.svc.rq_xprt->
 			    xp_flags & SVC_XPRT_FLAG_DESTROYED) {
@@ -1560,7 +1815,12 @@ static void worker_run(struct fridgethr_context *ctx)
 				 reqdata,
 				 reqdata->r_u.req.svc.rq_xprt,
 				 reqdata->r_u.req.svc.rq_xprt->xp_requests);
-			nfs_rpc_execute(reqdata);
+			if (!nfs_rpc_execute(reqdata)) {
+				/* Suspended; it will be requeued when its
+				 * I/O completes.
+				 */
+				continue;
+			}
 			break;
 
 		case NFS_CALL:
@@ -1586,6 +1846,7 @@ static void worker_run(struct fridgethr_context *ctx)
 			gsh_xprt_unref(reqdata->r_u.req.svc.rq_xprt,
 				       XPRT_PRIVATE_FLAG_DECREQ, __func__,
 				       __LINE__);
+			nfs_rpc_fq_release(reqdata);
 			break;
 		case NFS_CALL:
 			break;
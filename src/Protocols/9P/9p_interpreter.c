@@ -127,7 +127,14 @@ void _9p_tcp_process_request(struct _9p_request_data *req9p)
 {
 	u32 outdatalen = 0;
 	int rc = 0;
-	char replydata[_9P_MSG_SIZE];
+	char stackreply[_9P_MSG_SIZE];
+	char *replydata = stackreply;
+
+	/* Rread data is read by the FSAL straight into the reply, which
+	 * must then hold as much as the negotiated msize allows.
+	 */
+	if (req9p->pconn->msize > sizeof(stackreply))
+		replydata = gsh_malloc(req9p->pconn->msize);
 
 	rc = _9p_process_buffer(req9p, replydata, &outdatalen);
 	if (rc != 1) {
@@ -142,6 +149,9 @@ void _9p_tcp_process_request(struct _9p_request_data *req9p)
 				 req9p->pconn->trans_data.sockfd);
 	}
 	_9p_DiscardFlushHook(req9p);
+
+	if (replydata != stackreply)
+		gsh_free(replydata);
 }				/* _9p_process_request */
 
 int _9p_process_buffer(struct _9p_request_data *req9p, char *replydata,
@@ -47,6 +47,7 @@
 #include "uid2grp.h"
 #include "export_mgr.h"
 #include "fsal_convert.h"
+#include "server_stats.h"
 
 /**
  * @brief Allocate a new struct _9p_user_cred, with refcounter set to 1.
@@ -424,9 +425,171 @@ int _9p_tools_clunk(struct _9p_fid *pfid)
 	return 0;
 }
 
+/**
+ * @brief Bucket of a fid in a connection's fid table
+ *
+ * Multiplicative hashing, the top bits of the product select the
+ * bucket so both sequential and strided fid numbers spread out.
+ */
+static inline u32 _9p_fid_bucket(struct _9p_fid_table *table, u32 fid)
+{
+	return (fid * 2654435761U) >> (32 - __builtin_ctz(table->size));
+}
+
+/**
+ * @brief Double the number of buckets of a fid table
+ *
+ * The first call allocates the buckets.  The table write lock must
+ * be held.
+ */
+static void _9p_grow_fids(struct _9p_fid_table *table)
+{
+	struct _9p_fid **old = table->buckets;
+	u32 oldsize = table->size;
+	struct _9p_fid *pfid;
+	u32 i, b;
+
+	table->size = oldsize ? oldsize * 2 : _9P_FID_BUCKETS;
+	table->buckets = gsh_calloc(table->size, sizeof(struct _9p_fid *));
+
+	for (i = 0; i < oldsize; i++) {
+		while ((pfid = old[i]) != NULL) {
+			old[i] = pfid->fid_next;
+			b = _9p_fid_bucket(table, pfid->fid);
+			pfid->fid_next = table->buckets[b];
+			table->buckets[b] = pfid;
+		}
+	}
+
+	gsh_free(old);
+}
+
+void _9p_init_fids(struct _9p_conn *conn)
+{
+	memset(&conn->fids, 0, sizeof(conn->fids));
+	PTHREAD_RWLOCK_init(&conn->fids.lock, NULL);
+}
+
+/**
+ * @brief Find a fid of a connection
+ *
+ * @param[in] conn Connection
+ * @param[in] fid  Fid number sent by the client
+ *
+ * @return The fid or NULL if the client did not set it up.
+ */
+struct _9p_fid *_9p_getfid(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid *pfid = NULL;
+
+	PTHREAD_RWLOCK_rdlock(&conn->fids.lock);
+
+	if (conn->fids.buckets != NULL)
+		for (pfid = conn->fids.buckets[_9p_fid_bucket(&conn->fids,
+							      fid)];
+		     pfid != NULL && pfid->fid != fid;
+		     pfid = pfid->fid_next)
+			;
+
+	PTHREAD_RWLOCK_unlock(&conn->fids.lock);
+
+	return pfid;
+}
+
+/**
+ * @brief Make a fid reachable by its number
+ *
+ * A fid already using the number is only unhashed, as when the
+ * table was an array.  For the stats that is a release of the old fid
+ * as well as a creation of the new one.
+ *
+ * @param[in] conn Connection
+ * @param[in] pfid Fid, with pfid->fid set
+ */
+void _9p_setfid(struct _9p_conn *conn, struct _9p_fid *pfid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	struct _9p_fid **slot;
+	bool grown = false;
+	bool replaced = false;
+	u32 count;
+
+	PTHREAD_RWLOCK_wrlock(&table->lock);
+
+	if (table->buckets == NULL || table->count >= 2 * table->size) {
+		_9p_grow_fids(table);
+		grown = true;
+	}
+
+	slot = &table->buckets[_9p_fid_bucket(table, pfid->fid)];
+	while (*slot != NULL && (*slot)->fid != pfid->fid)
+		slot = &(*slot)->fid_next;
+
+	if (*slot != NULL) {
+		pfid->fid_next = (*slot)->fid_next;
+		replaced = true;
+	} else {
+		pfid->fid_next = NULL;
+		table->count++;
+	}
+	*slot = pfid;
+	count = table->count;
+
+	PTHREAD_RWLOCK_unlock(&table->lock);
+
+	if (conn->client != NULL) {
+		server_stats_9p_fid(conn->client, true, count, grown);
+		if (replaced)
+			server_stats_9p_fid(conn->client, false, 0, false);
+	}
+}
+
+/**
+ * @brief Make a fid unreachable by its number
+ *
+ * @param[in] conn Connection
+ * @param[in] fid  Fid number
+ *
+ * @return The fid taken out of the table, NULL if there was none.
+ */
+struct _9p_fid *_9p_delfid(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	struct _9p_fid **slot;
+	struct _9p_fid *pfid = NULL;
+
+	PTHREAD_RWLOCK_wrlock(&table->lock);
+
+	if (table->buckets != NULL) {
+		slot = &table->buckets[_9p_fid_bucket(table, fid)];
+		while (*slot != NULL && (*slot)->fid != fid)
+			slot = &(*slot)->fid_next;
+
+		pfid = *slot;
+		if (pfid != NULL) {
+			*slot = pfid->fid_next;
+			table->count--;
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&table->lock);
+
+	if (pfid != NULL && conn->client != NULL)
+		server_stats_9p_fid(conn->client, false, 0, false);
+
+	return pfid;
+}
+
+/**
+ * @brief Clunk the fids a connection left behind and free its table
+ *
+ * Nothing else uses the connection any more, so no lock is taken.
+ */
 void _9p_cleanup_fids(struct _9p_conn *conn)
 {
-	int i;
+	struct _9p_fid_table *table = &conn->fids;
+	struct _9p_fid *pfid;
+	u32 i;
 
 	/* Allocate op_ctx, is should always be NULL here
 	 * Note we only need it if there is a non-null fid,
@@ -434,15 +597,24 @@ void _9p_cleanup_fids(struct _9p_conn *conn)
 	 */
 	op_ctx = gsh_calloc(1, sizeof(struct req_op_context));
 
-	for (i = 0; i < _9P_FID_PER_CONN; i++) {
-		if (conn->fids[i]) {
-			_9p_init_opctx(conn->fids[i], NULL);
-			_9p_tools_clunk(conn->fids[i]);
+	for (i = 0; i < table->size; i++) {
+		while ((pfid = table->buckets[i]) != NULL) {
+			table->buckets[i] = pfid->fid_next;
+			_9p_init_opctx(pfid, NULL);
+			_9p_tools_clunk(pfid);
 			_9p_release_opctx();
-			conn->fids[i] = NULL;	/* poison the entry */
+			if (conn->client != NULL)
+				server_stats_9p_fid(conn->client, false, 0,
+						    false);
 		}
 	}
 
 	gsh_free(op_ctx);
 	op_ctx = NULL;
+
+	gsh_free(table->buckets);
+	table->buckets = NULL;
+	table->size = 0;
+	table->count = 0;
+	PTHREAD_RWLOCK_destroy(&table->lock);
 }
@@ -79,15 +79,17 @@ int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TWRITE: tag=%u fid=%u offset=%llu count=%u",
 		 (u32) *msgtag, *fid, (unsigned long long)*offset, *count);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_getfid(req9p->pconn, *fid);
 
 	/* Make sure the requested amount of data respects negotiated msize */
 	if (*count + _9P_ROOM_TWRITE > req9p->pconn->msize)
 		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
 
+	/* The data is written straight from the message, which must
+	 * hold all of it */
+	if (*count + _9P_ROOM_TWRITE > *(u32 *) req9p->_9pmsg)
+		return _9p_rerror(req9p, msgtag, EINVAL, plenout, preply);
+
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid fid=%u", *fid);
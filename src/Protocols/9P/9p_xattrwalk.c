@@ -87,13 +87,10 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 			 "TXATTRWALK (component): tag=%u fid=%u attrfid=%u name=%.*s",
 			 (u32) *msgtag, *fid, *attrfid, *name_len, name_str);
 
-	if (*fid >= _9P_FID_PER_CONN)
+	if (*attrfid == _9P_NOFID)
 		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
 
-	if (*attrfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_getfid(req9p->pconn, *fid);
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid fid=%u", *fid);
@@ -234,7 +231,8 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	pxattrfid->xattr->xattr_size = attrsize;
 	pxattrfid->xattr->xattr_write = _9P_XATTR_READ_ONLY;
 
-	req9p->pconn->fids[*attrfid] = pxattrfid;
+	pxattrfid->fid = *attrfid;
+	_9p_setfid(req9p->pconn, pxattrfid);
 
 	/* Increments refcount as we're manually making a new copy */
 	pfid->pentry->obj_ops.get_ref(pfid->pentry);
@@ -44,13 +44,14 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "sal_functions.h"
+#include "gsh_iobuf.h"
 
 static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 			uint32_t read_size, struct fsal_obj_handle *obj,
 			int eof)
 {
 	if ((read_size == 0) && (data != NULL)) {
-		gsh_free(data);
+		gsh_iobuf_put(data);
 		data = NULL;
 	}
 
@@ -67,6 +68,90 @@ static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 	res->res_read3.status = NFS3_OK;
 }
 
+/**
+ * @brief State of a READ waiting for asynchronous I/O
+ */
+struct nfs3_read_data {
+	nfs_request_t *reqnfs;		/*< Request to resume */
+	struct fsal_obj_handle *obj;	/*< File being read */
+	fsal_status_t status;		/*< Status of the read */
+	struct fsal_io_arg read_arg;	/*< Arguments and results */
+};
+
+/**
+ * @brief Finish a READ once the FSAL has done the I/O
+ *
+ * Releases the share reservation and object reference taken by nfs3_read
+ * and builds the result.
+ *
+ * @param[in]  req          SVC request related to this call
+ * @param[out] res          Structure to contain the result of the call
+ * @param[in]  obj          File read
+ * @param[in]  fsal_status  Status of the read
+ * @param[in]  data         Buffer read into
+ * @param[in]  size         Amount requested
+ * @param[in]  read_size    Amount read
+ * @param[in]  eof_met      Whether the read hit end of file
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+static int nfs3_read_done(struct svc_req *req, nfs_res_t *res,
+			  struct fsal_obj_handle *obj,
+			  fsal_status_t fsal_status, void *data,
+			  size_t size, size_t read_size, bool eof_met)
+{
+	int rc = NFS_REQ_OK;
+
+	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
+
+	if (!FSAL_IS_ERROR(fsal_status)) {
+		nfs_read_ok(req, res, data, read_size, obj, eof_met);
+		goto out;
+	}
+
+	gsh_iobuf_put(data);
+	read_size = 0;
+
+	/* If we are here, there was an error */
+	if (nfs_RetryableError(fsal_status.major)) {
+		rc = NFS_REQ_DROP;
+		goto out;
+	}
+
+	res->res_read3.status = nfs3_Errno_status(fsal_status);
+
+	nfs_SetPostOpAttr(obj,
+			  &res->res_read3.READ3res_u.resfail.file_attributes,
+			  NULL);
+
+ out:
+	/* return references */
+	obj->obj_ops.put_ref(obj);
+
+	server_stats_io_done(size, read_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     false);
+	return rc;
+}
+
+/**
+ * @brief Completion callback for an asynchronous READ
+ *
+ * @param[in] obj         File read
+ * @param[in] ret         Status of the read
+ * @param[in] read_arg    Arguments and results of the read
+ * @param[in] caller_arg  The nfs3_read_data
+ */
+static void nfs3_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 struct fsal_io_arg *read_arg, void *caller_arg)
+{
+	struct nfs3_read_data *rdata = caller_arg;
+
+	rdata->status = fsal_io_complete(ret, read_arg, true);
+	nfs_rpc_complete_async_request(rdata->reqnfs);
+}
+
 /**
  *
  * @brief The NFSPROC3_READ
@@ -113,6 +198,14 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			 str, offset, size);
 	}
 
+	/* Over the export or client rate limits, run again later */
+	if (nfs_rpc_rate_limit(nfs_req_from_svc(req), false,
+			       MIN(arg->arg_read3.count, MaxRead))) {
+		atomic_set_uint32_t_bits(&nfs_req_from_svc(req)->async_flags,
+					 NFS_REQ_ASYNC_RERUN);
+		return NFS_REQ_ASYNC_WAIT;
+	}
+
 	/* to avoid setting it on each error case */
 	res->res_read3.READ3res_u.resfail.file_attributes.attributes_follow =
 	    FALSE;
@@ -203,69 +296,70 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		nfs_read_ok(req, res, NULL, 0, obj, 0);
 		rc = NFS_REQ_OK;
 		goto out;
-	} else {
-		data = gsh_malloc(size);
-
-		res->res_read3.status = nfs3_Errno_state(
-				state_share_anonymous_io_start(
-					obj,
-					OPEN4_SHARE_ACCESS_READ,
-					SHARE_BYPASS_READ));
-
-		if (res->res_read3.status != NFS3_OK) {
-			rc = NFS_REQ_OK;
-			gsh_free(data);
-			goto out;
-		}
+	}
 
-		if (obj->fsal->m_ops.support_ex(obj)) {
-			/* Call the new fsal_read2 */
-			/** @todo for now pass NULL state */
-			fsal_status = fsal_read2(obj,
-						  true,
-						  NULL,
-						  offset,
-						  size,
-						  &read_size,
-						  data,
-						  &eof_met,
-						  NULL);
-		} else {
-			/* Call legacy fsal_rdwr */
-			fsal_status = fsal_rdwr(obj,
-						FSAL_IO_READ,
-						offset,
-						size,
-						&read_size,
-						data,
-						&eof_met,
-						&sync,
-						NULL);
-		}
+	data = gsh_iobuf_alloc(size);
 
-		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
+	res->res_read3.status = nfs3_Errno_state(
+			state_share_anonymous_io_start(
+				obj,
+				OPEN4_SHARE_ACCESS_READ,
+				SHARE_BYPASS_READ));
 
-		if (!FSAL_IS_ERROR(fsal_status)) {
-			nfs_read_ok(req, res, data, read_size, obj, eof_met);
-			rc = NFS_REQ_OK;
-			goto out;
-		}
-		gsh_free(data);
-	}
-
-	/* If we are here, there was an error */
-	if (nfs_RetryableError(fsal_status.major)) {
-		rc = NFS_REQ_DROP;
+	if (res->res_read3.status != NFS3_OK) {
+		rc = NFS_REQ_OK;
+		gsh_iobuf_put(data);
 		goto out;
 	}
 
-	res->res_read3.status = nfs3_Errno_status(fsal_status);
+	if (obj->fsal->m_ops.support_ex(obj) &&
+	    nfs_rpc_async_allowed(nfs_req_from_svc(req))) {
+		/* Hand the read to the FSAL and suspend the request */
+		nfs_request_t *reqnfs = nfs_req_from_svc(req);
+		struct nfs3_read_data *rdata = gsh_calloc(1, sizeof(*rdata));
+
+		rdata->reqnfs = reqnfs;
+		rdata->obj = obj;
+		/** @todo for now pass NULL state */
+		rdata->read_arg.state = NULL;
+		rdata->read_arg.offset = offset;
+		rdata->read_arg.io_request = size;
+		rdata->read_arg.buffer = data;
+		reqnfs->proc_data = rdata;
+
+		fsal_read2_async(obj, true, &rdata->read_arg, nfs3_read_cb,
+				 rdata);
+
+		return NFS_REQ_ASYNC_WAIT;
+	}
 
-	nfs_SetPostOpAttr(obj,
-			  &res->res_read3.READ3res_u.resfail.file_attributes,
-			  NULL);
+	if (obj->fsal->m_ops.support_ex(obj)) {
+		/* Call the new fsal_read2 */
+		/** @todo for now pass NULL state */
+		fsal_status = fsal_read2(obj,
+					  true,
+					  NULL,
+					  offset,
+					  size,
+					  &read_size,
+					  data,
+					  &eof_met,
+					  NULL);
+	} else {
+		/* Call legacy fsal_rdwr */
+		fsal_status = fsal_rdwr(obj,
+					FSAL_IO_READ,
+					offset,
+					size,
+					&read_size,
+					data,
+					&eof_met,
+					&sync,
+					NULL);
+	}
 
-	rc = NFS_REQ_OK;
+	return nfs3_read_done(req, res, obj, fsal_status, data, size,
+			      read_size, eof_met);
 
  out:
 	/* return references */
@@ -278,6 +372,34 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	return rc;
 }				/* nfs3_read */
 
+/**
+ * @brief Resume an NFSPROC3_READ after asynchronous I/O
+ *
+ * @param[in]  arg     NFS arguments union
+ * @param[in]  req     SVC request related to this call
+ * @param[out] res     Structure to contain the result of the call
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+
+int nfs3_read_resume(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
+{
+	nfs_request_t *reqnfs = nfs_req_from_svc(req);
+	struct nfs3_read_data *rdata = reqnfs->proc_data;
+	int rc;
+
+	reqnfs->proc_data = NULL;
+
+	rc = nfs3_read_done(req, res, rdata->obj, rdata->status,
+			    rdata->read_arg.buffer, rdata->read_arg.io_request,
+			    rdata->read_arg.io_amount,
+			    rdata->read_arg.end_of_file);
+
+	gsh_free(rdata);
+	return rc;
+}
+
 /**
  * @brief Free the result structure allocated for nfs3_read.
  *
@@ -289,6 +411,6 @@ void nfs3_read_free(nfs_res_t *res)
 {
 	if ((res->res_read3.status == NFS3_OK)
 	    && (res->res_read3.READ3res_u.resok.data.data_len != 0)) {
-		gsh_free(res->res_read3.READ3res_u.resok.data.data_val);
+		gsh_iobuf_put(res->res_read3.READ3res_u.resok.data.data_val);
 	}
 }
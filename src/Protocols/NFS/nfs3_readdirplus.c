@@ -53,23 +53,23 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 					       uint64_t cookie,
 					       enum cb_state cb_state);
 
-static void free_entryplus3s(entryplus3 *entryplus3s);
-
 /**
  * @brief Opaque bookkeeping structure for NFSPROC3_READDIRPLUS
  *
  * This structure keeps track of the process of writing out an NFSv3
  * READDIRPLUS response between calls to nfs3_readdirplus_callback.
+ * Entries are encoded straight into the reply, which is sized to
+ * maxcount, so the stream running out of room is what ends the reply.
  */
 
 struct nfs3_readdirplus_cb_data {
-	entryplus3 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
+	XDR xdrs;		/*< Stream encoding entries into entries_xdr */
+	char *entries_xdr;	/*< The entries as they will be sent */
+	u_int entries_size;	/*< Room for entries in entries_xdr */
+	struct fsal_readdir_enc enc;	/*< Entries kept by the cache */
 	size_t count;		/*< The count of complete entries stored in the
 				   buffer */
-	size_t total_entries;	/*< The number of entires we allocated for
-				   the array. */
+	bool full;		/*< An entry did not fit, send no more */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
 };
@@ -95,6 +95,32 @@ nfsstat3 nfs_readdir_dot_entry(struct fsal_obj_handle *obj, const char *name,
 		return tracker->error;
 }
 
+/**
+ * @brief Let the cache know where an entry may be copied next
+ *
+ * A kept entry is copied straight into the reply.
+ *
+ * @param[in,out] tracker The READDIRPLUS
+ */
+
+static void readdirplus_enc_next(struct nfs3_readdirplus_cb_data *tracker)
+{
+	u_int pos = xdr_getpos(&tracker->xdrs);
+
+	tracker->enc.buf = tracker->entries_xdr + pos;
+	tracker->enc.buflen = tracker->entries_size - pos;
+}
+
+/**
+ * @brief Reply overhead of READDIRPLUS3resok besides the entries
+ *
+ * The directory's post_op_attr (84 bytes of fattr3 on the wire), the
+ * cookie verifier, the FALSE after the last entry and eof.
+ */
+
+#define READDIRPLUS3_RESOK_FIXED (BYTES_PER_XDR_UNIT + 84 + \
+				  NFS3_COOKIEVERFSIZE + 2 * BYTES_PER_XDR_UNIT)
+
 /**
  * @brief The NFSPROC3_READDIRPLUS
  *
@@ -116,18 +142,20 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	uint64_t fsal_cookie = 0;
 	cookieverf3 cookie_verifier;
 	unsigned int num_entries = 0;
-	unsigned long estimated_num_entries = 0;
+	unsigned long maxcount = 0;
+	u_int pos = 0;
 	object_file_type_t dir_filetype = 0;
 	bool eod_met = false;
 	fsal_status_t fsal_status = {0, 0};
 	fsal_status_t fsal_status_gethandle = {0, 0};
 	int rc = NFS_REQ_OK;
 	struct nfs3_readdirplus_cb_data tracker = {
-		.entries = NULL,
-		.mem_left = 0,
+		.entries_xdr = NULL,
 		.count = 0,
 		.error = NFS3_OK,
 	};
+	dirlistplus3 * const reply =
+		&res->res_readdirplus3.READDIRPLUS3res_u.resok.reply;
 	struct attrlist attrs_dir, attrs_parent;
 	bool use_cookie_verifier = op_ctx_export_has_option(
 					EXPORT_OPTION_USE_COOKIE_VERIFIER);
@@ -164,26 +192,24 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
-	tracker.mem_left = (arg->arg_readdirplus3.maxcount * 9) / 10;
-	begin_cookie = arg->arg_readdirplus3.cookie;
-
-	tracker.mem_left -= sizeof(READDIRPLUS3resok);
-
-	/* Estimate assuming that we're going to send no names and no handles.
-	 * Don't count space for pointers for nextentry or
-	 * name_handle.data.data_val in entryplus3
+	/* maxcount bounds the whole READDIRPLUS3resok, and we will not
+	 * send more than fits in a send buffer.
 	 */
-	estimated_num_entries = MIN((tracker.mem_left + sizeof(entryplus3 *))
-				    / (sizeof(entryplus3) - sizeof(char *) * 2),
-				    50);
-
-	tracker.total_entries = estimated_num_entries;
+	maxcount = MIN(arg->arg_readdirplus3.maxcount,
+		       nfs_param.core_param.rpc.max_send_buffer_size);
+	begin_cookie = arg->arg_readdirplus3.cookie;
 
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "nfs3_readdirplus: dircount=%u begin_cookie=%" PRIu64
-		     " estimated_num_entries=%lu, mem_left=%zd",
-		     arg->arg_readdirplus3.dircount, begin_cookie,
-		     estimated_num_entries, tracker.mem_left);
+		     " maxcount=%lu",
+		     arg->arg_readdirplus3.dircount, begin_cookie, maxcount);
+
+	if (maxcount < READDIRPLUS3_RESOK_FIXED) {
+		res->res_readdirplus3.status = NFS3ERR_TOOSMALL;
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Response too small");
+		goto out;
+	}
 
 	/* Convert file handle into a vnode */
 	dir_obj = nfs3_FhandleToCache(&(arg->arg_readdirplus3.dir),
@@ -249,8 +275,10 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 	}
 
-	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries = NULL;
-	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof = FALSE;
+	reply->entries = NULL;
+	reply->entries_xdr = NULL;
+	reply->entries_xdr_len = 0;
+	reply->eof = FALSE;
 
 	/* Fudge cookie for "." and "..", if necessary */
 	if (begin_cookie > 2)
@@ -258,8 +286,14 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	else
 		fsal_cookie = 0;
 
-	/* Allocate space for entries */
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entryplus3));
+	/* Prepare to encode the entries.  The stream leaves room for the
+	 * FALSE that ends the list.
+	 */
+	tracker.entries_size = maxcount - READDIRPLUS3_RESOK_FIXED;
+	tracker.entries_xdr = gsh_malloc(tracker.entries_size +
+					 BYTES_PER_XDR_UNIT);
+	xdrmem_create(&tracker.xdrs, tracker.entries_xdr,
+		      tracker.entries_size, XDR_ENCODE);
 
 	if (begin_cookie == 0) {
 		/* Fill in "." */
@@ -305,11 +339,21 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 	}
 
+	/* Entries encoded for the same export may be kept by the cache
+	 * and reused.
+	 */
+	tracker.enc.key[0] = NFS_V3 << 8;
+	tracker.enc.key[1] = op_ctx->ctx_export->export_id;
+	readdirplus_enc_next(&tracker);
+	op_ctx->readdir_enc = &tracker.enc;
+
 	/* Call readdir */
 	fsal_status = fsal_readdir(dir_obj, fsal_cookie, &num_entries, &eod_met,
 				   ATTRS_NFS3, nfs3_readdirplus_callback,
 				   &tracker);
 
+	op_ctx->readdir_enc = NULL;
+
 	if (FSAL_IS_ERROR(fsal_status)) {
 		/* Is this a retryable error */
 		if (nfs_RetryableError(fsal_status.major)) {
@@ -330,18 +374,21 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		     "Readdirplus3 -> Call to fsal_readdir( cookie=%"
 		     PRIu64 ")", fsal_cookie);
 
-	if ((num_entries == 0) && (begin_cookie > 1)) {
-		res->res_readdirplus3.status = NFS3_OK;
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
-		    NULL;
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof = TRUE;
-	} else {
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
-		    tracker.entries;
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof =
-		    eod_met;
+	if (tracker.count != 0) {
+		/* End the list and hand the entries to the reply */
+		pos = xdr_getpos(&tracker.xdrs);
+		xdr_destroy(&tracker.xdrs);
+		memset(tracker.entries_xdr + pos, 0, BYTES_PER_XDR_UNIT);
+		reply->entries_xdr = tracker.entries_xdr;
+		reply->entries_xdr_len = pos + BYTES_PER_XDR_UNIT;
+		tracker.entries_xdr = NULL;
 	}
 
+	if ((num_entries == 0) && (begin_cookie > 1))
+		reply->eof = TRUE;
+	else
+		reply->eof = eod_met;
+
 	nfs_SetPostOpAttr(dir_obj,
 			  &res->res_readdirplus3.READDIRPLUS3res_u.resok.
 				dir_attributes,
@@ -374,9 +421,11 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	if (dir_obj)
 		dir_obj->obj_ops.put_ref(dir_obj);
 
-	if (((res->res_readdir3.status != NFS3_OK) || (rc != NFS_REQ_OK))
-	    && (tracker.entries != NULL))
-		free_entryplus3s(tracker.entries);
+	/* Whatever was not handed to the reply */
+	if (tracker.entries_xdr != NULL) {
+		xdr_destroy(&tracker.xdrs);
+		gsh_free(tracker.entries_xdr);
+	}
 
 	return rc;
 }				/* nfs3_readdirplus */
@@ -392,20 +441,40 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 void nfs3_readdirplus_free(nfs_res_t *resp)
 {
 #define RESREADDIRPLUSREPLY resp->res_readdirplus3.READDIRPLUS3res_u.resok.reply
-	if ((resp->res_readdirplus3.status == NFS3_OK)
-	    && (RESREADDIRPLUSREPLY.entries != NULL))
-		free_entryplus3s(RESREADDIRPLUSREPLY.entries);
+	if (resp->res_readdirplus3.status == NFS3_OK)
+		gsh_free(RESREADDIRPLUSREPLY.entries_xdr);
 }
 
 /**
- * @brief Populate entryplus3s when called from fsal_readdir
+ * @brief Encode one entryplus3, with its value follows marker
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entryplys3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * @param[in] xdrs The stream
+ * @param[in] ep3  The entry, its nextentry is not encoded
+ *
+ * @return true if the whole entry fit.
+ */
+
+static bool xdr_readdirplus_entry3(XDR *xdrs, entryplus3 *ep3)
+{
+	bool_t follows = TRUE;
+
+	return inline_xdr_bool(xdrs, &follows) &&
+	       xdr_fileid3(xdrs, &ep3->fileid) &&
+	       xdr_filename3(xdrs, &ep3->name) &&
+	       xdr_cookie3(xdrs, &ep3->cookie) &&
+	       xdr_post_op_attr(xdrs, &ep3->name_attributes) &&
+	       xdr_post_op_fh3(xdrs, &ep3->name_handle);
+}
+
+/**
+ * @brief Encode entryplus3s when called from fsal_readdir
+ *
+ * This function is a callback passed to fsal_readdir.  It encodes
+ * each entry into the reply buffer, stopping once an entry no longer
+ * fits.  Nothing is allocated per entry.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdirplus_cb_data that is
- *                    gives the location of the array and other
+ *                    gives the location of the buffer and other
  *                    bookeeping information
  * @param name [in] The filename for the current obj
  * @param handle [in] The current obj's filehandle
@@ -423,94 +492,82 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	/* Not-so-opaque pointer to callback data` */
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs3_readdirplus_cb_data *tracker = cb_parms->opaque;
-	/* Length of the current filename */
-	size_t namelen = strlen(cb_parms->name);
-	entryplus3 *ep3 = tracker->entries + tracker->count;
+	char fh_buf[NFS3_FHSIZE];
+	entryplus3 ep3;
+	u_int pos;
 
-	if (tracker->count == tracker->total_entries) {
+	if (tracker->full) {
 		cb_parms->in_result = false;
 		return ERR_FSAL_NO_ERROR;
 	}
-	/* This is a pessimistic check, which assumes that we're going
-	 * to send attributes and full size handle - if it fails then
-	 * we're close enough to the buffer size limit and t's time to
-	 * stop anyway */
-	if (tracker->mem_left
-	    < (sizeof(entryplus3) + namelen + NFS3_FHSIZE)) {
-		if (tracker->count == 0)
-			tracker->error = NFS3ERR_TOOSMALL;
 
-		cb_parms->in_result = false;
-		return ERR_FSAL_NO_ERROR;
+	/* The cache copied this entry as an earlier READDIRPLUS
+	 * encoded it
+	 */
+	if (op_ctx->readdir_enc != NULL && tracker->enc.cached_len != 0 &&
+	    cb_parms->attr_allowed) {
+		pos = xdr_getpos(&tracker->xdrs);
+		if (xdr_setpos(&tracker->xdrs, pos + tracker->enc.cached_len))
+			goto added;
 	}
 
-	ep3->fileid = obj->fileid;
-	ep3->name = gsh_strdup(cb_parms->name);
-	ep3->cookie = cookie;
+	memset(&ep3, 0, sizeof(ep3));
 
-	/* Account for file name + length + cookie */
-	tracker->mem_left -= sizeof(ep3->cookie) + ((namelen + 3) & ~3) + 4;
+	ep3.fileid = obj->fileid;
+	ep3.name = (char *) cb_parms->name;
+	ep3.cookie = cookie;
 
 	if (cb_parms->attr_allowed) {
-		ep3->name_handle.handle_follows = TRUE;
+		ep3.name_handle.handle_follows = TRUE;
+		ep3.name_handle.post_op_fh3_u.handle.data.data_val = fh_buf;
 
-		if (!nfs3_FSALToFhandle(true,
-					&ep3->name_handle.post_op_fh3_u.handle,
+		if (!nfs3_FSALToFhandle(false,
+					&ep3.name_handle.post_op_fh3_u.handle,
 					obj,
 					op_ctx->ctx_export)) {
 			tracker->error = NFS3ERR_SERVERFAULT;
-			gsh_free(ep3->name);
 			cb_parms->in_result = false;
 			return ERR_FSAL_NO_ERROR;
 		}
 
-		/* Account for filehande + length + follows + nextentry */
-		tracker->mem_left -=
-		    ep3->name_handle.post_op_fh3_u.handle.data.data_len + 12;
-
-		ep3->name_attributes.attributes_follow = true;
+		ep3.name_attributes.attributes_follow = TRUE;
 
 		nfs3_FSALattr_To_Fattr(
 			obj, attr,
-			&ep3->name_attributes.post_op_attr_u.attributes);
+			&ep3.name_attributes.post_op_attr_u.attributes);
 	} else {
-		ep3->name_handle.handle_follows = false;
-		ep3->name_attributes.attributes_follow = false;
-		tracker->mem_left -= sizeof(ep3->name_handle.handle_follows);
+		ep3.name_handle.handle_follows = FALSE;
+		ep3.name_attributes.attributes_follow = FALSE;
 	}
 
-	if (ep3->name_attributes.attributes_follow)
-		tracker->mem_left -= sizeof(ep3->name_attributes);
-	else
-		tracker->mem_left -=
-		    sizeof(ep3->name_attributes.attributes_follow);
+	/* Exactly what is sent counts against maxcount */
+	pos = xdr_getpos(&tracker->xdrs);
 
-	if (tracker->count > 0)
-		tracker->entries[tracker->count - 1].nextentry = ep3;
+	if (!xdr_readdirplus_entry3(&tracker->xdrs, &ep3)) {
+		/* Did not fit, leave it for the next READDIRPLUS */
+		xdr_setpos(&tracker->xdrs, pos);
+		tracker->full = true;
 
-	++(tracker->count);
-	cb_parms->in_result = true;
+		if (tracker->count == 0)
+			tracker->error = NFS3ERR_TOOSMALL;
 
-	return ERR_FSAL_NO_ERROR;
-}				/* nfs3_readdirplus_callback */
+		cb_parms->in_result = false;
+		return ERR_FSAL_NO_ERROR;
+	}
 
-/**
- * @brief Clean up memory allocated to serve NFSv3 READDIRPLUS
- *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
- *
- * @param entryplus3s [in] Pointer to first obj
- */
+	/* Let the cache keep it for the next READDIRPLUS */
+	if (op_ctx->readdir_enc != NULL && cb_parms->attr_allowed) {
+		tracker->enc.store = tracker->entries_xdr + pos;
+		tracker->enc.store_len = xdr_getpos(&tracker->xdrs) - pos;
+	}
 
-static void free_entryplus3s(entryplus3 *entryplus3s)
-{
-	entryplus3 *entry = NULL;
+ added:
 
-	for (entry = entryplus3s; entry != NULL; entry = entry->nextentry) {
-		gsh_free(entry->name);
-		gsh_free(entry->name_handle.post_op_fh3_u.handle.data.data_val);
-	}
+	++(tracker->count);
+	cb_parms->in_result = true;
 
-	gsh_free(entryplus3s);
-}
+	if (op_ctx->readdir_enc != NULL)
+		readdirplus_enc_next(tracker);
+
+	return ERR_FSAL_NO_ERROR;
+}				/* nfs3_readdirplus_callback */
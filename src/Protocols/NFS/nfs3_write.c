@@ -47,6 +47,104 @@
 #include "export_mgr.h"
 #include "sal_functions.h"
 
+/**
+ * @brief State of a WRITE waiting for asynchronous I/O
+ */
+struct nfs3_write_data {
+	nfs_request_t *reqnfs;		/*< Request to resume */
+	struct fsal_obj_handle *obj;	/*< File being written */
+	fsal_status_t status;		/*< Status of the write */
+	struct fsal_io_arg write_arg;	/*< Arguments and results */
+};
+
+/**
+ * @brief Finish a WRITE once the FSAL has done the I/O
+ *
+ * Releases the share reservation and object reference taken by nfs3_write
+ * and builds the result.
+ *
+ * @param[out] res           Structure to contain the result of the call
+ * @param[in]  obj           File written
+ * @param[in]  fsal_status   Status of the write
+ * @param[in]  size          Amount requested
+ * @param[in]  written_size  Amount written
+ * @param[in]  sync          Whether the data is on stable storage
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+static int nfs3_write_done(nfs_res_t *res, struct fsal_obj_handle *obj,
+			   fsal_status_t fsal_status, size_t size,
+			   size_t written_size, bool sync)
+{
+	int rc = NFS_REQ_OK;
+
+	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		/* If we are here, there was an error */
+		LogFullDebug(COMPONENT_NFSPROTO,
+			     "failed write: fsal_status=%s",
+			     fsal_err_txt(fsal_status));
+
+		if (nfs_RetryableError(fsal_status.major)) {
+			rc = NFS_REQ_DROP;
+			goto out;
+		}
+
+		res->res_write3.status = nfs3_Errno_status(fsal_status);
+
+		nfs_SetWccData(NULL, obj,
+			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
+	} else {
+		/* Build Weak Cache Coherency data */
+		nfs_SetWccData(NULL, obj,
+			       &res->res_write3.WRITE3res_u.resok.file_wcc);
+
+		/* Set the written size */
+		res->res_write3.WRITE3res_u.resok.count = written_size;
+
+		/* How do we commit data ? */
+		if (sync)
+			res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
+		else
+			res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
+
+		/* Set the write verifier */
+		memcpy(res->res_write3.WRITE3res_u.resok.verf,
+		       NFS3_write_verifier,
+		       sizeof(writeverf3));
+
+		res->res_write3.status = NFS3_OK;
+	}
+
+ out:
+	/* return references */
+	obj->obj_ops.put_ref(obj);
+
+	server_stats_io_done(size, written_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     true);
+	return rc;
+}
+
+/**
+ * @brief Completion callback for an asynchronous WRITE
+ *
+ * @param[in] obj         File written
+ * @param[in] ret         Status of the write
+ * @param[in] write_arg   Arguments and results of the write
+ * @param[in] caller_arg  The nfs3_write_data
+ */
+static void nfs3_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			  struct fsal_io_arg *write_arg, void *caller_arg)
+{
+	struct nfs3_write_data *wdata = caller_arg;
+
+	wdata->status = fsal_io_complete(ret, write_arg, false);
+	nfs_rpc_complete_async_request(wdata->reqnfs);
+}
+
 /**
  *
  * @brief The NFSPROC3_WRITE
@@ -115,6 +213,14 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			 str, offset, size, stables);
 	}
 
+	/* Over the export or client rate limits, run again later */
+	if (nfs_rpc_rate_limit(nfs_req_from_svc(req), true,
+			       MIN(size, MaxWrite))) {
+		atomic_set_uint32_t_bits(&nfs_req_from_svc(req)->async_flags,
+					 NFS_REQ_ASYNC_RERUN);
+		return NFS_REQ_ASYNC_WAIT;
+	}
+
 	/* to avoid setting it on each error case */
 	res->res_write3.WRITE3res_u.resfail.file_wcc.before.attributes_follow =
 	    false;
@@ -228,6 +334,28 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
+	if (obj->fsal->m_ops.support_ex(obj) &&
+	    nfs_rpc_async_allowed(nfs_req_from_svc(req))) {
+		/* Hand the write to the FSAL and suspend the request */
+		nfs_request_t *reqnfs = nfs_req_from_svc(req);
+		struct nfs3_write_data *wdata = gsh_calloc(1, sizeof(*wdata));
+
+		wdata->reqnfs = reqnfs;
+		wdata->obj = obj;
+		/** @todo for now pass NULL state */
+		wdata->write_arg.state = NULL;
+		wdata->write_arg.offset = offset;
+		wdata->write_arg.io_request = size;
+		wdata->write_arg.buffer = data;
+		wdata->write_arg.fsal_stable = sync;
+		reqnfs->proc_data = wdata;
+
+		fsal_write2_async(obj, true, &wdata->write_arg, nfs3_write_cb,
+				  wdata);
+
+		return NFS_REQ_ASYNC_WAIT;
+	}
+
 	if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
 		/** @todo for now pass NULL state */
@@ -253,48 +381,8 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 					NULL);
 	}
 
-	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
-
-	if (FSAL_IS_ERROR(fsal_status)) {
-		/* If we are here, there was an error */
-		LogFullDebug(COMPONENT_NFSPROTO,
-			     "failed write: fsal_status=%s",
-			     fsal_err_txt(fsal_status));
-
-		if (nfs_RetryableError(fsal_status.major)) {
-			rc = NFS_REQ_DROP;
-			goto out;
-		}
-
-		res->res_write3.status = nfs3_Errno_status(fsal_status);
-
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
-
-		rc = NFS_REQ_OK;
-	} else {
-		/* Build Weak Cache Coherency data */
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resok.file_wcc);
-
-		/* Set the written size */
-		res->res_write3.WRITE3res_u.resok.count = written_size;
-
-		/* How do we commit data ? */
-		if (sync)
-			res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
-		else
-			res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
-
-		/* Set the write verifier */
-		memcpy(res->res_write3.WRITE3res_u.resok.verf,
-		       NFS3_write_verifier,
-		       sizeof(writeverf3));
-
-		res->res_write3.status = NFS3_OK;
-	}
-
-	rc = NFS_REQ_OK;
+	return nfs3_write_done(res, obj, fsal_status, size, written_size,
+			       sync);
 
  out:
 	/* return references */
@@ -307,6 +395,34 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 }				/* nfs3_write */
 
+/**
+ * @brief Resume an NFSPROC3_WRITE after asynchronous I/O
+ *
+ * @param[in]  arg     NFS argument union
+ * @param[in]  req     SVC request related to this call
+ * @param[out] res     Structure to contain the result of the call
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+
+int nfs3_write_resume(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
+{
+	nfs_request_t *reqnfs = nfs_req_from_svc(req);
+	struct nfs3_write_data *wdata = reqnfs->proc_data;
+	int rc;
+
+	reqnfs->proc_data = NULL;
+
+	rc = nfs3_write_done(res, wdata->obj, wdata->status,
+			     wdata->write_arg.io_request,
+			     wdata->write_arg.io_amount,
+			     wdata->write_arg.fsal_stable);
+
+	gsh_free(wdata);
+	return rc;
+}
+
 /**
  * @brief Frees the result structure allocated for nfs3_write.
  *
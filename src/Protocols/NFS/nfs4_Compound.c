@@ -42,6 +42,7 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "nfs_creds.h"
+#include "nfs_dupreq.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -458,6 +459,388 @@ nfs_opnum4 LastOpcode[] = {
 	NFS4_OP_REMOVEXATTR
 };
 
+/**
+ * @brief Record the result of one operation of a compound
+ *
+ * @param[in,out] data           Compound request's data
+ * @param[in]     arg            Generic nfs arguments
+ * @param[in,out] res            NFSv4 reply structure
+ * @param[in]     opcode         Operation (0 for illegal ones)
+ * @param[in]     op_start_time  When the operation started
+ * @param[in,out] status         Status of the operation, replaced by the
+ *                               cached status on a replay
+ *
+ * @return true if no more operations are to be processed.
+ */
+
+static bool nfs4_op_done(compound_data_t *data, nfs_arg_t *arg,
+			 nfs_res_t *res, nfs_opnum4 opcode,
+			 nsecs_elapsed_t op_start_time, int *status)
+{
+	nfs_resop4 *resarray = res->res_compound4.resarray.resarray_val;
+	uint32_t i = data->oppos;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, v4op_end, i,
+		   arg->arg_compound4.argarray.argarray_val[i].argop,
+		   optabv4[opcode].name, nfsstat4_to_str(*status));
+#endif
+
+	LogCompoundFH(data);
+
+	/* All the operation, like NFS4_OP_ACESS, have a first replyied
+	 * field called .status
+	 */
+	resarray[i].nfs_resop4_u.opaccess.status = *status;
+
+	server_stats_nfsv4_op_done(opcode, op_start_time, *status);
+
+	if (*status != NFS4_OK) {
+		/* An error occured, we do not manage the other requests
+		 * in the COMPOUND, this may be a regular behavior
+		 */
+		LogDebug(COMPONENT_NFS_V4,
+			 "Status of %s in position %d = %s",
+			 optabv4[opcode].name, i,
+			 nfsstat4_to_str(*status));
+
+		res->res_compound4.resarray.resarray_len = i + 1;
+
+		return true;
+	}
+
+	/* Check Req size */
+
+	/* NFS_V4.1 specific stuff */
+	if (data->use_drc) {
+		/* Replay cache, only true for SEQUENCE or
+		 * CREATE_SESSION w/o SEQUENCE. Since will only be set
+		 * in those cases, no need to check operation or
+		 * anything.
+		 */
+
+		/* Free the reply allocated above */
+		gsh_free(res->res_compound4.resarray.resarray_val);
+
+		/* Copy the reply from the cache */
+		*status = ((COMPOUND4res *) data->cached_res)->status;
+		if (data->cached_res->res_encoded != NULL) {
+			/* Send the encoded reply, with our own reference */
+			memset(&res->res_compound4_extended, 0,
+			       sizeof(res->res_compound4_extended));
+			res->res_compound4.status = *status;
+			res->res_compound4_extended.res_encoded =
+				data->cached_res->res_encoded;
+			nfs_reply_get(data->cached_res->res_encoded);
+		} else {
+			res->res_compound4_extended = *data->cached_res;
+		}
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Use session replay cache %p result %s",
+			     data->cached_res, nfsstat4_to_str(*status));
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Estimate the memory held by a compound reply
+ *
+ * Counts the result array and the data returned by READ, which is
+ * what dominates the size of cached replies.
+ *
+ * @param[in] res The reply
+ *
+ * @return Size in bytes.
+ */
+
+static size_t nfs4_Compound_ResSize(COMPOUND4res *res)
+{
+	size_t size = res->resarray.resarray_len * sizeof(nfs_resop4) +
+		      res->tag.utf8string_len;
+	unsigned int i;
+
+	for (i = 0; i < res->resarray.resarray_len; i++) {
+		nfs_resop4 *val = &res->resarray.resarray_val[i];
+
+		if (val->resop == NFS4_OP_READ &&
+		    val->nfs_resop4_u.opread.status == NFS4_OK)
+			size += val->nfs_resop4_u.opread.READ4res_u.resok4
+				.data.data_len;
+	}
+
+	return size;
+}
+
+/**
+ * @brief Replace a compound reply with its XDR encoding
+ *
+ * The decoded results are freed; the reply keeps its status and is
+ * sent from the encoded copy by xdr_COMPOUND4res_extended.
+ *
+ * @param[in,out] res The reply
+ *
+ * @retval true if the reply was encoded.
+ * @retval false if encoding failed and the reply is unchanged.
+ */
+
+static bool nfs4_Compound_Encode(nfs_res_t *res)
+{
+	nfsstat4 status = res->res_compound4.status;
+	struct nfs_encoded_reply *enc;
+
+	enc = nfs_reply_encode((xdrproc_t) xdr_COMPOUND4res,
+			       &res->res_compound4);
+	if (enc == NULL)
+		return false;
+
+	nfs4_Compound_Free(res);
+
+	memset(&res->res_compound4_extended, 0,
+	       sizeof(res->res_compound4_extended));
+	res->res_compound4.status = status;
+	res->res_compound4_extended.res_encoded = enc;
+
+	return true;
+}
+
+/**
+ * @brief Finish a compound once all its operations have been processed
+ *
+ * @param[in,out] data       Compound request's data, freed here
+ * @param[in]     arg        Generic nfs arguments
+ * @param[in,out] res        NFSv4 reply structure
+ * @param[in]     status     Status of the last operation processed
+ * @param[in]     lastindex  Index at which processing stopped
+ *
+ * @return NFS_REQ_OK.
+ */
+
+static int nfs4_Compound_done(compound_data_t *data, nfs_arg_t *arg,
+			      nfs_res_t *res, int status,
+			      unsigned int lastindex)
+{
+	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
+
+	server_stats_compound_done(argarray_len, status);
+
+	/* Complete the reply, in particular, tell where you stopped if
+	 * unsuccessfull COMPOUD
+	 */
+	res->res_compound4.status = status;
+
+	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
+	 * save a replayed result again.
+	 */
+	if (data->cached_res != NULL && !data->use_drc) {
+		struct COMPOUND4res_extended cached;
+
+		/* Pointer has been set by nfs4_op_sequence and points to slot
+		 * to cache result in.
+		 */
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
+			     data->cached_res, (int)sizeof(nfs_res_t));
+
+		if (nfs_param.core_param.drc.encoded_replies &&
+		    nfs4_Compound_Encode(res)) {
+			/* The reply and the slot share the encoded reply */
+			memset(&cached, 0, sizeof(cached));
+			cached.res_compound4.status = status;
+			cached.res_encoded =
+				res->res_compound4_extended.res_encoded;
+			cached.res_size = cached.res_encoded->len;
+			nfs_reply_get(cached.res_encoded);
+		} else {
+			/* Indicate to nfs4_Compound_Free that this reply is
+			 * cached.
+			 */
+			res->res_compound4_extended.res_cached = true;
+			res->res_compound4_extended.res_size =
+				nfs4_Compound_ResSize(&res->res_compound4);
+			cached = res->res_compound4_extended;
+		}
+
+		cached.res_cached = true;
+
+		if (data->session != NULL)
+			PTHREAD_MUTEX_lock(
+				&data->session->slots[data->slot].lock);
+
+		/* If the cache is already in use, free it. */
+		nfs4_Compound_FreeCached(data->cached_res);
+
+		/* Save the result in the cache. */
+		*data->cached_res = cached;
+		(void) atomic_add_uint64_t(&nfs41_session_cache_size,
+					   data->cached_res->res_size);
+
+		if (data->session != NULL) {
+			/* The slot may have been released meanwhile */
+			data->session->slots[data->slot].cache_used = true;
+			PTHREAD_MUTEX_unlock(
+				&data->session->slots[data->slot].lock);
+		}
+	}
+
+	/* If we have reserved a lease, update it and release it */
+	if (data->preserved_clientid != NULL) {
+		/* Update and release lease */
+		PTHREAD_MUTEX_lock(&data->preserved_clientid->cid_mutex);
+
+		update_lease(data->preserved_clientid);
+
+		PTHREAD_MUTEX_unlock(&data->preserved_clientid->cid_mutex);
+	}
+
+	if (status != NFS4_OK)
+		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
+			 nfsstat4_to_str(status), lastindex);
+
+	nfs_req_from_svc(data->req)->proc_data = NULL;
+	compound_data_Free(data);
+	gsh_free(data);
+
+	return NFS_REQ_OK;
+}
+
+/**
+ * @brief Process the operations of a compound
+ *
+ * @param[in,out] data    Compound request's data
+ * @param[in]     arg     Generic nfs arguments
+ * @param[in,out] res     NFSv4 reply structure
+ * @param[in]     i       Index of the first operation to process
+ * @param[in]     status  Status so far
+ *
+ * @retval NFS_REQ_OK if a result is sent.
+ * @retval NFS_REQ_ASYNC_WAIT if an operation is waiting for I/O.
+ */
+
+static int nfs4_Compound_ops(compound_data_t *data, nfs_arg_t *arg,
+			     nfs_res_t *res, unsigned int i, int status)
+{
+	nfs_opnum4 opcode;
+	const uint32_t compound4_minor = data->minorversion;
+	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
+	/* Array of op arguments */
+	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
+	nfs_resop4 *resarray = res->res_compound4.resarray.resarray_val;
+	nsecs_elapsed_t op_start_time;
+	struct timespec ts;
+	int perm_flags;
+
+	for (; i < argarray_len; i++) {
+		/* Used to check if OP_SEQUENCE is the first operation */
+		data->oppos = i;
+
+		/* Verify BIND_CONN_TO_SESSION is not used in a compound
+		 * with length > 1.
+		 */
+		if (i > 0 &&
+		    argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
+			status = NFS4ERR_NOT_ONLY_OP;
+			goto bad_op_state;
+		}
+
+		/* time each op */
+		now(&ts);
+		op_start_time = timespec_diff(&ServerBootTime, &ts);
+		opcode = argarray[i].argop;
+
+		/* Handle opcode overflow */
+		if (opcode > LastOpcode[compound4_minor])
+			opcode = 0;
+
+		if (compound4_minor > 0 && data->session != NULL &&
+		    data->session->fore_channel_attrs.ca_maxoperations == i) {
+			status = NFS4ERR_TOO_MANY_OPS;
+			goto bad_op_state;
+		}
+
+		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
+			 argarray[i].argop, optabv4[opcode].name);
+		perm_flags =
+		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
+
+		if (perm_flags != 0) {
+			status = nfs4_Is_Fh_Empty(&data->currentFH);
+			if (status != NFS4_OK) {
+				LogDebug(COMPONENT_NFS_V4,
+					 "Status of %s for CurrentFH in position %d = %s",
+					 optabv4[opcode].name,
+					 i,
+					 nfsstat4_to_str(status));
+				goto bad_op_state;
+			}
+
+			/* Operation uses a CurrentFH, so we can check export
+			 * perms. Perms should even be set reasonably for pseudo
+			 * file system.
+			 */
+			LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+				       "Check export perms export = %08x req = %08x",
+				       op_ctx->export_perms->options &
+						EXPORT_OPTION_ACCESS_MASK,
+				       perm_flags);
+			if ((op_ctx->export_perms->options &
+			     perm_flags) != perm_flags) {
+				/* Export doesn't allow requested
+				 * access for this client.
+				 */
+				if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
+				    != 0)
+					status = NFS4ERR_ROFS;
+				else
+					status = NFS4ERR_ACCESS;
+
+				LogDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+					    "Status of %s due to export permissions in position %d = %s",
+					    optabv4[opcode].name, i,
+					    nfsstat4_to_str(status));
+ bad_op_state:
+				/* All the operation, like NFS4_OP_ACESS, have
+				 * a first replied field called .status
+				 */
+				resarray[i].nfs_resop4_u.opaccess.status =
+				    status;
+				resarray[i].resop = argarray[i].argop;
+
+				/* Do not manage the other requests in the
+				 * COMPOUND.
+				 */
+				res->res_compound4.resarray.resarray_len =
+					i + 1;
+				break;
+			}
+		}
+
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, v4op_start, i, argarray[i].argop,
+			   optabv4[opcode].name);
+#endif
+
+		status = (optabv4[opcode].funct) (&argarray[i],
+						  data,
+						  &resarray[i]);
+
+		if (data->op_async) {
+			/* The operation has started asynchronous I/O; the
+			 * request will be resumed at this op when it is done.
+			 */
+			data->op_start_time = op_start_time;
+			return NFS_REQ_ASYNC_WAIT;
+		}
+
+		if (nfs4_op_done(data, arg, res, opcode, op_start_time,
+				 &status))
+			break;
+	}			/* for */
+
+	return nfs4_Compound_done(data, arg, res, status, i);
+}
+
 /**
  * @brief The NFS PROC4 COMPOUND
  *
@@ -481,18 +864,12 @@ nfs_opnum4 LastOpcode[] = {
 
 int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
-	unsigned int i = 0;
 	int status = NFS4_OK;
-	compound_data_t data;
-	nfs_opnum4 opcode;
+	compound_data_t *data;
 	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
 	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
 	/* Array of op arguments */
 	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
-	nfs_resop4 *resarray;
-	nsecs_elapsed_t op_start_time;
-	struct timespec ts;
-	int perm_flags;
 	char *tagname = NULL;
 	char *notag = "NO TAG";
 
@@ -564,17 +941,21 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		return NFS_REQ_OK;
 	}
 
-	/* Initialisation of the compound request internal's data */
-	memset(&data, 0, sizeof(data));
+	/* Initialisation of the compound request internal's data.  It is
+	 * allocated so that it survives the request being suspended.
+	 */
+	data = gsh_calloc(1, sizeof(*data));
 	op_ctx->nfs_minorvers = compound4_minor;
 
 	/* Minor version related stuff */
-	data.minorversion = compound4_minor;
-	data.req = req;
+	data->minorversion = compound4_minor;
+	data->req = req;
 
 	/* Building the client credential field */
-	if (nfs_rpc_req2client_cred(req, &(data.credential)) == -1)
+	if (nfs_rpc_req2client_cred(req, &(data->credential)) == -1) {
+		gsh_free(data);
 		return NFS_REQ_DROP;	/* Malformed credential */
+	}
 
 	/* Keeping the same tag as in the arguments */
 	res->res_compound4.tag.utf8string_len =
@@ -585,7 +966,6 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
 
 	res->res_compound4.resarray.resarray_len = argarray_len;
-	resarray = res->res_compound4.resarray.resarray_val;
 
 	/* Manage errors NFS4ERR_OP_NOT_IN_SESSION and NFS4ERR_NOT_ONLY_OP.
 	 * These checks apply only to 4.1 */
@@ -603,6 +983,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			status = NFS4ERR_OP_NOT_IN_SESSION;
 			res->res_compound4.status = status;
 			res->res_compound4.resarray.resarray_len = 0;
+			gsh_free(data);
 			return NFS_REQ_OK;
 		}
 
@@ -628,6 +1009,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 				status = NFS4ERR_NOT_ONLY_OP;
 				res->res_compound4.status = status;
 				res->res_compound4.resarray.resarray_len = 0;
+				gsh_free(data);
 				return NFS_REQ_OK;
 			}
 		}
@@ -646,204 +1028,62 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			status = NFS4ERR_NOT_ONLY_OP;
 			res->res_compound4.status = status;
 			res->res_compound4.resarray.resarray_len = 0;
+			gsh_free(data);
 			return NFS_REQ_OK;
 		}
 	}
 
-	for (i = 0; i < argarray_len; i++) {
-		/* Used to check if OP_SEQUENCE is the first operation */
-		data.oppos = i;
-
-		/* Verify BIND_CONN_TO_SESSION is not used in a compound
-		 * with length > 1.
-		 */
-		if (i > 0 &&
-		    argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
-			status = NFS4ERR_NOT_ONLY_OP;
-			goto bad_op_state;
-		}
-
-		/* time each op */
-		now(&ts);
-		op_start_time = timespec_diff(&ServerBootTime, &ts);
-		opcode = argarray[i].argop;
-
-		/* Handle opcode overflow */
-		if (opcode > LastOpcode[compound4_minor])
-			opcode = 0;
-
-		if (compound4_minor > 0 && data.session != NULL &&
-		    data.session->fore_channel_attrs.ca_maxoperations == i) {
-			status = NFS4ERR_TOO_MANY_OPS;
-			goto bad_op_state;
-		}
-
-		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
-			 argarray[i].argop, optabv4[opcode].name);
-		perm_flags =
-		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
-
-		if (perm_flags != 0) {
-			status = nfs4_Is_Fh_Empty(&data.currentFH);
-			if (status != NFS4_OK) {
-				LogDebug(COMPONENT_NFS_V4,
-					 "Status of %s for CurrentFH in position %d = %s",
-					 optabv4[opcode].name,
-					 i,
-					 nfsstat4_to_str(status));
-				goto bad_op_state;
-			}
-
-			/* Operation uses a CurrentFH, so we can check export
-			 * perms. Perms should even be set reasonably for pseudo
-			 * file system.
-			 */
-			LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
-				       "Check export perms export = %08x req = %08x",
-				       op_ctx->export_perms->options &
-						EXPORT_OPTION_ACCESS_MASK,
-				       perm_flags);
-			if ((op_ctx->export_perms->options &
-			     perm_flags) != perm_flags) {
-				/* Export doesn't allow requested
-				 * access for this client.
-				 */
-				if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
-				    != 0)
-					status = NFS4ERR_ROFS;
-				else
-					status = NFS4ERR_ACCESS;
-
-				LogDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
-					    "Status of %s due to export permissions in position %d = %s",
-					    optabv4[opcode].name, i,
-					    nfsstat4_to_str(status));
- bad_op_state:
-				/* All the operation, like NFS4_OP_ACESS, have
-				 * a first replied field called .status
-				 */
-				resarray[i].nfs_resop4_u.opaccess.status =
-				    status;
-				resarray[i].resop = argarray[i].argop;
-
-				/* Do not manage the other requests in the
-				 * COMPOUND.
-				 */
-				res->res_compound4.resarray.resarray_len =
-					i + 1;
-				break;
-			}
-		}
-
-#ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_start, i, argarray[i].argop,
-			   optabv4[opcode].name);
-#endif
-
-		status = (optabv4[opcode].funct) (&argarray[i],
-						  &data,
-						  &resarray[i]);
-
-#ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_end, i, argarray[i].argop,
-			   optabv4[opcode].name, nfsstat4_to_str(status));
-#endif
-
-		LogCompoundFH(&data);
-
-		/* All the operation, like NFS4_OP_ACESS, have a first replyied
-		 * field called .status
-		 */
-		resarray[i].nfs_resop4_u.opaccess.status = status;
-
-		server_stats_nfsv4_op_done(opcode, op_start_time, status);
-
-		if (status != NFS4_OK) {
-			/* An error occured, we do not manage the other requests
-			 * in the COMPOUND, this may be a regular behavior
-			 */
-			LogDebug(COMPONENT_NFS_V4,
-				 "Status of %s in position %d = %s",
-				 optabv4[opcode].name, i,
-				 nfsstat4_to_str(status));
-
-			res->res_compound4.resarray.resarray_len = i + 1;
-
-			break;
-		}
-
-		/* Check Req size */
-
-		/* NFS_V4.1 specific stuff */
-		if (data.use_drc) {
-			/* Replay cache, only true for SEQUENCE or
-			 * CREATE_SESSION w/o SEQUENCE. Since will only be set
-			 * in those cases, no need to check operation or
-			 * anything.
-			 */
-
-			/* Free the reply allocated above */
-			gsh_free(res->res_compound4.resarray.resarray_val);
-
-			/* Copy the reply from the cache */
-			res->res_compound4_extended = *data.cached_res;
-			status = ((COMPOUND4res *) data.cached_res)->status;
-			LogFullDebug(COMPONENT_SESSIONS,
-				     "Use session replay cache %p result %s",
-				     data.cached_res, nfsstat4_to_str(status));
-			break;	/* Exit the for loop */
-		}
-	}			/* for */
-
-	server_stats_compound_done(argarray_len, status);
-
-	/* Complete the reply, in particular, tell where you stopped if
-	 * unsuccessfull COMPOUD
-	 */
-	res->res_compound4.status = status;
-
-	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
-	 * save a replayed result again.
-	 */
-	if (data.cached_res != NULL && !data.use_drc) {
-		/* Pointer has been set by nfs4_op_sequence and points to slot
-		 * to cache result in.
-		 */
-		LogFullDebug(COMPONENT_SESSIONS,
-			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
-			     data.cached_res, (int)sizeof(nfs_res_t));
-
-		/* Indicate to nfs4_Compound_Free that this reply is cached. */
-		res->res_compound4_extended.res_cached = true;
-
-		/* If the cache is already in use, free it. */
-		if (data.cached_res->res_cached) {
-			data.cached_res->res_cached = false;
-			nfs4_Compound_Free((nfs_res_t *) data.cached_res);
-		}
-
-		/* Save the result in the cache. */
-		*data.cached_res = res->res_compound4_extended;
-	}
+	nfs_req_from_svc(req)->proc_data = data;
 
-	/* If we have reserved a lease, update it and release it */
-	if (data.preserved_clientid != NULL) {
-		/* Update and release lease */
-		PTHREAD_MUTEX_lock(&data.preserved_clientid->cid_mutex);
+	return nfs4_Compound_ops(data, arg, res, 0, status);
+}				/* nfs4_Compound */
 
-		update_lease(data.preserved_clientid);
+/**
+ * @brief Resume an NFS PROC4 COMPOUND after asynchronous I/O
+ *
+ * Finishes the operation that was waiting for I/O, or runs again the
+ * operation that was deferred by rate limiting, then carries on with
+ * the rest of the compound.
+ *
+ *  @param[in]  arg        Generic nfs arguments
+ *  @param[in]  req        NFSv4 request structure
+ *  @param[out] res        NFSv4 reply structure
+ *
+ * @retval NFS_REQ_OK if a result is sent.
+ * @retval NFS_REQ_ASYNC_WAIT if a later operation is waiting for I/O.
+ */
 
-		PTHREAD_MUTEX_unlock(&data.preserved_clientid->cid_mutex);
+int nfs4_Compound_resume(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
+{
+	compound_data_t *data = nfs_req_from_svc(req)->proc_data;
+	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
+	nfs_resop4 *resarray = res->res_compound4.resarray.resarray_val;
+	uint32_t i = data->oppos;
+	nfs_opnum4 opcode = argarray[i].argop;
+	int status;
+
+	if (opcode > LastOpcode[data->minorversion])
+		opcode = 0;
+
+	data->op_async = false;
+
+	if (data->op_deferred) {
+		/* Deferred by rate limiting before it did anything */
+		data->op_deferred = false;
+		status = optabv4[opcode].funct(&argarray[i], data,
+					       &resarray[i]);
+		if (data->op_async)
+			return NFS_REQ_ASYNC_WAIT;
+	} else {
+		status = optabv4[opcode].resume(&argarray[i], data,
+						&resarray[i]);
 	}
 
-	if (status != NFS4_OK)
-		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
-			 nfsstat4_to_str(status), i);
-
-	compound_data_Free(&data);
+	if (nfs4_op_done(data, arg, res, opcode, data->op_start_time, &status))
+		return nfs4_Compound_done(data, arg, res, status, i);
 
-	return NFS_REQ_OK;
-}				/* nfs4_Compound */
+	return nfs4_Compound_ops(data, arg, res, i + 1, status);
+}
 
 /**
  *
@@ -908,6 +1148,48 @@ void nfs4_Compound_Free(nfs_res_t *res)
 
 	if (res->res_compound4.tag.utf8string_val)
 		gsh_free(res->res_compound4.tag.utf8string_val);
+
+	if (res->res_compound4_extended.res_encoded != NULL) {
+		nfs_reply_put(res->res_compound4_extended.res_encoded);
+		res->res_compound4_extended.res_encoded = NULL;
+	}
+}
+
+/**
+ * @brief XDR procedure for NFS4PROC_COMPOUND replies
+ *
+ * Sends the encoded copy of the reply if there is one, else encodes
+ * the reply.
+ *
+ * @param[in] xdrs XDR stream
+ * @param[in] objp The reply
+ *
+ * @return true if successful.
+ */
+bool xdr_COMPOUND4res_extended(XDR *xdrs, struct COMPOUND4res_extended *objp)
+{
+	if (objp->res_encoded != NULL)
+		return xdr_nfs_encoded_reply(xdrs, objp->res_encoded);
+
+	return xdr_COMPOUND4res(xdrs, &objp->res_compound4);
+}
+
+/**
+ * @brief Free a reply held in a session's reply cache
+ *
+ * Does nothing if nothing is cached.
+ *
+ * @param[in,out] res The cached reply
+ */
+void nfs4_Compound_FreeCached(struct COMPOUND4res_extended *res)
+{
+	if (!res->res_cached)
+		return;
+
+	res->res_cached = false;
+	nfs4_Compound_Free((nfs_res_t *) res);
+	(void) atomic_sub_uint64_t(&nfs41_session_cache_size, res->res_size);
+	res->res_size = 0;
 }
 
 /**
@@ -929,6 +1211,11 @@ void compound_data_Free(compound_data_t *data)
 		data->session = NULL;
 	}
 
+	if (data->replay_res.res_encoded != NULL) {
+		nfs_reply_put(data->replay_res.res_encoded);
+		data->replay_res.res_encoded = NULL;
+	}
+
 	/* Release CurrentFH reference to export. */
 	if (op_ctx->ctx_export) {
 		put_gsh_export(op_ctx->ctx_export);
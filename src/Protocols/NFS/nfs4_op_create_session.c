@@ -87,6 +87,8 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		sizeof(str_clientid4), str_clientid4, str_clientid4};
 	/* Return code from clientid calls */
 	int i, rc = 0;
+	/* Number of fore channel slots granted */
+	uint32_t nb_slots;
 	/* Component for logging */
 	log_components_t component = COMPONENT_CLIENTID;
 	/* Abbreviated alias for arguments */
@@ -324,9 +326,25 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	nfs41_session->cb_program = 0;
 	PTHREAD_MUTEX_init(&nfs41_session->cb_mutex, NULL);
 	PTHREAD_COND_init(&nfs41_session->cb_cond, NULL);
-	for (i = 0; i < NFS41_NB_SLOTS; i++)
+
+	/* Grant the slots the client asked for, up to the configured
+	 * maximum.
+	 */
+	nb_slots = MIN(arg_CREATE_SESSION4->csa_fore_chan_attrs.ca_maxrequests,
+		       nfs_param.nfsv4_param.max_session_slots);
+	if (nb_slots == 0)
+		nb_slots = 1;
+
+	nfs41_session->fore_channel_attrs.ca_maxrequests = nb_slots;
+	nfs41_session->highest_used_slotid = nb_slots - 1;
+	nfs41_session->slots = gsh_calloc(nb_slots,
+					  sizeof(nfs41_session_slot_t));
+	for (i = 0; i < nb_slots; i++)
 		PTHREAD_MUTEX_init(&nfs41_session->slots[i].lock, NULL);
 
+	LogDebug(component, "CREATE_SESSION granted %" PRIu32 " slots",
+		 nb_slots);
+
 	/* Take reference to clientid record on behalf the session. */
 	inc_client_id_ref(found);
 
@@ -336,8 +354,6 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		  &nfs41_session->session_link);
 	PTHREAD_MUTEX_unlock(&found->cid_mutex);
 
-	/* Set ca_maxrequests */
-	nfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
 	nfs41_Build_sessionid(&clientid, nfs41_session->session_id);
 
 	res_CREATE_SESSION4ok->csr_sequence = arg_CREATE_SESSION4->csa_sequence;
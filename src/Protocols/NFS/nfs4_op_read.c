@@ -47,6 +47,7 @@
 #include "fsal_pnfs.h"
 #include "server_stats.h"
 #include "export_mgr.h"
+#include "gsh_iobuf.h"
 
 /**
  * @brief Read on a pNFS pNFS data server
@@ -86,7 +87,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = gsh_iobuf_alloc(arg_READ4->count);
 
 	res_READ4->READ4res_u.resok4.data.data_val = buffer;
 
@@ -101,7 +102,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 				&eof);
 
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		gsh_iobuf_put(buffer);
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
 	}
 
@@ -157,7 +158,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = gsh_iobuf_alloc(arg_READ4->count);
 
 	nfs_status = data->current_ds->dsh_ops.read_plus(
 				data->current_ds,
@@ -171,7 +172,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_RPLUS->rpr_status = nfs_status;
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		gsh_iobuf_put(buffer);
 		return res_RPLUS->rpr_status;
 	}
 
@@ -194,6 +195,118 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 }
 
 
+/**
+ * @brief State of a READ across the FSAL read
+ */
+struct nfs4_read_data {
+	nfs_request_t *reqnfs;		/*< Request to resume if async */
+	struct fsal_obj_handle *obj;	/*< File being read */
+	state_t *state_found;		/*< State from the stateid */
+	state_t *state_open;		/*< Associated open state */
+	state_owner_t *owner;		/*< Owner whose clientid is in op_ctx */
+	bool anonymous_started;		/*< Anonymous I/O share taken */
+	fsal_status_t status;		/*< Status of the read */
+	struct fsal_io_arg read_arg;	/*< Arguments and results */
+};
+
+/**
+ * @brief Finish a READ once the FSAL has done the I/O
+ *
+ * Builds the result and releases everything nfs4_read acquired.
+ *
+ * @param[out]    resp  Results for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[in]     rd    State of the read
+ *
+ * @return per RFC5661, p. 371
+ */
+
+static int nfs4_read_done(struct nfs_resop4 *resp, compound_data_t *data,
+			  struct nfs4_read_data *rd)
+{
+	READ4res * const res_READ4 = &resp->nfs_resop4_u.opread;
+	struct fsal_obj_handle *obj = rd->obj;
+	uint64_t offset = rd->read_arg.offset;
+	size_t read_size = rd->read_arg.io_amount;
+	bool eof_met = rd->read_arg.end_of_file;
+
+	if (FSAL_IS_ERROR(rd->status)) {
+		res_READ4->status = nfs4_Errno_status(rd->status);
+		gsh_iobuf_put(rd->read_arg.buffer);
+		res_READ4->READ4res_u.resok4.data.data_val = NULL;
+		goto done;
+	}
+
+	if (!eof_met) {
+		/** @todo FSF: add a config option for this behavior?
+		 */
+		/* Need to check against filesize for ESXi clients */
+		struct attrlist attrs;
+
+		fsal_prepare_attrs(&attrs, ATTR_SIZE);
+
+		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
+			eof_met = (offset + read_size) >= attrs.filesize;
+
+		/* Done with the attrs */
+		fsal_release_attrs(&attrs);
+	}
+
+	if (!rd->anonymous_started && data->minorversion == 0)
+		op_ctx->clientid = NULL;
+
+	res_READ4->READ4res_u.resok4.data.data_len = read_size;
+	res_READ4->READ4res_u.resok4.data.data_val = rd->read_arg.buffer;
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "NFS4_OP_READ: offset = %" PRIu64
+		     " read length = %zu eof=%u", offset, read_size, eof_met);
+
+	/* Is EOF met or not ? */
+	res_READ4->READ4res_u.resok4.eof = eof_met;
+
+	/* Say it is ok */
+	res_READ4->status = NFS4_OK;
+
+ done:
+
+	if (rd->anonymous_started)
+		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
+
+	server_stats_io_done(rd->read_arg.io_request, read_size,
+			     (res_READ4->status == NFS4_OK) ? true : false,
+			     false);
+
+	if (rd->owner != NULL)
+		dec_state_owner_ref(rd->owner);
+
+	if (rd->state_found != NULL)
+		dec_state_t_ref(rd->state_found);
+
+	if (rd->state_open != NULL)
+		dec_state_t_ref(rd->state_open);
+
+	return res_READ4->status;
+}
+
+/**
+ * @brief Completion callback for an asynchronous READ
+ *
+ * @param[in] obj         File read
+ * @param[in] ret         Status of the read
+ * @param[in] read_arg    Arguments and results of the read
+ * @param[in] caller_arg  The nfs4_read_data
+ */
+
+static void nfs4_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 struct fsal_io_arg *read_arg, void *caller_arg)
+{
+	struct nfs4_read_data *rd = caller_arg;
+
+	rd->status = fsal_io_complete(ret, read_arg, true);
+	nfs_rpc_complete_async_request(rd->reqnfs);
+}
+
 static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		    struct nfs_resop4 *resp, fsal_io_direction_t io,
 		    struct io_info *info)
@@ -201,11 +314,10 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	READ4args * const arg_READ4 = &op->nfs_argop4_u.opread;
 	READ4res * const res_READ4 = &resp->nfs_resop4_u.opread;
 	uint64_t size = 0;
-	size_t read_size = 0;
 	uint64_t offset = 0;
-	bool eof_met = false;
 	void *bufferdata = NULL;
 	fsal_status_t fsal_status = {0, 0};
+	struct nfs4_read_data rd = {0};
 	state_t *state_found = NULL;
 	state_t *state_open = NULL;
 	struct fsal_obj_handle *obj = NULL;
@@ -236,6 +348,15 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_READ4->status != NFS4_OK)
 		return res_READ4->status;
 
+	/* Over the export or client rate limits, run again later */
+	if (io == FSAL_IO_READ &&
+	    nfs_rpc_rate_limit(nfs_req_from_svc(data->req), false,
+			       MIN(arg_READ4->count, MaxRead))) {
+		data->op_async = true;
+		data->op_deferred = true;
+		return NFS4_OK;
+	}
+
 	obj = data->current_obj;
 	/* Check stateid correctness and get pointer to state (also
 	   checks for special stateids) */
@@ -448,7 +569,7 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	}
 
 	/* Some work is to be done */
-	bufferdata = gsh_malloc_aligned(4096, size);
+	bufferdata = gsh_iobuf_alloc(size);
 
 	if (!anonymous_started && data->minorversion == 0) {
 		owner = get_state_owner_ref(state_found);
@@ -458,61 +579,55 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	if (obj->fsal->m_ops.support_ex(obj)) {
-		/* Call the new fsal_read2 */
-		fsal_status = fsal_read2(obj, bypass, state_found, offset, size,
-					 &read_size, bufferdata, &eof_met,
-					 info);
-	} else {
-		/* Call legacy fsal_rdwr */
-		fsal_status = fsal_rdwr(obj, io, offset, size, &read_size,
-					bufferdata, &eof_met, &sync, info);
-	}
-
-	if (FSAL_IS_ERROR(fsal_status)) {
-		res_READ4->status = nfs4_Errno_status(fsal_status);
-		gsh_free(bufferdata);
-		res_READ4->READ4res_u.resok4.data.data_val = NULL;
-		goto done;
-	}
-
-	if (!eof_met) {
-		/** @todo FSF: add a config option for this behavior?
+	rd.obj = obj;
+	rd.state_found = state_found;
+	rd.state_open = state_open;
+	rd.owner = owner;
+	rd.anonymous_started = anonymous_started;
+	rd.read_arg.state = state_found;
+	rd.read_arg.offset = offset;
+	rd.read_arg.io_request = size;
+	rd.read_arg.buffer = bufferdata;
+	rd.read_arg.info = info;
+
+	if (io == FSAL_IO_READ && obj->fsal->m_ops.support_ex(obj) &&
+	    nfs_rpc_async_allowed(nfs_req_from_svc(data->req))) {
+		/* Hand the read to the FSAL; the compound is suspended
+		 * and nfs4_op_read_resume finishes the READ.
 		 */
-		/* Need to check against filesize for ESXi clients */
-		struct attrlist attrs;
+		struct nfs4_read_data *ard = gsh_malloc(sizeof(*ard));
 
-		fsal_prepare_attrs(&attrs, ATTR_SIZE);
+		*ard = rd;
+		ard->reqnfs = nfs_req_from_svc(data->req);
+		data->op_data = ard;
+		data->op_async = true;
 
-		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
-			eof_met = (offset + read_size) >= attrs.filesize;
+		fsal_read2_async(obj, bypass, &ard->read_arg, nfs4_read_cb,
+				 ard);
 
-		/* Done with the attrs */
-		fsal_release_attrs(&attrs);
+		return NFS4_OK;
 	}
 
-	if (!anonymous_started && data->minorversion == 0)
-		op_ctx->clientid = NULL;
-
-	res_READ4->READ4res_u.resok4.data.data_len = read_size;
-	res_READ4->READ4res_u.resok4.data.data_val = bufferdata;
-
-	LogFullDebug(COMPONENT_NFS_V4,
-		     "NFS4_OP_READ: offset = %" PRIu64
-		     " read length = %zu eof=%u", offset, read_size, eof_met);
-
-	/* Is EOF met or not ? */
-	res_READ4->READ4res_u.resok4.eof = eof_met;
+	if (obj->fsal->m_ops.support_ex(obj)) {
+		/* Call the new fsal_read2 */
+		rd.status = fsal_read2(obj, bypass, state_found, offset, size,
+				       &rd.read_arg.io_amount, bufferdata,
+				       &rd.read_arg.end_of_file, info);
+	} else {
+		/* Call legacy fsal_rdwr */
+		rd.status = fsal_rdwr(obj, io, offset, size,
+				      &rd.read_arg.io_amount, bufferdata,
+				      &rd.read_arg.end_of_file, &sync, info);
+	}
 
-	/* Say it is ok */
-	res_READ4->status = NFS4_OK;
+	return nfs4_read_done(resp, data, &rd);
 
  done:
 
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
 
-	server_stats_io_done(size, read_size,
+	server_stats_io_done(size, 0,
 			     (res_READ4->status == NFS4_OK) ? true : false,
 			     false);
 
@@ -553,6 +668,29 @@ int nfs4_op_read(struct nfs_argop4 *op, compound_data_t *data,
 	return err;
 }
 
+/**
+ * @brief Finish an NFS4_OP_READ after asynchronous I/O
+ *
+ * @param[in]     op    The nfs4_op arguments
+ * @param[in,out] data  The compound request's data
+ * @param[out]    resp  The nfs4_op results
+ *
+ * @return Errors as specified by RFC3550 RFC5661 p. 371.
+ */
+
+int nfs4_op_read_resume(struct nfs_argop4 *op, compound_data_t *data,
+			struct nfs_resop4 *resp)
+{
+	struct nfs4_read_data *rd = data->op_data;
+	int status;
+
+	data->op_data = NULL;
+	status = nfs4_read_done(resp, data, rd);
+	gsh_free(rd);
+
+	return status;
+}
+
 /**
  * @brief Free data allocated for READ result.
  *
@@ -568,7 +706,7 @@ void nfs4_op_read_Free(nfs_resop4 *res)
 
 	if (resp->status == NFS4_OK)
 		if (resp->READ4res_u.resok4.data.data_val != NULL)
-			gsh_free(resp->READ4res_u.resok4.data.data_val);
+			gsh_iobuf_put(resp->READ4res_u.resok4.data.data_val);
 }
 
 /**
@@ -617,6 +755,9 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 					info.io_content.data.d_data.data_len;
 		contentp->data.d_data.data_val =
 					info.io_content.data.d_data.data_val;
+	} else if (res_READ4->READ4res_u.resok4.data.data_val != NULL) {
+		/* A hole carries no data, the buffer is not needed */
+		gsh_iobuf_put(res_READ4->READ4res_u.resok4.data.data_val);
 	}
 	return res_RPLUS->rpr_status;
 }
@@ -628,7 +769,7 @@ void nfs4_op_read_plus_Free(nfs_resop4 *res)
 
 	if (resp->rpr_status == NFS4_OK && conp->what == NFS4_CONTENT_DATA)
 		if (conp->data.d_data.data_val != NULL)
-			gsh_free(conp->data.d_data.data_val);
+			gsh_iobuf_put(conp->data.d_data.data_val);
 }
 
 /**
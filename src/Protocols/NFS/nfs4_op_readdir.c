@@ -39,17 +39,20 @@
  * @brief Opaque bookkeeping structure for NFSv4 readdir
  *
  * This structure keeps track of the process of writing out an NFSv4
- * READDIR response between calls to nfs4_readdir_callback.
+ * READDIR response between calls to nfs4_readdir_callback.  Entries
+ * are encoded straight into the reply, which is sized to maxcount, so
+ * the stream running out of room is what ends the reply.
  */
 
 struct nfs4_readdir_cb_data {
-	entry4 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
+	XDR xdrs;		/*< Stream encoding entries into entries_xdr */
+	char *entries_xdr;	/*< The entries as they will be sent */
+	u_int entries_size;	/*< Room for entries in entries_xdr */
+	struct fsal_readdir_enc enc;	/*< Entries kept by the cache */
+	char *attr_buf;		/*< Scratch space for an entry's attributes */
+	u_int attr_buflen;	/*< Size of attr_buf */
 	size_t count;		/*< The count of complete entries stored in the
 				   buffer */
-	size_t total_entries;	/*< The total number of entries available
-				   in the array */
 	nfsstat4 error;		/*< Set to a value other than NFS4_OK if the
 				   callback function finds a fatal error. */
 	struct bitmap4 *req_attr;	/*< The requested attributes */
@@ -78,11 +81,123 @@ static void restore_data(struct nfs4_readdir_cb_data *tracker)
 }
 
 /**
- * @brief Populate entry4s when called from fsal_readdir
+ * @brief Fill in a fattr4 holding just FATTR4_RDATTR_ERROR
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entry4 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * @param[out] attrs        The attributes
+ * @param[in]  rdattr_error The error
+ * @param[in]  buf          Buffer for the attribute value
+ * @param[in]  buflen       Size of buf
+ *
+ * @return true if successful.
+ */
+
+static bool readdir_fattr_error(fattr4 *attrs, nfsstat4 rdattr_error,
+				char *buf, u_int buflen)
+{
+	XDR attr_body;
+	bool res;
+
+	memset(attrs, 0, sizeof(*attrs));
+	xdrmem_create(&attr_body, buf, buflen, XDR_ENCODE);
+	res = xdr_nfsstat4(&attr_body, &rdattr_error);
+	attrs->attr_vals.attrlist4_len = xdr_getpos(&attr_body);
+	attrs->attr_vals.attrlist4_val = buf;
+	xdr_destroy(&attr_body);
+
+	return res && set_attribute_in_bitmap(&attrs->attrmask,
+					      FATTR4_RDATTR_ERROR);
+}
+
+/**
+ * @brief Whether entries with these attributes may be kept encoded
+ *
+ * Only attributes of the object itself, which are unchanged while its
+ * cached attributes are, may be reused from an earlier READDIR.
+ *
+ * @param[in] req_attr The requested attributes
+ *
+ * @return true if they may be.
+ */
+
+static bool readdir_enc_cacheable(struct bitmap4 *req_attr)
+{
+	int attr;
+
+	for (attr = next_attr_from_bitmap(req_attr, -1);
+	     attr != -1;
+	     attr = next_attr_from_bitmap(req_attr, attr)) {
+		switch (attr) {
+		case FATTR4_TYPE:
+		case FATTR4_CHANGE:
+		case FATTR4_SIZE:
+		case FATTR4_FSID:
+		case FATTR4_RDATTR_ERROR:
+		case FATTR4_FILEHANDLE:
+		case FATTR4_FILEID:
+		case FATTR4_MODE:
+		case FATTR4_NUMLINKS:
+		case FATTR4_OWNER:
+		case FATTR4_OWNER_GROUP:
+		case FATTR4_RAWDEV:
+		case FATTR4_SPACE_USED:
+		case FATTR4_TIME_ACCESS:
+		case FATTR4_TIME_CREATE:
+		case FATTR4_TIME_METADATA:
+		case FATTR4_TIME_MODIFY:
+		case FATTR4_MOUNTED_ON_FILEID:
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Let the cache know where an entry may be copied next
+ *
+ * A kept entry is copied straight into the reply.
+ *
+ * @param[in,out] tracker The READDIR
+ */
+
+static void readdir_enc_next(struct nfs4_readdir_cb_data *tracker)
+{
+	u_int pos = xdr_getpos(&tracker->xdrs);
+
+	tracker->enc.buf = tracker->entries_xdr + pos;
+	tracker->enc.buflen = tracker->entries_size - pos;
+}
+
+/**
+ * @brief Encode one entry4, with its value follows marker
+ *
+ * @param[in] xdrs   The stream
+ * @param[in] cookie The entry's cookie
+ * @param[in] name   The entry's name
+ * @param[in] attrs  The entry's attributes
+ *
+ * @return true if the whole entry fit.
+ */
+
+static bool xdr_readdir_entry4(XDR *xdrs, nfs_cookie4 cookie,
+			       component4 *name, fattr4 *attrs)
+{
+	bool_t follows = TRUE;
+
+	return inline_xdr_bool(xdrs, &follows) &&
+	       xdr_nfs_cookie4(xdrs, &cookie) &&
+	       xdr_component4(xdrs, name) &&
+	       xdr_fattr4(xdrs, attrs);
+}
+
+/**
+ * @brief Encode entry4s when called from fsal_readdir
+ *
+ * This function is a callback passed to fsal_readdir.  It encodes
+ * each entry into the reply buffer, stopping once an entry no longer
+ * fits.  Nothing is allocated per entry.
  *
  * @param[in,out] opaque A struct nfs4_readdir_cb_data that stores the
  *                       location of the array and other bookeeping
@@ -101,7 +216,9 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 {
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs4_readdir_cb_data *tracker = cb_parms->opaque;
-	size_t namelen = 0;
+	component4 name;
+	fattr4 attrs;
+	u_int pos, buflen;
 	char val_fh[NFS4_FHSIZE];
 	nfs_fh4 entryFH = {
 		.nfs_fh4_len = 0,
@@ -110,7 +227,6 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 	struct xdr_attrs_args args;
 	compound_data_t *data = tracker->data;
 	nfsstat4 rdattr_error = NFS4_OK;
-	entry4 *tracker_entry = tracker->entries + tracker->count;
 	fsal_status_t fsal_status;
 	fsal_accessflags_t access_mask_attr = 0;
 
@@ -121,7 +237,7 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 		return ERR_FSAL_NO_ERROR;
 	}
 
-	if (tracker->total_entries == tracker->count)
+	if (tracker->error != NFS4_OK)
 		goto not_inresult;
 
 	/* Test if this is a junction.
@@ -275,43 +391,14 @@ not_junction:
 
 	/* Now process the entry */
 	memset(val_fh, 0, NFS4_FHSIZE);
+	memset(&attrs, 0, sizeof(attrs));
 
-	/* Bits that don't require allocation */
-	if (tracker->mem_left < sizeof(entry4)) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
+	/* The filename is encoded straight from the callback's copy */
+	name.utf8string_len = strlen(cb_parms->name);
+	name.utf8string_val = (char *) cb_parms->name;
 
-	tracker->mem_left -= sizeof(entry4);
-	tracker_entry->cookie = cookie;
-	tracker_entry->nextentry = NULL;
-
-	/* The filename.  We don't use str2utf8 because that has an
-	 * additional copy into a buffer before copying into the
-	 * destination.
-	 */
-	namelen = strlen(cb_parms->name);
-
-	if (tracker->mem_left < (namelen + 1)) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
-
-	tracker->mem_left -= (namelen + 1);
-	tracker_entry->name.utf8string_len = namelen;
-	tracker_entry->name.utf8string_val = gsh_malloc(namelen + 1);
-
-	memcpy(tracker_entry->name.utf8string_val,
-	       cb_parms->name,
-	       namelen);
-
-	/* If we carried an error from above, now that we have
-	 * the name set up, go ahead and try and put error in
-	 * results.
+	/* If we carried an error from above, go ahead and try and put
+	 * error in results.
 	 */
 	if (rdattr_error != NFS4_OK) {
 		LogDebug(COMPONENT_NFS_READDIR,
@@ -358,6 +445,18 @@ not_junction:
 		goto skip;
 	}
 
+	/* The cache copied this entry as an earlier READDIR encoded it */
+	if (op_ctx->readdir_enc != NULL && tracker->enc.cached_len != 0 &&
+	    cb_state == CB_ORIGINAL &&
+	    !(obj->type == DIRECTORY && is_sticky_bit_set(obj, attr))) {
+		pos = xdr_getpos(&tracker->xdrs);
+		if (xdr_setpos(&tracker->xdrs, pos + tracker->enc.cached_len)) {
+			++(tracker->count);
+			cb_parms->in_result = true;
+			goto out;
+		}
+	}
+
 	memset(&args, 0, sizeof(args));
 	args.attrs = (struct attrlist *)attr;
 	args.data = data;
@@ -366,9 +465,16 @@ not_junction:
 	args.fileid = obj->fileid;
 	args.fsid = obj->fsid;
 
-	if (nfs4_FSALattr_To_Fattr(&args,
-				   tracker->req_attr,
-				   &tracker_entry->attrs) != 0) {
+	buflen = nfs4_Fattr_buflen(&args, tracker->req_attr);
+	if (buflen > tracker->attr_buflen) {
+		gsh_free(tracker->attr_buf);
+		tracker->attr_buf = gsh_malloc(buflen);
+		tracker->attr_buflen = buflen;
+	}
+
+	if (nfs4_FSALattr_To_Fattr_buf(&args, tracker->req_attr, &attrs,
+				       tracker->attr_buf,
+				       tracker->attr_buflen) != 0) {
 		LogCrit(COMPONENT_NFS_READDIR,
 			"nfs4_FSALattr_To_Fattr failed to convert attr");
 		goto server_fault;
@@ -386,30 +492,34 @@ not_junction:
 	if (rdattr_error != NFS4_OK) {
 		if (!attribute_is_set(tracker->req_attr, FATTR4_RDATTR_ERROR)) {
 			tracker->error = rdattr_error;
-			goto failure;
+			goto not_inresult;
 		}
 
-		if (nfs4_Fattr_Fill_Error(&tracker_entry->attrs,
-					  rdattr_error) == -1)
+		if (!readdir_fattr_error(&attrs, rdattr_error,
+					 tracker->attr_buf,
+					 tracker->attr_buflen))
 			goto server_fault;
 	}
 
-	if (tracker->mem_left <
-	    ((tracker_entry->attrs.attrmask.bitmap4_len * sizeof(uint32_t))
-	     + (tracker_entry->attrs.attr_vals.attrlist4_len))) {
+	/* Exactly what is sent counts against maxcount */
+	pos = xdr_getpos(&tracker->xdrs);
+
+	if (!xdr_readdir_entry4(&tracker->xdrs, cookie, &name, &attrs)) {
+		/* Did not fit, leave it for the next READDIR */
+		xdr_setpos(&tracker->xdrs, pos);
+
 		if (tracker->count == 0)
 			tracker->error = NFS4ERR_TOOSMALL;
 
-		goto failure;
+		goto not_inresult;
 	}
 
-	tracker->mem_left -= tracker_entry->attrs.attrmask.bitmap4_len *
-			     sizeof(uint32_t);
-
-	tracker->mem_left -= tracker_entry->attrs.attr_vals.attrlist4_len;
-
-	if (tracker->count != 0)
-		tracker->entries[tracker->count - 1].nextentry = tracker_entry;
+	/* Let the cache keep it for the next READDIR */
+	if (op_ctx->readdir_enc != NULL && rdattr_error == NFS4_OK &&
+	    cb_state == CB_ORIGINAL) {
+		tracker->enc.store = tracker->entries_xdr + pos;
+		tracker->enc.store_len = xdr_getpos(&tracker->xdrs) - pos;
+	}
 
 	++(tracker->count);
 	cb_parms->in_result = true;
@@ -419,48 +529,25 @@ not_junction:
 
 	tracker->error = NFS4ERR_SERVERFAULT;
 
- failure:
-
-	if (tracker_entry->attrs.attr_vals.attrlist4_val != NULL) {
-		gsh_free(tracker_entry->attrs.attr_vals.attrlist4_val);
-		tracker_entry->attrs.attr_vals.attrlist4_val = NULL;
-	}
-
-	if (tracker_entry->name.utf8string_val != NULL) {
-		gsh_free(tracker_entry->name.utf8string_val);
-		tracker_entry->name.utf8string_val = NULL;
-	}
-
  not_inresult:
 
 	cb_parms->in_result = false;
 
  out:
 
+	if (op_ctx->readdir_enc != NULL)
+		readdir_enc_next(tracker);
+
 	return ERR_FSAL_NO_ERROR;
 }
 
 /**
- * @brief Free a list of entry4s
- *
- * This function frees a list of entry4s and all dependent strctures.
+ * @brief Reply overhead of READDIR4resok besides the entries
  *
- * @param[in,out] entries The entries to be freed
+ * The cookie verifier, the FALSE after the last entry and eof.
  */
 
-static void free_entries(entry4 *entries)
-{
-	entry4 *entry = NULL;
-
-	for (entry = entries; entry != NULL; entry = entry->nextentry) {
-		if (entry->attrs.attr_vals.attrlist4_val != NULL)
-			gsh_free(entry->attrs.attr_vals.attrlist4_val);
-
-		if (entry->name.utf8string_val != NULL)
-			gsh_free(entry->name.utf8string_val);
-	}
-	gsh_free(entries);
-}
+#define READDIR4_RESOK_FIXED (NFS4_VERIFIER_SIZE + 2 * BYTES_PER_XDR_UNIT)
 
 /**
  * @brief NFS4_OP_READDIR
@@ -480,15 +567,15 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 {
 	READDIR4args * const arg_READDIR4 = &op->nfs_argop4_u.opreaddir;
 	READDIR4res * const res_READDIR4 = &resp->nfs_resop4_u.opreaddir;
+	dirlist4 * const reply = &res_READDIR4->READDIR4res_u.resok4.reply;
 	struct fsal_obj_handle *dir_obj = NULL;
 	bool eod_met = false;
 	unsigned long dircount = 0;
 	unsigned long maxcount = 0;
-	entry4 *entries = NULL;
 	verifier4 cookie_verifier;
 	uint64_t cookie = 0;
-	unsigned int estimated_num_entries = 0;
 	unsigned int num_entries = 0;
+	u_int pos;
 	struct nfs4_readdir_cb_data tracker;
 	fsal_status_t fsal_status = {0, 0};
 	attrmask_t attrmask;
@@ -498,33 +585,30 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	resp->resop = NFS4_OP_READDIR;
 	res_READDIR4->status = NFS4_OK;
 
+	memset(&tracker, 0, sizeof(tracker));
+
 	res_READDIR4->status = nfs4_sanity_check_FH(data, DIRECTORY, false);
 
 	if (res_READDIR4->status != NFS4_OK)
 		goto out;
 
-	memset(&tracker, 0, sizeof(tracker));
-
 	dir_obj = data->current_obj;
 
-	/* get the characteristic value for readdir operation */
+	/* get the characteristic value for readdir operation.  maxcount
+	 * bounds the whole READDIR4resok, and we will not send more than
+	 * fits in a send buffer.
+	 */
 	dircount = arg_READDIR4->dircount;
-	maxcount = (arg_READDIR4->maxcount * 9) / 10;
+	maxcount = MIN(arg_READDIR4->maxcount,
+		       nfs_param.core_param.rpc.max_send_buffer_size);
 	cookie = arg_READDIR4->cookie;
 
 	/* Dircount is considered meaningless by many nfsv4 client (like the
 	 * CITI one).  we use maxcount instead.
-	 *
-	 * The Linux 3.0, 3.1.0 clients vs. TCP Ganesha comes out 10x slower
-	 * with 500 max entries
 	 */
-	estimated_num_entries = 50;
-	tracker.total_entries = estimated_num_entries;
-
 	LogFullDebug(COMPONENT_NFS_READDIR,
-		     "dircount=%lu maxcount=%lu cookie=%" PRIu64
-		     " estimated_num_entries=%u",
-		     dircount, maxcount, cookie, estimated_num_entries);
+		     "dircount=%lu maxcount=%lu cookie=%" PRIu64,
+		     dircount, maxcount, cookie);
 
 	/* Since we never send a cookie of 1 or 2, we shouldn't ever get
 	 * them back.
@@ -545,10 +629,10 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
-	/* If maxcount is too short (14 should be enough for an empty
-	 * directory) return NFS4ERR_TOOSMALL
+	/* If maxcount is too short for even an empty directory return
+	 * NFS4ERR_TOOSMALL
 	 */
-	if (maxcount < 14 || estimated_num_entries == 0) {
+	if (maxcount < READDIR4_RESOK_FIXED) {
 		res_READDIR4->status = NFS4ERR_TOOSMALL;
 		LogFullDebug(COMPONENT_NFS_READDIR,
 			     "Response too small");
@@ -608,11 +692,16 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	/* Prepare to read the entries */
-
-	entries = gsh_calloc(estimated_num_entries, sizeof(entry4));
-	tracker.entries = entries;
-	tracker.mem_left = maxcount - sizeof(READDIR4resok);
+	/* Prepare to encode the entries.  The stream leaves room for
+	 * the FALSE that ends the list.
+	 */
+	tracker.entries_xdr = gsh_malloc(maxcount - NFS4_VERIFIER_SIZE -
+					 BYTES_PER_XDR_UNIT);
+	tracker.entries_size = maxcount - READDIR4_RESOK_FIXED;
+	xdrmem_create(&tracker.xdrs, tracker.entries_xdr,
+		      tracker.entries_size, XDR_ENCODE);
+	tracker.attr_buflen = NFS4_ATTRVALS_BUFFLEN;
+	tracker.attr_buf = gsh_malloc(tracker.attr_buflen);
 	tracker.count = 0;
 	tracker.error = NFS4_OK;
 	tracker.req_attr = &arg_READDIR4->attr_request;
@@ -627,6 +716,19 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	if (attribute_is_set(tracker.req_attr, FATTR4_ACL))
 		attrmask |= ATTR_ACL;
 
+	/* Entries encoded for the same export, minor version and
+	 * attributes may be kept by the cache and reused.
+	 */
+	if (readdir_enc_cacheable(tracker.req_attr)) {
+		tracker.enc.key[0] = (NFS_V4 << 8) | data->minorversion;
+		tracker.enc.key[1] = op_ctx->ctx_export->export_id;
+		memcpy(&tracker.enc.key[2], tracker.req_attr->map,
+		       MIN(tracker.req_attr->bitmap4_len, BITMAP4_MAPLEN) *
+		       sizeof(uint32_t));
+		readdir_enc_next(&tracker);
+		op_ctx->readdir_enc = &tracker.enc;
+	}
+
 	/* Perform the readdir operation */
 	fsal_status = fsal_readdir(dir_obj,
 				   cookie,
@@ -636,6 +738,11 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 				   nfs4_readdir_callback,
 				   &tracker);
 
+	op_ctx->readdir_enc = NULL;
+
+	pos = xdr_getpos(&tracker.xdrs);
+	xdr_destroy(&tracker.xdrs);
+
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res_READDIR4->status = nfs4_Errno_status(fsal_status);
 		LogFullDebug(COMPONENT_NFS_READDIR,
@@ -656,15 +763,19 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
+	reply->entries = NULL;
+
 	if (tracker.count != 0) {
-		/* Put the entry's list in the READDIR reply if
-		 * there were any.
+		/* Put the encoded entries in the READDIR reply if
+		 * there were any, ending the list.
 		 */
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = entries;
+		memset(tracker.entries_xdr + pos, 0, BYTES_PER_XDR_UNIT);
+		reply->entries_xdr = tracker.entries_xdr;
+		reply->entries_xdr_len = pos + BYTES_PER_XDR_UNIT;
+		tracker.entries_xdr = NULL;
 	} else {
-		gsh_free(entries);
-		entries = NULL;
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
+		reply->entries_xdr = NULL;
+		reply->entries_xdr_len = 0;
 	}
 
 	/* This slight bit of oddness is caused by most booleans
@@ -673,9 +784,9 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	 * type i(taking the values TRUE and FALSE)
 	 */
 	if (eod_met)
-		res_READDIR4->READDIR4res_u.resok4.reply.eof = TRUE;
+		reply->eof = TRUE;
 	else
-		res_READDIR4->READDIR4res_u.resok4.reply.eof = FALSE;
+		reply->eof = FALSE;
 
 	/* Do not forget to set the verifier */
 	memcpy(res_READDIR4->READDIR4res_u.resok4.cookieverf,
@@ -685,8 +796,8 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	res_READDIR4->status = NFS4_OK;
 
  out:
-	if ((res_READDIR4->status != NFS4_OK) && (entries != NULL))
-		free_entries(entries);
+	gsh_free(tracker.entries_xdr);
+	gsh_free(tracker.attr_buf);
 
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "Returning %s",
@@ -707,5 +818,6 @@ void nfs4_op_readdir_Free(nfs_resop4 *res)
 {
 	READDIR4res *resp = &res->nfs_resop4_u.opreaddir;
 
-	free_entries(resp->READDIR4res_u.resok4.reply.entries);
+	if (resp->status == NFS4_OK)
+		gsh_free(resp->READDIR4res_u.resok4.reply.entries_xdr);
 }				/* nfs4_op_readdir_Free */
@@ -32,8 +32,10 @@
 #include "config.h"
 #include "fsal.h"
 #include "sal_functions.h"
+#include "nfs_proto_functions.h"
 #include "nfs_rpc_callback.h"
 #include "nfs_convert.h"
+#include "nfs_dupreq.h"
 
 /**
  * @brief the NFS4_OP_SEQUENCE operation
@@ -54,6 +56,9 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	SEQUENCE4res * const res_SEQUENCE4 = &resp->nfs_resop4_u.opsequence;
 
 	nfs41_session_t *session;
+	nfs41_session_slot_t *slot;
+	slotid4 highest;
+	slotid4 prev;
 
 	resp->resop = NFS4_OP_SEQUENCE;
 	res_SEQUENCE4->sr_status = NFS4_OK;
@@ -111,28 +116,47 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 		return res_SEQUENCE4->sr_status;
 	}
 
+	slot = &session->slots[arg_SEQUENCE4->sa_slotid];
+
 	/* By default, no DRC replay */
 	data->use_drc = false;
 
-	PTHREAD_MUTEX_lock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
-	if (session->slots[arg_SEQUENCE4->sa_slotid].sequence + 1 !=
-	    arg_SEQUENCE4->sa_sequenceid) {
-		if (session->slots[arg_SEQUENCE4->sa_slotid].sequence ==
-		    arg_SEQUENCE4->sa_sequenceid) {
-#if IMPLEMENT_CACHETHIS
-			/** @todo
-			 *
-			 * Ganesha always caches result anyway so ignore
-			 * cachethis
-			 */
-			if (session->slots[arg_SEQUENCE4->sa_slotid]
-			    .cache_used) {
-#endif
-				/* Replay operation through the DRC */
+	PTHREAD_MUTEX_lock(&slot->lock);
+	if (slot->sequence + 1 != arg_SEQUENCE4->sa_sequenceid) {
+		if (slot->sequence == arg_SEQUENCE4->sa_sequenceid) {
+			if (slot->cache_used) {
+				struct nfs_encoded_reply *enc;
+
+				/* Replay operation through the DRC.  The
+				 * slot may be released once its lock is
+				 * dropped, so the replay holds its own
+				 * reference to the encoded reply.
+				 */
+				enc = slot->cached_result.res_encoded;
+				if (enc != NULL)
+					nfs_reply_get(enc);
+				else
+					enc = nfs_reply_encode(
+						(xdrproc_t) xdr_COMPOUND4res,
+						&slot->cached_result
+							.res_compound4);
+
+				if (enc == NULL) {
+					PTHREAD_MUTEX_unlock(&slot->lock);
+					dec_session_ref(session);
+					res_SEQUENCE4->sr_status =
+					    NFS4ERR_RETRY_UNCACHED_REP;
+					return res_SEQUENCE4->sr_status;
+				}
+
+				memset(&data->replay_res, 0,
+				       sizeof(data->replay_res));
+				data->replay_res.res_compound4.status =
+				    slot->cached_result.res_compound4.status;
+				data->replay_res.res_encoded = enc;
+
 				data->use_drc = true;
-				data->cached_res =
-				    &session->slots[arg_SEQUENCE4->sa_slotid].
-				    cached_result;
+				data->cached_res = &data->replay_res;
 
 				LogFullDebugAlt(COMPONENT_SESSIONS,
 						COMPONENT_CLIENTID,
@@ -141,16 +165,13 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 						arg_SEQUENCE4->sa_slotid,
 						data->cached_res);
 
-				PTHREAD_MUTEX_unlock(&session->
-					slots[arg_SEQUENCE4->sa_slotid].lock);
+				PTHREAD_MUTEX_unlock(&slot->lock);
 				dec_session_ref(session);
 				res_SEQUENCE4->sr_status = NFS4_OK;
 				return res_SEQUENCE4->sr_status;
-#if IMPLEMENT_CACHETHIS
 			} else {
-				/* Illegal replay */
-				PTHREAD_MUTEX_unlock(&session->
-					slots[arg_SEQUENCE4->sa_slotid].lock);
+				/* The reply was not kept */
+				PTHREAD_MUTEX_unlock(&slot->lock);
 				dec_session_ref(session);
 				res_SEQUENCE4->sr_status =
 				    NFS4ERR_RETRY_UNCACHED_REP;
@@ -161,11 +182,9 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 							    sr_status));
 				return res_SEQUENCE4->sr_status;
 			}
-#endif
 		}
 
-		PTHREAD_MUTEX_unlock(&session->
-			slots[arg_SEQUENCE4->sa_slotid].lock);
+		PTHREAD_MUTEX_unlock(&slot->lock);
 		dec_session_ref(session);
 		res_SEQUENCE4->sr_status = NFS4ERR_SEQ_MISORDERED;
 		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
@@ -182,18 +201,18 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	data->slot = arg_SEQUENCE4->sa_slotid;
 
 	/* Update the sequence id within the slot */
-	session->slots[arg_SEQUENCE4->sa_slotid].sequence += 1;
+	slot->sequence += 1;
 
 	memcpy(res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sessionid,
 	       arg_SEQUENCE4->sa_sessionid, NFS4_SESSIONID_SIZE);
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sequenceid =
-	    session->slots[arg_SEQUENCE4->sa_slotid].sequence;
+	    slot->sequence;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_slotid =
 	    arg_SEQUENCE4->sa_slotid;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_highest_slotid =
-	    NFS41_NB_SLOTS - 1;
-	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
 	    session->fore_channel_attrs.ca_maxrequests - 1;
+	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
+	    nfs41_Session_Target_Slotid(session);
 
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_status_flags = 0;
 
@@ -202,29 +221,45 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 		    SEQ4_STATUS_CB_PATH_DOWN;
 	}
 
-#if IMPLEMENT_CACHETHIS
-/* Ganesha always caches result anyway so ignore cachethis */
-	if (arg_SEQUENCE4->sa_cachethis) {
-#endif
-		data->cached_res =
-		    &session->slots[arg_SEQUENCE4->sa_slotid].cached_result;
-		session->slots[arg_SEQUENCE4->sa_slotid].cache_used = true;
+	/* Replies the client asked to be cached are always kept, others
+	 * only while the reply cache is within its memory budget.  The
+	 * reply of the previous request on the slot can't be replayed
+	 * any more, so if we don't keep this one, release it now.
+	 */
+	if (arg_SEQUENCE4->sa_cachethis || !nfs41_Session_Cache_Full()) {
+		data->cached_res = &slot->cached_result;
+		slot->cache_used = true;
 
 		LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
 				"Use sesson slot %" PRIu32 "=%p for DRC",
 				arg_SEQUENCE4->sa_slotid, data->cached_res);
-#if IMPLEMENT_CACHETHIS
 	} else {
+		nfs4_Compound_FreeCached(&slot->cached_result);
 		data->cached_res = NULL;
-		session->slots[arg_SEQUENCE4->sa_slotid].cache_used = false;
+		slot->cache_used = false;
 
 		LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
 				"Don't use sesson slot %" PRIu32
 				"=NULL for DRC", arg_SEQUENCE4->sa_slotid);
 	}
-#endif
 
-	PTHREAD_MUTEX_unlock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
+	PTHREAD_MUTEX_unlock(&slot->lock);
+
+	/* The client is using fewer slots than before, release the
+	 * replies cached above the ones it uses.  Only the SEQUENCE
+	 * that lowers highest_used_slotid releases them.
+	 */
+	highest = MIN(arg_SEQUENCE4->sa_highest_slotid,
+		      session->fore_channel_attrs.ca_maxrequests - 1);
+
+	prev = atomic_fetch_uint32_t(&session->highest_used_slotid);
+	while (prev != highest &&
+	       !__sync_bool_compare_and_swap(&session->highest_used_slotid,
+					     prev, highest))
+		prev = atomic_fetch_uint32_t(&session->highest_used_slotid);
+
+	if (highest < prev)
+		nfs41_Session_Release_Slots(session, highest);
 
 	/* If we were successful, stash the clientid in the request
 	 * context.
@@ -133,6 +133,104 @@ static int op_dswrite_plus(struct nfs_argop4 *op, compound_data_t *data,
 	return res_WRITE4->status;
 }
 
+/**
+ * @brief State of a WRITE across the FSAL write
+ */
+struct nfs4_write_data {
+	nfs_request_t *reqnfs;		/*< Request to resume if async */
+	struct fsal_obj_handle *obj;	/*< File being written */
+	state_t *state_found;		/*< State from the stateid */
+	state_t *state_open;		/*< Associated open state */
+	state_owner_t *owner;		/*< Owner whose clientid is in op_ctx */
+	bool anonymous_started;		/*< Anonymous I/O share taken */
+	fsal_status_t status;		/*< Status of the write */
+	struct fsal_io_arg write_arg;	/*< Arguments and results */
+};
+
+/**
+ * @brief Finish a WRITE once the FSAL has done the I/O
+ *
+ * Builds the result and releases everything nfs4_write acquired.
+ *
+ * @param[out]    resp  Results for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[in]     wd    State of the write
+ *
+ * @return per RFC5661, p. 376
+ */
+
+static int nfs4_write_done(struct nfs_resop4 *resp, compound_data_t *data,
+			   struct nfs4_write_data *wd)
+{
+	WRITE4res * const res_WRITE4 = &resp->nfs_resop4_u.opwrite;
+	struct gsh_buffdesc verf_desc;
+
+	if (FSAL_IS_ERROR(wd->status)) {
+		LogDebug(COMPONENT_NFS_V4, "write returned %s",
+			 fsal_err_txt(wd->status));
+		res_WRITE4->status = nfs4_Errno_status(wd->status);
+		goto done;
+	}
+
+	if (!wd->anonymous_started && data->minorversion == 0)
+		op_ctx->clientid = NULL;
+
+	/* Set the returned value */
+	if (wd->write_arg.fsal_stable)
+		res_WRITE4->WRITE4res_u.resok4.committed = FILE_SYNC4;
+	else
+		res_WRITE4->WRITE4res_u.resok4.committed = UNSTABLE4;
+
+	res_WRITE4->WRITE4res_u.resok4.count = wd->write_arg.io_amount;
+
+	verf_desc.addr = res_WRITE4->WRITE4res_u.resok4.writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	res_WRITE4->status = NFS4_OK;
+
+ done:
+
+	if (wd->anonymous_started)
+		state_share_anonymous_io_done(wd->obj,
+					      OPEN4_SHARE_ACCESS_WRITE);
+
+	server_stats_io_done(wd->write_arg.io_request,
+			     wd->write_arg.io_amount,
+			     (res_WRITE4->status == NFS4_OK) ? true : false,
+			     true);
+
+	if (wd->owner != NULL)
+		dec_state_owner_ref(wd->owner);
+
+	if (wd->state_found != NULL)
+		dec_state_t_ref(wd->state_found);
+
+	if (wd->state_open != NULL)
+		dec_state_t_ref(wd->state_open);
+
+	return res_WRITE4->status;
+}
+
+/**
+ * @brief Completion callback for an asynchronous WRITE
+ *
+ * @param[in] obj         File written
+ * @param[in] ret         Status of the write
+ * @param[in] write_arg   Arguments and results of the write
+ * @param[in] caller_arg  The nfs4_write_data
+ */
+
+static void nfs4_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			  struct fsal_io_arg *write_arg, void *caller_arg)
+{
+	struct nfs4_write_data *wd = caller_arg;
+
+	wd->status = fsal_io_complete(ret, write_arg, false);
+	nfs_rpc_complete_async_request(wd->reqnfs);
+}
+
 /**
  * @brief The NFS4_OP_WRITE operation
  *
@@ -153,7 +251,6 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	WRITE4args * const arg_WRITE4 = &op->nfs_argop4_u.opwrite;
 	WRITE4res * const res_WRITE4 = &resp->nfs_resop4_u.opwrite;
 	uint64_t size = 0;
-	size_t written_size = 0;
 	uint64_t offset;
 	bool eof_met;
 	bool sync = false;
@@ -166,6 +263,7 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	bool anonymous_started = false;
 	struct gsh_buffdesc verf_desc;
 	state_owner_t *owner = NULL;
+	struct nfs4_write_data wd = {0};
 	uint64_t MaxWrite =
 		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxWrite);
 	uint64_t MaxOffsetWrite =
@@ -191,6 +289,15 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_WRITE4->status != NFS4_OK)
 		return res_WRITE4->status;
 
+	/* Over the export or client rate limits, run again later */
+	if (io == FSAL_IO_WRITE &&
+	    nfs_rpc_rate_limit(nfs_req_from_svc(data->req), true,
+			       MIN(arg_WRITE4->data.data_len, MaxWrite))) {
+		data->op_async = true;
+		data->op_deferred = true;
+		return NFS4_OK;
+	}
+
 	/* if quota support is active, then we should check is the FSAL
 	   allows inode creation or not */
 	fsal_status = op_ctx->fsal_export->exp_ops.check_quota(
@@ -402,48 +509,58 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
+	wd.obj = obj;
+	wd.state_found = state_found;
+	wd.state_open = state_open;
+	wd.owner = owner;
+	wd.anonymous_started = anonymous_started;
+	wd.write_arg.state = state_found;
+	wd.write_arg.offset = offset;
+	wd.write_arg.io_request = size;
+	wd.write_arg.buffer = bufferdata;
+	wd.write_arg.fsal_stable = sync;
+	wd.write_arg.info = info;
+
+	if (io == FSAL_IO_WRITE && obj->fsal->m_ops.support_ex(obj) &&
+	    nfs_rpc_async_allowed(nfs_req_from_svc(data->req))) {
+		/* Hand the write to the FSAL; the compound is suspended
+		 * and nfs4_op_write_resume finishes the WRITE.
+		 */
+		struct nfs4_write_data *awd = gsh_malloc(sizeof(*awd));
+
+		*awd = wd;
+		awd->reqnfs = nfs_req_from_svc(data->req);
+		data->op_data = awd;
+		data->op_async = true;
+
+		fsal_write2_async(obj, false, &awd->write_arg, nfs4_write_cb,
+				  awd);
+
+		return NFS4_OK;
+	}
+
 	if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
-		fsal_status = fsal_write2(obj, false, state_found, offset, size,
-					  &written_size, bufferdata, &sync,
-					  info);
+		wd.status = fsal_write2(obj, false, state_found, offset, size,
+					&wd.write_arg.io_amount, bufferdata,
+					&sync, info);
 	} else {
 		/* Call legacy fsal_rdwr */
-		fsal_status = fsal_rdwr(obj, io, offset, size, &written_size,
-					bufferdata, &eof_met, &sync, info);
-	}
-
-	if (FSAL_IS_ERROR(fsal_status)) {
-		LogDebug(COMPONENT_NFS_V4, "write returned %s",
-			 fsal_err_txt(fsal_status));
-		res_WRITE4->status = nfs4_Errno_status(fsal_status);
-		goto done;
+		wd.status = fsal_rdwr(obj, io, offset, size,
+				      &wd.write_arg.io_amount, bufferdata,
+				      &eof_met, &sync, info);
 	}
 
-	if (!anonymous_started && data->minorversion == 0)
-		op_ctx->clientid = NULL;
-
-	/* Set the returned value */
-	if (sync)
-		res_WRITE4->WRITE4res_u.resok4.committed = FILE_SYNC4;
-	else
-		res_WRITE4->WRITE4res_u.resok4.committed = UNSTABLE4;
-
-	res_WRITE4->WRITE4res_u.resok4.count = written_size;
-
-	verf_desc.addr = res_WRITE4->WRITE4res_u.resok4.writeverf;
-	verf_desc.len = sizeof(verifier4);
-	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
-							&verf_desc);
+	wd.write_arg.fsal_stable = sync;
 
-	res_WRITE4->status = NFS4_OK;
+	return nfs4_write_done(resp, data, &wd);
 
  done:
 
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
 
-	server_stats_io_done(size, written_size,
+	server_stats_io_done(size, 0,
 			     (res_WRITE4->status == NFS4_OK) ? true : false,
 			     true);
 
@@ -484,6 +601,29 @@ int nfs4_op_write(struct nfs_argop4 *op, compound_data_t *data,
 	return err;
 }
 
+/**
+ * @brief Finish an NFS4_OP_WRITE after asynchronous I/O
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC5661, p. 376
+ */
+
+int nfs4_op_write_resume(struct nfs_argop4 *op, compound_data_t *data,
+			 struct nfs_resop4 *resp)
+{
+	struct nfs4_write_data *wd = data->op_data;
+	int status;
+
+	data->op_data = NULL;
+	status = nfs4_write_done(resp, data, wd);
+	gsh_free(wd);
+
+	return status;
+}
+
 /**
  * @brief Free memory allocated for WRITE result
  *
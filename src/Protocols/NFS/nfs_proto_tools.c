@@ -3589,31 +3589,57 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
 }
 
 /**
- * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
+ * @brief Size of buffer needed for the attribute values of a Fattr
  *
- * Converts FSAL Attributes to NFSv4 Fattr buffer.
+ * @param[in] args    XDR attribute arguments
+ * @param[in] Bitmap  Bitmap of attributes being requested
+ *
+ * @return The buffer size to pass to nfs4_FSALattr_To_Fattr_buf.
+ */
+
+u_int nfs4_Fattr_buflen(struct xdr_attrs_args *args, struct bitmap4 *Bitmap)
+{
+	u_int attrvals_buflen = NFS4_ATTRVALS_BUFFLEN;
+
+	if (attribute_is_set(Bitmap, FATTR4_ACL) && args->attrs->acl) {
+		/* Calculating an exact needed xdr buffer size is laborious
+		 * and time consuming, so making a rough estimate
+		 */
+		attrvals_buflen += (sizeof(fsal_ace_t) + NFS4_MAX_DOMAIN_LEN)
+			* args->attrs->acl->naces;
+	}
+
+	/* Check if the calculated len is less than the max send buffer size */
+	if (attrvals_buflen > nfs_param.core_param.rpc.max_send_buffer_size)
+		attrvals_buflen = nfs_param.core_param.rpc.max_send_buffer_size;
+
+	return attrvals_buflen;
+}
+
+/**
+ * @brief Converts FSAL Attributes to NFSv4 Fattr in a given buffer.
+ *
+ * The attribute values are encoded into the caller's buffer, which
+ * must be at least nfs4_Fattr_buflen bytes.  Nothing is allocated.
  *
  * @param[in]  args    XDR attribute arguments
  * @param[in]  Bitmap  Bitmap of attributes being requested
- * @param[out] Fattr   NFSv4 Fattr buffer
- *		       Memory for bitmap_val and attr_val is
- *                     dynamically allocated,
- *		       caller is responsible for freeing it.
+ * @param[out] Fattr   NFSv4 Fattr, attr_vals pointing into buf
+ * @param[in]  buf     Buffer for the attribute values
+ * @param[in]  buflen  Size of buf
  *
  * @return -1 if failed, 0 if successful.
- *
  */
 
-int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
-			   fattr4 *Fattr)
+int nfs4_FSALattr_To_Fattr_buf(struct xdr_attrs_args *args,
+			       struct bitmap4 *Bitmap, fattr4 *Fattr,
+			       char *buf, u_int buflen)
 {
 	int attribute_to_set = 0;
 	int max_attr_idx;
-	u_int LastOffset;
 	fsal_dynamicfsinfo_t dynamicinfo;
 	XDR attr_body;
 	fattr_xdr_result xdr_res;
-	uint32_t attrvals_buflen;
 
 	/* basic init */
 	memset(Fattr, 0, sizeof(*Fattr));
@@ -3621,29 +3647,12 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (Bitmap->bitmap4_len == 0)
 		return 0;	/* they ask for nothing, they get nothing */
 
-	attrvals_buflen = NFS4_ATTRVALS_BUFFLEN;
-	if (attribute_is_set(Bitmap, FATTR4_ACL) && args->attrs->acl) {
-		/* Calculating an exact needed xdr buffer size is laborious
-		 * and time consuming, so making a rough estimate
-		 */
-		attrvals_buflen += (sizeof(fsal_ace_t) + NFS4_MAX_DOMAIN_LEN)
-			* args->attrs->acl->naces;
-	}
-
-	/* Check if the calculated len is less than the max send buffer size */
-	if (attrvals_buflen > nfs_param.core_param.rpc.max_send_buffer_size)
-		attrvals_buflen = nfs_param.core_param.rpc.max_send_buffer_size;
-
-	Fattr->attr_vals.attrlist4_val = gsh_malloc(attrvals_buflen);
-
 	max_attr_idx = nfs4_max_attr_index(args->data);
 	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
 		 max_attr_idx);
 
-	LastOffset = 0;
 	memset(&attr_body, 0, sizeof(attr_body));
-	xdrmem_create(&attr_body, Fattr->attr_vals.attrlist4_val,
-		      attrvals_buflen, XDR_ENCODE);
+	xdrmem_create(&attr_body, buf, buflen, XDR_ENCODE);
 
 	if (args->dynamicinfo == NULL)
 		args->dynamicinfo = &dynamicinfo;
@@ -3675,27 +3684,64 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 				     "Encode FAILED for attr %d, name = %s",
 				     attribute_to_set,
 				     fattr4tab[attribute_to_set].name);
-
-			/* signal fail so if(LastOffset > 0) works right */
-			goto err;
+			xdr_destroy(&attr_body);
+			return -1;
 		}
 		/* mark the attribute in the bitmap should be new bitmap btw */
 	}
-	LastOffset = xdr_getpos(&attr_body);	/* dumb but for now */
+
+	Fattr->attr_vals.attrlist4_len = xdr_getpos(&attr_body);
+	Fattr->attr_vals.attrlist4_val = buf;
 	xdr_destroy(&attr_body);
 
-	if (LastOffset == 0) {	/* no supported attrs so we can free */
+	return 0;
+}
+
+/**
+ * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
+ *
+ * Converts FSAL Attributes to NFSv4 Fattr buffer.
+ *
+ * @param[in]  args    XDR attribute arguments
+ * @param[in]  Bitmap  Bitmap of attributes being requested
+ * @param[out] Fattr   NFSv4 Fattr buffer
+ *		       Memory for bitmap_val and attr_val is
+ *                     dynamically allocated,
+ *		       caller is responsible for freeing it.
+ *
+ * @return -1 if failed, 0 if successful.
+ *
+ */
+
+int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
+			   fattr4 *Fattr)
+{
+	u_int attrvals_buflen;
+	char *buf;
+
+	/* basic init */
+	memset(Fattr, 0, sizeof(*Fattr));
+
+	if (Bitmap->bitmap4_len == 0)
+		return 0;	/* they ask for nothing, they get nothing */
+
+	attrvals_buflen = nfs4_Fattr_buflen(args, Bitmap);
+	buf = gsh_malloc(attrvals_buflen);
+
+	if (nfs4_FSALattr_To_Fattr_buf(args, Bitmap, Fattr, buf,
+				       attrvals_buflen) != 0) {
+		gsh_free(buf);
+		return -1;
+	}
+
+	if (Fattr->attr_vals.attrlist4_len == 0) {
+		/* no supported attrs so we can free */
 		assert(Fattr->attrmask.bitmap4_len == 0);
-		gsh_free(Fattr->attr_vals.attrlist4_val);
+		gsh_free(buf);
 		Fattr->attr_vals.attrlist4_val = NULL;
 	}
-	Fattr->attr_vals.attrlist4_len = LastOffset;
-	return 0;
 
- err:
-	gsh_free(Fattr->attr_vals.attrlist4_val);
-	Fattr->attr_vals.attrlist4_val = NULL;
-	return -1;
+	return 0;
 }
 
 /**
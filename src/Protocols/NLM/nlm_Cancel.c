@@ -146,7 +146,7 @@ static void nlm4_cancel_message_resp(state_async_queue_t *arg)
 					     nlm_async_res.res_nlm4.stat.stat));
 	}
 	nlm_send_async(NLMPROC4_CANCEL_RES, nlm_arg->nlm_async_host,
-		       &(nlm_arg->nlm_async_args.nlm_async_res), NULL);
+		       &(nlm_arg->nlm_async_args.nlm_async_res), NULL, NULL);
 	nlm4_Cancel_Free(&nlm_arg->nlm_async_args.nlm_async_res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
 	dec_nlm_client_ref(nlm_arg->nlm_async_host);
@@ -178,7 +178,7 @@ static void nlm4_test_message_resp(state_async_queue_t *arg)
 	}
 	nlm_send_async(NLMPROC4_TEST_RES, nlm_arg->nlm_async_host,
 		       &nlm_arg->nlm_async_args.nlm_async_res,
-		       NULL);
+		       NULL, NULL);
 
 	nlm4_Test_Free(&nlm_arg->nlm_async_args.nlm_async_res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
@@ -152,7 +152,7 @@ static void nlm4_unlock_message_resp(state_async_queue_t *arg)
 	}
 
 	nlm_send_async(NLMPROC4_UNLOCK_RES, nlm_arg->nlm_async_host,
-		       &(nlm_arg->nlm_async_args.nlm_async_res), NULL);
+		       &(nlm_arg->nlm_async_args.nlm_async_res), NULL, NULL);
 
 	nlm4_Unlock_Free(&nlm_arg->nlm_async_args.nlm_async_res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
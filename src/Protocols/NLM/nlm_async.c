@@ -34,9 +34,9 @@
 #include "sal_functions.h"
 #include "nlm_util.h"
 #include "nlm_async.h"
-
-pthread_mutex_t nlm_async_resp_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t nlm_async_resp_cond = PTHREAD_COND_INITIALIZER;
+#include "fridgethr.h"
+#include "delayed_exec.h"
+#include "city.h"
 
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 			    nfs_res_t *pres)
@@ -112,159 +112,262 @@ xdrproc_t nlm_reply_proc[] = {
 	[NLMPROC4_UNLOCK_RES] = (xdrproc_t) xdr_nlm4_res,
 };
 
-static void *resp_key;
+/**
+ * @brief Callback connections to NLM clients
+ *
+ * Messages to a client are XDR encoded when they are sent, queued on
+ * a connection shared by every NLM client with the same caller name,
+ * transport and server address, and written out by the NLM_Callback
+ * fridge, one thread per connection at a time so each client sees
+ * its messages in order.  Nothing waits for the client.
+ *
+ * The connection and the address rpcbind gave for it are kept for
+ * the next message, and dropped once the connection has been idle
+ * for NLM_CB_IDLE seconds.
+ *
+ * So that unreachable clients do not tie up the threads, at most
+ * NLM_CB_QUEUE_MAX messages wait on a connection, and once a client
+ * could not be reached its messages fail straight away for a back off
+ * period that doubles, up to NLM_CB_BACKOFF_MAX, while it stays down.
+ */
+
+#define NLM_CB_BUCKETS 64
+#define NLM_CB_THREADS 16
+#define NLM_CB_IDLE 300		/*< Seconds before an idle connection goes */
+#define NLM_CB_ADDR_LIFETIME 600 /*< Seconds a resolved address is kept */
+#define NLM_CB_MSG_MAX 6144	/*< Larger than any encoded NLM4 reply */
+#define NLM_CB_QUEUE_MAX 256	/*< Messages waiting on one connection */
+#define NLM_CB_BACKOFF_MIN 5	/*< Seconds after a first failure */
+#define NLM_CB_BACKOFF_MAX 300	/*< Longest back off, in seconds */
 
 static const int MAX_ASYNC_RETRY = 2;
 
-/* Client routine  to send the asynchrnous response,
- * key is used to wait for a response
+struct nlm_cb_msg {
+	struct glist_head ncm_list;
+	int ncm_proc;
+	nlm_send_done_t ncm_done;	/*< Called once sent or failed */
+	void *ncm_done_arg;
+	u_int ncm_len;
+	char ncm_buf[];			/*< Encoded arguments */
+};
+
+struct nlm_cb_conn {
+	struct glist_head ncc_list;	/*< Hash bucket */
+	struct glist_head ncc_queue;	/*< Messages waiting to go */
+	unsigned int ncc_queued;	/*< Length of ncc_queue */
+	char *ncc_name;			/*< Caller name */
+	xprt_type_t ncc_type;
+	struct sockaddr_storage ncc_server_addr; /*< Our end */
+	struct sockaddr_in6 ncc_addr;	/*< Client's NLM service (TCP) */
+	socklen_t ncc_addrlen;
+	time_t ncc_addr_expire;		/*< 0 if ncc_addr must be looked up */
+	CLIENT *ncc_clnt;
+	AUTH *ncc_auth;
+	time_t ncc_last_used;
+	time_t ncc_retry_after;		/*< Fail messages until then */
+	time_t ncc_backoff;		/*< Current back off, 0 if up */
+	bool ncc_active;		/*< A thread owns the connection */
+};
+
+static pthread_mutex_t nlm_cb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head nlm_cb_table[NLM_CB_BUCKETS];
+static struct fridgethr *nlm_cb_fridge;
+
+static inline struct glist_head *nlm_cb_bucket(const char *name)
+{
+	return &nlm_cb_table[CityHash64(name, strlen(name)) % NLM_CB_BUCKETS];
+}
+
+/**
+ * @brief Write out arguments encoded when the message was queued
+ */
+
+static bool xdr_nlm_cb_msg(XDR *xdrs, struct nlm_cb_msg *msg)
+{
+	if (xdrs->x_op != XDR_ENCODE)
+		return false;
+
+	return XDR_PUTBYTES(xdrs, msg->ncm_buf, msg->ncm_len);
+}
+
+/**
+ * @brief Find the address of the client's NLM service over TCP
+ *
+ * @param[in,out] conn The connection, owned by the caller
+ *
+ * @return true if the address is known.
  */
-int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
+
+static bool nlm_cb_resolve(struct nlm_cb_conn *conn)
+{
+	struct netbuf *buf;
+	struct addrinfo *result;
+	struct addrinfo hints;
+	char port_str[20];
+	int retval;
+
+	if (conn->ncc_addr_expire > time(NULL))
+		return true;
+
+	buf = rpcb_find_mapped_addr((char *) xprt_type_to_str(conn->ncc_type),
+				    NLMPROG, NLM4_VERS, conn->ncc_name);
+	/* handle error here, for example,
+	 * client side blocking rpc call
+	 */
+	if (buf == NULL) {
+		LogMajor(COMPONENT_NLM,
+			 "Cannot create NLM async %s connection to client %s",
+			 xprt_type_to_str(conn->ncc_type), conn->ncc_name);
+		return false;
+	}
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_INET6;	/* only INET6 */
+	hints.ai_socktype = SOCK_STREAM; /* TCP */
+	hints.ai_protocol = 0;	/* Any protocol */
+
+	/* convert port to string format */
+	sprintf(port_str, "%d",
+		htons(((struct sockaddr_in *)buf->buf)->sin_port));
+
+	/* buf with inet is only needed for the port */
+	gsh_free(buf->buf);
+	gsh_free(buf);
+
+	/* get the IPv4 mapped IPv6 address */
+	retval = getaddrinfo(conn->ncc_name, port_str, &hints, &result);
+
+	if (retval != 0) {
+		LogEvent(COMPONENT_NLM,
+			 "failed to resolve %s to an address: %s",
+			 conn->ncc_name, gai_strerror(retval));
+		return false;
+	}
+
+	conn->ncc_addrlen = result->ai_addrlen < sizeof(conn->ncc_addr)
+				? result->ai_addrlen : sizeof(conn->ncc_addr);
+	memcpy(&conn->ncc_addr, result->ai_addr, conn->ncc_addrlen);
+	conn->ncc_addr_expire = time(NULL) + NLM_CB_ADDR_LIFETIME;
+	freeaddrinfo(result);
+
+	return true;
+}
+
+/**
+ * @brief Make sure a callback connection is up
+ *
+ * @param[in,out] conn The connection, owned by the caller
+ *
+ * @return true if connected.
+ */
+
+static bool nlm_cb_connect(struct nlm_cb_conn *conn)
+{
+	if (conn->ncc_clnt != NULL)
+		return true;
+
+	LogFullDebug(COMPONENT_NLM, "gsh_clnt_create %s", conn->ncc_name);
+
+	if (conn->ncc_type == XPRT_TCP) {
+		int fd;
+		struct sockaddr_in6 server_addr;
+		struct netbuf local_buf;
+
+		if (!nlm_cb_resolve(conn))
+			return false;
+
+		fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
+		if (fd < 0)
+			return false;
+
+		memcpy(&server_addr, &conn->ncc_server_addr,
+		       sizeof(struct sockaddr_in6));
+		server_addr.sin6_port = 0;
+
+		if (bind(fd, (struct sockaddr *)&server_addr,
+			 sizeof(server_addr)) == -1) {
+			LogMajor(COMPONENT_NLM, "Cannot bind");
+			close(fd);
+			return false;
+		}
+
+		/* setup the netbuf with in6 address */
+		local_buf.buf = &conn->ncc_addr;
+		local_buf.len = local_buf.maxlen = conn->ncc_addrlen;
+
+		conn->ncc_clnt = clnt_vc_ncreate(fd, &local_buf, NLMPROG,
+						 NLM4_VERS, 0, 0);
+		if (conn->ncc_clnt == NULL)
+			close(fd);
+	} else {
+		conn->ncc_clnt = gsh_clnt_create(
+			conn->ncc_name, NLMPROG, NLM4_VERS,
+			(char *) xprt_type_to_str(conn->ncc_type));
+	}
+
+	if (conn->ncc_clnt == NULL) {
+		LogMajor(COMPONENT_NLM,
+			 "Cannot create NLM async %s connection to client %s",
+			 xprt_type_to_str(conn->ncc_type), conn->ncc_name);
+		return false;
+	}
+
+	/* split auth (for authnone, idempotent) */
+	conn->ncc_auth = authnone_create();
+
+	return true;
+}
+
+static void nlm_cb_disconnect(struct nlm_cb_conn *conn)
+{
+	if (conn->ncc_clnt == NULL)
+		return;
+
+	gsh_clnt_destroy(conn->ncc_clnt);
+	conn->ncc_clnt = NULL;
+	AUTH_DESTROY(conn->ncc_auth);
+	conn->ncc_auth = NULL;
+}
+
+/**
+ * @brief Send one message
+ *
+ * @param[in,out] conn The connection, owned by the caller
+ * @param[in]     msg  The message
+ *
+ * @return RPC_SUCCESS or the error of the last try.
+ */
+
+static int nlm_cb_send(struct nlm_cb_conn *conn, struct nlm_cb_msg *msg)
 {
 	struct timeval tout = { 0, 10 };
-	int retval, retry;
-	struct timeval start, now;
-	struct timespec timeout;
+	int retval = RPC_CANTSEND;
+	int retry;
+	time_t now = time(NULL);
+
+	if (conn->ncc_clnt == NULL && conn->ncc_retry_after > now) {
+		LogFullDebug(COMPONENT_NLM,
+			     "Not sending to %s, unreachable for %ld more seconds",
+			     conn->ncc_name,
+			     (long) (conn->ncc_retry_after - now));
+		return RPC_CANTSEND;
+	}
 
 	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
-		if (host->slc_callback_clnt == NULL) {
-			LogFullDebug(COMPONENT_NLM,
-				     "gsh_clnt_create %s",
-				     host->slc_nsm_client->ssc_nlm_caller_name);
-
-			if (host->slc_client_type == XPRT_TCP) {
-				int fd;
-				struct sockaddr_in6 server_addr;
-				struct netbuf *buf, local_buf;
-				struct addrinfo *result;
-				struct addrinfo hints;
-				char port_str[20];
-
-				fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
-				if (fd < 0)
-					return -1;
-
-				memcpy(&server_addr,
-				       &(host->slc_server_addr),
-				       sizeof(struct sockaddr_in6));
-				server_addr.sin6_port = 0;
-
-				if (bind(fd,
-					 (struct sockaddr *)&server_addr,
-					  sizeof(server_addr)) == -1) {
-					LogMajor(COMPONENT_NLM, "Cannot bind");
-					close(fd);
-					return -1;
-				}
-
-				buf = rpcb_find_mapped_addr(
-				     (char *) xprt_type_to_str(
-							host->slc_client_type),
-				     NLMPROG, NLM4_VERS,
-				     host->slc_nsm_client->ssc_nlm_caller_name);
-				/* handle error here, for example,
-				 * client side blocking rpc call
-				 */
-				if (buf == NULL) {
-					LogMajor(COMPONENT_NLM,
-						 "Cannot create NLM async %s connection to client %s",
-						 xprt_type_to_str(
-							host->slc_client_type),
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name);
-					close(fd);
-					return -1;
-				}
-
-				memset(&hints, 0, sizeof(struct addrinfo));
-				hints.ai_family = AF_INET6;	/* only INET6 */
-				hints.ai_socktype = SOCK_STREAM; /* TCP */
-				hints.ai_protocol = 0;	/* Any protocol */
-				hints.ai_canonname = NULL;
-				hints.ai_addr = NULL;
-				hints.ai_next = NULL;
-
-				/* convert port to string format */
-				sprintf(port_str, "%d",
-					htons(((struct sockaddr_in *)
-						buf->buf)->sin_port));
-
-				/* buf with inet is only needed for the port */
-				gsh_free(buf->buf);
-				gsh_free(buf);
-
-				/* get the IPv4 mapped IPv6 address */
-				retval = getaddrinfo(host->slc_nsm_client->
-						     ssc_nlm_caller_name,
-						     port_str,
-						     &hints,
-						     &result);
-
-				/* retry for spurious EAI_NONAME errors */
-				if (retval == EAI_NONAME ||
-				    retval == EAI_AGAIN) {
-					LogEvent(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name,
-						 gai_strerror(retval));
-					/* getaddrinfo() failed, retry */
-					retval = RPC_UNKNOWNADDR;
-					usleep(1000);
-					continue;
-				} else if (retval != 0) {
-					LogMajor(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name,
-						 gai_strerror(retval));
-					return -1;
-				}
-
-				/* setup the netbuf with in6 address */
-				local_buf.buf = result->ai_addr;
-				local_buf.len = local_buf.maxlen =
-				    result->ai_addrlen;
-
-				host->slc_callback_clnt =
-				    clnt_vc_ncreate(fd, &local_buf, NLMPROG,
-						    NLM4_VERS, 0, 0);
-				freeaddrinfo(result);
-			} else {
-
-				host->slc_callback_clnt = gsh_clnt_create(
-				    host->slc_nsm_client->ssc_nlm_caller_name,
-				    NLMPROG,
-				    NLM4_VERS,
-				    (char *) xprt_type_to_str(
-						host->slc_client_type));
-			}
-
-			if (host->slc_callback_clnt == NULL) {
-				LogMajor(COMPONENT_NLM,
-					 "Cannot create NLM async %s connection to client %s",
-					 xprt_type_to_str(host->
-							  slc_client_type),
-					 host->slc_nsm_client->
-					 ssc_nlm_caller_name);
-				return -1;
-			}
-
-			/* split auth (for authnone, idempotent) */
-			host->slc_callback_auth = authnone_create();
+		if (!nlm_cb_connect(conn)) {
+			/* the client may have moved or restarted lockd */
+			conn->ncc_addr_expire = 0;
+			retval = RPC_CANTSEND;
+			continue;
 		}
 
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = key;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-
 		LogFullDebug(COMPONENT_NLM, "About to make clnt_call");
 
-		retval = clnt_call(host->slc_callback_clnt,
-				   host->slc_callback_auth,
-				   proc,
-				   nlm_reply_proc[proc],
-				   inarg,
+		retval = clnt_call(conn->ncc_clnt,
+				   conn->ncc_auth,
+				   msg->ncm_proc,
+				   (xdrproc_t) xdr_nlm_cb_msg,
+				   msg,
 				   (xdrproc_t) xdr_void,
 				   NULL,
 				   tout);
@@ -272,71 +375,258 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 		LogFullDebug(COMPONENT_NLM, "Done with clnt_call");
 
 		if (retval == RPC_TIMEDOUT || retval == RPC_SUCCESS) {
-			retval = RPC_SUCCESS;
-			break;
+			conn->ncc_backoff = 0;
+			return RPC_SUCCESS;
 		}
 
 		LogCrit(COMPONENT_NLM,
 			"NLM async Client procedure call %d failed with return code %d %s",
-			proc, retval,
-			clnt_sperror(host->slc_callback_clnt, ""));
+			msg->ncm_proc, retval,
+			clnt_sperror(conn->ncc_clnt, ""));
 
-		gsh_clnt_destroy(host->slc_callback_clnt);
-		host->slc_callback_clnt = NULL;
+		nlm_cb_disconnect(conn);
+		conn->ncc_addr_expire = 0;
 	}
 
-	if (retry == MAX_ASYNC_RETRY) {
-		LogMajor(COMPONENT_NLM,
-			 "NLM async Client exceeded retry count %d",
-			 MAX_ASYNC_RETRY);
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = NULL;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-		return retval;
+	if (conn->ncc_backoff == 0)
+		conn->ncc_backoff = NLM_CB_BACKOFF_MIN;
+	else if (conn->ncc_backoff < NLM_CB_BACKOFF_MAX / 2)
+		conn->ncc_backoff *= 2;
+	else
+		conn->ncc_backoff = NLM_CB_BACKOFF_MAX;
+	conn->ncc_retry_after = time(NULL) + conn->ncc_backoff;
+
+	LogMajor(COMPONENT_NLM,
+		 "NLM async Client exceeded retry count %d, not sending to %s for %ld seconds",
+		 MAX_ASYNC_RETRY, conn->ncc_name, (long) conn->ncc_backoff);
+
+	return retval;
+}
+
+/**
+ * @brief Send everything queued on a connection
+ *
+ * @param[in] ctx Thread context, the argument is the connection
+ */
+
+static void nlm_cb_run(struct fridgethr_context *ctx)
+{
+	struct nlm_cb_conn *conn = ctx->arg;
+	struct nlm_cb_msg *msg;
+	int retval;
+
+	PTHREAD_MUTEX_lock(&nlm_cb_mutex);
+
+	while ((msg = glist_first_entry(&conn->ncc_queue, struct nlm_cb_msg,
+					ncm_list)) != NULL) {
+		glist_del(&msg->ncm_list);
+		conn->ncc_queued--;
+		PTHREAD_MUTEX_unlock(&nlm_cb_mutex);
+
+		retval = nlm_cb_send(conn, msg);
+		if (msg->ncm_done != NULL)
+			msg->ncm_done(msg->ncm_done_arg, retval);
+		gsh_free(msg);
+
+		PTHREAD_MUTEX_lock(&nlm_cb_mutex);
 	}
 
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
+	conn->ncc_active = false;
+	conn->ncc_last_used = time(NULL);
 
-	if (resp_key != NULL) {
-		/* Wait for 5 seconds or a signal */
-		gettimeofday(&start, NULL);
-		gettimeofday(&now, NULL);
-		timeout.tv_sec = 5 + start.tv_sec;
-		timeout.tv_nsec = 0;
+	PTHREAD_MUTEX_unlock(&nlm_cb_mutex);
+}
 
-		LogFullDebug(COMPONENT_NLM,
-			     "About to wait for signal for key %p", resp_key);
-
-		while (resp_key != NULL && now.tv_sec < (start.tv_sec + 5)) {
-			int rc;
-
-			rc = pthread_cond_timedwait(&nlm_async_resp_cond,
-						    &nlm_async_resp_mutex,
-						    &timeout);
-			LogFullDebug(COMPONENT_NLM,
-				     "pthread_cond_timedwait returned %d",
-				     rc);
-			gettimeofday(&now, NULL);
+/**
+ * @brief Find or make the connection for a client
+ *
+ * @note The caller must hold nlm_cb_mutex.
+ */
+
+static struct nlm_cb_conn *nlm_cb_get(state_nlm_client_t *host)
+{
+	const char *name = host->slc_nsm_client->ssc_nlm_caller_name;
+	struct glist_head *bucket = nlm_cb_bucket(name);
+	struct glist_head *glist;
+	struct nlm_cb_conn *conn;
+
+	glist_for_each(glist, bucket) {
+		conn = glist_entry(glist, struct nlm_cb_conn, ncc_list);
+		if (conn->ncc_type == host->slc_client_type &&
+		    strcmp(conn->ncc_name, name) == 0 &&
+		    memcmp(&conn->ncc_server_addr, &host->slc_server_addr,
+			   sizeof(conn->ncc_server_addr)) == 0)
+			return conn;
+	}
+
+	conn = gsh_calloc(1, sizeof(*conn));
+	glist_init(&conn->ncc_queue);
+	conn->ncc_name = gsh_strdup(name);
+	conn->ncc_type = host->slc_client_type;
+	memcpy(&conn->ncc_server_addr, &host->slc_server_addr,
+	       sizeof(conn->ncc_server_addr));
+	glist_add_tail(bucket, &conn->ncc_list);
+
+	return conn;
+}
+
+/**
+ * @brief Drop connections that have been idle too long
+ *
+ * Runs every NLM_CB_IDLE / 2 seconds from the delayed executor.
+ */
+
+static void nlm_cb_expire(void *arg)
+{
+	struct glist_head expired = GLIST_HEAD_INIT(expired);
+	struct glist_head *glist;
+	struct glist_head *glistn;
+	struct nlm_cb_conn *conn;
+	time_t cutoff = time(NULL) - NLM_CB_IDLE;
+	int i;
+
+	PTHREAD_MUTEX_lock(&nlm_cb_mutex);
+
+	for (i = 0; i < NLM_CB_BUCKETS; i++) {
+		glist_for_each_safe(glist, glistn, &nlm_cb_table[i]) {
+			conn = glist_entry(glist, struct nlm_cb_conn,
+					   ncc_list);
+			if (conn->ncc_active || conn->ncc_last_used > cutoff)
+				continue;
+			glist_del(&conn->ncc_list);
+			glist_add_tail(&expired, &conn->ncc_list);
 		}
-		LogFullDebug(COMPONENT_NLM, "Done waiting");
 	}
 
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+	PTHREAD_MUTEX_unlock(&nlm_cb_mutex);
 
-	return retval;
+	glist_for_each_safe(glist, glistn, &expired) {
+		conn = glist_entry(glist, struct nlm_cb_conn, ncc_list);
+		LogFullDebug(COMPONENT_NLM, "Closing idle connection to %s",
+			     conn->ncc_name);
+		glist_del(&conn->ncc_list);
+		nlm_cb_disconnect(conn);
+		gsh_free(conn->ncc_name);
+		gsh_free(conn);
+	}
+
+	(void) delayed_submit(nlm_cb_expire, NULL,
+			      NLM_CB_IDLE / 2 * NS_PER_SEC);
 }
 
-void nlm_signal_async_resp(void *key)
+int nlm_async_callback_init(void)
 {
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
+	struct fridgethr_params frp;
+	int rc;
+	int i;
 
-	if (resp_key == key) {
-		resp_key = NULL;
-		pthread_cond_signal(&nlm_async_resp_cond);
-		LogFullDebug(COMPONENT_NLM, "Signaled condition variable");
-	} else {
-		LogFullDebug(COMPONENT_NLM, "Didn't signal condition variable");
+	for (i = 0; i < NLM_CB_BUCKETS; i++)
+		glist_init(&nlm_cb_table[i]);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = NLM_CB_THREADS;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&nlm_cb_fridge, "NLM_Callback", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Unable to initialize NLM callback fridge, error code %d.",
+			 rc);
+		return rc;
 	}
 
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+	return delayed_submit(nlm_cb_expire, NULL,
+			      NLM_CB_IDLE / 2 * NS_PER_SEC);
+}
+
+void nlm_async_callback_shutdown(void)
+{
+	int rc;
+
+	if (nlm_cb_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(nlm_cb_fridge, fridgethr_comm_stop, 30);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NLM,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(nlm_cb_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Failed shutting down NLM callback fridge: %d", rc);
+	}
+}
+
+/* Client routine to send the asynchronous response, done, if not NULL,
+ * is called once the message has been sent or given up on.
+ */
+int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg,
+		   nlm_send_done_t done, void *done_arg)
+{
+	char buf[NLM_CB_MSG_MAX];
+	struct nlm_cb_msg *msg;
+	struct nlm_cb_conn *conn;
+	XDR xdrs;
+	u_int len;
+	int rc;
+
+	/* Encode now, the caller frees the arguments on return */
+	xdrmem_create(&xdrs, buf, sizeof(buf), XDR_ENCODE);
+
+	if (!nlm_reply_proc[proc](&xdrs, inarg)) {
+		xdr_destroy(&xdrs);
+		LogCrit(COMPONENT_NLM,
+			"NLM async Client procedure call %d could not be encoded",
+			proc);
+		return RPC_CANTENCODEARGS;
+	}
+
+	len = xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	msg = gsh_malloc(sizeof(*msg) + len);
+	msg->ncm_proc = proc;
+	msg->ncm_done = done;
+	msg->ncm_done_arg = done_arg;
+	msg->ncm_len = len;
+	memcpy(msg->ncm_buf, buf, len);
+
+	PTHREAD_MUTEX_lock(&nlm_cb_mutex);
+
+	conn = nlm_cb_get(host);
+
+	if (conn->ncc_queued >= NLM_CB_QUEUE_MAX) {
+		LogMajor(COMPONENT_NLM,
+			 "Dropping NLM async procedure %d, %u messages already waiting for %s",
+			 proc, conn->ncc_queued, conn->ncc_name);
+		PTHREAD_MUTEX_unlock(&nlm_cb_mutex);
+		gsh_free(msg);
+		return RPC_CANTSEND;
+	}
+
+	glist_add_tail(&conn->ncc_queue, &msg->ncm_list);
+	conn->ncc_queued++;
+
+	if (!conn->ncc_active) {
+		conn->ncc_active = true;
+		rc = fridgethr_submit(nlm_cb_fridge, nlm_cb_run, conn);
+		if (rc != 0) {
+			LogMajor(COMPONENT_NLM,
+				 "Unable to send to %s, error %d",
+				 conn->ncc_name, rc);
+			glist_del(&msg->ncm_list);
+			conn->ncc_queued--;
+			conn->ncc_active = false;
+			conn->ncc_last_used = time(NULL);
+			PTHREAD_MUTEX_unlock(&nlm_cb_mutex);
+			gsh_free(msg);
+			return RPC_SYSTEMERROR;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&nlm_cb_mutex);
+
+	return RPC_SUCCESS;
 }
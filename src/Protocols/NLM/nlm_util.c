@@ -138,6 +138,10 @@ void nlm_init(void)
 	granted_cookie.gc_seconds = (unsigned long)nlm_grace_tv.tv_sec;
 	granted_cookie.gc_microseconds = (unsigned long)nlm_grace_tv.tv_usec;
 	granted_cookie.gc_cookie = 0;
+
+	if (nlm_async_callback_init() != 0)
+		LogFatal(COMPONENT_NLM,
+			 "Unable to start sending NLM callbacks");
 }
 
 void free_grant_arg(state_async_queue_t *arg)
@@ -153,13 +157,13 @@ void free_grant_arg(state_async_queue_t *arg)
 
 /**
  *
- * nlm4_send_grant_msg: Send NLMPROC4_GRANTED_MSG
+ * nlm4_send_grant_done: Clean up after NLMPROC4_GRANTED_MSG
  *
- * This runs in the nlm_asyn_thread context.
+ * This runs once the message has been sent or given up on.
  */
-static void nlm4_send_grant_msg(state_async_queue_t *arg)
+static void nlm4_send_grant_done(void *done_arg, int retval)
 {
-	int retval;
+	state_async_queue_t *arg = done_arg;
 	char buffer[1024] = "\0";
 	state_status_t state_status = STATE_SUCCESS;
 	state_cookie_entry_t *cookie_entry;
@@ -168,31 +172,14 @@ static void nlm4_send_grant_msg(state_async_queue_t *arg)
 	struct root_op_context root_op_context;
 	struct gsh_export *export;
 
-	if (isDebug(COMPONENT_NLM)) {
-		netobj_to_string(&nlm_arg->nlm_async_args.nlm_async_grant.
-				 cookie, buffer, sizeof(buffer));
-
-		LogDebug(COMPONENT_NLM,
-			 "Sending GRANTED for arg=%p svid=%d start=%llx len=%llx cookie=%s",
-			 arg,
-			 nlm_arg->nlm_async_args.nlm_async_grant.alock.svid,
-			 (unsigned long long)nlm_arg->nlm_async_args.
-			 nlm_async_grant.alock.l_offset,
-			 (unsigned long long)nlm_arg->nlm_async_args.
-			 nlm_async_grant.alock.l_len, buffer);
-	}
-
-	retval = nlm_send_async(NLMPROC4_GRANTED_MSG,
-				nlm_arg->nlm_async_host,
-				&nlm_arg->nlm_async_args.nlm_async_grant,
-				nlm_arg->nlm_async_key);
-
-	dec_nlm_client_ref(nlm_arg->nlm_async_host);
-
 	/* If success, we are done. */
 	if (retval == RPC_SUCCESS)
 		goto out;
 
+	if (isFullDebug(COMPONENT_NLM))
+		netobj_to_string(&nlm_arg->nlm_async_args.nlm_async_grant.
+				 cookie, buffer, sizeof(buffer));
+
 	/*
 	 * We are not able call granted callback. Some client may retry
 	 * the lock again. So remove the existing blocked nlm entry
@@ -248,6 +235,48 @@ static void nlm4_send_grant_msg(state_async_queue_t *arg)
 	free_grant_arg(arg);
 }
 
+/**
+ *
+ * nlm4_send_grant_msg: Send NLMPROC4_GRANTED_MSG
+ *
+ * This runs in the nlm_asyn_thread context.
+ */
+static void nlm4_send_grant_msg(state_async_queue_t *arg)
+{
+	int retval;
+	char buffer[1024] = "\0";
+	state_nlm_async_data_t *nlm_arg =
+	    &arg->state_async_data.state_nlm_async_data;
+	/* arg belongs to the callback thread once queued */
+	state_nlm_client_t *host = nlm_arg->nlm_async_host;
+
+	if (isDebug(COMPONENT_NLM)) {
+		netobj_to_string(&nlm_arg->nlm_async_args.nlm_async_grant.
+				 cookie, buffer, sizeof(buffer));
+
+		LogDebug(COMPONENT_NLM,
+			 "Sending GRANTED for arg=%p svid=%d start=%llx len=%llx cookie=%s",
+			 arg,
+			 nlm_arg->nlm_async_args.nlm_async_grant.alock.svid,
+			 (unsigned long long)nlm_arg->nlm_async_args.
+			 nlm_async_grant.alock.l_offset,
+			 (unsigned long long)nlm_arg->nlm_async_args.
+			 nlm_async_grant.alock.l_len, buffer);
+	}
+
+	retval = nlm_send_async(NLMPROC4_GRANTED_MSG,
+				host,
+				&nlm_arg->nlm_async_args.nlm_async_grant,
+				nlm4_send_grant_done,
+				arg);
+
+	dec_nlm_client_ref(host);
+
+	/* Once queued, the outcome is handled when it is known */
+	if (retval != RPC_SUCCESS)
+		nlm4_send_grant_done(arg, retval);
+}
+
 int nlm_process_parameters(struct svc_req *req, bool exclusive,
 			   nlm4_lock *alock, fsal_lock_param_t *plock,
 			   struct fsal_obj_handle **ppobj,
@@ -614,7 +643,6 @@ state_status_t nlm_granted_callback(struct fsal_obj_handle *obj,
 	arg->state_async_func = nlm4_send_grant_msg;
 	arg->state_async_data.state_nlm_async_data.nlm_async_host =
 	    nlm_grant_client;
-	arg->state_async_data.state_nlm_async_data.nlm_async_key = cookie_entry;
 	inarg = &arg->state_async_data.state_nlm_async_data.nlm_async_args.
 		nlm_async_grant;
 
@@ -24,23 +24,171 @@
  */
 
 #include "config.h"
+#include <assert.h>
 #include <sys/utsname.h>
 #include "abstract_atomic.h"
 #include "gsh_rpc.h"
 #include "nsm.h"
 #include "sal_data.h"
+#include "sal_functions.h"
+#include "fridgethr.h"
+#include "delayed_exec.h"
+#include "city.h"
+
+/**
+ * @file nsm.c
+ * @brief Monitoring of NLM clients with the local statd
+ *
+ * SM_MON and SM_UNMON are not called on the thread serving the NLM
+ * request.  They are queued, at most once per host, and sent by up
+ * to NSM_PIPELINE workers, each with its own connection to statd, so
+ * a burst of clients re-acquiring their locks after a failover does
+ * not line up all worker threads behind statd.
+ *
+ * Requests are kept per caller name, in a hash table, and go out one
+ * at a time per name, so statd sees them in the order they were made.
+ * Names with a request ready to go are on a list the workers take
+ * from.  An SM_UNMON that has not gone out yet is dropped if the name
+ * is monitored again, and an SM_UNMON is not queued while an SM_MON
+ * for the name is pending.  A failed request stays first for its name
+ * while it waits to be tried again, up to NSM_RETRY_MAX times.
+ * Nothing is sent until nsm_unmonitor_all has cleared statd's list.
+ */
+
+/**
+ * @brief Most requests in flight to statd at once
+ */
+
+#define NSM_PIPELINE 4
+
+/**
+ * @brief Delay before a failed request is tried again
+ */
+
+#define NSM_RETRY_DELAY (5 * NS_PER_SEC)
+
+/**
+ * @brief Attempts before a request is given up on
+ */
+
+#define NSM_RETRY_MAX 12
+
+#define NSM_NAME_BUCKETS 1024
+
+/**
+ * @brief A connection to statd
+ */
+
+struct nsm_conn {
+	CLIENT *clnt;		/*< NULL until connected */
+	AUTH *auth;
+	bool busy;		/*< Owned by a worker */
+};
+
+enum nsm_op {
+	NSM_OP_MON,
+	NSM_OP_UNMON,
+};
+
+/**
+ * @brief Requests for one caller name
+ */
+
+struct nsm_name {
+	struct glist_head nn_hash;	/*< Hash bucket */
+	struct glist_head nn_ready;	/*< On nsm_ready_names */
+	struct glist_head nn_reqs;	/*< Requests not sent yet, in order */
+	char *nn_name;
+	struct nsm_req *nn_inflight;	/*< Request being sent, if any */
+	bool nn_is_ready;		/*< On nsm_ready_names */
+};
+
+/**
+ * @brief A queued SM_MON or SM_UNMON
+ */
+
+struct nsm_req {
+	struct glist_head nr_list;	/*< On its name's nn_reqs */
+	struct nsm_name *nr_rec;	/*< Its name */
+	enum nsm_op nr_op;
+	state_nsm_client_t *nr_host;	/*< Host to monitor, referenced */
+	char *nr_name;			/*< Caller name */
+	unsigned int nr_tries;		/*< Failed attempts so far */
+	bool nr_waiting;		/*< Waiting to be tried again */
+};
+
+/**
+ * @brief Protects everything below
+ */
 
 pthread_mutex_t nsm_mutex = PTHREAD_MUTEX_INITIALIZER;
-CLIENT *nsm_clnt;
-AUTH *nsm_auth;
-unsigned long nsm_count;
 char *nodename;
 
-bool nsm_connect(void)
+static struct nsm_conn nsm_conns[NSM_PIPELINE];
+static struct glist_head nsm_names[NSM_NAME_BUCKETS];
+static struct glist_head nsm_ready_names = GLIST_HEAD_INIT(nsm_ready_names);
+static unsigned int nsm_nready;	/*< Length of nsm_ready_names */
+static struct fridgethr *nsm_fridge;
+static int nsm_workers;		/*< Worker jobs submitted or running */
+static bool nsm_ready;		/*< SM_UNMON_ALL has been sent */
+
+/**
+ * @brief Connect to statd
+ *
+ * @note Called without nsm_mutex, the connection is owned by the
+ *       caller.
+ *
+ * @param[in,out] conn The connection
+ *
+ * @return true if connected.
+ */
+
+static bool nsm_connect(struct nsm_conn *conn)
+{
+	if (conn->clnt != NULL)
+		return true;
+
+	conn->clnt = gsh_clnt_create("localhost", SM_PROG, SM_VERS, "tcp");
+
+	if (conn->clnt == NULL) {
+		LogCrit(COMPONENT_NLM, "failed to connect to statd");
+		return false;
+	}
+
+	/* split auth (for authnone, idempotent) */
+	conn->auth = authnone_create();
+
+	return true;
+}
+
+/**
+ * @brief Drop a connection to statd, after an error or when done
+ *
+ * @param[in,out] conn The connection
+ */
+
+static void nsm_disconnect(struct nsm_conn *conn)
+{
+	if (conn->clnt != NULL) {
+		gsh_clnt_destroy(conn->clnt);
+		conn->clnt = NULL;
+		AUTH_DESTROY(conn->auth);
+		conn->auth = NULL;
+	}
+}
+
+/**
+ * @brief Set up what every request needs
+ *
+ * @return true if the node name is known.
+ */
+
+static bool nsm_setup(void)
 {
 	struct utsname utsname;
+	int rc;
 
-	if (nsm_clnt != NULL)
+	if (nodename != NULL)
 		return true;
 
 	if (uname(&utsname) == -1) {
@@ -50,217 +198,538 @@ bool nsm_connect(void)
 		return false;
 	}
 
-	nodename = gsh_strdup(utsname.nodename);
-
-	nsm_clnt = gsh_clnt_create("localhost", SM_PROG, SM_VERS, "tcp");
-
-	if (nsm_clnt == NULL) {
-		LogCrit(COMPONENT_NLM, "failed to connect to statd");
-		gsh_free(nodename);
-		nodename = NULL;
+	if (nsm_fridge == NULL) {
+		struct fridgethr_params frp;
+		int i;
+
+		for (i = 0; i < NSM_NAME_BUCKETS; i++)
+			glist_init(&nsm_names[i]);
+
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = NSM_PIPELINE;
+		frp.thr_min = 0;
+		frp.flavor = fridgethr_flavor_worker;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&nsm_fridge, "NSM", &frp);
+		if (rc != 0) {
+			LogCrit(COMPONENT_NLM,
+				"Unable to initialize NSM fridge, error code %d.",
+				rc);
+			return false;
+		}
 	}
 
-	/* split auth (for authnone, idempotent) */
-	nsm_auth = authnone_create();
+	nodename = gsh_strdup(utsname.nodename);
 
-	return nsm_clnt != NULL;
+	return true;
 }
 
-void nsm_disconnect(void)
-{
-	if (nsm_count == 0 && nsm_clnt != NULL) {
-		gsh_clnt_destroy(nsm_clnt);
-		nsm_clnt = NULL;
-		AUTH_DESTROY(nsm_auth);
-		nsm_auth = NULL;
-		gsh_free(nodename);
-		nodename = NULL;
-	}
-}
+/**
+ * @brief Send one SM_MON or SM_UNMON
+ *
+ * @param[in,out] conn Connection to use
+ * @param[in]     req  The request
+ *
+ * @return true if statd did what it was asked.
+ */
 
-bool nsm_monitor(state_nsm_client_t *host)
+static bool nsm_call(struct nsm_conn *conn, struct nsm_req *req)
 {
 	enum clnt_stat ret;
 	struct mon nsm_mon;
 	struct sm_stat_res res;
+	struct sm_stat unmon_res;
 	struct timeval tout = { 25, 0 };
-
-	if (host == NULL)
-		return true;
-
-	PTHREAD_MUTEX_lock(&host->ssc_mutex);
-
-	if (atomic_fetch_int32_t(&host->ssc_monitored)) {
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return true;
-	}
+	const char *what = req->nr_op == NSM_OP_MON ? "monitor" : "unmonitor";
 
 	memset(&nsm_mon, 0, sizeof(nsm_mon));
-	nsm_mon.mon_id.mon_name = host->ssc_nlm_caller_name;
+	nsm_mon.mon_id.mon_name = req->nr_name;
+	nsm_mon.mon_id.my_id.my_name = nodename;
 	nsm_mon.mon_id.my_id.my_prog = NLMPROG;
 	nsm_mon.mon_id.my_id.my_vers = NLM4_VERS;
 	nsm_mon.mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
 	/* nothing to put in the private data */
-	LogDebug(COMPONENT_NLM, "Monitor %s", host->ssc_nlm_caller_name);
-
-	PTHREAD_MUTEX_lock(&nsm_mutex);
 
 	/* create a connection to nsm on the localhost */
-	if (!nsm_connect()) {
+	if (!nsm_connect(conn)) {
 		LogCrit(COMPONENT_NLM,
-			"Can not monitor %s clnt_create returned NULL",
-			nsm_mon.mon_id.mon_name);
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+			"Can not %s %s clnt_create returned NULL",
+			what, req->nr_name);
 		return false;
 	}
 
-	/* Set this after we call nsm_connect() */
-	nsm_mon.mon_id.my_id.my_name = nodename;
-
-	ret = clnt_call(nsm_clnt,
-			nsm_auth,
-			SM_MON,
-			(xdrproc_t) xdr_mon,
-			&nsm_mon,
-			(xdrproc_t) xdr_sm_stat_res,
-			&res,
-			tout);
+	if (req->nr_op == NSM_OP_MON) {
+		ret = clnt_call(conn->clnt, conn->auth, SM_MON,
+				(xdrproc_t) xdr_mon, &nsm_mon,
+				(xdrproc_t) xdr_sm_stat_res, &res, tout);
+	} else {
+		ret = clnt_call(conn->clnt, conn->auth, SM_UNMON,
+				(xdrproc_t) xdr_mon_id, &nsm_mon.mon_id,
+				(xdrproc_t) xdr_sm_stat, &unmon_res, tout);
+	}
 
 	if (ret != RPC_SUCCESS) {
 		LogCrit(COMPONENT_NLM,
-			"Can not monitor %s SM_MON ret %d %s",
-			nsm_mon.mon_id.mon_name,
-			ret,
-			clnt_sperror(nsm_clnt, ""));
-
-		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+			"Can not %s %s ret %d %s",
+			what, req->nr_name, ret,
+			clnt_sperror(conn->clnt, ""));
+		nsm_disconnect(conn);
 		return false;
 	}
 
-	if (res.res_stat != STAT_SUCC) {
+	if (req->nr_op == NSM_OP_MON && res.res_stat != STAT_SUCC) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s SM_MON status %d",
-			nsm_mon.mon_id.mon_name, res.res_stat);
-
-		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+			req->nr_name, res.res_stat);
 		return false;
 	}
 
-	nsm_count++;
-	atomic_store_int32_t(&host->ssc_monitored, true);
+	LogDebug(COMPONENT_NLM, "%sed %s for nodename %s",
+		 req->nr_op == NSM_OP_MON ? "Monitor" : "Unmonitor",
+		 req->nr_name, nodename);
+
+	return true;
+}
+
+/**
+ * @brief Look up the requests for a caller name
+ *
+ * @note The caller must hold nsm_mutex.
+ *
+ * @param[in] name   The caller name
+ * @param[in] create Whether to add the name if it has no requests
+ *
+ * @return The name's requests or NULL.
+ */
+
+static struct nsm_name *nsm_name_get(const char *name, bool create)
+{
+	struct glist_head *bucket =
+		&nsm_names[CityHash64(name, strlen(name)) % NSM_NAME_BUCKETS];
+	struct glist_head *glist;
+	struct nsm_name *rec;
+
+	glist_for_each(glist, bucket) {
+		rec = glist_entry(glist, struct nsm_name, nn_hash);
+		if (strcmp(rec->nn_name, name) == 0)
+			return rec;
+	}
+
+	if (!create)
+		return NULL;
+
+	rec = gsh_calloc(1, sizeof(*rec));
+	glist_init(&rec->nn_reqs);
+	rec->nn_name = gsh_strdup(name);
+	glist_add_tail(bucket, &rec->nn_hash);
+
+	return rec;
+}
+
+/**
+ * @brief Put a name on or off the ready list after a change
+ *
+ * A name is ready when nothing is in flight for it and its first
+ * request is not waiting to be tried again.  A name left with no
+ * requests is freed.
+ *
+ * @note The caller must hold nsm_mutex.
+ *
+ * @param[in] rec The name
+ */
+
+static void nsm_name_update(struct nsm_name *rec)
+{
+	struct nsm_req *first = glist_first_entry(&rec->nn_reqs,
+						  struct nsm_req, nr_list);
+	bool ready = rec->nn_inflight == NULL && first != NULL &&
+		     !first->nr_waiting;
+
+	if (ready && !rec->nn_is_ready) {
+		glist_add_tail(&nsm_ready_names, &rec->nn_ready);
+		nsm_nready++;
+	} else if (!ready && rec->nn_is_ready) {
+		glist_del(&rec->nn_ready);
+		nsm_nready--;
+	}
+	rec->nn_is_ready = ready;
+
+	if (first == NULL && rec->nn_inflight == NULL) {
+		glist_del(&rec->nn_hash);
+		gsh_free(rec->nn_name);
+		gsh_free(rec);
+	}
+}
+
+/**
+ * @brief Find a request for a caller name
+ *
+ * @note The caller must hold nsm_mutex.
+ *
+ * @param[in] name     The caller name
+ * @param[in] op       The operation
+ * @param[in] inflight Whether a request being sent counts
+ *
+ * @return The request or NULL.
+ */
 
-	LogDebug(COMPONENT_NLM,
-		 "Monitored %s for nodename %s",
-		 nsm_mon.mon_id.mon_name, nodename);
+static struct nsm_req *nsm_find(const char *name, enum nsm_op op,
+				bool inflight)
+{
+	struct nsm_name *rec = nsm_name_get(name, false);
+	struct glist_head *glist;
+	struct nsm_req *req;
+
+	if (rec == NULL)
+		return NULL;
 
+	if (inflight && rec->nn_inflight != NULL &&
+	    rec->nn_inflight->nr_op == op)
+		return rec->nn_inflight;
+
+	glist_for_each(glist, &rec->nn_reqs) {
+		req = glist_entry(glist, struct nsm_req, nr_list);
+		if (req->nr_op == op)
+			return req;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Take the first request of the first ready name
+ *
+ * @note The caller must hold nsm_mutex.
+ *
+ * @return The request, now in flight, or NULL.
+ */
+
+static struct nsm_req *nsm_next(void)
+{
+	struct nsm_name *rec;
+	struct nsm_req *req;
+
+	if (!nsm_ready)
+		return NULL;
+
+	rec = glist_first_entry(&nsm_ready_names, struct nsm_name, nn_ready);
+	if (rec == NULL)
+		return NULL;
+
+	req = glist_first_entry(&rec->nn_reqs, struct nsm_req, nr_list);
+	glist_del(&req->nr_list);
+	rec->nn_inflight = req;
+	nsm_name_update(rec);
+
+	return req;
+}
+
+static void nsm_worker(struct fridgethr_context *ctx);
+
+/**
+ * @brief Start another worker if there is work it could do
+ *
+ * @note The caller must hold nsm_mutex.
+ */
+
+static void nsm_kick(void)
+{
+	int rc;
+
+	if (!nsm_ready || nsm_workers >= NSM_PIPELINE ||
+	    (unsigned int) nsm_workers >= nsm_nready)
+		return;
+
+	nsm_workers++;
+	rc = fridgethr_submit(nsm_fridge, nsm_worker, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_NLM,
+			"Unable to start NSM worker, error %d", rc);
+		nsm_workers--;
+	}
+}
+
+/**
+ * @brief Queue a request
+ *
+ * @note The caller must hold nsm_mutex.
+ *
+ * @param[in] req The request
+ */
+
+static void nsm_enqueue(struct nsm_req *req)
+{
+	req->nr_rec = nsm_name_get(req->nr_name, true);
+	glist_add_tail(&req->nr_rec->nn_reqs, &req->nr_list);
+	nsm_name_update(req->nr_rec);
+	nsm_kick();
+}
+
+/**
+ * @brief Free a request
+ *
+ * @note Must not be called with nsm_mutex or the host's ssc_mutex
+ *       held, as it may drop the last reference to the host.
+ *
+ * @param[in] req The request
+ */
+
+static void nsm_free_req(struct nsm_req *req)
+{
+	if (req->nr_host != NULL)
+		dec_nsm_client_ref(req->nr_host);
+	else
+		gsh_free(req->nr_name);
+	gsh_free(req);
+}
+
+/**
+ * @brief Let a failed request be tried again
+ *
+ * @param[in] arg The request, first for its name
+ */
+
+static void nsm_retry(void *arg)
+{
+	struct nsm_req *req = arg;
+
+	PTHREAD_MUTEX_lock(&nsm_mutex);
+	req->nr_waiting = false;
+	nsm_name_update(req->nr_rec);
+	nsm_kick();
 	PTHREAD_MUTEX_unlock(&nsm_mutex);
-	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-	return true;
 }
 
-bool nsm_unmonitor(state_nsm_client_t *host)
+/**
+ * @brief Finish a request
+ *
+ * @param[in] req The request, on the in flight list
+ * @param[in] ok  Whether statd did it
+ */
+
+static void nsm_done(struct nsm_req *req, bool ok)
 {
-	enum clnt_stat ret;
-	struct sm_stat res;
-	struct mon_id nsm_mon_id;
-	struct timeval tout = { 25, 0 };
+	struct nsm_name *rec = req->nr_rec;
 
-	if (host == NULL)
-		return true;
+	PTHREAD_MUTEX_lock(&nsm_mutex);
+	rec->nn_inflight = NULL;
+
+	if (!ok && ++req->nr_tries < NSM_RETRY_MAX) {
+		/* Locks were granted regardless, keep at it so the
+		 * client hears about a reboot.  The request stays
+		 * first for its name so later ones keep their order.
+		 */
+		req->nr_waiting = true;
+		glist_add(&rec->nn_reqs, &req->nr_list);
+		if (delayed_submit(nsm_retry, req, NSM_RETRY_DELAY) == 0) {
+			nsm_name_update(rec);
+			PTHREAD_MUTEX_unlock(&nsm_mutex);
+			return;
+		}
+		glist_del(&req->nr_list);
+	}
 
-	PTHREAD_MUTEX_lock(&host->ssc_mutex);
+	if (!ok)
+		LogCrit(COMPONENT_NLM, "Giving up on %s after %u tries",
+			req->nr_name, req->nr_tries);
 
-	if (!atomic_fetch_int32_t(&host->ssc_monitored)) {
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return true;
+	if (req->nr_op == NSM_OP_MON) {
+		atomic_store_int32_t(&req->nr_host->ssc_monitored, ok);
+		req->nr_host->ssc_nsm_queued = false;
 	}
+	nsm_name_update(rec);
+	nsm_kick();
+	PTHREAD_MUTEX_unlock(&nsm_mutex);
+
+	nsm_free_req(req);
+}
 
-	nsm_mon_id.mon_name = host->ssc_nlm_caller_name;
-	nsm_mon_id.my_id.my_prog = NLMPROG;
-	nsm_mon_id.my_id.my_vers = NLM4_VERS;
-	nsm_mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
+/**
+ * @brief Send queued requests until there are none left
+ *
+ * @param[in] ctx Thread context
+ */
+
+static void nsm_worker(struct fridgethr_context *ctx)
+{
+	struct nsm_conn *conn = NULL;
+	struct nsm_req *req;
+	int i;
 
 	PTHREAD_MUTEX_lock(&nsm_mutex);
 
-	/* create a connection to nsm on the localhost */
-	if (!nsm_connect()) {
-		LogCrit(COMPONENT_NLM,
-			"Can not unmonitor %s clnt_create returned NULL",
-			nsm_mon_id.mon_name);
+	for (i = 0; i < NSM_PIPELINE; i++) {
+		if (!nsm_conns[i].busy) {
+			conn = &nsm_conns[i];
+			conn->busy = true;
+			break;
+		}
+	}
+	assert(conn != NULL);
+
+	while ((req = nsm_next()) != NULL) {
+		bool ok;
+
 		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return false;
+		ok = nsm_call(conn, req);
+		nsm_done(req, ok);
+		PTHREAD_MUTEX_lock(&nsm_mutex);
 	}
 
-	/* Set this after we call nsm_connect() */
-	nsm_mon_id.my_id.my_name = nodename;
+	conn->busy = false;
+	nsm_workers--;
+	PTHREAD_MUTEX_unlock(&nsm_mutex);
+}
 
-	ret = clnt_call(nsm_clnt,
-			nsm_auth,
-			SM_UNMON,
-			(xdrproc_t) xdr_mon_id,
-			&nsm_mon_id,
-			(xdrproc_t) xdr_sm_stat,
-			&res,
-			tout);
+/**
+ * @brief Have statd monitor a host
+ *
+ * The SM_MON is queued and sent in the background, so this does not
+ * wait for statd; a host already monitored, or already queued, is
+ * left alone.
+ *
+ * @param[in] host The host
+ *
+ * @return true unless the request could not be queued.
+ */
 
-	if (ret != RPC_SUCCESS) {
-		LogCrit(COMPONENT_NLM,
-			"Can not unmonitor %s SM_MON ret %d %s",
-			nsm_mon_id.mon_name,
-			ret,
-			clnt_sperror(nsm_clnt, ""));
+bool nsm_monitor(state_nsm_client_t *host)
+{
+	struct nsm_req *req;
+	struct nsm_req *unmon;
 
-		nsm_disconnect();
+	if (host == NULL)
+		return true;
+
+	if (atomic_fetch_int32_t(&host->ssc_monitored))
+		return true;
+
+	PTHREAD_MUTEX_lock(&nsm_mutex);
+
+	if (host->ssc_nsm_queued ||
+	    atomic_fetch_int32_t(&host->ssc_monitored)) {
+		PTHREAD_MUTEX_unlock(&nsm_mutex);
+		return true;
+	}
+
+	if (!nsm_setup()) {
 		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
+	/* An unmonitor of an earlier host of that name that hasn't
+	 * gone out yet can just be forgotten, statd still has it.  One
+	 * waiting to be retried belongs to the delayed executor, the
+	 * monitor then queues behind it.
+	 */
+	unmon = nsm_find(host->ssc_nlm_caller_name, NSM_OP_UNMON, false);
+	if (unmon != NULL && !unmon->nr_waiting) {
+		glist_del(&unmon->nr_list);
+		nsm_name_update(unmon->nr_rec);
+		atomic_store_int32_t(&host->ssc_monitored, true);
+		PTHREAD_MUTEX_unlock(&nsm_mutex);
+		LogDebug(COMPONENT_NLM, "Monitor %s, unmonitor dropped",
+			 host->ssc_nlm_caller_name);
+		nsm_free_req(unmon);
+		return true;
+	}
+
+	LogDebug(COMPONENT_NLM, "Monitor %s", host->ssc_nlm_caller_name);
+
+	inc_nsm_client_ref(host);
+	host->ssc_nsm_queued = true;
+
+	req = gsh_calloc(1, sizeof(*req));
+	req->nr_op = NSM_OP_MON;
+	req->nr_host = host;
+	req->nr_name = host->ssc_nlm_caller_name;
+	nsm_enqueue(req);
+
+	PTHREAD_MUTEX_unlock(&nsm_mutex);
+	return true;
+}
+
+/**
+ * @brief Have statd stop monitoring a host that is going away
+ *
+ * The SM_UNMON is queued and sent in the background.
+ *
+ * @param[in] host The host, no longer referenced
+ *
+ * @return true unless the request could not be queued.
+ */
+
+bool nsm_unmonitor(state_nsm_client_t *host)
+{
+	struct nsm_req *req;
+
+	if (host == NULL)
+		return true;
+
+	if (!atomic_fetch_int32_t(&host->ssc_monitored))
+		return true;
+
+	PTHREAD_MUTEX_lock(&nsm_mutex);
+
 	atomic_store_int32_t(&host->ssc_monitored, false);
-	nsm_count--;
 
-	LogDebug(COMPONENT_NLM, "Unonitored %s for nodename %s",
-		 nsm_mon_id.mon_name, nodename);
+	/* A newer host of the same name is being monitored, statd must
+	 * keep it.
+	 */
+	if (nsm_find(host->ssc_nlm_caller_name, NSM_OP_MON, true) != NULL) {
+		PTHREAD_MUTEX_unlock(&nsm_mutex);
+		return true;
+	}
 
-	nsm_disconnect();
+	LogDebug(COMPONENT_NLM, "Unmonitor %s", host->ssc_nlm_caller_name);
+
+	req = gsh_calloc(1, sizeof(*req));
+	req->nr_op = NSM_OP_UNMON;
+	req->nr_name = gsh_strdup(host->ssc_nlm_caller_name);
+	nsm_enqueue(req);
 
 	PTHREAD_MUTEX_unlock(&nsm_mutex);
-	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 	return true;
 }
 
+/**
+ * @brief Clear statd's list of monitored hosts
+ *
+ * This is done once at startup, and nothing queued is sent before it
+ * has been.
+ */
+
 void nsm_unmonitor_all(void)
 {
 	enum clnt_stat ret;
 	struct sm_stat res;
 	struct my_id nsm_id;
 	struct timeval tout = { 25, 0 };
+	struct nsm_conn conn = { NULL, NULL, true };
 
 	nsm_id.my_prog = NLMPROG;
 	nsm_id.my_vers = NLM4_VERS;
 	nsm_id.my_proc = NLMPROC4_SM_NOTIFY;
 
 	PTHREAD_MUTEX_lock(&nsm_mutex);
+	if (!nsm_setup()) {
+		PTHREAD_MUTEX_unlock(&nsm_mutex);
+		return;
+	}
+	PTHREAD_MUTEX_unlock(&nsm_mutex);
 
 	/* create a connection to nsm on the localhost */
-	if (!nsm_connect()) {
+	if (!nsm_connect(&conn)) {
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor all clnt_create returned NULL");
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		return;
+		goto ready;
 	}
 
-	/* Set this after we call nsm_connect() */
 	nsm_id.my_name = nodename;
 
-	ret = clnt_call(nsm_clnt,
-			nsm_auth,
+	ret = clnt_call(conn.clnt,
+			conn.auth,
 			SM_UNMON_ALL,
 			(xdrproc_t) xdr_my_id,
 			&nsm_id,
@@ -272,9 +741,55 @@ void nsm_unmonitor_all(void)
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor all ret %d %s",
 			ret,
-			clnt_sperror(nsm_clnt, ""));
+			clnt_sperror(conn.clnt, ""));
+	}
+
+	nsm_disconnect(&conn);
+
+ ready:
+	PTHREAD_MUTEX_lock(&nsm_mutex);
+	nsm_ready = true;
+	while (nsm_workers < NSM_PIPELINE &&
+	       (unsigned int) nsm_workers < nsm_nready) {
+		int workers = nsm_workers;
+
+		nsm_kick();
+		if (nsm_workers == workers)
+			break;
 	}
+	PTHREAD_MUTEX_unlock(&nsm_mutex);
+}
+
+/**
+ * @brief Stop the NSM workers
+ *
+ * Requests still queued are dropped with the process.
+ */
+
+void nsm_shutdown(void)
+{
+	int rc;
+	int i;
 
-	nsm_disconnect();
+	if (nsm_fridge == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&nsm_mutex);
+	nsm_ready = false;
 	PTHREAD_MUTEX_unlock(&nsm_mutex);
+
+	rc = fridgethr_sync_command(nsm_fridge, fridgethr_comm_stop, 30);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NLM,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(nsm_fridge);
+		return;
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Failed shutting down NSM fridge: %d", rc);
+		return;
+	}
+
+	for (i = 0; i < NSM_PIPELINE; i++)
+		nsm_disconnect(&nsm_conns[i]);
 }
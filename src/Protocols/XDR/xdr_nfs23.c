@@ -5,6 +5,7 @@
 #include "config.h"
 #include "gsh_rpc.h"
 #include "nfs23.h"
+#include "gsh_iobuf.h"
 #include "nfs_fh.h"
 
 static struct nfs_request_lookahead dummy_lookahead = {
@@ -1264,7 +1265,7 @@ READ3resok *objp;
 		return (false);
 	if (!xdr_bool(xdrs, &objp->eof))
 		return (false);
-	if (!xdr_bytes
+	if (!xdr_iobuf
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 		return (false);
@@ -2369,7 +2370,11 @@ dirlistplus3 *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
-	if (!xdr_pointer
+	if (xdrs->x_op == XDR_ENCODE && objp->entries_xdr != NULL) {
+		if (!xdr_opaque(xdrs, objp->entries_xdr,
+				objp->entries_xdr_len))
+			return (false);
+	} else if (!xdr_pointer
 	    (xdrs, (char **)&objp->entries, sizeof(entryplus3),
 	     (xdrproc_t) xdr_entryplus3))
 		return (false);
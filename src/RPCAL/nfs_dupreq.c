@@ -47,6 +47,7 @@
 #include "nfs_dupreq.h"
 #include "city.h"
 #include "abstract_mem.h"
+#include "gsh_iobuf.h"
 #include "gsh_intrinsic.h"
 #include "wait_queue.h"
 
@@ -847,6 +848,8 @@ static inline void nfs_dupreq_free_dupreq(dupreq_entry_t *dv)
 		func->free_function(dv->res);
 		free_nfs_res(dv->res);
 	}
+	if (dv->enc)
+		nfs_reply_put(dv->enc);
 	PTHREAD_MUTEX_destroy(&dv->mtx);
 	pool_free(dupreq_pool, dv);
 }
@@ -1165,7 +1168,16 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 		goto out;
 
 	PTHREAD_MUTEX_lock(&dv->mtx);
-	dv->res = res_nfs;
+	if (dv->enc) {
+		/* The encoded reply is all a retransmission needs */
+		const nfs_function_desc_t *func = nfs_dupreq_func(dv);
+
+		func->free_function(res_nfs);
+		free_nfs_res(res_nfs);
+		dv->res = NULL;
+	} else {
+		dv->res = res_nfs;
+	}
 	dv->timestamp = time(NULL);
 	dv->state = DUPREQ_COMPLETE;
 	drc = dv->hin.drc;
@@ -1354,6 +1366,170 @@ void nfs_dupreq_rele(struct svc_req *req, const nfs_function_desc_t *func)
 		SVCAUTH_RELEASE(req->rq_auth, req);
 }
 
+/**
+ * @brief Encode a reply body into a buffer
+ *
+ * @param[in] proc XDR procedure for the reply
+ * @param[in] res  The reply
+ *
+ * @return The encoded reply, with one reference, or NULL if the
+ *         reply could not be encoded.
+ */
+struct nfs_encoded_reply *nfs_reply_encode(xdrproc_t proc, void *res)
+{
+	struct nfs_encoded_reply *enc;
+	u_int len = xdr_sizeof(proc, res);
+	XDR xdrs;
+	bool ok;
+
+	enc = gsh_malloc(sizeof(*enc) + len);
+
+	xdrmem_create(&xdrs, enc->data, len, XDR_ENCODE);
+	ok = proc(&xdrs, res);
+	enc->len = xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	if (!ok) {
+		LogDebug(COMPONENT_DUPREQ,
+			 "could not encode reply of %u bytes", len);
+		gsh_free(enc);
+		return NULL;
+	}
+
+	enc->refcount = 1;
+
+	return enc;
+}
+
+/**
+ * @brief Release a reference on an encoded reply
+ *
+ * @param[in] enc The encoded reply
+ */
+void nfs_reply_put(struct nfs_encoded_reply *enc)
+{
+	if (atomic_dec_int32_t(&enc->refcount) == 0)
+		gsh_free(enc);
+}
+
+static void nfs_reply_uio_release(struct xdr_uio *uio, u_int flags)
+{
+	if (--uio->uio_references != 0)
+		return;
+
+	nfs_reply_put(container_of((char *) uio->uio_vio[0].vio_base,
+				   struct nfs_encoded_reply, data[0]));
+	gsh_free(uio);
+}
+
+/**
+ * @brief XDR procedure sending an encoded reply body verbatim
+ *
+ * Where the transport can take it, the body is appended to the reply
+ * as its own iovec holding a reference on the encoded reply, so a
+ * retransmission costs no copy.  Otherwise, or when the reply is
+ * wrapped by RPCSEC_GSS, it is copied into the send buffer.
+ *
+ * Encoded replies are only ever sent, never decoded.
+ *
+ * @param[in] xdrs XDR stream
+ * @param[in] enc  The encoded reply
+ *
+ * @return true if successful.
+ */
+bool xdr_nfs_encoded_reply(XDR *xdrs, struct nfs_encoded_reply *enc)
+{
+	struct xdr_uio *uio;
+
+	switch (xdrs->x_op) {
+	case XDR_ENCODE:
+		break;
+	case XDR_FREE:
+		return true;
+	default:
+		return false;
+	}
+
+	if (!gsh_iobuf_zero_copy_ok(xdrs) || enc->len == 0)
+		return xdr_opaque(xdrs, enc->data, enc->len);
+
+	uio = gsh_calloc(1, sizeof(*uio) + sizeof(struct xdr_vio));
+	uio->uio_release = nfs_reply_uio_release;
+	uio->uio_count = 1;
+	uio->uio_references = 1;
+	uio->uio_vio[0].vio_base = (uint8_t *) enc->data;
+	uio->uio_vio[0].vio_head = (uint8_t *) enc->data;
+	uio->uio_vio[0].vio_tail = (uint8_t *) enc->data + enc->len;
+	uio->uio_vio[0].vio_wrap = (uint8_t *) enc->data + enc->len;
+
+	/* The transport's reference, dropped by nfs_reply_uio_release */
+	nfs_reply_get(enc);
+
+	if (!XDR_PUTBUFS(xdrs, uio, UIO_FLAG_NONE)) {
+		nfs_reply_uio_release(uio, UIO_FLAG_NONE);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Encode the reply of a request the DRC will keep
+ *
+ * If DRC_Encoded_Replies is set and the request has an entry in the
+ * DRC, the reply is encoded and attached to the entry.  The caller
+ * sends the encoded reply; nfs_dupreq_finish then frees the decoded
+ * one.
+ *
+ * @param[in] req  The request
+ * @param[in] func The function descriptor for this request type
+ * @param[in] res  The decoded reply
+ *
+ * @return The encoded reply to send, or NULL to send @c res.
+ */
+struct nfs_encoded_reply *nfs_dupreq_encode(struct svc_req *req,
+					    const nfs_function_desc_t *func,
+					    nfs_res_t *res)
+{
+	dupreq_entry_t *dv = (dupreq_entry_t *)req->rq_u1;
+	struct nfs_encoded_reply *enc;
+
+	if (!nfs_param.core_param.drc.encoded_replies ||
+	    dv == (void *)DUPREQ_NOCACHE ||
+	    dv == (void *)DUPREQ_BAD_ADDR1)
+		return NULL;
+
+	enc = nfs_reply_encode(func->xdr_encode_func, res);
+
+	if (enc != NULL) {
+		PTHREAD_MUTEX_lock(&dv->mtx);
+		dv->enc = enc;
+		PTHREAD_MUTEX_unlock(&dv->mtx);
+	}
+
+	return enc;
+}
+
+/**
+ * @brief Get the encoded reply of a request satisfied from the DRC
+ *
+ * Valid while the caller holds the call path reference taken by
+ * nfs_dupreq_start.
+ *
+ * @param[in] req The request
+ *
+ * @return The encoded reply, or NULL if the DRC kept the decoded one.
+ */
+struct nfs_encoded_reply *nfs_dupreq_encoded(struct svc_req *req)
+{
+	dupreq_entry_t *dv = (dupreq_entry_t *)req->rq_u1;
+
+	if (dv == (void *)DUPREQ_NOCACHE || dv == (void *)DUPREQ_BAD_ADDR1)
+		return NULL;
+
+	return dv->enc;
+}
+
 /**
  * @brief Shutdown the dupreq2 package.
  */
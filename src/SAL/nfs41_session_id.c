@@ -36,6 +36,7 @@
 
 #include "config.h"
 #include "nfs_core.h"
+#include "nfs_proto_functions.h"
 #include "sal_functions.h"
 
 /**
@@ -43,6 +44,11 @@
  */
 pool_t *nfs41_session_pool = NULL;
 
+/**
+ * @brief Memory held by cached replies in all session slots
+ */
+uint64_t nfs41_session_cache_size;
+
 /**
  * @param Session ID hash
  */
@@ -189,7 +195,7 @@ static hash_parameter_t session_id_param = {
 	.compare_key = compare_session_id,
 	.key_to_str = display_session_id_key,
 	.val_to_str = display_session_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU,
 };
 
 /**
@@ -231,6 +237,73 @@ void nfs41_Build_sessionid(clientid4 *clientid, char *sessionid)
 	memcpy(sessionid + sizeof(clientid4), &seq, sizeof(seq));
 }
 
+/**
+ * @brief Release the cached replies of slots the client is not using
+ *
+ * The client reports in SEQUENCE the highest slot it has in use.
+ * Replies cached in slots above it can no longer be replayed, so
+ * give their memory back.
+ *
+ * @param[in] session Session to trim
+ * @param[in] highest Highest slot the client is using
+ */
+
+void nfs41_Session_Release_Slots(nfs41_session_t *session, slotid4 highest)
+{
+	slotid4 i;
+
+	for (i = highest + 1;
+	     i < session->fore_channel_attrs.ca_maxrequests; i++) {
+		nfs41_session_slot_t *slot = &session->slots[i];
+
+		PTHREAD_MUTEX_lock(&slot->lock);
+		nfs4_Compound_FreeCached(&slot->cached_result);
+		slot->cache_used = false;
+		PTHREAD_MUTEX_unlock(&slot->lock);
+	}
+}
+
+/**
+ * @brief Check whether cached replies are over their memory budget
+ *
+ * @retval true if Session_Reply_Cache_Size is exceeded.
+ * @retval false otherwise.
+ */
+
+bool nfs41_Session_Cache_Full(void)
+{
+	return atomic_fetch_uint64_t(&nfs41_session_cache_size) >
+	       nfs_param.nfsv4_param.session_reply_cache_size;
+}
+
+/**
+ * @brief Compute the target highest slot ID to return in SEQUENCE
+ *
+ * While the reply cache is within its budget, the client may use all
+ * the slots negotiated at CREATE_SESSION.  Past it, the slot count is
+ * scaled down in proportion to the overshoot, so that clients with
+ * many slots give back the most.
+ *
+ * @param[in] session Session the SEQUENCE is on
+ *
+ * @return The target highest slot ID.
+ */
+
+slotid4 nfs41_Session_Target_Slotid(nfs41_session_t *session)
+{
+	uint64_t budget = nfs_param.nfsv4_param.session_reply_cache_size;
+	uint64_t used = atomic_fetch_uint64_t(&nfs41_session_cache_size);
+	uint64_t nb_slots = session->fore_channel_attrs.ca_maxrequests;
+
+	if (used > budget) {
+		nb_slots = nb_slots * budget / used;
+		if (nb_slots == 0)
+			nb_slots = 1;
+	}
+
+	return nb_slots - 1;
+}
+
 int32_t inc_session_ref(nfs41_session_t *session)
 {
 	int32_t refcnt = atomic_inc_int32_t(&session->refcount);
@@ -254,8 +327,14 @@ int32_t dec_session_ref(nfs41_session_t *session)
 		dec_client_id_ref(session->clientid_record);
 		/* Destroy this session's mutexes and condition variable */
 
-		for (i = 0; i < NFS41_NB_SLOTS; i++)
+		for (i = 0; i < session->fore_channel_attrs.ca_maxrequests;
+		     i++) {
+			nfs4_Compound_FreeCached(
+				&session->slots[i].cached_result);
 			PTHREAD_MUTEX_destroy(&session->slots[i].lock);
+		}
+
+		gsh_free(session->slots);
 
 		PTHREAD_COND_destroy(&session->cb_cond);
 		PTHREAD_MUTEX_destroy(&session->cb_mutex);
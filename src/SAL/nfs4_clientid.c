@@ -46,6 +46,7 @@
 #include "nfs4.h"
 #include "fsal.h"
 #include "sal_functions.h"
+#include "nfs_proto_functions.h"
 #include "abstract_atomic.h"
 #include "city.h"
 #include "client_mgr.h"
@@ -338,6 +339,10 @@ void free_client_id(nfs_client_id_t *clientid)
 							       session_link);
 			nfs41_Session_Del(session->session_id);
 		}
+
+		/* Release the cached CREATE_SESSION reply */
+		nfs4_Compound_FreeCached(
+			&clientid->cid_create_session_slot.cached_result);
 	}
 
 	if (clientid->cid_recov_dir) {
@@ -1100,7 +1105,7 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	}
 
 	if (clientid->cid_recov_dir != NULL && !make_stale) {
-		nfs4_rm_clid(clientid->cid_recov_dir, v4_recov_dir, 0);
+		nfs4_rm_clid(clientid);
 		gsh_free(clientid->cid_recov_dir);
 		clientid->cid_recov_dir = NULL;
 	}
@@ -1242,7 +1247,7 @@ static hash_parameter_t cid_confirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Confirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -1255,7 +1260,7 @@ static hash_parameter_t cid_unconfirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Unconfirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -41,20 +41,275 @@
 #include "bsd-base64.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "city.h"
 
 #define NFS_V4_RECOV_DIR "v4recov"
 #define NFS_V4_OLD_DIR "v4old"
 
-char v4_recov_dir[PATH_MAX];
-char v4_old_dir[PATH_MAX];
+/** Smallest number of chains in a clid_table */
+#define CLID_TABLE_MIN_SIZE 64
+
+static char v4_recov_dir[PATH_MAX];
+static char v4_old_dir[PATH_MAX];
 time_t current_grace;
 pthread_mutex_t grace_mutex = PTHREAD_MUTEX_INITIALIZER;        /*< Mutex */
-struct glist_head clid_list = GLIST_HEAD_INIT(clid_list);  /*< Clients */
+static struct clid_table reclaim_clids;	/*< Clients that may reclaim */
+static struct nfs4_recovery_backend *recovery_backend = &fs_recovery_backend;
 
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp);
 static void nfs_release_nlm_state(char *release_ip);
 static void nfs_release_v4_client(char *ip);
 
+/**
+ * @brief Initialize an empty table of client entries
+ *
+ * @param[in] tbl The table
+ */
+void clid_table_init(struct clid_table *tbl)
+{
+	tbl->buckets = NULL;
+	tbl->size = 0;
+	tbl->count = 0;
+}
+
+static void clid_table_grow(struct clid_table *tbl)
+{
+	uint32_t size = tbl->size != 0 ? tbl->size * 2 : CLID_TABLE_MIN_SIZE;
+	struct glist_head *buckets = gsh_malloc(size * sizeof(*buckets));
+	struct glist_head *node, *noden;
+	clid_entry_t *clid_ent;
+	uint32_t ix;
+
+	for (ix = 0; ix < size; ix++)
+		glist_init(&buckets[ix]);
+
+	for (ix = 0; ix < tbl->size; ix++) {
+		glist_for_each_safe(node, noden, &tbl->buckets[ix]) {
+			clid_ent = glist_entry(node, clid_entry_t, cl_list);
+			glist_del(&clid_ent->cl_list);
+			glist_add_tail(&buckets[clid_ent->cl_hash & (size - 1)],
+				       &clid_ent->cl_list);
+		}
+	}
+
+	gsh_free(tbl->buckets);
+	tbl->buckets = buckets;
+	tbl->size = size;
+}
+
+/**
+ * @brief Find a client entry by name
+ *
+ * @param[in] tbl  The table
+ * @param[in] name Client name
+ *
+ * @return The entry, or NULL if there is none.
+ */
+clid_entry_t *clid_table_lookup(struct clid_table *tbl, const char *name)
+{
+	struct glist_head *node;
+	clid_entry_t *clid_ent;
+	uint64_t hash;
+
+	if (tbl->count == 0)
+		return NULL;
+
+	hash = CityHash64(name, strlen(name));
+
+	glist_for_each(node, &tbl->buckets[hash & (tbl->size - 1)]) {
+		clid_ent = glist_entry(node, clid_entry_t, cl_list);
+		if (clid_ent->cl_hash == hash &&
+		    strcmp(clid_ent->cl_name, name) == 0)
+			return clid_ent;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Add a client entry
+ *
+ * The caller must know there is no entry of that name already.
+ *
+ * @param[in] tbl  The table
+ * @param[in] name Client name
+ *
+ * @return The new entry, with no revoked handles.
+ */
+clid_entry_t *clid_table_add(struct clid_table *tbl, const char *name)
+{
+	size_t len = strlen(name);
+	clid_entry_t *clid_ent;
+
+	if (tbl->count >= tbl->size)
+		clid_table_grow(tbl);
+
+	clid_ent = gsh_malloc(sizeof(*clid_ent) + len + 1);
+	glist_init(&clid_ent->cl_rfh_list);
+	clid_ent->cl_hash = CityHash64(name, len);
+	memcpy(clid_ent->cl_name, name, len + 1);
+
+	glist_add_tail(&tbl->buckets[clid_ent->cl_hash & (tbl->size - 1)],
+		       &clid_ent->cl_list);
+	tbl->count++;
+
+	return clid_ent;
+}
+
+/**
+ * @brief Remove and free a client entry and its revoked handles
+ *
+ * @param[in] tbl      The table
+ * @param[in] clid_ent The entry
+ */
+void clid_table_del(struct clid_table *tbl, clid_entry_t *clid_ent)
+{
+	rdel_fh_t *rfh_entry;
+
+	glist_del(&clid_ent->cl_list);
+	tbl->count--;
+
+	while ((rfh_entry = glist_first_entry(&clid_ent->cl_rfh_list,
+					      rdel_fh_t,
+					      rdfh_list)) != NULL) {
+		glist_del(&rfh_entry->rdfh_list);
+		gsh_free(rfh_entry->rdfh_handle_str);
+		gsh_free(rfh_entry);
+	}
+
+	gsh_free(clid_ent);
+}
+
+/**
+ * @brief Remove and free all entries of a table
+ *
+ * @param[in] tbl The table
+ */
+void clid_table_clear(struct clid_table *tbl)
+{
+	clid_entry_t *clid_ent;
+	uint32_t ix;
+
+	for (ix = 0; ix < tbl->size; ix++) {
+		while ((clid_ent = glist_first_entry(&tbl->buckets[ix],
+						     clid_entry_t,
+						     cl_list)) != NULL)
+			clid_table_del(tbl, clid_ent);
+	}
+
+	gsh_free(tbl->buckets);
+	clid_table_init(tbl);
+}
+
+/**
+ * @brief Check whether a revoked handle is recorded for a client
+ *
+ * @param[in] clid_ent Client entry
+ * @param[in] rfh_str  Handle, base64url encoded
+ */
+bool clid_entry_has_rfh(clid_entry_t *clid_ent, const char *rfh_str)
+{
+	struct glist_head *node;
+	rdel_fh_t *rfh_entry;
+
+	glist_for_each(node, &clid_ent->cl_rfh_list) {
+		rfh_entry = glist_entry(node, rdel_fh_t, rdfh_list);
+		if (strcmp(rfh_str, rfh_entry->rdfh_handle_str) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Record a revoked handle for a client
+ *
+ * @param[in] clid_ent Client entry
+ * @param[in] rfh_str  Handle, base64url encoded
+ */
+void clid_entry_add_rfh(clid_entry_t *clid_ent, const char *rfh_str)
+{
+	rdel_fh_t *new_ent = gsh_malloc(sizeof(rdel_fh_t));
+
+	new_ent->rdfh_handle_str = gsh_strdup(rfh_str);
+	glist_add(&clid_ent->cl_rfh_list, &new_ent->rdfh_list);
+	LogFullDebug(COMPONENT_CLIENTID,
+		"revoked handle: %s",
+		new_ent->rdfh_handle_str);
+}
+
+/**
+ * @brief Allow a client to reclaim
+ *
+ * Called by the recovery backend from recovery_read_clids.
+ *
+ * @param[in] cl_name Client name
+ *
+ * @return The client's entry, to add revoked handles to.
+ */
+clid_entry_t *nfs4_add_clid_entry(const char *cl_name)
+{
+	clid_entry_t *clid_ent = clid_table_lookup(&reclaim_clids, cl_name);
+
+	if (clid_ent == NULL) {
+		clid_ent = clid_table_add(&reclaim_clids, cl_name);
+		LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
+			 clid_ent->cl_name);
+	}
+
+	return clid_ent;
+}
+
+/**
+ * @brief Set up stable storage for recovery
+ *
+ * Picks the backend selected by RecoveryBackend.  This needs to be
+ * done before the recovery thread is started.
+ */
+void nfs4_recovery_init(void)
+{
+	if (nfs_param.nfsv4_param.recovery_backend == RECOVERY_BACKEND_LOG)
+		recovery_backend = &log_recovery_backend;
+	else
+		recovery_backend = &fs_recovery_backend;
+
+	clid_table_init(&reclaim_clids);
+	recovery_backend->recovery_init();
+}
+
+/**
+ * @brief Release stable storage at shutdown
+ */
+void nfs4_recovery_shutdown(void)
+{
+	recovery_backend->recovery_shutdown();
+
+	PTHREAD_MUTEX_lock(&grace_mutex);
+	clid_table_clear(&reclaim_clids);
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
+/**
+ * @brief Forget the clients of the previous instance
+ *
+ * Called once the grace period is over.
+ */
+void nfs4_recovery_cleanup(void)
+{
+	PTHREAD_MUTEX_lock(&grace_mutex);
+	recovery_backend->recovery_cleanup();
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
+/**
+ * @brief Periodic housekeeping of stable storage
+ */
+void nfs4_recovery_maintain(void)
+{
+	if (recovery_backend->recovery_maintain != NULL)
+		recovery_backend->recovery_maintain();
+}
+
 /**
  * @brief Start grace period
  *
@@ -241,21 +496,32 @@ void nfs4_create_clid_name(nfs_client_record_t *cl_rec,
 }
 
 /**
- * @brief Create an entry in the recovery directory
+ * @brief Record a client on stable storage
  *
- * This entry alows the client to reclaim state after a server
+ * The record alows the client to reclaim state after a server
  * reboot/restart.
  *
  * @param[in] clientid Client record
  */
 void nfs4_add_clid(nfs_client_id_t *clientid)
+{
+	nfs4_create_clid_name(clientid->cid_client_record, clientid);
+
+	if (clientid->cid_recov_dir != NULL)
+		recovery_backend->add_clid(clientid);
+}
+
+/**
+ * @brief Create an entry in the recovery directory
+ *
+ * @param[in] clientid Client record
+ */
+static void fs_add_clid(nfs_client_id_t *clientid)
 {
 	int err = 0;
 	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
 	int length, position = 0;
 
-	nfs4_create_clid_name(clientid->cid_client_record, clientid);
-
 	/* break clientid down if it is greater than max dir name */
 	/* and create a directory hierachy to represent the clientid. */
 	snprintf(path, sizeof(path), "%s", v4_recov_dir);
@@ -332,13 +598,27 @@ void nfs4_rm_revoked_handles(char *path)
 }
 
 /**
- * @brief Remove a client entry from the recovery directory
+ * @brief Remove a client from stable storage
  *
  * This function would be called when a client expires.
  *
- * @param[in] recov_dir Recovery directory
+ * @param[in] clientid Client record
+ */
+void nfs4_rm_clid(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_recov_dir != NULL)
+		recovery_backend->rm_clid(clientid);
+}
+
+/**
+ * @brief Remove a client entry from the recovery directory
+ *
+ * @param[in] recov_dir   Client name
+ * @param[in] parent_path Directory holding the rest of the name
+ * @param[in] position    Length of the name already consumed
  */
-void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
+static void fs_rm_clid_impl(const char *recov_dir, char *parent_path,
+			    int position)
 {
 	int err;
 	char *path;
@@ -377,7 +657,7 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	/* recursively remove the directory hirerchy which represent the
 	 *clientid
 	 */
-	nfs4_rm_clid(recov_dir, path, position+segment_len);
+	fs_rm_clid_impl(recov_dir, path, position+segment_len);
 
 	err = rmdir(path);
 	if (err == -1) {
@@ -390,6 +670,11 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	gsh_free(path);
 }
 
+static void fs_rm_clid(nfs_client_id_t *clientid)
+{
+	fs_rm_clid_impl(clientid->cid_recov_dir, v4_recov_dir, 0);
+}
+
 /**
  * @brief Determine whether or not this client may reclaim state
  *
@@ -399,7 +684,6 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
  */
 void  nfs4_chk_clid_impl(nfs_client_id_t *clientid, clid_entry_t **clid_ent_arg)
 {
-	struct glist_head *node;
 	clid_entry_t *clid_ent;
 	*clid_ent_arg = NULL;
 
@@ -407,38 +691,23 @@ void  nfs4_chk_clid_impl(nfs_client_id_t *clientid, clid_entry_t **clid_ent_arg)
 	if (clientid->cid_recov_dir == NULL)
 		return;
 
-	/* If there were no clients at time of restart, we're done */
-	if (glist_empty(&clid_list))
+	/* Only clients known at the time of restart may reclaim */
+	clid_ent = clid_table_lookup(&reclaim_clids, clientid->cid_recov_dir);
+	if (clid_ent == NULL)
 		return;
 
-	/*
-	 * loop through the list and try to find this client.  if we
-	 * find it, mark it to allow reclaims.  perhaps the client should
-	 * be removed from the list at this point to make the list shorter?
-	 */
-	glist_for_each(node, &clid_list) {
-		clid_ent = glist_entry(node, clid_entry_t, cl_list);
-		LogDebug(COMPONENT_CLIENTID, "compare %s to %s",
-			 clid_ent->cl_name, clientid->cid_recov_dir);
-		if (!strncmp(clid_ent->cl_name,
-			     clientid->cid_recov_dir,
-			     PATH_MAX)) {
-			if (isDebug(COMPONENT_CLIENTID)) {
-				char str[LOG_BUFF_LEN] = "\0";
-				struct display_buffer dspbuf = {
-					sizeof(str), str, str};
-
-				display_client_id_rec(&dspbuf, clientid);
-
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Allowed to reclaim ClientId %s",
-					     str);
-			}
-			clientid->cid_allow_reclaim = 1;
-			*clid_ent_arg = clid_ent;
-			return;
-		}
+	if (isDebug(COMPONENT_CLIENTID)) {
+		char str[LOG_BUFF_LEN] = "\0";
+		struct display_buffer dspbuf = {sizeof(str), str, str};
+
+		display_client_id_rec(&dspbuf, clientid);
+
+		LogFullDebug(COMPONENT_CLIENTID,
+			     "Allowed to reclaim ClientId %s",
+			     str);
 	}
+	clientid->cid_allow_reclaim = 1;
+	*clid_ent_arg = clid_ent;
 }
 
 void  nfs4_chk_clid(nfs_client_id_t *clientid)
@@ -486,9 +755,6 @@ void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
 {
 	struct dirent *dentp;
 	DIR *dp;
-	rdel_fh_t *new_ent;
-
-	glist_init(&clid_ent->cl_rfh_list);
 	/* Read the contents from recov dir of this clientid. */
 	dp = opendir(path);
 	if (dp == NULL) {
@@ -525,15 +791,9 @@ void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
 			}
 		}
 
-		new_ent = gsh_malloc(sizeof(rdel_fh_t));
-
 		/* Ignore the beginning \x1 and copy the rest (file handle) */
-		new_ent->rdfh_handle_str = gsh_strdup(dentp->d_name+1);
-
-		glist_add(&clid_ent->cl_rfh_list, &new_ent->rdfh_list);
-		LogFullDebug(COMPONENT_CLIENTID,
-			"revoked handle: %s",
-			new_ent->rdfh_handle_str);
+		if (!clid_entry_has_rfh(clid_ent, dentp->d_name + 1))
+			clid_entry_add_rfh(clid_ent, dentp->d_name + 1);
 
 		/* Since the handle is loaded into memory, go ahead and
 		 * delete it from the stable storage.
@@ -735,18 +995,12 @@ static int nfs4_read_recov_clids(DIR *dp,
 			cid_len = atoi(temp);
 			len = strlen(ptr2);
 			if ((len == (cid_len+2)) && (ptr2[len-1] == ')')) {
-				new_ent = gsh_malloc(sizeof(clid_entry_t));
+				new_ent = nfs4_add_clid_entry(build_clid);
 
 				nfs4_cp_pop_revoked_delegs(new_ent,
 							path,
 							tgtdir,
 							!takeover);
-				strcpy(new_ent->cl_name, build_clid);
-				glist_add(&clid_list,
-					  &new_ent->cl_list);
-				LogDebug(COMPONENT_CLIENTID,
-					 "added %s to clid list",
-					 new_ent->cl_name);
 			}
 		}
 		gsh_free(build_clid);
@@ -773,23 +1027,28 @@ static int nfs4_read_recov_clids(DIR *dp,
  * @param[in] nodeid Node, on takeover
  */
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
+{
+	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
+
+	/* when not doing a takeover, start with an empty list */
+	if (gsp == NULL)
+		clid_table_clear(&reclaim_clids);
+
+	recovery_backend->recovery_read_clids(gsp);
+}
+
+/**
+ * @brief Read the clients from the recovery directories
+ *
+ * @param[in] gsp Grace period start information, on takeover
+ */
+static void fs_read_clids(nfs_grace_start_t *gsp)
 {
 	DIR *dp;
-	struct clid_entry *clid_entry;
 	int rc;
 	char path[PATH_MAX];
 
-	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
-
 	if (gsp == NULL) {
-		/* when not doing a takeover, start with an empty list */
-		while ((clid_entry = glist_first_entry(&clid_list,
-						       struct clid_entry,
-						       cl_list)) != NULL) {
-			glist_del(&clid_entry->cl_list);
-			gsh_free(clid_entry);
-		}
-
 		dp = opendir(v4_old_dir);
 		if (dp == NULL) {
 			LogEvent(COMPONENT_CLIENTID,
@@ -892,7 +1151,7 @@ void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
 /**
  * @brief Clean up recovery directory
  */
-void nfs4_clean_old_recov_dir(char *parent_path)
+static void fs_clean_old_recov_dir(char *parent_path)
 {
 	DIR *dp;
 	struct dirent *dentp;
@@ -938,7 +1197,7 @@ void nfs4_clean_old_recov_dir(char *parent_path)
 
 		snprintf(path, total_len, "%s/%s", parent_path, dentp->d_name);
 
-		nfs4_clean_old_recov_dir(path);
+		fs_clean_old_recov_dir(path);
 		rc = rmdir(path);
 		if (rc == -1) {
 			LogEvent(COMPONENT_CLIENTID,
@@ -956,7 +1215,7 @@ void nfs4_clean_old_recov_dir(char *parent_path)
  * should only need to be done once (if at all).  Also, the location
  * of the directory could be configurable.
  */
-void nfs4_create_recov_dir(void)
+static void fs_create_recov_dir(void)
 {
 	int err;
 
@@ -1016,9 +1275,6 @@ void nfs4_create_recov_dir(void)
 void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 {
 	char rhdlstr[NAME_MAX];
-	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
-	int length, position = 0;
-	int fd;
 	int retval;
 
 	/* Convert nfs_fh4_val into base64 encoded string */
@@ -1043,9 +1299,24 @@ void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 	}
 	PTHREAD_MUTEX_unlock(&delr_clid->cid_mutex);
 
-	/* Parse through the clientid directory structure */
 	assert(delr_clid->cid_recov_dir != NULL);
 
+	recovery_backend->add_revoke_fh(delr_clid, rhdlstr);
+}
+
+/**
+ * @brief Record revoked filehandle in the client's recovery directory
+ *
+ * @param[in] delr_clid Client record
+ * @param[in] rhdlstr   Handle, base64url encoded
+ */
+static void fs_add_revoke_fh(nfs_client_id_t *delr_clid, const char *rhdlstr)
+{
+	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
+	int length, position = 0;
+	int fd;
+
+	/* Parse through the clientid directory structure */
 	snprintf(path, sizeof(path), "%s", v4_recov_dir);
 	length = strlen(delr_clid->cid_recov_dir);
 	while (position < length) {
@@ -1084,8 +1355,6 @@ void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 bool nfs4_check_deleg_reclaim(nfs_client_id_t *clid, nfs_fh4 *fhandle)
 {
 	char rhdlstr[NAME_MAX];
-	struct glist_head *node;
-	rdel_fh_t *rfh_entry;
 	clid_entry_t *clid_ent;
 	int retval;
 
@@ -1105,16 +1374,12 @@ bool nfs4_check_deleg_reclaim(nfs_client_id_t *clid, nfs_fh4 *fhandle)
 		return true;
 	}
 
-	glist_for_each(node, &clid_ent->cl_rfh_list) {
-		rfh_entry = glist_entry(node, rdel_fh_t, rdfh_list);
-		assert(rfh_entry != NULL);
-		if (!strcmp(rhdlstr, rfh_entry->rdfh_handle_str)) {
-			PTHREAD_MUTEX_unlock(&grace_mutex);
-			LogFullDebug(COMPONENT_CLIENTID,
-				"Can't reclaim revoked fh:%s",
-				rfh_entry->rdfh_handle_str);
-			return false;
-		}
+	if (clid_entry_has_rfh(clid_ent, rhdlstr)) {
+		PTHREAD_MUTEX_unlock(&grace_mutex);
+		LogFullDebug(COMPONENT_CLIENTID,
+			"Can't reclaim revoked fh:%s",
+			rhdlstr);
+		return false;
 	}
 
 	PTHREAD_MUTEX_unlock(&grace_mutex);
@@ -1122,6 +1387,25 @@ bool nfs4_check_deleg_reclaim(nfs_client_id_t *clid, nfs_fh4 *fhandle)
 	return true;
 }
 
+static void fs_recovery_shutdown(void)
+{
+}
+
+static void fs_recovery_cleanup(void)
+{
+	fs_clean_old_recov_dir(v4_old_dir);
+}
+
+struct nfs4_recovery_backend fs_recovery_backend = {
+	.recovery_init = fs_create_recov_dir,
+	.recovery_shutdown = fs_recovery_shutdown,
+	.recovery_read_clids = fs_read_clids,
+	.recovery_cleanup = fs_recovery_cleanup,
+	.add_clid = fs_add_clid,
+	.rm_clid = fs_rm_clid,
+	.add_revoke_fh = fs_add_revoke_fh,
+};
+
 
 #ifdef _USE_NLM
 /**
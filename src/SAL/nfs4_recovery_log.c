@@ -0,0 +1,847 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file nfs4_recovery_log.c
+ * @brief NFSv4 recovery records in an append-only log
+ *
+ * Each change to the set of clients is appended to a single file as a
+ * checksummed record, and the file is fsynced before the change is
+ * acknowledged.  Callers that arrive while an fsync is in progress
+ * wait for the next one, which covers all of them.  Replaying the file
+ * at startup rebuilds the set; a torn or corrupt record ends the replay
+ * and is cut off.
+ *
+ * The set is kept in two hash tables, mirroring the two directories of
+ * the fs backend: the clients of the previous instance ("old"), which
+ * may reclaim during grace, and the clients of this one.  At startup
+ * both become "old"; after grace the old ones are dropped.  Whenever
+ * more than half the file is stale it is rewritten with just the live
+ * records and renamed over the old one.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include "city.h"
+#include "fsal.h"
+
+#define RECOV_LOG_MAGIC 0x4e34524c	/* "N4RL" */
+#define RECOV_LOG_NAME "v4recov.log"
+#define RECOV_LOG_DIR "v4recov"
+
+/** Stale bytes needed before the log is compacted */
+#define RECOV_LOG_COMPACT_MIN (64 * 1024)
+
+/** Bytes gathered before a write while compacting */
+#define RECOV_LOG_BUF_SIZE (64 * 1024)
+
+enum recov_log_type {
+	RECOV_LOG_ADD = 1,	/*< Client of this instance */
+	RECOV_LOG_RM,		/*< Client of this instance went away */
+	RECOV_LOG_REVOKE,	/*< Delegation revoked from a client */
+	RECOV_LOG_OLD,		/*< Client of the previous instance */
+	RECOV_LOG_OLD_REVOKE,	/*< Delegation revoked from one of those */
+};
+
+/**
+ * @brief Record header
+ *
+ * Followed by the client name and, for revokes, the handle, neither
+ * NUL terminated, padded to 8 bytes.  The checksum covers the whole
+ * record with the checksum field zeroed.
+ */
+struct recov_log_hdr {
+	uint32_t magic;		/*< RECOV_LOG_MAGIC */
+	uint16_t type;		/*< enum recov_log_type */
+	uint16_t name_len;	/*< Length of the client name */
+	uint32_t data_len;	/*< Length of the handle */
+	uint32_t reserved;
+	uint64_t checksum;	/*< CityHash64 of the record */
+};
+
+/**
+ * @brief Records being gathered for a write
+ */
+struct recov_log_buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+static pthread_mutex_t recov_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t recov_log_cond = PTHREAD_COND_INITIALIZER;
+
+/* All protected by recov_log_mutex */
+static int recov_log_fd = -1;
+static char recov_log_path[PATH_MAX];
+static char recov_log_dir[PATH_MAX];
+static struct clid_table recov_log_cur;	/*< Clients of this instance */
+static struct clid_table recov_log_old;	/*< Clients of the previous one */
+static uint64_t recov_log_size;		/*< Bytes in the file */
+static uint64_t recov_log_live;		/*< Of those, bytes still needed */
+static uint64_t recov_log_seq;		/*< Bytes ever appended */
+static uint64_t recov_log_synced;	/*< Of those, bytes known durable */
+static bool recov_log_syncing;		/*< An fsync is in progress */
+
+static inline size_t recov_log_rec_size(size_t name_len, size_t data_len)
+{
+	return (sizeof(struct recov_log_hdr) + name_len + data_len + 7) &
+	       ~(size_t) 7;
+}
+
+/* Bytes of the records describing an entry */
+static size_t recov_log_ent_size(clid_entry_t *clid_ent)
+{
+	size_t name_len = strlen(clid_ent->cl_name);
+	size_t size = recov_log_rec_size(name_len, 0);
+	struct glist_head *node;
+	rdel_fh_t *rfh_entry;
+
+	glist_for_each(node, &clid_ent->cl_rfh_list) {
+		rfh_entry = glist_entry(node, rdel_fh_t, rdfh_list);
+		size += recov_log_rec_size(name_len,
+					   strlen(rfh_entry->rdfh_handle_str));
+	}
+
+	return size;
+}
+
+static size_t recov_log_table_size(struct clid_table *tbl)
+{
+	struct glist_head *node;
+	size_t size = 0;
+	uint32_t ix;
+
+	for (ix = 0; ix < tbl->size; ix++)
+		glist_for_each(node, &tbl->buckets[ix])
+			size += recov_log_ent_size(glist_entry(node,
+							       clid_entry_t,
+							       cl_list));
+
+	return size;
+}
+
+/**
+ * @brief Add a record to a buffer
+ *
+ * @param[in,out] buf  The buffer
+ * @param[in]     type Record type
+ * @param[in]     name Client name
+ * @param[in]     data Revoked handle, or NULL
+ */
+static void recov_log_put(struct recov_log_buf *buf, uint16_t type,
+			  const char *name, const char *data)
+{
+	size_t name_len = strlen(name);
+	size_t data_len = data != NULL ? strlen(data) : 0;
+	size_t len = recov_log_rec_size(name_len, data_len);
+	struct recov_log_hdr *hdr;
+	char *rec;
+
+	if (buf->len + len > buf->size) {
+		buf->size = MAX(buf->size * 2, buf->len + len);
+		buf->data = gsh_realloc(buf->data, buf->size);
+	}
+
+	rec = buf->data + buf->len;
+	memset(rec, 0, len);
+
+	hdr = (struct recov_log_hdr *) rec;
+	hdr->magic = RECOV_LOG_MAGIC;
+	hdr->type = type;
+	hdr->name_len = name_len;
+	hdr->data_len = data_len;
+	memcpy(rec + sizeof(*hdr), name, name_len);
+	if (data_len != 0)
+		memcpy(rec + sizeof(*hdr) + name_len, data, data_len);
+	hdr->checksum = CityHash64(rec, len);
+
+	buf->len += len;
+}
+
+static int recov_log_write(int fd, struct recov_log_buf *buf)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < buf->len) {
+		n = write(fd, buf->data + done, buf->len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		done += n;
+	}
+
+	buf->len = 0;
+	return 0;
+}
+
+/**
+ * @brief Append a record to the log
+ *
+ * Called with recov_log_mutex held.  The record is durable once
+ * recov_log_commit returns.
+ *
+ * @param[in] type Record type
+ * @param[in] name Client name
+ * @param[in] data Revoked handle, or NULL
+ * @param[in] live Whether the record stays needed
+ */
+static void recov_log_append(uint16_t type, const char *name,
+			     const char *data, bool live)
+{
+	struct recov_log_buf buf = {NULL, 0, 0};
+	size_t len;
+	int rc;
+
+	if (recov_log_fd < 0)
+		return;
+
+	recov_log_put(&buf, type, name, data);
+	len = buf.len;
+
+	rc = recov_log_write(recov_log_fd, &buf);
+	gsh_free(buf.data);
+
+	if (rc != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to append to recovery log %s, errno=%d",
+			recov_log_path, rc);
+		return;
+	}
+
+	recov_log_size += len;
+	recov_log_seq += len;
+	if (live)
+		recov_log_live += len;
+}
+
+/**
+ * @brief Wait until everything appended so far is durable
+ *
+ * Called with recov_log_mutex held, which is dropped while syncing.
+ * One caller syncs on behalf of all those that appended before it
+ * started; the others wait for it.
+ */
+static void recov_log_commit(void)
+{
+	uint64_t target = recov_log_seq, upto;
+	int fd, rc;
+
+	while (recov_log_synced < target) {
+		if (recov_log_syncing) {
+			pthread_cond_wait(&recov_log_cond, &recov_log_mutex);
+			continue;
+		}
+
+		recov_log_syncing = true;
+		upto = recov_log_seq;
+		fd = recov_log_fd;
+
+		PTHREAD_MUTEX_unlock(&recov_log_mutex);
+
+		rc = fd >= 0 ? fdatasync(fd) : 0;
+		if (rc != 0)
+			LogCrit(COMPONENT_CLIENTID,
+				"Failed to sync recovery log %s, errno=%d",
+				recov_log_path, errno);
+
+		PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+		recov_log_synced = upto;
+		recov_log_syncing = false;
+		pthread_cond_broadcast(&recov_log_cond);
+	}
+}
+
+static void recov_log_apply(uint16_t type, const char *name,
+			    const char *data, struct clid_table *cur,
+			    struct clid_table *old)
+{
+	struct clid_table *tbl = cur;
+	clid_entry_t *clid_ent;
+
+	switch (type) {
+	case RECOV_LOG_OLD:
+		tbl = old;
+		/* fall through */
+	case RECOV_LOG_ADD:
+		if (clid_table_lookup(tbl, name) == NULL)
+			(void) clid_table_add(tbl, name);
+		break;
+
+	case RECOV_LOG_RM:
+		clid_ent = clid_table_lookup(cur, name);
+		if (clid_ent != NULL)
+			clid_table_del(cur, clid_ent);
+		break;
+
+	case RECOV_LOG_OLD_REVOKE:
+		tbl = old;
+		/* fall through */
+	case RECOV_LOG_REVOKE:
+		clid_ent = clid_table_lookup(tbl, name);
+		if (clid_ent != NULL && !clid_entry_has_rfh(clid_ent, data))
+			clid_entry_add_rfh(clid_ent, data);
+		break;
+
+	default:
+		LogEvent(COMPONENT_CLIENTID,
+			 "Unknown recovery log record type %u for %s",
+			 type, name);
+		break;
+	}
+}
+
+/**
+ * @brief Replay a log into a pair of tables
+ *
+ * @param[in]  fd   The log
+ * @param[in]  path Its path, for messages
+ * @param[in]  cur  Table for clients of the instance that wrote it
+ * @param[in]  old  Table for clients of the instance before that
+ * @param[out] size Size of the file
+ *
+ * @return Length of the valid records at the start of the file.
+ */
+static off_t recov_log_replay(int fd, const char *path,
+			      struct clid_table *cur, struct clid_table *old,
+			      off_t *size)
+{
+	struct recov_log_hdr *hdr;
+	char name[PATH_MAX], data[NAME_MAX + 1];
+	struct stat st;
+	uint64_t checksum;
+	char *buf;
+	off_t pos = 0, done = 0;
+	ssize_t n;
+	size_t len;
+
+	*size = 0;
+
+	if (fstat(fd, &st) != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to stat recovery log %s, errno=%d",
+			path, errno);
+		return 0;
+	}
+
+	if (st.st_size == 0)
+		return 0;
+
+	*size = st.st_size;
+	buf = gsh_malloc(st.st_size);
+
+	while (done < st.st_size) {
+		n = pread(fd, buf + done, st.st_size - done, done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+	}
+
+	while (pos + (off_t) sizeof(*hdr) <= done) {
+		hdr = (struct recov_log_hdr *) (buf + pos);
+
+		if (hdr->magic != RECOV_LOG_MAGIC || hdr->name_len == 0 ||
+		    hdr->name_len >= sizeof(name) ||
+		    hdr->data_len >= sizeof(data))
+			break;
+
+		len = recov_log_rec_size(hdr->name_len, hdr->data_len);
+		if (pos + (off_t) len > done)
+			break;
+
+		checksum = hdr->checksum;
+		hdr->checksum = 0;
+		if (CityHash64(buf + pos, len) != checksum)
+			break;
+
+		memcpy(name, buf + pos + sizeof(*hdr), hdr->name_len);
+		name[hdr->name_len] = '\0';
+		memcpy(data, buf + pos + sizeof(*hdr) + hdr->name_len,
+		       hdr->data_len);
+		data[hdr->data_len] = '\0';
+
+		recov_log_apply(hdr->type, name, data, cur, old);
+
+		pos += len;
+	}
+
+	if (pos < *size)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Recovery log %s has %"PRIu64
+			 " bytes of invalid records at offset %"PRIu64,
+			 path, (uint64_t) (*size - pos), (uint64_t) pos);
+
+	gsh_free(buf);
+	return pos;
+}
+
+static int recov_log_put_table(int fd, struct recov_log_buf *buf,
+			       struct clid_table *tbl, uint16_t type,
+			       uint16_t rtype)
+{
+	struct glist_head *node, *rnode;
+	clid_entry_t *clid_ent;
+	rdel_fh_t *rfh_entry;
+	uint32_t ix;
+	int rc;
+
+	for (ix = 0; ix < tbl->size; ix++) {
+		glist_for_each(node, &tbl->buckets[ix]) {
+			clid_ent = glist_entry(node, clid_entry_t, cl_list);
+			recov_log_put(buf, type, clid_ent->cl_name, NULL);
+
+			glist_for_each(rnode, &clid_ent->cl_rfh_list) {
+				rfh_entry = glist_entry(rnode, rdel_fh_t,
+							rdfh_list);
+				recov_log_put(buf, rtype, clid_ent->cl_name,
+					      rfh_entry->rdfh_handle_str);
+			}
+
+			if (buf->len >= RECOV_LOG_BUF_SIZE) {
+				rc = recov_log_write(fd, buf);
+				if (rc != 0)
+					return rc;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Rewrite the log with just the live records
+ *
+ * Called with recov_log_mutex held.  The new log is written beside the
+ * old one, synced, and renamed over it, so a crash leaves one or the
+ * other.
+ */
+static void recov_log_compact(void)
+{
+	struct recov_log_buf buf = {NULL, 0, 0};
+	char tmp_path[PATH_MAX + 4];
+	struct stat st;
+	int fd, dirfd, rc;
+
+	if (recov_log_fd < 0)
+		return;
+
+	/* The fd being synced must not be closed under the syncer */
+	while (recov_log_syncing)
+		pthread_cond_wait(&recov_log_cond, &recov_log_mutex);
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", recov_log_path);
+
+	fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+	if (fd < 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to create %s, errno=%d", tmp_path, errno);
+		return;
+	}
+
+	rc = recov_log_put_table(fd, &buf, &recov_log_old, RECOV_LOG_OLD,
+				 RECOV_LOG_OLD_REVOKE);
+	if (rc == 0)
+		rc = recov_log_put_table(fd, &buf, &recov_log_cur,
+					 RECOV_LOG_ADD, RECOV_LOG_REVOKE);
+	if (rc == 0)
+		rc = recov_log_write(fd, &buf);
+	if (rc == 0 && fsync(fd) != 0)
+		rc = errno;
+	if (rc == 0 && fstat(fd, &st) != 0)
+		rc = errno;
+	if (rc == 0 && rename(tmp_path, recov_log_path) != 0)
+		rc = errno;
+
+	gsh_free(buf.data);
+
+	if (rc != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to compact recovery log %s, errno=%d",
+			recov_log_path, rc);
+		close(fd);
+		(void) unlink(tmp_path);
+		return;
+	}
+
+	/* Make the rename durable */
+	dirfd = open(recov_log_dir, O_RDONLY | O_DIRECTORY);
+	if (dirfd >= 0) {
+		if (fsync(dirfd) != 0)
+			LogCrit(COMPONENT_CLIENTID,
+				"Failed to sync %s, errno=%d",
+				recov_log_dir, errno);
+		close(dirfd);
+	}
+
+	close(recov_log_fd);
+	recov_log_fd = fd;
+	recov_log_size = st.st_size;
+	recov_log_live = st.st_size;
+	recov_log_synced = recov_log_seq;
+
+	LogDebug(COMPONENT_CLIENTID,
+		 "Compacted recovery log %s to %"PRIu64" bytes",
+		 recov_log_path, recov_log_size);
+}
+
+/**
+ * @brief Add an entry to a table of the log, and its records to the log
+ *
+ * @param[in] tbl     Table to add to
+ * @param[in] src     Entry to copy
+ * @param[in] type    Type of record for the client
+ * @param[in] rtype   Type of record for its revoked handles
+ * @param[in] logged  Whether to append records
+ */
+static void recov_log_merge(struct clid_table *tbl, clid_entry_t *src,
+			    uint16_t type, uint16_t rtype, bool logged)
+{
+	clid_entry_t *clid_ent = clid_table_lookup(tbl, src->cl_name);
+	struct glist_head *node;
+	rdel_fh_t *rfh_entry;
+
+	if (clid_ent == NULL) {
+		clid_ent = clid_table_add(tbl, src->cl_name);
+		if (logged)
+			recov_log_append(type, src->cl_name, NULL, true);
+	}
+
+	glist_for_each(node, &src->cl_rfh_list) {
+		rfh_entry = glist_entry(node, rdel_fh_t, rdfh_list);
+		if (clid_entry_has_rfh(clid_ent, rfh_entry->rdfh_handle_str))
+			continue;
+		clid_entry_add_rfh(clid_ent, rfh_entry->rdfh_handle_str);
+		if (logged)
+			recov_log_append(rtype, src->cl_name,
+					 rfh_entry->rdfh_handle_str, true);
+	}
+}
+
+/**
+ * @brief Allow the clients of a table to reclaim
+ *
+ * @param[in] tbl    The clients
+ * @param[in] keep   If not NULL, also record them there as clients of
+ *                   the previous instance
+ * @param[in] logged Whether to append records for those
+ */
+static void recov_log_reclaim(struct clid_table *tbl, struct clid_table *keep,
+			      bool logged)
+{
+	struct glist_head *node, *rnode;
+	clid_entry_t *clid_ent, *reclaim_ent;
+	rdel_fh_t *rfh_entry;
+	uint32_t ix;
+
+	for (ix = 0; ix < tbl->size; ix++) {
+		glist_for_each(node, &tbl->buckets[ix]) {
+			clid_ent = glist_entry(node, clid_entry_t, cl_list);
+			reclaim_ent = nfs4_add_clid_entry(clid_ent->cl_name);
+
+			glist_for_each(rnode, &clid_ent->cl_rfh_list) {
+				rfh_entry = glist_entry(rnode, rdel_fh_t,
+							rdfh_list);
+				if (!clid_entry_has_rfh(reclaim_ent,
+					rfh_entry->rdfh_handle_str))
+					clid_entry_add_rfh(reclaim_ent,
+						rfh_entry->rdfh_handle_str);
+			}
+
+			if (keep != NULL)
+				recov_log_merge(keep, clid_ent, RECOV_LOG_OLD,
+						RECOV_LOG_OLD_REVOKE, logged);
+		}
+	}
+}
+
+static void log_recovery_init(void)
+{
+	struct clid_table *tables[] = {&recov_log_old, &recov_log_cur};
+	off_t good, size;
+	int err, ix;
+
+	err = mkdir(NFS_V4_RECOV_ROOT, 0755);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s), errno=%d",
+			 NFS_V4_RECOV_ROOT, errno);
+	}
+
+	if (nfs_param.core_param.clustered) {
+		snprintf(recov_log_dir, sizeof(recov_log_dir), "%s/%s",
+			 NFS_V4_RECOV_ROOT, RECOV_LOG_DIR);
+		err = mkdir(recov_log_dir, 0755);
+		if (err == -1 && errno != EEXIST) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to create v4 recovery dir(%s), errno=%d",
+				 recov_log_dir, errno);
+		}
+		snprintf(recov_log_path, sizeof(recov_log_path),
+			 "%s/node%d.log", recov_log_dir, g_nodeid);
+	} else {
+		snprintf(recov_log_dir, sizeof(recov_log_dir), "%s",
+			 NFS_V4_RECOV_ROOT);
+		snprintf(recov_log_path, sizeof(recov_log_path), "%s/%s",
+			 NFS_V4_RECOV_ROOT, RECOV_LOG_NAME);
+	}
+
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	for (ix = 0; ix < 2; ix++)
+		clid_table_init(tables[ix]);
+
+	recov_log_fd = open(recov_log_path, O_RDWR | O_CREAT | O_APPEND,
+			    0600);
+	if (recov_log_fd < 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to open recovery log %s, errno=%d",
+			recov_log_path, errno);
+		PTHREAD_MUTEX_unlock(&recov_log_mutex);
+		return;
+	}
+
+	good = recov_log_replay(recov_log_fd, recov_log_path,
+				&recov_log_cur, &recov_log_old, &size);
+
+	/* Cut off a torn record so appends follow the valid ones */
+	if (good < size && ftruncate(recov_log_fd, good) != 0)
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to truncate recovery log %s, errno=%d",
+			recov_log_path, errno);
+
+	recov_log_size = good;
+	recov_log_live = recov_log_table_size(&recov_log_old) +
+			 recov_log_table_size(&recov_log_cur);
+
+	LogInfo(COMPONENT_CLIENTID,
+		"Recovery log %s: %u clients, %u of the previous instance",
+		recov_log_path, recov_log_cur.count, recov_log_old.count);
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+}
+
+static void log_recovery_shutdown(void)
+{
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	while (recov_log_syncing)
+		pthread_cond_wait(&recov_log_cond, &recov_log_mutex);
+
+	if (recov_log_fd >= 0) {
+		(void) fdatasync(recov_log_fd);
+		close(recov_log_fd);
+		recov_log_fd = -1;
+	}
+
+	clid_table_clear(&recov_log_cur);
+	clid_table_clear(&recov_log_old);
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+}
+
+/**
+ * @brief Pass the clients that may reclaim to the recovery code
+ *
+ * At startup the clients of the previous instance, and those of the
+ * instance before it if that one never finished grace, become the
+ * clients of the previous instance; the log is rewritten to say so.
+ * On takeover, the clients recorded by the other node are added to
+ * those of the previous instance.
+ *
+ * @param[in] gsp Grace period start information, on takeover
+ */
+static void log_read_clids(nfs_grace_start_t *gsp)
+{
+	struct clid_table cur, old;
+	char path[PATH_MAX];
+	off_t size;
+	int fd;
+
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	if (gsp == NULL) {
+		recov_log_reclaim(&recov_log_old, NULL, false);
+		recov_log_reclaim(&recov_log_cur, &recov_log_old, false);
+		clid_table_clear(&recov_log_cur);
+		recov_log_compact();
+		PTHREAD_MUTEX_unlock(&recov_log_mutex);
+		return;
+	}
+
+	if (gsp->event == EVENT_UPDATE_CLIENTS) {
+		recov_log_reclaim(&recov_log_cur, &recov_log_old, true);
+		recov_log_commit();
+		PTHREAD_MUTEX_unlock(&recov_log_mutex);
+		return;
+	}
+
+	if (gsp->event == EVENT_TAKE_IP)
+		snprintf(path, sizeof(path), "%s/%s/%s",
+			 NFS_V4_RECOV_ROOT, gsp->ipaddr, RECOV_LOG_NAME);
+	else if (gsp->event == EVENT_TAKE_NODEID)
+		snprintf(path, sizeof(path), "%s/%s/node%d.log",
+			 NFS_V4_RECOV_ROOT, RECOV_LOG_DIR, gsp->nodeid);
+	else {
+		PTHREAD_MUTEX_unlock(&recov_log_mutex);
+		return;
+	}
+
+	LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d log (%s)",
+		 gsp->nodeid, path);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to open recovery log (%s), errno=%d",
+			 path, errno);
+		PTHREAD_MUTEX_unlock(&recov_log_mutex);
+		return;
+	}
+
+	clid_table_init(&cur);
+	clid_table_init(&old);
+
+	(void) recov_log_replay(fd, path, &cur, &old, &size);
+	close(fd);
+
+	recov_log_reclaim(&cur, &recov_log_old, true);
+	recov_log_commit();
+
+	clid_table_clear(&cur);
+	clid_table_clear(&old);
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+}
+
+static void log_recovery_cleanup(void)
+{
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	if (recov_log_old.count != 0) {
+		clid_table_clear(&recov_log_old);
+		recov_log_compact();
+	}
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+}
+
+static void log_recovery_maintain(void)
+{
+	uint64_t stale;
+
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	stale = recov_log_size - recov_log_live;
+	if (stale >= RECOV_LOG_COMPACT_MIN && stale > recov_log_live)
+		recov_log_compact();
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+}
+
+static void log_add_clid(nfs_client_id_t *clientid)
+{
+	const char *name = clientid->cid_recov_dir;
+
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	/* A client that comes back is already recorded */
+	if (clid_table_lookup(&recov_log_cur, name) == NULL) {
+		(void) clid_table_add(&recov_log_cur, name);
+		recov_log_append(RECOV_LOG_ADD, name, NULL, true);
+		recov_log_commit();
+	}
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+
+	LogDebug(COMPONENT_CLIENTID, "Logged client [%s]", name);
+}
+
+static void log_rm_clid(nfs_client_id_t *clientid)
+{
+	const char *name = clientid->cid_recov_dir;
+	clid_entry_t *clid_ent;
+
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	clid_ent = clid_table_lookup(&recov_log_cur, name);
+	if (clid_ent != NULL) {
+		recov_log_live -= recov_log_ent_size(clid_ent);
+		clid_table_del(&recov_log_cur, clid_ent);
+		recov_log_append(RECOV_LOG_RM, name, NULL, false);
+		recov_log_commit();
+	}
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+
+	LogDebug(COMPONENT_CLIENTID, "Logged removal of client [%s]", name);
+}
+
+static void log_add_revoke_fh(nfs_client_id_t *delr_clid,
+			      const char *rhdlstr)
+{
+	const char *name = delr_clid->cid_recov_dir;
+	clid_entry_t *clid_ent;
+
+	PTHREAD_MUTEX_lock(&recov_log_mutex);
+
+	clid_ent = clid_table_lookup(&recov_log_cur, name);
+	if (clid_ent == NULL) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Revoke for client not in recovery log [%s]", name);
+	} else if (!clid_entry_has_rfh(clid_ent, rhdlstr)) {
+		clid_entry_add_rfh(clid_ent, rhdlstr);
+		recov_log_append(RECOV_LOG_REVOKE, name, rhdlstr, true);
+		recov_log_commit();
+	}
+
+	PTHREAD_MUTEX_unlock(&recov_log_mutex);
+}
+
+struct nfs4_recovery_backend log_recovery_backend = {
+	.recovery_init = log_recovery_init,
+	.recovery_shutdown = log_recovery_shutdown,
+	.recovery_read_clids = log_read_clids,
+	.recovery_cleanup = log_recovery_cleanup,
+	.recovery_maintain = log_recovery_maintain,
+	.add_clid = log_add_clid,
+	.rm_clid = log_rm_clid,
+	.add_revoke_fh = log_add_revoke_fh,
+};
+
+/** @} */
@@ -319,7 +319,7 @@ static hash_parameter_t state_id_param = {
 	.compare_key = compare_state_id,
 	.key_to_str = display_state_id_key,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State ID Table"
 };
@@ -431,7 +431,7 @@ static hash_parameter_t state_obj_param = {
 	.compare_key = compare_state_obj,
 	.key_to_str = display_state_id_val,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State Obj Table"
 };
@@ -637,7 +637,8 @@ struct state_t *nfs4_State_Get_Pointer(char *other)
 	buffkey.addr = other;
 	buffkey.len = OTHERSIZE;
 
-	rc = hashtable_getlatch(ht_state_id, &buffkey, &buffval, true, &latch);
+	rc = hashtable_getlatch(ht_state_id, &buffkey, &buffval, false,
+				&latch);
 
 	if (rc != HASHTABLE_SUCCESS) {
 		if (rc == HASHTABLE_ERROR_NO_SUCH_KEY)
@@ -686,7 +687,7 @@ struct state_t *nfs4_State_Get_Obj(struct fsal_obj_handle *obj,
 	rc = hashtable_getlatch(ht_state_obj,
 				&buffkey,
 				&buffval,
-				true,
+				false,
 				&latch);
 
 	if (rc != HASHTABLE_SUCCESS) {
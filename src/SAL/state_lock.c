@@ -40,6 +40,7 @@
 #include <time.h>
 #include <pthread.h>
 #include <string.h>
+#include <assert.h>
 
 #include "log.h"
 #include "hashtable.h"
@@ -548,6 +549,367 @@ void dump_all_locks(const char *label)
 #endif
 }
 
+/******************************************************************************
+ *
+ * Functions to maintain the lock range tree
+ *
+ * Every entry on a file's lock_list is also in an AVL tree rooted at
+ * file.lock_tree, keyed by lock_start (ties broken by entry address).
+ * Each node carries the last byte locked anywhere in its subtree, which
+ * lets the entries overlapping a range be found in O(log n + k), and the
+ * export shared by all locks in its subtree, which lets the lock owner
+ * export check be skipped when a file is only locked through one export.
+ *
+ * The range of an entry must not change while it is in the tree; take it
+ * out with lock_tree_remove() and put it back with lock_tree_insert().
+ *
+ ******************************************************************************/
+
+/**
+ * @brief Callback to check a lock entry found by lock_tree_search
+ *
+ * @param[in] entry Entry overlapping the searched range
+ * @param[in] arg   Caller data
+ *
+ * @return true to stop the search and return this entry.
+ */
+typedef bool (*lock_tree_cb_t)(state_lock_entry_t *entry, void *arg);
+
+static inline bool lock_is_pending(state_blocking_t blocked)
+{
+	return blocked != STATE_NON_BLOCKING;
+}
+
+static inline int32_t lock_tree_height(state_lock_entry_t *node)
+{
+	return node != NULL ? node->sle_tree_height : 0;
+}
+
+static inline int lock_tree_cmp(state_lock_entry_t *le1,
+				state_lock_entry_t *le2)
+{
+	if (le1->sle_lock.lock_start != le2->sle_lock.lock_start)
+		return le1->sle_lock.lock_start < le2->sle_lock.lock_start
+			? -1 : 1;
+
+	if (le1 != le2)
+		return (uintptr_t) le1 < (uintptr_t) le2 ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * @brief Recompute the augmented fields of a node from its children
+ *
+ * @param[in,out] node Node to update
+ */
+static void lock_tree_update(state_lock_entry_t *node)
+{
+	state_lock_entry_t *child[2] = {node->sle_tree_left,
+					node->sle_tree_right};
+	uint64_t max_end = lock_end(&node->sle_lock);
+	struct gsh_export *export = node->sle_export;
+	int32_t height = 0;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (child[i] == NULL)
+			continue;
+
+		if (child[i]->sle_tree_max_end > max_end)
+			max_end = child[i]->sle_tree_max_end;
+
+		if (child[i]->sle_tree_export != export)
+			export = NULL;
+
+		if (child[i]->sle_tree_height > height)
+			height = child[i]->sle_tree_height;
+	}
+
+	node->sle_tree_max_end = max_end;
+	node->sle_tree_export = export;
+	node->sle_tree_height = height + 1;
+}
+
+static state_lock_entry_t *lock_tree_rotate_right(state_lock_entry_t *node)
+{
+	state_lock_entry_t *left = node->sle_tree_left;
+
+	node->sle_tree_left = left->sle_tree_right;
+	left->sle_tree_right = node;
+	lock_tree_update(node);
+	lock_tree_update(left);
+	return left;
+}
+
+static state_lock_entry_t *lock_tree_rotate_left(state_lock_entry_t *node)
+{
+	state_lock_entry_t *right = node->sle_tree_right;
+
+	node->sle_tree_right = right->sle_tree_left;
+	right->sle_tree_left = node;
+	lock_tree_update(node);
+	lock_tree_update(right);
+	return right;
+}
+
+/**
+ * @brief Restore the AVL balance of a subtree after a change below it
+ *
+ * @param[in] node Subtree root
+ *
+ * @return The new subtree root.
+ */
+static state_lock_entry_t *lock_tree_balance(state_lock_entry_t *node)
+{
+	int32_t balance;
+
+	lock_tree_update(node);
+	balance = lock_tree_height(node->sle_tree_left) -
+		  lock_tree_height(node->sle_tree_right);
+
+	if (balance > 1) {
+		state_lock_entry_t *left = node->sle_tree_left;
+
+		if (lock_tree_height(left->sle_tree_left) <
+		    lock_tree_height(left->sle_tree_right))
+			node->sle_tree_left = lock_tree_rotate_left(left);
+		return lock_tree_rotate_right(node);
+	}
+
+	if (balance < -1) {
+		state_lock_entry_t *right = node->sle_tree_right;
+
+		if (lock_tree_height(right->sle_tree_right) <
+		    lock_tree_height(right->sle_tree_left))
+			node->sle_tree_right = lock_tree_rotate_right(right);
+		return lock_tree_rotate_left(node);
+	}
+
+	return node;
+}
+
+static state_lock_entry_t *lock_tree_add(state_lock_entry_t *node,
+					 state_lock_entry_t *entry)
+{
+	if (node == NULL) {
+		entry->sle_tree_left = NULL;
+		entry->sle_tree_right = NULL;
+		lock_tree_update(entry);
+		return entry;
+	}
+
+	if (lock_tree_cmp(entry, node) < 0)
+		node->sle_tree_left = lock_tree_add(node->sle_tree_left,
+						    entry);
+	else
+		node->sle_tree_right = lock_tree_add(node->sle_tree_right,
+						     entry);
+
+	return lock_tree_balance(node);
+}
+
+static state_lock_entry_t *lock_tree_del_min(state_lock_entry_t *node,
+					     state_lock_entry_t **min)
+{
+	if (node->sle_tree_left == NULL) {
+		*min = node;
+		return node->sle_tree_right;
+	}
+
+	node->sle_tree_left = lock_tree_del_min(node->sle_tree_left, min);
+	return lock_tree_balance(node);
+}
+
+static state_lock_entry_t *lock_tree_del(state_lock_entry_t *node,
+					 state_lock_entry_t *entry)
+{
+	state_lock_entry_t *min;
+	int cmp;
+
+	assert(node != NULL);
+
+	cmp = lock_tree_cmp(entry, node);
+
+	if (cmp < 0) {
+		node->sle_tree_left = lock_tree_del(node->sle_tree_left,
+						    entry);
+	} else if (cmp > 0) {
+		node->sle_tree_right = lock_tree_del(node->sle_tree_right,
+						     entry);
+	} else {
+		if (node->sle_tree_right == NULL)
+			return node->sle_tree_left;
+
+		node->sle_tree_right = lock_tree_del_min(node->sle_tree_right,
+							 &min);
+		min->sle_tree_left = node->sle_tree_left;
+		min->sle_tree_right = node->sle_tree_right;
+		node = min;
+	}
+
+	return lock_tree_balance(node);
+}
+
+/**
+ * @brief Add a lock entry to its file's range tree
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] entry Entry to add, must not be in the tree
+ */
+static void lock_tree_insert(state_lock_entry_t *entry)
+{
+	struct state_file *file = &entry->sle_obj->state_hdl->file;
+
+	assert(entry->sle_tree_height == 0);
+
+	file->lock_tree = lock_tree_add(file->lock_tree, entry);
+
+	if (lock_is_pending(entry->sle_blocked))
+		file->lock_pending++;
+}
+
+/**
+ * @brief Remove a lock entry from its file's range tree
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] entry Entry to remove, nothing is done if not in the tree
+ */
+static void lock_tree_remove(state_lock_entry_t *entry)
+{
+	struct state_file *file = &entry->sle_obj->state_hdl->file;
+
+	if (entry->sle_tree_height == 0)
+		return;
+
+	file->lock_tree = lock_tree_del(file->lock_tree, entry);
+
+	entry->sle_tree_left = NULL;
+	entry->sle_tree_right = NULL;
+	entry->sle_tree_height = 0;
+
+	if (lock_is_pending(entry->sle_blocked))
+		file->lock_pending--;
+}
+
+/**
+ * @brief Find a lock entry overlapping a range
+ *
+ * Entries are offered to the callback in lock_start order.  The callback
+ * must not change the tree.
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] node  Subtree to search
+ * @param[in] start First byte of range
+ * @param[in] end   Last byte of range
+ * @param[in] cb    Callback to check each overlapping entry
+ * @param[in] arg   Callback data
+ *
+ * @return The first entry accepted by the callback or NULL.
+ */
+static state_lock_entry_t *lock_tree_search(state_lock_entry_t *node,
+					    uint64_t start, uint64_t end,
+					    lock_tree_cb_t cb, void *arg)
+{
+	state_lock_entry_t *found;
+
+	while (node != NULL && node->sle_tree_max_end >= start) {
+		found = lock_tree_search(node->sle_tree_left, start, end,
+					 cb, arg);
+		if (found != NULL)
+			return found;
+
+		/* Everything further right starts after this one */
+		if (node->sle_lock.lock_start > end)
+			return NULL;
+
+		if (lock_end(&node->sle_lock) >= start && cb(node, arg))
+			return node;
+
+		node = node->sle_tree_right;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Change the blocking status of a lock entry
+ *
+ * Keeps the count of pending entries on the file's lock list up to date.
+ *
+ * @param[in,out] entry   Lock entry
+ * @param[in]     blocked New blocking status
+ */
+static void set_lock_blocked(state_lock_entry_t *entry,
+			     state_blocking_t blocked)
+{
+	if (entry->sle_tree_height != 0) {
+		struct state_file *file = &entry->sle_obj->state_hdl->file;
+
+		if (lock_is_pending(entry->sle_blocked))
+			file->lock_pending--;
+		if (lock_is_pending(blocked))
+			file->lock_pending++;
+	}
+
+	entry->sle_blocked = blocked;
+}
+
+/**
+ * @brief Add a lock entry to a lock list
+ *
+ * If the list is its file's lock list the entry is also indexed.
+ *
+ * @param[in,out] list  List to add to
+ * @param[in,out] entry Entry to add
+ */
+static void lock_list_add(struct glist_head *list, state_lock_entry_t *entry)
+{
+	glist_add_tail(list, &entry->sle_list);
+
+	if (list == &entry->sle_obj->state_hdl->file.lock_list)
+		lock_tree_insert(entry);
+}
+
+/**
+ * @brief Find a lock of an owner held through a different export
+ *
+ * A lock owner may only hold locks on a file through one export.
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate File state to search
+ * @param[in] owner  Lock owner
+ * @param[in] export Export of the new request
+ *
+ * @return A lock entry of owner on another export or NULL.
+ */
+static state_lock_entry_t *get_other_export_entry(struct state_hdl *ostate,
+						  state_owner_t *owner,
+						  struct gsh_export *export)
+{
+	struct glist_head *glist;
+	state_lock_entry_t *found_entry;
+
+	/* No locks, or all locks are through this export */
+	if (ostate->file.lock_tree == NULL ||
+	    ostate->file.lock_tree->sle_tree_export == export)
+		return NULL;
+
+	glist_for_each(glist, &ostate->file.lock_list) {
+		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+
+		if (found_entry->sle_export != export
+		    && !different_owners(found_entry->sle_owner, owner))
+			return found_entry;
+	}
+
+	return NULL;
+}
+
 /******************************************************************************
  *
  * Functions to manage lock entries and lock list
@@ -770,10 +1132,54 @@ static void remove_from_locklist(state_lock_entry_t *lock_entry)
 	}
 
 	lock_entry->sle_owner = NULL;
+	lock_tree_remove(lock_entry);
 	glist_del(&lock_entry->sle_list);
 	lock_entry_dec_ref(lock_entry);
 }
 
+/**
+ * @brief Arguments for the lock_tree_search callbacks
+ */
+struct lock_search_arg {
+	state_owner_t *owner;	/*< Lock owner */
+	fsal_lock_param_t *lock;	/*< Lock being checked */
+	state_lock_entry_t *skip;	/*< Entry to ignore */
+	bool state_applies;	/*< Skip locks of NLM state */
+	int32_t state;		/*< NLM state to skip */
+	state_blocking_t blocking;	/*< Blocking type */
+	bool conflict;		/*< Out: entry found conflicts */
+	bool overlap;		/*< Out: compatible lock covers the range */
+};
+
+/**
+ * @brief Check whether a lock entry conflicts with a lock
+ *
+ * @param[in] found_entry Entry overlapping the lock
+ * @param[in] arg         struct lock_search_arg
+ *
+ * @return true if the entry conflicts.
+ */
+static bool overlapping_entry_cb(state_lock_entry_t *found_entry, void *arg)
+{
+	struct lock_search_arg *search = arg;
+
+	LogEntry("Checking", found_entry);
+
+	/* Skip blocked or cancelled locks */
+	if (found_entry->sle_blocked == STATE_NLM_BLOCKING
+	    || found_entry->sle_blocked == STATE_NFSV4_BLOCKING
+	    || found_entry->sle_blocked == STATE_CANCELED)
+		return false;
+
+	/* lock overlaps see if we can allow:
+	 * allow if neither lock is exclusive or
+	 * the owner is the same
+	 */
+	return (found_entry->sle_lock.lock_type == FSAL_LOCK_W
+		|| search->lock->lock_type == FSAL_LOCK_W)
+	    && different_owners(found_entry->sle_owner, search->owner);
+}
+
 /**
  * @brief Find a conflicting entry
  *
@@ -789,48 +1195,53 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 						 state_owner_t *owner,
 						 fsal_lock_param_t *lock)
 {
-	struct glist_head *glist;
-	state_lock_entry_t *found_entry = NULL;
-	uint64_t found_entry_end, range_end = lock_end(lock);
+	struct lock_search_arg search = {
+		.owner = owner,
+		.lock = lock,
+	};
 
-	glist_for_each(glist, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	return lock_tree_search(ostate->file.lock_tree, lock->lock_start,
+				lock_end(lock), overlapping_entry_cb, &search);
+}
 
-		LogEntry("Checking", found_entry);
+/**
+ * @brief Check whether a lock entry needs merging with a new lock
+ *
+ * @param[in] check_entry Entry touching or overlapping the new lock
+ * @param[in] arg         struct lock_search_arg, skip is the new lock
+ *
+ * @return true if the entry must be merged, split or shrunk.
+ */
+static bool merge_entry_cb(state_lock_entry_t *check_entry, void *arg)
+{
+	state_lock_entry_t *lock_entry = ((struct lock_search_arg *)arg)->skip;
 
-		/* Skip blocked or cancelled locks */
-		if (found_entry->sle_blocked == STATE_NLM_BLOCKING
-		    || found_entry->sle_blocked == STATE_NFSV4_BLOCKING
-		    || found_entry->sle_blocked == STATE_CANCELED)
-			continue;
+	/* Skip entry being merged - it could be in the list */
+	if (check_entry == lock_entry)
+		return false;
 
-		found_entry_end = lock_end(&found_entry->sle_lock);
+	if (different_owners(check_entry->sle_owner, lock_entry->sle_owner))
+		return false;
 
-		if ((found_entry_end >= lock->lock_start)
-		    && (found_entry->sle_lock.lock_start <= range_end)) {
-			/* lock overlaps see if we can allow:
-			 * allow if neither lock is exclusive or
-			 * the owner is the same
-			 */
-			if ((found_entry->sle_lock.lock_type == FSAL_LOCK_W
-			     || lock->lock_type == FSAL_LOCK_W)
-			    && different_owners(found_entry->sle_owner, owner)
-			    ) {
-				/* found a conflicting lock, return it */
-				return found_entry;
-			}
-		}
-	}
+	/* Only merge fully granted locks */
+	if (check_entry->sle_blocked != STATE_NON_BLOCKING)
+		return false;
 
-	return NULL;
+	/* A lock of the other type that merely touches stays as it is */
+	if (check_entry->sle_lock.lock_type != lock_entry->sle_lock.lock_type)
+		return lock_end(&check_entry->sle_lock) >=
+				lock_entry->sle_lock.lock_start
+		    && check_entry->sle_lock.lock_start <=
+				lock_end(&lock_entry->sle_lock);
+
+	return true;
 }
 
 /**
  * @brief Add a lock, potentially merging with existing locks
  *
- * We need to iterate over the full lock list and remove
- * any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0 lock_entry
- * implies remove all entries
+ * We need to find every lock of the same owner touching or overlapping
+ * the new lock and merge, split or shrink it.
  *
  * @note The state_lock MUST be held for write
  *
@@ -844,36 +1255,33 @@ static void merge_lock_entry(struct state_hdl *ostate,
 	state_lock_entry_t *check_entry_right;
 	uint64_t check_entry_end;
 	uint64_t lock_entry_end;
-	struct glist_head *glist;
-	struct glist_head *glistn;
+	struct lock_search_arg search = {
+		.skip = lock_entry,
+	};
+	bool indexed = lock_entry->sle_tree_height != 0;
 
 	/* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	/* lock_entry may grow as locks are merged into it, keep it out of
+	 * the range tree until done.
+	 */
+	lock_tree_remove(lock_entry);
 
-		/* Skip entry being merged - it could be in the list */
-		if (check_entry == lock_entry)
-			continue;
+	while (true) {
+		lock_entry_end = lock_end(&lock_entry->sle_lock);
 
-		if (different_owners
-		    (check_entry->sle_owner, lock_entry->sle_owner))
-			continue;
+		check_entry = lock_tree_search(
+			ostate->file.lock_tree,
+			lock_entry->sle_lock.lock_start > 0
+				? lock_entry->sle_lock.lock_start - 1 : 0,
+			lock_entry_end < UINT64_MAX
+				? lock_entry_end + 1 : UINT64_MAX,
+			merge_entry_cb, &search);
 
-		/* Only merge fully granted locks */
-		if (check_entry->sle_blocked != STATE_NON_BLOCKING)
-			continue;
+		if (check_entry == NULL)
+			break;
 
 		check_entry_end = lock_end(&check_entry->sle_lock);
-		lock_entry_end = lock_end(&lock_entry->sle_lock);
-
-		if ((check_entry_end + 1) < lock_entry->sle_lock.lock_start)
-			/* nothing to merge */
-			continue;
-
-		if ((lock_entry_end + 1) < check_entry->sle_lock.lock_start)
-			/* nothing to merge */
-			continue;
 
 		/* Need to handle locks of different types differently, may
 		 * split an old lock. If new lock totally overlaps old lock,
@@ -885,14 +1293,14 @@ static void merge_lock_entry(struct state_hdl *ostate,
 		    && ((lock_entry_end < check_entry_end)
 			|| (check_entry->sle_lock.lock_start <
 			    lock_entry->sle_lock.lock_start))) {
+			lock_tree_remove(check_entry);
+
 			if (lock_entry_end < check_entry_end
 			    && check_entry->sle_lock.lock_start <
 			    lock_entry->sle_lock.lock_start) {
 				/* Need to split old lock */
 				check_entry_right =
 				    state_lock_entry_t_dup(check_entry);
-				glist_add_tail(&ostate->file.lock_list,
-					       &(check_entry_right->sle_list));
 			} else {
 				/* No split, just shrink, make the logic below
 				 * work on original lock
@@ -923,6 +1331,12 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				    check_entry->sle_lock.lock_start;
 				LogEntry("Merge shrunk left", check_entry);
 			}
+
+			lock_tree_insert(check_entry);
+			if (check_entry_right != check_entry)
+				lock_list_add(&ostate->file.lock_list,
+					      check_entry_right);
+
 			/* Done splitting/shrinking old lock */
 			continue;
 		}
@@ -941,14 +1355,21 @@ static void merge_lock_entry(struct state_hdl *ostate,
 			    check_entry->sle_lock.lock_start;
 
 		/* Compute new lock length */
-		lock_entry->sle_lock.lock_length =
-		    lock_entry_end - lock_entry->sle_lock.lock_start + 1;
+		if (lock_entry_end == UINT64_MAX)
+			lock_entry->sle_lock.lock_length = 0;
+		else
+			lock_entry->sle_lock.lock_length =
+			    lock_entry_end - lock_entry->sle_lock.lock_start
+			    + 1;
 
 		/* Remove merged entry */
 		LogEntry("Merged", lock_entry);
 		LogEntry("Merging removing", check_entry);
 		remove_from_locklist(check_entry);
 	}
+
+	if (indexed)
+		lock_tree_insert(lock_entry);
 }
 
 /**
@@ -1048,6 +1469,7 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
 	/* Remove the lock from the list it's
 	 * on and put it on the remove_list
 	 */
+	lock_tree_remove(found_entry);
 	glist_del(&found_entry->sle_list);
 	glist_add_tail(remove_list, &(found_entry->sle_list));
 
@@ -1055,11 +1477,43 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
 	return status;
 }
 
+/**
+ * @brief Check whether a lock entry is to be subtracted from
+ *
+ * @param[in] found_entry Entry overlapping the lock being removed
+ * @param[in] arg         struct lock_search_arg
+ *
+ * @return true if the entry is affected.
+ */
+static bool subtract_entry_cb(state_lock_entry_t *found_entry, void *arg)
+{
+	struct lock_search_arg *search = arg;
+
+	if (search->owner != NULL
+	    && different_owners(found_entry->sle_owner, search->owner))
+		return false;
+
+	/* Only care about granted locks */
+	if (found_entry->sle_blocked != STATE_NON_BLOCKING)
+		return false;
+
+	/* Skip locks owned by this NLM state.
+	 * This protects NLM locks from the current iteration of an NLM
+	 * client from being released by SM_NOTIFY.
+	 */
+	if (search->state_applies &&
+	    found_entry->sle_state->state_seqid == search->state)
+		return false;
+
+	return true;
+}
+
 /**
  * @brief Subtract a lock from a list of locks
  *
  * This function possibly splits entries in the list.
  *
+ * @param[in]     ostate  File state if list is its lock list, else NULL
  * @param[in]     owner   Lock owner
  * @param[in]     state   Associated lock state
  * @param[in]     lock    Lock to remove
@@ -1068,7 +1522,8 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
  *
  * @return State status.
  */
-static state_status_t subtract_lock_from_list(state_owner_t *owner,
+static state_status_t subtract_lock_from_list(struct state_hdl *ostate,
+					      state_owner_t *owner,
 					      bool state_applies,
 					      int32_t state,
 					      fsal_lock_param_t *lock,
@@ -1080,46 +1535,61 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 	struct glist_head *glist, *glistn;
 	state_status_t status = STATE_SUCCESS;
 	bool removed_one = false;
+	struct lock_search_arg search = {
+		.owner = owner,
+		.state_applies = state_applies,
+		.state = state,
+	};
 
 	*removed = false;
 
 	glist_init(&split_lock_list);
 	glist_init(&remove_list);
 
-	glist_for_each_safe(glist, glistn, list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-
-		if (owner != NULL
-		    && different_owners(found_entry->sle_owner, owner))
-			continue;
+	if (ostate != NULL) {
+		/* Only the locks overlapping the range are affected, and
+		 * each one found is taken out of the tree.
+		 */
+		while (status == STATE_SUCCESS) {
+			found_entry = lock_tree_search(ostate->file.lock_tree,
+						       lock->lock_start,
+						       lock_end(lock),
+						       subtract_entry_cb,
+						       &search);
+			if (found_entry == NULL)
+				break;
 
-		/* Only care about granted locks */
-		if (found_entry->sle_blocked != STATE_NON_BLOCKING)
-			continue;
+			status = subtract_lock_from_entry(found_entry, lock,
+							  &split_lock_list,
+							  &remove_list,
+							  &removed_one);
+			*removed |= removed_one;
+		}
+	} else {
+		glist_for_each_safe(glist, glistn, list) {
+			found_entry = glist_entry(glist, state_lock_entry_t,
+						  sle_list);
 
-		/* Skip locks owned by this NLM state.
-		 * This protects NLM locks from the current iteration of an NLM
-		 * client from being released by SM_NOTIFY.
-		 */
-		if (state_applies &&
-		    found_entry->sle_state->state_seqid == state)
-			continue;
+			if (!subtract_entry_cb(found_entry, &search))
+				continue;
 
-		/* We have matched owner. Even though we are taking a reference
-		 * to found_entry, we don't inc the ref count because we want
-		 * to drop the lock entry.
-		 */
-		status =
-		    subtract_lock_from_entry(found_entry, lock,
-					     &split_lock_list, &remove_list,
-					     &removed_one);
-		*removed |= removed_one;
-
-		if (status != STATE_SUCCESS) {
-			/* We ran out of memory while splitting,
-			 * deal with it outside loop
+			/* We have matched owner. Even though we are taking a
+			 * reference to found_entry, we don't inc the ref
+			 * count because we want to drop the lock entry.
 			 */
-			break;
+			status =
+			    subtract_lock_from_entry(found_entry, lock,
+						     &split_lock_list,
+						     &remove_list,
+						     &removed_one);
+			*removed |= removed_one;
+
+			if (status != STATE_SUCCESS) {
+				/* We ran out of memory while splitting,
+				 * deal with it outside loop
+				 */
+				break;
+			}
 		}
 	}
 
@@ -1133,14 +1603,19 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 			found_entry =
 			    glist_entry(glist, state_lock_entry_t, sle_list);
 			glist_del(&found_entry->sle_list);
-			glist_add_tail(list, &(found_entry->sle_list));
+			lock_list_add(list, found_entry);
 		}
 	} else {
 		/* free the enttries on the remove_list */
 		free_list(&remove_list);
 
 		/* now add the split lock list */
-		glist_add_list_tail(list, &split_lock_list);
+		glist_for_each_safe(glist, glistn, &split_lock_list) {
+			found_entry =
+			    glist_entry(glist, state_lock_entry_t, sle_list);
+			glist_del(&found_entry->sle_list);
+			lock_list_add(list, found_entry);
+		}
 	}
 
 	LogFullDebug(COMPONENT_STATE,
@@ -1171,7 +1646,7 @@ static state_status_t subtract_list_from_list(struct fsal_obj_handle *obj,
 	glist_for_each_safe(glist, glistn, source) {
 		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
 
-		status = subtract_lock_from_list(NULL, false, 0,
+		status = subtract_lock_from_list(NULL, NULL, false, 0,
 						 &found_entry->sle_lock,
 						 &removed, target);
 		if (status != STATE_SUCCESS)
@@ -1691,7 +2166,7 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 	}
 
 	/* Mark lock as granted */
-	lock_entry->sle_blocked = STATE_NON_BLOCKING;
+	set_lock_blocked(lock_entry, STATE_NON_BLOCKING);
 
 	/* Merge any touching or overlapping locks into this one. */
 	LogEntry("Granted immediate, merging locks for", lock_entry);
@@ -1730,7 +2205,7 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 	/* We need to make sure lock is ready to be granted */
 	if (lock_entry->sle_blocked == STATE_GRANTING) {
 		/* Mark lock as granted */
-		lock_entry->sle_blocked = STATE_NON_BLOCKING;
+		set_lock_blocked(lock_entry, STATE_NON_BLOCKING);
 
 		/* Merge any touching or overlapping locks into this one. */
 		LogEntry("Granted, merging locks for", lock_entry);
@@ -1783,7 +2258,7 @@ void try_to_grant_lock(state_lock_entry_t *lock_entry)
 		 * for acquiring a reference to the lock entry if needed.
 		 */
 		blocked = lock_entry->sle_blocked;
-		lock_entry->sle_blocked = STATE_GRANTING;
+		set_lock_blocked(lock_entry, STATE_GRANTING);
 		if (lock_entry->sle_block_data->sbd_grant_type ==
 		    STATE_GRANT_NONE)
 			lock_entry->sle_block_data->sbd_grant_type =
@@ -1805,7 +2280,7 @@ void try_to_grant_lock(state_lock_entry_t *lock_entry)
 			/* The lock is still blocked, restore it's type and
 			 * leave it in the list.
 			 */
-			lock_entry->sle_blocked = blocked;
+			set_lock_blocked(lock_entry, blocked);
 			lock_entry->sle_block_data->sbd_grant_type =
 							STATE_GRANT_NONE;
 			return;
@@ -1868,6 +2343,10 @@ static void grant_blocked_locks(struct state_hdl *ostate)
 	if (!ostate)
 		return;
 
+	/* Nothing waiting on this file */
+	if (ostate->file.lock_pending == 0)
+		return;
+
 	/* If FSAL supports async blocking locks,
 	 * allow it to grant blocked locks.
 	 */
@@ -1910,7 +2389,7 @@ void cancel_blocked_lock(struct fsal_obj_handle *obj,
 
 	/* Mark lock as canceled */
 	LogEntry("Cancelling blocked", lock_entry);
-	lock_entry->sle_blocked = STATE_CANCELED;
+	set_lock_blocked(lock_entry, STATE_CANCELED);
 
 	/* Unlocking the entire region will remove any FSAL locks we held,
 	 * whether from fully granted locks, or from blocking locks that were
@@ -2006,6 +2485,10 @@ void cancel_blocked_locks_range(struct state_hdl *ostate,
 	state_lock_entry_t *found_entry = NULL;
 	uint64_t found_entry_end, range_end = lock_end(lock);
 
+	/* Only granted locks on this file */
+	if (ostate->file.lock_pending == 0)
+		return;
+
 	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
 		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
 
@@ -2062,7 +2545,7 @@ state_status_t state_release_grant(state_cookie_entry_t *cookie_entry)
 	 */
 	if (lock_entry->sle_blocked == STATE_GRANTING) {
 		/* Mark lock as canceled */
-		lock_entry->sle_blocked = STATE_CANCELED;
+		set_lock_blocked(lock_entry, STATE_CANCELED);
 
 		/* We had acquired an FSAL lock, need to release it. */
 		status = do_lock_op(obj,
@@ -2480,6 +2963,74 @@ state_status_t state_test(struct fsal_obj_handle *obj,
 	return status;
 }
 
+/**
+ * @brief Check whether a lock entry is the same blocked request
+ *
+ * @param[in] found_entry Entry overlapping the request
+ * @param[in] arg         struct lock_search_arg
+ *
+ * @return true if the entry matches the request.
+ */
+static bool blocked_entry_cb(state_lock_entry_t *found_entry, void *arg)
+{
+	struct lock_search_arg *search = arg;
+
+	return !different_owners(found_entry->sle_owner, search->owner)
+	    && found_entry->sle_blocked == search->blocking
+	    && !different_lock(&found_entry->sle_lock, search->lock);
+}
+
+/**
+ * @brief Check a lock entry against a lock request
+ *
+ * Stops on a conflicting lock, or on a granted lock of the same owner
+ * and type that already covers the request.
+ *
+ * @param[in]     found_entry Entry overlapping the request
+ * @param[in,out] arg         struct lock_search_arg
+ *
+ * @return true if the entry decides the request.
+ */
+static bool lock_entry_cb(state_lock_entry_t *found_entry, void *arg)
+{
+	struct lock_search_arg *search = arg;
+	fsal_lock_param_t *lock = search->lock;
+
+	/* lock overlaps see if we can allow:
+	 * allow if neither lock is exclusive or
+	 * the owner is the same
+	 */
+	if (!lock->lock_reclaim
+	    && (found_entry->sle_lock.lock_type == FSAL_LOCK_W
+		|| lock->lock_type == FSAL_LOCK_W)
+	    && different_owners(found_entry->sle_owner, search->owner)) {
+		search->conflict = true;
+		return true;
+	}
+
+	if (lock_end(&found_entry->sle_lock) >= lock_end(lock)
+	    && found_entry->sle_lock.lock_start <= lock->lock_start
+	    && found_entry->sle_lock.lock_type == lock->lock_type
+	    && (found_entry->sle_blocked == STATE_NON_BLOCKING
+		|| found_entry->sle_blocked == STATE_GRANTING)) {
+		/* Found an entry that entirely overlaps the new entry
+		 * (and due to the preceding test does not prevent
+		 * granting this lock - therefore there can't be any
+		 * other locks that would prevent granting this lock
+		 */
+		if (!different_owners(found_entry->sle_owner, search->owner))
+			return true;
+
+		/* Found a compatible lock with a different lock owner
+		 * that fully overlaps, set hint.
+		 */
+		LogEntry("state_lock Found overlapping", found_entry);
+		search->overlap = true;
+	}
+
+	return false;
+}
+
 /**
  * @brief Attempt to acquire a lock
  *
@@ -2504,10 +3055,13 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 			  fsal_lock_param_t *conflict)
 {
 	bool allow = true, overlap = false;
-	struct glist_head *glist;
 	state_lock_entry_t *found_entry;
-	uint64_t found_entry_end;
 	uint64_t range_end = lock_end(lock);
+	struct lock_search_arg search = {
+		.owner = owner,
+		.lock = lock,
+		.blocking = blocking,
+	};
 	fsal_status_t fsal_status;
 	struct fsal_export *fsal_export = op_ctx->fsal_export;
 	fsal_lock_op_t lock_op;
@@ -2549,45 +3103,37 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
+	/* Need to reject lock request if this lock owner already has
+	 * a lock on this file via a different export.
+	 */
+	found_entry = get_other_export_entry(obj->state_hdl, owner,
+					     op_ctx->ctx_export);
+	if (found_entry != NULL) {
+		LogEvent(COMPONENT_STATE,
+			 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+			 found_entry->sle_export->export_id,
+			 op_ctx_export_path(found_entry->sle_export),
+			 op_ctx->ctx_export->export_id,
+			 op_ctx_export_path(op_ctx->ctx_export));
+
+		LogEntry("Found lock entry belonging to another export",
+			 found_entry);
+
+		status = STATE_INVALID_ARGUMENT;
+		goto out_unlock;
+	}
+
 	if (blocking != STATE_NON_BLOCKING) {
 		/* First search for a blocked request. Client can ignore the
 		 * blocked request and keep sending us new lock request again
 		 * and again. So if we have a mapping blocked request return
 		 * that
 		 */
-		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-			found_entry =
-			    glist_entry(glist, state_lock_entry_t, sle_list);
-
-			if (different_owners(found_entry->sle_owner, owner))
-				continue;
-
-			/* Need to reject lock request if this lock owner
-			 * already has a lock on this file via a different
-			 * export.
-			 */
-			if (found_entry->sle_export != op_ctx->ctx_export) {
-				LogEvent(COMPONENT_STATE,
-					 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-					 found_entry->sle_export->export_id,
-					 op_ctx_export_path(
-						found_entry->sle_export),
-					 op_ctx->ctx_export->export_id,
-					 op_ctx_export_path(
-							op_ctx->ctx_export));
-				LogEntry(
-					"Found lock entry belonging to another export",
-					found_entry);
-				status = STATE_INVALID_ARGUMENT;
-				goto out_unlock;
-			}
-
-			if (found_entry->sle_blocked != blocking)
-				continue;
-
-			if (different_lock(&found_entry->sle_lock, lock))
-				continue;
+		found_entry = lock_tree_search(obj->state_hdl->file.lock_tree,
+					       lock->lock_start, range_end,
+					       blocked_entry_cb, &search);
 
+		if (found_entry != NULL) {
 			/* We have matched all atribute of the existing lock.
 			 * Just return with blocked status. Client may be
 			 * polling.
@@ -2598,95 +3144,41 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		}
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-		/* Need to reject lock request if this lock owner already has
-		 * a lock on this file via a different export.
-		 */
-		if (found_entry->sle_export != op_ctx->ctx_export
-		    && !different_owners(found_entry->sle_owner, owner)) {
-			LogEvent(COMPONENT_STATE,
-				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-				 found_entry->sle_export->export_id,
-				 op_ctx_export_path(found_entry->sle_export),
-				 op_ctx->ctx_export->export_id,
-				 op_ctx_export_path(op_ctx->ctx_export));
-
-			LogEntry("Found lock entry belonging to another export",
-				 found_entry);
-
-			status = STATE_INVALID_ARGUMENT;
-			goto out_unlock;
-		}
+	/* Look for a conflicting lock, or a lock of this owner that already
+	 * covers the request. Don't skip blocked locks for fairness.
+	 */
+	found_entry = lock_tree_search(obj->state_hdl->file.lock_tree,
+				       lock->lock_start, range_end,
+				       lock_entry_cb, &search);
 
-		/* Don't skip blocked locks for fairness */
-		found_entry_end = lock_end(&found_entry->sle_lock);
+	overlap = search.overlap;
 
-		if (!(lock->lock_reclaim)
-		    && (found_entry_end >= lock->lock_start)
-		    && (found_entry->sle_lock.lock_start <= range_end)) {
-			/* lock overlaps see if we can allow:
-			 * allow if neither lock is exclusive or
-			 * the owner is the same
+	if (found_entry != NULL && search.conflict) {
+		/* Found a conflicting lock. Also indicate overlap hint. */
+		LogEntry("Conflicts with", found_entry);
+		LogList("Locks", obj, &obj->state_hdl->file.lock_list);
+		copy_conflict(found_entry, holder, conflict);
+		allow = false;
+		overlap = true;
+	} else if (found_entry != NULL) {
+		/* The lock actually has the same owner, we're done, other
+		 * than dealing with a lock in GRANTING state.
+		 */
+		if (found_entry->sle_blocked == STATE_GRANTING) {
+			/* Need to handle completion of granting of this lock
+			 * because a GRANT was in progress. This could be a
+			 * client retrying a blocked lock due to mis-trust of
+			 * server. If the client also accepts the GRANT_MSG
+			 * with a GRANT_RESP, that will be just fine.
 			 */
-			if ((found_entry->sle_lock.lock_type == FSAL_LOCK_W
-			     || lock->lock_type == FSAL_LOCK_W)
-			    && different_owners(found_entry->sle_owner,
-						owner)) {
-				/* Found a conflicting lock, break out of loop.
-				 * Also indicate overlap hint.
-				 */
-				LogEntry("Conflicts with", found_entry);
-				LogList("Locks", obj,
-					&obj->state_hdl->file.lock_list);
-				copy_conflict(found_entry, holder, conflict);
-				allow = false;
-				overlap = true;
-				break;
-			}
+			grant_blocked_lock_immediate(obj->state_hdl,
+						     found_entry);
 		}
 
-		if (found_entry_end >= range_end
-		    && found_entry->sle_lock.lock_start <= lock->lock_start
-		    && found_entry->sle_lock.lock_type == lock->lock_type
-		    && (found_entry->sle_blocked == STATE_NON_BLOCKING
-			|| found_entry->sle_blocked == STATE_GRANTING)) {
-			/* Found an entry that entirely overlaps the new entry
-			 * (and due to the preceding test does not prevent
-			 * granting this lock - therefore there can't be any
-			 * other locks that would prevent granting this lock
-			 */
-			if (!different_owners(found_entry->sle_owner, owner)) {
-				/* The lock actually has the same owner, we're
-				 * done, other than dealing with a lock in
-				 * GRANTING state.
-				 */
-				if (found_entry->sle_blocked
-				    == STATE_GRANTING) {
-					/* Need to handle completion of granting
-					 * of this lock because a GRANT was in
-					 * progress. This could be a client
-					 * retrying a blocked lock due to
-					 * mis-trust of server. If the client
-					 * also accepts the GRANT_MSG with a
-					 * GRANT_RESP, that will be just fine.
-					 */
-					grant_blocked_lock_immediate(
-						obj->state_hdl, found_entry);
-				}
-
-				LogEntry("Found existing", found_entry);
-
-				status = STATE_SUCCESS;
-				goto out_unlock;
-			}
+		LogEntry("Found existing", found_entry);
 
-			/* Found a compatible lock with a different lock owner
-			 * that fully overlaps, set hint.
-			 */
-			LogEntry("state_lock Found overlapping", found_entry);
-			overlap = true;
-		}
+		status = STATE_SUCCESS;
+		goto out_unlock;
 	}
 
 	/* Decide how to proceed */
@@ -2807,8 +3299,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("New lock", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(&obj->state_hdl->file.lock_list, found_entry);
 
 		/* A lock downgrade could unblock blocked locks */
 		grant_blocked_locks(obj->state_hdl);
@@ -2820,7 +3311,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 	} else if (status == STATE_LOCK_BLOCKED) {
 		/* Mark entry as blocking and attach block_data */
 		found_entry->sle_block_data = block_data;
-		found_entry->sle_blocked = blocking;
+		set_lock_blocked(found_entry, blocking);
 		block_data->sbd_lock_entry = found_entry;
 		if (async) {
 			/* Allow FSAL to signal when lock is granted or
@@ -2840,8 +3331,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("FSAL block for", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(&obj->state_hdl->file.lock_list, found_entry);
 
 		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
 
@@ -2914,8 +3404,8 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 				   nsm_state, lock);
 
 	/* Release the lock from cache inode lock list for entry */
-	status = subtract_lock_from_list(owner, state_applies, nsm_state, lock,
-					 &removed,
+	status = subtract_lock_from_list(obj->state_hdl, owner, state_applies,
+					 nsm_state, lock, &removed,
 					 &obj->state_hdl->file.lock_list);
 
 	/* If the lock list has become zero; decrement the pin ref count pt
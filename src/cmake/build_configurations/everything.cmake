@@ -10,5 +10,6 @@ set(USE_FSAL_RGW ON)
 set(USE_FSAL_GLUSTER ON)
 set(USE_FSAL_ZFS ON)
 set(USE_TOOL_MULTILOCK ON)
+set(USE_TOOL_BENCH ON)
 
 message(STATUS "Building everything")
@@ -0,0 +1,221 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Lock-free lookups in the generic hashtable.
+ *
+ * Two tables holding the same keys are built, one locked as before
+ * and one with HT_FLAG_RCU.  LOOKUP checks every key is found in both.
+ * CHURN has reader threads look up random keys the way the SAL does,
+ * taking a read latch and releasing it, while writer threads overwrite,
+ * delete and re-insert the same keys; every value a reader finds must
+ * still be the one stored for its key.
+ *
+ * The lookup throughput is measured by tools/bench/ht_bench.
+ */
+
+#include <sys/types.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <random>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "hashtable.h"
+#include "gsh_config.h"
+
+/* The server configuration logging reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+}
+
+namespace {
+
+  const uint64_t nkeys = 10000;
+
+  std::vector<uint64_t> keys;
+
+  uint32_t key_index(struct hash_param *hparam, struct gsh_buffdesc *key) {
+    return *(uint64_t *) key->addr % hparam->index_size;
+  }
+
+  uint64_t key_hash(struct hash_param *hparam, struct gsh_buffdesc *key) {
+    /* what the SAL tables feed the tree: an already mixed value */
+    return *(uint64_t *) key->addr * 0xff51afd7ed558ccdULL;
+  }
+
+  int key_compare(struct gsh_buffdesc *k1, struct gsh_buffdesc *k2) {
+    return *(uint64_t *) k1->addr != *(uint64_t *) k2->addr;
+  }
+
+  int key_free(struct gsh_buffdesc key, struct gsh_buffdesc val) {
+    return 1;
+  }
+
+  /* For CHURN, values are allocated so a reader touching a freed one
+   * shows up under a memory checker */
+  int churn_free(struct gsh_buffdesc key, struct gsh_buffdesc val) {
+    delete (uint64_t *) key.addr;
+    delete (uint64_t *) val.addr;
+    return 1;
+  }
+
+  struct hash_param make_param(const char *name, uint32_t flags) {
+    struct hash_param hparam;
+
+    memset(&hparam, 0, sizeof(hparam));
+    hparam.flags = flags;
+    hparam.index_size = 17;
+    hparam.hash_func_key = key_index;
+    hparam.hash_func_rbt = key_hash;
+    hparam.compare_key = key_compare;
+    hparam.ht_name = (char *) name;
+    hparam.ht_log_component = COMPONENT_HASHTABLE;
+    return hparam;
+  }
+
+  struct hash_param locked_param = make_param("locked", HT_FLAG_CACHE);
+  struct hash_param rcu_param = make_param("rcu",
+					   HT_FLAG_CACHE | HT_FLAG_RCU);
+  struct hash_param churn_param = make_param("churn",
+					     HT_FLAG_CACHE | HT_FLAG_RCU);
+
+  struct hash_table* locked_ht = nullptr;
+  struct hash_table* rcu_ht = nullptr;
+
+  void fill(struct hash_table* ht) {
+    for (uint64_t& k : keys) {
+      struct gsh_buffdesc key = { &k, sizeof(k) };
+      struct gsh_buffdesc val = { &k, sizeof(k) };
+
+      ASSERT_EQ(HashTable_Set(ht, &key, &val), HASHTABLE_SUCCESS);
+    }
+  }
+
+  void churn_reader(struct hash_table* ht, int seed,
+		    std::atomic<bool>* stop, std::atomic<uint64_t>* bad) {
+    std::minstd_rand rng(seed);
+    struct hash_latch latch;
+    struct gsh_buffdesc key, val;
+    uint64_t k;
+
+    key.addr = &k;
+    key.len = sizeof(k);
+    while (!stop->load(std::memory_order_relaxed)) {
+      k = rng() % nkeys;
+      if (hashtable_getlatch(ht, &key, &val, false, &latch) ==
+	  HASHTABLE_SUCCESS && *(uint64_t *) val.addr != k)
+	++*bad;
+      hashtable_releaselatched(ht, &latch);
+    }
+  }
+
+  void churn_writer(struct hash_table* ht, int seed, int rounds) {
+    std::minstd_rand rng(seed);
+
+    for (int ix = 0; ix < rounds; ++ix) {
+      uint64_t k = rng() % nkeys;
+      struct gsh_buffdesc key = { new uint64_t(k), sizeof(uint64_t) };
+      struct gsh_buffdesc val = { new uint64_t(k), sizeof(uint64_t) };
+      struct gsh_buffdesc old_key, old_val;
+
+      if (ix % 3 == 0) {
+	if (HashTable_Del(ht, &key, &old_key, &old_val) ==
+	    HASHTABLE_SUCCESS)
+	  churn_free(old_key, old_val);
+	churn_free(key, val);
+      } else {
+	struct hash_latch latch;
+	hash_error_t rc;
+
+	rc = hashtable_getlatch(ht, &key, nullptr, true, &latch);
+	if (rc == HASHTABLE_SUCCESS || rc == HASHTABLE_ERROR_NO_SUCH_KEY)
+	  rc = hashtable_setlatched(ht, &key, &val, &latch, true,
+				    &old_key, &old_val);
+	if (rc == HASHTABLE_OVERWRITTEN) {
+	  churn_free(old_key, old_val);
+	} else if (rc != HASHTABLE_SUCCESS) {
+	  ADD_FAILURE() << "set of key " << k << " failed: " << rc;
+	  churn_free(key, val);
+	}
+      }
+    }
+  }
+
+} /* namespace */
+
+TEST(HASHTABLE1, INIT)
+{
+  keys.resize(nkeys);
+  for (uint64_t ix = 0; ix < nkeys; ++ix)
+    keys[ix] = ix;
+
+  locked_ht = hashtable_init(&locked_param);
+  ASSERT_NE(locked_ht, nullptr);
+  rcu_ht = hashtable_init(&rcu_param);
+  ASSERT_NE(rcu_ht, nullptr);
+
+  fill(locked_ht);
+  fill(rcu_ht);
+}
+
+TEST(HASHTABLE1, LOOKUP)
+{
+  for (uint64_t& k : keys) {
+    struct gsh_buffdesc key = { &k, sizeof(k) };
+    struct gsh_buffdesc val;
+
+    ASSERT_EQ(HashTable_Get(locked_ht, &key, &val), HASHTABLE_SUCCESS);
+    ASSERT_EQ(val.addr, &k);
+    ASSERT_EQ(HashTable_Get(rcu_ht, &key, &val), HASHTABLE_SUCCESS);
+    ASSERT_EQ(val.addr, &k);
+  }
+}
+
+TEST(HASHTABLE1, CHURN)
+{
+  struct hash_table* ht = hashtable_init(&churn_param);
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> bad(0);
+  std::vector<std::thread> readers, writers;
+
+  ASSERT_NE(ht, nullptr);
+
+  for (int ix = 0; ix < 4; ++ix)
+    readers.emplace_back(churn_reader, ht, ix + 1, &stop, &bad);
+  for (int ix = 0; ix < 3; ++ix)
+    writers.emplace_back(churn_writer, ht, ix + 11, 20000);
+  for (auto& t : writers)
+    t.join();
+  stop = true;
+  for (auto& t : readers)
+    t.join();
+
+  EXPECT_EQ(bad.load(), 0u);
+  EXPECT_EQ(hashtable_destroy(ht, churn_free), HASHTABLE_SUCCESS);
+}
+
+TEST(HASHTABLE1, CLEANUP)
+{
+  EXPECT_EQ(hashtable_destroy(locked_ht, key_free), HASHTABLE_SUCCESS);
+  EXPECT_EQ(hashtable_destroy(rcu_ht, key_free), HASHTABLE_SUCCESS);
+}
@@ -0,0 +1,130 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+
+/*
+ * XDR encoded names in the idmapper cache.
+ *
+ * The cache is filled with user and group names for a range of IDs,
+ * then owners and groups are encoded the way fattr4 encoding does and
+ * must come out as a padded XDR opaque of the cached name.  Replacing a
+ * name must replace its encoding.
+ *
+ * The fattr4 encode throughput is measured by tools/bench/idmap_bench.
+ */
+
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <string>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "gsh_rpc.h"
+#include "idmapper.h"
+#include "gsh_config.h"
+
+/* The server configuration the idmapper reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+}
+
+namespace {
+
+  const uint32_t nids = 100;
+  const uint32_t base_id = 100000;
+
+  void cache_name(enum idmapper_map map, uint32_t id,
+		  const std::string& name) {
+    struct gsh_buffdesc desc = { (void *) name.data(), name.size() };
+
+    idmapper_cache_set(map, &desc, id, nullptr, false);
+  }
+
+  /* Encode the owner or group of id, and check it is name as an
+   * opaque, zero padded to a multiple of four bytes */
+  void check_encode(uint32_t id, bool group, const std::string& name) {
+    char buf[IDMAPPER_NAME_MAX + 8];
+    size_t padded = (name.size() + 3) & ~3;
+    uint32_t len;
+    XDR xdrs;
+
+    memset(buf, 0xff, sizeof(buf));
+    xdrmem_create(&xdrs, buf, sizeof(buf), XDR_ENCODE);
+
+    if (group)
+      ASSERT_TRUE(xdr_encode_nfs4_group(&xdrs, id));
+    else
+      ASSERT_TRUE(xdr_encode_nfs4_owner(&xdrs, id));
+
+    EXPECT_EQ(xdr_getpos(&xdrs), 4 + padded);
+    memcpy(&len, buf, 4);
+    EXPECT_EQ(ntohl(len), name.size());
+    EXPECT_EQ(std::string(buf + 4, name.size()), name);
+    for (size_t ix = 4 + name.size(); ix < 4 + padded; ++ix)
+      EXPECT_EQ(buf[ix], 0) << "padding byte " << ix;
+
+    xdr_destroy(&xdrs);
+  }
+
+  /* names of every length modulo 4 */
+  std::string user_name(uint32_t id) {
+    return "user" + std::to_string(id) + std::string(id % 4, 'u') +
+      "@localdomain";
+  }
+
+  std::string group_name(uint32_t id) {
+    return "group" + std::to_string(id) + std::string(id % 4, 'g') +
+      "@localdomain";
+  }
+
+} /* namespace */
+
+TEST(IDMAPPER1, INIT)
+{
+  idmapper_cache_init();
+
+  for (uint32_t id = base_id; id < base_id + nids; ++id) {
+    cache_name(IDMAPPER_UID, id, user_name(id));
+    cache_name(IDMAPPER_GID, id, group_name(id));
+  }
+}
+
+TEST(IDMAPPER1, ENCODE)
+{
+  for (uint32_t id = base_id; id < base_id + nids; ++id) {
+    check_encode(id, false, user_name(id));
+    check_encode(id, true, group_name(id));
+  }
+}
+
+TEST(IDMAPPER1, REPLACE)
+{
+  const std::string name = "renamed@localdomain";
+
+  cache_name(IDMAPPER_UID, base_id, name);
+  check_encode(base_id, false, name);
+  check_encode(base_id, true, group_name(base_id));
+}
+
+TEST(IDMAPPER1, CLEANUP)
+{
+  idmapper_clear_cache();
+}
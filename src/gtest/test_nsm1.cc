@@ -0,0 +1,323 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * NSM monitoring against a fake statd.
+ *
+ * A small statd registers itself with rpcbind over TCP, counts the
+ * SM_MON, SM_UNMON and SM_UNMON_ALL calls it gets and takes delay_ms
+ * milliseconds to answer each.  Many threads then get NSM clients for
+ * the same few hundred hosts, the way NLM LOCK requests do.  No get
+ * may wait for statd, each host must be monitored exactly once, and
+ * unmonitored once when its last reference goes.  Only the NSM client
+ * table and the NSM queue are set up; no server is started.
+ *
+ * rpcbind must be running and the system statd stopped.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "fsal.h"
+#include "sal_functions.h"
+#include "nsm.h"
+#include <rpc/pmap_clnt.h>
+
+/* The server configuration the NSM code reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+}
+
+namespace {
+
+  const int delay_ms = 100;
+  const int nthreads = 32;
+  const int nhosts = 200;
+
+  /* what the fake statd saw */
+  std::atomic<int> mon_calls(0);
+  std::atomic<int> unmon_calls(0);
+  std::atomic<int> unmon_all_calls(0);
+  std::atomic<int> inflight(0);
+  std::atomic<int> max_inflight(0);
+  std::mutex names_mtx;
+  std::multiset<std::string> mon_names;
+
+  int statd_fd = -1;
+  std::vector<state_nsm_client_t*> refs;
+  std::mutex refs_mtx;
+
+  bool read_full(int fd, void *buf, size_t len) {
+    char *p = (char *) buf;
+
+    while (len > 0) {
+      ssize_t n = read(fd, p, len);
+
+      if (n <= 0)
+	return false;
+      p += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  uint32_t get32(const std::vector<char>& msg, size_t& off) {
+    uint32_t v = 0;
+
+    if (off + 4 <= msg.size())
+      memcpy(&v, &msg[off], 4);
+    off += 4;
+    return ntohl(v);
+  }
+
+  /* skip an opaque_auth or read a string, both length prefixed */
+  std::string get_opaque(const std::vector<char>& msg, size_t& off) {
+    uint32_t len = get32(msg, off);
+    std::string s;
+
+    if (off + len <= msg.size())
+      s.assign(&msg[off], len);
+    off += (len + 3) & ~3;
+    return s;
+  }
+
+  void statd_conn(int fd) {
+    for (;;) {
+      std::vector<char> msg;
+      uint32_t mark;
+
+      /* gather one record */
+      do {
+	if (!read_full(fd, &mark, 4))
+	  goto out;
+	mark = ntohl(mark);
+	size_t at = msg.size();
+
+	msg.resize(at + (mark & 0x7fffffff));
+	if (!read_full(fd, &msg[at], mark & 0x7fffffff))
+	  goto out;
+      } while (!(mark & 0x80000000));
+
+      size_t off = 0;
+      uint32_t xid = get32(msg, off);
+      (void) get32(msg, off); /* CALL */
+      (void) get32(msg, off); /* rpcvers */
+      (void) get32(msg, off); /* prog */
+      (void) get32(msg, off); /* vers */
+      uint32_t proc = get32(msg, off);
+
+      (void) get32(msg, off);
+      (void) get_opaque(msg, off); /* cred */
+      (void) get32(msg, off);
+      (void) get_opaque(msg, off); /* verf */
+
+      int now = ++inflight;
+      int seen = max_inflight.load();
+
+      while (now > seen && !max_inflight.compare_exchange_weak(seen, now))
+	;
+
+      std::vector<uint32_t> res;
+
+      switch (proc) {
+      case SM_MON:
+	{
+	  std::string name = get_opaque(msg, off);
+	  std::lock_guard<std::mutex> guard(names_mtx);
+
+	  mon_names.insert(name);
+	}
+	++mon_calls;
+	res = { 0 /* STAT_SUCC */, 1 };
+	break;
+      case SM_UNMON:
+	++unmon_calls;
+	res = { 1 };
+	break;
+      case SM_UNMON_ALL:
+	++unmon_all_calls;
+	res = { 1 };
+	break;
+      default:
+	break;
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+      --inflight;
+
+      /* accepted reply, AUTH_NONE verifier, SUCCESS */
+      std::vector<uint32_t> reply = { xid, 1, 0, 0, 0, 0 };
+
+      reply.insert(reply.end(), res.begin(), res.end());
+      for (uint32_t& w : reply)
+	w = htonl(w);
+      mark = htonl(0x80000000 | (reply.size() * 4));
+      if (write(fd, &mark, 4) != 4 ||
+	  write(fd, reply.data(), reply.size() * 4) !=
+	  (ssize_t) (reply.size() * 4))
+	goto out;
+    }
+  out:
+    close(fd);
+  }
+
+  void statd_server() {
+    for (;;) {
+      int fd = accept(statd_fd, nullptr, nullptr);
+
+      if (fd < 0)
+	return;
+      std::thread(statd_conn, fd).detach();
+    }
+  }
+
+  bool statd_start() {
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    statd_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (statd_fd < 0)
+      return false;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(statd_fd, (struct sockaddr *) &sin, sizeof(sin)) != 0 ||
+	listen(statd_fd, 64) != 0 ||
+	getsockname(statd_fd, (struct sockaddr *) &sin, &len) != 0)
+      return false;
+
+    (void) pmap_unset(SM_PROG, SM_VERS);
+    if (!pmap_set(SM_PROG, SM_VERS, IPPROTO_TCP, ntohs(sin.sin_port)))
+      return false;
+
+    std::thread(statd_server).detach();
+    return true;
+  }
+
+  std::string host_name(int ix) {
+    return "client" + std::to_string(ix) + ".localdomain";
+  }
+
+  void locker(int seed, double* max_ms) {
+    struct req_op_context req_ctx;
+    std::vector<state_nsm_client_t*> mine;
+
+    memset(&req_ctx, 0, sizeof(req_ctx));
+    op_ctx = &req_ctx;
+
+    *max_ms = 0;
+    for (int ix = 0; ix < nhosts; ++ix) {
+      std::string name = host_name((ix + seed) % nhosts);
+      auto start = std::chrono::steady_clock::now();
+      state_nsm_client_t* host =
+	get_nsm_client(CARE_MONITOR, nullptr, (char *) name.c_str());
+      std::chrono::duration<double, std::milli> took =
+	std::chrono::steady_clock::now() - start;
+
+      if (took.count() > *max_ms)
+	*max_ms = took.count();
+      if (host != nullptr)
+	mine.push_back(host);
+    }
+
+    std::lock_guard<std::mutex> guard(refs_mtx);
+    refs.insert(refs.end(), mine.begin(), mine.end());
+    op_ctx = nullptr;
+  }
+
+  template <typename F>
+  bool wait_for(F done, int seconds) {
+    for (int ix = 0; ix < seconds * 100; ++ix) {
+      if (done())
+	return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return done();
+  }
+
+} /* namespace */
+
+TEST(NSM1, INIT)
+{
+  ASSERT_TRUE(statd_start()) << "Unable to register fake statd with rpcbind";
+
+  nfs_param.core_param.nsm_use_caller_name = true;
+  ASSERT_EQ(Init_nlm_hash(), 0);
+
+  /* what the server does at startup, before any monitoring */
+  nsm_unmonitor_all();
+  EXPECT_EQ(unmon_all_calls.load(), 1);
+}
+
+TEST(NSM1, MONITOR)
+{
+  std::vector<std::thread> threads;
+  std::vector<double> worst(nthreads * 8, 0); /* avoid sharing */
+
+  for (int ix = 0; ix < nthreads; ++ix)
+    threads.emplace_back(locker, ix, &worst[ix * 8]);
+  for (auto& t : threads)
+    t.join();
+
+  ASSERT_EQ(refs.size(), (size_t) nthreads * nhosts);
+
+  /* statd takes delay_ms per call, no get may have waited for it */
+  for (int ix = 0; ix < nthreads; ++ix)
+    EXPECT_LT(worst[ix * 8], delay_ms) << "thread " << ix;
+
+  /* nothing waited for statd, now let it catch up */
+  EXPECT_TRUE(wait_for([] {
+	for (state_nsm_client_t* host : refs)
+	  if (!atomic_fetch_int32_t(&host->ssc_monitored))
+	    return false;
+	return true;
+      }, 60));
+
+  EXPECT_EQ(mon_calls.load(), nhosts);
+  /* and it was sent more than one request at a time */
+  EXPECT_GT(max_inflight.load(), 1);
+  for (int ix = 0; ix < nhosts; ++ix)
+    EXPECT_EQ(mon_names.count(host_name(ix)), 1U);
+}
+
+TEST(NSM1, UNMONITOR)
+{
+  for (state_nsm_client_t* host : refs)
+    dec_nsm_client_ref(host);
+  refs.clear();
+
+  EXPECT_TRUE(wait_for([] { return unmon_calls >= nhosts; }, 60));
+  std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms * 4));
+  EXPECT_EQ(unmon_calls.load(), nhosts);
+}
@@ -0,0 +1,367 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * The slab and magazine pool allocator.
+ *
+ * Objects are freed on other threads than the ones that allocated
+ * them, overflow the thread magazines into the depot and back to the
+ * slabs, and pools are destroyed while other threads still cache their
+ * magazines.  The constructor and destructor record every object, so
+ * the tests can check each object is constructed once when its slab is
+ * made, destroyed once when its slab goes, and only once nothing in
+ * the slab is in use.
+ */
+
+#include <sys/types.h>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "abstract_mem.h"
+#include "gsh_config.h"
+
+/* The server configuration logging reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+}
+
+namespace {
+
+  const uint32_t magic = 0x706f6f6c;
+
+  struct object {
+    uint32_t magic;	/* set by the constructor only */
+    bool in_use;	/* set while the test holds the object */
+    uint64_t tag;
+    char pad[40];
+  };
+
+  std::mutex objs_mtx;
+  std::set<void*> constructed;
+  uint64_t nconstructed;
+  uint64_t ndestroyed;
+  uint64_t destroyed_in_use;
+
+  void reset(void) {
+    std::lock_guard<std::mutex> guard(objs_mtx);
+
+    constructed.clear();
+    nconstructed = 0;
+    ndestroyed = 0;
+    destroyed_in_use = 0;
+  }
+
+  void construct(void *obj) {
+    struct object *o = (struct object *) obj;
+    std::lock_guard<std::mutex> guard(objs_mtx);
+
+    EXPECT_TRUE(constructed.insert(obj).second)
+      << "object " << obj << " constructed twice";
+    o->magic = magic;
+    o->in_use = false;
+    ++nconstructed;
+  }
+
+  void destroy(void *obj) {
+    struct object *o = (struct object *) obj;
+    std::lock_guard<std::mutex> guard(objs_mtx);
+
+    EXPECT_EQ(constructed.erase(obj), 1U)
+      << "object " << obj << " not constructed";
+    EXPECT_EQ(o->magic, magic);
+    if (o->in_use)
+      ++destroyed_in_use;
+    ++ndestroyed;
+  }
+
+  pool_t *make_pool(void) {
+    reset();
+    return pool_init("test", sizeof(struct object), 0, construct, destroy);
+  }
+
+  struct object *get(pool_t *pool, uint64_t tag) {
+    struct object *o = (struct object *) pool_alloc(pool);
+
+    EXPECT_EQ(o->magic, magic);
+    EXPECT_FALSE(o->in_use) << "object " << o << " handed out twice";
+    o->in_use = true;
+    o->tag = tag;
+    return o;
+  }
+
+  void put(pool_t *pool, struct object *o) {
+    o->in_use = false;
+    pool_free(pool, o);
+  }
+
+  uint64_t constructed_count(void) {
+    std::lock_guard<std::mutex> guard(objs_mtx);
+
+    return nconstructed;
+  }
+
+  /* Objects per slab: what allocating one object from a new pool
+   * constructs */
+  uint64_t slab_objects(void) {
+    pool_t *pool = make_pool();
+    uint64_t n;
+
+    put(pool, get(pool, 0));
+    n = constructed_count();
+    pool_destroy(pool);
+    reset();
+    return n;
+  }
+
+} /* namespace */
+
+TEST(POOL1, CROSS_THREAD_FREE)
+{
+  /* fewer objects than the depot holds, so none go back to the slabs */
+  pool_t *pool = make_pool();
+  const int n = 16 * POOL_MAGAZINE_SIZE;
+  std::vector<struct object*> objs;
+  uint64_t before;
+
+  for (int ix = 0; ix < n; ++ix)
+    objs.push_back(get(pool, ix));
+  before = constructed_count();
+
+  /* freed on a thread that then exits, handing its magazines back */
+  std::thread([&]() {
+      for (int ix = 0; ix < n; ++ix) {
+	EXPECT_EQ(objs[ix]->tag, (uint64_t) ix);
+	put(pool, objs[ix]);
+      }
+    }).join();
+
+  /* reused here without making new slabs */
+  std::set<struct object*> seen;
+
+  for (int ix = 0; ix < n; ++ix) {
+    objs[ix] = get(pool, ix);
+    EXPECT_TRUE(seen.insert(objs[ix]).second);
+  }
+  EXPECT_EQ(constructed_count(), before);
+
+  for (auto o : objs)
+    put(pool, o);
+  pool_destroy(pool);
+  EXPECT_TRUE(constructed.empty());
+  EXPECT_EQ(destroyed_in_use, 0U);
+}
+
+TEST(POOL1, DEPOT_OVERFLOW)
+{
+  /* many more objects than the thread magazines and the depot hold */
+  pool_t *pool = make_pool();
+  const int n = 50 * POOL_MAGAZINE_SIZE * 64;
+  std::vector<struct object*> objs;
+  uint64_t before;
+
+  for (int round = 0; round < 3; ++round) {
+    std::set<struct object*> seen;
+
+    for (int ix = 0; ix < n; ++ix) {
+      objs.push_back(get(pool, ix));
+      EXPECT_TRUE(seen.insert(objs.back()).second);
+    }
+    if (round == 0)
+      before = constructed_count();
+    for (auto o : objs)
+      put(pool, o);
+    objs.clear();
+  }
+
+  /* all rounds after the first ran on the objects freed by it, give or
+   * take the slabs released between rounds */
+  EXPECT_LE(constructed_count(), 3 * before);
+  EXPECT_GE(constructed_count(), before);
+
+  pool_destroy(pool);
+  EXPECT_TRUE(constructed.empty());
+  EXPECT_EQ(destroyed_in_use, 0U);
+}
+
+TEST(POOL1, SLAB_RELEASE)
+{
+  uint64_t per_slab = slab_objects();
+  pool_t *pool = make_pool();
+  const uint64_t n = 64 * per_slab;
+  std::vector<struct object*> objs;
+
+  ASSERT_GE(per_slab, 8U);
+
+  for (uint64_t ix = 0; ix < n; ++ix)
+    objs.push_back(get(pool, ix));
+  EXPECT_EQ(ndestroyed, 0U);
+
+  /* free most objects, keeping some scattered over the slabs */
+  std::vector<struct object*> kept;
+
+  for (uint64_t ix = 0; ix < n; ++ix) {
+    if (ix % 97 == 0)
+      kept.push_back(objs[ix]);
+    else
+      put(pool, objs[ix]);
+  }
+  objs.clear();
+
+  /* whatever was released was wholly free */
+  EXPECT_EQ(destroyed_in_use, 0U);
+  EXPECT_EQ(ndestroyed % per_slab, 0U);
+
+  for (auto o : kept)
+    put(pool, o);
+  EXPECT_EQ(destroyed_in_use, 0U);
+  EXPECT_EQ(ndestroyed % per_slab, 0U);
+  /* most slabs are empty now; only a few are kept */
+  EXPECT_GT(ndestroyed, 0U);
+
+  pool_destroy(pool);
+  EXPECT_TRUE(constructed.empty());
+  EXPECT_EQ(ndestroyed, nconstructed);
+  EXPECT_EQ(nconstructed % per_slab, 0U);
+}
+
+TEST(POOL1, CONSTRUCTED_REUSE)
+{
+  pool_t *pool = make_pool();
+  struct object *o = get(pool, 1);
+  struct object *again;
+
+  o->magic = magic;
+  put(pool, o);
+  again = get(pool, 2);
+
+  /* the same object, still constructed, not constructed again */
+  EXPECT_EQ(again, o);
+  EXPECT_EQ(again->magic, magic);
+  put(pool, again);
+
+  pool_destroy(pool);
+  EXPECT_TRUE(constructed.empty());
+}
+
+TEST(POOL1, ZERO)
+{
+  pool_t *zeroed = pool_basic_init("zeroed", 256);
+  pool_t *plain = pool_init("plain", 256, 0, nullptr, nullptr);
+  unsigned char *p, *q;
+
+  for (int round = 0; round < 3; ++round) {
+    p = (unsigned char *) pool_alloc(zeroed);
+    for (int ix = 0; ix < 256; ++ix)
+      ASSERT_EQ(p[ix], 0) << "round " << round << " byte " << ix;
+    memset(p, 0xab, 256);
+    pool_free(zeroed, p);
+  }
+
+  /* a plain pool hands back the object as it was freed */
+  p = (unsigned char *) pool_alloc(plain);
+  memset(p, 0xab, 256);
+  pool_free(plain, p);
+  q = (unsigned char *) pool_alloc(plain);
+  ASSERT_EQ(q, p);
+  for (int ix = sizeof(void *); ix < 256; ++ix)
+    EXPECT_EQ(q[ix], 0xab) << "byte " << ix;
+  pool_free(plain, q);
+
+  pool_destroy(zeroed);
+  pool_destroy(plain);
+}
+
+TEST(POOL1, DESTROY_WHILE_CACHED)
+{
+  const int n = 3 * POOL_MAGAZINE_SIZE;
+  std::mutex mtx;
+  std::condition_variable cv;
+  int step = 0;
+  pool_t *pool = make_pool();
+  pool_t *next = nullptr;
+
+  auto wait_step = [&](int s) {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    cv.wait(lock, [&] { return step >= s; });
+  };
+  auto set_step = [&](int s) {
+    std::lock_guard<std::mutex> guard(mtx);
+
+    step = s;
+    cv.notify_all();
+  };
+
+  /* fills its magazines from the first pool, and uses the next one
+   * once the first is gone */
+  std::thread other([&]() {
+      std::vector<struct object*> objs;
+
+      for (int ix = 0; ix < n; ++ix)
+	objs.push_back(get(pool, ix));
+      for (auto o : objs)
+	put(pool, o);
+      objs.clear();
+      set_step(1);
+
+      wait_step(2);
+      for (int ix = 0; ix < n; ++ix) {
+	objs.push_back(get(next, ix));
+	EXPECT_EQ(objs.back()->magic, magic);
+      }
+      for (auto o : objs)
+	put(next, o);
+      set_step(3);
+
+      wait_step(4);
+    });
+
+  wait_step(1);
+  pool_destroy(pool);
+  /* every object, including the ones cached by the other thread */
+  EXPECT_TRUE(constructed.empty());
+
+  /* likely to take the cache slot of the destroyed pool */
+  next = make_pool();
+  set_step(2);
+  wait_step(3);
+
+  /* the other thread only ever got objects of the new pool */
+  {
+    std::lock_guard<std::mutex> guard(objs_mtx);
+
+    EXPECT_EQ(ndestroyed, 0U);
+    EXPECT_GE(nconstructed, (uint64_t) n);
+  }
+
+  /* it exits with magazines of the new pool */
+  set_step(4);
+  other.join();
+
+  pool_destroy(next);
+  EXPECT_TRUE(constructed.empty());
+  EXPECT_EQ(destroyed_in_use, 0U);
+}
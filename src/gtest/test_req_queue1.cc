@@ -0,0 +1,331 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Behaviour and throughput of the request queues.
+ *
+ * EXACTLY_ONCE has a fridge of workers take a set of requests and
+ * checks each comes out once; WEIGHTS checks the classes are served in
+ * their Dispatch_Weight_* shares; SHARDS checks a request queued on one
+ * CPU reaches a worker on another.
+ *
+ * The server is not started; only the queues and the fridge are used.
+ * The throughput of the queues is measured by tools/bench/reqq_bench.
+ */
+
+#include <sys/types.h>
+#include <sched.h>
+#include <pthread.h>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "abstract_mem.h"
+#include "nfs_core.h"
+#include "nfs_req_queue.h"
+#include "fridgethr.h"
+#include "gsh_config.h"
+}
+
+namespace {
+
+  const int nreqs = 1024;
+
+  std::atomic<uint64_t> dequeues(0);
+
+  /* For EXACTLY_ONCE: the requests, and how often each came out */
+  request_data_t *once_reqs;
+  std::vector<std::atomic<uint32_t>> *once_seen;
+
+  void worker_init(struct fridgethr_context *ctx) {
+    init_wait_q_entry(&ctx->wd.wqe);
+  }
+
+  void once_worker(struct fridgethr_context *ctx) {
+    request_data_t *reqdata;
+
+    while (!fridgethr_you_should_break(ctx)) {
+      reqdata = nfs_rpc_dequeue_req(&ctx->wd);
+      if (reqdata == nullptr)
+	continue;
+      ++(*once_seen)[reqdata - once_reqs];
+      ++dequeues;
+    }
+  }
+
+  /* Class of the ix'th request: one in eight is a MOUNT or a CALL, the
+   * rest are split between the low and high latency queues */
+  void make_req(request_data_t *reqdata, int ix) {
+    reqdata->rtype = NFS_REQUEST;
+    switch (ix % 8) {
+    case 0:
+      reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_MOUNT;
+      break;
+    case 1:
+      reqdata->rtype = NFS_CALL;
+      break;
+    case 2:
+    case 3:
+    case 4:
+      reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_READ;
+      break;
+    default:
+      reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_LOOKUP;
+      break;
+    }
+  }
+
+  /* Requests queued over all the shards */
+  uint32_t queued(void) {
+    uint32_t n = 0;
+
+    for (uint32_t ix = 0; ix < nfs_req_st.reqs.nshards; ++ix)
+      n += atomic_fetch_uint32_t(&nfs_req_st.reqs.shards[ix].size);
+    return n;
+  }
+
+  /* Take one request on the calling thread; there must be one queued,
+   * or this waits like a worker would. */
+  request_data_t *dequeue_one(void) {
+    struct fridgethr_context ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    init_wait_q_entry(&ctx.wd.wqe);
+    return nfs_rpc_dequeue_req(&ctx.wd);
+  }
+
+  /* Empty the queues, once no worker runs, so the requests can be
+   * freed without leaving them linked in a shard */
+  void drain(void) {
+    while (queued() != 0)
+      (void) dequeue_one();
+  }
+
+  struct fridgethr *start_workers(int nthreads,
+				  void (*func)(struct fridgethr_context *)) {
+    struct fridgethr_params frp;
+    struct fridgethr *fr = nullptr;
+    int rc;
+
+    memset(&frp, 0, sizeof(struct fridgethr_params));
+    frp.thr_max = nthreads;
+    frp.thr_min = nthreads;
+    frp.flavor = fridgethr_flavor_looper;
+    frp.thread_initialize = worker_init;
+    frp.wake_threads = nfs_rpc_queue_awaken;
+    frp.wake_threads_arg = &nfs_req_st;
+
+    rc = fridgethr_init(&fr, "QTest", &frp);
+    EXPECT_EQ(rc, 0);
+    if (rc != 0)
+      return nullptr;
+
+    rc = fridgethr_populate(fr, func, nullptr);
+    EXPECT_EQ(rc, 0);
+    return fr;
+  }
+
+  void stop_workers(struct fridgethr *fr) {
+    int rc = fridgethr_sync_command(fr, fridgethr_comm_stop, 120);
+
+    EXPECT_EQ(rc, 0);
+    fridgethr_destroy(fr);
+  }
+
+  void exactly_once(dispatch_shard_by_t mode, int nthreads) {
+    std::vector<std::atomic<uint32_t>> seen(nreqs);
+    struct fridgethr *fr;
+
+    nfs_rpc_queue_shards_init(mode);
+    once_reqs = (request_data_t *) gsh_calloc(nreqs,
+					      sizeof(request_data_t));
+    once_seen = &seen;
+    dequeues = 0;
+
+    fr = start_workers(nthreads, once_worker);
+    ASSERT_NE(fr, nullptr);
+    for (int ix = 0; ix < nreqs; ++ix) {
+      make_req(&once_reqs[ix], ix);
+      nfs_rpc_enqueue_req(&once_reqs[ix]);
+    }
+
+    auto limit = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (dequeues < (uint64_t) nreqs &&
+	   std::chrono::steady_clock::now() < limit)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    stop_workers(fr);
+
+    EXPECT_EQ(dequeues.load(), (uint64_t) nreqs);
+    EXPECT_EQ(queued(), 0U);
+    for (int ix = 0; ix < nreqs; ++ix)
+      EXPECT_EQ(seen[ix].load(), 1U) << "request " << ix;
+
+    drain();
+    gsh_free(once_reqs);
+    once_reqs = nullptr;
+    once_seen = nullptr;
+  }
+
+  /* Run func on a thread bound to cpu */
+  void on_cpu(int cpu, std::function<void()> func) {
+    std::thread thr([cpu, &func]() {
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	ASSERT_EQ(pthread_setaffinity_np(pthread_self(), sizeof(set), &set),
+		  0);
+	func();
+      });
+    thr.join();
+  }
+
+  void shards(dispatch_shard_by_t mode) {
+    const int n = 64;
+    request_data_t *reqs =
+      (request_data_t *) gsh_calloc(n, sizeof(request_data_t));
+    struct req_q_shard *local;
+    cpu_set_t set;
+    int first = -1, last = -1;
+
+    ASSERT_EQ(sched_getaffinity(0, sizeof(set), &set), 0);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &set)) {
+	if (first < 0)
+	  first = cpu;
+	last = cpu;
+      }
+
+    nfs_rpc_queue_shards_init(mode);
+    local = &nfs_req_st.reqs.shards[nfs_req_st.reqs.cpu_shard[first]];
+
+    on_cpu(first, [&]() {
+	for (int ix = 0; ix < n; ++ix) {
+	  make_req(&reqs[ix], ix);
+	  nfs_rpc_enqueue_req(&reqs[ix]);
+	}
+      });
+
+    /* All on the shard of the CPU that queued them */
+    EXPECT_EQ(atomic_fetch_uint32_t(&local->size), (uint32_t) n);
+    EXPECT_EQ(queued(), (uint32_t) n);
+
+    /* and taken by a worker on another CPU, from another shard when
+     * there is more than one */
+    on_cpu(last, [&]() {
+	for (int ix = 0; ix < n; ++ix) {
+	  ASSERT_NE(queued(), 0U);
+	  EXPECT_NE(dequeue_one(), nullptr);
+	}
+      });
+    EXPECT_EQ(queued(), 0U);
+
+    drain();
+    gsh_free(reqs);
+  }
+
+} /* namespace */
+
+TEST(REQ_QUEUE1, EXACTLY_ONCE)
+{
+  int nthreads = std::thread::hardware_concurrency();
+
+  if (nthreads < 2)
+    nthreads = 2;
+
+  exactly_once(DISPATCH_SHARD_NONE, nthreads);
+  exactly_once(DISPATCH_SHARD_NODE, nthreads);
+  exactly_once(DISPATCH_SHARD_CPU, nthreads);
+}
+
+TEST(REQ_QUEUE1, WEIGHTS)
+{
+  nfs_core_parameter_t *core = &nfs_param.core_param;
+  const int per_class = 200, rounds = 10;
+  request_data_t *reqs =
+    (request_data_t *) gsh_calloc(N_REQ_QUEUES * per_class,
+				  sizeof(request_data_t));
+  uint32_t weight[N_REQ_QUEUES] = { 1, 2, 3, 4 };
+  uint32_t total = 0, count[N_REQ_QUEUES] = { 0 };
+  request_data_t *reqdata;
+  int ix;
+
+  core->dispatch_weight_mount = weight[REQ_Q_MOUNT];
+  core->dispatch_weight_call = weight[REQ_Q_CALL];
+  core->dispatch_weight_low_latency = weight[REQ_Q_LOW_LATENCY];
+  core->dispatch_weight_high_latency = weight[REQ_Q_HIGH_LATENCY];
+  for (ix = 0; ix < N_REQ_QUEUES; ++ix)
+    total += weight[ix];
+
+  nfs_rpc_queue_shards_init(DISPATCH_SHARD_NONE);
+
+  /* per_class of each class, the classes in index order */
+  for (ix = 0; ix < N_REQ_QUEUES * per_class; ++ix) {
+    reqdata = &reqs[ix];
+    reqdata->rtype = NFS_REQUEST;
+    switch (ix / per_class) {
+    case REQ_Q_MOUNT:
+      reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_MOUNT;
+      break;
+    case REQ_Q_CALL:
+      reqdata->rtype = NFS_CALL;
+      break;
+    case REQ_Q_LOW_LATENCY:
+      reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_LOOKUP;
+      break;
+    default:
+      reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_READ;
+      break;
+    }
+    nfs_rpc_enqueue_req(reqdata);
+  }
+
+  /* While no class runs dry, each full turn of the schedule serves
+   * every class exactly its weight */
+  for (uint32_t n = 0; n < rounds * total; ++n) {
+    reqdata = dequeue_one();
+    ASSERT_NE(reqdata, nullptr);
+    ++count[(reqdata - reqs) / per_class];
+  }
+
+  for (ix = 0; ix < N_REQ_QUEUES; ++ix)
+    EXPECT_EQ(count[ix], rounds * weight[ix]) << req_q_s[ix];
+
+  drain();
+  gsh_free(reqs);
+  core->dispatch_weight_mount = 0;
+  core->dispatch_weight_call = 0;
+  core->dispatch_weight_low_latency = 0;
+  core->dispatch_weight_high_latency = 0;
+  nfs_rpc_queue_shards_init(DISPATCH_SHARD_NONE);
+}
+
+TEST(REQ_QUEUE1, SHARDS)
+{
+  shards(DISPATCH_SHARD_NODE);
+  shards(DISPATCH_SHARD_CPU);
+  nfs_rpc_queue_shards_init(DISPATCH_SHARD_NONE);
+}
@@ -0,0 +1,157 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Sharded server statistics.
+ *
+ * Worker threads on every CPU replay the stats calls of a small
+ * NFSv4.1 compound (PUTFH, READ) against one export and one client,
+ * and the shards of the export, the client and the global stats must
+ * add up to the number of compounds recorded.  The export and client
+ * are bare stats structs; no server is started.
+ *
+ * The throughput of this path is measured by tools/bench/stats_bench.
+ */
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "client_mgr.h"
+#include "server_stats.h"
+#include "server_stats_private.h"
+#include "fsal.h"
+
+/* The server configuration the stats code reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+}
+
+namespace {
+
+  int duration = 1;
+
+  struct export_stats* exp_stats = nullptr;
+  struct server_stats* cl_stats = nullptr;
+
+  void worker(std::atomic<bool>* stop, uint64_t* compounds) {
+    struct req_op_context req_ctx;
+    struct user_cred user_credentials;
+    uint64_t n = 0;
+
+    memset(&user_credentials, 0, sizeof(struct user_cred));
+    memset(&req_ctx, 0, sizeof(struct req_op_context));
+    req_ctx.ctx_export = &exp_stats->export;
+    req_ctx.creds = &user_credentials;
+    req_ctx.client = &cl_stats->client;
+    req_ctx.req_type = NFS_REQUEST;
+    req_ctx.nfs_vers = NFS_V4;
+    req_ctx.nfs_minorvers = 1;
+    req_ctx.queue_wait = 1000;
+
+    /* stashed in tls */
+    op_ctx = &req_ctx;
+
+    while (!stop->load(std::memory_order_relaxed)) {
+      server_stats_nfsv4_op_done(NFS4_OP_PUTFH, 0, NFS4_OK);
+      server_stats_io_done(4096, 4096, true, false);
+      server_stats_nfsv4_op_done(NFS4_OP_READ, 0, NFS4_OK);
+      server_stats_compound_done(2, NFS4_OK);
+      ++n;
+    }
+    *compounds = n;
+    op_ctx = nullptr;
+  }
+
+  uint64_t run(int nthreads) {
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> counts(nthreads * 8, 0); /* avoid sharing */
+    std::vector<std::thread> threads;
+    uint64_t total = 0;
+
+    for (int ix = 0; ix < nthreads; ++ix)
+      threads.emplace_back(worker, &stop, &counts[ix * 8]);
+    std::this_thread::sleep_for(std::chrono::seconds(duration));
+    stop = true;
+    for (auto& t : threads)
+      t.join();
+    for (int ix = 0; ix < nthreads; ++ix)
+      total += counts[ix * 8];
+    return total;
+  }
+
+  void shard_sums(bool shard_client_stats) {
+    int ncpus = std::thread::hardware_concurrency();
+    int nthreads = ncpus > 1 ? ncpus : 2;
+    uint64_t putfh_before, read_before, compounds;
+
+    nfs_param.core_param.enable_FASTSTATS = false;
+    nfs_param.core_param.shard_client_stats = shard_client_stats;
+    server_stats_init();
+
+    exp_stats = (struct export_stats*) calloc(1, sizeof(*exp_stats));
+    cl_stats = (struct server_stats*) calloc(1, sizeof(*cl_stats));
+    ASSERT_NE(exp_stats, nullptr);
+    ASSERT_NE(cl_stats, nullptr);
+    pthread_rwlock_init(&exp_stats->export.lock, nullptr);
+    pthread_rwlock_init(&cl_stats->client.lock, nullptr);
+
+    putfh_before = server_stats_v4_op_total(NFS4_OP_PUTFH);
+    read_before = server_stats_v4_op_total(NFS4_OP_READ);
+
+    compounds = run(nthreads);
+
+    ASSERT_GT(compounds, 0u);
+    EXPECT_EQ(server_stats_v41_reads(&exp_stats->st), compounds);
+    EXPECT_EQ(server_stats_v41_reads(&cl_stats->st), compounds);
+    EXPECT_EQ(server_stats_v4_op_total(NFS4_OP_PUTFH) - putfh_before,
+	      compounds);
+    EXPECT_EQ(server_stats_v4_op_total(NFS4_OP_READ) - read_before,
+	      compounds);
+
+    server_stats_free(&exp_stats->st);
+    server_stats_free(&cl_stats->st);
+    pthread_rwlock_destroy(&exp_stats->export.lock);
+    pthread_rwlock_destroy(&cl_stats->client.lock);
+    free(exp_stats);
+    free(cl_stats);
+    exp_stats = nullptr;
+    cl_stats = nullptr;
+  }
+
+} /* namespace */
+
+TEST(SERVER_STATS1, SHARD_SUMS)
+{
+  shard_sums(false);
+}
+
+TEST(SERVER_STATS1, SHARD_SUMS_CLIENT_SHARDS)
+{
+  shard_sums(true);
+}
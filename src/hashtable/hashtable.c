@@ -39,6 +39,17 @@
  * determines which of the partitions (each containing a tree and each
  * separately locked), and a hash which acts as the key within an
  * individual Red-Black Tree.
+ *
+ * Tables created with HT_FLAG_RCU also link every entry onto a chained
+ * index in its partition, which lookups without may_write search
+ * without taking the partition lock.  Such a reader only announces
+ * itself by incrementing a counter in one of several cache-line
+ * separated shards, chosen per thread, so readers on different CPUs
+ * do not contend.  Writers, still serialized by the partition lock,
+ * publish changes with atomic pointer stores and, before freeing
+ * anything they unlinked, wait for the readers of the partition that
+ * could have seen it.  The counters come in two phases, so a writer
+ * only waits for readers that started before it, not for new ones.
  */
 
 #include "config.h"
@@ -50,7 +61,59 @@
 #include "log.h"
 #include "abstract_atomic.h"
 #include "common_utils.h"
+#include "gsh_intrinsic.h"
 #include <assert.h>
+#include <sched.h>
+
+/** Reader counter shards in each partition of an HT_FLAG_RCU table */
+#define HT_RCU_SHARDS 16
+
+/** Initial number of chains in each partition */
+#define HT_RCU_MIN_BITS 6
+
+/**
+ * @brief Readers of one shard of a partition, by phase
+ */
+struct hash_rcu_shard {
+	uint32_t readers[2];
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
+
+/**
+ * @brief An entry of an HT_FLAG_RCU table
+ *
+ * The opaque pointer of the tree node points to the data, so entries
+ * are found from the tree as in any other table.
+ */
+struct hash_rcu_node {
+	struct hash_data data; /*< Key and value, must be first */
+	struct hash_rcu_node *next; /*< Next on the chain */
+	uint64_t rbt_hash; /*< Red-black hash of the key */
+};
+
+/**
+ * @brief The chains of a partition
+ */
+struct hash_rcu_chains {
+	uint32_t bits; /*< log2 of the number of chains */
+	struct hash_rcu_node *heads[]; /*< The chains */
+};
+
+/**
+ * @brief Lock-free index of a partition
+ */
+struct hash_rcu {
+	struct hash_rcu_shard shards[HT_RCU_SHARDS]; /*< Reader counters */
+	struct hash_rcu_chains *chains; /*< Current chains */
+	uint32_t phase; /*< Phase new readers count themselves in */
+	pthread_mutex_t sync_lock; /*< Serializes grace periods */
+	uint64_t gp_seq; /*< Grace periods completed */
+};
+
+/** Reader shard of this thread, plus one */
+static __thread uint32_t rcu_thread_shard;
+
+/** Shard to give the next thread */
+static uint32_t rcu_next_shard;
 
 /**
  * @brief Total size of the cache page configured for a table
@@ -268,6 +331,265 @@ compute(struct hash_table *ht, const struct gsh_buffdesc *key,
 	return HASHTABLE_SUCCESS;
 }
 
+/**
+ * @brief Start a lock-free read of a partition
+ *
+ * @param[in] rcu The partition's index
+ *
+ * @return Token to pass to rcu_read_unlock, never 0.
+ */
+static inline uint32_t
+rcu_read_lock(struct hash_rcu *rcu)
+{
+	uint32_t shard, phase;
+
+	if (unlikely(rcu_thread_shard == 0))
+		rcu_thread_shard = atomic_inc_uint32_t(&rcu_next_shard);
+
+	shard = (rcu_thread_shard - 1) % HT_RCU_SHARDS;
+	phase = atomic_fetch_uint32_t(&rcu->phase) & 1;
+
+	/* Full barrier: the chains are read only after this is seen */
+	(void) atomic_inc_uint32_t(&rcu->shards[shard].readers[phase]);
+
+	return ((shard << 1) | phase) + 1;
+}
+
+/**
+ * @brief End a lock-free read of a partition
+ *
+ * @param[in] rcu    The partition's index
+ * @param[in] reader Token from rcu_read_lock
+ */
+static inline void
+rcu_read_unlock(struct hash_rcu *rcu, uint32_t reader)
+{
+	reader--;
+	(void) atomic_dec_uint32_t(&rcu->shards[reader >> 1].
+				   readers[reader & 1]);
+}
+
+static void
+rcu_wait_readers(struct hash_rcu *rcu, uint32_t phase)
+{
+	int shard;
+
+	for (shard = 0; shard < HT_RCU_SHARDS; shard++)
+		while (atomic_fetch_uint32_t(&rcu->shards[shard].
+					     readers[phase]) != 0)
+			sched_yield();
+}
+
+/**
+ * @brief Wait for lock-free readers that may see removed entries
+ *
+ * Called without the partition lock, after removed entries have been
+ * unlinked from the chains and @c seq read.  Readers that count
+ * themselves after the phase flips see the chains without them.  Those
+ * left over in the other phase from before the previous flip are
+ * waited for first, so that no reader is missed.
+ *
+ * Grace periods are run one at a time.  If two have completed since
+ * @c seq was read, the second started after the entries were unlinked
+ * and there is nothing left to wait for.
+ *
+ * @param[in] rcu The partition's index
+ * @param[in] seq rcu->gp_seq read after unlinking
+ */
+static void
+rcu_synchronize(struct hash_rcu *rcu, uint64_t seq)
+{
+	uint32_t phase;
+
+	PTHREAD_MUTEX_lock(&rcu->sync_lock);
+
+	if (atomic_fetch_uint64_t(&rcu->gp_seq) < seq + 2) {
+		phase = atomic_fetch_uint32_t(&rcu->phase) & 1;
+		rcu_wait_readers(rcu, phase ^ 1);
+		(void) atomic_inc_uint32_t(&rcu->phase);
+		rcu_wait_readers(rcu, phase);
+		(void) atomic_inc_uint64_t(&rcu->gp_seq);
+	}
+
+	PTHREAD_MUTEX_unlock(&rcu->sync_lock);
+}
+
+/**
+ * @brief Free chains and the entries on them
+ *
+ * @param[in] ht     The hash table
+ * @param[in] chains Chains no reader can reach any more
+ */
+static void
+rcu_free_chains(struct hash_table *ht, struct hash_rcu_chains *chains)
+{
+	struct hash_rcu_node *node, *next;
+	uint64_t chain;
+
+	for (chain = 0; chain < (1ULL << chains->bits); chain++) {
+		for (node = chains->heads[chain]; node != NULL; node = next) {
+			next = node->next;
+			pool_free(ht->data_pool, node);
+		}
+	}
+	gsh_free(chains);
+}
+
+/**
+ * @brief Free what a latch retired, once lock-free readers are done
+ *
+ * Called after the partition lock is released.
+ *
+ * @param[in] ht     The hash table
+ * @param[in] rcu    The partition's index
+ * @param[in] latch  Copy of the released latch
+ */
+static void
+rcu_reclaim(struct hash_table *ht, struct hash_rcu *rcu,
+	    const struct hash_latch *latch)
+{
+	rcu_synchronize(rcu, latch->retired_seq);
+
+	if (latch->retired != NULL)
+		pool_free(ht->data_pool, latch->retired);
+
+	if (latch->retired_chains != NULL)
+		rcu_free_chains(ht, latch->retired_chains);
+}
+
+/**
+ * @brief Chain on which a hash belongs
+ *
+ * The red-black hash is mixed first, since some tables only fill its
+ * low bits.
+ */
+static inline uint64_t
+rcu_chain(const struct hash_rcu_chains *chains, uint64_t rbt_hash)
+{
+	return (rbt_hash * 0x9e3779b97f4a7c15ULL) >> (64 - chains->bits);
+}
+
+static struct hash_rcu_chains *
+rcu_chains_alloc(uint32_t bits)
+{
+	struct hash_rcu_chains *chains;
+
+	chains = gsh_calloc(1, sizeof(struct hash_rcu_chains) +
+			    (sizeof(struct hash_rcu_node *) << bits));
+	chains->bits = bits;
+
+	return chains;
+}
+
+/**
+ * @brief Look up a key on the chains, without the lock
+ *
+ * @param[in] ht      The hash table
+ * @param[in] rcu     The partition's index, with a read in progress
+ * @param[in] key     The key to look up
+ * @param[in] rbthash Hash of the key
+ *
+ * @return The entry or NULL.
+ */
+static struct hash_rcu_node *
+rcu_locate(struct hash_table *ht, struct hash_rcu *rcu,
+	   const struct gsh_buffdesc *key, uint64_t rbthash)
+{
+	struct hash_rcu_chains *chains;
+	struct hash_rcu_node *node;
+
+	chains = atomic_fetch_voidptr((void **)&rcu->chains);
+	node = atomic_fetch_voidptr((void **)
+				    &chains->heads[rcu_chain(chains,
+							     rbthash)]);
+
+	while (node != NULL) {
+		if (node->rbt_hash == rbthash &&
+		    ht->parameter.compare_key((struct gsh_buffdesc *)key,
+					      &node->data.key) == 0)
+			return node;
+		node = atomic_fetch_voidptr((void **)&node->next);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Find the pointer to an entry on its chain
+ *
+ * Called with the partition write-locked.
+ */
+static struct hash_rcu_node **
+rcu_link(struct hash_rcu *rcu, struct hash_rcu_node *node)
+{
+	struct hash_rcu_node **link;
+
+	link = &rcu->chains->heads[rcu_chain(rcu->chains, node->rbt_hash)];
+	while (*link != node)
+		link = &(*link)->next;
+
+	return link;
+}
+
+/**
+ * @brief Double the chains of a partition once they get long
+ *
+ * Called with the partition write-locked.  Lock-free readers may still
+ * be on the old chains, so the new ones are built from copies of the
+ * entries, which the tree is then pointed at, and the old chains are
+ * left on the latch to be freed once those readers are done.
+ *
+ * @param[in] ht        The hash table
+ * @param[in] partition The partition
+ * @param[in,out] latch The write latch held on it
+ */
+static void
+rcu_grow(struct hash_table *ht, struct hash_partition *partition,
+	 struct hash_latch *latch)
+{
+	struct hash_rcu *rcu = partition->rcu;
+	struct hash_rcu_chains *old = rcu->chains, *chains;
+	struct hash_rcu_node *node, *copy;
+	struct rbt_node *it;
+	uint64_t chain;
+
+	if (partition->count <= (2ULL << old->bits) || old->bits >= 24)
+		return;
+
+	chains = rcu_chains_alloc(old->bits + 1);
+
+	RBT_LOOP(&partition->rbt, it) {
+		node = RBT_OPAQ(it);
+		copy = pool_alloc(ht->data_pool);
+		*copy = *node;
+		chain = rcu_chain(chains, copy->rbt_hash);
+		copy->next = chains->heads[chain];
+		chains->heads[chain] = copy;
+		RBT_OPAQ(it) = copy;
+		RBT_INCREMENT(it);
+	}
+
+	atomic_store_voidptr((void **)&rcu->chains, chains);
+	latch->retired_chains = old;
+	latch->retired_seq = atomic_fetch_uint64_t(&rcu->gp_seq);
+
+	LogDebug(COMPONENT_HASHTABLE,
+		 "%s partition %td now has %u chains for %zu entries",
+		 ht->parameter.ht_name, partition - ht->partitions,
+		 1U << chains->bits, partition->count);
+}
+
+static void
+rcu_destroy(struct hash_rcu *rcu)
+{
+	if (rcu == NULL)
+		return;
+
+	PTHREAD_MUTEX_destroy(&rcu->sync_lock);
+	gsh_free(rcu->chains);
+	gsh_free(rcu);
+}
+
 /* The following are the hash table primitives implementing the
    actual functionality. */
 
@@ -340,11 +662,24 @@ hashtable_init(struct hash_param *hparam)
 		if (hparam->flags & HT_FLAG_CACHE)
 			partition->cache = gsh_calloc(1, cache_page_size(ht));
 
+		if (hparam->flags & HT_FLAG_RCU) {
+			partition->rcu =
+			    gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+					       sizeof(struct hash_rcu));
+			memset(partition->rcu, 0, sizeof(struct hash_rcu));
+			PTHREAD_MUTEX_init(&partition->rcu->sync_lock, NULL);
+			partition->rcu->chains =
+			    rcu_chains_alloc(HT_RCU_MIN_BITS);
+		}
+
 		completed++;
 	}
 
 	ht->node_pool = pool_basic_init(NULL, sizeof(rbt_node_t));
-	ht->data_pool = pool_basic_init(NULL, sizeof(struct hash_data));
+	ht->data_pool = pool_basic_init(NULL,
+					(hparam->flags & HT_FLAG_RCU)
+					? sizeof(struct hash_rcu_node)
+					: sizeof(struct hash_data));
 
 	pthread_rwlockattr_destroy(&rwlockattr);
 	return ht;
@@ -355,6 +690,8 @@ hashtable_init(struct hash_param *hparam)
 		if (hparam->flags & HT_FLAG_CACHE)
 			gsh_free(ht->partitions[completed - 1].cache);
 
+		rcu_destroy(ht->partitions[completed - 1].rcu);
+
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[completed - 1].lock));
 		completed--;
 	}
@@ -399,6 +736,9 @@ hashtable_destroy(struct hash_table *ht,
 			ht->partitions[index].cache = NULL;
 		}
 
+		rcu_destroy(ht->partitions[index].rcu);
+		ht->partitions[index].rcu = NULL;
+
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[index].lock));
 	}
 	pool_destroy(ht->node_pool);
@@ -417,6 +757,10 @@ hashtable_destroy(struct hash_table *ht,
  * activities.  This function is a primitive and is intended more for
  * use building other access functions than for client code itself.
  *
+ * In an HT_FLAG_RCU table, a latch taken without may_write does not
+ * lock the partition, but entries are still not freed until it is
+ * released.
+ *
  * @brief[in]  ht        The hash table to search
  * @brief[in]  key       The key for which to search
  * @brief[out] val       The value found
@@ -447,6 +791,10 @@ hashtable_getlatch(struct hash_table *ht,
 	uint64_t rbt_hash = 0;
 	/* Stored error return */
 	hash_error_t rc = HASHTABLE_SUCCESS;
+	/* Lock-free index of the partition */
+	struct hash_rcu *rcu;
+	/* Lock-free read in progress, if not 0 */
+	uint32_t reader = 0;
 
 	/* This combination of options makes no sense ever */
 	assert(!(may_write && !latch));
@@ -455,17 +803,32 @@ hashtable_getlatch(struct hash_table *ht,
 	if (rc != HASHTABLE_SUCCESS)
 		return rc;
 
-	/* Acquire mutex */
-	if (may_write)
-		PTHREAD_RWLOCK_wrlock(&(ht->partitions[index].lock));
-	else
-		PTHREAD_RWLOCK_rdlock(&(ht->partitions[index].lock));
+	rcu = ht->partitions[index].rcu;
 
-	rc = key_locate(ht, key, index, rbt_hash, &locator);
+	if (rcu != NULL && !may_write) {
+		/* Search the chains instead of the tree */
+		struct hash_rcu_node *node;
+
+		reader = rcu_read_lock(rcu);
+		node = rcu_locate(ht, rcu, key, rbt_hash);
+		if (node != NULL)
+			data = &node->data;
+		else
+			rc = HASHTABLE_ERROR_NO_SUCH_KEY;
+	} else {
+		/* Acquire mutex */
+		if (may_write)
+			PTHREAD_RWLOCK_wrlock(&(ht->partitions[index].lock));
+		else
+			PTHREAD_RWLOCK_rdlock(&(ht->partitions[index].lock));
+
+		rc = key_locate(ht, key, index, rbt_hash, &locator);
+		if (rc == HASHTABLE_SUCCESS)
+			data = RBT_OPAQ(locator);
+	}
 
 	if (rc == HASHTABLE_SUCCESS) {
 		/* Key was found */
-		data = RBT_OPAQ(locator);
 		if (val) {
 			val->addr = data->val.addr;
 			val->len = data->val.len;
@@ -492,6 +855,11 @@ hashtable_getlatch(struct hash_table *ht,
 		latch->index = index;
 		latch->rbt_hash = rbt_hash;
 		latch->locator = locator;
+		latch->reader = reader;
+		latch->retired = NULL;
+		latch->retired_chains = NULL;
+	} else if (reader != 0) {
+		rcu_read_unlock(rcu, reader);
 	} else {
 		PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
 	}
@@ -515,6 +883,10 @@ hashtable_getlatch(struct hash_table *ht,
  * freed by some other means (hashtable_setlatched or
  * HashTable_DelLatched).
  *
+ * In an HT_FLAG_RCU table, entries removed under the latch are freed
+ * here, once the lock is released and lock-free readers that may have
+ * found them are done.
+ *
  * @param[in] ht    The hash table with the lock to be released
  * @param[in] latch The latch structure holding retained state
  */
@@ -522,9 +894,23 @@ hashtable_getlatch(struct hash_table *ht,
 void
 hashtable_releaselatched(struct hash_table *ht, struct hash_latch *latch)
 {
+	struct hash_rcu *rcu;
+	struct hash_latch retired;
+
 	if (latch) {
-		PTHREAD_RWLOCK_unlock(&ht->partitions[latch->index].lock);
+		rcu = ht->partitions[latch->index].rcu;
+		retired = *latch;
+
+		if (latch->reader != 0)
+			rcu_read_unlock(rcu, latch->reader);
+		else
+			PTHREAD_RWLOCK_unlock(
+				&ht->partitions[latch->index].lock);
 		memset(latch, 0, sizeof(struct hash_latch));
+
+		if (retired.retired != NULL ||
+		    retired.retired_chains != NULL)
+			rcu_reclaim(ht, rcu, &retired);
 	}
 }
 
@@ -571,6 +957,8 @@ hashtable_setlatched(struct hash_table *ht,
 	struct rbt_node *locator = NULL;
 	/* New node for the case of non-overwrite */
 	struct rbt_node *mutator = NULL;
+	/* Its partition */
+	struct hash_partition *partition = &ht->partitions[latch->index];
 
 	if (isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -635,9 +1023,31 @@ hashtable_setlatched(struct hash_table *ht,
 		if (stored_val)
 			*stored_val = descriptors->val;
 
+		rc = HASHTABLE_OVERWRITTEN;
+
+		if (partition->rcu != NULL) {
+			/* Lock-free readers must not see the key and value
+			   change under them, so replace the entry. */
+			struct hash_rcu_node *old = RBT_OPAQ(latch->locator);
+			struct hash_rcu_node *node;
+
+			node = pool_alloc(ht->data_pool);
+			node->data.key = *key;
+			node->data.val = *val;
+			node->rbt_hash = old->rbt_hash;
+			node->next = old->next;
+			atomic_store_voidptr((void **)
+					     rcu_link(partition->rcu, old),
+					     node);
+			RBT_OPAQ(latch->locator) = node;
+			latch->retired = old;
+			latch->retired_seq =
+				atomic_fetch_uint64_t(&partition->rcu->gp_seq);
+			goto out;
+		}
+
 		descriptors->key = *key;
 		descriptors->val = *val;
-		rc = HASHTABLE_OVERWRITTEN;
 		goto out;
 	}
 
@@ -663,6 +1073,19 @@ hashtable_setlatched(struct hash_table *ht,
 	/* Only in the non-overwrite case */
 	++ht->partitions[latch->index].count;
 
+	if (partition->rcu != NULL) {
+		/* Publish the entry, filled in, on its chain */
+		struct hash_rcu_node *node = RBT_OPAQ(mutator);
+		struct hash_rcu_chains *chains = partition->rcu->chains;
+		uint64_t chain = rcu_chain(chains, latch->rbt_hash);
+
+		node->rbt_hash = latch->rbt_hash;
+		node->next = chains->heads[chain];
+		atomic_store_voidptr((void **)&chains->heads[chain], node);
+
+		rcu_grow(ht, partition, latch);
+	}
+
 	rc = HASHTABLE_SUCCESS;
 
  out:
@@ -685,6 +1108,12 @@ hashtable_setlatched(struct hash_table *ht,
  * lock is retained. hashtable_getlatch must have been called with
  * may_write true.
  *
+ * In an HT_FLAG_RCU table, the entry is freed by
+ * hashtable_releaselatched, which first waits, without the lock, for
+ * lock-free readers of the partition that may have found it.  A
+ * reference they took under their latch is so taken before the caller
+ * goes on to free the value.
+ *
  * @param[in,out] ht      The hash store to be modified
  * @param[in]     key     A buffer descriptore locating the key to remove
  * @param[in]     latch   A pointer to a structure filled by a previous
@@ -769,7 +1198,17 @@ void hashtable_deletelatched(struct hash_table *ht,
 
 	/* Now remove the entry */
 	RBT_UNLINK(&partition->rbt, latch->locator);
-	pool_free(ht->data_pool, data);
+	if (partition->rcu != NULL) {
+		struct hash_rcu_node *node = RBT_OPAQ(latch->locator);
+
+		atomic_store_voidptr((void **)rcu_link(partition->rcu, node),
+				     node->next);
+		latch->retired = node;
+		latch->retired_seq =
+			atomic_fetch_uint64_t(&partition->rcu->gp_seq);
+	} else {
+		pool_free(ht->data_pool, data);
+	}
 	pool_free(ht->node_pool, latch->locator);
 	--ht->partitions[latch->index].count;
 }
@@ -799,9 +1238,21 @@ hashtable_delall(struct hash_table *ht,
 		struct rbt_head *root = &ht->partitions[index].rbt;
 		/* Pointer to node in tree for removal */
 		struct rbt_node *cursor = NULL;
+		/* Lock-free index of the partition */
+		struct hash_rcu *rcu = ht->partitions[index].rcu;
+		/* Its chains, taken away from readers */
+		struct hash_rcu_chains *old = NULL;
 
 		PTHREAD_RWLOCK_wrlock(&ht->partitions[index].lock);
 
+		if (rcu != NULL) {
+			/* Readers are given empty chains; the entries on
+			   the old ones are freed once they are done */
+			old = rcu->chains;
+			atomic_store_voidptr((void **)&rcu->chains,
+					     rcu_chains_alloc(HT_RCU_MIN_BITS));
+		}
+
 		/* Continue until there are no more entries in the red-black
 		   tree */
 		while ((cursor = RBT_LEFTMOST(root)) != NULL) {
@@ -821,13 +1272,16 @@ hashtable_delall(struct hash_table *ht,
 
 			RBT_UNLINK(root, cursor);
 			data = RBT_OPAQ(holder);
+			pool_free(ht->node_pool, holder);
+			--ht->partitions[index].count;
+
+			if (rcu != NULL)
+				continue;
 
 			key = data->key;
 			val = data->val;
 
 			pool_free(ht->data_pool, data);
-			pool_free(ht->node_pool, holder);
-			--ht->partitions[index].count;
 			rc = free_func(key, val);
 
 			if (rc == 0) {
@@ -837,6 +1291,27 @@ hashtable_delall(struct hash_table *ht,
 			}
 		}
 		PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
+
+		if (old != NULL) {
+			struct hash_rcu_node *node;
+			uint64_t chain;
+			bool failed = false;
+
+			rcu_synchronize(rcu,
+					atomic_fetch_uint64_t(&rcu->gp_seq));
+
+			for (chain = 0; chain < (1ULL << old->bits); chain++)
+				for (node = old->heads[chain]; node != NULL;
+				     node = node->next)
+					if (free_func(node->data.key,
+						      node->data.val) == 0)
+						failed = true;
+
+			rcu_free_chains(ht, old);
+
+			if (failed)
+				return HASHTABLE_ERROR_DELALL_FAIL;
+		}
 	}
 
 	return HASHTABLE_SUCCESS;
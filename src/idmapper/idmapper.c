@@ -52,10 +52,44 @@
 #include "common_utils.h"
 #include "gsh_rpc.h"
 #include "nfs_core.h"
+#include "fridgethr.h"
 #include "idmapper.h"
 
 static struct gsh_buffdesc owner_domain;
 
+/**
+ * @brief Threads looking up expired cache entries again
+ */
+
+static struct fridgethr *idmapper_fridge;
+
+/**
+ * @brief Outcome of asking the password database or nfsidmap
+ */
+
+enum idmapper_resolve {
+	RESOLVE_FOUND,		/*< Mapped */
+	RESOLVE_NOT_FOUND,	/*< There is no such name or ID */
+	RESOLVE_ERROR,		/*< The look up itself failed */
+	RESOLVE_BAD_NAME,	/*< Not a name we would ever map */
+};
+
+/**
+ * @brief An expired cache entry to look up again
+ */
+
+struct idmapper_refresh {
+	enum idmapper_map map;	/*< The map holding the entry */
+	uint32_t id;		/*< ID, for IDMAPPER_UID and IDMAPPER_GID */
+	bool principal;		/*< The name is a GSS principal */
+	struct gsh_buffdesc name;	/*< NUL terminated name, for
+					    IDMAPPER_UNAME and
+					    IDMAPPER_GNAME */
+};
+
+static void idmapper_queue_refresh(enum idmapper_map,
+				   const struct gsh_buffdesc *, uint32_t, bool);
+
 /**
  * @brief Initialize the ID Mapper
  *
@@ -64,6 +98,9 @@ static struct gsh_buffdesc owner_domain;
 
 bool idmapper_init(void)
 {
+	struct fridgethr_params frp;
+	int rc;
+
 #ifdef USE_NFSIDMAP
 	if (!nfs_param.nfsv4_param.use_getpwnam) {
 		if (nfs4_init_name_mapping(nfs_param.nfsv4_param.idmapconf)
@@ -87,9 +124,166 @@ bool idmapper_init(void)
 	}
 
 	idmapper_cache_init();
+
+	/* A couple of threads are plenty, each entry is refreshed at
+	 * most once at a time and a stalled directory service should
+	 * not pile up threads.
+	 */
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 2;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&idmapper_fridge, "Idmap_Refresh", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize idmapper refresh fridge, error code %d.",
+			 rc);
+		return false;
+	}
+
 	return true;
 }
 
+/**
+ * @brief Stop the ID Mapper's refresh threads
+ */
+
+void idmapper_shutdown(void)
+{
+	int rc;
+
+	if (idmapper_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(idmapper_fridge, fridgethr_comm_stop, 10);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(idmapper_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Failed shutting down idmapper refresh fridge: %d",
+			 rc);
+	}
+}
+
+/**
+ * @brief Look up the name of a UID or GID
+ *
+ * @param[in]     id    UID or GID
+ * @param[in]     group True if this is a GID, false for a UID
+ * @param[in,out] name  Buffer of IDMAPPER_NAME_MAX bytes, its length
+ *                      is set to that of the name found.
+ *
+ * @return Whether the name was found.
+ */
+
+static enum idmapper_resolve id2name(uint32_t id, bool group,
+				     struct gsh_buffdesc *name)
+{
+	int rc;
+
+	if (nfs_param.nfsv4_param.use_getpwnam) {
+		const char *found = NULL;
+		char *cursor = name->addr;
+		size_t len;
+		char *buf;
+		int size;
+
+		if (group)
+			size = sysconf(_SC_GETGR_R_SIZE_MAX);
+		else
+			size = sysconf(_SC_GETPW_R_SIZE_MAX);
+		if (size == -1)
+			size = PWENT_BEST_GUESS_LEN;
+
+		buf = alloca(size);
+
+		if (group) {
+			struct group g;
+			struct group *gres;
+
+			rc = getgrgid_r(id, &g, buf, size, &gres);
+			if (rc == 0 && gres != NULL)
+				found = gres->gr_name;
+		} else {
+			struct passwd p;
+			struct passwd *pres;
+
+			rc = getpwuid_r(id, &p, buf, size, &pres);
+			if (rc == 0 && pres != NULL)
+				found = pres->pw_name;
+		}
+
+		if (rc != 0) {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "getgrgid_r" : "getpwuid_r"), rc);
+			return RESOLVE_ERROR;
+		}
+
+		if (found == NULL)
+			return RESOLVE_NOT_FOUND;
+
+		len = strlen(found);
+		if (len + 1 + owner_domain.len > IDMAPPER_NAME_MAX)
+			return RESOLVE_NOT_FOUND;
+
+		memcpy(cursor, found, len);
+		cursor += len;
+		*(cursor++) = '@';
+		memcpy(cursor, owner_domain.addr, owner_domain.len);
+		name->len = len + 1 + owner_domain.len;
+		return RESOLVE_FOUND;
+	}
+
+#ifdef USE_NFSIDMAP
+	if (group) {
+		rc = nfs4_gid_to_name(id, owner_domain.addr, name->addr,
+				      IDMAPPER_NAME_MAX);
+	} else {
+		rc = nfs4_uid_to_name(id, owner_domain.addr, name->addr,
+				      IDMAPPER_NAME_MAX);
+	}
+	if (rc == 0) {
+		name->len = strlen(name->addr);
+		return RESOLVE_FOUND;
+	}
+
+	LogInfo(COMPONENT_IDMAPPER, "%s failed with code %d.",
+		(group ? "nfs4_gid_to_name" : "nfs4_uid_to_name"), rc);
+	return rc == -ENOENT ? RESOLVE_NOT_FOUND : RESOLVE_ERROR;
+#else				/* USE_NFSIDMAP */
+	return RESOLVE_NOT_FOUND;
+#endif				/* !USE_NFSIDMAP */
+}
+
+/**
+ * @brief Make up a name for an ID that could not be looked up
+ *
+ * @param[in]     id    UID or GID
+ * @param[in]     group True if this is a GID, false for a UID
+ * @param[in,out] name  Buffer of IDMAPPER_NAME_MAX bytes
+ */
+
+static void id2fallback(uint32_t id, bool group, struct gsh_buffdesc *name)
+{
+	if (nfs_param.nfsv4_param.allow_numeric_owners) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"Lookup for %d failed, using numeric %s",
+			id, (group ? "group" : "owner"));
+		/* 2**32 is 10 digits long in decimal */
+		name->len = sprintf(name->addr, "%"PRIu32, id);
+	} else {
+		LogInfo(COMPONENT_IDMAPPER,
+			"Lookup for %d failed, using nobody.", id);
+		memcpy(name->addr, "nobody", 6);
+		name->len = 6;
+	}
+}
+
 /**
  * @brief Encode a UID or GID as a string
  *
@@ -103,13 +297,16 @@ bool idmapper_init(void)
 
 static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 {
-	const struct gsh_buffdesc *found;
+	enum idmapper_map map = group ? IDMAPPER_GID : IDMAPPER_UID;
+	enum idmapper_status status;
+	enum idmapper_resolve res;
+	char namebuff[IDMAPPER_NAME_MAX];
+	struct gsh_buffdesc name;
 	uint32_t not_a_size_t;
 	bool success = false;
 
 	if (nfs_param.nfsv4_param.only_numeric_owners) {
 		/* 2**32 is 10 digits long in decimal */
-		struct gsh_buffdesc name;
 		char namebuf[11];
 
 		name.addr = namebuf;
@@ -120,146 +317,26 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 					&not_a_size_t, UINT32_MAX);
 	}
 
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-	if (group)
-		success = idmapper_lookup_by_gid(id, &found);
-	else
-		success = idmapper_lookup_by_uid(id, &found, NULL);
-
-	if (likely(success)) {
-		not_a_size_t = found->len;
-
-		/* Fully qualified owners are always stored in the
-		   hash table, no matter what our lookup method. */
-		success =
-		    inline_xdr_bytes(xdrs, (char **)&found->addr, &not_a_size_t,
-				     UINT32_MAX);
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+	/* Fully qualified owners are always stored in the cache, no
+	   matter what our lookup method, and already XDR encoded. */
+	status = idmapper_encode_id(map, id, xdrs, &success);
+	if (likely(status != IDMAPPER_MISS)) {
+		if (unlikely(status == IDMAPPER_STALE))
+			idmapper_queue_refresh(map, NULL, id, false);
 		return success;
-	} else {
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		int rc;
-		int size;
-		bool looked_up = false;
-		char *namebuff = NULL;
-		struct gsh_buffdesc new_name;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			if (group)
-				size = sysconf(_SC_GETGR_R_SIZE_MAX);
-			else
-				size = sysconf(_SC_GETPW_R_SIZE_MAX);
-			if (size == -1)
-				size = PWENT_BEST_GUESS_LEN;
-			new_name.len = size;
-			size += owner_domain.len + 2;
-		} else {
-			size = NFS4_MAX_DOMAIN_LEN + 2;
-		}
-
-		namebuff = alloca(size);
-
-		new_name.addr = namebuff;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			char *cursor;
-			bool nulled;
-
-			if (group) {
-				struct group g;
-				struct group *gres;
+	}
 
-				rc = getgrgid_r(id, &g, namebuff, new_name.len,
-						&gres);
-				nulled = (gres == NULL);
-			} else {
-				struct passwd p;
-				struct passwd *pres;
+	name.addr = namebuff;
+	res = id2name(id, group, &name);
+	if (res != RESOLVE_FOUND)
+		id2fallback(id, group, &name);
 
-				rc = getpwuid_r(id, &p, namebuff, new_name.len,
-						&pres);
-				nulled = (pres == NULL);
-			}
+	/* Add to the cache and encode the result. */
+	idmapper_cache_set(map, &name, id, NULL, res != RESOLVE_FOUND);
 
-			if ((rc == 0) && !nulled) {
-				new_name.len = strlen(namebuff);
-				cursor = namebuff + new_name.len;
-				*(cursor++) = '@';
-				++new_name.len;
-				memcpy(cursor, owner_domain.addr,
-				       owner_domain.len);
-				new_name.len += owner_domain.len;
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "getgrgid_r" : "getpwuid_r"),
-					rc);
-			}
-		} else {
-#ifdef USE_NFSIDMAP
-			if (group) {
-				rc = nfs4_gid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			} else {
-				rc = nfs4_uid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			}
-			if (rc == 0) {
-				new_name.len = strlen(namebuff);
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "nfs4_gid_to_name" :
-					"nfs4_uid_to_name"), rc);
-			}
-#else				/* USE_NFSIDMAP */
-			looked_up = false;
-#endif				/* !USE_NFSIDMAP */
-		}
-
-		if (!looked_up) {
-			if (nfs_param.nfsv4_param.allow_numeric_owners) {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using numeric %s",
-					id, (group ? "group" : "owner"));
-				/* 2**32 is 10 digits long in decimal */
-				sprintf(namebuff, "%"PRIu32, id);
-				new_name.len = strlen(namebuff);
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using nobody.",
-					id);
-				memcpy(new_name.addr, "nobody", 6);
-				new_name.len = 6;
-			}
-		}
-
-		/* Add to the cache and encode the result. */
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(&new_name, id);
-		else
-			success = idmapper_add_user(&new_name, id, NULL, false);
-
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (unlikely(!success)) {
-			LogMajor(COMPONENT_IDMAPPER, "%s failed.",
-				 group ? "idmapper_add_group" :
-				 "idmaper_add_user");
-		}
-		not_a_size_t = new_name.len;
-		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
-					&not_a_size_t, UINT32_MAX);
-	}
+	not_a_size_t = name.len;
+	return inline_xdr_bytes(xdrs, (char **)&name.addr, &not_a_size_t,
+				UINT32_MAX);
 }
 
 /**
@@ -295,29 +372,29 @@ bool xdr_encode_nfs4_group(XDR *xdrs, gid_t gid)
 /**
  * @brief Handle unqualified names
  *
+ * "nobody" is left to each export's anonymous ID, so it counts as not
+ * found.
+ *
  * @param[in]  name C string of name
  * @param[in]  len  Length of name
  * @param[out] id   ID found
- * @param[in]  anon ID to use in case of nobody
  *
- * @return true on success, false on just phoning it in.
+ * @return Whether the name is numeric, nobody, or neither.
  */
 
-static bool atless2id(char *name, size_t len, uint32_t *id,
-		      const uint32_t anon)
+static enum idmapper_resolve atless2id(char *name, size_t len, uint32_t *id)
 {
 	if ((len == 6) && (!memcmp(name, "nobody", 6))) {
-		*id = anon;
-		return true;
+		return RESOLVE_NOT_FOUND;
 	} else if (nfs_param.nfsv4_param.allow_numeric_owners) {
 		char *end = NULL;
 		*id = strtol(name, &end, 10);
 		if (!(end && *end != '\0'))
-			return true;
+			return RESOLVE_FOUND;
 	}
 
 	/* Nothing else without an @ is allowed. */
-	return false;
+	return RESOLVE_BAD_NAME;
 }
 
 /**
@@ -381,23 +458,21 @@ static int name_to_gid(const char *name, gid_t *gid)
  * @param[in]  name       C string of name
  * @param[in]  len        Length of name
  * @param[out] id         ID found
- * @param[in]  anon       ID to use in case of nobody
  * @param[in]  group      Whether this a group lookup
- * @param[out] gss_gid    Found GID
- * @param[out] gss_uid    Found UID
- * @apram[out] gotgss_gid Found a GID.
+ * @param[out] gid        Found GID
+ * @param[out] got_gid    Found a GID.
  * @param[in]  at         Location of the @
  *
- * @return true on success, false not making the grade
+ * @return Whether the name was found.
  */
-static bool pwentname2id(char *name, size_t len, uint32_t *id,
-			 const uint32_t anon, bool group, gid_t *gid,
-			 bool *got_gid, char *at)
+static enum idmapper_resolve pwentname2id(char *name, size_t len,
+					  uint32_t *id, bool group,
+					  gid_t *gid, bool *got_gid, char *at)
 {
 	if (at != NULL) {
 		if (strcmp(at + 1, owner_domain.addr) != 0) {
 			/* We won't map what isn't even in the right domain */
-			return false;
+			return RESOLVE_NOT_FOUND;
 		}
 		*at = '\0';
 	}
@@ -406,11 +481,11 @@ static bool pwentname2id(char *name, size_t len, uint32_t *id,
 
 		err = name_to_gid(name, id);
 		if (err == 0)
-			return true;
+			return RESOLVE_FOUND;
 		else if (err != ENOENT) {
 			LogWarn(COMPONENT_IDMAPPER,
 				"getgrnam_r %s failed, error: %d", name, err);
-			return false;
+			return RESOLVE_ERROR;
 		}
 #ifndef USE_NFSIDMAP
 		else {
@@ -419,10 +494,10 @@ static bool pwentname2id(char *name, size_t len, uint32_t *id,
 
 			gid = strtol(name, &end, 10);
 			if (end && *end != '\0')
-				return 0;
+				return RESOLVE_NOT_FOUND;
 
 			*id = gid;
-			return true;
+			return RESOLVE_FOUND;
 		}
 #endif
 	} else {
@@ -439,12 +514,12 @@ static bool pwentname2id(char *name, size_t len, uint32_t *id,
 		if (getpwnam_r(name, &p, buf, size, &pres) != 0) {
 			LogInfo(COMPONENT_IDMAPPER, "getpwnam_r %s failed",
 				name);
-			return false;
+			return RESOLVE_ERROR;
 		} else if (pres != NULL) {
 			*id = pres->pw_uid;
 			*gid = pres->pw_gid;
 			*got_gid = true;
-			return true;
+			return RESOLVE_FOUND;
 		}
 #ifndef USE_NFSIDMAP
 		else {
@@ -453,15 +528,15 @@ static bool pwentname2id(char *name, size_t len, uint32_t *id,
 
 			uid = strtol(name, &end, 10);
 			if (end && *end != '\0')
-				return 0;
+				return RESOLVE_NOT_FOUND;
 
 			*id = uid;
 			*got_gid = false;
-			return true;
+			return RESOLVE_FOUND;
 		}
 #endif
 	}
-	return false;
+	return RESOLVE_NOT_FOUND;
 }
 
 /**
@@ -470,19 +545,17 @@ static bool pwentname2id(char *name, size_t len, uint32_t *id,
  * @param[in]  name       C string of name
  * @param[in]  len        Length of name
  * @param[out] id         ID found
- * @param[in]  anon       ID to use in case of nobody
  * @param[in]  group      Whether this a group lookup
- * @param[out] gss_gid    Found GID
- * @param[out] gss_uid    Found UID
- * @apram[out] gotgss_gid Found a GID.
+ * @param[out] gid        Found GID
+ * @param[out] got_gid    Found a GID.
  * @param[in]  at         Location of the @
  *
- * @return true on success, false not making the grade
+ * @return Whether the name was found.
  */
 
-static bool idmapname2id(char *name, size_t len, uint32_t *id,
-			 const uint32_t anon, bool group, gid_t *gid,
-			 bool *got_gid, char *at)
+static enum idmapper_resolve idmapname2id(char *name, size_t len,
+					  uint32_t *id, bool group,
+					  gid_t *gid, bool *got_gid, char *at)
 {
 #ifdef USE_NFSIDMAP
 	int rc;
@@ -493,17 +566,175 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 		rc = nfs4_name_to_uid(name, id);
 
 	if (rc == 0) {
-		return true;
+		return RESOLVE_FOUND;
 	} else {
 		LogInfo(COMPONENT_IDMAPPER,
 			"%s %s failed with %d, using anonymous.",
 			(group ? "nfs4_name_to_gid" : "nfs4_name_to_uid"), name,
 			-rc);
-		return false;
+		return rc == -ENOENT ? RESOLVE_NOT_FOUND : RESOLVE_ERROR;
 	}
 #else				/* USE_NFSIDMAP */
-	return false;
+	return RESOLVE_NOT_FOUND;
+#endif				/* USE_NFSIDMAP */
+}
+
+/**
+ * @brief Look up the ID of a name
+ *
+ * @param[in]  name    The name
+ * @param[in]  group   True if this is a group name
+ * @param[out] id      The ID found
+ * @param[out] gid     The user's primary GID
+ * @param[out] got_gid Whether gid was found
+ *
+ * @return Whether the name was found.
+ */
+
+static enum idmapper_resolve name2ids(const struct gsh_buffdesc *name,
+				      bool group, uint32_t *id, gid_t *gid,
+				      bool *got_gid)
+{
+	/* Something we can mutate and count on as terminated */
+	char *namebuff = alloca(name->len + 1);
+	enum idmapper_resolve res;
+	char *at;
+
+	memcpy(namebuff, name->addr, name->len);
+	*(namebuff + name->len) = '\0';
+	at = memchr(namebuff, '@', name->len);
+
+	if (at == NULL) {
+		res = pwentname2id(namebuff, name->len, id, group, gid,
+				   got_gid, NULL);
+		if (res == RESOLVE_FOUND || res == RESOLVE_ERROR)
+			return res;
+		return atless2id(namebuff, name->len, id);
+	} else if (nfs_param.nfsv4_param.use_getpwnam) {
+		return pwentname2id(namebuff, name->len, id, group, gid,
+				    got_gid, at);
+	} else {
+		return idmapname2id(namebuff, name->len, id, group, gid,
+				    got_gid, at);
+	}
+}
+
+#ifdef USE_NFSIDMAP
+/**
+ * @brief Look up the IDs of a GSS principal
+ *
+ * @param[in]  principal NUL terminated principal
+ * @param[out] uid       The UID found
+ * @param[out] gid       The GID found
+ *
+ * @return Whether the principal was found.
+ */
+
+static enum idmapper_resolve principal2ids(char *principal, uid_t *uid,
+					   gid_t *gid)
+{
+	/* nfs4_gss_princ_to_ids required to extract uid/gid from gss
+	   creds */
+	int rc = nfs4_gss_princ_to_ids("krb5", principal, uid, gid);
+
+	if (rc == 0)
+		return RESOLVE_FOUND;
+
+	return rc == -ENOENT ? RESOLVE_NOT_FOUND : RESOLVE_ERROR;
+}
 #endif				/* USE_NFSIDMAP */
+
+/**
+ * @brief Look up an expired cache entry again
+ *
+ * If the look up fails for any reason other than the name or ID being
+ * gone, the entry is kept as it was and tried again later, so an
+ * unreachable directory service leaves the cache as it was.
+ *
+ * @param[in] ctx Thread context, its arg is the struct idmapper_refresh
+ */
+
+static void idmapper_refresh(struct fridgethr_context *ctx)
+{
+	struct idmapper_refresh *refresh = ctx->arg;
+	bool group = refresh->map == IDMAPPER_GID ||
+		     refresh->map == IDMAPPER_GNAME;
+	enum idmapper_resolve res;
+	char namebuff[IDMAPPER_NAME_MAX];
+	struct gsh_buffdesc name = {
+		.addr = namebuff
+	};
+	uint32_t id = 0;
+	gid_t gid;
+	bool got_gid = false;
+
+	if (refresh->map == IDMAPPER_UID || refresh->map == IDMAPPER_GID) {
+		res = id2name(refresh->id, group, &name);
+		if (res == RESOLVE_NOT_FOUND)
+			id2fallback(refresh->id, group, &name);
+		if (res == RESOLVE_FOUND || res == RESOLVE_NOT_FOUND)
+			idmapper_cache_set(refresh->map, &name, refresh->id,
+					   NULL, res != RESOLVE_FOUND);
+		else
+			idmapper_cache_retry(refresh->map, NULL, refresh->id);
+		goto out;
+	}
+
+	if (refresh->principal) {
+#ifdef USE_NFSIDMAP
+		res = principal2ids(refresh->name.addr, &id, &gid);
+		got_gid = true;
+#else
+		res = RESOLVE_ERROR;
+#endif
+	} else {
+		res = name2ids(&refresh->name, group, &id, &gid, &got_gid);
+	}
+
+	if (res == RESOLVE_ERROR)
+		idmapper_cache_retry(refresh->map, &refresh->name, 0);
+	else
+		idmapper_cache_set(refresh->map, &refresh->name, id,
+				   got_gid ? &gid : NULL, res != RESOLVE_FOUND);
+
+ out:
+	gsh_free(refresh);
+}
+
+/**
+ * @brief Have an expired cache entry looked up in the background
+ *
+ * @param[in] map       The map holding the entry
+ * @param[in] name      The name, for IDMAPPER_UNAME and IDMAPPER_GNAME
+ * @param[in] id        The ID, for IDMAPPER_UID and IDMAPPER_GID
+ * @param[in] principal The name is a GSS principal
+ */
+
+static void idmapper_queue_refresh(enum idmapper_map map,
+				   const struct gsh_buffdesc *name,
+				   uint32_t id, bool principal)
+{
+	size_t len = name != NULL ? name->len : 0;
+	struct idmapper_refresh *refresh;
+	int rc;
+
+	refresh = gsh_malloc(sizeof(struct idmapper_refresh) + len + 1);
+	refresh->map = map;
+	refresh->id = id;
+	refresh->principal = principal;
+	refresh->name.addr = (char *)refresh + sizeof(*refresh);
+	refresh->name.len = len;
+	if (len != 0)
+		memcpy(refresh->name.addr, name->addr, len);
+	((char *)refresh->name.addr)[len] = '\0';
+
+	rc = fridgethr_submit(idmapper_fridge, idmapper_refresh, refresh);
+	if (rc != 0) {
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Unable to queue refresh, error %d", rc);
+		idmapper_cache_retry(map, name, id);
+		gsh_free(refresh);
+	}
 }
 
 /**
@@ -520,75 +751,35 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		    const uint32_t anon)
 {
-	bool success;
-
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-	if (group)
-		success = idmapper_lookup_by_gname(name, id);
-	else
-		success = idmapper_lookup_by_uname(name, id, NULL, false);
-	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-
-	if (success)
+	enum idmapper_map map = group ? IDMAPPER_GNAME : IDMAPPER_UNAME;
+	struct idmapper_found found;
+	enum idmapper_status status;
+	enum idmapper_resolve res;
+	gid_t gid;
+	bool got_gid = false;
+
+	status = idmapper_lookup_name(map, name, &found);
+	if (likely(status != IDMAPPER_MISS)) {
+		if (unlikely(status == IDMAPPER_STALE))
+			idmapper_queue_refresh(map, name, 0, false);
+		*id = found.negative ? anon : found.id;
 		return true;
-	else {
-		gid_t gid;
-		bool got_gid = false;
-		/* Something we can mutate and count on as terminated */
-		char *namebuff = alloca(name->len + 1);
-		char *at;
-		bool looked_up = false;
-
-		memcpy(namebuff, name->addr, name->len);
-		*(namebuff + name->len) = '\0';
-		at = memchr(namebuff, '@', name->len);
-
-		if (at == NULL) {
-			if (pwentname2id
-			    (namebuff, name->len, id, anon, group, &gid,
-			     &got_gid, NULL))
-				looked_up = true;
-			else if (atless2id(namebuff, name->len, id, anon))
-				looked_up = true;
-			else
-				return false;
-		} else if (nfs_param.nfsv4_param.use_getpwnam) {
-			looked_up =
-			    pwentname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		} else {
-			looked_up =
-			    idmapname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		}
-
-		if (!looked_up) {
-			LogInfo(COMPONENT_IDMAPPER,
-				"All lookups failed for %s, using anonymous.",
-				namebuff);
-			*id = anon;
-		}
-
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(name, *id);
-		else
-			success =
-			    idmapper_add_user(name, *id, got_gid ? &gid : NULL,
-					      false);
+	}
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+	res = name2ids(name, group, id, &gid, &got_gid);
+	if (res == RESOLVE_BAD_NAME)
+		return false;
 
-		if (!success)
-			LogMajor(COMPONENT_IDMAPPER, "%s(%s %u) failed",
-				 (group ? "gidmap_add" : "uidmap_add"),
-				 namebuff, *id);
-		return true;
+	if (res != RESOLVE_FOUND) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"All lookups failed for %.*s, using anonymous.",
+			(int)name->len, (char *)name->addr);
+		*id = anon;
 	}
+
+	idmapper_cache_set(map, name, *id, got_gid ? &gid : NULL,
+			   res != RESOLVE_FOUND);
+	return true;
 }
 
 /**
@@ -648,8 +839,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 #ifdef USE_NFSIDMAP
 	uid_t gss_uid = -1;
 	gid_t gss_gid = -1;
-	const gid_t *gss_gidres = NULL;
-	int rc;
+	struct idmapper_found found;
+	enum idmapper_status status;
 	bool success;
 	struct gsh_buffdesc princbuff = {
 		.addr = principal,
@@ -661,18 +852,18 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 		return false;
 
 #ifdef USE_NFSIDMAP
-	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
-	success =
-	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres, true);
+	status = idmapper_lookup_name(IDMAPPER_UNAME, &princbuff, &found);
+	if (unlikely(status == IDMAPPER_STALE))
+		idmapper_queue_refresh(IDMAPPER_UNAME, &princbuff, 0, true);
 
 	/* We do need uid and gid. If gid is not in the cache, treat it as a
 	 * failure.
 	 */
-	if (success && gss_gidres != NULL)
-		gss_gid = *gss_gidres;
-	else
-		success = false;
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+	success = status != IDMAPPER_MISS && !found.negative && found.gid_set;
+	if (success) {
+		gss_uid = found.id;
+		gss_gid = found.gid;
+	}
 	if (unlikely(!success)) {
 		if ((princbuff.len >= 4)
 		    && (!memcmp(princbuff.addr, "nfs/", 4)
@@ -691,11 +882,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 			*gid = 0;
 			return true;
 		}
-		/* nfs4_gss_princ_to_ids required to extract uid/gid
-		   from gss creds */
-		rc = nfs4_gss_princ_to_ids("krb5", principal, &gss_uid,
-					   &gss_gid);
-		if (rc) {
+		if (principal2ids(principal, &gss_uid, &gss_gid) !=
+		    RESOLVE_FOUND) {
 #ifdef _MSPAC_SUPPORT
 			bool found_uid = false;
 			bool found_gid = false;
@@ -770,16 +958,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
  principal_found:
 #endif
 
-		PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
-		success =
-		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true);
-		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
-
-		if (!success) {
-			LogMajor(COMPONENT_IDMAPPER,
-				 "idmapper_add_user(%s, %d, %d) failed",
-				 principal, gss_uid, gss_gid);
-		}
+		idmapper_cache_set(IDMAPPER_UNAME, &princbuff, gss_uid,
+				   &gss_gid, false);
 	}
 
 	*uid = gss_uid;
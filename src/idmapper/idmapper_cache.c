@@ -30,103 +30,123 @@
 /**
  * @file    idmapper_cache.c
  * @brief   Id mapping cache functions
+ *
+ * Each direction of each mapping is kept on its own, so an entry sits
+ * in a single tree.  Entries are spread over IDMAPPER_SHARDS shards by
+ * a hash of their name or ID, each shard with its own lock, so look ups
+ * of different names rarely meet on a lock and a writer only holds up
+ * its own shard.
+ *
+ * Entries expire Idmap_Cache_Lifetime seconds after they were looked
+ * up, or Idmap_Negative_Cache_Lifetime seconds if the look up failed.
+ * An expired entry keeps being returned; the first caller to find it
+ * is told it is stale, and is expected to have it looked up again.
+ *
+ * Names in the UID and GID maps are kept as XDR opaques, length and
+ * padding included, so encoding an owner or group is one copy into
+ * the reply.
  */
 #include "config.h"
 #include "log.h"
 #include "config_parsing.h"
 #include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
 #include <pwd.h>
 #include <grp.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
 #include "common_utils.h"
 #include "avltree.h"
+#include "city.h"
+#include "gsh_config.h"
 #include "idmapper.h"
-#include "abstract_atomic.h"
-
-/**
- * @brief User entry in the IDMapper cache
- */
-
-struct cache_user {
-	struct gsh_buffdesc uname;	/*< Username */
-	uid_t uid;		/*< Corresponding UID */
-	gid_t gid;		/*< Corresponding GID */
-	bool gid_set;		/*< if the GID has been set */
-	struct avltree_node uname_node;	/*< Node in the name tree */
-	struct avltree_node uid_node;	/*< Node in the UID tree */
-	bool in_uidtree;		/* true iff this is in uid_tree */
-};
 
 /**
- * @brief Group entry in the IDMapper cache
+ * @brief Number of cache shards, a power of two
  */
 
-struct cache_group {
-	struct gsh_buffdesc gname;	/*< Group name */
-	gid_t gid;		/*< Group ID */
-	struct avltree_node gname_node;	/*< Node in the name tree */
-	struct avltree_node gid_node;	/*< Node in the GID tree */
-};
+#define IDMAPPER_SHARD_BITS 6
+#define IDMAPPER_SHARDS (1 << IDMAPPER_SHARD_BITS)
 
 /**
- * @brief Number of entires in the UID cache, should be prime.
+ * @brief Bytes taken by an opaque of len bytes, length and padding
  */
 
-#define id_cache_size 1009
+#define XDR_OPAQUE_LEN(len) \
+	(BYTES_PER_XDR_UNIT + (((len) + BYTES_PER_XDR_UNIT - 1) & \
+			       ~(BYTES_PER_XDR_UNIT - 1)))
 
 /**
- * @brief UID cache, may only be accessed with idmapper_user_lock
- * held.  If idmapper_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief Entry in the IDMapper cache
  */
 
-static struct avltree_node *uid_cache[id_cache_size];
+struct cache_entry {
+	struct avltree_node node;	/*< Node in the shard's tree */
+	struct gsh_buffdesc name;	/*< User or group name */
+	struct gsh_buffdesc xdr;	/*< Name as an XDR opaque, for the
+					    UID and GID maps */
+	uint32_t id;		/*< UID or GID */
+	gid_t gid;		/*< Primary GID of a user found by name */
+	bool gid_set;		/*< if the GID has been set */
+	bool negative;		/*< The look up failed */
+	uint32_t refreshing;	/*< A caller has been told it is stale */
+	time_t expires;		/*< When to look it up again, 0 for never */
+};
 
 /**
- * @brief GID cache, may only be accessed with idmapper_group_lock
- * held.  If idmapper_group_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief A shard of the cache
  */
 
-static struct avltree_node *gid_cache[id_cache_size];
+struct cache_shard {
+	pthread_rwlock_t lock;	/*< Protects the trees and their entries */
+	struct avltree trees[IDMAPPER_MAPS];	/*< One tree per map */
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
-/**
- * @brief Lock that protects the idmapper user cache
- */
-
-pthread_rwlock_t idmapper_user_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct cache_shard cache_shards[IDMAPPER_SHARDS];
 
 /**
- * @brief Lock that protects the idmapper group cache
- */
-
-pthread_rwlock_t idmapper_group_lock = PTHREAD_RWLOCK_INITIALIZER;
-
-/**
- * @brief Tree of users, by name
+ * @brief Whether a map is keyed by name
+ *
+ * @param[in] map The map
+ *
+ * @return true for the name to ID maps.
  */
 
-static struct avltree uname_tree;
+static inline bool by_name(enum idmapper_map map)
+{
+	return map == IDMAPPER_UNAME || map == IDMAPPER_GNAME;
+}
 
 /**
- * @brief Tree of users, by ID
+ * @brief Find the shard holding a name
+ *
+ * @param[in] name The name
+ *
+ * @return The shard.
  */
 
-static struct avltree uid_tree;
-
-/**
- * @brief Tree of groups, by name
- */
-static struct avltree gname_tree;
+static inline struct cache_shard *name_shard(const struct gsh_buffdesc *name)
+{
+	return &cache_shards[CityHash64(name->addr, name->len) &
+			     (IDMAPPER_SHARDS - 1)];
+}
 
 /**
- * @brief Tree of groups, by ID
+ * @brief Find the shard holding an ID
+ *
+ * IDs are handed out in runs, so spread them with a multiplicative
+ * hash rather than taking the low bits.
+ *
+ * @param[in] id The ID
+ *
+ * @return The shard.
  */
 
-static struct avltree gid_tree;
+static inline struct cache_shard *id_shard(uint32_t id)
+{
+	return &cache_shards[(id * 2654435761U) >> (32 - IDMAPPER_SHARD_BITS)];
+}
 
 /**
  * @brief Compare two buffers
@@ -160,7 +180,7 @@ static inline int buffdesc_comparator(const struct gsh_buffdesc *buffa,
 }
 
 /**
- * @brief Comparison for user names
+ * @brief Comparison for names
  *
  * @param[in] node1 A node
  * @param[in] nodea Another node
@@ -170,50 +190,19 @@ static inline int buffdesc_comparator(const struct gsh_buffdesc *buffa,
  * @retval 1 if node1 is greater than nodea
  */
 
-static int uname_comparator(const struct avltree_node *node1,
-			    const struct avltree_node *nodea)
+static int name_comparator(const struct avltree_node *node1,
+			   const struct avltree_node *nodea)
 {
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uname_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uname_node);
-
-	return buffdesc_comparator(&user1->uname, &usera->uname);
-}
-
-/**
- * @brief Comparison for UIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
+	struct cache_entry *entry1 =
+	    avltree_container_of(node1, struct cache_entry, node);
+	struct cache_entry *entrya =
+	    avltree_container_of(nodea, struct cache_entry, node);
 
-static int uid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
-{
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uid_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uid_node);
-
-	if (user1->uid < usera->uid)
-		return -1;
-	else if (user1->uid > usera->uid)
-		return 1;
-	else
-		return 0;
+	return buffdesc_comparator(&entry1->name, &entrya->name);
 }
 
 /**
- * @brief Comparison for group names
+ * @brief Comparison for IDs
  *
  * @param[in] node1 A node
  * @param[in] nodea Another node
@@ -223,43 +212,17 @@ static int uid_comparator(const struct avltree_node *node1,
  * @retval 1 if node1 is greater than nodea
  */
 
-static inline int gname_comparator(const struct avltree_node *node1,
-				   const struct avltree_node *nodea)
+static int id_comparator(const struct avltree_node *node1,
+			 const struct avltree_node *nodea)
 {
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gname_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gname_node);
-
-	return buffdesc_comparator(&group1->gname, &groupa->gname);
-}
+	struct cache_entry *entry1 =
+	    avltree_container_of(node1, struct cache_entry, node);
+	struct cache_entry *entrya =
+	    avltree_container_of(nodea, struct cache_entry, node);
 
-/**
- * @brief Comparison for GIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
-
-static int gid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
-{
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gid_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gid_node);
-
-	if (group1->gid < groupa->gid)
+	if (entry1->id < entrya->id)
 		return -1;
-	else if (group1->gid > groupa->gid)
+	else if (entry1->id > entrya->id)
 		return 1;
 	else
 		return 0;
@@ -271,398 +234,258 @@ static int gid_comparator(const struct avltree_node *node1,
 
 void idmapper_cache_init(void)
 {
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	avltree_init(&gname_tree, gname_comparator, 0);
-	avltree_init(&gid_tree, gid_comparator, 0);
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	int i, map;
+
+	for (i = 0; i < IDMAPPER_SHARDS; i++) {
+		PTHREAD_RWLOCK_init(&cache_shards[i].lock, NULL);
+		for (map = 0; map < IDMAPPER_MAPS; map++)
+			avltree_init(&cache_shards[i].trees[map],
+				     by_name(map) ? name_comparator :
+				     id_comparator, 0);
+	}
 }
 
 /**
- * @brief Add a user entry to the cache
+ * @brief Find an entry
  *
- * @note The caller must hold idmapper_user_lock for write.
+ * @note The caller must hold the shard's lock.
  *
- * @param[in] name The user name
- * @param[in] uid  The user ID
- * @param[in] gid  Optional.  Set to NULL if no gid is known.
- * @param[in] gss_princ true when name is gss principal.
- *                      The uid to name map is not added for gss principals.
+ * @param[in] shard The shard
+ * @param[in] map   The map to search
+ * @param[in] name  The name, for maps keyed by name
+ * @param[in] id    The ID, for maps keyed by ID
  *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
+ * @return The entry or NULL.
  */
 
-bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
-		       const gid_t *gid, bool gss_princ)
+static struct cache_entry *cache_find(struct cache_shard *shard,
+				      enum idmapper_map map,
+				      const struct gsh_buffdesc *name,
+				      uint32_t id)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_user *old;
-	struct cache_user *new;
-
-	new = gsh_malloc(sizeof(struct cache_user) + name->len);
-
-	new->uname.addr = (char *)new + sizeof(struct cache_user);
-	new->uname.len = name->len;
-	new->uid = uid;
-	memcpy(new->uname.addr, name->addr, name->len);
-	if (gid) {
-		new->gid = *gid;
-		new->gid_set = true;
-	} else {
-		new->gid = -1;
-		new->gid_set = false;
-	}
-	new->in_uidtree = (gss_princ) ? false : true;
-
-	/*
-	 * There are 3 cases why we find an existing cache entry.
-	 *
-	 * Case 1:
-	 * The threads that lookup by-name or by-id use the read lock.
-	 * If they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping.
-	 *
-	 * Case 2:
-	 * It is also possible that name got a different id or an id got
-	 * a different name causing us to find an existing entry when we
-	 * are trying to add an entry. This case calls for removing the
-	 * stale entry and update with this new entry.
-	 *
-	 * Case 3:
-	 * The username to id mapping could be from plain nfs idmapping
-	 * in which case we will not have a valid gid. If this is for a
-	 * kerberos principal mapping, we will have uid and gid but we
-	 * will not have "uid to name" cache entry (the reverse
-	 * mapping). This case requires us to combine the old entry and
-	 * the new entry!
-	 *
-	 * Note that the 3rd case happens if and only if IDMAPD_DOMAIN
-	 * and LOCAL_REALMS are set to the same value!
-	 */
-	found_name = avltree_insert(&new->uname_node, &uname_tree);
-	if (unlikely(found_name)) {
-		old = avltree_container_of(found_name, struct cache_user,
-					   uname_node);
-		/* Combine old into new if uid's match */
-		if (old->uid == new->uid) {
-			if (!new->gid_set && old->gid_set) {
-				new->gid = old->gid;
-				new->gid_set = true;
-			}
-			if (!new->in_uidtree && old->in_uidtree)
-				new->in_uidtree = true;
-		}
-
-		/* Remove the old and insert the new */
-		avltree_remove(found_name, &uname_tree);
-		if (old->in_uidtree) {
-			uid_cache[old->uid % id_cache_size] = NULL;
-			avltree_remove(&old->uid_node, &uid_tree);
-		}
-		gsh_free(old);
-		found_name = avltree_insert(&new->uname_node, &uname_tree);
-		assert(found_name == NULL);
-	}
+	struct cache_entry prototype = {
+		.id = id
+	};
+	struct avltree_node *node;
 
-	if (!new->in_uidtree) /* all done */
-		return true;
+	if (name != NULL)
+		prototype.name = *name;
 
-	found_id = avltree_insert(&new->uid_node, &uid_tree);
-	if (unlikely(found_id)) {
-		old = avltree_container_of(found_id, struct cache_user,
-					   uid_node);
-		uid_cache[old->uid % id_cache_size] = NULL;
-		avltree_remove(found_id, &uid_tree);
-		avltree_remove(&old->uname_node, &uname_tree);
-		gsh_free(old);
-		found_id = avltree_insert(&new->uid_node, &uid_tree);
-		assert(found_id == NULL);
-	}
-	uid_cache[uid % id_cache_size] = &new->uid_node;
+	node = avltree_lookup(&prototype.node, &shard->trees[map]);
+	if (node == NULL)
+		return NULL;
 
-	return true;
+	return avltree_container_of(node, struct cache_entry, node);
 }
 
 /**
- * @brief Add a group entry to the cache
+ * @brief Check whether an entry has expired
  *
- * @note The caller must hold idmapper_group_lock for write.
+ * @note The caller must hold the shard's lock for read.
  *
- * @param[in] name The user name
- * @param[in] gid  The group id
+ * @param[in] entry The entry
  *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
+ * @retval IDMAPPER_HIT if it is current, or some other caller has
+ *         already been told it is stale.
+ * @retval IDMAPPER_STALE if the caller should have it looked up again.
  */
 
-bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
+static enum idmapper_status cache_status(struct cache_entry *entry)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_group *tmp;
-	struct cache_group *new;
-
-	new = gsh_malloc(sizeof(struct cache_group) + name->len);
-
-	new->gname.addr = (char *)new + sizeof(struct cache_group);
-	new->gname.len = name->len;
-	new->gid = gid;
-	memcpy(new->gname.addr, name->addr, name->len);
-
-	/*
-	 * The threads that lookup by-name or by-id use the read lock. If
-	 * they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping. It is also possible
-	 * that name got a different id or an id got a different name
-	 * causing us to find an existing entry when we are trying to
-	 * add an entry!
-	 *
-	 * If we find an existing entry, we remove it from both the name
-	 * and the id AVL trees, and then add the new entry.
-	 */
-	found_name = avltree_insert(&new->gname_node, &gname_tree);
-	if (unlikely(found_name)) {
-		tmp = avltree_container_of(found_name, struct cache_group,
-					   gname_node);
-		avltree_remove(found_name, &gname_tree);
-		avltree_remove(&tmp->gid_node, &gid_tree);
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		gsh_free(tmp);
-		found_name = avltree_insert(&new->gname_node, &gname_tree);
-		assert(found_name == NULL);
-	}
+	if (entry->expires == 0 || entry->expires > time(NULL))
+		return IDMAPPER_HIT;
 
-	found_id = avltree_insert(&new->gid_node, &gid_tree);
-	if (unlikely(found_id)) {
-		tmp = avltree_container_of(found_id, struct cache_group,
-					   gid_node);
-
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		avltree_remove(found_id, &gid_tree);
-		avltree_remove(&tmp->gname_node, &gname_tree);
-		gsh_free(tmp);
-		found_id = avltree_insert(&new->gid_node, &gid_tree);
-		assert(found_id == NULL);
-	}
-	gid_cache[gid % id_cache_size] = &new->gid_node;
+	/* Only one refresh per entry at a time */
+	if (__sync_bool_compare_and_swap(&entry->refreshing, 0, 1))
+		return IDMAPPER_STALE;
 
-	return true;
+	return IDMAPPER_HIT;
 }
 
 /**
- * @brief Look up a user by name
+ * @brief Look up a name
  *
- * @note The caller must hold idmapper_user_lock for read.
+ * @param[in]  map   IDMAPPER_UNAME or IDMAPPER_GNAME
+ * @param[in]  name  The user name, principal or group name
+ * @param[out] found The entry found
  *
- * @param[in]  name The user name to look up.
- * @param[out] uid  The user ID found.  May be NULL if the caller
- *                  isn't interested in the UID.  (This seems
- *                  unlikely.)
- * @param[out] gid  The GID for the user, or NULL if there is
- *                  none. The caller may specify NULL if it isn't
- *                  interested.
- *
- * @retval true on success.
- * @retval false if we need to try, try again.
+ * @return Whether the entry was found and is current.
  */
 
-bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
-			      const gid_t **gid, bool gss_princ)
+enum idmapper_status idmapper_lookup_name(enum idmapper_map map,
+					  const struct gsh_buffdesc *name,
+					  struct idmapper_found *found)
 {
-	struct cache_user prototype = {
-		.uname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.uname_node,
-							 &uname_tree);
-	struct cache_user *found_user;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
-
-	found_user =
-	    avltree_container_of(found_node, struct cache_user, uname_node);
-	if (!gss_princ) {
-		/* I assume that if someone likes this user enough to look it
-		   up by name, they'll like it enough to look it up by ID
-		   later.
-
-		   If the name is gss principal it does not have entry
-		   in uid tree */
-
-		cache_slot = (void **)
-			&uid_cache[found_user->uid % id_cache_size];
-		atomic_store_voidptr(cache_slot, &found_user->uid_node);
+	struct cache_shard *shard = name_shard(name);
+	struct cache_entry *entry;
+	enum idmapper_status status = IDMAPPER_MISS;
+
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+	entry = cache_find(shard, map, name, 0);
+	if (likely(entry != NULL)) {
+		found->id = entry->id;
+		found->gid = entry->gid;
+		found->gid_set = entry->gid_set;
+		found->negative = entry->negative;
+		status = cache_status(entry);
 	}
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	if (likely(uid))
-		*uid = found_user->uid;
-
-	if (unlikely(gid))
-		*gid = (found_user->gid_set ? &found_user->gid : NULL);
-
-	return true;
+	return status;
 }
 
 /**
- * @brief Look up a user by ID
- *
- * @note The caller must hold idmapper_user_lock for read.
+ * @brief Encode the name of an ID from the cache
  *
- * @param[in]  uid  The user ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name.)
- * @param[out] gid  The GID for the user, or NULL if there is
- *                  none. The caller may specify NULL if it isn't
- *                  interested.
+ * @param[in]  map     IDMAPPER_UID or IDMAPPER_GID
+ * @param[in]  id      The UID or GID
+ * @param[in]  xdrs    XDR stream to which to encode
+ * @param[out] encoded Whether encoding succeeded, unless not cached
  *
- * @retval true on success.
- * @retval false if we weren't so successful.
+ * @return Whether the entry was found and is current.
  */
 
-bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
-			    const gid_t **gid)
+enum idmapper_status idmapper_encode_id(enum idmapper_map map, uint32_t id,
+					XDR *xdrs, bool *encoded)
 {
-	struct cache_user prototype = {
-		.uid = uid
-	};
-	void **cache_slot = (void **)&uid_cache[uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_user *found_user;
-	bool found = false;
-
-	if (likely(found_node)) {
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
-		if (found_user->uid == uid)
-			found = true;
-	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
-
-		atomic_store_voidptr(cache_slot, found_node);
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
+	struct cache_shard *shard = id_shard(id);
+	struct cache_entry *entry;
+	enum idmapper_status status = IDMAPPER_MISS;
+	int32_t *buf;
+
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+	entry = cache_find(shard, map, NULL, id);
+	if (likely(entry != NULL)) {
+		status = cache_status(entry);
+		buf = XDR_INLINE(xdrs, entry->xdr.len);
+		if (likely(buf != NULL)) {
+			memcpy(buf, entry->xdr.addr, entry->xdr.len);
+			*encoded = true;
+		} else {
+			/* Not enough contiguous room, take the long way */
+			char *addr = entry->name.addr;
+			uint32_t len = entry->name.len;
+
+			*encoded = inline_xdr_bytes(xdrs, &addr, &len,
+						    UINT32_MAX);
+		}
 	}
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	if (likely(name))
-		*name = &found_user->uname;
-
-	if (gid)
-		*gid = (found_user->gid_set ? &found_user->gid : NULL);
-
-	return true;
+	return status;
 }
 
 /**
- * @brief Lookup a group by name
- *
- * @note The caller must hold idmapper_group_lock for read.
- *
- * @param[in]  name The user name to look up.
- * @param[out] gid  The group ID found.  May be NULL if the caller
- *                  isn't interested in the GID.  (This seems
- *                  unlikely, since you can't get anything else from
- *                  this function.)
- *
- * @retval true on success.
- * @retval false if we need to try, try again.
+ * @brief Add or replace an entry
+ *
+ * @param[in] map      The map
+ * @param[in] name     The name
+ * @param[in] id       The UID or GID
+ * @param[in] gid      Optional.  Set to NULL if no gid is known.
+ * @param[in] negative true if the look up failed; name or id is then
+ *                     only the fallback to hand out.
  */
 
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
+void idmapper_cache_set(enum idmapper_map map,
+			const struct gsh_buffdesc *name, uint32_t id,
+			const gid_t *gid, bool negative)
 {
-	struct cache_group prototype = {
-		.gname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.gname_node,
-							 &gname_tree);
-	struct cache_group *found_group;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
-
-	found_group =
-	    avltree_container_of(found_node, struct cache_group, gname_node);
-
-	/* I assume that if someone likes this group enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
-
-	cache_slot = (void **)&gid_cache[found_group->gid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_group->gid_node);
+	struct cache_shard *shard;
+	struct cache_entry *new;
+	struct cache_entry *old;
+	uint32_t lifetime;
+
+	if (unlikely(name->len > IDMAPPER_NAME_MAX)) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"Not caching %zu byte name for %"PRIu32,
+			name->len, id);
+		return;
+	}
 
-	if (likely(gid))
-		*gid = found_group->gid;
-	else
-		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
+	lifetime = negative ?
+	    nfs_param.nfsv4_param.idmap_negative_cache_lifetime :
+	    nfs_param.nfsv4_param.idmap_cache_lifetime;
 
-	return true;
+	if (by_name(map)) {
+		new = gsh_malloc(sizeof(struct cache_entry) + name->len);
+		new->xdr.addr = NULL;
+		new->xdr.len = 0;
+		new->name.addr = (char *)new + sizeof(struct cache_entry);
+	} else {
+		uint32_t *len;
+
+		new = gsh_malloc(sizeof(struct cache_entry) +
+				 XDR_OPAQUE_LEN(name->len));
+		new->xdr.addr = (char *)new + sizeof(struct cache_entry);
+		new->xdr.len = XDR_OPAQUE_LEN(name->len);
+		len = new->xdr.addr;
+		*len = htonl(name->len);
+		/* zero the padding */
+		len[new->xdr.len / BYTES_PER_XDR_UNIT - 1] = 0;
+		new->name.addr = (char *)new->xdr.addr + BYTES_PER_XDR_UNIT;
+	}
+	new->name.len = name->len;
+	memcpy(new->name.addr, name->addr, name->len);
+	new->id = id;
+	if (gid) {
+		new->gid = *gid;
+		new->gid_set = true;
+	} else {
+		new->gid = -1;
+		new->gid_set = false;
+	}
+	new->negative = negative;
+	new->refreshing = 0;
+	new->expires = lifetime == 0 ? 0 : time(NULL) + lifetime;
+
+	shard = by_name(map) ? name_shard(name) : id_shard(id);
+
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
+	old = cache_find(shard, map, name, id);
+	if (unlikely(old != NULL)) {
+		/* A user mapped by plain NFS idmapping has no GID, the
+		 * same user mapped as a kerberos principal does.  Keep
+		 * the GID if the UID didn't change (this only happens
+		 * when IDMAPD_DOMAIN and LOCAL_REALMS are the same.)
+		 */
+		if (!new->negative && !new->gid_set && old->gid_set &&
+		    !old->negative && old->id == new->id) {
+			new->gid = old->gid;
+			new->gid_set = true;
+		}
+		avltree_remove(&old->node, &shard->trees[map]);
+		gsh_free(old);
+	}
+	avltree_insert(&new->node, &shard->trees[map]);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 }
 
 /**
- * @brief Look up a group by ID
- *
- * @note The caller must hold idmapper_group_lock for read.
+ * @brief Keep an entry that could not be looked up again
  *
- * @param[in]  gid  The group ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name, which would be weird.)
+ * The entry is served as it is for Idmap_Negative_Cache_Lifetime
+ * seconds more, after which the next caller is told it is stale.
  *
- * @retval true on success.
- * @retval false if we're most unfortunate.
+ * @param[in] map  The map
+ * @param[in] name The name, for maps keyed by name
+ * @param[in] id   The ID, for maps keyed by ID
  */
 
-bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
+void idmapper_cache_retry(enum idmapper_map map,
+			  const struct gsh_buffdesc *name, uint32_t id)
 {
-	struct cache_group prototype = {
-		.gid = gid
-	};
-	void **cache_slot = (void **)&gid_cache[gid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_group *found_group;
-	bool found = false;
-
-	if (likely(found_node)) {
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
-		if (found_group->gid == gid)
-			found = true;
+	struct cache_shard *shard = by_name(map) ? name_shard(name) :
+	    id_shard(id);
+	struct cache_entry *entry;
+
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
+	entry = cache_find(shard, map, by_name(map) ? name : NULL, id);
+	if (entry != NULL) {
+		entry->expires = time(NULL) +
+		    nfs_param.nfsv4_param.idmap_negative_cache_lifetime;
+		entry->refreshing = 0;
 	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.gid_node, &gid_tree);
-		if (unlikely(!found_node))
-			return false;
-
-		atomic_store_voidptr(cache_slot, found_node);
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
-	}
-
-	if (likely(name))
-		*name = &found_group->gname;
-	else
-		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
-
-	return true;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 }
 
 /**
@@ -672,43 +495,24 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 void idmapper_clear_cache(void)
 {
 	struct avltree_node *node;
-
-	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
-	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
-
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	for (node = avltree_first(&uname_tree);
-	     node != NULL;
-	     node = avltree_first(&uname_tree)) {
-		struct cache_user *user;
-
-		user = avltree_container_of(node,
-					    struct cache_user, uname_node);
-		avltree_remove(&user->uname_node, &uname_tree);
-		avltree_remove(&user->uid_node, &uid_tree);
-		gsh_free(user);
-	}
-
-	assert(avltree_first(&uid_tree) == NULL);
-
-	for (node = avltree_first(&gname_tree);
-	     node != NULL;
-	     node = avltree_first(&gname_tree)) {
-		struct cache_group *group;
-
-		group = avltree_container_of(node,
-					     struct cache_group, gname_node);
-		avltree_remove(&group->gname_node, &gname_tree);
-		avltree_remove(&group->gid_node, &gid_tree);
-		gsh_free(group);
+	int i, map;
+
+	for (i = 0; i < IDMAPPER_SHARDS; i++) {
+		struct cache_shard *shard = &cache_shards[i];
+
+		PTHREAD_RWLOCK_wrlock(&shard->lock);
+		for (map = 0; map < IDMAPPER_MAPS; map++) {
+			for (node = avltree_first(&shard->trees[map]);
+			     node != NULL;
+			     node = avltree_first(&shard->trees[map])) {
+				avltree_remove(node, &shard->trees[map]);
+				gsh_free(avltree_container_of(
+						node, struct cache_entry,
+						node));
+			}
+		}
+		PTHREAD_RWLOCK_unlock(&shard->lock);
 	}
-
-	assert(avltree_first(&gid_tree) == NULL);
-
-	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
 }
 
 /** @} */
@@ -53,7 +53,8 @@
 
 #define _9P_LOCK_CLIENT_LEN 64
 
-#define _9P_FID_PER_CONN        1024
+/* Buckets a connection's fid table starts with, it doubles from there */
+#define _9P_FID_BUCKETS         16
 
 /* _9P_MSG_SIZE: maximum message size for 9P/TCP */
 #define _9P_MSG_SIZE 70000
@@ -319,6 +320,7 @@ struct _9p_xattr_desc {
 
 struct _9p_fid {
 	u32 fid;
+	struct _9p_fid *fid_next;	/*< Next fid in the same bucket */
 	/** Ganesha export of the file (refcounted). */
 	struct gsh_export *export;
 	struct _9p_user_cred *ucred; /*< Client credentials (refcounted). */
@@ -364,6 +366,16 @@ struct _9p_flush_bucket {
 
 #define FLUSH_BUCKETS 32
 
+/* Fids of a connection, hashed on their number.  Buckets are only
+ * allocated with the first fid and the table doubles when it holds
+ * more than two fids per bucket on average. */
+struct _9p_fid_table {
+	pthread_rwlock_t lock;
+	struct _9p_fid **buckets;
+	u32 size;		/*< Number of buckets, a power of two */
+	u32 count;		/*< Number of fids in the table */
+};
+
 struct _9p_conn {
 	union trans_data {
 		long int sockfd;
@@ -376,7 +388,7 @@ struct _9p_conn {
 	struct gsh_client *client;
 	struct timeval birth;	/* This is useful if same sockfd is
 				   reused on socket's close/open */
-	struct _9p_fid *fids[_9P_FID_PER_CONN];
+	struct _9p_fid_table fids;
 	struct _9p_flush_bucket flush_buckets[FLUSH_BUCKETS];
 	unsigned long sequence;
 	pthread_mutex_t sock_lock;
@@ -416,6 +428,36 @@ struct _9p_request_data {
 	struct _9p_flush_hook flush_hook;
 };
 
+/**
+ * @brief Whether a request moves file data, as NFS_LOOKAHEAD_HIGH_LATENCY
+ *
+ * Such requests are queued apart from metadata operations so they do
+ * not hold them up.
+ *
+ * 9P/RDMA requests are dispatched before _9pmsg is attached, so the
+ * message is then read from the receive buffer.
+ *
+ * @param[in] req9p The request, with its message read
+ */
+static inline bool _9p_high_latency(struct _9p_request_data *req9p)
+{
+	char *msg = req9p->_9pmsg;
+
+#ifdef _USE_9P_RDMA
+	if (msg == NULL)
+		msg = req9p->data->data;
+#endif
+	switch (*(u8 *) (msg + _9P_HDR_SIZE)) {
+	case _9P_TREAD:
+	case _9P_TWRITE:
+	case _9P_TREADDIR:
+	case _9P_TFSYNC:
+		return true;
+	default:
+		return false;
+	}
+}
+
 typedef int (*_9p_function_t) (struct _9p_request_data *req9p,
 			       u32 *plenout, char *preply);
 
@@ -606,6 +648,11 @@ do {                                                   \
  */
 #define _9P_TCP_MSIZE 65536
 
+/**
+ * @brief Default value for _9p_tcp_event_threads
+ */
+#define _9P_TCP_EVENT_THREADS 4
+
 /**
  * @brief Default value for _9p_rdma_msize
  */
@@ -645,6 +692,9 @@ struct _9p_param {
 	/** Msize for 9P operation on tcp.  Defaults to _9P_TCP_MSIZE,
 	    settable by _9P_TCP_Msize */
 	uint32_t _9p_tcp_msize;
+	/** Threads reading 9P/TCP connections.  Defaults to
+	    _9P_TCP_EVENT_THREADS, settable by _9P_TCP_Event_Threads */
+	uint16_t _9p_tcp_event_threads;
 	/** Msize for 9P operation on rdma.  Defaults to _9P_RDMA_MSIZE,
 	    settable by _9P_RDMA_Msize */
 	uint32_t _9p_rdma_msize;
@@ -726,6 +776,10 @@ int _9p_tools_get_req_context_by_name(int uname_len, char *uname_str,
 int _9p_tools_errno(fsal_status_t fsal_status);
 void _9p_openflags2FSAL(u32 *inflags, fsal_openflags_t *outflags);
 int _9p_tools_clunk(struct _9p_fid *pfid);
+void _9p_init_fids(struct _9p_conn *conn);
+struct _9p_fid *_9p_getfid(struct _9p_conn *conn, u32 fid);
+void _9p_setfid(struct _9p_conn *conn, struct _9p_fid *pfid);
+struct _9p_fid *_9p_delfid(struct _9p_conn *conn, u32 fid);
 void _9p_cleanup_fids(struct _9p_conn *conn);
 
 static inline unsigned int _9p_openflags_to_share_access(u32 *inflags)
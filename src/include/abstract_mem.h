@@ -30,15 +30,15 @@
  *
  * This file's purpose is to allow us to easily replace the memory
  * allocator used by Ganesha.  Further, it provides a pool abstraction
- * that may be implemented in terms of the normal allocator that may
- * be expanded at a later date.  These are intended to be thin
- * wrappers, but conditionally compiled trace information could be
- * added.
+ * for fixed size objects, implemented in support/abstract_mem.c.  The
+ * general allocation functions are intended to be thin wrappers, but
+ * conditionally compiled trace information could be added.
  */
 
 #ifndef ABSTRACT_MEM_H
 #define ABSTRACT_MEM_H
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -287,6 +287,22 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 	free(p);
 }
 
+/**
+ * @page PoolAllocator Pool Allocator
+ *
+ * Pools hand out fixed size objects carved from slabs.  Each thread
+ * keeps a pair of magazines (small stacks of free objects) per pool,
+ * so the common alloc/free path touches no shared state.  Magazines
+ * are exchanged with a per-pool depot when they run empty or full,
+ * and objects only return to the slab free list when the depot has
+ * no magazine to trade.  A few entirely free slabs are kept, further
+ * ones are released, as are all slabs when the pool is destroyed.
+ *
+ * Only a limited number of pools get per-thread magazines
+ * (POOL_MAX_CACHED); any further pool is served directly from its
+ * depot under the pool lock.
+ */
+
 /**
  * @brief Type representing a pool
  *
@@ -295,32 +311,59 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
  * stored or passed to pool functions.  The pointer should never be
  * referenced.  No assumptions about the size of the pointed-to type
  * should be made.
+ */
+
+typedef struct pool pool_t;
+
+/**
+ * @brief Object constructor
+ *
+ * Called once on every object when its slab is created, after zeroing
+ * if the pool was created with POOL_ZERO.  Objects are handed out by
+ * pool_alloc as pool_free got them back, so they must be returned in
+ * their constructed state; pool_alloc does not zero them.
  *
- * This allows for flexible growth in the future.
+ * @param[in] object Object being allocated
  */
+typedef void (*pool_constructor_t)(void *object);
 
-typedef struct pool {
-	char *name; /*< The name of the pool */
-	size_t object_size; /*< The size of the objects created */
-} pool_t;
+/**
+ * @brief Object destructor
+ *
+ * Called once on every object when its slab is released.
+ *
+ * @param[in] object Object being freed
+ */
+typedef void (*pool_destructor_t)(void *object);
+
+/** Zero objects on allocation */
+#define POOL_ZERO 0x0001
+
+/** Number of pools that may have per-thread magazines */
+#define POOL_MAX_CACHED 128
+
+/** Objects per magazine */
+#define POOL_MAGAZINE_SIZE 32
+
+pool_t *pool_init__(const char *name, size_t object_size, uint32_t flags,
+		    pool_constructor_t constructor,
+		    pool_destructor_t destructor,
+		    const char *file, int line, const char *function);
 
 /**
- * @brief Create a basic object pool
+ * @brief Create an object pool
  *
  * This function creates a new object pool, given a name, object size,
- * constructor and destructor.
- *
- * This particular implementation throws the name away, but other
- * implementations that do tracking or keep counts of allocated or
- * de-allocated objects will likely wish to use it in log messages.
+ * flags, constructor and destructor.  The name is used in log messages
+ * and in the statistics reported over DBus; it may be NULL.
  *
- * This initializer function is expected to abort if it fails.
+ * This initializer function aborts if it fails.
  *
  * @param[in] name             The name of this pool
  * @param[in] object_size      The size of objects to allocate
- * @param[in] file             Calling source file
- * @param[in] line             Calling source line
- * @param[in] function         Calling source function
+ * @param[in] flags            POOL_ZERO or 0
+ * @param[in] constructor      Called on each allocated object (or NULL)
+ * @param[in] destructor       Called on each freed object (or NULL)
  *
  * @return A pointer to the pool object.  This pointer must not be
  *         dereferenced.  It may be stored or supplied as an argument
@@ -329,50 +372,47 @@ typedef struct pool {
  *         pool_destroy.
  */
 
-static inline pool_t *
-pool_basic_init__(const char *name, size_t object_size,
-		  const char *file, int line, const char *function)
-{
-	pool_t *pool = (pool_t *) gsh_malloc__(sizeof(pool_t), file, line,
-					function);
-
-	pool->object_size = object_size;
-
-	if (name)
-		pool->name = gsh_strdup__(name, file, line, function);
-	else
-		pool->name = NULL;
+#define pool_init(name, object_size, flags, constructor, destructor) \
+	pool_init__(name, object_size, flags, constructor, destructor, \
+		    __FILE__, __LINE__, __func__)
 
-	return pool;
-}
+/**
+ * @brief Create a basic object pool
+ *
+ * A basic pool hands out zeroed objects and has no constructor or
+ * destructor, matching the semantics of gsh_calloc.
+ *
+ * @param[in] name             The name of this pool
+ * @param[in] object_size      The size of objects to allocate
+ *
+ * @return A pointer to the pool object.
+ */
 
 #define pool_basic_init(name, object_size) \
-	pool_basic_init__(name, object_size, __FILE__, __LINE__, __func__)
+	pool_init(name, object_size, POOL_ZERO, NULL, NULL)
 
 /**
  * @brief Destroy a memory pool
  *
  * This function destroys a memory pool.  All objects must be returned
- * to the pool before this function is called.
+ * to the pool before this function is called.  Slabs are released
+ * back to the general allocator.
  *
  * @param[in] pool The pool to be destroyed.
  */
 
-static inline void
-pool_destroy(pool_t *pool)
-{
-	gsh_free(pool->name);
-	gsh_free(pool);
-}
+void pool_destroy(pool_t *pool);
+
+void *pool_alloc__(pool_t *pool, const char *file, int line,
+		   const char *function);
 
 /**
  * @brief Allocate an object from a pool
  *
  * This function allocates a single object from the pool and returns a
- * pointer to it.  If a constructor was specified at pool creation, it
- * is called on that pointer.  This function must be thread safe.  If
- * the underlying pool abstraction requires a lock, this function must
- * take and release it.
+ * pointer to it.  If the pool was created with POOL_ZERO and no
+ * constructor the object is zeroed.  Objects of a pool with a
+ * constructor are already constructed.  This function is thread safe.
  *
  * This function returns void pointers.  Programmers who wish for more
  * type safety can easily create static inline wrappers (alloc_client
@@ -382,30 +422,18 @@ pool_destroy(pool_t *pool)
  * This function aborts if no memory is available.
  *
  * @param[in] pool       The pool from which to allocate
- * @param[in] file       Calling source file
- * @param[in] line       Calling source line
- * @param[in] function   Calling source function
  *
  * @return A pointer to the allocated pool item.
  */
 
-static inline void *
-pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
-{
-	return gsh_calloc__(1, pool->object_size, file, line, function);
-}
-
 #define pool_alloc(pool) \
 	pool_alloc__(pool, __FILE__, __LINE__, __func__)
 
 /**
  * @brief Return an entry to a pool
  *
- * This function returns a single object to the pool.  If a destructor
- * was defined at pool creation time, it is called before the object
- * is freed.  This function must be thread-safe.  If the underlying
- * pool abstract requires a lock, this function must take and release
- * it.
+ * This function returns a single object to the pool, where it is
+ * cached as is.  This function is thread-safe.
  *
  * @param[in] pool   Pool to which to return the object
  * @param[in] object Object to return.  This is a void pointer.
@@ -414,10 +442,6 @@ pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
  *                   specific type (and omitting the pool parameter.)
  */
 
-static inline void
-pool_free(pool_t *pool, void *object)
-{
-	gsh_free(object);
-}
+void pool_free(pool_t *pool, void *object);
 
 #endif /* ABSTRACT_MEM_H */
@@ -45,6 +45,8 @@
 #include "avltree.h"
 #include "gsh_types.h"
 
+struct req_flow;
+
 struct gsh_client {
 	struct avltree_node node_k;
 	pthread_rwlock_t lock;
@@ -52,6 +54,13 @@ struct gsh_client {
 	int64_t refcnt;
 	nsecs_elapsed_t last_update;
 	char *hostaddr_str;
+	uint32_t qos_weight;	/*< Fair queuing weight, 0 for the default */
+	uint32_t qos_max_reqs;	/*< Outstanding request cap, 0 for the
+				    default */
+	uint32_t qos_reqs;	/*< Requests queued or in progress */
+	struct req_flow *qos_flows;	/*< Per shard and class queues */
+	struct client_rate_limiter *rate_limiters;	/*< Buckets per export,
+							    protected by lock */
 	unsigned char addrbuf[];
 };
 
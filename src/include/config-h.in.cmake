@@ -24,6 +24,7 @@
 #cmakedefine _USE_CB_SIMULATOR 1
 #cmakedefine USE_CAPS 1
 #cmakedefine USE_BLKID 1
+#cmakedefine USE_IO_URING 1
 #cmakedefine PROXY_HANDLE_MAPPING 1
 #cmakedefine _USE_9P 1
 #cmakedefine _USE_9P_RDMA 1
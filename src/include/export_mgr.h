@@ -40,10 +40,13 @@
 #include "avltree.h"
 #include "abstract_atomic.h"
 #include "fsal.h"
+#include "rate_limit.h"
 
 #ifndef EXPORT_MGR_H
 #define EXPORT_MGR_H
 
+struct export_client_index;
+
 enum export_status {
 	EXPORT_READY,		/*< searchable, usable */
 	EXPORT_STALE,		/*< export is no longer valid */
@@ -79,6 +82,8 @@ struct gsh_export {
 	struct fsal_obj_handle *exp_root_obj;
 	/** CFG Allowed clients - update protected by lock */
 	struct glist_head clients;
+	/** Compiled lookup index of clients - update protected by lock */
+	struct export_client_index *client_index;
 	/** Entry for the junction of this export.  Protected by lock */
 	struct fsal_obj_handle *exp_junction_obj;
 	/** The export this export sits on. Protected by lock */
@@ -107,6 +112,10 @@ struct gsh_export {
 	uint64_t MaxOffsetWrite;
 	/** CFG: Maximum Offset allowed for read - atomic changeable option */
 	uint64_t MaxOffsetRead;
+	/** CFG: READ and WRITE rate limits - atomic changeable option */
+	struct rate_limits rate_limits;
+	/** Token buckets for rate_limits */
+	struct rate_limiter rate_limiter;
 	/** CFG: Filesystem ID for overriding fsid from FSAL - ????? */
 	fsal_fsid_t filesystem_id;
 	/** References to this export */
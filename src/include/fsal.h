@@ -366,6 +366,19 @@ fsal_status_t fsal_write2(struct fsal_obj_handle *obj,
 			  void *buffer,
 			  bool *sync,
 			  struct io_info *info);
+void fsal_read2_async(struct fsal_obj_handle *obj,
+		      bool bypass,
+		      struct fsal_io_arg *read_arg,
+		      fsal_async_cb done_cb,
+		      void *caller_arg);
+void fsal_write2_async(struct fsal_obj_handle *obj,
+		       bool bypass,
+		       struct fsal_io_arg *write_arg,
+		       fsal_async_cb done_cb,
+		       void *caller_arg);
+fsal_status_t fsal_io_complete(fsal_status_t status,
+			       struct fsal_io_arg *io_arg,
+			       bool is_read);
 fsal_status_t fsal_rdwr(struct fsal_obj_handle *obj,
 		      fsal_io_direction_t io_direction,
 		      uint64_t offset, size_t io_size,
@@ -324,7 +324,7 @@ struct state_t;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 2
 
 /* Forward references for object methods */
 
@@ -365,6 +365,67 @@ struct io_hints {
 	uint32_t hints;
 };
 
+/**
+ * @brief Arguments and results of an asynchronous read or write
+ *
+ * The caller owns this structure and must keep it (and the buffer it
+ * points to) valid until the completion callback has been invoked.
+ */
+struct fsal_io_arg {
+	struct state_t *state;	/*< state_t to use for this operation */
+	uint64_t offset;	/*< Position at which to read or write */
+	size_t io_request;	/*< Amount of data to read or write */
+	void *buffer;		/*< Buffer for the data */
+	size_t io_amount;	/*< Amount of data actually moved */
+	bool end_of_file;	/*< Read reached the end of the file */
+	bool fsal_stable;	/*< In, the caller wants stable data; out, the
+				    FSAL reports what it did */
+	struct io_info *info;	/*< READ_PLUS/WRITE_PLUS info, or NULL */
+};
+
+/**
+ * @brief Completion callback for asynchronous reads and writes
+ *
+ * The callback may be invoked before the submitting method returns (when
+ * the FSAL completes the I/O inline) or later from an FSAL thread.  When
+ * invoked from an FSAL thread, op_ctx is not set, so the callback must only
+ * record the result and hand the request back to a worker.
+ *
+ * @param[in] obj         Object the I/O was issued against
+ * @param[in] ret         Status of the I/O
+ * @param[in] io_arg      The fsal_io_arg passed to the method
+ * @param[in] caller_arg  Opaque argument passed to the method
+ */
+typedef void (*fsal_async_cb)(struct fsal_obj_handle *obj,
+			      fsal_status_t ret,
+			      struct fsal_io_arg *io_arg,
+			      void *caller_arg);
+
+/** Words in the key of a READDIR entry encoding */
+#define FSAL_READDIR_ENC_KEY 5
+
+/**
+ * @brief Encoded directory entries a cache may keep for READDIR
+ *
+ * A protocol layer that points op_ctx->readdir_enc at one of these
+ * around fsal_readdir lets an FSAL that caches directories keep each
+ * entry as the protocol encoded it.  Before each callback the FSAL
+ * copies an encoding made earlier with the same key into buf, if the
+ * entry's attributes have not changed since; after it, the FSAL keeps
+ * the encoding the callback left in store.  FSALs that do not cache
+ * directories ignore it.
+ */
+
+struct fsal_readdir_enc {
+	uint32_t key[FSAL_READDIR_ENC_KEY];	/*< Protocol, export and
+						    attributes encoded */
+	char *buf;		/*< Where a kept encoding is copied */
+	uint32_t buflen;	/*< Size of buf */
+	uint32_t cached_len;	/*< Length copied to buf, 0 if none */
+	const char *store;	/*< The callback's encoding of the entry */
+	uint32_t store_len;	/*< Its length, 0 if it is not to be kept */
+};
+
 /**
  * @brief request op context
  *
@@ -420,6 +481,9 @@ struct req_op_context {
 	void *fsal_private;		/*< private for FSAL use */
 	struct fsal_module *fsal_module;	/*< current fsal module */
 	struct fsal_pnfs_ds *fsal_pnfs_ds;	/*< current pNFS DS */
+	struct rate_limits client_rate_limits;	/*< Limits of the CLIENT block
+						    matched for ctx_export */
+	struct fsal_readdir_enc *readdir_enc;	/*< Set during READDIR */
 	/* add new context members here */
 };
 
@@ -2722,6 +2786,52 @@ struct fsal_obj_ops {
 	 fsal_status_t (*close2)(struct fsal_obj_handle *obj_hdl,
 				 struct state_t *state);
 
+/**
+ * @brief Read data from a file asynchronously
+ *
+ * This function starts a read and arranges for @a done_cb to be called
+ * when it completes.  It has the same semantics as read2 with respect to
+ * state and share reservations.  The FSAL may complete the read inline, in
+ * which case @a done_cb is called before this function returns.
+ *
+ * Any resource the FSAL acquires to find a file descriptor (e.g. the
+ * object lock) must be released before this function returns; only
+ * resources owned by the I/O itself may be held until completion.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in,out] read_arg       Arguments and results of the read
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for @a done_cb
+ */
+	 void (*read2_async)(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct fsal_io_arg *read_arg,
+			     fsal_async_cb done_cb,
+			     void *caller_arg);
+
+/**
+ * @brief Write data to a file asynchronously
+ *
+ * This function starts a write and arranges for @a done_cb to be called
+ * when it completes.  It has the same semantics as write2; if
+ * write_arg->fsal_stable is set, the data must be on stable storage before
+ * @a done_cb is called.  The FSAL may complete the write inline.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in,out] write_arg      Arguments and results of the write
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for @a done_cb
+ */
+	 void (*write2_async)(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct fsal_io_arg *write_arg,
+			      fsal_async_cb done_cb,
+			      void *caller_arg);
+
 /**@}*/
 };
 
@@ -192,6 +192,15 @@ typedef enum protos {
 				CORE_OPTION_NFS_VSOCK |			\
 				CORE_OPTION_9P)
 
+/**
+ * @brief Request queue sharding
+ */
+typedef enum dispatch_shard_by {
+	DISPATCH_SHARD_NONE,	/*< One set of queues for all threads */
+	DISPATCH_SHARD_CPU,	/*< A set of queues per CPU */
+	DISPATCH_SHARD_NODE	/*< A set of queues per NUMA node */
+} dispatch_shard_by_t;
+
 typedef struct nfs_core_param {
 	/** An array of port numbers, one for each protocol.  Set by
 	    the NFS_Port, MNT_Port, NLM_Port, and Rquota_Port options. */
@@ -232,11 +241,41 @@ typedef struct nfs_core_param {
 	    specific transport.  Defaults to 512 and settable by
 	    Dispatch_Max_Reqs_Xprt. */
 	uint32_t dispatch_max_reqs_xprt;
+	/** How to shard the request queues, one of the
+	    DISPATCH_SHARD_* values.  Defaults to DISPATCH_SHARD_NONE
+	    and settable by Dispatch_Shard_By. */
+	uint32_t dispatch_shard_by;
+	/** Whether to queue requests per client and serve the clients
+	    in turn.  Defaults to false and settable by
+	    Dispatch_Fair_Queuing. */
+	bool dispatch_fair_queuing;
+	/** Number of requests served in a client's turn, unless set
+	    for the client over DBus.  Defaults to 1 and settable by
+	    Dispatch_Client_Weight. */
+	uint32_t dispatch_client_weight;
+	/** Number of requests a client may have queued or in progress
+	    before its transports are stalled, unless set for the client
+	    over DBus.  0 means no limit.  Defaults to 0 and settable by
+	    Dispatch_Client_Max_Reqs. */
+	uint32_t dispatch_client_max_reqs;
+	/** Relative share of the workers for the MOUNT, CALL, low and
+	    high latency request classes.  Default to 1 and settable by
+	    Dispatch_Weight_Mount, Dispatch_Weight_Call,
+	    Dispatch_Weight_Low_Latency and
+	    Dispatch_Weight_High_Latency. */
+	uint32_t dispatch_weight_mount;
+	uint32_t dispatch_weight_call;
+	uint32_t dispatch_weight_low_latency;
+	uint32_t dispatch_weight_high_latency;
 	/** Parameters controlling the Duplicate Request Cache.  */
 	struct {
 		/** Whether to disable the DRC entirely.  Defaults to
 		    false, settable by DRC_Disabled. */
 		bool disabled;
+		/** Whether to keep cached replies (DRC and NFSv4.1
+		    session slots) XDR encoded rather than decoded.
+		    Defaults to false, settable by DRC_Encoded_Replies. */
+		bool encoded_replies;
 		/* Parameters controlling TCP specific DRC behavior. */
 		struct {
 			/** Number of partitions in the tree for the
@@ -368,6 +407,10 @@ typedef struct nfs_core_param {
 	bool enable_RQUOTA;
 	/** Whether to use fast stats.  Defaults to false. */
 	bool enable_FASTSTATS;
+	/** Whether export and client stats are split per CPU like the
+	    global stats.  Defaults to false and is settable with
+	    Shard_Client_Stats. */
+	bool shard_client_stats;
 	/** Whether tcp sockets should use SO_KEEPALIVE */
 	bool enable_tcp_keepalive;
 	/** Maximum number of TCP probes before dropping the connection */
@@ -395,6 +438,13 @@ typedef struct nfs_core_param {
 	/** Whether to use Pseudo (true) or Path (false) for NFS v3 and 9P
 	    mounts. */
 	bool mount_path_pseudo;
+	/** Bytes of idle READ buffers of each size to keep for reuse.
+	    Defaults to 32MB and settable with Read_Buffer_Cache_Size. */
+	uint64_t read_buffer_cache_size;
+	/** Whether READ data may be sent on TCP straight from the buffer
+	    it was read into.  Defaults to true and settable with
+	    Read_Zero_Copy. */
+	bool read_zero_copy;
 } nfs_core_parameter_t;
 
 /** @} */
@@ -430,6 +480,34 @@ typedef struct nfs_core_param {
  */
 #define DELEG_RECALL_RETRY_DELAY_DEFAULT 1
 
+/**
+ * @brief Default value of max_session_slots.
+ */
+#define MAX_SESSION_SLOTS_DEFAULT 64
+
+/**
+ * @brief Default value of session_reply_cache_size (bytes).
+ */
+#define SESSION_REPLY_CACHE_SIZE_DEFAULT (256 * 1024 * 1024)
+
+/**
+ * @brief Default value of idmap_cache_lifetime (seconds).
+ */
+#define IDMAP_CACHE_LIFETIME_DEFAULT 900
+
+/**
+ * @brief Default value of idmap_negative_cache_lifetime (seconds).
+ */
+#define IDMAP_NEGATIVE_CACHE_LIFETIME_DEFAULT 60
+
+/**
+ * @brief Where NFSv4 recovery records are kept
+ */
+enum recovery_backend {
+	RECOVERY_BACKEND_FS,	/*< A directory per client */
+	RECOVERY_BACKEND_LOG,	/*< An append-only log file */
+};
+
 typedef struct nfs_version4_parameter {
 	/** Whether to disable the NFSv4 grace period.  Defaults to
 	    false and settable with Graceless. */
@@ -470,6 +548,28 @@ typedef struct nfs_version4_parameter {
 	bool pnfs_mds;
 	/** Whether this a pNFS DS server. Defaults to false */
 	bool pnfs_ds;
+	/** Maximum number of fore channel slots granted to an NFSv4.1
+	    session.  Defaults to MAX_SESSION_SLOTS_DEFAULT and settable
+	    with Max_Session_Slots. */
+	uint32_t max_session_slots;
+	/** Memory, in bytes, all sessions together may hold in cached
+	    replies before the server stops caching replies the client
+	    did not ask to be cached and asks clients to use fewer slots.
+	    Defaults to SESSION_REPLY_CACHE_SIZE_DEFAULT and settable
+	    with Session_Reply_Cache_Size. */
+	uint64_t session_reply_cache_size;
+	/** Where recovery records are kept.  Defaults to
+	    RECOVERY_BACKEND_FS and settable with RecoveryBackend. */
+	uint32_t recovery_backend;
+	/** Seconds after which a cached owner or group mapping is
+	    looked up again, in the background; 0 keeps it forever.
+	    Defaults to IDMAP_CACHE_LIFETIME_DEFAULT and settable with
+	    Idmap_Cache_Lifetime. */
+	uint32_t idmap_cache_lifetime;
+	/** Seconds a failed owner or group look up is remembered.
+	    Defaults to IDMAP_NEGATIVE_CACHE_LIFETIME_DEFAULT and
+	    settable with Idmap_Negative_Cache_Lifetime. */
+	uint32_t idmap_negative_cache_lifetime;
 } nfs_version4_parameter_t;
 
 /** @} */
@@ -0,0 +1,64 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_iobuf.h
+ * @brief Pooled, reference counted I/O buffers
+ *
+ * READ data is read by the FSAL into an I/O buffer, and the reply
+ * encoder hands that same buffer to the transport instead of copying
+ * it into the send buffer.  The reply and the transport each hold a
+ * reference; the buffer goes back to its pool when both are done.
+ *
+ * Buffers are page aligned and come in power of 2 sizes from
+ * IOBUF_MIN_SIZE up to XDR_BYTES_MAXLEN_IO.  Idle buffers of each size
+ * are kept for reuse, up to Read_Buffer_Cache_Size bytes per size.
+ * The usable size of a buffer always has room for the XDR padding of
+ * the data it was allocated for.
+ */
+
+#ifndef GSH_IOBUF_H
+#define GSH_IOBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "gsh_rpc.h"
+
+/** Alignment of buffer data */
+#define IOBUF_ALIGN 4096
+
+/** Smallest buffer handed out */
+#define IOBUF_MIN_SIZE IOBUF_ALIGN
+
+/** Data shorter than this is copied into the reply rather than sent
+    from the buffer */
+#define IOBUF_ZERO_COPY_MIN IOBUF_ALIGN
+
+void *gsh_iobuf_alloc(size_t size);
+void gsh_iobuf_ref(void *data);
+void gsh_iobuf_put(void *data);
+size_t gsh_iobuf_size(void *data);
+void gsh_iobuf_zero_copy(bool allowed);
+bool gsh_iobuf_zero_copy_ok(XDR *xdrs);
+
+bool xdr_iobuf(XDR *xdrs, char **data, u_int *len, u_int maxlen);
+
+#endif /* GSH_IOBUF_H */
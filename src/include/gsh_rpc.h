@@ -152,9 +152,12 @@ const char *str_gc_proc(rpc_gss_proc_t);
 #define XPRT_PRIVATE_FLAG_INCREQ	0x00040000
 #define XPRT_PRIVATE_FLAG_DECREQ	0x00080000
 
+struct gsh_client;
+
 typedef struct gsh_xprt_private {
 	SVCXPRT *xprt;
 	struct glist_head stallq;
+	struct gsh_client *client;	/* connection's client, holds a ref */
 	uint16_t flags;
 } gsh_xprt_private_t;
 
@@ -165,6 +168,7 @@ static inline gsh_xprt_private_t *alloc_gsh_xprt_private(SVCXPRT *xprt,
 		gsh_malloc(sizeof(gsh_xprt_private_t));
 
 	xu->xprt = xprt;
+	xu->client = NULL;
 	xu->flags = flags;
 
 	return xu;
@@ -58,4 +58,18 @@ struct gsh_buffdesc {
 	size_t len;		/*< Length of the buffer */
 };
 
+/**
+ * @brief READ and WRITE rate limits
+ *
+ * Set in the EXPORT and CLIENT blocks.  Each is per second, 0 for no
+ * limit.
+ */
+
+struct rate_limits {
+	uint64_t read_bytes;	/*< Max_Read_Bandwidth */
+	uint64_t write_bytes;	/*< Max_Write_Bandwidth */
+	uint64_t read_ops;	/*< Max_Read_IOPS */
+	uint64_t write_ops;	/*< Max_Write_IOPS */
+};
+
 #endif				/* !GSH_TYPES_H */
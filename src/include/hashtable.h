@@ -77,6 +77,8 @@ typedef int (*val_display_function_t)(struct gsh_buffdesc *, char *);
 #define HT_FLAG_NONE 0x0000	/*< Null hash table flags */
 #define HT_FLAG_CACHE 0x0001	/*< Indicates that caching should be
 				   enabled */
+#define HT_FLAG_RCU 0x0002	/*< Look up without locking when the
+				   table will not be modified */
 
 /**
  * @brief Hash parameters
@@ -137,11 +139,22 @@ typedef struct hash_stat {
 				       the rbt used. */
 } hash_stat_t;
 
+struct hash_rcu;
+struct hash_rcu_node;
+struct hash_rcu_chains;
+
 /**
  * @brief Represents an individual partition
  *
  * This structure holds the per-subtree data making up each partition in
  * a hash table.
+ *
+ * With HT_FLAG_RCU, each entry is also kept on a chained index that
+ * lookups made without may_write search without taking the lock.
+ * Writers still take the lock to unlink entries, then release it and
+ * wait for such lookups to finish before freeing what they removed and
+ * returning, so anything done under a read latch remains safe from
+ * concurrent deletion.
  */
 
 struct hash_partition {
@@ -149,6 +162,7 @@ struct hash_partition {
 	struct rbt_head rbt; /*< The red-black tree */
 	pthread_rwlock_t lock; /*< Lock for this partition */
 	struct rbt_node **cache; /*< Expected entry cache */
+	struct hash_rcu *rcu; /*< Lock-free index, with HT_FLAG_RCU */
 };
 
 /**
@@ -178,6 +192,13 @@ struct hash_latch {
 	struct rbt_node *locator; /*< Saved location in the tree */
 	uint64_t rbt_hash; /*< Saved red-black hash */
 	uint32_t index;	/*< Saved partition index */
+	uint32_t reader; /*< Lock-free read in progress instead of
+			     the lock, with HT_FLAG_RCU */
+	struct hash_rcu_node *retired; /*< Unlinked entry to free once the
+					   latch is released */
+	struct hash_rcu_chains *retired_chains; /*< Replaced chains, the
+						    same */
+	uint64_t retired_seq; /*< Grace periods done when retired */
 };
 
 typedef enum hash_set_how {
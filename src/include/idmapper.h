@@ -54,22 +54,54 @@
  * @{
  */
 
-extern pthread_rwlock_t idmapper_user_lock;
-extern pthread_rwlock_t idmapper_group_lock;
+/**
+ * @brief Maps kept by the cache, each direction separately
+ */
+enum idmapper_map {
+	IDMAPPER_UNAME,		/*< User name or principal to UID */
+	IDMAPPER_UID,		/*< UID to user name */
+	IDMAPPER_GNAME,		/*< Group name to GID */
+	IDMAPPER_GID,		/*< GID to group name */
+	IDMAPPER_MAPS
+};
+
+/**
+ * @brief Result of a cache look up
+ */
+enum idmapper_status {
+	IDMAPPER_MISS,		/*< Not cached */
+	IDMAPPER_HIT,		/*< Cached and current */
+	IDMAPPER_STALE,		/*< Cached but expired, the caller should
+				    have it looked up again */
+};
+
+/* Longest name kept in the cache, user@domain included */
+#define IDMAPPER_NAME_MAX 1024
+
+/**
+ * @brief A name to ID entry, copied out by idmapper_lookup_name
+ */
+struct idmapper_found {
+	uint32_t id;		/*< UID or GID */
+	gid_t gid;		/*< Primary GID, for users found by name */
+	bool gid_set;		/*< gid is valid */
+	bool negative;		/*< The name could not be looked up */
+};
 
 void idmapper_cache_init(void);
-bool idmapper_add_user(const struct gsh_buffdesc *, uid_t, const gid_t *,
-		       bool);
-bool idmapper_add_group(const struct gsh_buffdesc *, gid_t);
-bool idmapper_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
-			      const gid_t **, bool);
-bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
-			    const gid_t **);
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
-bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **);
+enum idmapper_status idmapper_lookup_name(enum idmapper_map,
+					  const struct gsh_buffdesc *,
+					  struct idmapper_found *);
+enum idmapper_status idmapper_encode_id(enum idmapper_map, uint32_t, XDR *,
+					bool *);
+void idmapper_cache_set(enum idmapper_map, const struct gsh_buffdesc *,
+			uint32_t, const gid_t *, bool);
+void idmapper_cache_retry(enum idmapper_map, const struct gsh_buffdesc *,
+			  uint32_t);
 /** @} */
 
 bool idmapper_init(void);
+void idmapper_shutdown(void);
 void idmapper_clear_cache(void);
 
 bool xdr_encode_nfs4_owner(XDR *, uid_t);
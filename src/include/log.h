@@ -198,6 +198,14 @@ int set_log_destination(const char *name, char *dest);
 int set_log_level(const char *name, log_levels_t max_level);
 void set_const_log_str(void);
 
+/* Asynchronous file logging, see log/log_async.c */
+int log_async_start(uint64_t ring_size, uint32_t flush_interval);
+void log_async_stop(void);
+void log_async_flush(void);
+int log_async_open(const char *path, mode_t mode);
+void log_async_close(const char *path);
+bool log_async_write(const char *path, const char *buf, size_t len);
+
 struct log_component_info {
 	const char *comp_name;	/* component name */
 	const char *comp_str;	/* shorter, more useful name */
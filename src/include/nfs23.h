@@ -816,6 +816,10 @@ typedef struct entryplus3 entryplus3;
 struct dirlistplus3 {
 	entryplus3 *entries;
 	bool_t eof;
+	/* Encoding only: the entries already in XDR form, ending with the
+	 * FALSE after the last one, sent in place of entries if not NULL. */
+	char *entries_xdr;
+	u_int entries_xdr_len;
 };
 typedef struct dirlistplus3 dirlistplus3;
 
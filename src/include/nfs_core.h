@@ -163,14 +163,43 @@ void nfs_rpc_dispatch_stop(void);
 
 request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker);
 void nfs_rpc_enqueue_req(request_data_t *req);
+void nfs_rpc_fq_release(request_data_t *req);
+void nfs_rpc_defer_req(nfs_request_t *reqnfs, nsecs_elapsed_t delay);
 uint32_t get_dequeue_count(void);
 uint32_t get_enqueue_count(void);
 
 /* in nfs_worker_thread.c */
 
-void nfs_rpc_execute(request_data_t *req);
+bool nfs_rpc_execute(request_data_t *req);
+bool nfs_rpc_resume(request_data_t *req);
+void nfs_rpc_complete_async_request(nfs_request_t *reqnfs);
+bool nfs_rpc_rate_limit(nfs_request_t *reqnfs, bool write, uint64_t bytes);
 const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *);
 
+/**
+ * @brief Get the NFS request a service function is working on
+ *
+ * @param[in] req  The svc_req passed to the service function
+ *
+ * @return The enclosing request.
+ */
+static inline nfs_request_t *nfs_req_from_svc(struct svc_req *req)
+{
+	return container_of(req, nfs_request_t, svc);
+}
+
+/**
+ * @brief Check whether a request may be suspended for asynchronous I/O
+ *
+ * @param[in] reqnfs  The request
+ *
+ * @return true if the service function may return NFS_REQ_ASYNC_WAIT.
+ */
+static inline bool nfs_rpc_async_allowed(nfs_request_t *reqnfs)
+{
+	return (reqnfs->async_flags & NFS_REQ_ASYNC_DISABLED) == 0;
+}
+
 int worker_init(void);
 int worker_shutdown(void);
 
@@ -108,6 +108,7 @@ struct dupreq_entry {
 	dupreq_state_t state;
 	uint32_t refcnt;
 	nfs_res_t *res;
+	struct nfs_encoded_reply *enc;	/* encoded reply, replaces res */
 	time_t timestamp;
 };
 
@@ -145,5 +146,18 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *,
 dupreq_status_t nfs_dupreq_finish(struct svc_req *, nfs_res_t *);
 dupreq_status_t nfs_dupreq_delete(struct svc_req *);
 void nfs_dupreq_rele(struct svc_req *, const nfs_function_desc_t *);
+struct nfs_encoded_reply *nfs_dupreq_encode(struct svc_req *,
+					    const nfs_function_desc_t *,
+					    nfs_res_t *);
+struct nfs_encoded_reply *nfs_dupreq_encoded(struct svc_req *);
+
+struct nfs_encoded_reply *nfs_reply_encode(xdrproc_t, void *);
+void nfs_reply_put(struct nfs_encoded_reply *);
+bool xdr_nfs_encoded_reply(XDR *, struct nfs_encoded_reply *);
+
+static inline void nfs_reply_get(struct nfs_encoded_reply *enc)
+{
+	(void)atomic_inc_int32_t(&enc->refcount);
+}
 
 #endif /* NFS_DUPREQ_H */
@@ -93,6 +93,7 @@ typedef struct exportlist_client_entry__ {
 		struct {
 			unsigned int netaddr;
 			unsigned int netmask;
+			int pflen;	/* prefix length, -1 if not a prefix */
 		} network;
 		struct {
 			char *netgroupname;
@@ -105,6 +106,7 @@ typedef struct exportlist_client_entry__ {
 		} gssprinc;
 	} client;
 	struct export_perms client_perms;	/*< Available mount options */
+	struct rate_limits rate_limits;	/*< READ and WRITE limits */
 } exportlist_client_entry_t;
 
 /* Constants for export options masks */
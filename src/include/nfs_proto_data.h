@@ -100,9 +100,23 @@ typedef union nfs_arg__ {
 	ext_setquota_args arg_ext_rquota_setactivequota;
 } nfs_arg_t;
 
+/**
+ * @brief An XDR encoded reply body, kept for retransmission
+ */
+struct nfs_encoded_reply {
+	int32_t refcount;	/*< References from caches and replies */
+	uint32_t len;		/*< Length of the encoded body */
+	char data[];		/*< The encoded body */
+};
+
 struct COMPOUND4res_extended {
 	COMPOUND4res res_compound4;
 	bool res_cached;
+	size_t res_size;	/*< Memory accounted to the reply cache */
+	struct nfs_encoded_reply *res_encoded;	/*< If set, the reply is
+						   sent from here and
+						   res_compound4 only holds
+						   the status */
 };
 
 typedef union nfs_res__ {
@@ -187,14 +201,37 @@ typedef struct nfs_function_desc__ {
 	xdrproc_t xdr_encode_func;
 	char *funcname;
 	unsigned int dispatch_behaviour;
+	nfs_protocol_function_t resume_function; /*< Continue a request whose
+						     service function returned
+						     NFS_REQ_ASYNC_WAIT */
 } nfs_function_desc_t;
 
+/* Flags for nfs_request_t.async_flags */
+#define NFS_REQ_ASYNC_SUSPENDED	0x0001	/* Worker has given up the request */
+#define NFS_REQ_ASYNC_COMPLETE	0x0002	/* Asynchronous work is done */
+#define NFS_REQ_ASYNC_DISABLED	0x0004	/* Request may not be suspended */
+#define NFS_REQ_ASYNC_RERUN	0x0008	/* Run the service function again
+					   rather than resume it */
+
 typedef struct nfs_request {
 	struct svc_req svc;
 	struct nfs_request_lookahead lookahead;
 	nfs_arg_t arg_nfs;
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
+	/* Request context, kept here rather than on the worker's stack so a
+	 * request can be suspended while asynchronous I/O is in flight and
+	 * resumed on another worker.
+	 */
+	struct req_op_context req_ctx;
+	struct export_perms export_perms;
+	struct user_cred user_credentials;
+	uint32_t async_flags;
+	nsecs_elapsed_t deferred_until;	/*< When a request deferred by
+					    nfs_rpc_defer_req goes again */
+	void *proc_data;	/*< Protocol state kept across a suspension */
+	struct gsh_client *client;	/*< Client charged for the request by
+					    fair queuing, holds a ref */
 } nfs_request_t;
 
 enum rpc_chan_type {
@@ -316,6 +353,10 @@ typedef struct compound_data {
 	struct COMPOUND4res_extended *cached_res;	/*< NFv41: pointer to
 							   cached RPC result in
 							   a session's slot */
+	struct COMPOUND4res_extended replay_res; /*< NFSv4.1: reply
+						    replayed from a slot,
+						    with its own reference
+						    to the encoded reply */
 	bool use_drc;		/*< Set to true if session DRC is to be used */
 	uint32_t oppos;		/*< Position of the operation within the
 				    request processed  */
@@ -325,6 +366,14 @@ typedef struct compound_data {
 				   (if applicable) */
 	slotid4 slot;		/*< Slot ID of the current compound
 				   (if applicable) */
+	bool op_async;		/*< Set by an operation that started
+				    asynchronous I/O; its resume function
+				    finishes it */
+	bool op_deferred;	/*< Set with op_async by an operation
+				    deferred by rate limiting; it is run
+				    again instead of resumed */
+	void *op_data;		/*< Operation state kept across suspension */
+	nsecs_elapsed_t op_start_time;	/*< Start of the suspended op */
 } compound_data_t;
 
 typedef int (*nfs4_op_function_t) (struct nfs_argop4 *, compound_data_t *,
@@ -120,8 +120,12 @@ int nfs3_readlink(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
 int nfs3_read(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
+int nfs3_read_resume(nfs_arg_t *, struct svc_req *, nfs_res_t *);
+
 int nfs3_write(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
+int nfs3_write_resume(nfs_arg_t *, struct svc_req *, nfs_res_t *);
+
 int nfs3_create(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
 int nfs3_remove(nfs_arg_t *, struct svc_req *, nfs_res_t *);
@@ -155,6 +159,7 @@ int nfs3_mknod(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 /* Functions needed for nfs v4 */
 
 int nfs4_Compound(nfs_arg_t *, struct svc_req *, nfs_res_t *);
+int nfs4_Compound_resume(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
 int nfs4_op_access(struct nfs_argop4 *, compound_data_t *,
 		   struct nfs_resop4 *);
@@ -214,6 +219,8 @@ int nfs4_op_putrootfh(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
 
 int nfs4_op_read(struct nfs_argop4 *, compound_data_t *, struct nfs_resop4 *);
+int nfs4_op_read_resume(struct nfs_argop4 *, compound_data_t *,
+			struct nfs_resop4 *);
 
 int nfs4_op_readdir(struct nfs_argop4 *, compound_data_t *,
 		    struct nfs_resop4 *);
@@ -306,6 +313,8 @@ int nfs4_op_test_stateid(struct nfs_argop4 *, compound_data_t *,
 			 struct nfs_resop4 *);
 
 int nfs4_op_write(struct nfs_argop4 *, compound_data_t *, struct nfs_resop4 *);
+int nfs4_op_write_resume(struct nfs_argop4 *, compound_data_t *,
+			 struct nfs_resop4 *);
 
 /* NFSv4.2 */
 int nfs4_op_write_same(struct nfs_argop4 *, compound_data_t *,
@@ -375,6 +384,8 @@ void nfs4_op_removexattr_Free(nfs_resop4 *resp);
 
 #define NFS_REQ_OK   0
 #define NFS_REQ_DROP 1
+#define NFS_REQ_ASYNC_WAIT 2	/* Suspended pending asynchronous I/O; the
+				 * descriptor's resume_function finishes it */
 
 /* Free functions */
 void mnt1_Mnt_Free(nfs_res_t *);
@@ -430,6 +441,8 @@ void nfs3_read_free(nfs_res_t *);
 
 void nfs4_Compound_FreeOne(nfs_resop4 *);
 void nfs4_Compound_Free(nfs_res_t *);
+void nfs4_Compound_FreeCached(struct COMPOUND4res_extended *);
+bool xdr_COMPOUND4res_extended(XDR *, struct COMPOUND4res_extended *);
 void nfs4_Compound_CopyResOne(nfs_resop4 *, nfs_resop4 *);
 void nfs4_Compound_CopyRes(nfs_res_t *, nfs_res_t *);
 
@@ -295,6 +295,11 @@ int nfs4_Fattr_Fill_Error(fattr4 *, nfsstat4);
 int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *, struct bitmap4 *,
 			   fattr4 *);
 
+u_int nfs4_Fattr_buflen(struct xdr_attrs_args *, struct bitmap4 *);
+
+int nfs4_FSALattr_To_Fattr_buf(struct xdr_attrs_args *, struct bitmap4 *,
+			       fattr4 *, char *, u_int);
+
 void nfs4_bitmap4_Remove_Unsupported(struct bitmap4 *);
 
 enum nfs4_minor_vers {
@@ -35,7 +35,10 @@
 #ifndef NFS_REQ_QUEUE_H
 #define NFS_REQ_QUEUE_H
 
+#include <sched.h>
 #include "gsh_list.h"
+#include "gsh_intrinsic.h"
+#include "abstract_atomic.h"
 #include "wait_queue.h"
 
 struct req_q {
@@ -67,14 +70,62 @@ struct req_q_set {
 	struct req_q_pair qset[N_REQ_QUEUES];
 };
 
+/**
+ * @brief The requests of one client in one class of one shard
+ *
+ * Each client has an array of these, one per shard and class, so
+ * queueing a request never allocates.
+ */
+struct req_flow {
+	struct glist_head link;	/* on the fair queue's active list */
+	struct glist_head q;	/* queued requests, oldest first */
+	uint32_t size;
+	uint32_t deficit;	/* requests left in this flow's turn */
+};
+
+/**
+ * @brief Deficit round robin over the clients of one class
+ *
+ * Flows with requests queued take turns; a flow's turn lasts for as
+ * many requests as its client's weight.
+ */
+struct req_fq {
+	pthread_spinlock_t sp;
+	struct glist_head active;	/* flows with requests, in turn */
+	uint32_t size;
+	uint32_t turn;	/* alternates with requests without a client */
+};
+
+/**
+ * @brief A set of request queues and the workers waiting on them
+ *
+ * With Dispatch_Shard_By = NONE there is one shard shared by every
+ * thread.  Otherwise there is one shard per CPU (or NUMA node);
+ * requests are queued on the shard of the CPU that decoded them, and
+ * workers serve the shard of the CPU they run on before stealing from
+ * the others.  With Dispatch_Fair_Queuing, requests with a client are
+ * queued per client in the fair queue of their class.
+ */
+struct req_q_shard {
+	struct req_q_set nfs_request_q;
+	struct req_fq fq[N_REQ_QUEUES];
+	uint32_t ctr;		/* rotates the class served first */
+	uint32_t size;		/* requests queued in this shard */
+	pthread_spinlock_t sp;	/* protects wait_list */
+	struct glist_head wait_list;
+	uint32_t waiters;
+	GSH_CACHE_PAD(0);
+};
+
 struct nfs_req_st {
 	struct {
-		uint32_t ctr;
-		struct req_q_set nfs_request_q;
-		uint64_t size;
-		pthread_spinlock_t sp;
-		struct glist_head wait_list;
-		uint32_t waiters;
+		struct req_q_shard *shards;
+		uint32_t nshards;
+		uint32_t ncpus;
+		uint32_t *cpu_shard;	/* shard of each CPU */
+		uint32_t waiters;	/* workers waiting on any shard */
+		uint8_t *schedule;	/* weighted order of the classes */
+		uint32_t schedule_len;
 	} reqs;
 	GSH_CACHE_PAD(1);
 	struct {
@@ -83,11 +134,18 @@ struct nfs_req_st {
 		uint32_t stalled;
 		bool active;
 	} stallq;
+	struct {
+		pthread_mutex_t mtx;
+		pthread_cond_t cv;
+		struct glist_head q;	/* deferred requests by deadline */
+		bool active;
+	} deferq;
 };
 
 extern struct nfs_req_st nfs_req_st;
 
 void nfs_rpc_queue_init(void);
+void nfs_rpc_queue_shards_init(uint32_t shard_by);
 
 static inline void nfs_rpc_q_init(struct req_q *q)
 {
@@ -97,29 +155,52 @@ static inline void nfs_rpc_q_init(struct req_q *q)
 	q->waiters = 0;
 }
 
-static inline uint32_t nfs_rpc_q_next_slot(void)
+static inline uint32_t nfs_rpc_q_next_slot(struct req_q_shard *shard)
 {
-	uint32_t ix = atomic_inc_uint32_t(&nfs_req_st.reqs.ctr);
+	uint32_t ix = atomic_inc_uint32_t(&shard->ctr);
 
 	if (!ix)
-		ix = atomic_inc_uint32_t(&nfs_req_st.reqs.ctr);
+		ix = atomic_inc_uint32_t(&shard->ctr);
 	return ix;
 }
 
+/**
+ * @brief Shard of the calling thread
+ */
+static inline struct req_q_shard *nfs_rpc_q_local_shard(void)
+{
+	int cpu;
+
+	if (nfs_req_st.reqs.nshards == 1)
+		return nfs_req_st.reqs.shards;
+
+	cpu = sched_getcpu();
+	if (cpu < 0 || (uint32_t) cpu >= nfs_req_st.reqs.ncpus)
+		cpu = 0;
+
+	return &nfs_req_st.reqs.shards[nfs_req_st.reqs.cpu_shard[cpu]];
+}
+
 static inline void nfs_rpc_queue_awaken(void *arg)
 {
 	struct nfs_req_st *st = arg;
+	struct req_q_shard *shard;
 	struct glist_head *g = NULL;
 	struct glist_head *n = NULL;
-
-	pthread_spin_lock(&st->reqs.sp);
-	glist_for_each_safe(g, n, &st->reqs.wait_list) {
-		wait_q_entry_t *wqe = glist_entry(g, wait_q_entry_t, waitq);
-
-		pthread_cond_signal(&wqe->lwe.cv);
-		pthread_cond_signal(&wqe->rwe.cv);
+	uint32_t ix;
+
+	for (ix = 0; ix < st->reqs.nshards; ++ix) {
+		shard = &st->reqs.shards[ix];
+		pthread_spin_lock(&shard->sp);
+		glist_for_each_safe(g, n, &shard->wait_list) {
+			wait_q_entry_t *wqe =
+				glist_entry(g, wait_q_entry_t, waitq);
+
+			pthread_cond_signal(&wqe->lwe.cv);
+			pthread_cond_signal(&wqe->rwe.cv);
+		}
+		pthread_spin_unlock(&shard->sp);
 	}
-	pthread_spin_unlock(&st->reqs.sp);
 }
 
 #endif				/* NFS_REQ_QUEUE_H */
@@ -21,6 +21,7 @@ extern "C" {
 
 #include "gsh_rpc.h"
 #include "nfs_fh.h"
+#include "gsh_iobuf.h"
 
 	typedef struct authsys_parms authsys_parms;
 #endif				/* _AUTH_SYS_DEFINE_FOR_NFSv41 */
@@ -1676,6 +1677,11 @@ extern "C" {
 	struct dirlist4 {
 		entry4 *entries;
 		bool_t eof;
+		/* Encoding only: the entries already in XDR form, ending
+		 * with the FALSE after the last one, sent in place of
+		 * entries if not NULL. */
+		char *entries_xdr;
+		u_int entries_xdr_len;
 	};
 	typedef struct dirlist4 dirlist4;
 
@@ -6386,7 +6392,7 @@ extern "C" {
 	{
 		if (!inline_xdr_bool(xdrs, &objp->eof))
 			return false;
-		if (!inline_xdr_bytes
+		if (!xdr_iobuf
 		    (xdrs, (char **)&objp->data.data_val,
 		     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 			return false;
@@ -6440,7 +6446,11 @@ extern "C" {
 
 	static inline bool xdr_dirlist4(XDR * xdrs, dirlist4 *objp)
 	{
-		if (!xdr_pointer
+		if (xdrs->x_op == XDR_ENCODE && objp->entries_xdr != NULL) {
+			if (!xdr_opaque(xdrs, objp->entries_xdr,
+					objp->entries_xdr_len))
+				return false;
+		} else if (!xdr_pointer
 		    (xdrs, (char **)&objp->entries, sizeof(entry4),
 		     (xdrproc_t) xdr_entry4))
 			return false;
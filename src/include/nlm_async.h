@@ -28,10 +28,8 @@
 
 #include "sal_data.h"
 
-extern pthread_mutex_t nlm_async_resp_mutex;
-extern pthread_cond_t nlm_async_resp_cond;
-
 int nlm_async_callback_init(void);
+void nlm_async_callback_shutdown(void);
 
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 			    nfs_res_t *pres);
@@ -39,11 +37,19 @@ int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 int nlm_send_async_res_nlm4test(state_nlm_client_t *host,
 				state_async_func_t func, nfs_res_t *pres);
 
-/* Client routine  to send the asynchrnous response, key is used to wait for
- * a response
+/**
+ * @brief Called once an asynchronous message has been sent or given up on
+ *
+ * @param[in] arg    The argument given to nlm_send_async
+ * @param[in] retval RPC_SUCCESS or the RPC error
  */
-int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key);
+typedef void (*nlm_send_done_t)(void *arg, int retval);
 
-void nlm_signal_async_resp(void *key);
+/* Client routine to queue an asynchronous response, it never waits for
+ * the client.  If the message cannot be queued, done is not called and
+ * the error is returned.
+ */
+int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg,
+		   nlm_send_done_t done, void *done_arg);
 
 #endif				/* NLM_ASYNC_H */
@@ -0,0 +1,63 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file rate_limit.h
+ * @brief READ and WRITE rate limiting
+ *
+ * Each export, and each client of an export that matched a CLIENT
+ * block with limits, has a token bucket per limit.  A bucket fills at
+ * the configured rate and holds at most one second's worth.  An
+ * operation that would overdraw a bucket is not charged; the caller is
+ * told how long to wait and defers the request for that long.
+ */
+
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "gsh_types.h"
+
+enum rate_limit_bucket {
+	RATE_LIMIT_READ_BYTES,
+	RATE_LIMIT_WRITE_BYTES,
+	RATE_LIMIT_READ_OPS,
+	RATE_LIMIT_WRITE_OPS,
+	RATE_LIMIT_BUCKETS
+};
+
+struct rate_limiter {
+	pthread_mutex_t lock;		/*< Protects the rest */
+	nsecs_elapsed_t last;		/*< Last time the buckets were filled */
+	double tokens[RATE_LIMIT_BUCKETS];	/*< Negative after an operation
+						    bigger than the bucket */
+};
+
+struct gsh_client;
+
+void rate_limiter_init(struct rate_limiter *rl);
+void rate_limiter_destroy(struct rate_limiter *rl);
+void rate_limit_client_free(struct gsh_client *client);
+
+nsecs_elapsed_t rate_limit_check(bool write, uint64_t bytes);
+
+#endif /* RATE_LIMIT_H */
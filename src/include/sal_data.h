@@ -116,12 +116,28 @@ extern pool_t *nfs41_session_pool;
 extern hash_table_t *ht_session_id;
 
 /**
- * @brief Number of forechannel slots in a session
+ * @brief Memory held by cached replies in all session slots
  *
- * This is also the maximum number of backchannel slots we'll use,
- * even if the client offers more.
+ * Compared against Session_Reply_Cache_Size.
  */
-#define NFS41_NB_SLOTS 3
+
+extern uint64_t nfs41_session_cache_size;
+
+/**
+ * @brief Upper bound for Max_Session_Slots
+ *
+ * The number of forechannel slots in a session is negotiated in
+ * CREATE_SESSION up to the configured Max_Session_Slots.
+ */
+#define NFS41_MAX_SLOTS 1024
+
+/**
+ * @brief Number of backchannel slots in a session
+ *
+ * This is the maximum number of backchannel slots we'll use, even if
+ * the client offers more.
+ */
+#define NFS41_NB_CB_SLOTS 3
 
 /**
  * @brief Members in the slot table
@@ -170,10 +186,14 @@ struct nfs41_session {
 	SVCXPRT *xprt;		/*< Referenced pointer to transport */
 
 	channel_attrs4 fore_channel_attrs;	/*< Fore-channel attributes */
-	nfs41_session_slot_t slots[NFS41_NB_SLOTS];	/*< Slot table */
+	nfs41_session_slot_t *slots;	/*< Slot table, of
+					   fore_channel_attrs.ca_maxrequests
+					   entries */
+	slotid4 highest_used_slotid;	/*< Highest slot the client said it
+					   was using in its last SEQUENCE */
 
 	channel_attrs4 back_channel_attrs;	/*< Back-channel attributes */
-	nfs41_cb_session_slot_t cb_slots[NFS41_NB_SLOTS];	/*< Callback
+	nfs41_cb_session_slot_t cb_slots[NFS41_NB_CB_SLOTS];	/*< Callback
 								   Slot table */
 	uint32_t cb_program;	/*< Callback program ID */
 	struct rpc_call_channel cb_chan;	/*< Back channel */
@@ -214,13 +234,20 @@ typedef struct rdel_fh {
  * @brief A client entry
  */
 typedef struct clid_entry {
-	struct glist_head cl_list;	/*< Link in the list */
+	struct glist_head cl_list;	/*< Link in the hash chain */
 	struct glist_head cl_rfh_list;
-	char cl_name[PATH_MAX];	/*< Client name */
+	uint64_t cl_hash;		/*< Hash of the name */
+	char cl_name[];			/*< Client name */
 } clid_entry_t;
 
-extern char v4_old_dir[PATH_MAX];
-extern char v4_recov_dir[PATH_MAX];
+/**
+ * @brief A hash table of client entries, keyed by name
+ */
+struct clid_table {
+	struct glist_head *buckets;	/*< Hash chains */
+	uint32_t size;			/*< Number of chains, a power of 2 */
+	uint32_t count;			/*< Number of entries */
+};
 
 /******************************************************************************
  *
@@ -478,6 +505,8 @@ typedef struct state_nsm_client_t {
 				   structure */
 	int32_t ssc_monitored;	/*< If this client is actively
 				   monitored */
+	bool ssc_nsm_queued;	/*< SM_MON queued or in flight,
+				   protected by nsm_mutex */
 	int32_t ssc_nlm_caller_name_len;	/*< Length of identifier */
 	char *ssc_nlm_caller_name;	/*< Client identifier */
 } state_nsm_client_t;
@@ -495,8 +524,6 @@ struct state_nlm_client_t {
 						     made */
 	int32_t slc_nlm_caller_name_len;	/*< Length of client name */
 	char *slc_nlm_caller_name;	/*< Client name */
-	CLIENT *slc_callback_clnt;	/*< Callback for blocking locks */
-	AUTH *slc_callback_auth;	/*< Authentication for callback */
 };
 
 /**
@@ -836,6 +863,12 @@ struct state_lock_entry_t {
 	int32_t sle_ref_count;	/*< Reference count */
 	fsal_lock_param_t sle_lock;	/*< Lock description */
 	pthread_mutex_t sle_mutex;	/*< Mutex to protect the structure */
+	state_lock_entry_t *sle_tree_left;	/*< Lock range tree links */
+	state_lock_entry_t *sle_tree_right;
+	uint64_t sle_tree_max_end;	/*< Last byte locked in subtree */
+	struct gsh_export *sle_tree_export;	/*< Export of all locks in
+						   subtree, NULL if mixed */
+	int32_t sle_tree_height;	/*< Subtree height, 0 if not in tree */
 };
 
 /**
@@ -888,6 +921,11 @@ struct state_file {
 	struct glist_head layoutrecall_list;
 	/** Pointers for lock list. Protected by state_lock */
 	struct glist_head lock_list;
+	/** Range tree of the lock_list entries. Protected by state_lock */
+	state_lock_entry_t *lock_tree;
+	/** Entries in lock_list that are not granted. Protected by
+	    state_lock */
+	uint32_t lock_pending;
 	/** Pointers for NLM share list. Protected by state_lock */
 	struct glist_head nlm_share_list;
 	/** Share reservation state for this file. Protected by state_lock */
@@ -1026,7 +1064,6 @@ typedef void (state_async_func_t) (state_async_queue_t *arg);
  */
 typedef struct state_nlm_async_data_t {
 	state_nlm_client_t *nlm_async_host;	/*< The client */
-	void *nlm_async_key;	/*< Identifying key */
 	union {
 		nfs_res_t nlm_async_res;	/*< Asynchronous response */
 		nlm4_testargs nlm_async_grant;	/*< Arguments for grant */
@@ -373,6 +373,9 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 
 int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE]);
 void nfs41_Build_sessionid(clientid4 *clientid, char *sessionid);
+void nfs41_Session_Release_Slots(nfs41_session_t *session, slotid4 highest);
+slotid4 nfs41_Session_Target_Slotid(nfs41_session_t *session);
+bool nfs41_Session_Cache_Full(void);
 void nfs41_Session_PrintAll(void);
 
 /******************************************************************************
@@ -994,14 +997,58 @@ void blocked_lock_polling(struct fridgethr_context *ctx);
  *
  ******************************************************************************/
 
+/**
+ * @brief Stable storage for NFSv4 recovery
+ *
+ * A backend keeps the names of clients holding state, and the handles
+ * of delegations revoked from them, so that after a restart or a
+ * takeover the clients may reclaim their state.  The recovery code
+ * serializes calls to recovery_read_clids and recovery_cleanup under
+ * the grace mutex; the other calls may be made concurrently.
+ */
+struct nfs4_recovery_backend {
+	/** Set up the stable storage, at startup */
+	void (*recovery_init)(void);
+	/** Release it, at shutdown */
+	void (*recovery_shutdown)(void);
+	/** Pass the clients that may reclaim to nfs4_add_clid_entry,
+	    and their revoked handles to clid_entry_add_rfh */
+	void (*recovery_read_clids)(nfs_grace_start_t *gsp);
+	/** Forget the clients of the previous instance, after grace */
+	void (*recovery_cleanup)(void);
+	/** Periodic housekeeping, called by the reaper; may be NULL */
+	void (*recovery_maintain)(void);
+	/** Record a client, named by its cid_recov_dir */
+	void (*add_clid)(nfs_client_id_t *clientid);
+	/** Forget a client */
+	void (*rm_clid)(nfs_client_id_t *clientid);
+	/** Record a delegation revoked from a client */
+	void (*add_revoke_fh)(nfs_client_id_t *clientid, const char *rhdlstr);
+};
+
+extern struct nfs4_recovery_backend fs_recovery_backend;
+extern struct nfs4_recovery_backend log_recovery_backend;
+
+void clid_table_init(struct clid_table *tbl);
+clid_entry_t *clid_table_lookup(struct clid_table *tbl, const char *name);
+clid_entry_t *clid_table_add(struct clid_table *tbl, const char *name);
+void clid_table_del(struct clid_table *tbl, clid_entry_t *clid_ent);
+void clid_table_clear(struct clid_table *tbl);
+bool clid_entry_has_rfh(clid_entry_t *clid_ent, const char *rfh_str);
+void clid_entry_add_rfh(clid_entry_t *clid_ent, const char *rfh_str);
+
+clid_entry_t *nfs4_add_clid_entry(const char *cl_name);
+
+void nfs4_recovery_init(void);
+void nfs4_recovery_shutdown(void);
+void nfs4_recovery_cleanup(void);
+void nfs4_recovery_maintain(void);
 void nfs4_start_grace(nfs_grace_start_t *gsp);
 int nfs_in_grace(void);
 void nfs4_add_clid(nfs_client_id_t *);
-void nfs4_rm_clid(const char *, char *, int);
+void nfs4_rm_clid(nfs_client_id_t *);
 void nfs4_chk_clid(nfs_client_id_t *);
 void nfs4_load_recov_clids(nfs_grace_start_t *gsp);
-void nfs4_clean_old_recov_dir(char *);
-void nfs4_create_recov_dir(void);
 void nfs4_record_revoke(nfs_client_id_t *, nfs_fh4 *);
 bool nfs4_check_deleg_reclaim(nfs_client_id_t *, nfs_fh4 *);
 
@@ -41,10 +41,13 @@
 
 #include <sys/types.h>
 
+void server_stats_init(void);
 void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup);
 
 #ifdef _USE_9P
 void server_stats_9p_done(u8 msgtype, struct _9p_request_data *req9p);
+void server_stats_9p_fid(struct gsh_client *client, bool created,
+			 uint32_t conn_fids, bool grown);
 #endif
 
 void server_stats_io_done(size_t requested,
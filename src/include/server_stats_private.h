@@ -60,6 +60,12 @@ struct nfsv41_stats;
 struct nfsv42_stats;
 struct deleg_stats;
 struct _9p_stats;
+struct op_hists;
+
+/* All but deleg point to an array of shards, one unless
+ * Shard_Client_Stats is set, see server_stats.c.  Only the functions
+ * there know how to sum them.
+ */
 
 struct gsh_stats {
 	struct nfsv3_stats *nfsv3;
@@ -167,6 +173,13 @@ struct export_stats {
 	.direction = "out" \
 }
 
+#define FID_STATS_REPLY    \
+{                          \
+	.name = "fids",    \
+	.type = "(ttttt)", \
+	.direction = "out" \
+}
+
 #define TOTAL_OPS_REPLY      \
 {                            \
 	.name = "op",        \
@@ -235,6 +248,56 @@ struct export_stats {
 	.direction = "out"  \
 }
 
+/* count, sum, p50, p90, p99, p99.9, max, then (limit, count) of the
+ * non-empty buckets
+ */
+#define HIST_REPLY_TYPE "(ttttttta(tt))"
+
+#define PROTO_OP_ARG         \
+{                            \
+	.name = "proto",     \
+	.type = "s",         \
+	.direction = "in"    \
+},                           \
+{                            \
+	.name = "op",        \
+	.type = "s",         \
+	.direction = "in"    \
+}
+
+#define OP_LATENCY_REPLY           \
+{                                  \
+	.name = "latency",         \
+	.type = HIST_REPLY_TYPE,   \
+	.direction = "out"         \
+},                                 \
+{                                  \
+	.name = "queue_wait",      \
+	.type = HIST_REPLY_TYPE,   \
+	.direction = "out"         \
+}
+
+#define IO_HIST_REPLY              \
+{                                  \
+	.name = "read_latency",    \
+	.type = HIST_REPLY_TYPE,   \
+	.direction = "out"         \
+},                                 \
+{                                  \
+	.name = "read_size",       \
+	.type = HIST_REPLY_TYPE,   \
+	.direction = "out"         \
+},                                 \
+{                                  \
+	.name = "write_latency",   \
+	.type = HIST_REPLY_TYPE,   \
+	.direction = "out"         \
+},                                 \
+{                                  \
+	.name = "write_size",      \
+	.type = HIST_REPLY_TYPE,   \
+	.direction = "out"         \
+}
 
 void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st);
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter);
@@ -250,7 +313,11 @@ void server_dbus_total_ops(struct export_stats *export_st,
 			   DBusMessageIter *iter);
 void global_dbus_total_ops(DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
+struct op_hists *server_stats_op_hists(const char *proto, const char *op);
+void server_dbus_op_latency(struct op_hists *oh, DBusMessageIter *iter);
+void server_dbus_io_hists(struct gsh_stats *st, DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
+void pool_dbus_show(DBusMessageIter *iter);
 void server_reset_stats(DBusMessageIter *iter);
 void reset_export_stats(void);
 void reset_client_stats(void);
@@ -259,6 +326,7 @@ void reset_gsh_stats(struct gsh_stats *st);
 #ifdef _USE_9P
 void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter);
 void server_dbus_9p_transstats(struct _9p_stats *_9pp, DBusMessageIter *iter);
+void server_dbus_9p_fidstats(struct _9p_stats *_9pp, DBusMessageIter *iter);
 void server_dbus_9p_tcpstats(struct _9p_stats *_9pp, DBusMessageIter *iter);
 void server_dbus_9p_rdmastats(struct _9p_stats *_9pp, DBusMessageIter *iter);
 void server_dbus_9p_opstats(struct _9p_stats *_9pp, u8 opcode,
@@ -268,8 +336,8 @@ void server_dbus_9p_opstats(struct _9p_stats *_9pp, u8 opcode,
 #endif				/* USE_DBUS */
 
 void server_stats_free(struct gsh_stats *statsp);
-
-void server_stats_init(void);
+uint64_t server_stats_v41_reads(struct gsh_stats *st);
+uint64_t server_stats_v4_op_total(int proto_op);
 
 #endif				/* !SERVER_STATS_PRIVATE_H */
 /** @} */
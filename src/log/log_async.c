@@ -0,0 +1,580 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file log_async.c
+ * @brief Asynchronous file logging
+ *
+ * Threads logging to a file facility copy the formatted line into a
+ * ring buffer of their own.  Each ring has a single producer (the
+ * owning thread) and a single consumer (the writer thread), so the
+ * only synchronization is an atomic load/store of the head and tail
+ * offsets.  The writer wakes every flush interval, or sooner when a
+ * ring is half full, and writes everything queued with writev on a
+ * file descriptor it keeps open.  A line that does not fit is dropped
+ * and counted; the writer reports the count in the log.
+ *
+ * Lines from different threads may be written out of order with
+ * respect to each other; each line carries its own timestamp.
+ *
+ * Targets (one per open log file) are looked up by path.  The target
+ * list is only modified under the log rwlock held for write, and only
+ * read by producers that hold it for read, so it needs no lock of its
+ * own.  The writer never looks at the list and never logs, as it may
+ * be waited on by a thread holding the log rwlock.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "gsh_list.h"
+#include "common_utils.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+
+/** Ring records are aligned to this */
+#define LOG_RING_ALIGN 16
+
+/** Maximum iovecs handed to a single writev */
+#define LOG_ASYNC_IOV 64
+
+struct log_async_target {
+	struct glist_head targets;	/*< List of targets */
+	char *path;			/*< File path */
+	int fd;				/*< Persistent O_APPEND descriptor */
+	int refcnt;			/*< Facilities writing here */
+	bool error_reported;		/*< Write error already reported */
+};
+
+/**
+ * @brief Header of a record in a ring
+ *
+ * A record with a NULL target is padding at the end of the ring.
+ */
+struct log_ring_rec {
+	struct log_async_target *target;	/*< Where it goes */
+	uint32_t len;				/*< Bytes of text */
+	uint32_t total;				/*< Bytes of ring used */
+};
+
+struct log_ring {
+	struct glist_head rings;	/*< List of all rings */
+	char *buf;			/*< Ring storage */
+	uint64_t size;			/*< Size of buf, power of 2 */
+	uint64_t head;			/*< Consumed offset (writer) */
+	uint64_t tail;			/*< Produced offset (owner) */
+	uint64_t dropped;		/*< Lines that did not fit */
+	uint64_t dropped_seen;		/*< dropped already accounted */
+	int32_t dead;			/*< Owner thread has exited */
+};
+
+static struct glist_head log_async_targets =
+	GLIST_HEAD_INIT(log_async_targets);
+
+static pthread_mutex_t log_async_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_async_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_async_done_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head log_rings = GLIST_HEAD_INIT(log_rings);
+static pthread_t log_async_thrid;
+static int32_t log_async_running;
+static bool log_async_stopping;
+static uint64_t log_async_ring_size;
+static uint32_t log_async_interval;	/*< Flush interval (ms) */
+static uint64_t log_async_flush_req;	/*< Flush tickets issued */
+static uint64_t log_async_flush_done;	/*< Flush tickets honored */
+static uint64_t log_async_dropped;	/*< Dropped, not yet reported */
+
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_ring_key;
+static __thread struct log_ring *log_thread_ring;
+
+static cleanup_list_element log_async_cleanup = {
+	.clean = log_async_stop,
+};
+static bool log_async_cleanup_registered;
+
+static void log_ring_release(void *arg)
+{
+	struct log_ring *ring = arg;
+
+	/* The writer frees the ring once it is drained */
+	log_thread_ring = NULL;
+	atomic_store_int32_t(&ring->dead, 1);
+}
+
+static void log_ring_key_init(void)
+{
+	(void) pthread_key_create(&log_ring_key, log_ring_release);
+}
+
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring = log_thread_ring;
+
+	if (likely(ring != NULL))
+		return ring;
+
+	(void) pthread_once(&log_ring_once, log_ring_key_init);
+
+	ring = gsh_calloc(1, sizeof(*ring));
+
+	PTHREAD_MUTEX_lock(&log_async_mtx);
+	ring->size = log_async_ring_size;
+	ring->buf = gsh_malloc(ring->size);
+	glist_add_tail(&log_rings, &ring->rings);
+	PTHREAD_MUTEX_unlock(&log_async_mtx);
+
+	(void) pthread_setspecific(log_ring_key, ring);
+	log_thread_ring = ring;
+
+	return ring;
+}
+
+static struct log_async_target *log_async_lookup(const char *path)
+{
+	struct glist_head *glist;
+	struct log_async_target *target;
+
+	glist_for_each(glist, &log_async_targets) {
+		target = glist_entry(glist, struct log_async_target, targets);
+		if (strcmp(target->path, path) == 0)
+			return target;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Write a set of iovecs completely
+ *
+ * @return 0 or errno.
+ */
+static int log_async_writev(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t rc;
+
+	while (iovcnt > 0) {
+		rc = writev(fd, iov, iovcnt);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		if (rc == 0)
+			return ENOSPC;
+
+		while (iovcnt > 0 && (size_t) rc >= iov->iov_len) {
+			rc -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
+	}
+
+	return 0;
+}
+
+static void log_async_emit(struct log_async_target *target,
+			   struct iovec *iov, int iovcnt)
+{
+	int rc;
+
+	if (target == NULL || iovcnt == 0)
+		return;
+
+	rc = log_async_writev(target->fd, iov, iovcnt);
+
+	if (rc != 0 && !target->error_reported) {
+		target->error_reported = true;
+		fprintf(stderr,
+			"Error: couldn't complete write to the log file %s status=%d (%s)\n",
+			target->path, rc, strerror(rc));
+	} else if (rc == 0) {
+		target->error_reported = false;
+	}
+}
+
+/**
+ * @brief Write out everything queued in one ring
+ *
+ * @param[in]     ring     The ring to drain
+ * @param[in,out] dropmsg  Drop notice, sent ahead of the first batch
+ */
+static void log_ring_drain(struct log_ring *ring, struct iovec *dropmsg)
+{
+	struct iovec iov[LOG_ASYNC_IOV + 1];
+	struct log_async_target *target = NULL;
+	struct log_ring_rec *rec;
+	uint64_t head = ring->head;
+	uint64_t tail = atomic_fetch_uint64_t(&ring->tail);
+	int iovcnt = 0;
+
+	while (head != tail) {
+		rec = (struct log_ring_rec *)
+			(ring->buf + (head & (ring->size - 1)));
+		head += rec->total;
+
+		if (rec->target == NULL)
+			continue;
+
+		if (rec->target != target || iovcnt == LOG_ASYNC_IOV) {
+			log_async_emit(target, iov, iovcnt);
+			target = rec->target;
+			iovcnt = 0;
+			if (dropmsg->iov_len != 0) {
+				iov[iovcnt++] = *dropmsg;
+				dropmsg->iov_len = 0;
+			}
+		}
+
+		iov[iovcnt].iov_base = rec + 1;
+		iov[iovcnt].iov_len = rec->len;
+		iovcnt++;
+	}
+
+	log_async_emit(target, iov, iovcnt);
+
+	/* Only now may the owner reuse the space */
+	atomic_store_uint64_t(&ring->head, head);
+}
+
+/**
+ * @brief Drain all rings once
+ *
+ * Called with log_async_mtx held, which keeps the ring list stable.
+ */
+static void log_async_drain(void)
+{
+	struct glist_head *glist, *glistn;
+	struct log_ring *ring;
+	uint64_t dropped;
+	char dropbuf[96];
+	struct iovec dropmsg = {dropbuf, 0};
+
+	glist_for_each(glist, &log_rings) {
+		ring = glist_entry(glist, struct log_ring, rings);
+		dropped = atomic_fetch_uint64_t(&ring->dropped);
+		log_async_dropped += dropped - ring->dropped_seen;
+		ring->dropped_seen = dropped;
+	}
+
+	if (log_async_dropped != 0) {
+		dropmsg.iov_len = snprintf(dropbuf, sizeof(dropbuf),
+					   "Asynchronous logging dropped %"
+					   PRIu64 " messages\n",
+					   log_async_dropped);
+	}
+
+	glist_for_each_safe(glist, glistn, &log_rings) {
+		ring = glist_entry(glist, struct log_ring, rings);
+
+		log_ring_drain(ring, &dropmsg);
+
+		if (atomic_fetch_int32_t(&ring->dead) &&
+		    ring->head == atomic_fetch_uint64_t(&ring->tail)) {
+			glist_del(&ring->rings);
+			gsh_free(ring->buf);
+			gsh_free(ring);
+		}
+	}
+
+	/* Notice made it out with some batch, or stays pending */
+	if (log_async_dropped != 0 && dropmsg.iov_len == 0)
+		log_async_dropped = 0;
+}
+
+static void *log_async_thread(void *arg)
+{
+	struct timespec then;
+	uint64_t ticket;
+
+	SetNameFunction("log_writer");
+
+	PTHREAD_MUTEX_lock(&log_async_mtx);
+
+	while (true) {
+		if (!log_async_stopping &&
+		    log_async_flush_done == log_async_flush_req) {
+			clock_gettime(CLOCK_REALTIME, &then);
+			timespec_add_nsecs((nsecs_elapsed_t) log_async_interval
+					   * NS_PER_MSEC, &then);
+			(void) pthread_cond_timedwait(&log_async_cond,
+						      &log_async_mtx, &then);
+		}
+
+		ticket = log_async_flush_req;
+		log_async_drain();
+		log_async_flush_done = ticket;
+		pthread_cond_broadcast(&log_async_done_cond);
+
+		if (log_async_stopping)
+			break;
+	}
+
+	PTHREAD_MUTEX_unlock(&log_async_mtx);
+
+	return NULL;
+}
+
+/**
+ * @brief Start the writer, or update its parameters
+ *
+ * @param[in] ring_size      Bytes of ring per logging thread
+ * @param[in] flush_interval Longest time a line waits (ms)
+ *
+ * @return 0 or errno.
+ */
+int log_async_start(uint64_t ring_size, uint32_t flush_interval)
+{
+	uint64_t size = LOG_RING_ALIGN * 4;
+	int rc = 0;
+
+	/* Rings are a power of 2 so offsets can be masked */
+	while (size < ring_size)
+		size <<= 1;
+
+	PTHREAD_MUTEX_lock(&log_async_mtx);
+
+	/* Threads that already have a ring keep its size */
+	log_async_ring_size = size;
+	log_async_interval = flush_interval;
+
+	if (!atomic_fetch_int32_t(&log_async_running)) {
+		log_async_stopping = false;
+		rc = pthread_create(&log_async_thrid, NULL, log_async_thread,
+				    NULL);
+		if (rc == 0) {
+			atomic_store_int32_t(&log_async_running, 1);
+			if (!log_async_cleanup_registered) {
+				RegisterCleanup(&log_async_cleanup);
+				log_async_cleanup_registered = true;
+			}
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&log_async_mtx);
+
+	return rc;
+}
+
+/**
+ * @brief Stop the writer after writing out everything queued
+ *
+ * Lines logged afterwards are written synchronously.
+ */
+void log_async_stop(void)
+{
+	PTHREAD_MUTEX_lock(&log_async_mtx);
+
+	if (!atomic_fetch_int32_t(&log_async_running)) {
+		PTHREAD_MUTEX_unlock(&log_async_mtx);
+		return;
+	}
+
+	atomic_store_int32_t(&log_async_running, 0);
+	log_async_stopping = true;
+	pthread_cond_signal(&log_async_cond);
+
+	PTHREAD_MUTEX_unlock(&log_async_mtx);
+
+	(void) pthread_join(log_async_thrid, NULL);
+
+	/* Anything that raced with the stop */
+	PTHREAD_MUTEX_lock(&log_async_mtx);
+	log_async_drain();
+	PTHREAD_MUTEX_unlock(&log_async_mtx);
+}
+
+/**
+ * @brief Wait until everything queued so far has been written
+ */
+void log_async_flush(void)
+{
+	uint64_t ticket;
+
+	PTHREAD_MUTEX_lock(&log_async_mtx);
+
+	if (!atomic_fetch_int32_t(&log_async_running)) {
+		log_async_drain();
+		PTHREAD_MUTEX_unlock(&log_async_mtx);
+		return;
+	}
+
+	ticket = ++log_async_flush_req;
+	pthread_cond_signal(&log_async_cond);
+
+	while (log_async_flush_done < ticket &&
+	       atomic_fetch_int32_t(&log_async_running))
+		pthread_cond_wait(&log_async_done_cond, &log_async_mtx);
+
+	PTHREAD_MUTEX_unlock(&log_async_mtx);
+}
+
+/**
+ * @brief Open (or take another reference on) an asynchronous file
+ *
+ * Must be called with the log rwlock held for write.
+ *
+ * @param[in] path Log file path
+ * @param[in] mode Creation mode of the file
+ *
+ * @return 0 or -errno.
+ */
+int log_async_open(const char *path, mode_t mode)
+{
+	struct log_async_target *target = log_async_lookup(path);
+	int fd;
+
+	if (target != NULL) {
+		target->refcnt++;
+		return 0;
+	}
+
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, mode);
+	if (fd < 0)
+		return -errno;
+
+	target = gsh_calloc(1, sizeof(*target));
+	target->path = gsh_strdup(path);
+	target->fd = fd;
+	target->refcnt = 1;
+	glist_add_tail(&log_async_targets, &target->targets);
+
+	return 0;
+}
+
+/**
+ * @brief Drop a reference on an asynchronous file
+ *
+ * The last reference writes out what is queued for the file and
+ * closes it.  Must be called with the log rwlock held for write.
+ *
+ * @param[in] path Log file path
+ */
+void log_async_close(const char *path)
+{
+	struct log_async_target *target = log_async_lookup(path);
+
+	if (target == NULL || --target->refcnt > 0)
+		return;
+
+	glist_del(&target->targets);
+
+	/* No producer can queue more, the log rwlock is held */
+	log_async_flush();
+
+	(void) close(target->fd);
+	gsh_free(target->path);
+	gsh_free(target);
+}
+
+/**
+ * @brief Queue a line for an asynchronous file
+ *
+ * Must be called with the log rwlock held for read.
+ *
+ * @param[in] path Log file path
+ * @param[in] buf  Line, including its newline
+ * @param[in] len  Length of line
+ *
+ * @retval true if the line was queued or dropped.
+ * @retval false if the file is not asynchronous; the caller writes it.
+ */
+bool log_async_write(const char *path, const char *buf, size_t len)
+{
+	struct log_async_target *target;
+	struct log_ring *ring;
+	struct log_ring_rec *rec;
+	uint64_t head, tail, off, contig, total, used;
+	bool truncated = false;
+
+	if (!atomic_fetch_int32_t(&log_async_running))
+		return false;
+
+	target = log_async_lookup(path);
+	if (target == NULL)
+		return false;
+
+	ring = log_ring_get();
+
+	/* Never let one line take more than half the ring */
+	if (sizeof(*rec) + len > ring->size / 2) {
+		len = ring->size / 2 - sizeof(*rec);
+		truncated = true;
+	}
+
+	total = (sizeof(*rec) + len + LOG_RING_ALIGN - 1)
+		& ~((uint64_t) LOG_RING_ALIGN - 1);
+
+	tail = ring->tail;
+	head = atomic_fetch_uint64_t(&ring->head);
+	off = tail & (ring->size - 1);
+	contig = ring->size - off;
+
+	if ((contig < total ? contig : 0) + total > ring->size - (tail - head)) {
+		atomic_inc_uint64_t(&ring->dropped);
+		pthread_cond_signal(&log_async_cond);
+		return true;
+	}
+
+	if (contig < total) {
+		/* Pad out the end of the ring and wrap */
+		rec = (struct log_ring_rec *) (ring->buf + off);
+		rec->target = NULL;
+		rec->len = 0;
+		rec->total = contig;
+		tail += contig;
+		off = 0;
+	}
+
+	rec = (struct log_ring_rec *) (ring->buf + off);
+	rec->target = target;
+	rec->len = len;
+	rec->total = total;
+	memcpy(rec + 1, buf, len);
+	if (truncated)
+		((char *) (rec + 1))[len - 1] = '\n';
+
+	tail += total;
+	atomic_store_uint64_t(&ring->tail, tail);
+
+	used = tail - head;
+	if (used > ring->size / 2)
+		pthread_cond_signal(&log_async_cond);
+
+	return true;
+}
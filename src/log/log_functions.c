@@ -199,6 +199,7 @@ struct log_facility {
 					 */
 	lf_function_t *lf_func;	/*< Function that describes facility   */
 	void *lf_private;	/*< Private info for facility          */
+	bool lf_async;		/*< File written by the async writer   */
 };
 
 /* Define the maximum length of a user time/date format. */
@@ -228,6 +229,9 @@ static struct glist_head active_facility_list;
 
 static struct log_facility *default_facility;
 
+/* File facilities go through the async writer (log_async.c) */
+static bool async_file_logging;
+
 log_header_t max_headers = LH_COMPONENT;
 
 char const_log_str[LOG_BUFF_LEN] = "\0";
@@ -766,9 +770,12 @@ int create_log_facility(const char *name, lf_function_t *log_func,
 	facility->lf_max_level = max_level;
 	facility->lf_headers = header;
 
-	if (log_func == log_to_file && private != NULL)
+	if (log_func == log_to_file && private != NULL) {
 		facility->lf_private = gsh_strdup(private);
-	else
+		if (async_file_logging)
+			facility->lf_async =
+				log_async_open(private, log_mask) == 0;
+	} else
 		facility->lf_private = private;
 
 	glist_add_tail(&facility_list, &facility->lf_list);
@@ -817,6 +824,8 @@ void release_log_facility(const char *name)
 	if (!glist_null(&facility->lf_active))
 		glist_del(&facility->lf_active);
 	glist_del(&facility->lf_list);
+	if (facility->lf_async)
+		log_async_close(facility->lf_private);
 	PTHREAD_RWLOCK_unlock(&log_rwlock);
 	if (facility->lf_func == log_to_file &&
 	    facility->lf_private != NULL)
@@ -1017,6 +1026,11 @@ int set_log_destination(const char *name, char *dest)
 			return -errno;
 		}
 		logfile = gsh_strdup(dest);
+		if (facility->lf_async) {
+			log_async_close(facility->lf_private);
+			facility->lf_async = log_async_open(logfile,
+							    log_mask) == 0;
+		}
 		gsh_free(facility->lf_private);
 		facility->lf_private = logfile;
 	} else if (facility->lf_func == log_to_stream) {
@@ -1206,6 +1220,14 @@ static int log_to_file(log_header_t headers, void *private,
 	buffer->b_start[len] = '\n';
 	buffer->b_start[len + 1] = '\0';
 
+	/* Fatal messages must be out before we exit, so write them here
+	 * after whatever is still queued.
+	 */
+	if (level == NIV_FATAL)
+		log_async_flush();
+	else if (log_async_write(path, buffer->b_start, len + 1))
+		goto out;
+
 	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, log_mask);
 
 	if (fd != -1) {
@@ -1912,6 +1934,9 @@ struct logger_config {
 	struct glist_head facility_list;
 	struct logfields *logfields;
 	log_levels_t *comp_log_level;
+	bool async_file_logging;
+	uint64_t async_buffer_size;
+	uint32_t async_flush_interval;
 };
 
 /**
@@ -2407,6 +2432,60 @@ static void *log_conf_init(void *link_mem, void *self_struct)
 	return NULL;
 }
 
+/**
+ * @brief Switch file facilities to or from the async writer
+ *
+ * @param[in] logger The committed LOG block
+ */
+
+static void set_async_file_logging(struct logger_config *logger)
+{
+	struct glist_head *glist;
+	struct log_facility *facility;
+	bool enable = logger->async_file_logging;
+	int failed = 0;
+	int rc = 0;
+
+	if (enable) {
+		rc = log_async_start(logger->async_buffer_size,
+				     logger->async_flush_interval);
+		if (rc != 0) {
+			LogCrit(COMPONENT_CONFIG,
+				"Could not start async log writer (%s)",
+				strerror(rc));
+			enable = false;
+		}
+	}
+
+	PTHREAD_RWLOCK_wrlock(&log_rwlock);
+	async_file_logging = enable;
+	glist_for_each(glist, &facility_list) {
+		facility = glist_entry(glist, struct log_facility, lf_list);
+		if (facility->lf_func != log_to_file ||
+		    facility->lf_private == NULL ||
+		    facility->lf_async == enable)
+			continue;
+		if (enable) {
+			facility->lf_async =
+				log_async_open(facility->lf_private,
+					       log_mask) == 0;
+			if (!facility->lf_async)
+				failed++;
+		} else {
+			log_async_close(facility->lf_private);
+			facility->lf_async = false;
+		}
+	}
+	PTHREAD_RWLOCK_unlock(&log_rwlock);
+
+	if (!enable)
+		log_async_stop();
+	else if (failed != 0)
+		LogCrit(COMPONENT_CONFIG,
+			"%d log files could not be opened for async logging, they are written synchronously",
+			failed);
+}
+
 static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 			   struct config_error_type *err_type)
 {
@@ -2528,6 +2607,7 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 				gsh_free(component_log_level);
 			component_log_level = logger->comp_log_level;
 		}
+		set_async_file_logging(logger);
 	} else {
 		if (logger->logfields != NULL) {
 			struct logfields *lf = logger->logfields;
@@ -2558,6 +2638,12 @@ static struct config_item logging_params[] = {
 	CONF_ITEM_BLOCK("Components", component_levels,
 			component_init, component_commit,
 			logger_config, comp_log_level),
+	CONF_ITEM_BOOL("Async_File_Logging", false,
+		       logger_config, async_file_logging),
+	CONF_ITEM_UI64("Async_Buffer_Size", 16 * 1024, 64 * 1024 * 1024,
+		       128 * 1024, logger_config, async_buffer_size),
+	CONF_ITEM_UI32("Async_Flush_Interval", 1, 10000, 100,
+		       logger_config, async_flush_interval),
 	CONFIG_EOL
 };
 
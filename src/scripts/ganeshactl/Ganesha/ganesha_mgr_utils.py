@@ -83,6 +83,19 @@ class ClientMgr():
         msg = reply[1]
         return status, msg
 
+    def SetClientQoS(self, ipaddr, weight, max_reqs):
+        set_qos_method = self.dbusobj.get_dbus_method("SetClientQoS",
+                                                      self.dbus_interface)
+        try:
+           reply = set_qos_method(ipaddr, dbus.UInt32(weight),
+                                  dbus.UInt32(max_reqs))
+        except dbus.exceptions.DBusException as e:
+           return False, e
+
+        status = reply[0]
+        msg = reply[1]
+        return status, msg
+
     def ShowClients(self):
         show_client_method = self.dbusobj.get_dbus_method("ShowClients",
                                                           self.dbus_interface)
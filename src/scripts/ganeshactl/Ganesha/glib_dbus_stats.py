@@ -44,6 +44,23 @@ class RetrieveExportStats():
         stats_op = self.exportmgrobj.get_dbus_method("ShowCacheInode",
                                  self.dbus_exportstats_name)
         return InodeStats(stats_op())
+    # object pool stats
+    def pool_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowMemPools",
+                                 self.dbus_exportstats_name)
+        return PoolStats(stats_op())
+    # latency histograms of a single protocol op over all exports
+    def op_latency(self, proto, op):
+        stats_op = self.exportmgrobj.get_dbus_method("GetOpLatency",
+                                 self.dbus_exportstats_name)
+        return Histograms(stats_op(proto, op), ("Latency", "Queue wait"))
+    # read/write latency and size histograms of an export
+    def io_hist(self, export_id):
+        stats_op = self.exportmgrobj.get_dbus_method("GetIOHist",
+                                 self.dbus_exportstats_name)
+        return Histograms(stats_op(int(export_id)),
+                          ("Read latency", "Read size",
+                           "Write latency", "Write size"))
     # list of all exports
     def export_stats(self):
         stats_op = self.exportmgrobj.get_dbus_method("ShowExports",
@@ -241,6 +258,43 @@ class InodeStats():
                  "\nInode Cache Adds: " + str(self.cache_add) +
                  "\nInode Cache Mapping: " + str(self.cache_mapping) )
 
+class PoolStats():
+    def __init__(self, stats):
+        self.status = stats[1]
+        if stats[1] != "OK":
+            return
+        self.timestamp = (stats[2][0], stats[2][1])
+        self.pools = stats[3]
+    def __str__(self):
+        if self.status != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs" +
+                  "\n%-28s %8s %14s %14s %10s %12s %10s" % ("Pool", "Size", "Allocs",
+                  "Frees", "In use", "Slab bytes", "Exchanges"))
+        for pool in self.pools:
+            output += "\n%-28s %8d %14d %14d %10d %12d %10d" % (pool[0], pool[1], pool[2],
+                      pool[3], pool[4], pool[5], pool[6])
+        return output
+
+class Histograms():
+    def __init__(self, stats, names):
+        self.status = stats[1]
+        if stats[1] != "OK":
+            return
+        self.timestamp = (stats[2][0], stats[2][1])
+        self.hists = zip(names, stats[3:])
+    def __str__(self):
+        if self.status != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = "Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs"
+        for name, hist in self.hists:
+            output += ("\n%s: count %d sum %d p50 %d p90 %d p99 %d p99.9 %d max %d" %
+                       (name, hist[0], hist[1], hist[2], hist[3], hist[4],
+                        hist[5], hist[6]))
+            for bucket in hist[7]:
+                output += "\n\t< %-14d %d" % (bucket[0], bucket[1])
+        return output
+
 class FastStats():
     def __init__(self, stats):
         self.stats = stats
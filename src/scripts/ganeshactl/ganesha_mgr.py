@@ -49,6 +49,13 @@ class ManageClients():
         status, errormsg = self.clientmgr.RemoveClient(ipaddr)
         self.status_message(status, errormsg)
 
+    def setclientqos(self, ipaddr, weight, max_reqs):
+        print "Set QoS of client %s to weight %s, max requests %s" % \
+              (ipaddr, weight, max_reqs)
+        status, errormsg = self.clientmgr.SetClientQoS(ipaddr, int(weight),
+                                                       int(max_reqs))
+        self.status_message(status, errormsg)
+
     def showclients(self):
         print "Show clients"
         status, errormsg, reply = self.clientmgr.ShowClients()
@@ -224,6 +231,9 @@ if __name__ == '__main__':
        "   add_client ipaddr: Adds the client with the given IP\n\n"         \
        "   remove_client ipaddr: Removes the client with the given IP\n\n"   \
        "   show_client: Shows the current clients\n\n"                       \
+       "   set_client_qos ipaddr weight max_reqs: \n"                        \
+       "      Sets the fair queuing weight and request cap of the client\n"  \
+       "      with the given IP, 0 for the defaults\n\n"                     \
        "   display_export export_id: \n"                                     \
        "      Displays the export with the given ID\n\n"                     \
        "   show_exports: Displays all current exports\n\n"                   \
@@ -264,6 +274,12 @@ if __name__ == '__main__':
         clientmgr.removeclient(sys.argv[2])
     elif sys.argv[1] == "show_client":
         clientmgr.showclients()
+    elif sys.argv[1] == "set_client_qos":
+        if len(sys.argv) < 5:
+           print "set_client_qos requires an IP, a weight and a cap."\
+                 " Try \"ganesha_mgr.py help\" for more info"
+           sys.exit(1)
+        clientmgr.setclientqos(sys.argv[2], sys.argv[3], sys.argv[4])
 
     elif sys.argv[1] == "add_export":
         if len(sys.argv) < 4:
@@ -15,8 +15,9 @@ import Ganesha.glib_dbus_stats
 def usage():
     message = "Command gives global stats by default.\n"
     message += "%s [list_clients | deleg <ip address> | " % (sys.argv[0])
-    message += "inode | iov3 [export id] | iov4 [export id] | export |"
-    message += " total [export id] | fast | pnfs [export id] ]\n"
+    message += "inode | pools | iov3 [export id] | iov4 [export id] | export |"
+    message += " total [export id] | fast | pnfs [export id] |"
+    message += " latency <protocol> <op> | iohist <export id> ]\n"
     message += "To reset stat counters use \n"
     message += "%s reset " % (sys.argv[0])
     sys.exit(message)
@@ -27,8 +28,8 @@ else:
     command = sys.argv[1]
 
 # check arguments
-commands = ('help', 'list_clients', 'deleg', 'global', 'inode', 'iov3', 'iov4',
-           'export', 'total', 'fast', 'pnfs', 'reset')
+commands = ('help', 'list_clients', 'deleg', 'global', 'inode', 'pools', 'iov3', 'iov4',
+           'export', 'total', 'fast', 'pnfs', 'latency', 'iohist', 'reset')
 if command not in commands:
     print "Option \"%s\" is not correct." % (command)
     usage()
@@ -46,6 +47,17 @@ elif command in ('iov3', 'iov4', 'total', 'pnfs'):
         command_arg = sys.argv[2]
     else:
         usage()
+# requires a protocol and an op name
+elif command == "latency":
+    if not len(sys.argv) == 4:
+        print "Option \"%s\" must be followed by a protocol and an op." % (command)
+        usage()
+# requires an export id
+elif command == "iohist":
+    if not (len(sys.argv) == 3 and sys.argv[2].isdigit()):
+        print "Option \"%s\" must be followed by an export id." % (command)
+        usage()
+    command_arg = sys.argv[2]
 elif command == "help":
     usage()
 
@@ -58,6 +70,8 @@ elif command == "export":
     print exp_interface.export_stats()
 elif command == "inode":
     print exp_interface.inode_stats()
+elif command == "pools":
+    print exp_interface.pool_stats()
 elif command == "fast":
     print exp_interface.fast_stats()
 elif command == "list_clients":
@@ -72,5 +86,9 @@ elif command == "total":
     print exp_interface.total_stats(command_arg)
 elif command == "pnfs":
     print exp_interface.pnfs_stats(command_arg)
+elif command == "latency":
+    print exp_interface.op_latency(sys.argv[2], sys.argv[3])
+elif command == "iohist":
+    print exp_interface.io_hist(command_arg)
 elif command == "reset":
     print exp_interface.reset_stats()
@@ -0,0 +1,719 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright © Linux box Corporation, 2012
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file abstract_mem.c
+ * @brief Slab backed object pools with per-thread magazines
+ *
+ * Each pool owns a list of slabs carved into fixed size slots and a
+ * depot of magazines.  Every thread keeps two magazines (loaded and
+ * previous) per cached pool, so pool_alloc and pool_free only touch
+ * thread local state until a magazine runs empty or full.  At that
+ * point the thread trades with the depot under the pool lock, which
+ * is also where the per-thread counters are folded into the pool.
+ *
+ * Slabs are aligned on their (power of two) size, so the slab of an
+ * object is found by masking its address.  Each slab keeps its own
+ * free list; once more than POOL_EMPTY_SLABS_MAX slabs are entirely
+ * free, further ones are given back to the system.
+ *
+ * Objects are constructed when their slab is created and destroyed
+ * when it is released, so objects keep their constructed state while
+ * they are cached.  In pools with a constructor, the free list link
+ * lives after the object instead of over it.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "gsh_intrinsic.h"
+#include "gsh_list.h"
+#include "log.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Index of a pool that has no per-thread magazines */
+#define POOL_NO_INDEX UINT32_MAX
+
+/** Target slab size, a power of two */
+#define POOL_SLAB_SIZE (64 * 1024)
+
+/** Entirely free slabs kept before releasing them */
+#define POOL_EMPTY_SLABS_MAX 2
+
+/** Minimum number of objects per slab */
+#define POOL_SLAB_MIN_OBJECTS 8
+
+/** Slot alignment, matching what malloc guarantees */
+#define POOL_ALIGN 16
+
+/** Full magazines kept in the depot before draining to the slabs */
+#define POOL_DEPOT_MAX 64
+
+struct pool_magazine {
+	struct glist_head mag_list;	/*< Depot list linkage */
+	uint32_t rounds;		/*< Number of objects held */
+	void *objs[POOL_MAGAZINE_SIZE];	/*< The objects */
+};
+
+struct pool_slab {
+	struct glist_head slab_list;	/*< Partial or full list linkage */
+	void *free_objs;		/*< Free slots of this slab */
+	size_t nfree;			/*< Length of free_objs */
+};
+
+struct pool {
+	char *name;		/*< The name of the pool */
+	size_t object_size;	/*< The size of the objects created */
+	size_t slot_size;	/*< Aligned size of a slot in a slab */
+	size_t link_offset;	/*< Free list link position in a slot */
+	size_t slab_size;	/*< Bytes per slab, a power of two */
+	size_t slab_hdr;	/*< Aligned size of the slab header */
+	size_t slab_objects;	/*< Slots per slab */
+	uint32_t flags;		/*< POOL_ZERO */
+	uint32_t index;		/*< Per-thread cache index */
+	uint64_t gen;		/*< Unique generation of this pool */
+	pool_constructor_t constructor;
+	pool_destructor_t destructor;
+	struct glist_head pools;	/*< Registry linkage */
+	pthread_mutex_t lock;		/*< Protects everything below */
+	struct glist_head full_mags;	/*< Depot full magazines */
+	struct glist_head empty_mags;	/*< Depot empty magazines */
+	uint32_t nfull;			/*< Length of full_mags */
+	uint32_t nempty;		/*< Length of empty_mags */
+	struct glist_head partial_slabs;	/*< Slabs with free slots */
+	struct glist_head full_slabs;	/*< Slabs with none */
+	uint64_t nslabs;		/*< Number of slabs */
+	uint64_t nempty_slabs;		/*< Slabs with every slot free */
+	uint64_t allocs;		/*< Objects allocated */
+	uint64_t frees;			/*< Objects freed */
+	uint64_t exchanges;		/*< Magazine exchanges with the depot */
+};
+
+/**
+ * @brief Per-thread, per-pool magazine pair
+ */
+struct pool_cache {
+	uint64_t gen;			/*< Generation of the owning pool */
+	struct pool_magazine *loaded;	/*< Magazine in use */
+	struct pool_magazine *previous;	/*< Spare magazine */
+	uint64_t allocs;		/*< Not yet folded into the pool */
+	uint64_t frees;			/*< Not yet folded into the pool */
+};
+
+static pthread_mutex_t pool_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_t *pool_registry[POOL_MAX_CACHED];
+static struct glist_head pool_list = GLIST_HEAD_INIT(pool_list);
+static uint64_t pool_next_gen = 1;
+
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+static __thread struct pool_cache *pool_thread_cache;
+
+static void pool_cache_free(struct pool_cache *cache)
+{
+	gsh_free(cache->loaded);
+	gsh_free(cache->previous);
+	memset(cache, 0, sizeof(*cache));
+}
+
+/**
+ * @brief Fold a thread's counters into the pool
+ *
+ * Must be called with the pool lock held.
+ */
+static inline void pool_fold_counters(pool_t *pool, struct pool_cache *cache)
+{
+	pool->allocs += cache->allocs;
+	pool->frees += cache->frees;
+	cache->allocs = 0;
+	cache->frees = 0;
+}
+
+/**
+ * @brief Give a magazine back to the depot
+ *
+ * Must be called with the pool lock held.
+ */
+static void pool_depot_put(pool_t *pool, struct pool_magazine *mag)
+{
+	if (mag->rounds != 0) {
+		glist_add_tail(&pool->full_mags, &mag->mag_list);
+		pool->nfull++;
+	} else {
+		glist_add_tail(&pool->empty_mags, &mag->mag_list);
+		pool->nempty++;
+	}
+}
+
+/**
+ * @brief Return a thread's magazines when it exits
+ *
+ * @param[in] arg The thread's cache array
+ */
+static void pool_thread_release(void *arg)
+{
+	struct pool_cache *caches = arg;
+	struct pool_cache *cache;
+	pool_t *pool;
+	int i;
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+
+	for (i = 0; i < POOL_MAX_CACHED; i++) {
+		cache = &caches[i];
+
+		if (cache->gen == 0)
+			continue;
+
+		pool = pool_registry[i];
+
+		if (pool == NULL || pool->gen != cache->gen) {
+			/* Pool is gone, its slabs with it */
+			pool_cache_free(cache);
+			continue;
+		}
+
+		PTHREAD_MUTEX_lock(&pool->lock);
+		pool_fold_counters(pool, cache);
+		pool_depot_put(pool, cache->loaded);
+		pool_depot_put(pool, cache->previous);
+		PTHREAD_MUTEX_unlock(&pool->lock);
+		cache->gen = 0;
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	if (caches == pool_thread_cache)
+		pool_thread_cache = NULL;
+
+	gsh_free(caches);
+}
+
+static void pool_key_init(void)
+{
+	int rc = pthread_key_create(&pool_key, pool_thread_release);
+
+	if (rc != 0) {
+		LogFatal(COMPONENT_INIT,
+			 "Unable to create pool thread key: %d", rc);
+	}
+}
+
+static struct pool_magazine *pool_magazine_new(void)
+{
+	struct pool_magazine *mag = gsh_malloc(sizeof(*mag));
+
+	glist_init(&mag->mag_list);
+	mag->rounds = 0;
+
+	return mag;
+}
+
+/**
+ * @brief Find (or set up) this thread's magazines for a pool
+ *
+ * A cache slot whose generation does not match the pool belonged to
+ * a pool that has since been destroyed; the objects it holds lived in
+ * that pool's slabs and are simply forgotten.
+ *
+ * @param[in] pool The pool
+ *
+ * @return The cache, or NULL if the pool is depot only.
+ */
+static inline struct pool_cache *pool_cache_get(pool_t *pool)
+{
+	struct pool_cache *cache;
+
+	if (unlikely(pool->index == POOL_NO_INDEX))
+		return NULL;
+
+	if (unlikely(pool_thread_cache == NULL)) {
+		(void) pthread_once(&pool_key_once, pool_key_init);
+		pool_thread_cache = gsh_calloc(POOL_MAX_CACHED,
+					       sizeof(struct pool_cache));
+		(void) pthread_setspecific(pool_key, pool_thread_cache);
+	}
+
+	cache = &pool_thread_cache[pool->index];
+
+	if (unlikely(cache->gen != pool->gen)) {
+		if (cache->gen != 0)
+			pool_cache_free(cache);
+		cache->loaded = pool_magazine_new();
+		cache->previous = pool_magazine_new();
+		cache->gen = pool->gen;
+	}
+
+	return cache;
+}
+
+static inline void **pool_link(pool_t *pool, void *object)
+{
+	return (void **) ((char *) object + pool->link_offset);
+}
+
+static inline struct pool_slab *pool_slab_of(pool_t *pool, void *object)
+{
+	return (struct pool_slab *) ((uintptr_t) object &
+				     ~((uintptr_t) pool->slab_size - 1));
+}
+
+static inline void *pool_slab_slot(pool_t *pool, struct pool_slab *slab,
+				   size_t i)
+{
+	return (char *) slab + pool->slab_hdr + i * pool->slot_size;
+}
+
+/**
+ * @brief Make a slab and construct its objects
+ *
+ * Must be called with the pool lock held.
+ */
+static struct pool_slab *pool_slab_new(pool_t *pool)
+{
+	struct pool_slab *slab;
+	void *object;
+	size_t i;
+
+	slab = gsh_malloc_aligned(pool->slab_size, pool->slab_size);
+	slab->free_objs = NULL;
+	slab->nfree = pool->slab_objects;
+
+	/* Thread the new slots onto the free list, lowest first */
+	for (i = pool->slab_objects; i > 0; i--) {
+		object = pool_slab_slot(pool, slab, i - 1);
+		if (pool->flags & POOL_ZERO)
+			memset(object, 0, pool->object_size);
+		if (pool->constructor)
+			pool->constructor(object);
+		*pool_link(pool, object) = slab->free_objs;
+		slab->free_objs = object;
+	}
+
+	glist_add_tail(&pool->partial_slabs, &slab->slab_list);
+	pool->nslabs++;
+	pool->nempty_slabs++;
+
+	return slab;
+}
+
+/**
+ * @brief Destroy the objects of a slab and give it back
+ *
+ * Must be called with the pool lock held, or the pool being destroyed.
+ */
+static void pool_slab_release(pool_t *pool, struct pool_slab *slab)
+{
+	size_t i;
+
+	glist_del(&slab->slab_list);
+	pool->nslabs--;
+
+	if (pool->destructor) {
+		for (i = 0; i < pool->slab_objects; i++)
+			pool->destructor(pool_slab_slot(pool, slab, i));
+	}
+
+	gsh_free(slab);
+}
+
+/**
+ * @brief Take one slot from the slabs, growing if needed
+ *
+ * Must be called with the pool lock held.
+ */
+static void *pool_slab_get(pool_t *pool)
+{
+	struct pool_slab *slab;
+	void *object;
+
+	slab = glist_first_entry(&pool->partial_slabs, struct pool_slab,
+				 slab_list);
+	if (unlikely(slab == NULL))
+		slab = pool_slab_new(pool);
+
+	if (slab->nfree == pool->slab_objects)
+		pool->nempty_slabs--;
+
+	object = slab->free_objs;
+	slab->free_objs = *pool_link(pool, object);
+	if (--slab->nfree == 0) {
+		glist_del(&slab->slab_list);
+		glist_add_tail(&pool->full_slabs, &slab->slab_list);
+	}
+
+	return object;
+}
+
+/**
+ * @brief Put one slot back on its slab
+ *
+ * A slab left with every slot free is released if enough others are.
+ *
+ * Must be called with the pool lock held.
+ */
+static inline void pool_slab_put(pool_t *pool, void *object)
+{
+	struct pool_slab *slab = pool_slab_of(pool, object);
+
+	*pool_link(pool, object) = slab->free_objs;
+	slab->free_objs = object;
+
+	if (slab->nfree++ == 0) {
+		glist_del(&slab->slab_list);
+		glist_add_tail(&pool->partial_slabs, &slab->slab_list);
+	}
+
+	if (slab->nfree == pool->slab_objects) {
+		if (pool->nempty_slabs >= POOL_EMPTY_SLABS_MAX)
+			pool_slab_release(pool, slab);
+		else
+			pool->nempty_slabs++;
+	}
+}
+
+/**
+ * @brief Refill a thread's loaded magazine
+ *
+ * Both of the thread's magazines are empty.  Swap an empty one for a
+ * full magazine from the depot or, failing that, fill the loaded one
+ * from the slabs.
+ */
+static void pool_depot_get_full(pool_t *pool, struct pool_cache *cache)
+{
+	struct pool_magazine *mag;
+
+	PTHREAD_MUTEX_lock(&pool->lock);
+
+	pool_fold_counters(pool, cache);
+	pool->exchanges++;
+
+	if (pool->nfull != 0) {
+		mag = glist_first_entry(&pool->full_mags, struct pool_magazine,
+					mag_list);
+		glist_del(&mag->mag_list);
+		pool->nfull--;
+		pool_depot_put(pool, cache->previous);
+		cache->previous = cache->loaded;
+		cache->loaded = mag;
+	} else {
+		mag = cache->loaded;
+		while (mag->rounds < POOL_MAGAZINE_SIZE / 2)
+			mag->objs[mag->rounds++] = pool_slab_get(pool);
+	}
+
+	PTHREAD_MUTEX_unlock(&pool->lock);
+}
+
+/**
+ * @brief Make room in a thread's loaded magazine
+ *
+ * Both of the thread's magazines are full.  Hand the spare one to the
+ * depot and load an empty magazine in its place.  Once the depot holds
+ * POOL_DEPOT_MAX full magazines, further ones are drained back to the
+ * slab free list instead.
+ */
+static void pool_depot_put_full(pool_t *pool, struct pool_cache *cache)
+{
+	struct pool_magazine *mag = cache->previous;
+
+	PTHREAD_MUTEX_lock(&pool->lock);
+
+	pool_fold_counters(pool, cache);
+	pool->exchanges++;
+
+	if (pool->nfull >= POOL_DEPOT_MAX) {
+		while (mag->rounds != 0)
+			pool_slab_put(pool, mag->objs[--mag->rounds]);
+	} else {
+		pool_depot_put(pool, mag);
+
+		if (pool->nempty != 0) {
+			mag = glist_first_entry(&pool->empty_mags,
+						struct pool_magazine,
+						mag_list);
+			glist_del(&mag->mag_list);
+			pool->nempty--;
+		} else {
+			mag = pool_magazine_new();
+		}
+	}
+
+	cache->previous = cache->loaded;
+	cache->loaded = mag;
+
+	PTHREAD_MUTEX_unlock(&pool->lock);
+}
+
+pool_t *pool_init__(const char *name, size_t object_size, uint32_t flags,
+		    pool_constructor_t constructor,
+		    pool_destructor_t destructor,
+		    const char *file, int line, const char *function)
+{
+	pool_t *pool = gsh_calloc__(1, sizeof(pool_t), file, line, function);
+	uint32_t i;
+
+	pool->object_size = object_size;
+	if (name)
+		pool->name = gsh_strdup__(name, file, line, function);
+
+	/* A free slot holds the free list link, past the object if it
+	 * must stay constructed.
+	 */
+	pool->link_offset = constructor == NULL ? 0
+		: (object_size + sizeof(void *) - 1)
+		  & ~(sizeof(void *) - 1);
+	pool->slot_size = pool->link_offset + sizeof(void *);
+	if (pool->slot_size < object_size)
+		pool->slot_size = object_size;
+	pool->slot_size = (pool->slot_size + POOL_ALIGN - 1)
+			  & ~((size_t) POOL_ALIGN - 1);
+
+	pool->slab_hdr = (sizeof(struct pool_slab) + POOL_ALIGN - 1)
+			 & ~((size_t) POOL_ALIGN - 1);
+	pool->slab_size = POOL_SLAB_SIZE;
+	while ((pool->slab_size - pool->slab_hdr) / pool->slot_size <
+	       POOL_SLAB_MIN_OBJECTS)
+		pool->slab_size *= 2;
+	pool->slab_objects = (pool->slab_size - pool->slab_hdr) /
+			     pool->slot_size;
+
+	pool->flags = flags;
+	pool->constructor = constructor;
+	pool->destructor = destructor;
+	PTHREAD_MUTEX_init(&pool->lock, NULL);
+	glist_init(&pool->full_mags);
+	glist_init(&pool->empty_mags);
+	glist_init(&pool->partial_slabs);
+	glist_init(&pool->full_slabs);
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+
+	pool->gen = pool_next_gen++;
+	pool->index = POOL_NO_INDEX;
+	for (i = 0; i < POOL_MAX_CACHED; i++) {
+		if (pool_registry[i] == NULL) {
+			pool_registry[i] = pool;
+			pool->index = i;
+			break;
+		}
+	}
+	glist_add_tail(&pool_list, &pool->pools);
+
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	if (pool->index == POOL_NO_INDEX) {
+		LogInfo(COMPONENT_INIT,
+			"Pool %s has no per-thread cache, more than %d pools",
+			pool->name ? pool->name : "(anonymous)",
+			POOL_MAX_CACHED);
+	}
+
+	return pool;
+}
+
+void pool_destroy(pool_t *pool)
+{
+	struct glist_head *glist, *glistn;
+	struct pool_cache *cache;
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+
+	if (pool->index != POOL_NO_INDEX)
+		pool_registry[pool->index] = NULL;
+	glist_del(&pool->pools);
+
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	/* Other threads notice the generation change on their own */
+	if (pool->index != POOL_NO_INDEX && pool_thread_cache != NULL) {
+		cache = &pool_thread_cache[pool->index];
+		if (cache->gen == pool->gen)
+			pool_cache_free(cache);
+	}
+
+	glist_for_each_safe(glist, glistn, &pool->full_mags) {
+		glist_del(glist);
+		gsh_free(glist_entry(glist, struct pool_magazine, mag_list));
+	}
+
+	glist_for_each_safe(glist, glistn, &pool->empty_mags) {
+		glist_del(glist);
+		gsh_free(glist_entry(glist, struct pool_magazine, mag_list));
+	}
+
+	glist_for_each_safe(glist, glistn, &pool->partial_slabs) {
+		pool_slab_release(pool, glist_entry(glist, struct pool_slab,
+						    slab_list));
+	}
+
+	glist_for_each_safe(glist, glistn, &pool->full_slabs) {
+		pool_slab_release(pool, glist_entry(glist, struct pool_slab,
+						    slab_list));
+	}
+
+	PTHREAD_MUTEX_destroy(&pool->lock);
+	gsh_free(pool->name);
+	gsh_free(pool);
+}
+
+void *pool_alloc__(pool_t *pool, const char *file, int line,
+		   const char *function)
+{
+	struct pool_cache *cache = pool_cache_get(pool);
+	struct pool_magazine *mag;
+	void *object;
+
+	if (likely(cache != NULL)) {
+		mag = cache->loaded;
+
+		if (unlikely(mag->rounds == 0)) {
+			if (cache->previous->rounds != 0) {
+				cache->loaded = cache->previous;
+				cache->previous = mag;
+			} else {
+				pool_depot_get_full(pool, cache);
+			}
+			mag = cache->loaded;
+		}
+
+		object = mag->objs[--mag->rounds];
+		cache->allocs++;
+	} else {
+		PTHREAD_MUTEX_lock(&pool->lock);
+		object = pool_slab_get(pool);
+		pool->allocs++;
+		PTHREAD_MUTEX_unlock(&pool->lock);
+	}
+
+	/* Constructed objects keep their state while cached */
+	if ((pool->flags & POOL_ZERO) && pool->constructor == NULL)
+		memset(object, 0, pool->object_size);
+
+	return object;
+}
+
+void pool_free(pool_t *pool, void *object)
+{
+	struct pool_cache *cache;
+	struct pool_magazine *mag;
+
+	if (object == NULL)
+		return;
+
+	cache = pool_cache_get(pool);
+
+	if (likely(cache != NULL)) {
+		mag = cache->loaded;
+
+		if (unlikely(mag->rounds == POOL_MAGAZINE_SIZE)) {
+			if (cache->previous->rounds == 0) {
+				cache->loaded = cache->previous;
+				cache->previous = mag;
+			} else {
+				pool_depot_put_full(pool, cache);
+			}
+			mag = cache->loaded;
+		}
+
+		mag->objs[mag->rounds++] = object;
+		cache->frees++;
+	} else {
+		PTHREAD_MUTEX_lock(&pool->lock);
+		pool_slab_put(pool, object);
+		pool->frees++;
+		PTHREAD_MUTEX_unlock(&pool->lock);
+	}
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report pool statistics
+ *
+ * Counters held by threads that have not traded with the depot since
+ * their last operations are not included, so allocs, frees and in_use
+ * lag by at most a couple of magazines per thread.
+ *
+ * @param[in,out] iter Reply iterator
+ */
+void pool_dbus_show(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct glist_head *glist;
+	pool_t *pool;
+	char *name;
+	uint64_t object_size, allocs, frees, in_use, slab_bytes, exchanges;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(stttttt)", &array_iter);
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+
+	glist_for_each(glist, &pool_list) {
+		pool = glist_entry(glist, pool_t, pools);
+
+		PTHREAD_MUTEX_lock(&pool->lock);
+		object_size = pool->object_size;
+		allocs = pool->allocs;
+		frees = pool->frees;
+		slab_bytes = pool->nslabs * pool->slab_size;
+		exchanges = pool->exchanges;
+		PTHREAD_MUTEX_unlock(&pool->lock);
+
+		in_use = allocs > frees ? allocs - frees : 0;
+		name = pool->name ? pool->name : "(anonymous)";
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &object_size);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &allocs);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &frees);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &in_use);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &slab_bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &exchanges);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif /* USE_DBUS */
@@ -66,6 +66,7 @@
 #include "gsh_intrinsic.h"
 #include "server_stats.h"
 #include "sal_functions.h"
+#include "rate_limit.h"
 
 /* Clients are stored in an AVL tree
  */
@@ -334,6 +335,8 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 		server_stats_free(&server_st->st);
 		if (cl->hostaddr_str != NULL)
 			gsh_free(cl->hostaddr_str);
+		gsh_free(cl->qos_flows);
+		rate_limit_client_free(cl);
 		gsh_free(server_st);
 	}
 	return removed;
@@ -494,6 +497,81 @@ static struct gsh_dbus_method cltmgr_remove_client = {
 		 END_ARG_LIST}
 };
 
+/* parse the next uint32 in args, no larger than max
+ */
+
+static bool arg_next_uint32(DBusMessageIter *args, uint32_t max,
+			    uint32_t *val, char **errormsg)
+{
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		*errormsg = "arg not a uint32";
+		return false;
+	}
+	dbus_message_iter_get_basic(args, val);
+	if (*val > max) {
+		*errormsg = "arg out of range";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Set a client's fair queuing weight and request cap via DBUS
+ *
+ * The client is added if it is not known yet.  A weight or cap of 0
+ * reverts to Dispatch_Client_Weight or Dispatch_Client_Max_Reqs.
+ *
+ * @param args [IN] dbus argument stream from the message
+ * @param reply [OUT] dbus reply stream for method to fill
+ */
+
+static bool gsh_client_setqos(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	struct gsh_client *client;
+	sockaddr_t sockaddr;
+	uint32_t weight = 0, max_reqs = 0;
+	bool success;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	success = arg_ipaddr(args, &sockaddr, &errormsg) &&
+		  arg_next_uint32(args, 1024, &weight, &errormsg) &&
+		  arg_next_uint32(args, 10000, &max_reqs, &errormsg);
+	if (success) {
+		client = get_gsh_client(&sockaddr, false);
+		if (client != NULL) {
+			atomic_store_uint32_t(&client->qos_weight, weight);
+			atomic_store_uint32_t(&client->qos_max_reqs, max_reqs);
+			put_gsh_client(client);
+		} else {
+			success = false;
+			errormsg = "No memory to insert client";
+		}
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_set_qos = {
+	.name = "SetClientQoS",
+	.method = gsh_client_setqos,
+	.args = {IPADDR_ARG,
+		 {
+		  .name = "weight",
+		  .type = "u",
+		  .direction = "in"},
+		 {
+		  .name = "max_reqs",
+		  .type = "u",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 struct showclients_state {
 	DBusMessageIter client_iter;
 };
@@ -580,6 +658,7 @@ static struct gsh_dbus_method *cltmgr_client_methods[] = {
 	&cltmgr_add_client,
 	&cltmgr_remove_client,
 	&cltmgr_show_clients,
+	&cltmgr_set_qos,
 	NULL
 };
 
@@ -943,6 +1022,53 @@ static struct gsh_dbus_method cltmgr_show_9p_trans = {
 		 END_ARG_LIST}
 };
 
+/**
+ * DBUS method to report 9p fid statistics
+ *
+ */
+
+static bool get_9p_stats_fids(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+		if (errormsg == NULL)
+			errormsg = "Client IP address not found";
+	} else {
+		server_st = container_of(client, struct server_stats, client);
+		if (server_st->st._9p == NULL) {
+			success = false;
+			errormsg = "Client does not have any 9p activity";
+		}
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_9p_fidstats(server_st->st._9p, &iter);
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_9p_fids = {
+	.name = "Get9pFids",
+	.method = get_9p_stats_fids,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 FID_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
 /**
  * DBUS method to report 9p protocol operation statistics
  *
@@ -994,6 +1120,48 @@ static struct gsh_dbus_method cltmgr_show_9p_op_stats = {
 };
 #endif
 
+/**
+ * DBUS method to report read/write latency and size histograms
+ *
+ */
+
+static bool get_client_io_hist(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = NULL;
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+		if (errormsg == NULL)
+			errormsg = "Client IP address not found";
+	} else {
+		server_st = container_of(client, struct server_stats, client);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_io_hists(&server_st->st, &iter);
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_io_hist = {
+	.name = "GetIOHist",
+	.method = get_client_io_hist,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IO_HIST_REPLY,
+		 END_ARG_LIST}
+};
 
 static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_v3_io,
@@ -1001,9 +1169,11 @@ static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_v41_io,
 	&cltmgr_show_v41_layouts,
 	&cltmgr_show_delegations,
+	&cltmgr_show_io_hist,
 #ifdef _USE_9P
 	&cltmgr_show_9p_io,
 	&cltmgr_show_9p_trans,
+	&cltmgr_show_9p_fids,
 	&cltmgr_show_9p_op_stats,
 #endif
 	NULL
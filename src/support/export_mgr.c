@@ -231,6 +231,7 @@ struct gsh_export *alloc_export(void)
 	glist_init(&export->clients);
 
 	PTHREAD_RWLOCK_init(&export->lock, NULL);
+	rate_limiter_init(&export->rate_limiter);
 
 	return export;
 }
@@ -252,6 +253,7 @@ void free_export(struct gsh_export *export)
 	free_export_resources(export);
 	export_st = container_of(export, struct export_stats, export);
 	server_stats_free(&export_st->st);
+	rate_limiter_destroy(&export->rate_limiter);
 	gsh_free(export_st);
 	PTHREAD_RWLOCK_destroy(&export->lock);
 }
@@ -1725,6 +1727,34 @@ static bool show_cache_inode_stats(DBusMessageIter *args,
 	return true;
 }
 
+/**
+ * @brief Report object pool statistics
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of (
+ *		pool name, object size, allocs, frees, objects in use,
+ *		slab bytes, depot magazine exchanges
+ *	)
+ */
+static bool show_mem_pools(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	pool_dbus_show(&iter);
+
+	return true;
+}
+
 static struct gsh_dbus_method export_show_v41_layouts = {
 	.name = "GetNFSv41Layouts",
 	.method = get_nfsv41_export_layouts,
@@ -1895,6 +1925,109 @@ static struct gsh_dbus_method cache_inode_show = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method mem_pools_show = {
+	.name = "ShowMemPools",
+	.method = show_mem_pools,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 {
+		  .name = "pools",
+		  .type = "a(stttttt)",
+		  .direction = "out"},
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the latency histograms of a protocol op
+ *
+ */
+
+static bool get_op_latency(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	struct op_hists *oh = NULL;
+	char *proto = NULL, *op = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		success = false;
+		errormsg = "protocol arg not a string";
+	} else {
+		dbus_message_iter_get_basic(args, &proto);
+		dbus_message_iter_next(args);
+		if (dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+			success = false;
+			errormsg = "op arg not a string";
+		} else {
+			dbus_message_iter_get_basic(args, &op);
+			oh = server_stats_op_hists(proto, op);
+			if (oh == NULL) {
+				success = false;
+				errormsg = "unknown protocol or op";
+			}
+		}
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_op_latency(oh, &iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_op_latency = {
+	.name = "GetOpLatency",
+	.method = get_op_latency,
+	.args = {PROTO_OP_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 OP_LATENCY_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report read/write latency and size histograms
+ *
+ */
+
+static bool get_export_io_hist(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	else
+		export_st = container_of(export, struct export_stats, export);
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_io_hists(&export_st->st, &iter);
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method export_show_io_hist = {
+	.name = "GetIOHist",
+	.method = get_export_io_hist,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IO_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
 /**
  * @brief Report all IO stats of all exports in one call
  *
@@ -1962,6 +2095,9 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 	&global_show_total_ops,
 	&global_show_fast_ops,
 	&cache_inode_show,
+	&mem_pools_show,
+	&global_show_op_latency,
+	&export_show_io_hist,
 	&export_show_all_io,
 	&reset_statistics,
 	NULL
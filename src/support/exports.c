@@ -52,6 +52,7 @@
 #include "pnfs_utils.h"
 #include "netgroup_cache.h"
 #include "mdcache.h"
+#include "city.h"
 
 /**
  * @brief Protect EXPORT_DEFAULTS structure for dynamic update.
@@ -87,6 +88,9 @@ struct global_export_perms export_opt_cfg = {
 };
 
 static void FreeClientList(struct glist_head *clients);
+static struct export_client_index *build_client_index(
+					struct glist_head *clients);
+static void free_client_index(struct export_client_index *idx);
 
 static int StrExportOptions(struct display_buffer *dspbuf,
 			    struct export_perms *p_perms)
@@ -417,6 +421,7 @@ static void display_clients(struct gsh_export *export)
  * @param client_tok [IN] the name string.  We modify it.
  * @param type_hint  [IN] type hint from parser for client_tok
  * @param perms      [IN] pointer to the permissions to copy into each
+ * @param limits     [IN] pointer to the rate limits to copy into each
  * @param cnode      [IN] opaque pointer needed for config_proc_error()
  * @param err_type   [OUT] error handling ref
  *
@@ -427,6 +432,7 @@ static int add_client(struct glist_head *client_list,
 		      const char *client_tok,
 		      enum term_type type_hint,
 		      struct export_perms *perms,
+		      struct rate_limits *limits,
 		      void *cnode,
 		      struct config_error_type *err_type)
 {
@@ -470,6 +476,7 @@ static int add_client(struct glist_head *client_list,
 		cli->client.network.netaddr = ntohl(addr);
 		memcpy(&addr, &cidr->mask[12], 4);
 		cli->client.network.netmask = ntohl(addr);
+		cli->client.network.pflen = cidr_get_pflen(cidr);
 		cidr_free(cidr);
 		cli->type = NETWORK_CLIENT;
 		break;
@@ -577,6 +584,7 @@ static int add_client(struct glist_head *client_list,
 				} else
 					continue;
 				cli->client_perms = *perms;
+				cli->rate_limits = *limits;
 				LogClientListEntry(NIV_MID_DEBUG,
 						   COMPONENT_CONFIG,
 						   __LINE__,
@@ -606,6 +614,7 @@ static int add_client(struct glist_head *client_list,
 		goto out;
 	}
 	cli->client_perms = *perms;
+	cli->rate_limits = *limits;
 	LogClientListEntry(NIV_MID_DEBUG,
 			   COMPONENT_CONFIG,
 			   __LINE__,
@@ -984,6 +993,14 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 	atomic_store_int32_t(&export->expire_time_attr, src->expire_time_attr);
+	atomic_store_uint64_t(&export->rate_limits.read_bytes,
+			      src->rate_limits.read_bytes);
+	atomic_store_uint64_t(&export->rate_limits.write_bytes,
+			      src->rate_limits.write_bytes);
+	atomic_store_uint64_t(&export->rate_limits.read_ops,
+			      src->rate_limits.read_ops);
+	atomic_store_uint64_t(&export->rate_limits.write_ops,
+			      src->rate_limits.write_ops);
 }
 
 /**
@@ -1004,6 +1021,7 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 				enum export_commit_type commit_type)
 {
 	struct gsh_export *export = self_struct, *probe_exp;
+	struct export_client_index *client_index;
 	int errcnt = 0;
 	char perms[1024] = "\0";
 	struct display_buffer dspbuf = {sizeof(perms), perms, perms};
@@ -1075,6 +1093,12 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	 * have fsal_export attached.
 	 */
 
+	/* Compile the client list for export_check_access. On update the
+	 * index moves to the existing export along with the list.
+	 */
+	free_client_index(export->client_index);
+	export->client_index = build_client_index(&export->clients);
+
 	probe_exp = get_gsh_export(export->export_id);
 
 	if (commit_type == update_export && probe_exp != NULL) {
@@ -1170,6 +1194,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			     export->clients.next, export->clients.prev);
 
 		glist_swap_lists(&probe_exp->clients, &export->clients);
+		client_index = probe_exp->client_index;
+		probe_exp->client_index = export->client_index;
+		export->client_index = client_index;
 
 		PTHREAD_RWLOCK_unlock(&probe_exp->lock);
 
@@ -1606,6 +1633,19 @@ struct config_item_list deleg_types[] =  {
 		EXPORT_OPTION_NO_DELEGATIONS, EXPORT_OPTION_DELEGATIONS,\
 		delegations, _struct_, _perms_.options, _perms_.set)
 
+/**
+ * @brief READ and WRITE rate limits, for EXPORT and CLIENT blocks
+ */
+#define CONF_RATE_LIMITS(_struct_, _limits_)				\
+	CONF_ITEM_UI64("Max_Read_Bandwidth", 0, UINT64_MAX, 0,		\
+		       _struct_, _limits_.read_bytes),			\
+	CONF_ITEM_UI64("Max_Write_Bandwidth", 0, UINT64_MAX, 0,		\
+		       _struct_, _limits_.write_bytes),			\
+	CONF_ITEM_UI64("Max_Read_IOPS", 0, UINT64_MAX, 0,		\
+		       _struct_, _limits_.read_ops),			\
+	CONF_ITEM_UI64("Max_Write_IOPS", 0, UINT64_MAX, 0,		\
+		       _struct_, _limits_.write_ops)
+
 /**
  * @brief Process a list of clients for a client block
  *
@@ -1642,7 +1682,8 @@ static int client_adder(const char *token,
 	LogMidDebug(COMPONENT_CONFIG, "Adding client %s", token);
 	rc = add_client(&proto_cli->cle_list,
 			token, type_hint,
-			&proto_cli->client_perms, cnode, err_type);
+			&proto_cli->client_perms, &proto_cli->rate_limits,
+			cnode, err_type);
 	return rc;
 }
 
@@ -1656,6 +1697,7 @@ static int client_adder(const char *token,
 
 static struct config_item client_params[] = {
 	CONF_EXPORT_PERMS(exportlist_client_entry__, client_perms),
+	CONF_RATE_LIMITS(exportlist_client_entry__, rate_limits),
 	CONF_ITEM_PROC("Clients", noop_conf_init, client_adder,
 		       exportlist_client_entry__, cle_list),
 	CONFIG_EOL
@@ -1741,6 +1783,7 @@ static struct config_item fsal_params[] = {
 static struct config_item export_params[] = {
 	CONF_EXPORT_PARAMS(gsh_export),
 	CONF_EXPORT_PERMS(gsh_export, export_perms),
+	CONF_RATE_LIMITS(gsh_export, rate_limits),
 
 	/* NOTE: the Client and FSAL sub-blocks must be the *last*
 	 * two entries in the list.  This is so all other
@@ -1763,6 +1806,7 @@ static struct config_item export_params[] = {
 static struct config_item export_update_params[] = {
 	CONF_EXPORT_PARAMS(gsh_export),
 	CONF_EXPORT_PERMS(gsh_export, export_perms),
+	CONF_RATE_LIMITS(gsh_export, rate_limits),
 
 	/* NOTE: the Client and FSAL sub-blocks must be the *last*
 	 * two entries in the list.  This is so all other
@@ -2096,6 +2140,8 @@ static void FreeClientList(struct glist_head *clients)
 
 void free_export_resources(struct gsh_export *export)
 {
+	free_client_index(export->client_index);
+	export->client_index = NULL;
 	FreeClientList(&export->clients);
 	if (export->fsal_export != NULL) {
 		struct fsal_module *fsal = export->fsal_export->fsal;
@@ -2391,25 +2437,149 @@ void unexport(struct gsh_export *export)
 		release_root_op_context();
 }
 
+/**
+ * @brief Per lookup state for matching one host against client entries
+ *
+ * The printable address and host name are only produced when an entry
+ * that needs them is tried, and then only once per lookup.
+ */
+struct client_match_ctx {
+	sockaddr_t *hostaddr;
+	in_addr_t addr;
+	int ipvalid;	/* -1 need to print, 0 - invalid, 1 - ok */
+	int namevalid;	/* -1 need to look up, 0 - invalid, 1 - ok */
+	char hostname[MAXHOSTNAMELEN + 1];
+	char ipstring[SOCK_NAME_MAX + 1];
+};
+
+static void client_match_ctx_init(struct client_match_ctx *ctx,
+				  sockaddr_t *hostaddr)
+{
+	ctx->hostaddr = hostaddr;
+	ctx->addr = get_in_addr(hostaddr);
+	ctx->ipvalid = -1;
+	ctx->namevalid = -1;
+}
+
+/**
+ * @brief Get the host name of the client from the IP/name cache
+ *
+ * @param[in,out] ctx  Lookup state
+ *
+ * @return true if a name was found.
+ */
+static bool client_match_hostname(struct client_match_ctx *ctx)
+{
+	int rc;
+
+	if (ctx->namevalid >= 0)
+		return ctx->namevalid;
+
+	/* Try to get the entry from th IP/name cache */
+	rc = nfs_ip_name_get(ctx->hostaddr, ctx->hostname,
+			     sizeof(ctx->hostname));
+
+	if (rc == IP_NAME_NOT_FOUND) {
+		/* IPaddr was not cached, add it to the cache */
+
+		/** @todo this change from 1.5 is not IPv6
+		 * useful.  come back to this and use the
+		 * string from client mgr inside req_ctx...
+		 */
+		rc = nfs_ip_name_add(ctx->hostaddr,
+				     ctx->hostname,
+				     sizeof(ctx->hostname));
+	}
+
+	ctx->namevalid = rc == IP_NAME_SUCCESS;
+	return ctx->namevalid;
+}
+
+/**
+ * @brief Check whether a single client entry matches an IPv4 host
+ *
+ * @param[in]     client  Client entry
+ * @param[in,out] ctx     Lookup state
+ *
+ * @return true if the entry matches.
+ */
+static bool client_entry_match(exportlist_client_entry_t *client,
+			       struct client_match_ctx *ctx)
+{
+	switch (client->type) {
+	case HOSTIF_CLIENT:
+		return client->client.hostif.clientaddr == ctx->addr;
+
+	case NETWORK_CLIENT:
+		return (client->client.network.netmask & ntohl(ctx->addr)) ==
+			client->client.network.netaddr;
+
+	case NETGROUP_CLIENT:
+		if (!client_match_hostname(ctx))
+			return false; /* Fatal failure */
+
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		return ng_innetgr(client->client.netgroup.netgroupname,
+				  ctx->hostname);
+
+	case WILDCARDHOST_CLIENT:
+		/* Now checking for IP wildcards */
+		if (ctx->ipvalid < 0)
+			ctx->ipvalid = sprint_sockip(ctx->hostaddr,
+						     ctx->ipstring,
+						     sizeof(ctx->ipstring));
+
+		if (ctx->ipvalid &&
+		    (fnmatch(client->client.wildcard.wildcard,
+			     ctx->ipstring,
+			     FNM_PATHNAME) == 0)) {
+			return true;
+		}
+
+		if (!client_match_hostname(ctx))
+			return false;
+
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		return fnmatch(client->client.wildcard.wildcard,
+			       ctx->hostname, FNM_PATHNAME) == 0;
+
+	case GSSPRINCIPAL_CLIENT:
+	  /** @todo BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
+		LogCrit(COMPONENT_EXPORT,
+			"Unsupported type GSS_PRINCIPAL_CLIENT");
+		return false;
+
+	case MATCH_ANY_CLIENT:
+		return true;
+
+	case HOSTIF_CLIENT_V6:
+	case BAD_CLIENT:
+	default:
+		return false;
+	}
+}
+
 /**
  * @brief Match a specific option in the client export list
  *
+ * This is the linear walk used when the export has no client index.
+ *
  * @param[in]  hostaddr      Host to search for
- * @param[in]  clients       Client list to search
- * @param[out] client_found Matching entry
- * @param[in]  export_option Option to search for
+ * @param[in]  export        Export whose client list to search
  *
- * @return true if found, false otherwise.
+ * @return the first matching entry or NULL.
  */
 static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 					       struct gsh_export *export)
 {
 	struct glist_head *glist;
-	in_addr_t addr = get_in_addr(hostaddr);
-	int rc;
-	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
-	char hostname[MAXHOSTNAMELEN + 1];
-	char ipstring[SOCK_NAME_MAX + 1];
+	struct client_match_ctx ctx;
+
+	client_match_ctx_init(&ctx, hostaddr);
 
 	glist_for_each(glist, &export->clients) {
 		exportlist_client_entry_t *client;
@@ -2423,101 +2593,8 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 				   "Match V4: ",
 				   client);
 
-		switch (client->type) {
-		case HOSTIF_CLIENT:
-			if (client->client.hostif.clientaddr == addr)
-				return client;
-			break;
-
-		case NETWORK_CLIENT:
-			if ((client->client.network.netmask & ntohl(addr)) ==
-			    client->client.network.netaddr)
-				return client;
-			break;
-
-		case NETGROUP_CLIENT:
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
-
-			if (rc != IP_NAME_SUCCESS)
-				break; /* Fatal failure */
-
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (ng_innetgr(client->client.netgroup.netgroupname,
-				    hostname)) {
-				return client;
-			}
-			break;
-
-		case WILDCARDHOST_CLIENT:
-			/* Now checking for IP wildcards */
-			if (ipvalid < 0)
-				ipvalid = sprint_sockip(hostaddr,
-							ipstring,
-							sizeof(ipstring));
-
-			if (ipvalid &&
-			    (fnmatch(client->client.wildcard.wildcard,
-				     ipstring,
-				     FNM_PATHNAME) == 0)) {
-				return client;
-			}
-
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-
-				/** @todo this change from 1.5 is not IPv6
-				 * useful.  come back to this and use the
-				 * string from client mgr inside req_ctx...
-				 */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
-
-			if (rc != IP_NAME_SUCCESS)
-					break;
-
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (fnmatch
-			    (client->client.wildcard.wildcard, hostname,
-			     FNM_PATHNAME) == 0) {
-				return client;
-			}
-			break;
-
-		case GSSPRINCIPAL_CLIENT:
-	  /** @todo BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
-			LogCrit(COMPONENT_EXPORT,
-				"Unsupported type GSS_PRINCIPAL_CLIENT");
-			break;
-
-		case HOSTIF_CLIENT_V6:
-			break;
-
-		case MATCH_ANY_CLIENT:
+		if (client_entry_match(client, &ctx))
 			return client;
-
-		case BAD_CLIENT:
-		default:
-			continue;
-		}
 	}
 
 	/* no export found for this option */
@@ -2528,12 +2605,12 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 /**
  * @brief Match a specific option in the client export list
  *
+ * This is the linear walk used when the export has no client index.
+ *
  * @param[in]  paddrv6       Host to search for
- * @param[in]  clients       Client list to search
- * @param[out] client_found Matching entry
- * @param[in]  export_option Option to search for
+ * @param[in]  export        Export whose client list to search
  *
- * @return true if found, false otherwise.
+ * @return the first matching entry or NULL.
  */
 static exportlist_client_entry_t *client_matchv6(struct in6_addr *paddrv6,
 						 struct gsh_export *export)
@@ -2583,9 +2660,417 @@ static exportlist_client_entry_t *client_matchv6(struct in6_addr *paddrv6,
 	return NULL;
 }
 
+/**
+ * @brief Compiled form of an export's client list
+ *
+ * Client entries match first-match-wins in list order, so everything in
+ * the index is keyed to the entry's position in the list:
+ *
+ * - IPv4 networks live in a binary trie on the prefix bits.  Each node
+ *   holds the earliest position of a network with exactly that prefix,
+ *   so the earliest matching network is the minimum along the path of
+ *   the address.
+ * - Exact IPv4 and IPv6 hosts live in an open addressed hash keyed on
+ *   the (v4 mapped) address.
+ * - Netgroups, wildcards and anything else that cannot be indexed stay in
+ *   an ordered array and are only tried when they precede the best
+ *   indexed match.
+ *
+ * The outcome of each lookup is kept in a direct mapped decision cache
+ * keyed on client address.  Decisions that needed a name lookup expire
+ * like the netgroup cache does.  The index is rebuilt, and so the cache
+ * dropped, whenever an update replaces the export's client list.
+ */
+
+#define CLIENT_POS_NONE UINT32_MAX
+#define CLIENT_CACHE_MIN 64
+#define CLIENT_CACHE_MAX 4096
+#define CLIENT_CACHE_NAME_EXPIRE (30 * 60)
+
+struct client_trie_node {
+	struct client_trie_node *child[2];
+	uint32_t pos;
+};
+
+struct client_host_slot {
+	struct in6_addr addr;
+	uint32_t pos;
+};
+
+struct client_cache_slot {
+	pthread_spinlock_t sp;
+	uint32_t pos;
+	bool valid;
+	time_t expire;		/*< 0 if no name lookup was needed */
+	struct in6_addr addr;
+};
+
+struct export_client_index {
+	exportlist_client_entry_t **entries;	/*< by list position */
+	uint32_t nentries;
+	uint32_t any_pos;	/*< first MATCH_ANY_CLIENT */
+	struct client_trie_node *v4_trie;
+	struct client_host_slot *hosts;
+	uint32_t host_mask;
+	uint32_t *fallback;	/*< positions of unindexed entries */
+	uint32_t nfallback;
+	struct client_cache_slot *cache;
+	uint32_t cache_mask;
+};
+
+static inline uint32_t client_pow2(uint32_t n)
+{
+	uint32_t size = 1;
+
+	while (size < n)
+		size <<= 1;
+	return size;
+}
+
+static inline uint32_t client_addr_hash(const struct in6_addr *addr)
+{
+	return (uint32_t) CityHash64((const char *) addr->s6_addr,
+				     sizeof(addr->s6_addr));
+}
+
+static void client_addr_v4mapped(in_addr_t addr, struct in6_addr *addr6)
+{
+	memset(addr6, 0, sizeof(*addr6));
+	addr6->s6_addr[10] = 0xFF;
+	addr6->s6_addr[11] = 0xFF;
+	memcpy(&addr6->s6_addr[12], &addr, sizeof(addr));
+}
+
+static void client_trie_insert(struct client_trie_node **root,
+			       uint32_t netaddr, int pflen, uint32_t pos)
+{
+	struct client_trie_node **nodep = root;
+	int bit;
+
+	for (bit = 31; ; bit--) {
+		if (*nodep == NULL) {
+			*nodep = gsh_calloc(1, sizeof(**nodep));
+			(*nodep)->pos = CLIENT_POS_NONE;
+		}
+
+		if (31 - bit == pflen)
+			break;
+
+		nodep = &(*nodep)->child[(netaddr >> bit) & 1];
+	}
+
+	if (pos < (*nodep)->pos)
+		(*nodep)->pos = pos;
+}
+
+static uint32_t client_trie_lookup(struct client_trie_node *node,
+				   uint32_t addr)
+{
+	uint32_t best = CLIENT_POS_NONE;
+	int bit;
+
+	for (bit = 31; node != NULL; bit--) {
+		if (node->pos < best)
+			best = node->pos;
+
+		if (bit < 0)
+			break;
+
+		node = node->child[(addr >> bit) & 1];
+	}
+
+	return best;
+}
+
+static void client_trie_free(struct client_trie_node *node)
+{
+	if (node == NULL)
+		return;
+
+	client_trie_free(node->child[0]);
+	client_trie_free(node->child[1]);
+	gsh_free(node);
+}
+
+static void client_host_insert(struct export_client_index *idx,
+			       const struct in6_addr *addr, uint32_t pos)
+{
+	uint32_t i = client_addr_hash(addr) & idx->host_mask;
+
+	while (idx->hosts[i].pos != CLIENT_POS_NONE) {
+		if (!memcmp(&idx->hosts[i].addr, addr, sizeof(*addr))) {
+			/* Duplicate host, the earlier entry wins */
+			return;
+		}
+		i = (i + 1) & idx->host_mask;
+	}
+
+	idx->hosts[i].addr = *addr;
+	idx->hosts[i].pos = pos;
+}
+
+static uint32_t client_host_lookup(struct export_client_index *idx,
+				   const struct in6_addr *addr)
+{
+	uint32_t i;
+
+	if (idx->hosts == NULL)
+		return CLIENT_POS_NONE;
+
+	i = client_addr_hash(addr) & idx->host_mask;
+
+	while (idx->hosts[i].pos != CLIENT_POS_NONE) {
+		if (!memcmp(&idx->hosts[i].addr, addr, sizeof(*addr)))
+			return idx->hosts[i].pos;
+		i = (i + 1) & idx->host_mask;
+	}
+
+	return CLIENT_POS_NONE;
+}
+
+/**
+ * @brief Free a client index
+ *
+ * @param[in] idx  Index to free, may be NULL
+ */
+static void free_client_index(struct export_client_index *idx)
+{
+	uint32_t i;
+
+	if (idx == NULL)
+		return;
+
+	if (idx->cache != NULL) {
+		for (i = 0; i <= idx->cache_mask; i++)
+			pthread_spin_destroy(&idx->cache[i].sp);
+	}
+
+	client_trie_free(idx->v4_trie);
+	gsh_free(idx->cache);
+	gsh_free(idx->fallback);
+	gsh_free(idx->hosts);
+	gsh_free(idx->entries);
+	gsh_free(idx);
+}
+
+/**
+ * @brief Compile a client list into an index
+ *
+ * The list must not change while the index is in use, the index refers
+ * to the entries rather than copying them.
+ *
+ * @param[in] clients  Client list
+ *
+ * @return the new index.
+ */
+static struct export_client_index *build_client_index(
+					struct glist_head *clients)
+{
+	struct export_client_index *idx;
+	struct glist_head *glist;
+	struct in6_addr addr6;
+	uint32_t nhosts = 0;
+	uint32_t pos = 0;
+	uint32_t i;
+
+	idx = gsh_calloc(1, sizeof(*idx));
+	idx->nentries = glist_length(clients);
+	idx->any_pos = CLIENT_POS_NONE;
+
+	if (idx->nentries != 0) {
+		idx->entries = gsh_calloc(idx->nentries,
+					  sizeof(*idx->entries));
+		idx->fallback = gsh_calloc(idx->nentries,
+					   sizeof(*idx->fallback));
+	}
+
+	glist_for_each(glist, clients) {
+		exportlist_client_entry_t *client;
+
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+		idx->entries[pos++] = client;
+		if (client->type == HOSTIF_CLIENT ||
+		    client->type == HOSTIF_CLIENT_V6)
+			nhosts++;
+	}
+
+	if (nhosts != 0) {
+		idx->host_mask = client_pow2(nhosts * 2) - 1;
+		idx->hosts = gsh_calloc(idx->host_mask + 1,
+					sizeof(*idx->hosts));
+		for (i = 0; i <= idx->host_mask; i++)
+			idx->hosts[i].pos = CLIENT_POS_NONE;
+	}
+
+	for (pos = 0; pos < idx->nentries; pos++) {
+		exportlist_client_entry_t *client = idx->entries[pos];
+
+		switch (client->type) {
+		case HOSTIF_CLIENT:
+			client_addr_v4mapped(client->client.hostif.clientaddr,
+					     &addr6);
+			client_host_insert(idx, &addr6, pos);
+			break;
+
+		case HOSTIF_CLIENT_V6:
+			client_host_insert(idx,
+					   &client->client.hostif.clientaddr6,
+					   pos);
+			break;
+
+		case NETWORK_CLIENT:
+			if (client->client.network.pflen < 0) {
+				/* Not a prefix, can't go in the trie */
+				idx->fallback[idx->nfallback++] = pos;
+				break;
+			}
+
+			/* A network with host bits set never matches */
+			if ((client->client.network.netaddr &
+			     ~client->client.network.netmask) != 0)
+				break;
+
+			client_trie_insert(&idx->v4_trie,
+					   client->client.network.netaddr,
+					   client->client.network.pflen,
+					   pos);
+			break;
+
+		case MATCH_ANY_CLIENT:
+			if (idx->any_pos == CLIENT_POS_NONE)
+				idx->any_pos = pos;
+			break;
+
+		case GSSPRINCIPAL_CLIENT:
+			LogCrit(COMPONENT_EXPORT,
+				"Unsupported type GSS_PRINCIPAL_CLIENT");
+			break;
+
+		case NETGROUP_CLIENT:
+		case WILDCARDHOST_CLIENT:
+			idx->fallback[idx->nfallback++] = pos;
+			break;
+
+		case BAD_CLIENT:
+		default:
+			break;
+		}
+	}
+
+	i = client_pow2(idx->nentries * 2);
+	if (i < CLIENT_CACHE_MIN)
+		i = CLIENT_CACHE_MIN;
+	if (i > CLIENT_CACHE_MAX)
+		i = CLIENT_CACHE_MAX;
+	idx->cache_mask = i - 1;
+	idx->cache = gsh_calloc(i, sizeof(*idx->cache));
+	for (i = 0; i <= idx->cache_mask; i++)
+		pthread_spin_init(&idx->cache[i].sp, PTHREAD_PROCESS_PRIVATE);
+
+	LogDebug(COMPONENT_EXPORT,
+		 "Client index %p: %"PRIu32" entries, %"PRIu32
+		 " hosts, %"PRIu32" unindexed",
+		 idx, idx->nentries, nhosts, idx->nfallback);
+
+	return idx;
+}
+
+/**
+ * @brief Match a host against an export's client index
+ *
+ * @param[in] idx       Client index
+ * @param[in] hostaddr  Host to search for, IPv4 mapped addresses must
+ *                      already have been converted
+ *
+ * @return the first matching entry in list order or NULL.
+ */
+static exportlist_client_entry_t *client_index_match(
+					struct export_client_index *idx,
+					sockaddr_t *hostaddr)
+{
+	struct client_cache_slot *slot;
+	struct client_match_ctx ctx;
+	struct in6_addr key;
+	uint32_t best, pos, i;
+	time_t expire = 0;
+	bool is_v4 = hostaddr->ss_family != AF_INET6;
+
+	if (is_v4) {
+		client_match_ctx_init(&ctx, hostaddr);
+		client_addr_v4mapped(ctx.addr, &key);
+	} else {
+		key = ((struct sockaddr_in6 *)hostaddr)->sin6_addr;
+	}
+
+	slot = &idx->cache[client_addr_hash(&key) & idx->cache_mask];
+
+	pthread_spin_lock(&slot->sp);
+	if (slot->valid &&
+	    !memcmp(&slot->addr, &key, sizeof(key)) &&
+	    (slot->expire == 0 || slot->expire > time(NULL))) {
+		best = slot->pos;
+		pthread_spin_unlock(&slot->sp);
+		goto out;
+	}
+	pthread_spin_unlock(&slot->sp);
+
+	best = idx->any_pos;
+
+	pos = client_host_lookup(idx, &key);
+	if (pos < best)
+		best = pos;
+
+	if (is_v4) {
+		pos = client_trie_lookup(idx->v4_trie, ntohl(ctx.addr));
+		if (pos < best)
+			best = pos;
+
+		/* Only unindexed entries listed ahead of the best indexed
+		 * match can change the outcome.
+		 */
+		for (i = 0; i < idx->nfallback && idx->fallback[i] < best;
+		     i++) {
+			exportlist_client_entry_t *client;
+
+			client = idx->entries[idx->fallback[i]];
+			if (client->type != NETWORK_CLIENT)
+				expire = time(NULL) + CLIENT_CACHE_NAME_EXPIRE;
+
+			if (client_entry_match(client, &ctx)) {
+				best = idx->fallback[i];
+				break;
+			}
+		}
+	}
+
+	pthread_spin_lock(&slot->sp);
+	slot->addr = key;
+	slot->pos = best;
+	slot->expire = expire;
+	slot->valid = true;
+	pthread_spin_unlock(&slot->sp);
+
+ out:
+	if (best == CLIENT_POS_NONE)
+		return NULL;
+
+	LogClientListEntry(NIV_MID_DEBUG,
+			   COMPONENT_EXPORT,
+			   __LINE__,
+			   (char *) __func__,
+			   is_v4 ? "Match V4: " : "Match V6: ",
+			   idx->entries[best]);
+
+	return idx->entries[best];
+}
+
 static exportlist_client_entry_t *client_match_any(sockaddr_t *hostaddr,
 						   struct gsh_export *export)
 {
+	if (export->client_index != NULL)
+		return client_index_match(export->client_index, hostaddr);
+
 	if (hostaddr->ss_family == AF_INET6) {
 		struct sockaddr_in6 *psockaddr_in6 =
 		    (struct sockaddr_in6 *)hostaddr;
@@ -2832,6 +3317,8 @@ void export_check_access(void)
 	 * anonymous_gid will get set farther down.
 	 */
 	memset(op_ctx->export_perms, 0, sizeof(*op_ctx->export_perms));
+	memset(&op_ctx->client_rate_limits, 0,
+	       sizeof(op_ctx->client_rate_limits));
 
 	if (op_ctx->ctx_export != NULL) {
 		/* Take lock */
@@ -2871,6 +3358,7 @@ void export_check_access(void)
 					client->client_perms.anonymous_gid;
 
 		op_ctx->export_perms->set = client->client_perms.set;
+		op_ctx->client_rate_limits = client->rate_limits;
 	}
 
 	/* Any options not set by the client, take from the export */
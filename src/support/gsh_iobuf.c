@@ -0,0 +1,300 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_iobuf.c
+ * @brief Pooled, reference counted I/O buffers
+ *
+ * Each buffer is preceded by a page holding its header, so the data
+ * stays page aligned and the header can be found from the data
+ * pointer the FSAL and the XDR structures carry.  Idle buffers are
+ * kept on a free list per size, which is what makes the buffers cheap
+ * to get: a 1MB READ no longer goes through the general allocator
+ * (and usually mmap and munmap) every time.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "log.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "gsh_iobuf.h"
+#include "nfs_core.h"
+
+#define IOBUF_MAGIC 0x696f6275
+
+#define IOBUF_MIN_SHIFT 12
+#define IOBUF_MAX_SHIFT 26	/* XDR_BYTES_MAXLEN_IO */
+#define IOBUF_CLASSES (IOBUF_MAX_SHIFT - IOBUF_MIN_SHIFT + 1)
+
+struct gsh_iobuf {
+	struct gsh_iobuf *next;		/*< Free list */
+	uint32_t magic;			/*< IOBUF_MAGIC */
+	uint32_t class;			/*< Size class */
+	int32_t refcnt;			/*< References to the buffer */
+};
+
+struct iobuf_class {
+	pthread_mutex_t lock;		/*< Protects the free list */
+	struct gsh_iobuf *free;		/*< Idle buffers */
+	uint32_t nfree;			/*< Buffers on the free list */
+};
+
+static struct iobuf_class iobuf_classes[IOBUF_CLASSES] = {
+	[0 ... IOBUF_CLASSES - 1] = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	},
+};
+
+/** Whether the reply being encoded by this thread may refer to
+    buffers rather than copy them */
+static __thread bool iobuf_zero_copy_allowed;
+
+static inline struct gsh_iobuf *iobuf_hdr(void *data)
+{
+	struct gsh_iobuf *buf = (struct gsh_iobuf *)
+					((char *) data - sizeof(*buf));
+
+	if (unlikely(buf->magic != IOBUF_MAGIC))
+		LogFatal(COMPONENT_MEM_ALLOC,
+			 "%p is not an I/O buffer", data);
+
+	return buf;
+}
+
+static inline size_t iobuf_class_size(uint32_t class)
+{
+	return (size_t) 1 << (class + IOBUF_MIN_SHIFT);
+}
+
+/* Round up to the XDR unit */
+static inline size_t iobuf_rndup(size_t size)
+{
+	return (size + BYTES_PER_XDR_UNIT - 1) & ~(BYTES_PER_XDR_UNIT - 1);
+}
+
+/**
+ * @brief Get a buffer
+ *
+ * The buffer has room for @c size bytes rounded up to the XDR unit,
+ * and one reference.  This function aborts if no memory is available.
+ *
+ * @param[in] size Bytes needed
+ *
+ * @return The buffer data.
+ */
+void *gsh_iobuf_alloc(size_t size)
+{
+	struct iobuf_class *ic;
+	struct gsh_iobuf *buf;
+	uint32_t class = 0;
+	char *base;
+
+	size = iobuf_rndup(size);
+
+	if (size > IOBUF_MIN_SIZE)
+		class = 64 - __builtin_clzll(size - 1) - IOBUF_MIN_SHIFT;
+
+	if (unlikely(class >= IOBUF_CLASSES))
+		LogFatal(COMPONENT_MEM_ALLOC,
+			 "I/O buffer of %zu bytes requested", size);
+
+	ic = &iobuf_classes[class];
+
+	PTHREAD_MUTEX_lock(&ic->lock);
+
+	buf = ic->free;
+	if (buf != NULL) {
+		ic->free = buf->next;
+		ic->nfree--;
+	}
+
+	PTHREAD_MUTEX_unlock(&ic->lock);
+
+	if (buf == NULL) {
+		base = gsh_malloc_aligned(IOBUF_ALIGN,
+					  IOBUF_ALIGN + iobuf_class_size(class));
+		buf = (struct gsh_iobuf *) (base + IOBUF_ALIGN - sizeof(*buf));
+		buf->magic = IOBUF_MAGIC;
+		buf->class = class;
+	}
+
+	buf->next = NULL;
+	buf->refcnt = 1;
+
+	return buf + 1;
+}
+
+/**
+ * @brief Take another reference on a buffer
+ *
+ * @param[in] data The buffer data
+ */
+void gsh_iobuf_ref(void *data)
+{
+	(void) atomic_inc_int32_t(&iobuf_hdr(data)->refcnt);
+}
+
+/**
+ * @brief Release a reference on a buffer
+ *
+ * The last reference returns the buffer to its pool, or frees it if
+ * the pool already holds Read_Buffer_Cache_Size bytes of that size.
+ *
+ * @param[in] data The buffer data
+ */
+void gsh_iobuf_put(void *data)
+{
+	struct gsh_iobuf *buf = iobuf_hdr(data);
+	struct iobuf_class *ic;
+	size_t size;
+
+	if (atomic_dec_int32_t(&buf->refcnt) != 0)
+		return;
+
+	ic = &iobuf_classes[buf->class];
+	size = iobuf_class_size(buf->class);
+
+	PTHREAD_MUTEX_lock(&ic->lock);
+
+	if ((uint64_t) (ic->nfree + 1) * size <=
+	    nfs_param.core_param.read_buffer_cache_size) {
+		buf->next = ic->free;
+		ic->free = buf;
+		ic->nfree++;
+		buf = NULL;
+	}
+
+	PTHREAD_MUTEX_unlock(&ic->lock);
+
+	if (buf != NULL)
+		gsh_free((char *) (buf + 1) - IOBUF_ALIGN);
+}
+
+/**
+ * @brief Usable size of a buffer
+ *
+ * @param[in] data The buffer data
+ *
+ * @return Bytes available at @c data.
+ */
+size_t gsh_iobuf_size(void *data)
+{
+	return iobuf_class_size(iobuf_hdr(data)->class);
+}
+
+/**
+ * @brief Allow or forbid sending buffers without copying them
+ *
+ * Set around the encoding of a reply on a transport that sends the
+ * iovecs it is given and releases them once sent, when the reply is
+ * not wrapped by RPCSEC_GSS.  Anything else encoding a reply (the DRC,
+ * xdr_sizeof) gets a copy.
+ *
+ * @param[in] allowed Whether the reply may refer to buffers
+ */
+void gsh_iobuf_zero_copy(bool allowed)
+{
+	iobuf_zero_copy_allowed = allowed;
+}
+
+/**
+ * @brief Whether data may be appended to a stream as its own iovec
+ *
+ * @param[in] xdrs XDR stream
+ *
+ * @return true if the stream is encoding a reply that may refer to
+ *         buffers, and can take them.
+ */
+bool gsh_iobuf_zero_copy_ok(XDR *xdrs)
+{
+	return xdrs->x_op == XDR_ENCODE && iobuf_zero_copy_allowed &&
+	       xdrs->x_ops->x_putbufs != NULL;
+}
+
+static void iobuf_uio_release(struct xdr_uio *uio, u_int flags)
+{
+	if (--uio->uio_references != 0)
+		return;
+
+	gsh_iobuf_put(uio->uio_vio[0].vio_base);
+	gsh_free(uio);
+}
+
+/**
+ * @brief XDR counted opaque data held in an I/O buffer
+ *
+ * Encoded like xdr_bytes.  When the thread may send buffers without
+ * copying, the length is encoded inline and the data (with its
+ * padding) is appended to the reply as a separate iovec that holds a
+ * reference on the buffer.
+ *
+ * @param[in]     xdrs   XDR stream
+ * @param[in,out] data   Buffer data, an I/O buffer when encoding
+ * @param[in,out] len    Length of data
+ * @param[in]     maxlen Largest length allowed
+ *
+ * @return true if successful.
+ */
+bool xdr_iobuf(XDR *xdrs, char **data, u_int *len, u_int maxlen)
+{
+	struct xdr_uio *uio;
+	u_int size;
+
+	if (!nfs_param.core_param.read_zero_copy ||
+	    !gsh_iobuf_zero_copy_ok(xdrs) ||
+	    *data == NULL || *len < IOBUF_ZERO_COPY_MIN)
+		return inline_xdr_bytes(xdrs, data, len, maxlen);
+
+	if (*len > maxlen)
+		return false;
+
+	if (!inline_xdr_u_int32_t(xdrs, len))
+		return false;
+
+	/* The buffer always has room for the padding */
+	size = iobuf_rndup(*len);
+	if (size != *len)
+		memset(*data + *len, 0, size - *len);
+
+	uio = gsh_calloc(1, sizeof(*uio) + sizeof(struct xdr_vio));
+	uio->uio_release = iobuf_uio_release;
+	uio->uio_count = 1;
+	uio->uio_references = 1;
+	uio->uio_vio[0].vio_base = (uint8_t *) *data;
+	uio->uio_vio[0].vio_head = (uint8_t *) *data;
+	uio->uio_vio[0].vio_tail = (uint8_t *) *data + size;
+	uio->uio_vio[0].vio_wrap = (uint8_t *) *data + size;
+
+	/* The transport's reference, dropped by iobuf_uio_release */
+	gsh_iobuf_ref(*data);
+
+	if (!XDR_PUTBUFS(xdrs, uio, UIO_FLAG_NONE)) {
+		iobuf_uio_release(uio, UIO_FLAG_NONE);
+		return false;
+	}
+
+	return true;
+}
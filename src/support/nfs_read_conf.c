@@ -71,6 +71,13 @@ static struct config_item_list protocols[] = {
 	CONFIG_LIST_EOL
 };
 
+static struct config_item_list dispatch_shard_by[] = {
+	CONFIG_LIST_TOK("NONE", DISPATCH_SHARD_NONE),
+	CONFIG_LIST_TOK("CPU", DISPATCH_SHARD_CPU),
+	CONFIG_LIST_TOK("NODE", DISPATCH_SHARD_NODE),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item core_params[] = {
 	CONF_ITEM_UI16("NFS_Port", 0, UINT16_MAX, NFS_PORT,
 		       nfs_core_param, port[P_NFS]),
@@ -102,8 +109,26 @@ static struct config_item core_params[] = {
 		       nfs_core_param, dispatch_max_reqs),
 	CONF_ITEM_UI32("Dispatch_Max_Reqs_Xprt", 1, 2048, 512,
 		       nfs_core_param, dispatch_max_reqs_xprt),
+	CONF_ITEM_TOKEN("Dispatch_Shard_By", DISPATCH_SHARD_NONE,
+			dispatch_shard_by, nfs_core_param, dispatch_shard_by),
+	CONF_ITEM_BOOL("Dispatch_Fair_Queuing", false,
+		       nfs_core_param, dispatch_fair_queuing),
+	CONF_ITEM_UI32("Dispatch_Client_Weight", 1, 1024, 1,
+		       nfs_core_param, dispatch_client_weight),
+	CONF_ITEM_UI32("Dispatch_Client_Max_Reqs", 0, 10000, 0,
+		       nfs_core_param, dispatch_client_max_reqs),
+	CONF_ITEM_UI32("Dispatch_Weight_Mount", 1, 64, 1,
+		       nfs_core_param, dispatch_weight_mount),
+	CONF_ITEM_UI32("Dispatch_Weight_Call", 1, 64, 1,
+		       nfs_core_param, dispatch_weight_call),
+	CONF_ITEM_UI32("Dispatch_Weight_Low_Latency", 1, 64, 1,
+		       nfs_core_param, dispatch_weight_low_latency),
+	CONF_ITEM_UI32("Dispatch_Weight_High_Latency", 1, 64, 1,
+		       nfs_core_param, dispatch_weight_high_latency),
 	CONF_ITEM_BOOL("DRC_Disabled", false,
 		       nfs_core_param, drc.disabled),
+	CONF_ITEM_BOOL("DRC_Encoded_Replies", false,
+		       nfs_core_param, drc.encoded_replies),
 	CONF_ITEM_UI32("DRC_TCP_Npart", 1, 20, DRC_TCP_NPART,
 		       nfs_core_param, drc.tcp.npart),
 	CONF_ITEM_UI32("DRC_TCP_Size", 1, 32767, DRC_TCP_SIZE,
@@ -176,6 +201,8 @@ static struct config_item core_params[] = {
 		       nfs_core_param, tcp_keepintvl),
 	CONF_ITEM_BOOL("Enable_Fast_Stats", false,
 		       nfs_core_param, enable_FASTSTATS),
+	CONF_ITEM_BOOL("Shard_Client_Stats", false,
+		       nfs_core_param, shard_client_stats),
 	CONF_ITEM_BOOL("Short_File_Handle", false,
 		       nfs_core_param, short_file_handle),
 	CONF_ITEM_I64("Manage_Gids_Expiration", 0, 7*24*60*60, 30*60,
@@ -188,6 +215,10 @@ static struct config_item core_params[] = {
 		       nfs_core_param, fsid_device),
 	CONF_ITEM_BOOL("mount_path_pseudo", false,
 		       nfs_core_param, mount_path_pseudo),
+	CONF_ITEM_UI64("Read_Buffer_Cache_Size", 0, UINT64_MAX, 32*1024*1024,
+		       nfs_core_param, read_buffer_cache_size),
+	CONF_ITEM_BOOL("Read_Zero_Copy", true,
+		       nfs_core_param, read_zero_copy),
 	CONFIG_EOL
 };
 
@@ -235,6 +266,12 @@ struct config_block krb5_param = {
 #define GETPWNAMDEF true
 #endif
 
+static struct config_item_list recovery_backends[] = {
+	CONFIG_LIST_TOK("fs", RECOVERY_BACKEND_FS),
+	CONFIG_LIST_TOK("log", RECOVERY_BACKEND_LOG),
+	CONFIG_LIST_EOL
+};
+
 /**
  * @brief NFSv4 specific parameters
  */
@@ -265,6 +302,21 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, pnfs_mds),
 	CONF_ITEM_BOOL("PNFS_DS", true,
 		       nfs_version4_parameter, pnfs_ds),
+	CONF_ITEM_UI32("Max_Session_Slots", 1, NFS41_MAX_SLOTS,
+		       MAX_SESSION_SLOTS_DEFAULT,
+		       nfs_version4_parameter, max_session_slots),
+	CONF_ITEM_UI64("Session_Reply_Cache_Size", 1024 * 1024, UINT64_MAX,
+		       SESSION_REPLY_CACHE_SIZE_DEFAULT,
+		       nfs_version4_parameter, session_reply_cache_size),
+	CONF_ITEM_TOKEN("RecoveryBackend", RECOVERY_BACKEND_FS,
+			recovery_backends,
+			nfs_version4_parameter, recovery_backend),
+	CONF_ITEM_UI32("Idmap_Cache_Lifetime", 0, 7 * 24 * 60 * 60,
+		       IDMAP_CACHE_LIFETIME_DEFAULT,
+		       nfs_version4_parameter, idmap_cache_lifetime),
+	CONF_ITEM_UI32("Idmap_Negative_Cache_Lifetime", 1, 24 * 60 * 60,
+		       IDMAP_NEGATIVE_CACHE_LIFETIME_DEFAULT,
+		       nfs_version4_parameter, idmap_negative_cache_lifetime),
 	CONFIG_EOL
 };
 
@@ -0,0 +1,271 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file rate_limit.c
+ * @brief READ and WRITE rate limiting
+ *
+ * The export's limits come from its EXPORT block and may be changed by
+ * UpdateExport.  A client's limits come from the CLIENT block it
+ * matched and are copied into the op context by export_check_access;
+ * the client's buckets for each export hang off its gsh_client.
+ *
+ * An operation is let through when each bucket it draws on holds at
+ * least what it needs, or a full bucket's worth if it needs more than
+ * that, and is then charged in full.  A bucket may thus go negative,
+ * which makes later operations wait long enough to keep the average
+ * at the limit.
+ */
+
+#include "config.h"
+
+#include <float.h>
+
+#include "log.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "fsal.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "rate_limit.h"
+
+/** A client's buckets for one export */
+struct client_rate_limiter {
+	struct client_rate_limiter *next;
+	uint16_t export_id;
+	struct rate_limiter rl;
+};
+
+void rate_limiter_init(struct rate_limiter *rl)
+{
+	int ix;
+
+	PTHREAD_MUTEX_init(&rl->lock, NULL);
+	rl->last = 0;
+	for (ix = 0; ix < RATE_LIMIT_BUCKETS; ix++)
+		rl->tokens[ix] = DBL_MAX;
+}
+
+void rate_limiter_destroy(struct rate_limiter *rl)
+{
+	PTHREAD_MUTEX_destroy(&rl->lock);
+}
+
+/**
+ * @brief Free a client's buckets
+ *
+ * @param[in] client The client, being removed
+ */
+void rate_limit_client_free(struct gsh_client *client)
+{
+	struct client_rate_limiter *crl;
+
+	while (client->rate_limiters != NULL) {
+		crl = client->rate_limiters;
+		client->rate_limiters = crl->next;
+		rate_limiter_destroy(&crl->rl);
+		gsh_free(crl);
+	}
+}
+
+/**
+ * @brief Find or add a client's buckets for an export
+ */
+static struct rate_limiter *client_rate_limiter(struct gsh_client *client,
+						uint16_t export_id)
+{
+	struct client_rate_limiter *crl;
+
+	PTHREAD_RWLOCK_rdlock(&client->lock);
+
+	for (crl = client->rate_limiters; crl != NULL; crl = crl->next)
+		if (crl->export_id == export_id)
+			break;
+
+	PTHREAD_RWLOCK_unlock(&client->lock);
+
+	if (crl != NULL)
+		return &crl->rl;
+
+	PTHREAD_RWLOCK_wrlock(&client->lock);
+
+	for (crl = client->rate_limiters; crl != NULL; crl = crl->next)
+		if (crl->export_id == export_id)
+			break;
+
+	if (crl == NULL) {
+		crl = gsh_calloc(1, sizeof(*crl));
+		crl->export_id = export_id;
+		rate_limiter_init(&crl->rl);
+		crl->next = client->rate_limiters;
+		client->rate_limiters = crl;
+	}
+
+	PTHREAD_RWLOCK_unlock(&client->lock);
+
+	return &crl->rl;
+}
+
+static inline bool rate_limits_set(const struct rate_limits *limits)
+{
+	return limits->read_bytes != 0 || limits->write_bytes != 0 ||
+	       limits->read_ops != 0 || limits->write_ops != 0;
+}
+
+/**
+ * @brief Take an operation's tokens from a set of buckets
+ *
+ * @param[in] rl     The buckets
+ * @param[in] limits Their rates
+ * @param[in] write  Whether the operation is a write
+ * @param[in] bytes  Bytes the operation transfers
+ * @param[in] now    The time
+ * @param[in] take   Whether to charge the operation if it may go
+ *
+ * @return Nanoseconds until the operation may go, 0 if it may go now.
+ */
+static nsecs_elapsed_t rate_limiter_take(struct rate_limiter *rl,
+					 const struct rate_limits *limits,
+					 bool write, uint64_t bytes,
+					 nsecs_elapsed_t now, bool take)
+{
+	uint64_t rates[RATE_LIMIT_BUCKETS];
+	double need[RATE_LIMIT_BUCKETS] = { 0 };
+	double secs = 0, wait = 0, w;
+	int ix;
+
+	rates[RATE_LIMIT_READ_BYTES] = limits->read_bytes;
+	rates[RATE_LIMIT_WRITE_BYTES] = limits->write_bytes;
+	rates[RATE_LIMIT_READ_OPS] = limits->read_ops;
+	rates[RATE_LIMIT_WRITE_OPS] = limits->write_ops;
+
+	if (write) {
+		need[RATE_LIMIT_WRITE_BYTES] = bytes;
+		need[RATE_LIMIT_WRITE_OPS] = 1;
+	} else {
+		need[RATE_LIMIT_READ_BYTES] = bytes;
+		need[RATE_LIMIT_READ_OPS] = 1;
+	}
+
+	PTHREAD_MUTEX_lock(&rl->lock);
+
+	if (now > rl->last)
+		secs = (double) (now - rl->last) / NS_PER_SEC;
+	rl->last = now;
+
+	for (ix = 0; ix < RATE_LIMIT_BUCKETS; ix++) {
+		if (rates[ix] == 0) {
+			/* Full whenever a limit is set */
+			rl->tokens[ix] = DBL_MAX;
+			continue;
+		}
+
+		rl->tokens[ix] += rates[ix] * secs;
+		if (rl->tokens[ix] > rates[ix])
+			rl->tokens[ix] = rates[ix];
+
+		/* What it needs, or a full bucket if that is less */
+		w = (need[ix] < rates[ix] ? need[ix] : rates[ix]) -
+		    rl->tokens[ix];
+		if (w > 0 && w / rates[ix] > wait)
+			wait = w / rates[ix];
+	}
+
+	if (wait == 0 && take) {
+		for (ix = 0; ix < RATE_LIMIT_BUCKETS; ix++)
+			if (rates[ix] != 0)
+				rl->tokens[ix] -= need[ix];
+	}
+
+	PTHREAD_MUTEX_unlock(&rl->lock);
+
+	/* Round up so a deferred request finds its tokens */
+	return wait > 0 ? (nsecs_elapsed_t) (wait * NS_PER_SEC) + 1 : 0;
+}
+
+/**
+ * @brief Check a READ or WRITE against the limits of op_ctx
+ *
+ * The operation is charged to the export and the client only if both
+ * let it go now.
+ *
+ * @param[in] write Whether the operation is a write
+ * @param[in] bytes Bytes the operation transfers
+ *
+ * @return Nanoseconds the request should be deferred for, 0 to go ahead.
+ */
+nsecs_elapsed_t rate_limit_check(bool write, uint64_t bytes)
+{
+	struct gsh_export *export = op_ctx->ctx_export;
+	struct rate_limits limits;
+	struct rate_limiter *crl = NULL;
+	bool export_set, client_set;
+	struct timespec ts;
+	nsecs_elapsed_t now_ns, wait, cwait;
+
+	if (export == NULL)
+		return 0;
+
+	limits.read_bytes = atomic_fetch_uint64_t(
+					&export->rate_limits.read_bytes);
+	limits.write_bytes = atomic_fetch_uint64_t(
+					&export->rate_limits.write_bytes);
+	limits.read_ops = atomic_fetch_uint64_t(&export->rate_limits.read_ops);
+	limits.write_ops = atomic_fetch_uint64_t(
+					&export->rate_limits.write_ops);
+
+	export_set = rate_limits_set(&limits);
+	client_set = op_ctx->client != NULL &&
+		     rate_limits_set(&op_ctx->client_rate_limits);
+
+	if (!export_set && !client_set)
+		return 0;
+
+	now(&ts);
+	now_ns = timespec_to_nsecs(&ts);
+
+	if (client_set)
+		crl = client_rate_limiter(op_ctx->client, export->export_id);
+
+	if (!client_set)
+		return rate_limiter_take(&export->rate_limiter, &limits,
+					 write, bytes, now_ns, true);
+
+	if (!export_set)
+		return rate_limiter_take(crl, &op_ctx->client_rate_limits,
+					 write, bytes, now_ns, true);
+
+	wait = rate_limiter_take(&export->rate_limiter, &limits,
+				 write, bytes, now_ns, false);
+	cwait = rate_limiter_take(crl, &op_ctx->client_rate_limits,
+				  write, bytes, now_ns, false);
+
+	if (wait != 0 || cwait != 0)
+		return wait > cwait ? wait : cwait;
+
+	(void) rate_limiter_take(&export->rate_limiter, &limits,
+				 write, bytes, now_ns, true);
+	(void) rate_limiter_take(crl, &op_ctx->client_rate_limits,
+				 write, bytes, now_ns, true);
+
+	return 0;
+}
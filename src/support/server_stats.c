@@ -45,6 +45,8 @@
 #include <stdint.h>
 #include <sys/param.h>
 #include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <assert.h>
 #include <arpa/inet.h>
 #include "fsal.h"
@@ -59,6 +61,7 @@
 #include "export_mgr.h"
 #include "server_stats.h"
 #include <abstract_atomic.h>
+#include "gsh_intrinsic.h"
 #include "nfs_proto_functions.h"
 
 #define NFS_V3_NB_COMMAND (NFSPROC3_COMMIT + 1)
@@ -141,7 +144,7 @@ static const struct op_name optabv3[] = {
 	[NFSPROC3_READDIR] = {.name = "READDIR", },
 	[NFSPROC3_READDIRPLUS] = {.name = "READDIRPLUS", },
 	[NFSPROC3_FSSTAT] = {.name = "FSSTAT", },
-	[NFSPROC3_FSINFO] = {.name = "FSINFO	", },
+	[NFSPROC3_FSINFO] = {.name = "FSINFO", },
 	[NFSPROC3_PATHCONF] = {.name = "PATHCONF", },
 	[NFSPROC3_COMMIT] = {.name = "COMMIT", },
 };
@@ -278,6 +281,186 @@ struct op_latency {
 	uint64_t max;
 };
 
+/* Log-linear histograms
+ *
+ * Values below HIST_SUB_BUCKETS get a bucket each.  Above that, every
+ * power of two is split into HIST_SUB_BUCKETS linear sub-buckets so the
+ * relative error of any bucket is bounded by 1/HIST_SUB_BUCKETS.  Values
+ * beyond 2^(HIST_MAX_EXP+1) land in the last bucket.  The same layout is
+ * used for latencies (nsecs) and transfer sizes (bytes).
+ *
+ * Histograms embedded in the per CPU stats shards below have a single
+ * shard of their own.  The global per op histograms are split in
+ * stats_shards shards.  Readers merge the shards when reporting.
+ */
+
+#define HIST_SUB_BITS 3
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 36
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB_BUCKETS)
+
+struct stats_hist_shard {
+	uint64_t count[HIST_BUCKETS];
+	uint64_t sum;
+	uint64_t max;
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
+
+struct stats_hist {
+	uint32_t nshards;
+	struct stats_hist_shard shard[];
+};
+
+/* Per CPU sharding
+ *
+ * The global stats are an array of stats_shards copies, each aligned on
+ * its own cache lines.  Updates go to the copy picked by the CPU the
+ * worker runs on, so workers on different CPUs never write the same
+ * lines.  The counters are still updated atomically since a shard can be
+ * shared by several CPUs or a thread can migrate.  DBus readers sum the
+ * shards.
+ *
+ * The per export and per client stats blocks are arrays of block_shards
+ * copies.  There can be thousands of clients, so they are only split per
+ * CPU like the global stats when Shard_Client_Stats is set.
+ *
+ * Both counts are set once at init, before any stats block is allocated.
+ */
+#define STATS_MAX_SHARDS 32
+
+static uint32_t stats_shards = 1;
+static uint32_t block_shards = 1;
+
+static pthread_rwlock_t global_hist_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* global per op latency histograms
+ */
+struct op_hists {
+	struct stats_hist *latency;
+	struct stats_hist *qwait;
+};
+
+static struct op_hists v3_hists[NFS_V3_NB_COMMAND];
+static struct op_hists v4_hists[NFS4_OP_LAST_ONE];
+static struct op_hists compound_hists;
+static struct op_hists nlm_hists[NLM_V4_NB_OPERATION];
+static struct op_hists mnt_hists[MNT_V3_NB_COMMAND];
+
+/**
+ * @brief Map a value to its histogram bucket
+ */
+
+static inline uint32_t hist_index(uint64_t value)
+{
+	uint32_t exp;
+
+	if (value < HIST_SUB_BUCKETS)
+		return value;
+	exp = 63 - __builtin_clzll(value);
+	if (exp > HIST_MAX_EXP)
+		return HIST_BUCKETS - 1;
+	return (exp - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+	       ((value >> (exp - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief Upper bound (exclusive) of the values counted in a bucket
+ */
+
+static inline uint64_t hist_bucket_limit(uint32_t idx)
+{
+	uint32_t group = idx / HIST_SUB_BUCKETS;
+	uint64_t sub = idx % HIST_SUB_BUCKETS;
+
+	if (group == 0)
+		return idx + 1;
+	return (HIST_SUB_BUCKETS + sub + 1) << (group - 1);
+}
+
+/**
+ * @brief Pick the shard of the calling thread
+ */
+
+static inline uint32_t stats_shard_index(uint32_t nshards)
+{
+	int cpu;
+
+	if (nshards == 1)
+		return 0;
+	cpu = sched_getcpu();
+	return cpu < 0 ? 0 : (uint32_t)cpu % nshards;
+}
+
+static inline uint32_t stats_shard(void)
+{
+	return stats_shard_index(stats_shards);
+}
+
+static inline uint32_t block_shard(void)
+{
+	return stats_shard_index(block_shards);
+}
+
+/**
+ * @brief Get a histogram, allocating it on first use
+ *
+ * @param histp   [IN] where the histogram pointer lives
+ * @param nshards [IN] number of shards if we allocate
+ * @param lock    [IN] the lock in the stats owning struct
+ */
+
+static struct stats_hist *get_hist(struct stats_hist **histp,
+				   uint32_t nshards, pthread_rwlock_t *lock)
+{
+	if (unlikely(*histp == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (*histp == NULL) {
+			size_t size = sizeof(struct stats_hist) +
+				      sizeof(struct stats_hist_shard) * nshards;
+			struct stats_hist *hist;
+
+			hist = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE, size);
+			memset(hist, 0, size);
+			hist->nshards = nshards;
+			*histp = hist;
+		}
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	return *histp;
+}
+
+/**
+ * @brief Count a value in a histogram
+ *
+ * Only the shard of the current CPU is touched so the atomics are
+ * very nearly uncontended.
+ */
+
+static void record_hist(struct stats_hist **histp, uint32_t nshards,
+			pthread_rwlock_t *lock, uint64_t value)
+{
+	struct stats_hist *hist = get_hist(histp, nshards, lock);
+	struct stats_hist_shard *shard;
+	uint64_t max;
+
+	shard = &hist->shard[stats_shard_index(hist->nshards)];
+	(void)atomic_inc_uint64_t(&shard->count[hist_index(value)]);
+	(void)atomic_add_uint64_t(&shard->sum, value);
+
+	/* shards are shared, don't let a smaller value win */
+	max = atomic_fetch_uint64_t(&shard->max);
+	while (value > max &&
+	       !__sync_bool_compare_and_swap(&shard->max, max, value))
+		max = atomic_fetch_uint64_t(&shard->max);
+}
+
+static void free_hist(struct stats_hist **histp)
+{
+	if (*histp != NULL) {
+		gsh_free(*histp);
+		*histp = NULL;
+	}
+}
+
 /* v3 ops
  */
 struct nfsv3_ops {
@@ -326,6 +509,8 @@ struct xfer_op {
 	struct proto_op cmd;
 	uint64_t requested;
 	uint64_t transferred;
+	struct stats_hist *lat_hist;	/* latency distribution */
+	struct stats_hist *size_hist;	/* transfer size distribution */
 };
 
 /* pNFS Layout counters
@@ -344,21 +529,21 @@ struct nfsv3_stats {
 	struct proto_op cmds;	/* non-I/O ops = cmds - (read+write) */
 	struct xfer_op read;
 	struct xfer_op write;
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
 /* Mount statistics counters
  */
 struct mnt_stats {
 	struct proto_op v1_ops;
 	struct proto_op v3_ops;
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
 /* lock manager counters
  */
 
 struct nlmv4_stats {
 	struct proto_op ops;
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
 /* Quota counters
  */
@@ -366,7 +551,7 @@ struct nlmv4_stats {
 struct rquota_stats {
 	struct proto_op ops;
 	struct proto_op ext_ops;
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
 /* NFSv4 statistics counters
  */
@@ -376,7 +561,7 @@ struct nfsv40_stats {
 	uint64_t ops_per_compound;	/* avg = total / ops_per */
 	struct xfer_op read;
 	struct xfer_op write;
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
 struct nfsv41_stats {
 	struct proto_op compounds;
@@ -388,7 +573,7 @@ struct nfsv41_stats {
 	struct layout_op layout_commit;
 	struct layout_op layout_return;
 	struct layout_op recall;
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
 struct transport_stats {
 	uint64_t rx_bytes;
@@ -400,13 +585,21 @@ struct transport_stats {
 };
 
 #ifdef _USE_9P
+struct _9p_fid_stats {
+	uint64_t created;	/* fids set up by attach, walk and xattrwalk */
+	uint64_t released;	/* fids clunked, removed or closed with conn */
+	uint64_t max_per_conn;	/* most fids one connection held at once */
+	uint64_t grows;		/* times a connection's fid table doubled */
+};
+
 struct _9p_stats {
 	struct proto_op cmds;	/* non-I/O ops */
 	struct xfer_op read;
 	struct xfer_op write;
 	struct transport_stats trans;
+	struct _9p_fid_stats fids;
 	struct proto_op *opcodes[_9P_RWSTAT+1];
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 #endif
 
 struct global_stats {
@@ -422,7 +615,7 @@ struct global_stats {
 	struct nlm_ops lm;
 	struct mnt_ops mn;
 	struct qta_ops qt;
-};
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
 
 struct deleg_stats {
 	uint32_t curr_deleg_grants; /* current num of delegations owned by
@@ -433,7 +626,12 @@ struct deleg_stats {
 	uint32_t num_revokes;	    /* Num revokes for the client */
 };
 
-static struct global_stats global_st;
+static struct global_stats global_st[STATS_MAX_SHARDS];
+
+static inline struct global_stats *global_shard(void)
+{
+	return &global_st[stats_shard()];
+}
 
 /* include the top level server_stats struct definition
  */
@@ -443,7 +641,8 @@ static struct global_stats global_st;
  * @brief Get stats struct helpers
  *
  * These functions dereference the protocol specific struct
- * silently calloc the struct on first use.
+ * silently calloc the struct on first use.  They return the
+ * shard of the current CPU.
  *
  * @param stats [IN] the stats structure to dereference in
  * @param lock  [IN] the lock in the stats owning struct
@@ -453,17 +652,31 @@ static struct global_stats global_st;
  * @TODO make them inlines for release
  */
 
+/**
+ * @brief Allocate the shards of an export or client stats struct
+ *
+ * @param size [IN] size of one (cache aligned) shard
+ */
+
+static void *alloc_shards(size_t size)
+{
+	void *shards;
+
+	shards = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE, size * block_shards);
+	memset(shards, 0, size * block_shards);
+	return shards;
+}
+
 static struct nfsv3_stats *get_v3(struct gsh_stats *stats,
 				  pthread_rwlock_t *lock)
 {
 	if (unlikely(stats->nfsv3 == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv3 == NULL)
-			stats->nfsv3 =
-			    gsh_calloc(1, sizeof(struct nfsv3_stats));
+			stats->nfsv3 = alloc_shards(sizeof(struct nfsv3_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv3;
+	return &stats->nfsv3[block_shard()];
 }
 
 static struct mnt_stats *get_mnt(struct gsh_stats *stats,
@@ -472,10 +685,10 @@ static struct mnt_stats *get_mnt(struct gsh_stats *stats,
 	if (unlikely(stats->mnt == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->mnt == NULL)
-			stats->mnt = gsh_calloc(1, sizeof(struct mnt_stats));
+			stats->mnt = alloc_shards(sizeof(struct mnt_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->mnt;
+	return &stats->mnt[block_shard()];
 }
 
 static struct nlmv4_stats *get_nlm4(struct gsh_stats *stats,
@@ -484,10 +697,10 @@ static struct nlmv4_stats *get_nlm4(struct gsh_stats *stats,
 	if (unlikely(stats->nlm4 == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nlm4 == NULL)
-			stats->nlm4 = gsh_calloc(1, sizeof(struct nlmv4_stats));
+			stats->nlm4 = alloc_shards(sizeof(struct nlmv4_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nlm4;
+	return &stats->nlm4[block_shard()];
 }
 
 static struct rquota_stats *get_rquota(struct gsh_stats *stats,
@@ -497,10 +710,10 @@ static struct rquota_stats *get_rquota(struct gsh_stats *stats,
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->rquota == NULL)
 			stats->rquota =
-			    gsh_calloc(1, sizeof(struct rquota_stats));
+			    alloc_shards(sizeof(struct rquota_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->rquota;
+	return &stats->rquota[block_shard()];
 }
 
 static struct nfsv40_stats *get_v40(struct gsh_stats *stats,
@@ -510,10 +723,10 @@ static struct nfsv40_stats *get_v40(struct gsh_stats *stats,
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv40 == NULL)
 			stats->nfsv40 =
-			    gsh_calloc(1, sizeof(struct nfsv40_stats));
+			    alloc_shards(sizeof(struct nfsv40_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv40;
+	return &stats->nfsv40[block_shard()];
 }
 
 static struct nfsv41_stats *get_v41(struct gsh_stats *stats,
@@ -523,10 +736,10 @@ static struct nfsv41_stats *get_v41(struct gsh_stats *stats,
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv41 == NULL)
 			stats->nfsv41 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
+			    alloc_shards(sizeof(struct nfsv41_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv41;
+	return &stats->nfsv41[block_shard()];
 }
 
 static struct nfsv41_stats *get_v42(struct gsh_stats *stats,
@@ -536,10 +749,10 @@ static struct nfsv41_stats *get_v42(struct gsh_stats *stats,
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv42 == NULL)
 			stats->nfsv42 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
+			    alloc_shards(sizeof(struct nfsv41_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv42;
+	return &stats->nfsv42[block_shard()];
 }
 
 #ifdef _USE_9P
@@ -548,10 +761,10 @@ static struct _9p_stats *get_9p(struct gsh_stats *stats, pthread_rwlock_t *lock)
 	if (unlikely(stats->_9p == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->_9p == NULL)
-			stats->_9p = gsh_calloc(1, sizeof(struct _9p_stats));
+			stats->_9p = alloc_shards(sizeof(struct _9p_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->_9p;
+	return &stats->_9p[block_shard()];
 }
 #endif
 
@@ -606,18 +819,20 @@ void record_latency(struct proto_op *op, nsecs_elapsed_t request_time,
  * operation/compound completion.
  *
  * @param iop          [IN] transfer stats struct
+ * @param lock         [IN] lock in the stats owning struct
  * @param requested    [IN] bytes requested
  * @param transferred  [IN] bytes actually transferred
  * @param success      [IN] the op returned OK (or error)
  */
 
-static void record_io(struct xfer_op *iop, size_t requested, size_t transferred,
-		      bool success)
+static void record_io(struct xfer_op *iop, pthread_rwlock_t *lock,
+		      size_t requested, size_t transferred, bool success)
 {
 	(void)atomic_inc_uint64_t(&iop->cmd.total);
 	if (success) {
 		(void)atomic_add_uint64_t(&iop->requested, requested);
 		(void)atomic_add_uint64_t(&iop->transferred, transferred);
+		record_hist(&iop->size_hist, 1, lock, transferred);
 	} else {
 		(void)atomic_inc_uint64_t(&iop->cmd.errors);
 	}
@@ -666,7 +881,26 @@ static void record_io_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 	} else {
 		return;
 	}
-	record_io(iop, requested, transferred, success);
+	record_io(iop, lock, requested, transferred, success);
+}
+
+/**
+ * @brief Record the latency of a read or write
+ *
+ * @param iop          [IN] transfer stats struct
+ * @param lock         [IN] lock in the stats owning struct
+ * @param request_time [IN] time consumed by request
+ * @param qwait_time   [IN] time sitting on queue
+ * @param dup          [IN] detected this was a dup request
+ */
+
+static void record_xfer_latency(struct xfer_op *iop, pthread_rwlock_t *lock,
+				nsecs_elapsed_t request_time,
+				nsecs_elapsed_t qwait_time, bool dup)
+{
+	record_latency(&iop->cmd, request_time, qwait_time, dup);
+	if (likely(!dup))
+		record_hist(&iop->lat_hist, 1, lock, request_time);
 }
 
 /**
@@ -697,6 +931,40 @@ static void record_op(struct proto_op *op, nsecs_elapsed_t request_time,
 }
 
 #ifdef USE_DBUS
+/**
+ * @brief reset a histogram
+ *
+ * Racing updates may survive the reset, same as for the counters.
+ *
+ * @param hist [IN] histogram to clear, may be NULL
+ */
+
+static void reset_hist(struct stats_hist *hist)
+{
+	uint32_t i, j;
+
+	if (hist == NULL)
+		return;
+	for (i = 0; i < hist->nshards; i++) {
+		struct stats_hist_shard *shard = &hist->shard[i];
+
+		for (j = 0; j < HIST_BUCKETS; j++)
+			(void)atomic_store_uint64_t(&shard->count[j], 0);
+		(void)atomic_store_uint64_t(&shard->sum, 0);
+		(void)atomic_store_uint64_t(&shard->max, 0);
+	}
+}
+
+static void reset_op_hists(struct op_hists *oh, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		reset_hist(oh[i].latency);
+		reset_hist(oh[i].qwait);
+	}
+}
+
 /**
  *  @brief reset the counts for protocol operation
  *  Use atomic ops to avoid locks.
@@ -731,6 +999,8 @@ static void reset_xfer_op(struct xfer_op *xfer)
 	reset_op(&xfer->cmd);
 	(void)atomic_store_uint64_t(&xfer->requested, 0);
 	(void)atomic_store_uint64_t(&xfer->transferred, 0);
+	reset_hist(xfer->lat_hist);
+	reset_hist(xfer->size_hist);
 }
 
 /**
@@ -864,6 +1134,10 @@ static void reset__9P_stats(struct _9p_stats *_9p)
 	(void)atomic_store_uint64_t(&_9p->trans.tx_bytes, 0);
 	(void)atomic_store_uint64_t(&_9p->trans.tx_pkt, 0);
 	(void)atomic_store_uint64_t(&_9p->trans.tx_err, 0);
+	(void)atomic_store_uint64_t(&_9p->fids.created, 0);
+	(void)atomic_store_uint64_t(&_9p->fids.released, 0);
+	(void)atomic_store_uint64_t(&_9p->fids.max_per_conn, 0);
+	(void)atomic_store_uint64_t(&_9p->fids.grows, 0);
 	for (opc = 0; opc <= _9P_RWSTAT; opc++) {
 		if (_9p->opcodes[opc] != NULL)
 			reset_op(_9p->opcodes[opc]);
@@ -918,12 +1192,12 @@ static void record_nfsv4_op(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		/* record stuff */
 		switch (nfsv40_optype[proto_op]) {
 		case READ_OP:
-			record_latency(&sp->read.cmd, request_time, qwait_time,
-				       false);
+			record_xfer_latency(&sp->read, lock, request_time,
+					    qwait_time, false);
 			break;
 		case WRITE_OP:
-			record_latency(&sp->write.cmd, request_time, qwait_time,
-				       false);
+			record_xfer_latency(&sp->write, lock, request_time,
+					    qwait_time, false);
 			break;
 		default:
 			record_op(&sp->compounds, request_time, qwait_time,
@@ -935,12 +1209,12 @@ static void record_nfsv4_op(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		/* record stuff */
 		switch (nfsv41_optype[proto_op]) {
 		case READ_OP:
-			record_latency(&sp->read.cmd, request_time, qwait_time,
-				       false);
+			record_xfer_latency(&sp->read, lock, request_time,
+					    qwait_time, false);
 			break;
 		case WRITE_OP:
-			record_latency(&sp->write.cmd, request_time, qwait_time,
-				       false);
+			record_xfer_latency(&sp->write, lock, request_time,
+					    qwait_time, false);
 			break;
 		case LAYOUT_OP:
 			record_layout(sp, proto_op, status);
@@ -955,12 +1229,12 @@ static void record_nfsv4_op(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		/* record stuff */
 		switch (nfsv42_optype[proto_op]) {
 		case READ_OP:
-			record_latency(&sp->read.cmd, request_time, qwait_time,
-				       false);
+			record_xfer_latency(&sp->read, lock, request_time,
+					    qwait_time, false);
 			break;
 		case WRITE_OP:
-			record_latency(&sp->write.cmd, request_time, qwait_time,
-				       false);
+			record_xfer_latency(&sp->write, lock, request_time,
+					    qwait_time, false);
 			break;
 		case LAYOUT_OP:
 			record_layout(sp, proto_op, status);
@@ -1031,6 +1305,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 	struct svc_req *req = &reqdata->r_u.req.svc;
 	uint32_t proto_op = req->rq_msg.cb_proc;
 	uint32_t program_op = req->rq_msg.cb_prog;
+	struct global_stats *gsp = global_shard();
 
 	if (program_op == NFS_program[P_NFS]) {
 		if (proto_op == 0)
@@ -1040,16 +1315,18 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 
 			/* record stuff */
 			if (global)
-				record_op(&global_st.nfsv3.cmds, request_time,
+				record_op(&gsp->nfsv3.cmds, request_time,
 					  qwait_time, success, dup);
 			switch (nfsv3_optype[proto_op]) {
 			case READ_OP:
-				record_latency(&sp->read.cmd, request_time,
-					       qwait_time, dup);
+				record_xfer_latency(&sp->read, lock,
+						    request_time, qwait_time,
+						    dup);
 				break;
 			case WRITE_OP:
-				record_latency(&sp->write.cmd, request_time,
-					       qwait_time, dup);
+				record_xfer_latency(&sp->write, lock,
+						    request_time, qwait_time,
+						    dup);
 				break;
 			default:
 				record_op(&sp->cmds, request_time, qwait_time,
@@ -1063,10 +1340,10 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct mnt_stats *sp = get_mnt(gsh_st, lock);
 
 		if (global && req->rq_msg.cb_vers == MOUNT_V1)
-			record_op(&global_st.mnt.v1_ops, request_time,
+			record_op(&gsp->mnt.v1_ops, request_time,
 				  qwait_time, success, dup);
 		else if (global)
-			record_op(&global_st.mnt.v3_ops, request_time,
+			record_op(&gsp->mnt.v3_ops, request_time,
 				  qwait_time, success, dup);
 
 		/* record stuff */
@@ -1080,7 +1357,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct nlmv4_stats *sp = get_nlm4(gsh_st, lock);
 
 		if (global)
-			record_op(&global_st.nlm4.ops, request_time,
+			record_op(&gsp->nlm4.ops, request_time,
 				  qwait_time, success, dup);
 		/* record stuff */
 		record_op(&sp->ops, request_time, qwait_time, success, dup);
@@ -1088,7 +1365,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct rquota_stats *sp = get_rquota(gsh_st, lock);
 
 		if (global)
-			record_op(&global_st.rquota.ops, request_time,
+			record_op(&gsp->rquota.ops, request_time,
 				  qwait_time, success, dup);
 		/* record stuff */
 		if (req->rq_msg.cb_vers == RQUOTAVERS)
@@ -1144,6 +1421,40 @@ void server_stats_transport_done(struct gsh_client *client,
 				       tx_bytes, tx_pkt, tx_err);
 }
 
+/**
+ * @brief record 9P fid table stats
+ *
+ * Called when a fid is added to or taken out of a connection's table
+ *
+ * @param[in] client    Client of the connection
+ * @param[in] created   A new fid was added, else one was released
+ * @param[in] conn_fids Fids the connection now holds, when created
+ * @param[in] grown     The table doubled to make room
+ */
+void server_stats_9p_fid(struct gsh_client *client, bool created,
+			 uint32_t conn_fids, bool grown)
+{
+	struct server_stats *server_st =
+		container_of(client, struct server_stats, client);
+	struct _9p_stats *sp = get_9p(&server_st->st, &client->lock);
+	uint64_t max;
+
+	if (!created) {
+		(void)atomic_inc_uint64_t(&sp->fids.released);
+		return;
+	}
+
+	(void)atomic_inc_uint64_t(&sp->fids.created);
+	if (grown)
+		(void)atomic_inc_uint64_t(&sp->fids.grows);
+
+	max = atomic_fetch_uint64_t(&sp->fids.max_per_conn);
+	while (conn_fids > max &&
+	       !__sync_bool_compare_and_swap(&sp->fids.max_per_conn, max,
+					     conn_fids))
+		max = atomic_fetch_uint64_t(&sp->fids.max_per_conn);
+}
+
 /**
  * @bried record 9p operation stats
  *
@@ -1181,6 +1492,22 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 }
 #endif
 
+/**
+ * @brief Record the global latency histograms of an op
+ *
+ * @param oh           [IN] histograms of the op
+ * @param request_time [IN] time consumed by request
+ * @param qwait_time   [IN] time sitting on queue
+ */
+
+static void record_op_hists(struct op_hists *oh, nsecs_elapsed_t request_time,
+			    nsecs_elapsed_t qwait_time)
+{
+	record_hist(&oh->latency, stats_shards, &global_hist_lock,
+		    request_time);
+	record_hist(&oh->qwait, stats_shards, &global_hist_lock, qwait_time);
+}
+
 /**
  * @brief record NFS op finished
  *
@@ -1195,21 +1522,38 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 	struct svc_req *req = &reqdata->r_u.req.svc;
 	uint32_t proto_op = req->rq_msg.cb_proc;
 	uint32_t program_op = req->rq_msg.cb_prog;
+	struct global_stats *gsp = global_shard();
 
 	if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3)
-		global_st.v3.op[proto_op]++;
+		gsp->v3.op[proto_op]++;
 	else if (program_op == NFS_program[P_NLM])
-		global_st.lm.op[proto_op]++;
+		gsp->lm.op[proto_op]++;
 	else if (program_op == NFS_program[P_MNT])
-		global_st.mn.op[proto_op]++;
+		gsp->mn.op[proto_op]++;
 	else if (program_op == NFS_program[P_RQUOTA])
-		global_st.qt.op[proto_op]++;
+		gsp->qt.op[proto_op]++;
 
 	if (nfs_param.core_param.enable_FASTSTATS)
 		return;
 
 	now(&current_time);
 	stop_time = timespec_diff(&ServerBootTime, &current_time);
+	if (!dup) {
+		struct op_hists *oh = NULL;
+
+		if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3 &&
+		    proto_op < NFS_V3_NB_COMMAND)
+			oh = &v3_hists[proto_op];
+		else if (program_op == NFS_program[P_NLM] &&
+			 proto_op < NLM_V4_NB_OPERATION)
+			oh = &nlm_hists[proto_op];
+		else if (program_op == NFS_program[P_MNT] &&
+			 proto_op < MNT_V3_NB_COMMAND)
+			oh = &mnt_hists[proto_op];
+		if (oh != NULL)
+			record_op_hists(oh, stop_time - op_ctx->start_time,
+					op_ctx->queue_wait);
+	}
 	if (client != NULL) {
 		struct server_stats *server_st;
 
@@ -1246,9 +1590,10 @@ void server_stats_nfsv4_op_done(int proto_op,
 	struct gsh_client *client = op_ctx->client;
 	struct timespec current_time;
 	nsecs_elapsed_t stop_time;
+	struct global_stats *gsp = global_shard();
 
 	if (op_ctx->nfs_vers == NFS_V4)
-		global_st.v4.op[proto_op]++;
+		(void)atomic_inc_uint64_t(&gsp->v4.op[proto_op]);
 
 	if (nfs_param.core_param.enable_FASTSTATS)
 		return;
@@ -1256,6 +1601,11 @@ void server_stats_nfsv4_op_done(int proto_op,
 	now(&current_time);
 	stop_time = timespec_diff(&ServerBootTime, &current_time);
 
+	/* queue wait belongs to the compound, not to its ops */
+	if (op_ctx->nfs_vers == NFS_V4 && proto_op < NFS4_OP_LAST_ONE)
+		record_hist(&v4_hists[proto_op].latency, stats_shards,
+			    &global_hist_lock, stop_time - start_time);
+
 	if (client != NULL) {
 		struct server_stats *server_st;
 
@@ -1267,13 +1617,13 @@ void server_stats_nfsv4_op_done(int proto_op,
 	}
 
 	if (op_ctx->nfs_minorvers == 0)
-		record_op(&global_st.nfsv40.compounds, stop_time - start_time,
+		record_op(&gsp->nfsv40.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 1)
-		record_op(&global_st.nfsv41.compounds, stop_time - start_time,
+		record_op(&gsp->nfsv41.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 2)
-		record_op(&global_st.nfsv42.compounds, stop_time - start_time,
+		record_op(&gsp->nfsv42.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 
 	if (op_ctx->ctx_export != NULL) {
@@ -1305,6 +1655,10 @@ void server_stats_compound_done(int num_ops, int status)
 
 	now(&current_time);
 	stop_time = timespec_diff(&ServerBootTime, &current_time);
+	if (!nfs_param.core_param.enable_FASTSTATS)
+		record_op_hists(&compound_hists,
+				stop_time - op_ctx->start_time,
+				op_ctx->queue_wait);
 	if (client != NULL) {
 		struct server_stats *server_st;
 
@@ -1428,6 +1782,150 @@ void inc_failed_recalls(struct gsh_client *client)
 
 #ifdef USE_DBUS
 
+/* Functions for summing the per CPU shards
+ *
+ * The sums are plain structs with no histograms attached.
+ */
+
+static void merge_latency(struct op_latency *dst, struct op_latency *src)
+{
+	dst->latency += src->latency;
+	if (src->min != 0 && (dst->min == 0 || dst->min > src->min))
+		dst->min = src->min;
+	if (dst->max < src->max)
+		dst->max = src->max;
+}
+
+static void merge_op(struct proto_op *dst, struct proto_op *src)
+{
+	dst->total += src->total;
+	dst->errors += src->errors;
+	dst->dups += src->dups;
+	merge_latency(&dst->latency, &src->latency);
+	merge_latency(&dst->dup_latency, &src->dup_latency);
+	merge_latency(&dst->queue_latency, &src->queue_latency);
+}
+
+static void merge_xfer_op(struct xfer_op *dst, struct xfer_op *src)
+{
+	merge_op(&dst->cmd, &src->cmd);
+	dst->requested += src->requested;
+	dst->transferred += src->transferred;
+}
+
+static void merge_layout_op(struct layout_op *dst, struct layout_op *src)
+{
+	dst->total += src->total;
+	dst->errors += src->errors;
+	dst->delays += src->delays;
+}
+
+static void sum_nfsv3_stats(struct nfsv3_stats *sum,
+			    struct nfsv3_stats *shards)
+{
+	uint32_t i;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < block_shards; i++) {
+		merge_op(&sum->cmds, &shards[i].cmds);
+		merge_xfer_op(&sum->read, &shards[i].read);
+		merge_xfer_op(&sum->write, &shards[i].write);
+	}
+}
+
+static void sum_nfsv40_stats(struct nfsv40_stats *sum,
+			     struct nfsv40_stats *shards)
+{
+	uint32_t i;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < block_shards; i++) {
+		merge_op(&sum->compounds, &shards[i].compounds);
+		sum->ops_per_compound += shards[i].ops_per_compound;
+		merge_xfer_op(&sum->read, &shards[i].read);
+		merge_xfer_op(&sum->write, &shards[i].write);
+	}
+}
+
+static void sum_nfsv41_stats(struct nfsv41_stats *sum,
+			     struct nfsv41_stats *shards)
+{
+	uint32_t i;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < block_shards; i++) {
+		merge_op(&sum->compounds, &shards[i].compounds);
+		sum->ops_per_compound += shards[i].ops_per_compound;
+		merge_xfer_op(&sum->read, &shards[i].read);
+		merge_xfer_op(&sum->write, &shards[i].write);
+		merge_layout_op(&sum->getdevinfo, &shards[i].getdevinfo);
+		merge_layout_op(&sum->layout_get, &shards[i].layout_get);
+		merge_layout_op(&sum->layout_commit,
+				&shards[i].layout_commit);
+		merge_layout_op(&sum->layout_return,
+				&shards[i].layout_return);
+		merge_layout_op(&sum->recall, &shards[i].recall);
+	}
+}
+
+#ifdef _USE_9P
+static void sum_9p_stats(struct _9p_stats *sum, struct _9p_stats *shards)
+{
+	uint32_t i;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < block_shards; i++) {
+		struct transport_stats *t_st = &shards[i].trans;
+
+		merge_op(&sum->cmds, &shards[i].cmds);
+		merge_xfer_op(&sum->read, &shards[i].read);
+		merge_xfer_op(&sum->write, &shards[i].write);
+		sum->trans.rx_bytes += t_st->rx_bytes;
+		sum->trans.rx_pkt += t_st->rx_pkt;
+		sum->trans.rx_err += t_st->rx_err;
+		sum->trans.tx_bytes += t_st->tx_bytes;
+		sum->trans.tx_pkt += t_st->tx_pkt;
+		sum->trans.tx_err += t_st->tx_err;
+		sum->fids.created += shards[i].fids.created;
+		sum->fids.released += shards[i].fids.released;
+		sum->fids.grows += shards[i].fids.grows;
+		if (shards[i].fids.max_per_conn > sum->fids.max_per_conn)
+			sum->fids.max_per_conn = shards[i].fids.max_per_conn;
+	}
+}
+#endif
+
+static void sum_global_stats(struct global_stats *sum)
+{
+	struct global_stats *gsp;
+	uint32_t i;
+	int j;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < stats_shards; i++) {
+		gsp = &global_st[i];
+		merge_op(&sum->nfsv3.cmds, &gsp->nfsv3.cmds);
+		merge_op(&sum->mnt.v1_ops, &gsp->mnt.v1_ops);
+		merge_op(&sum->mnt.v3_ops, &gsp->mnt.v3_ops);
+		merge_op(&sum->nlm4.ops, &gsp->nlm4.ops);
+		merge_op(&sum->rquota.ops, &gsp->rquota.ops);
+		merge_op(&sum->rquota.ext_ops, &gsp->rquota.ext_ops);
+		merge_op(&sum->nfsv40.compounds, &gsp->nfsv40.compounds);
+		merge_op(&sum->nfsv41.compounds, &gsp->nfsv41.compounds);
+		merge_op(&sum->nfsv42.compounds, &gsp->nfsv42.compounds);
+		for (j = 0; j < NFS_V3_NB_COMMAND; j++)
+			sum->v3.op[j] += gsp->v3.op[j];
+		for (j = 0; j < NFS4_OP_LAST_ONE; j++)
+			sum->v4.op[j] += gsp->v4.op[j];
+		for (j = 0; j < NLM_V4_NB_OPERATION; j++)
+			sum->lm.op[j] += gsp->lm.op[j];
+		for (j = 0; j < MNT_V3_NB_COMMAND; j++)
+			sum->mn.op[j] += gsp->mn.op[j];
+		for (j = 0; j < RQUOTA_NB_COMMAND; j++)
+			sum->qt.op[j] += gsp->qt.op[j];
+	}
+}
+
 /* Functions for marshalling statistics to DBUS
  */
 
@@ -1574,6 +2072,9 @@ static void server_dbus_transportstats(struct transport_stats *tstats,
 void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
+	struct nfsv3_stats v3;
+	struct nfsv40_stats v40;
+	struct nfsv41_stats v41;
 	uint64_t total = 0;
 	char *version;
 
@@ -1583,47 +2084,59 @@ void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 	version = "NFSv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv3 == NULL)
+	if (export_st->st.nfsv3 == NULL) {
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	} else {
+		sum_nfsv3_stats(&v3, export_st->st.nfsv3);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv3->cmds.total);
+				&v3.cmds.total);
+	}
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv40 == NULL)
+	if (export_st->st.nfsv40 == NULL) {
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	} else {
+		sum_nfsv40_stats(&v40, export_st->st.nfsv40);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv40->compounds.total);
+				&v40.compounds.total);
+	}
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv41 == NULL)
+	if (export_st->st.nfsv41 == NULL) {
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	} else {
+		sum_nfsv41_stats(&v41, export_st->st.nfsv41);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv41->compounds.total);
+				&v41.compounds.total);
+	}
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv42 == NULL)
+	if (export_st->st.nfsv42 == NULL) {
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	} else {
+		sum_nfsv41_stats(&v41, export_st->st.nfsv42);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv42->compounds.total);
+				&v41.compounds.total);
+	}
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
 void global_dbus_total(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
+	struct global_stats *gs = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+						     sizeof(*gs));
 	char *version;
 
+	sum_global_stats(gs);
+
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
 
@@ -1631,52 +2144,57 @@ void global_dbus_total(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv3.cmds.total);
+					&gs->nfsv3.cmds.total);
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv40.compounds.total);
+					&gs->nfsv40.compounds.total);
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv41.compounds.total);
+					&gs->nfsv41.compounds.total);
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv42.compounds.total);
+					&gs->nfsv42.compounds.total);
 	version = "NLM4";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nlm4.ops.total);
+					&gs->nlm4.ops.total);
 	version = "MNTv1";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v1_ops.total);
+					&gs->mnt.v1_ops.total);
 	version = "MNTv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v3_ops.total);
+					&gs->mnt.v3_ops.total);
 	version = "RQUOTA";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.rquota.ops.total);
+					&gs->rquota.ops.total);
 	dbus_message_iter_close_container(iter, &struct_iter);
+	gsh_free(gs);
 }
 
 void global_dbus_fast(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
+	struct global_stats *gs = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+						     sizeof(*gs));
 	char *version;
 	char *op;
 	int i;
 
+	sum_global_stats(gs);
+
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
 
@@ -1684,103 +2202,112 @@ void global_dbus_fast(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFSPROC3_COMMIT; i++) {
-		if (global_st.v3.op[i] > 0) {
+		if (gs->v3.op[i] > 0) {
 			op = optabv3[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v3.op[i]);
+					DBUS_TYPE_UINT64, &gs->v3.op[i]);
 		}
 	}
 	version = "\nNFSv4:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
-		if (global_st.v4.op[i] > 0) {
+		if (gs->v4.op[i] > 0) {
 			op = optabv4[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v4.op[i]);
+					DBUS_TYPE_UINT64, &gs->v4.op[i]);
 		}
 	}
 	version = "\nNLM:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NLM4_FAILED; i++) {
-		if (global_st.lm.op[i] > 0) {
+		if (gs->lm.op[i] > 0) {
 			op = optnlm[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.lm.op[i]);
+					DBUS_TYPE_UINT64, &gs->lm.op[i]);
 		}
 	}
 	version = "\nMNT:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < MOUNTPROC3_EXPORT; i++) {
-		if (global_st.mn.op[i] > 0) {
+		if (gs->mn.op[i] > 0) {
 			op = optmnt[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.mn.op[i]);
+					DBUS_TYPE_UINT64, &gs->mn.op[i]);
 		}
 	}
 	version = "\nQUOTA:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++) {
-		if (global_st.qt.op[i] > 0) {
+		if (gs->qt.op[i] > 0) {
 			op = optqta[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.qt.op[i]);
+					DBUS_TYPE_UINT64, &gs->qt.op[i]);
 		}
 	}
 	dbus_message_iter_close_container(iter, &struct_iter);
+	gsh_free(gs);
 }
 
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv3_stats sum;
 
+	sum_nfsv3_stats(&sum, v3p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v3p->read, iter);
-	server_dbus_iostats(&v3p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_v40_iostats(struct nfsv40_stats *v40p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv40_stats sum;
 
+	sum_nfsv40_stats(&sum, v40p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v40p->read, iter);
-	server_dbus_iostats(&v40p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_v41_iostats(struct nfsv41_stats *v41p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	sum_nfsv41_stats(&sum, v41p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v41p->read, iter);
-	server_dbus_iostats(&v41p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_v42_iostats(struct nfsv41_stats *v42p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	sum_nfsv41_stats(&sum, v42p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v42p->read, iter);
-	server_dbus_iostats(&v42p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_fill_io(DBusMessageIter *array_iter, uint16_t *export_id,
@@ -1824,93 +2351,103 @@ void server_dbus_fill_io(DBusMessageIter *array_iter, uint16_t *export_id,
 void server_dbus_all_iostats(struct export_stats *export_statistics,
 			     DBusMessageIter *array_iter)
 {
+	struct nfsv3_stats v3;
+	struct nfsv40_stats v40;
+	struct nfsv41_stats v41;
+
 	if (export_statistics->st.nfsv3 != NULL) {
+		sum_nfsv3_stats(&v3, export_statistics->st.nfsv3);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv3",
-				    &(export_statistics->st.nfsv3->read),
-				    &(export_statistics->st.nfsv3->write));
+				    "NFSv3", &v3.read, &v3.write);
 	}
 
 	if (export_statistics->st.nfsv40 != NULL) {
+		sum_nfsv40_stats(&v40, export_statistics->st.nfsv40);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv40",
-				    &(export_statistics->st.nfsv40->read),
-				    &(export_statistics->st.nfsv40->write));
+				    "NFSv40", &v40.read, &v40.write);
 	}
 
 	if (export_statistics->st.nfsv41 != NULL) {
+		sum_nfsv41_stats(&v41, export_statistics->st.nfsv41);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv41",
-				    &(export_statistics->st.nfsv41->read),
-				    &(export_statistics->st.nfsv41->write));
+				    "NFSv41", &v41.read, &v41.write);
 	}
 
 	if (export_statistics->st.nfsv42 != NULL) {
+		sum_nfsv41_stats(&v41, export_statistics->st.nfsv42);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv42",
-				    &(export_statistics->st.nfsv42->read),
-				    &(export_statistics->st.nfsv42->write));
+				    "NFSv42", &v41.read, &v41.write);
 	}
 }
 
 void reset_gsh_stats(struct gsh_stats *st)
 {
-	if (st->nfsv3)
-		reset_nfsv3_stats(st->nfsv3);
-	if (st->nfsv40)
-		reset_nfsv40_stats(st->nfsv40);
-	if (st->nfsv41)
-		reset_nfsv41_stats(st->nfsv41);
-	if (st->nfsv42)
-		reset_nfsv41_stats(st->nfsv42); /* Uses v41 stats */
-	if (st->mnt)
-		reset_mnt_stats(st->mnt);
-	if (st->rquota)
-		reset_rquota_stats(st->rquota);
-	if (st->nlm4)
-		reset_nlmv4_stats(st->nlm4);
-	if (st->deleg)
-		reset_deleg_stats(st->deleg);
+	uint32_t i;
+
+	for (i = 0; i < block_shards; i++) {
+		if (st->nfsv3)
+			reset_nfsv3_stats(&st->nfsv3[i]);
+		if (st->nfsv40)
+			reset_nfsv40_stats(&st->nfsv40[i]);
+		if (st->nfsv41)
+			reset_nfsv41_stats(&st->nfsv41[i]);
+		if (st->nfsv42)
+			reset_nfsv41_stats(&st->nfsv42[i]); /* Uses v41 stats */
+		if (st->mnt)
+			reset_mnt_stats(&st->mnt[i]);
+		if (st->rquota)
+			reset_rquota_stats(&st->rquota[i]);
+		if (st->nlm4)
+			reset_nlmv4_stats(&st->nlm4[i]);
 #ifdef _USE_9P
-	if (st->_9p)
-		reset__9P_stats(st->_9p);
+		if (st->_9p)
+			reset__9P_stats(&st->_9p[i]);
 #endif
+	}
+	if (st->deleg)
+		reset_deleg_stats(st->deleg);
 }
 
 void reset_global_stats(void)
 {
+	struct global_stats *gsp;
+	uint32_t shard;
 	int i;
-	/* Reset all ops counters of nfsv3 */
-	for (i = 0; i < NFSPROC3_COMMIT; i++) {
-		(void)atomic_store_uint64_t(&global_st.v3.op[i], 0);
-	}
-	/* Reset all ops counters of nfsv4 */
-	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
-		(void)atomic_store_uint64_t(&global_st.v4.op[i], 0);
-	}
-	/* Reset all ops counters of lock manager */
-	for (i = 0; i < NLM4_FAILED; i++) {
-		(void)atomic_store_uint64_t(&global_st.lm.op[i], 0);
-	}
-	/* Reset all ops counters of mountd */
-	for (i = 0; i < MOUNTPROC3_EXPORT; i++) {
-		(void)atomic_store_uint64_t(&global_st.mn.op[i], 0);
-	}
-	/* Reset all ops counters of rquotad */
-	for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++) {
-		(void)atomic_store_uint64_t(&global_st.qt.op[i], 0);
+
+	for (shard = 0; shard < stats_shards; shard++) {
+		gsp = &global_st[shard];
+		/* Reset all ops counters of nfsv3 */
+		for (i = 0; i < NFSPROC3_COMMIT; i++)
+			(void)atomic_store_uint64_t(&gsp->v3.op[i], 0);
+		/* Reset all ops counters of nfsv4 */
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+			(void)atomic_store_uint64_t(&gsp->v4.op[i], 0);
+		/* Reset all ops counters of lock manager */
+		for (i = 0; i < NLM4_FAILED; i++)
+			(void)atomic_store_uint64_t(&gsp->lm.op[i], 0);
+		/* Reset all ops counters of mountd */
+		for (i = 0; i < MOUNTPROC3_EXPORT; i++)
+			(void)atomic_store_uint64_t(&gsp->mn.op[i], 0);
+		/* Reset all ops counters of rquotad */
+		for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++)
+			(void)atomic_store_uint64_t(&gsp->qt.op[i], 0);
+		reset_nfsv3_stats(&gsp->nfsv3);
+		reset_nfsv40_stats(&gsp->nfsv40);
+		reset_nfsv41_stats(&gsp->nfsv41);
+		reset_nfsv41_stats(&gsp->nfsv42);  /* Uses v41 stats */
+		reset_mnt_stats(&gsp->mnt);
+		reset_rquota_stats(&gsp->rquota);
+		reset_nlmv4_stats(&gsp->nlm4);
 	}
-	reset_nfsv3_stats(&global_st.nfsv3);
-	reset_nfsv40_stats(&global_st.nfsv40);
-	reset_nfsv41_stats(&global_st.nfsv41);
-	reset_nfsv41_stats(&global_st.nfsv42);  /* Uses v41 stats */
-	reset_mnt_stats(&global_st.mnt);
-	reset_rquota_stats(&global_st.rquota);
-	reset_nlmv4_stats(&global_st.nlm4);
+	reset_op_hists(v3_hists, NFS_V3_NB_COMMAND);
+	reset_op_hists(v4_hists, NFS4_OP_LAST_ONE);
+	reset_op_hists(&compound_hists, 1);
+	reset_op_hists(nlm_hists, NLM_V4_NB_OPERATION);
+	reset_op_hists(mnt_hists, MNT_V3_NB_COMMAND);
 }
 
 void global_dbus_reset_stats(DBusMessageIter *iter)
@@ -1961,30 +2498,85 @@ void server_reset_stats(DBusMessageIter *iter)
 void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct _9p_stats sum;
 
+	sum_9p_stats(&sum, _9pp);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&_9pp->read, iter);
-	server_dbus_iostats(&_9pp->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_9p_transstats(struct _9p_stats *_9pp, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct _9p_stats sum;
 
+	sum_9p_stats(&sum, _9pp);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_transportstats(&_9pp->trans, iter);
+	server_dbus_transportstats(&sum.trans, iter);
+}
+
+/**
+ * @brief Report 9P fid stats as a struct
+ *
+ * The counts are kept per client, summed over all its connections;
+ * max_per_conn is the most any one of those connections held.
+ *
+ * struct fids {
+ *	uint64_t created;
+ *	uint64_t released;
+ *	uint64_t in_use;
+ *	uint64_t max_per_conn;
+ *	uint64_t grows;
+ * }
+ */
+void server_dbus_9p_fidstats(struct _9p_stats *_9pp, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	struct _9p_stats sum;
+	DBusMessageIter struct_iter;
+	uint64_t in_use;
+
+	sum_9p_stats(&sum, _9pp);
+	/* shards are read without locks, don't report a wrapped count */
+	in_use = sum.fids.created > sum.fids.released ?
+			sum.fids.created - sum.fids.released : 0;
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &sum.fids.created);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &sum.fids.released);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &in_use);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &sum.fids.max_per_conn);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &sum.fids.grows);
+	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
 void server_dbus_9p_opstats(struct _9p_stats *_9pp, u8 opcode,
 			    DBusMessageIter *iter)
 {
 	struct timespec timestamp;
-
+	struct proto_op sum, *op = NULL;
+	uint32_t i;
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < block_shards; i++) {
+		if (_9pp[i].opcodes[opcode] != NULL) {
+			merge_op(&sum, _9pp[i].opcodes[opcode]);
+			op = &sum;
+		}
+	}
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_op_stats(_9pp->opcodes[opcode], iter);
+	server_dbus_op_stats(op, iter);
 }
 #endif
 
@@ -2020,27 +2612,31 @@ static void server_dbus_layouts(struct layout_op *lop, DBusMessageIter *iter)
 void server_dbus_v41_layouts(struct nfsv41_stats *v41p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	sum_nfsv41_stats(&sum, v41p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v41p->getdevinfo, iter);
-	server_dbus_layouts(&v41p->layout_get, iter);
-	server_dbus_layouts(&v41p->layout_commit, iter);
-	server_dbus_layouts(&v41p->layout_return, iter);
-	server_dbus_layouts(&v41p->recall, iter);
+	server_dbus_layouts(&sum.getdevinfo, iter);
+	server_dbus_layouts(&sum.layout_get, iter);
+	server_dbus_layouts(&sum.layout_commit, iter);
+	server_dbus_layouts(&sum.layout_return, iter);
+	server_dbus_layouts(&sum.recall, iter);
 }
 
 void server_dbus_v42_layouts(struct nfsv41_stats *v42p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	sum_nfsv41_stats(&sum, v42p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v42p->getdevinfo, iter);
-	server_dbus_layouts(&v42p->layout_get, iter);
-	server_dbus_layouts(&v42p->layout_commit, iter);
-	server_dbus_layouts(&v42p->layout_return, iter);
-	server_dbus_layouts(&v42p->recall, iter);
+	server_dbus_layouts(&sum.getdevinfo, iter);
+	server_dbus_layouts(&sum.layout_get, iter);
+	server_dbus_layouts(&sum.layout_commit, iter);
+	server_dbus_layouts(&sum.layout_return, iter);
+	server_dbus_layouts(&sum.recall, iter);
 }
 
 /**
@@ -2069,8 +2665,299 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
+/* Histogram merged across its shards for reporting
+ */
+
+struct hist_summary {
+	uint64_t count[HIST_BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t max;
+};
+
+static void merge_hist(struct hist_summary *hs, struct stats_hist *hist)
+{
+	uint32_t i, j;
+
+	if (hist == NULL)
+		return;
+	for (i = 0; i < hist->nshards; i++) {
+		struct stats_hist_shard *shard = &hist->shard[i];
+		uint64_t max;
+
+		for (j = 0; j < HIST_BUCKETS; j++) {
+			uint64_t cnt = atomic_fetch_uint64_t(&shard->count[j]);
+
+			hs->count[j] += cnt;
+			hs->total += cnt;
+		}
+		hs->sum += atomic_fetch_uint64_t(&shard->sum);
+		max = atomic_fetch_uint64_t(&shard->max);
+		if (hs->max < max)
+			hs->max = max;
+	}
+}
+
+/**
+ * @brief Estimate a percentile from a merged histogram
+ *
+ * @param hs  [IN] merged histogram
+ * @param ppt [IN] percentile in parts per ten thousand
+ *
+ * @return upper bound of the bucket holding the percentile
+ */
+
+static uint64_t hist_percentile(struct hist_summary *hs, uint64_t ppt)
+{
+	uint64_t rank, seen = 0;
+	uint32_t i;
+
+	if (hs->total == 0)
+		return 0;
+	rank = (hs->total * ppt + 9999) / 10000;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hs->count[i];
+		if (seen >= rank)
+			return MIN(hist_bucket_limit(i) - 1, hs->max);
+	}
+	return hs->max;
+}
+
+/**
+ * @brief Report a histogram as a struct
+ *
+ * struct histogram {
+ *       uint64_t count;
+ *       uint64_t sum;
+ *       uint64_t p50;
+ *       uint64_t p90;
+ *       uint64_t p99;
+ *       uint64_t p999;
+ *       uint64_t max;
+ *       struct {
+ *               uint64_t limit;	(exclusive upper bound)
+ *               uint64_t count;
+ *       } buckets[];		(non-empty buckets only)
+ * }
+ *
+ * @param hs    [IN] merged histogram
+ * @param iter  [IN] interator in reply stream to fill
+ */
+
+static void server_dbus_hist(struct hist_summary *hs, DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter, array_iter, bucket_iter;
+	uint64_t val;
+	uint32_t i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &hs->total);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &hs->sum);
+	val = hist_percentile(hs, 5000);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = hist_percentile(hs, 9000);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = hist_percentile(hs, 9900);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = hist_percentile(hs, 9990);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &hs->max);
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY, "(tt)",
+					 &array_iter);
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (hs->count[i] == 0)
+			continue;
+		val = hist_bucket_limit(i);
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &bucket_iter);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &val);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &hs->count[i]);
+		dbus_message_iter_close_container(&array_iter, &bucket_iter);
+	}
+	dbus_message_iter_close_container(&struct_iter, &array_iter);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+static struct op_hists *find_op_hists(const struct op_name *optab,
+				      struct op_hists *hists, int count,
+				      const char *op)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (optab[i].name != NULL && strcmp(optab[i].name, op) == 0)
+			return &hists[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief Find the global latency histograms of a protocol op
+ *
+ * @param proto [IN] "NFSv3", "NFSv4", "NLM4" or "MNT"
+ * @param op    [IN] op name as reported by GetFastOPS, or "COMPOUND"
+ *
+ * @return the histograms or NULL if the op is unknown
+ */
+
+struct op_hists *server_stats_op_hists(const char *proto, const char *op)
+{
+	if (strcmp(proto, "NFSv3") == 0)
+		return find_op_hists(optabv3, v3_hists, NFS_V3_NB_COMMAND, op);
+	if (strcmp(proto, "NFSv4") == 0) {
+		if (strcmp(op, "COMPOUND") == 0)
+			return &compound_hists;
+		return find_op_hists(optabv4, v4_hists, NFS4_OP_LAST_ONE, op);
+	}
+	if (strcmp(proto, "NLM4") == 0)
+		return find_op_hists(optnlm, nlm_hists, NLM_V4_NB_OPERATION,
+				     op);
+	if (strcmp(proto, "MNT") == 0)
+		return find_op_hists(optmnt, mnt_hists, MNT_V3_NB_COMMAND, op);
+	return NULL;
+}
+
+/**
+ * @brief Report the global latency and queue wait histograms of an op
+ *
+ * Latencies are in nsecs.  NFSv4 ops other than COMPOUND have no
+ * queue wait of their own, it is charged to the compound.
+ */
+
+void server_dbus_op_latency(struct op_hists *oh, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	struct hist_summary *hs = gsh_calloc(2, sizeof(struct hist_summary));
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	merge_hist(&hs[0], oh->latency);
+	merge_hist(&hs[1], oh->qwait);
+	server_dbus_hist(&hs[0], iter);
+	server_dbus_hist(&hs[1], iter);
+	gsh_free(hs);
+}
+
+static void merge_xfer_hists(struct hist_summary *hs, struct xfer_op *read,
+			     struct xfer_op *write)
+{
+	merge_hist(&hs[0], read->lat_hist);
+	merge_hist(&hs[1], read->size_hist);
+	merge_hist(&hs[2], write->lat_hist);
+	merge_hist(&hs[3], write->size_hist);
+}
+
+/**
+ * @brief Report read/write latency and size histograms
+ *
+ * All protocol versions and shards are merged.  Reports read latency,
+ * read size, write latency and write size, in that order.
+ *
+ * @param st    [IN] export or client stats
+ * @param iter  [IN] interator in reply stream to fill
+ */
+
+void server_dbus_io_hists(struct gsh_stats *st, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	struct hist_summary *hs = gsh_calloc(4, sizeof(struct hist_summary));
+	uint32_t i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	for (i = 0; i < block_shards; i++) {
+		if (st->nfsv3 != NULL)
+			merge_xfer_hists(hs, &st->nfsv3[i].read,
+					 &st->nfsv3[i].write);
+		if (st->nfsv40 != NULL)
+			merge_xfer_hists(hs, &st->nfsv40[i].read,
+					 &st->nfsv40[i].write);
+		if (st->nfsv41 != NULL)
+			merge_xfer_hists(hs, &st->nfsv41[i].read,
+					 &st->nfsv41[i].write);
+		if (st->nfsv42 != NULL)
+			merge_xfer_hists(hs, &st->nfsv42[i].read,
+					 &st->nfsv42[i].write);
+#ifdef _USE_9P
+		if (st->_9p != NULL)
+			merge_xfer_hists(hs, &st->_9p[i].read,
+					 &st->_9p[i].write);
+#endif
+	}
+	for (i = 0; i < 4; i++)
+		server_dbus_hist(&hs[i], iter);
+	gsh_free(hs);
+}
+
 #endif				/* USE_DBUS */
 
+/**
+ * @brief Initialize server statistics
+ *
+ * Size the histogram shards to the CPUs we may run on.
+ */
+
+void server_stats_init(void)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+	if (ncpus < 1)
+		ncpus = 1;
+	stats_shards = MIN(ncpus, STATS_MAX_SHARDS);
+	if (nfs_param.core_param.shard_client_stats)
+		block_shards = stats_shards;
+}
+
+/**
+ * @brief Sum the NFSv4.1 READs counted in an export or client
+ *
+ * @param st [IN] export or client stats
+ *
+ * @return The count over all shards.
+ */
+
+uint64_t server_stats_v41_reads(struct gsh_stats *st)
+{
+	uint64_t total = 0;
+	uint32_t i;
+
+	if (st->nfsv41 == NULL)
+		return 0;
+	for (i = 0; i < block_shards; i++)
+		total += atomic_fetch_uint64_t(&st->nfsv41[i].read.cmd.total);
+	return total;
+}
+
+/**
+ * @brief Sum the global count of an NFSv4 operation
+ *
+ * @param proto_op [IN] the operation
+ *
+ * @return The count over all shards.
+ */
+
+uint64_t server_stats_v4_op_total(int proto_op)
+{
+	uint64_t total = 0;
+	uint32_t i;
+
+	for (i = 0; i < stats_shards; i++)
+		total += atomic_fetch_uint64_t(&global_st[i].v4.op[proto_op]);
+	return total;
+}
+
+static void free_xfer_hists(struct xfer_op *iop)
+{
+	free_hist(&iop->lat_hist);
+	free_hist(&iop->size_hist);
+}
+
 /**
  * @brief Free statistics storage
  *
@@ -2082,7 +2969,13 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 
 void server_stats_free(struct gsh_stats *statsp)
 {
+	uint32_t i;
+
 	if (statsp->nfsv3 != NULL) {
+		for (i = 0; i < block_shards; i++) {
+			free_xfer_hists(&statsp->nfsv3[i].read);
+			free_xfer_hists(&statsp->nfsv3[i].write);
+		}
 		gsh_free(statsp->nfsv3);
 		statsp->nfsv3 = NULL;
 	}
@@ -2099,14 +2992,26 @@ void server_stats_free(struct gsh_stats *statsp)
 		statsp->rquota = NULL;
 	}
 	if (statsp->nfsv40 != NULL) {
+		for (i = 0; i < block_shards; i++) {
+			free_xfer_hists(&statsp->nfsv40[i].read);
+			free_xfer_hists(&statsp->nfsv40[i].write);
+		}
 		gsh_free(statsp->nfsv40);
 		statsp->nfsv40 = NULL;
 	}
 	if (statsp->nfsv41 != NULL) {
+		for (i = 0; i < block_shards; i++) {
+			free_xfer_hists(&statsp->nfsv41[i].read);
+			free_xfer_hists(&statsp->nfsv41[i].write);
+		}
 		gsh_free(statsp->nfsv41);
 		statsp->nfsv41 = NULL;
 	}
 	if (statsp->nfsv42 != NULL) {
+		for (i = 0; i < block_shards; i++) {
+			free_xfer_hists(&statsp->nfsv42[i].read);
+			free_xfer_hists(&statsp->nfsv42[i].write);
+		}
 		gsh_free(statsp->nfsv42);
 		statsp->nfsv42 = NULL;
 	}
@@ -2114,9 +3019,15 @@ void server_stats_free(struct gsh_stats *statsp)
 	if (statsp->_9p != NULL) {
 		u8 opc;
 
-		for (opc = 0; opc <= _9P_RWSTAT; opc++) {
-			if (statsp->_9p->opcodes[opc] != NULL)
-				gsh_free(statsp->_9p->opcodes[opc]);
+		for (i = 0; i < block_shards; i++) {
+			struct _9p_stats *sp = &statsp->_9p[i];
+
+			for (opc = 0; opc <= _9P_RWSTAT; opc++) {
+				if (sp->opcodes[opc] != NULL)
+					gsh_free(sp->opcodes[opc]);
+			}
+			free_xfer_hists(&sp->read);
+			free_xfer_hists(&sp->write);
 		}
 		gsh_free(statsp->_9p);
 		statsp->_9p = NULL;
@@ -0,0 +1,282 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Lookup throughput of the generic hashtable.
+ *
+ * Two tables holding the same keys are built, one locked as before
+ * and one with HT_FLAG_RCU.  Worker threads look up random keys the
+ * way the SAL does, taking a read latch and releasing it, while one
+ * more thread keeps inserting and deleting other keys.  The lookups/s
+ * of each table are printed at 1 to the most threads.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "abstract_atomic.h"
+#include "hashtable.h"
+#include "gsh_config.h"
+
+/* The server configuration logging reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+
+/* command line syntax */
+
+char options[] = "d:t:k:h?";
+char usage[] =
+	"Usage: ht_bench [-d seconds] [-t threads] [-k keys]\n"
+	"\n"
+	"  -d seconds - length of each run (default 2)\n"
+	"  -t threads - most reader threads (default 64)\n"
+	"  -k keys    - entries in each table (default 100000)\n";
+
+int duration = 2;
+int max_threads = 64;
+uint64_t nkeys = 100000;
+
+uint64_t *keys;
+
+struct reader {
+	pthread_t thread;
+	struct hash_table *ht;
+	unsigned int seed;
+	uint32_t *stop;
+	uint64_t lookups;
+} __attribute__((aligned(64)));
+
+static double now_secs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint32_t key_index(struct hash_param *hparam, struct gsh_buffdesc *key)
+{
+	return *(uint64_t *)key->addr % hparam->index_size;
+}
+
+static uint64_t key_hash(struct hash_param *hparam, struct gsh_buffdesc *key)
+{
+	/* what the SAL tables feed the tree: an already mixed value */
+	return *(uint64_t *)key->addr * 0xff51afd7ed558ccdULL;
+}
+
+static int key_compare(struct gsh_buffdesc *k1, struct gsh_buffdesc *k2)
+{
+	return *(uint64_t *)k1->addr != *(uint64_t *)k2->addr;
+}
+
+static int key_free(struct gsh_buffdesc key, struct gsh_buffdesc val)
+{
+	return 1;
+}
+
+static struct hash_table *make_table(const char *name, uint32_t flags)
+{
+	struct hash_param hparam;
+	struct hash_table *ht;
+	uint64_t i;
+
+	memset(&hparam, 0, sizeof(hparam));
+	hparam.flags = flags;
+	hparam.index_size = 17;
+	hparam.hash_func_key = key_index;
+	hparam.hash_func_rbt = key_hash;
+	hparam.compare_key = key_compare;
+	hparam.ht_name = (char *)name;
+	hparam.ht_log_component = COMPONENT_HASHTABLE;
+
+	ht = hashtable_init(&hparam);
+	if (ht == NULL) {
+		fprintf(stderr, "Unable to create table %s\n", name);
+		exit(1);
+	}
+
+	for (i = 0; i < nkeys; i++) {
+		struct gsh_buffdesc key = { &keys[i], sizeof(keys[i]) };
+		struct gsh_buffdesc val = { &keys[i], sizeof(keys[i]) };
+
+		if (HashTable_Set(ht, &key, &val) != HASHTABLE_SUCCESS) {
+			fprintf(stderr, "Unable to fill table %s\n", name);
+			exit(1);
+		}
+	}
+
+	return ht;
+}
+
+static void *reader(void *arg)
+{
+	struct reader *r = arg;
+	struct hash_latch latch;
+	struct gsh_buffdesc key, val;
+	uint64_t n = 0;
+
+	key.len = sizeof(uint64_t);
+	while (!atomic_fetch_uint32_t(r->stop)) {
+		key.addr = &keys[rand_r(&r->seed) % nkeys];
+		if (hashtable_getlatch(r->ht, &key, &val, false, &latch) ==
+		    HASHTABLE_SUCCESS)
+			n++;
+		hashtable_releaselatched(r->ht, &latch);
+	}
+
+	r->lookups = n;
+	return NULL;
+}
+
+struct writer {
+	struct hash_table *ht;
+	uint32_t *stop;
+};
+
+static void *writer(void *arg)
+{
+	struct writer *w = arg;
+	uint64_t k = nkeys;
+	struct gsh_buffdesc key = { &k, sizeof(k) };
+	struct gsh_buffdesc val = { &k, sizeof(k) };
+
+	while (!atomic_fetch_uint32_t(w->stop)) {
+		k = nkeys + (k + 1) % nkeys;
+		(void)HashTable_Set(w->ht, &key, &val);
+		(void)HashTable_Del(w->ht, &key, NULL, NULL);
+	}
+
+	return NULL;
+}
+
+static double run(struct hash_table *ht, int nthreads)
+{
+	struct reader *readers = calloc(nthreads, sizeof(*readers));
+	struct writer w;
+	pthread_t churn;
+	uint32_t stop = 0;
+	uint64_t total = 0;
+	double start;
+	int i;
+
+	if (readers == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	w.ht = ht;
+	w.stop = &stop;
+	start = now_secs();
+
+	for (i = 0; i < nthreads; i++) {
+		readers[i].ht = ht;
+		readers[i].seed = i + 1;
+		readers[i].stop = &stop;
+		if (pthread_create(&readers[i].thread, NULL, reader,
+				   &readers[i]) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			exit(1);
+		}
+	}
+	if (pthread_create(&churn, NULL, writer, &w) != 0) {
+		fprintf(stderr, "pthread_create failed\n");
+		exit(1);
+	}
+
+	sleep(duration);
+	atomic_store_uint32_t(&stop, 1);
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(readers[i].thread, NULL);
+		total += readers[i].lookups;
+	}
+	pthread_join(churn, NULL);
+
+	free(readers);
+	return total / (now_secs() - start);
+}
+
+int main(int argc, char **argv)
+{
+	struct hash_table *locked_ht, *rcu_ht;
+	double locked, rcu;
+	uint64_t i;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, options)) != EOF) {
+		switch (opt) {
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'k':
+			nkeys = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			fputs(usage, stderr);
+			return opt == 'h' || opt == '?' ? 0 : 1;
+		}
+	}
+
+	if (max_threads <= 0)
+		max_threads = 1;
+	if (nkeys == 0)
+		nkeys = 1;
+
+	keys = calloc(nkeys, sizeof(*keys));
+	if (keys == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < nkeys; i++)
+		keys[i] = i;
+
+	locked_ht = make_table("locked", HT_FLAG_CACHE);
+	rcu_ht = make_table("rcu", HT_FLAG_CACHE | HT_FLAG_RCU);
+
+	printf("%8s %15s %15s %9s\n", "threads", "locked/s", "rcu/s", "ratio");
+
+	for (n = 1; ; n *= 2) {
+		if (n > max_threads)
+			n = max_threads;
+
+		locked = run(locked_ht, n);
+		rcu = run(rcu_ht, n);
+
+		printf("%8d %15.0f %15.0f %9.2f\n", n, locked, rcu,
+		       locked > 0 ? rcu / locked : 0.0);
+
+		if (n == max_threads)
+			break;
+	}
+
+	hashtable_destroy(locked_ht, key_free);
+	hashtable_destroy(rcu_ht, key_free);
+	free(keys);
+	return 0;
+}
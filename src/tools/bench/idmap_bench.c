@@ -0,0 +1,224 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Throughput of fattr4 encoding with owner and owner_group.
+ *
+ * The idmapper cache is filled with user and group names for a range
+ * of IDs, then worker threads encode fattr4s the way READDIR does,
+ * first with type, mode and size only, then with owner and
+ * owner_group added.  The fattr4s/s of each run and the cost of the
+ * owner and group strings per entry are printed at 1 to the most
+ * threads.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "abstract_atomic.h"
+#include "nfs_core.h"
+#include "nfs_proto_tools.h"
+#include "idmapper.h"
+
+/* The server configuration the idmapper reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+
+/* command line syntax */
+
+char options[] = "d:t:n:h?";
+char usage[] =
+	"Usage: idmap_bench [-d seconds] [-t threads] [-n ids]\n"
+	"\n"
+	"  -d seconds - length of each run (default 2)\n"
+	"  -t threads - most worker threads (default 8)\n"
+	"  -n ids     - users and groups in the cache (default 10000)\n";
+
+#define BASE_ID 100000
+
+int duration = 2;
+int max_threads = 8;
+uint32_t nids = 10000;
+
+struct bitmap4 basic_bitmap;
+struct bitmap4 owner_bitmap;
+
+struct worker {
+	pthread_t thread;
+	struct bitmap4 *bitmap;
+	unsigned int seed;
+	uint32_t *stop;
+	uint64_t encodes;
+} __attribute__((aligned(64)));
+
+static double now_secs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	struct attrlist attrs;
+	struct xdr_attrs_args args;
+	fattr4 fattr;
+	char buf[NFS4_ATTRVALS_BUFFLEN];
+	uint64_t n = 0;
+
+	memset(&attrs, 0, sizeof(attrs));
+	attrs.type = REGULAR_FILE;
+	attrs.mode = 0644;
+	attrs.filesize = 4096;
+
+	memset(&args, 0, sizeof(args));
+	args.attrs = &attrs;
+
+	while (!atomic_fetch_uint32_t(w->stop)) {
+		uint32_t id = BASE_ID + rand_r(&w->seed) % nids;
+
+		attrs.owner = id;
+		attrs.group = id;
+		if (nfs4_FSALattr_To_Fattr_buf(&args, w->bitmap, &fattr, buf,
+					       sizeof(buf)) == 0)
+			n++;
+	}
+
+	w->encodes = n;
+	return NULL;
+}
+
+static double run(struct bitmap4 *bitmap, int nthreads)
+{
+	struct worker *workers = calloc(nthreads, sizeof(*workers));
+	uint32_t stop = 0;
+	uint64_t total = 0;
+	double start;
+	int i;
+
+	if (workers == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	start = now_secs();
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].bitmap = bitmap;
+		workers[i].seed = i + 1;
+		workers[i].stop = &stop;
+		if (pthread_create(&workers[i].thread, NULL, worker,
+				   &workers[i]) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			exit(1);
+		}
+	}
+
+	sleep(duration);
+	atomic_store_uint32_t(&stop, 1);
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].encodes;
+	}
+
+	free(workers);
+	return total / (now_secs() - start);
+}
+
+int main(int argc, char **argv)
+{
+	char name[64];
+	struct gsh_buffdesc desc;
+	double basic, owner;
+	uint32_t id;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, options)) != EOF) {
+		switch (opt) {
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'n':
+			nids = atoi(optarg);
+			break;
+		default:
+			fputs(usage, stderr);
+			return opt == 'h' || opt == '?' ? 0 : 1;
+		}
+	}
+
+	if (max_threads <= 0)
+		max_threads = 1;
+	if (nids == 0)
+		nids = 1;
+
+	memset(&basic_bitmap, 0, sizeof(basic_bitmap));
+	set_attribute_in_bitmap(&basic_bitmap, FATTR4_TYPE);
+	set_attribute_in_bitmap(&basic_bitmap, FATTR4_SIZE);
+	set_attribute_in_bitmap(&basic_bitmap, FATTR4_MODE);
+
+	owner_bitmap = basic_bitmap;
+	set_attribute_in_bitmap(&owner_bitmap, FATTR4_OWNER);
+	set_attribute_in_bitmap(&owner_bitmap, FATTR4_OWNER_GROUP);
+
+	/* names of a typical length, whatever the password database says */
+	idmapper_cache_init();
+	desc.addr = name;
+	for (id = BASE_ID; id < BASE_ID + nids; id++) {
+		desc.len = snprintf(name, sizeof(name), "user%u@localdomain",
+				    id);
+		idmapper_cache_set(IDMAPPER_UID, &desc, id, NULL, false);
+		desc.len = snprintf(name, sizeof(name), "group%u@localdomain",
+				    id);
+		idmapper_cache_set(IDMAPPER_GID, &desc, id, NULL, false);
+	}
+
+	printf("%8s %15s %15s %15s\n",
+	       "threads", "basic/s", "owner/s", "ns/owner+group");
+
+	for (n = 1; ; n *= 2) {
+		if (n > max_threads)
+			n = max_threads;
+
+		basic = run(&basic_bitmap, n);
+		owner = run(&owner_bitmap, n);
+
+		printf("%8d %15.0f %15.0f %15.1f\n", n, basic, owner,
+		       owner > 0 && basic > 0 ?
+		       (1e9 / owner - 1e9 / basic) * n : 0.0);
+
+		if (n == max_threads)
+			break;
+	}
+
+	idmapper_clear_cache();
+	return 0;
+}
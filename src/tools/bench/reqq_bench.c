@@ -0,0 +1,234 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Throughput of the request queues.
+ *
+ * Workers take requests with nfs_rpc_dequeue_req and queue each one
+ * again straight away, so a fixed set of requests circulates through
+ * the queues.  The requests are spread over the MOUNT, CALL, low and
+ * high latency queues.  Each Dispatch_Shard_By mode is run at various
+ * thread counts and the dequeues/s printed.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "nfs_core.h"
+#include "nfs_req_queue.h"
+#include "fridgethr.h"
+#include "gsh_config.h"
+
+/* command line syntax */
+
+char options[] = "d:t:r:h?";
+char usage[] =
+	"Usage: reqq_bench [-d seconds] [-t threads] [-r requests]\n"
+	"\n"
+	"  -d seconds  - length of each run (default 2)\n"
+	"  -t threads  - most worker threads (default: number of CPUs)\n"
+	"  -r requests - requests circulating through the queues\n"
+	"                (default 1024)\n";
+
+int duration = 2;
+int max_threads;
+int nreqs = 1024;
+
+uint64_t dequeues;
+
+static double now_secs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void worker_init(struct fridgethr_context *ctx)
+{
+	init_wait_q_entry(&ctx->wd.wqe);
+}
+
+static void worker(struct fridgethr_context *ctx)
+{
+	request_data_t *reqdata;
+	uint64_t n = 0;
+
+	while (!fridgethr_you_should_break(ctx)) {
+		reqdata = nfs_rpc_dequeue_req(&ctx->wd);
+		if (reqdata == NULL)
+			continue;
+		n++;
+		nfs_rpc_enqueue_req(reqdata);
+	}
+
+	(void)atomic_add_uint64_t(&dequeues, n);
+}
+
+/* Class of the ix'th request: one in eight is a MOUNT or a CALL, the
+ * rest are split between the low and high latency queues */
+static void make_req(request_data_t *reqdata, int ix)
+{
+	reqdata->rtype = NFS_REQUEST;
+	switch (ix % 8) {
+	case 0:
+		reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_MOUNT;
+		break;
+	case 1:
+		reqdata->rtype = NFS_CALL;
+		break;
+	case 2:
+	case 3:
+	case 4:
+		reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_READ;
+		break;
+	default:
+		reqdata->r_u.req.lookahead.flags = NFS_LOOKAHEAD_LOOKUP;
+		break;
+	}
+}
+
+/* Empty the queues, once no worker runs, so the requests can be freed
+ * without leaving them linked in a shard */
+static void drain(void)
+{
+	struct fridgethr_context ctx;
+	uint32_t queued, ix;
+
+	memset(&ctx, 0, sizeof(ctx));
+	init_wait_q_entry(&ctx.wd.wqe);
+
+	for (;;) {
+		queued = 0;
+		for (ix = 0; ix < nfs_req_st.reqs.nshards; ix++)
+			queued += atomic_fetch_uint32_t(
+					&nfs_req_st.reqs.shards[ix].size);
+		if (queued == 0)
+			break;
+		(void)nfs_rpc_dequeue_req(&ctx.wd);
+	}
+}
+
+static double run(dispatch_shard_by_t mode, int nthreads)
+{
+	struct fridgethr_params frp;
+	struct fridgethr *fr = NULL;
+	request_data_t *reqs;
+	double start, secs;
+	int ix, rc;
+
+	/* Fresh, empty queues for each run */
+	nfs_rpc_queue_shards_init(mode);
+	reqs = gsh_calloc(nreqs, sizeof(request_data_t));
+	dequeues = 0;
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = nthreads;
+	frp.thr_min = nthreads;
+	frp.flavor = fridgethr_flavor_looper;
+	frp.thread_initialize = worker_init;
+	frp.wake_threads = nfs_rpc_queue_awaken;
+	frp.wake_threads_arg = &nfs_req_st;
+
+	start = now_secs();
+
+	rc = fridgethr_init(&fr, "QBench", &frp);
+	if (rc == 0)
+		rc = fridgethr_populate(fr, worker, NULL);
+	if (rc != 0) {
+		fprintf(stderr, "Unable to start workers: %d\n", rc);
+		exit(1);
+	}
+
+	for (ix = 0; ix < nreqs; ix++) {
+		make_req(&reqs[ix], ix);
+		nfs_rpc_enqueue_req(&reqs[ix]);
+	}
+
+	sleep(duration);
+
+	rc = fridgethr_sync_command(fr, fridgethr_comm_stop, 120);
+	if (rc != 0) {
+		fprintf(stderr, "Unable to stop workers: %d\n", rc);
+		exit(1);
+	}
+	fridgethr_destroy(fr);
+	secs = now_secs() - start;
+
+	drain();
+	gsh_free(reqs);
+
+	return dequeues / secs;
+}
+
+int main(int argc, char **argv)
+{
+	double none, node, cpu;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, options)) != EOF) {
+		switch (opt) {
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'r':
+			nreqs = atoi(optarg);
+			break;
+		default:
+			fputs(usage, stderr);
+			return opt == 'h' || opt == '?' ? 0 : 1;
+		}
+	}
+
+	if (max_threads <= 0)
+		max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (max_threads <= 0)
+		max_threads = 1;
+
+	printf("%8s %15s %15s %15s\n",
+	       "threads", "single/s", "per node/s", "per CPU/s");
+
+	for (n = 1; ; n *= 2) {
+		if (n > max_threads)
+			n = max_threads;
+
+		none = run(DISPATCH_SHARD_NONE, n);
+		node = run(DISPATCH_SHARD_NODE, n);
+		cpu = run(DISPATCH_SHARD_CPU, n);
+
+		printf("%8d %15.0f %15.0f %15.0f\n", n, none, node, cpu);
+
+		if (n == max_threads)
+			break;
+	}
+
+	nfs_rpc_queue_shards_init(DISPATCH_SHARD_NONE);
+	return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Throughput of the server statistics recording path.
+ *
+ * Worker threads replay the stats calls of a small NFSv4.1 compound
+ * (PUTFH, READ) against one export and one client, first without any
+ * stats calls, then with FASTSTATS, then with full stats.  The ops/s
+ * of each run are printed so the cost of stats can be compared at
+ * various thread counts.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "abstract_atomic.h"
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "client_mgr.h"
+#include "server_stats.h"
+#include "server_stats_private.h"
+#include "fsal.h"
+
+/* The server configuration the stats code reads, normally the daemon's */
+nfs_parameter_t nfs_param;
+
+/* command line syntax */
+
+char options[] = "d:t:sh?";
+char usage[] =
+	"Usage: stats_bench [-d seconds] [-t threads] [-s]\n"
+	"\n"
+	"  -d seconds - length of each run (default 2)\n"
+	"  -t threads - most worker threads (default: number of CPUs)\n"
+	"  -s         - shard the export and client stats per CPU\n";
+
+enum stats_mode { STATS_NONE, STATS_FAST, STATS_FULL };
+
+int duration = 2;
+int max_threads;
+
+struct export_stats *exp_stats;
+struct server_stats *cl_stats;
+
+struct worker {
+	pthread_t thread;
+	enum stats_mode mode;
+	uint32_t *stop;
+	uint64_t compounds;
+} __attribute__((aligned(64)));
+
+static double now_secs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	struct req_op_context req_ctx;
+	struct user_cred user_credentials;
+	uint64_t n = 0;
+
+	memset(&user_credentials, 0, sizeof(user_credentials));
+	memset(&req_ctx, 0, sizeof(req_ctx));
+	req_ctx.ctx_export = &exp_stats->export;
+	req_ctx.creds = &user_credentials;
+	req_ctx.client = &cl_stats->client;
+	req_ctx.req_type = NFS_REQUEST;
+	req_ctx.nfs_vers = NFS_V4;
+	req_ctx.nfs_minorvers = 1;
+	req_ctx.queue_wait = 1000;
+	op_ctx = &req_ctx;
+
+	while (!atomic_fetch_uint32_t(w->stop)) {
+		if (w->mode != STATS_NONE) {
+			server_stats_nfsv4_op_done(NFS4_OP_PUTFH, 0, NFS4_OK);
+			server_stats_io_done(4096, 4096, true, false);
+			server_stats_nfsv4_op_done(NFS4_OP_READ, 0, NFS4_OK);
+			server_stats_compound_done(2, NFS4_OK);
+		}
+		n++;
+	}
+
+	w->compounds = n;
+	op_ctx = NULL;
+	return NULL;
+}
+
+static double run(enum stats_mode mode, int nthreads)
+{
+	struct worker *workers = calloc(nthreads, sizeof(*workers));
+	uint32_t stop = 0;
+	uint64_t total = 0;
+	double start;
+	int i;
+
+	if (workers == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	nfs_param.core_param.enable_FASTSTATS = mode == STATS_FAST;
+	start = now_secs();
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].mode = mode;
+		workers[i].stop = &stop;
+		if (pthread_create(&workers[i].thread, NULL, worker,
+				   &workers[i]) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			exit(1);
+		}
+	}
+
+	sleep(duration);
+	atomic_store_uint32_t(&stop, 1);
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].compounds;
+	}
+
+	free(workers);
+	return total / (now_secs() - start);
+}
+
+int main(int argc, char **argv)
+{
+	double none, fast, full;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, options)) != EOF) {
+		switch (opt) {
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			nfs_param.core_param.shard_client_stats = true;
+			break;
+		default:
+			fputs(usage, stderr);
+			return opt == 'h' || opt == '?' ? 0 : 1;
+		}
+	}
+
+	if (max_threads <= 0)
+		max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (max_threads <= 0)
+		max_threads = 1;
+
+	server_stats_init();
+
+	exp_stats = calloc(1, sizeof(*exp_stats));
+	cl_stats = calloc(1, sizeof(*cl_stats));
+	if (exp_stats == NULL || cl_stats == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	pthread_rwlock_init(&exp_stats->export.lock, NULL);
+	pthread_rwlock_init(&cl_stats->client.lock, NULL);
+
+	printf("%8s %15s %15s %15s %9s\n",
+	       "threads", "no stats/s", "faststats/s", "full stats/s",
+	       "full %");
+
+	for (n = 1; ; n *= 2) {
+		if (n > max_threads)
+			n = max_threads;
+
+		none = run(STATS_NONE, n);
+		fast = run(STATS_FAST, n);
+		full = run(STATS_FULL, n);
+
+		printf("%8d %15.0f %15.0f %15.0f %8.1f%%\n",
+		       n, none, fast, full,
+		       none > 0 ? 100.0 * full / none : 0.0);
+
+		if (n == max_threads)
+			break;
+	}
+
+	server_stats_free(&exp_stats->st);
+	server_stats_free(&cl_stats->st);
+	free(exp_stats);
+	free(cl_stats);
+	return 0;
+}
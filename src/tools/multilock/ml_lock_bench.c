@@ -0,0 +1,292 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Byte range lock throughput versus number of locks held on the file.
+ *
+ * One open file description holds an increasing number of one byte write
+ * locks, spaced so they can not merge.  At each step a second open file
+ * description (a different lock owner) runs timed LOCK/UNLOCK pairs in
+ * the gaps between held locks, and timed TEST calls that conflict with a
+ * held lock.  The time to add the held locks for the step is also shown,
+ * so servers with linear lock lists show up as falling throughput and
+ * quadratic setup time.
+ */
+
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "multilock.h"
+
+/* command line syntax */
+
+char options[] = "c:n:o:s:ph?";
+char usage[] =
+	"Usage: ml_lock_bench [-c path] [-n maxlocks] [-o ops] [-s seed] [-p] file\n"
+	"\n"
+	"  -c path     - chdir\n"
+	"  -n maxlocks - largest number of locks held (default 65536)\n"
+	"  -o ops      - timed operations per step (default 10000)\n"
+	"  -s seed     - random seed\n"
+	"  -p          - use a child process instead of OFD locks for the\n"
+	"                second lock owner\n"
+	"  file        - file to lock, created if necessary\n";
+
+long int max_locks = 65536;
+long int num_ops = 10000;
+bool posix_child;
+
+static double now_secs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void do_fcntl(int fd, int cmd, short type, off_t start, off_t len)
+{
+	struct flock lock;
+
+	memset(&lock, 0, sizeof(lock));
+	lock.l_whence = SEEK_SET;
+	lock.l_type = type;
+	lock.l_start = start;
+	lock.l_len = len;
+
+	if (posix_child)
+		cmd = cmd == F_OFD_GETLK ? F_GETLK : F_SETLK;
+
+	if (fcntl(fd, cmd, &lock) == -1)
+		fatal("fcntl %d type %d start %lld len %lld failed errno = %d \"%s\"\n",
+		      cmd, (int) type, (long long) start, (long long) len,
+		      errno, strerror(errno));
+
+	if (cmd == F_OFD_GETLK || cmd == F_GETLK) {
+		if (lock.l_type == F_UNLCK)
+			fatal("Test at %lld found no conflict\n",
+			      (long long) start);
+	}
+}
+
+/* Add held locks at even offsets until count are held */
+static double hold_locks(int fd, long int held, long int count)
+{
+	double start = now_secs();
+	long int i;
+
+	for (i = held; i < count; i++)
+		do_fcntl(fd, F_OFD_SETLK, F_WRLCK, i * 2, 1);
+
+	return now_secs() - start;
+}
+
+/* Time num_ops LOCK/UNLOCK pairs and num_ops TESTs against count locks */
+static void measure(int fd, long int count, double *lock_rate,
+		    double *test_rate)
+{
+	double start, elapsed;
+	long int i;
+	off_t off;
+
+	start = now_secs();
+
+	for (i = 0; i < num_ops; i++) {
+		/* Odd offsets are free */
+		off = (random() % (count + 1)) * 2 + 1;
+		do_fcntl(fd, F_OFD_SETLK, F_WRLCK, off, 1);
+		do_fcntl(fd, F_OFD_SETLK, F_UNLCK, off, 1);
+	}
+
+	elapsed = now_secs() - start;
+	*lock_rate = elapsed > 0 ? num_ops / elapsed : 0;
+
+	*test_rate = 0;
+	if (count == 0)
+		return;
+
+	start = now_secs();
+
+	for (i = 0; i < num_ops; i++) {
+		/* Even offsets below count * 2 are held */
+		off = (random() % count) * 2;
+		do_fcntl(fd, F_OFD_GETLK, F_RDLCK, off, 1);
+	}
+
+	elapsed = now_secs() - start;
+	*test_rate = elapsed > 0 ? num_ops / elapsed : 0;
+}
+
+/* With -p the held locks are set by a child, driven over a pipe */
+static int child_pipe[2];
+static int done_pipe[2];
+static pid_t child;
+
+static void child_hold(const char *file)
+{
+	long int count, held = 0;
+	double secs;
+	int fd;
+
+	close(child_pipe[1]);
+	close(done_pipe[0]);
+
+	fd = open(file, O_RDWR);
+	if (fd == -1)
+		fatal("Child could not open %s errno = %d \"%s\"\n",
+		      file, errno, strerror(errno));
+
+	while (read(child_pipe[0], &count, sizeof(count)) == sizeof(count)) {
+		secs = hold_locks(fd, held, count);
+		held = count;
+		if (write(done_pipe[1], &secs, sizeof(secs)) != sizeof(secs))
+			break;
+	}
+
+	exit(0);
+}
+
+static double hold_locks_child(long int count)
+{
+	double secs;
+
+	if (write(child_pipe[1], &count, sizeof(count)) != sizeof(count) ||
+	    read(done_pipe[0], &secs, sizeof(secs)) != sizeof(secs))
+		fatal("Lost contact with child errno = %d \"%s\"\n",
+		      errno, strerror(errno));
+
+	return secs;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, fd_held = -1, fd_test;
+	long int count, held = 0;
+	double setup, lock_rate, test_rate;
+	unsigned int seed = time(NULL);
+	const char *file;
+
+	input = stdin;
+	output = stdout;
+
+	while ((opt = getopt(argc, argv, options)) != EOF) {
+		switch (opt) {
+		case 'c':
+			if (chdir(optarg) == -1)
+				fatal("Can not change dir to %s errno = %d \"%s\"\n",
+				      optarg, errno, strerror(errno));
+			break;
+
+		case 'n':
+			max_locks = atol(optarg);
+			break;
+
+		case 'o':
+			num_ops = atol(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		case 'p':
+			posix_child = true;
+			break;
+
+		case '?':
+		case 'h':
+		default:
+			/* display the help */
+			show_usage(0, "Help\n");
+		}
+	}
+
+	if (optind != argc - 1)
+		show_usage(1, "Must specify a file\n");
+
+	if (max_locks < 1 || num_ops < 1)
+		show_usage(1, "maxlocks and ops must be positive\n");
+
+	file = argv[optind];
+	srandom(seed);
+
+	fd_test = open(file, O_RDWR | O_CREAT, 0666);
+	if (fd_test == -1)
+		fatal("Could not open %s errno = %d \"%s\"\n",
+		      file, errno, strerror(errno));
+
+	if (posix_child) {
+		if (pipe(child_pipe) == -1 || pipe(done_pipe) == -1)
+			fatal("pipe failed errno = %d \"%s\"\n",
+			      errno, strerror(errno));
+
+		child = fork();
+		if (child == -1)
+			fatal("fork failed errno = %d \"%s\"\n",
+			      errno, strerror(errno));
+		if (child == 0)
+			child_hold(file);
+
+		close(child_pipe[0]);
+		close(done_pipe[1]);
+	} else {
+		fd_held = open(file, O_RDWR);
+		if (fd_held == -1)
+			fatal("Could not open %s errno = %d \"%s\"\n",
+			      file, errno, strerror(errno));
+	}
+
+	fprintf(output, "seed %u, %ld ops per step, %s lock owners\n",
+		seed, num_ops, posix_child ? "process" : "OFD");
+	fprintf(output, "%10s %12s %14s %14s\n",
+		"held", "setup secs", "lock+unlock/s", "test/s");
+
+	for (count = 0; ; count = count == 0 ? 1 : count * 4) {
+		if (count > max_locks)
+			count = max_locks;
+
+		if (posix_child)
+			setup = hold_locks_child(count);
+		else
+			setup = hold_locks(fd_held, held, count);
+
+		held = count;
+
+		measure(fd_test, count, &lock_rate, &test_rate);
+
+		fprintf(output, "%10ld %12.3f %14.0f %14.0f\n",
+			count, setup, lock_rate, test_rate);
+		fflush(output);
+
+		if (count == max_locks)
+			break;
+	}
+
+	if (posix_child) {
+		close(child_pipe[1]);
+		waitpid(child, NULL, 0);
+	} else {
+		close(fd_held);
+	}
+
+	close(fd_test);
+
+	return 0;
+}